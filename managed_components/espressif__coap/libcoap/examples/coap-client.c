@@ -326,6 +326,7 @@ event_handler(coap_session_t *session COAP_UNUSED,
     break;
   case COAP_EVENT_DTLS_CONNECTED:
   case COAP_EVENT_DTLS_RENEGOTIATE:
+  case COAP_EVENT_DTLS_RESUMED:
   case COAP_EVENT_DTLS_ERROR:
   case COAP_EVENT_TCP_CONNECTED:
   case COAP_EVENT_TCP_FAILED:
@@ -47,6 +47,7 @@ strndup(const char *s1, size_t n) {
 #include <unistd.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -127,6 +128,12 @@ static coap_proto_t use_unix_proto = COAP_PROTO_NONE;
 static int enable_ws = 0;
 static int ws_port = 80;
 static int wss_port = 443;
+#ifndef _WIN32
+static unsigned int num_shards = 0;
+static coap_shard_steer_t shard_steer = COAP_SHARD_STEER_HASH;
+static pid_t *shard_pids = NULL;
+static unsigned int shard_pid_count = 0;
+#endif /* ! _WIN32 */
 
 static coap_dtls_pki_t *setup_pki(coap_context_t *ctx, coap_dtls_role_t role, char *sni);
 
@@ -626,8 +633,8 @@ static ssize_t user_length = -1;
 
 static size_t proxy_host_name_count = 0;
 static const char **proxy_host_name_list = NULL;
-static coap_proxy_server_list_t forward_proxy = { NULL, 0, 0, COAP_PROXY_FORWARD, 0, 300};
-static coap_proxy_server_list_t reverse_proxy = { NULL, 0, 0, COAP_PROXY_REVERSE_STRIP, 0, 10};
+static coap_proxy_server_list_t forward_proxy = { NULL, 0, 0, COAP_PROXY_FORWARD, 0, 300, 0};
+static coap_proxy_server_list_t reverse_proxy = { NULL, 0, 0, COAP_PROXY_REVERSE_STRIP, 0, 10, 0};
 
 static coap_dtls_cpsk_t *
 setup_cpsk(char *client_sni) {
@@ -1064,6 +1071,7 @@ proxy_event_handler(coap_session_t *session COAP_UNUSED,
   case COAP_EVENT_WS_CLOSED:
   case COAP_EVENT_DTLS_CONNECTED:
   case COAP_EVENT_DTLS_RENEGOTIATE:
+  case COAP_EVENT_DTLS_RESUMED:
   case COAP_EVENT_DTLS_ERROR:
   case COAP_EVENT_TCP_CONNECTED:
   case COAP_EVENT_TCP_FAILED:
@@ -1562,7 +1570,7 @@ usage(const char *program, const char *version) {
           "Usage: %s [-a priority] [-b max_block_size] [-d max] [-e]\n"
           "\t\t[-f scheme://address[:port] [-g group] -l loss] [-p port]\n"
           "\t\t[-q tls_engine_conf_file] [-r] [-v num] [-w [port][,secure_port]]\n"
-          "\t\t[-A address] [-E oscore_conf_file[,seq_file]] [-G group_if]\n"
+          "\t\t[-y shards[,addr]] [-A address] [-E oscore_conf_file[,seq_file]] [-G group_if]\n"
           "\t\t[-L value] [-N] [-P scheme://address[:port],[name1[,name2..]]]\n"
           "\t\t[-T max_token_size] [-U type] [-V num] [-X size]\n"
           "\t\t[[-h hint] [-i match_identity_file] [-k key]\n"
@@ -1612,6 +1620,15 @@ usage(const char *program, const char *version) {
           "\t-w [port][,secure_port]\n"
           "\t       \t\tEnable WebSockets support on port (WS) and/or secure_port\n"
           "\t       \t\t(WSS), comma separated\n"
+          "\t-y shards[,addr]\n"
+          "\t       \t\tRun shards server processes (typically one per core)\n"
+          "\t       \t\tsharing the same ports with SO_REUSEPORT. Each shard\n"
+          "\t       \t\thas its own context (and lock), resource and observe\n"
+          "\t       \t\tstate. Processes rather than threads are used as the\n"
+          "\t       \t\tresource handlers keep their data in unlocked\n"
+          "\t       \t\tglobals. Peers are steered to a shard by address and\n"
+          "\t       \t\tport, or by address only if ',addr' is given (Linux\n"
+          "\t       \t\tonly)\n"
           "\t-A address\tInterface address to bind to\n"
           "\t-E oscore_conf_file[,seq_file]\n"
           "\t       \t\toscore_conf_file contains OSCORE configuration. See\n"
@@ -1758,6 +1775,16 @@ get_context(const char *node, const char *port) {
     return NULL;
   }
 
+#ifndef _WIN32
+  /* Need shards set up before we set up the endpoints */
+  if (num_shards > 1 &&
+      !coap_context_set_shards(ctx, num_shards, shard_steer)) {
+    coap_log_err("sharded server not supported\n");
+    coap_free_context(ctx);
+    return NULL;
+  }
+#endif /* ! _WIN32 */
+
   /* Need PKI/RPK/PSK set up before we set up (D)TLS endpoints */
   fill_keystore(ctx);
 
@@ -2149,6 +2176,77 @@ cmdline_read_identity_check(char *arg) {
   return valid_ids.count > 0;
 }
 
+#ifndef _WIN32
+static int
+cmdline_shards(char *arg) {
+  char *cp = strchr(arg, ',');
+
+  num_shards = (unsigned int)atoi(arg);
+  if (num_shards < 1) {
+    fprintf(stderr, "Number of shards must be at least 1\n");
+    return 0;
+  }
+  if (cp) {
+    if (strcmp(cp + 1, "addr") != 0) {
+      fprintf(stderr, "Unknown shard steering '%s'\n", cp + 1);
+      return 0;
+    }
+    shard_steer = COAP_SHARD_STEER_ADDR;
+  }
+  return 1;
+}
+
+static void
+stop_shards(void) {
+  unsigned int i;
+
+  for (i = 0; i < shard_pid_count; i++) {
+    kill(shard_pids[i], SIGTERM);
+  }
+  for (i = 0; i < shard_pid_count; i++) {
+    waitpid(shard_pids[i], NULL, 0);
+  }
+  free(shard_pids);
+  shard_pids = NULL;
+  shard_pid_count = 0;
+}
+
+/*
+ * Fork off a server process for each additional shard. Each process (this
+ * one included) then sets up its own context with the same resources and
+ * endpoints. The contexts could equally be driven by threads of one process,
+ * but the resource handlers here keep their data (such as
+ * example_data_value and the dynamic resources) in globals without locking.
+ */
+static int
+start_shards(void) {
+  unsigned int i;
+
+  shard_pids = malloc((num_shards - 1) * sizeof(pid_t));
+  if (!shard_pids)
+    return 0;
+  for (i = 1; i < num_shards; i++) {
+    pid_t pid = fork();
+
+    if (pid == -1) {
+      perror("fork");
+      /* Do not leave the shards already started running */
+      stop_shards();
+      return 0;
+    }
+    if (pid == 0) {
+      /* Shard process - does not own the other shards */
+      free(shard_pids);
+      shard_pids = NULL;
+      shard_pid_count = 0;
+      return 1;
+    }
+    shard_pids[shard_pid_count++] = pid;
+  }
+  return 1;
+}
+#endif /* ! _WIN32 */
+
 static int
 cmdline_unix(char *arg) {
   if (!strcmp("coap", arg)) {
@@ -2332,7 +2430,7 @@ main(int argc, char **argv) {
   clock_offset = time(NULL);
 
   while ((opt = getopt(argc, argv,
-                       "a:b:c:d:ef:g:h:i:j:k:l:mnp:q:rs:tu:v:w:A:C:E:G:J:L:M:NP:R:S:T:U:V:X:2")) != -1) {
+                       "a:b:c:d:ef:g:h:i:j:k:l:mnp:q:rs:tu:v:w:y:A:C:E:G:J:L:M:NP:R:S:T:U:V:X:2")) != -1) {
     switch (opt) {
 #ifndef _WIN32
     case 'a':
@@ -2513,6 +2611,14 @@ main(int argc, char **argv) {
     case 'X':
       csm_max_message_size = strtol(optarg, NULL, 10);
       break;
+#ifndef _WIN32
+    case 'y':
+      if (!cmdline_shards(optarg)) {
+        usage(argv[0], LIBCOAP_PACKAGE_VERSION);
+        goto failed;
+      }
+      break;
+#endif /* ! _WIN32 */
     case '2':
       ec_jpake = 1;
       break;
@@ -2548,9 +2654,24 @@ main(int argc, char **argv) {
   coap_set_log_level(log_level);
   coap_dtls_set_log_level(dtls_log_level);
 
+#ifndef _WIN32
+  if (num_shards > 1) {
+    if (track_observes) {
+      fprintf(stderr, "-t cannot be used with -y\n");
+      goto failed;
+    }
+    if (!start_shards())
+      goto failed;
+  }
+#endif /* ! _WIN32 */
+
   ctx = get_context(addr_str, port_str);
-  if (!ctx)
+  if (!ctx) {
+#ifndef _WIN32
+    stop_shards();
+#endif /* ! _WIN32 */
     return -1;
+  }
 
   init_resources(ctx);
   if (mcast_per_resource)
@@ -2742,6 +2863,9 @@ finish:
   /* Clean up library usage */
   coap_free_context(ctx);
   coap_cleanup();
+#ifndef _WIN32
+  stop_shards();
+#endif /* ! _WIN32 */
 
   return exit_code;
 
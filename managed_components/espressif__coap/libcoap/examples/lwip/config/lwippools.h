@@ -107,6 +107,10 @@ typedef struct l_coap_tiny_context_t {
 #define MEMP_NUM_COAPSTRING 12
 #endif
 
+#ifndef MEMP_NUM_COAPWORK
+#define MEMP_NUM_COAPWORK 4
+#endif
+
 #ifndef MEMP_LEN_COAPSTRING
 #ifdef COAP_WS_SUPPORT
 #define MEMP_LEN_COAPSTRING 176
@@ -127,6 +131,14 @@ typedef struct l_coap_tiny_context_t {
 #define MEMP_NUM_COAPCACHE_ENTRIES        (2U)
 #endif /* MEMP_NUM_COAPCACHE_ENTRIES */
 
+#ifndef MEMP_NUM_COAPCACHE_EXPIRE
+#define MEMP_NUM_COAPCACHE_EXPIRE        (1U)
+#endif /* MEMP_NUM_COAPCACHE_EXPIRE */
+
+#ifndef MEMP_NUM_COAPPROXY_EXPIRE
+#define MEMP_NUM_COAPPROXY_EXPIRE        (1U)
+#endif /* MEMP_NUM_COAPPROXY_EXPIRE */
+
 #ifndef MEMP_NUM_COAPPDUBUF
 #define MEMP_NUM_COAPPDUBUF 2
 #endif
@@ -177,11 +189,22 @@ LWIP_MEMPOOL(COAP_OPTLIST, MEMP_NUM_COAPOPTLIST, sizeof(coap_optlist_t)+MEMP_LEN
              "COAP_OPTLIST")
 LWIP_MEMPOOL(COAP_STRING, MEMP_NUM_COAPSTRING, sizeof(coap_string_t)+MEMP_LEN_COAPSTRING,
              "COAP_STRING")
+LWIP_MEMPOOL(COAP_WORK, MEMP_NUM_COAPWORK, sizeof(coap_work_t), "COAP_WORK")
 #ifdef COAP_SERVER_SUPPORT
 LWIP_MEMPOOL(COAP_CACHE_KEY, MEMP_NUM_COAPCACHE_KEYS, sizeof(coap_cache_key_t), "COAP_CACHE_KEY")
 LWIP_MEMPOOL(COAP_CACHE_ENTRY, MEMP_NUM_COAPCACHE_ENTRIES, sizeof(coap_cache_entry_t),
              "COAP_CACHE_ENTRY")
+/* The expiry heap starts at 16 entries and doubles as needed */
+LWIP_MEMPOOL(COAP_CACHE_EXPIRE, MEMP_NUM_COAPCACHE_EXPIRE,
+             2 * sizeof(coap_cache_entry_t *) *
+             (MEMP_NUM_COAPCACHE_ENTRIES < 16 ? 16 : MEMP_NUM_COAPCACHE_ENTRIES),
+             "COAP_CACHE_EXPIRE")
 #endif /* COAP_SERVER_SUPPORT */
+#if COAP_PROXY_SUPPORT
+/* The proxy expiry heap starts at 16 entries, so this allows it to double once */
+LWIP_MEMPOOL(COAP_PROXY_EXPIRE, MEMP_NUM_COAPPROXY_EXPIRE,
+             32 * sizeof(coap_proxy_list_t *), "COAP_PROXY_EXPIRE")
+#endif /* COAP_PROXY_SUPPORT */
 LWIP_MEMPOOL(COAP_PDU_BUF, MEMP_NUM_COAPPDUBUF, MEMP_LEN_COAPPDUBUF, "COAP_PDU_BUF")
 LWIP_MEMPOOL(COAP_LG_XMIT, MEMP_NUM_COAPLGXMIT, sizeof(coap_lg_xmit_t), "COAP_LG_XMIT")
 #ifdef COAP_CLIENT_SUPPORT
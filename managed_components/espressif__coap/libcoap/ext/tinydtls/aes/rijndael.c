@@ -1043,6 +1043,22 @@ rijndaelEncrypt(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 pt[16],
 	PUTU32(ct + 12, s3);
 }
 
+static void
+rijndaelEncryptBlocks(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr,
+    const aes_u8 *pt, aes_u8 *ct, size_t blocks)
+{
+	for (; blocks; blocks--, pt += 16, ct += 16)
+		rijndaelEncrypt(rk, Nr, pt, ct);
+}
+
+/*
+ * The table driven implementation. Its lookups are indexed by key and
+ * data bytes, so its timing depends on the cache state.
+ */
+const rijndael_impl_t rijndael_impl_table = {
+	"table", rijndaelKeySetupEnc, rijndaelEncryptBlocks
+};
+
 #ifdef WITH_AES_DECRYPT
 void
 rijndaelDecrypt(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 ct[16],
@@ -28,6 +28,7 @@
 #ifndef __RIJNDAEL_H
 #define __RIJNDAEL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define AES_MAXKEYBITS	(256)
@@ -42,8 +43,22 @@ typedef uint8_t		aes_u8;
 typedef uint16_t	aes_u16;
 typedef uint32_t	aes_u32;
 
+/*
+ * A block cipher implementation. setup_enc() fills in the encrypt key
+ * schedule in whatever layout encrypt() needs and returns the number of
+ * rounds (0 if the key size is not supported). encrypt() encrypts blocks
+ * consecutive 16 byte blocks, which an implementation may process in
+ * parallel.
+ */
+typedef struct rijndael_impl {
+	const char	*name;
+	int	(*setup_enc)(aes_u32 rk[/*4*(Nr + 1)*/], const aes_u8 cipherKey[], int keyBits);
+	void	(*encrypt)(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 *pt, aes_u8 *ct, size_t blocks);
+} rijndael_impl_t;
+
 /*  The structure for key information */
 typedef struct {
+	const rijndael_impl_t *impl;	/* implementation the schedule is for */
 #ifdef WITH_AES_DECRYPT
 	int	enc_only;		/* context contains only encrypt schedule */
 #endif
@@ -58,6 +73,20 @@ int	 rijndael_set_key(rijndael_ctx *, const u_char *, int);
 int	 rijndael_set_key_enc_only(rijndael_ctx *, const u_char *, int);
 void	 rijndael_decrypt(rijndael_ctx *, const u_char *, u_char *);
 void	 rijndael_encrypt(rijndael_ctx *, const u_char *, u_char *);
+void	 rijndael_encrypt_blocks(rijndael_ctx *, const u_char *, u_char *, size_t);
+
+/* implementation used for new key schedules, picked on first use */
+const rijndael_impl_t *rijndael_get_impl(void);
+int	 rijndael_set_impl(const char *);
+const rijndael_impl_t *rijndael_find_impl(const char *);
+
+extern const rijndael_impl_t rijndael_impl_table;	/* rijndael.c */
+extern const rijndael_impl_t rijndael_impl_ct;		/* rijndael_ct.c */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define RIJNDAEL_HAVE_AESNI 1
+extern const rijndael_impl_t rijndael_impl_aesni;	/* rijndael_aesni.c */
+int	 rijndael_aesni_supported(void);
+#endif
 
 int	rijndaelKeySetupEnc(aes_u32 rk[/*4*(Nr + 1)*/], const aes_u8 cipherKey[], int keyBits);
 int	rijndaelKeySetupDec(aes_u32 rk[/*4*(Nr + 1)*/], const aes_u8 cipherKey[], int keyBits);
@@ -0,0 +1,129 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2025 Contributors to the Eclipse Foundation.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v. 1.0 which accompanies this distribution.
+ *
+ * The Eclipse Public License is available at http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ *******************************************************************************/
+
+/*
+ * AES encryption with the x86-64 AES-NI instructions. The functions are
+ * compiled for the "aes" target individually, so the rest of the library
+ * needs no special compiler flags; rijndael_aesni_supported() tells at run
+ * time whether the CPU has the instructions.
+ *
+ * The key schedule is kept as Nr + 1 round keys of 16 bytes each, which
+ * is the size of the encrypt key schedule of a rijndael_ctx.
+ */
+
+#include "rijndael.h"
+
+#ifdef RIJNDAEL_HAVE_AESNI
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define AESNI __attribute__((target("aes,sse2")))
+
+int
+rijndael_aesni_supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return (ecx & bit_AES) != 0;
+}
+
+static AESNI __m128i
+expand_step(__m128i key, __m128i assist)
+{
+	assist = _mm_shuffle_epi32(assist, 0xff);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+/* the round constant must be an immediate */
+#define EXPAND(i, rcon)							\
+	k = expand_step(k, _mm_aeskeygenassist_si128(k, rcon));		\
+	_mm_storeu_si128((__m128i *)(void *)(rk + 4 * (i)), k)
+
+static AESNI int
+rijndaelNiKeySetupEnc(aes_u32 rk[/*4*(Nr + 1)*/], const aes_u8 cipherKey[],
+    int keyBits)
+{
+	__m128i k;
+
+	if (keyBits != 128)
+		return 0;
+
+	k = _mm_loadu_si128((const __m128i *)(const void *)cipherKey);
+	_mm_storeu_si128((__m128i *)(void *)rk, k);
+	EXPAND(1, 0x01);
+	EXPAND(2, 0x02);
+	EXPAND(3, 0x04);
+	EXPAND(4, 0x08);
+	EXPAND(5, 0x10);
+	EXPAND(6, 0x20);
+	EXPAND(7, 0x40);
+	EXPAND(8, 0x80);
+	EXPAND(9, 0x1b);
+	EXPAND(10, 0x36);
+	return AES_MAXROUNDS;
+}
+
+#undef EXPAND
+
+#define ROUNDKEY(i) _mm_loadu_si128((const __m128i *)(const void *)(rk + 4 * (i)))
+#define LOAD(p) _mm_loadu_si128((const __m128i *)(const void *)(p))
+#define STORE(p, v) _mm_storeu_si128((__m128i *)(void *)(p), v)
+
+/*
+ * Two blocks are run through the rounds side by side, so that the
+ * latency of one aesenc is hidden behind the other.
+ */
+static AESNI void
+rijndaelNiEncrypt(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 *pt,
+    aes_u8 *ct, size_t blocks)
+{
+	__m128i k, b0, b1;
+	int r;
+
+	for (; blocks >= 2; blocks -= 2, pt += 32, ct += 32) {
+		k = ROUNDKEY(0);
+		b0 = _mm_xor_si128(LOAD(pt), k);
+		b1 = _mm_xor_si128(LOAD(pt + 16), k);
+		for (r = 1; r < Nr; r++) {
+			k = ROUNDKEY(r);
+			b0 = _mm_aesenc_si128(b0, k);
+			b1 = _mm_aesenc_si128(b1, k);
+		}
+		k = ROUNDKEY(Nr);
+		STORE(ct, _mm_aesenclast_si128(b0, k));
+		STORE(ct + 16, _mm_aesenclast_si128(b1, k));
+	}
+	if (blocks) {
+		b0 = _mm_xor_si128(LOAD(pt), ROUNDKEY(0));
+		for (r = 1; r < Nr; r++)
+			b0 = _mm_aesenc_si128(b0, ROUNDKEY(r));
+		STORE(ct, _mm_aesenclast_si128(b0, ROUNDKEY(Nr)));
+	}
+}
+
+const rijndael_impl_t rijndael_impl_aesni = {
+	"aesni", rijndaelNiKeySetupEnc, rijndaelNiEncrypt
+};
+
+#else /* ! RIJNDAEL_HAVE_AESNI */
+
+/* ISO C forbids an empty translation unit */
+typedef int rijndael_aesni_unused;
+
+#endif /* RIJNDAEL_HAVE_AESNI */
@@ -0,0 +1,462 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2025 Contributors to the Eclipse Foundation.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v. 1.0 which accompanies this distribution.
+ *
+ * The Eclipse Public License is available at http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * The bitsliced representation, the key schedule and the round functions
+ * follow the "aes_ct" implementation of BearSSL:
+ *
+ * Copyright (c) 2016 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+
+/*
+ * Constant-time AES encryption without any table lookups. Two blocks are
+ * held in eight 32-bit words, one word per bit of each state byte, and
+ * the S-box is evaluated as the boolean circuit by Boyar and Peralta
+ * ("A new combinational logic minimization technique with applications
+ * to cryptology", https://eprint.iacr.org/2009/191.pdf). Encrypting two
+ * blocks costs the same as encrypting one.
+ *
+ * The key schedule is kept in its compressed form of 4*(Nr + 1) words,
+ * so it fits the encrypt key schedule of a rijndael_ctx.
+ */
+
+#include <string.h>
+
+#include "rijndael.h"
+
+static aes_u32
+dec32le(const aes_u8 *p)
+{
+	return (aes_u32)p[0] | ((aes_u32)p[1] << 8) |
+	    ((aes_u32)p[2] << 16) | ((aes_u32)p[3] << 24);
+}
+
+static void
+enc32le(aes_u8 *p, aes_u32 x)
+{
+	p[0] = (aes_u8)x;
+	p[1] = (aes_u8)(x >> 8);
+	p[2] = (aes_u8)(x >> 16);
+	p[3] = (aes_u8)(x >> 24);
+}
+
+static void
+bitslice_sbox(aes_u32 *q)
+{
+	/*
+	 * x0..x7 are the input bits and s0..s7 the output bits, numbered
+	 * from the most significant bit downwards.
+	 */
+	aes_u32 x0, x1, x2, x3, x4, x5, x6, x7;
+	aes_u32 y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	aes_u32 y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	aes_u32 y20, y21;
+	aes_u32 z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	aes_u32 z10, z11, z12, z13, z14, z15, z16, z17;
+	aes_u32 t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	aes_u32 t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	aes_u32 t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	aes_u32 t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	aes_u32 t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	aes_u32 t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	aes_u32 t60, t61, t62, t63, t64, t65, t66, t67;
+	aes_u32 s0, s1, s2, s3, s4, s5, s6, s7;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	/* top linear transformation */
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	/* non-linear section */
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	/* bottom linear transformation */
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	s0 = t59 ^ t63;
+	s6 = t56 ^ ~t62;
+	s7 = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	s3 = t53 ^ t66;
+	s4 = t51 ^ t66;
+	s5 = t47 ^ t65;
+	s1 = t64 ^ ~s3;
+	s2 = t55 ^ ~t67;
+
+	q[7] = s0;
+	q[6] = s1;
+	q[5] = s2;
+	q[4] = s3;
+	q[3] = s4;
+	q[2] = s5;
+	q[1] = s6;
+	q[0] = s7;
+}
+
+#define SWAPN(cl, ch, s, x, y) do {					\
+		aes_u32 a_, b_;						\
+		a_ = (x);						\
+		b_ = (y);						\
+		(x) = (a_ & (aes_u32)(cl)) | ((b_ & (aes_u32)(cl)) << (s)); \
+		(y) = ((a_ & (aes_u32)(ch)) >> (s)) | (b_ & (aes_u32)(ch)); \
+	} while (0)
+
+#define SWAP2(x, y)	SWAPN(0x55555555, 0xAAAAAAAA, 1, x, y)
+#define SWAP4(x, y)	SWAPN(0x33333333, 0xCCCCCCCC, 2, x, y)
+#define SWAP8(x, y)	SWAPN(0x0F0F0F0F, 0xF0F0F0F0, 4, x, y)
+
+/* converts between the byte and the bitsliced representation (both ways) */
+static void
+ortho(aes_u32 *q)
+{
+	SWAP2(q[0], q[1]);
+	SWAP2(q[2], q[3]);
+	SWAP2(q[4], q[5]);
+	SWAP2(q[6], q[7]);
+
+	SWAP4(q[0], q[2]);
+	SWAP4(q[1], q[3]);
+	SWAP4(q[4], q[6]);
+	SWAP4(q[5], q[7]);
+
+	SWAP8(q[0], q[4]);
+	SWAP8(q[1], q[5]);
+	SWAP8(q[2], q[6]);
+	SWAP8(q[3], q[7]);
+}
+
+static aes_u32
+sub_word(aes_u32 x)
+{
+	aes_u32 q[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		q[i] = x;
+	ortho(q);
+	bitslice_sbox(q);
+	ortho(q);
+	return q[0];
+}
+
+static const aes_u8 Rcon[] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36
+};
+
+/*
+ * Expands the cipher key into the compressed bitsliced key schedule.
+ *
+ * @return	the number of rounds for the given key size, or 0 if the
+ *		schedule would not fit rijndael_ctx.
+ */
+static int
+rijndaelCtKeySetupEnc(aes_u32 rk[/*4*(Nr + 1)*/], const aes_u8 cipherKey[],
+    int keyBits)
+{
+	aes_u32 skey[8 * (AES_MAXROUNDS + 1)];
+	aes_u32 tmp;
+	int i, j, k, nk, nkf;
+
+	if (keyBits != 128)
+		return 0;
+
+	nk = keyBits / 32;
+	nkf = 4 * (AES_MAXROUNDS + 1);
+	tmp = 0;
+	for (i = 0; i < nk; i++) {
+		tmp = dec32le(cipherKey + (i << 2));
+		skey[(i << 1) + 0] = tmp;
+		skey[(i << 1) + 1] = tmp;
+	}
+	for (i = nk, j = 0, k = 0; i < nkf; i++) {
+		if (j == 0) {
+			tmp = (tmp << 24) | (tmp >> 8);
+			tmp = sub_word(tmp) ^ Rcon[k];
+		}
+		tmp ^= skey[(i - nk) << 1];
+		skey[(i << 1) + 0] = tmp;
+		skey[(i << 1) + 1] = tmp;
+		if (++j == nk) {
+			j = 0;
+			k++;
+		}
+	}
+	for (i = 0; i < nkf; i += 4)
+		ortho(skey + (i << 1));
+	for (i = 0, j = 0; i < nkf; i++, j += 2)
+		rk[i] = (skey[j + 0] & 0x55555555) | (skey[j + 1] & 0xAAAAAAAA);
+	memset(skey, 0, sizeof(skey));
+	return AES_MAXROUNDS;
+}
+
+static void
+skey_expand(aes_u32 *skey, int Nr, const aes_u32 *rk)
+{
+	int u, v, n;
+
+	n = (Nr + 1) << 2;
+	for (u = 0, v = 0; u < n; u++, v += 2) {
+		aes_u32 x, y;
+
+		x = y = rk[u];
+		x &= 0x55555555;
+		skey[v + 0] = x | (x << 1);
+		y &= 0xAAAAAAAA;
+		skey[v + 1] = y | (y >> 1);
+	}
+}
+
+static void
+add_round_key(aes_u32 *q, const aes_u32 *sk)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		q[i] ^= sk[i];
+}
+
+static void
+shift_rows(aes_u32 *q)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		aes_u32 x;
+
+		x = q[i];
+		q[i] = (x & 0x000000FF)
+		    | ((x & 0x0000FC00) >> 2) | ((x & 0x00000300) << 6)
+		    | ((x & 0x00F00000) >> 4) | ((x & 0x000F0000) << 4)
+		    | ((x & 0xC0000000) >> 6) | ((x & 0x3F000000) << 2);
+	}
+}
+
+static aes_u32
+rotr16(aes_u32 x)
+{
+	return (x << 16) | (x >> 16);
+}
+
+static void
+mix_columns(aes_u32 *q)
+{
+	aes_u32 q0, q1, q2, q3, q4, q5, q6, q7;
+	aes_u32 r0, r1, r2, r3, r4, r5, r6, r7;
+
+	q0 = q[0];
+	q1 = q[1];
+	q2 = q[2];
+	q3 = q[3];
+	q4 = q[4];
+	q5 = q[5];
+	q6 = q[6];
+	q7 = q[7];
+	r0 = (q0 >> 8) | (q0 << 24);
+	r1 = (q1 >> 8) | (q1 << 24);
+	r2 = (q2 >> 8) | (q2 << 24);
+	r3 = (q3 >> 8) | (q3 << 24);
+	r4 = (q4 >> 8) | (q4 << 24);
+	r5 = (q5 >> 8) | (q5 << 24);
+	r6 = (q6 >> 8) | (q6 << 24);
+	r7 = (q7 >> 8) | (q7 << 24);
+
+	q[0] = q7 ^ r7 ^ r0 ^ rotr16(q0 ^ r0);
+	q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ rotr16(q1 ^ r1);
+	q[2] = q1 ^ r1 ^ r2 ^ rotr16(q2 ^ r2);
+	q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ rotr16(q3 ^ r3);
+	q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ rotr16(q4 ^ r4);
+	q[5] = q4 ^ r4 ^ r5 ^ rotr16(q5 ^ r5);
+	q[6] = q5 ^ r5 ^ r6 ^ rotr16(q6 ^ r6);
+	q[7] = q6 ^ r6 ^ r7 ^ rotr16(q7 ^ r7);
+}
+
+static void
+bitslice_encrypt(int Nr, const aes_u32 *skey, aes_u32 *q)
+{
+	int u;
+
+	add_round_key(q, skey);
+	for (u = 1; u < Nr; u++) {
+		bitslice_sbox(q);
+		shift_rows(q);
+		mix_columns(q);
+		add_round_key(q, skey + (u << 3));
+	}
+	bitslice_sbox(q);
+	shift_rows(q);
+	add_round_key(q, skey + (Nr << 3));
+}
+
+static void
+rijndaelCtEncrypt(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 *pt,
+    aes_u8 *ct, size_t blocks)
+{
+	aes_u32 skey[8 * (AES_MAXROUNDS + 1)];
+	aes_u32 q[8];
+	int i;
+
+	skey_expand(skey, Nr, rk);
+	while (blocks) {
+		/* the first block goes to the even words, the second to the odd */
+		for (i = 0; i < 4; i++) {
+			q[i << 1] = dec32le(pt + (i << 2));
+			q[(i << 1) + 1] = blocks > 1 ? dec32le(pt + 16 + (i << 2)) : 0;
+		}
+		ortho(q);
+		bitslice_encrypt(Nr, skey, q);
+		ortho(q);
+		for (i = 0; i < 4; i++)
+			enc32le(ct + (i << 2), q[i << 1]);
+		if (blocks == 1)
+			break;
+		for (i = 0; i < 4; i++)
+			enc32le(ct + 16 + (i << 2), q[(i << 1) + 1]);
+		pt += 32;
+		ct += 32;
+		blocks -= 2;
+	}
+	memset(skey, 0, sizeof(skey));
+}
+
+const rijndael_impl_t rijndael_impl_ct = {
+	"ct", rijndaelCtKeySetupEnc, rijndaelCtEncrypt
+};
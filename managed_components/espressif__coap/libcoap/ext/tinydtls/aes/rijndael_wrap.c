@@ -16,18 +16,81 @@
  *
  *******************************************************************************/
 
+#include <string.h>
+
 #include "rijndael.h"
 
+static const rijndael_impl_t *rijndael_impl;
+
+/*
+ * The implementations in order of preference. The table driven one is
+ * only used when asked for, as it is not constant-time.
+ */
+static const rijndael_impl_t *
+rijndael_default_impl(void)
+{
+#ifdef RIJNDAEL_HAVE_AESNI
+	if (rijndael_aesni_supported())
+		return &rijndael_impl_aesni;
+#endif
+	return &rijndael_impl_ct;
+}
+
+const rijndael_impl_t *
+rijndael_find_impl(const char *name)
+{
+#ifdef RIJNDAEL_HAVE_AESNI
+	if (strcmp(name, rijndael_impl_aesni.name) == 0)
+		return rijndael_aesni_supported() ? &rijndael_impl_aesni : NULL;
+#endif
+	if (strcmp(name, rijndael_impl_ct.name) == 0)
+		return &rijndael_impl_ct;
+	if (strcmp(name, rijndael_impl_table.name) == 0)
+		return &rijndael_impl_table;
+	return NULL;
+}
+
+const rijndael_impl_t *
+rijndael_get_impl(void)
+{
+	if (!rijndael_impl)
+		rijndael_impl = rijndael_default_impl();
+	return rijndael_impl;
+}
+
+/*
+ * select the implementation for key contexts set up from now on, NULL
+ * selects the default; existing contexts keep theirs
+ */
+int
+rijndael_set_impl(const char *name)
+{
+	const rijndael_impl_t *impl;
+
+	impl = name ? rijndael_find_impl(name) : rijndael_default_impl();
+	if (!impl)
+		return -1;
+	rijndael_impl = impl;
+	return 0;
+}
+
 /* setup key context for encryption only */
 int
 rijndael_set_key_enc_only(rijndael_ctx *ctx, const u_char *key, int bits)
 {
+	const rijndael_impl_t *impl = rijndael_get_impl();
 	int rounds;
 
-	rounds = rijndaelKeySetupEnc(ctx->ek, key, bits);
+	rounds = impl->setup_enc(ctx->ek, key, bits);
+	if (rounds == 0 && impl != &rijndael_impl_table) {
+		/* only the table driven implementation has other key sizes */
+		impl = &rijndael_impl_table;
+		rounds = impl->setup_enc(ctx->ek, key, bits);
+	}
 	if (rounds == 0)
 		return -1;
 
+	ctx->impl = impl;
 	ctx->Nr = rounds;
 #ifdef WITH_AES_DECRYPT
 	ctx->enc_only = 1;
@@ -49,6 +112,7 @@ rijndael_set_key(rijndael_ctx *ctx, const u_char *key, int bits)
 	if (rijndaelKeySetupDec(ctx->dk, key, bits) != rounds)
 		return -1;
 
+	ctx->impl = &rijndael_impl_table;
 	ctx->Nr = rounds;
 	ctx->enc_only = 0;
 
@@ -65,5 +129,13 @@ rijndael_decrypt(rijndael_ctx *ctx, const u_char *src, u_char *dst)
 void
 rijndael_encrypt(rijndael_ctx *ctx, const u_char *src, u_char *dst)
 {
-	rijndaelEncrypt(ctx->ek, ctx->Nr, src, dst);
+	ctx->impl->encrypt(ctx->ek, ctx->Nr, src, dst, 1);
+}
+
+/* encrypt consecutive blocks, which the implementation may do in parallel */
+void
+rijndael_encrypt_blocks(rijndael_ctx *ctx, const u_char *src, u_char *dst,
+    size_t blocks)
+{
+	ctx->impl->encrypt(ctx->ek, ctx->Nr, src, dst, blocks);
 }
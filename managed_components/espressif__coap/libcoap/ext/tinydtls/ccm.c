@@ -65,11 +65,10 @@ block0(size_t M,       /* number of auth bytes */
  * \param ctx  The crypto context for the AES encryption.
  * \param msg  The message starting with the additional authentication data.
  * \param la   The number of additional authentication bytes in \p msg.
- * \param B    The input buffer for crypto operations. When this function
- *             is called, \p B must be initialized with \c B0 (the first
- *             authentication block.
+ * \param B    The input buffer for crypto operations.
  * \param X    The output buffer where the result of the CBC calculation
- *             is placed.
+ *             is placed. When this function is called, \p X must hold
+ *             the encrypted \c B0 (the first authentication block).
  */
 static void
 add_auth_data(rijndael_ctx *ctx, const unsigned char *msg, uint64_t la,
@@ -77,8 +76,6 @@ add_auth_data(rijndael_ctx *ctx, const unsigned char *msg, uint64_t la,
 	      unsigned char X[DTLS_CCM_BLOCKSIZE]) {
   uint64_t i,j;
 
-  rijndael_encrypt(ctx, B, X);
-
   memset(B, 0, DTLS_CCM_BLOCKSIZE);
 
   if (!la)
@@ -136,31 +133,57 @@ add_auth_data(rijndael_ctx *ctx, const unsigned char *msg, uint64_t la,
   } 
 }
 
+/**
+ * Sets up \c B0 in the first and the counter block \c A0 in the second
+ * half of \p B and encrypts both into \p X. The first half of \p X then
+ * is the start of the CBC-MAC, the second half \c S0 to encrypt the MAC
+ * with.
+ */
 static inline void
-encrypt(rijndael_ctx *ctx, size_t L, unsigned long counter,
-	unsigned char *msg, size_t len,
-	unsigned char A[DTLS_CCM_BLOCKSIZE],
-	unsigned char S[DTLS_CCM_BLOCKSIZE]) {
+start_blocks(rijndael_ctx *ctx, size_t M, size_t L, size_t la, size_t lm,
+	     const unsigned char nonce[DTLS_CCM_BLOCKSIZE],
+	     unsigned char B[2 * DTLS_CCM_BLOCKSIZE],
+	     unsigned char X[2 * DTLS_CCM_BLOCKSIZE]) {
+  unsigned char *A = B + DTLS_CCM_BLOCKSIZE;
+  unsigned long counter_tmp;
+
+  block0(M, L, la, lm, nonce, B);
+
+  /* initialize block template */
+  A[0] = L-1;
 
-  static unsigned long counter_tmp;
+  /* copy the nonce */
+  memcpy(A + 1, nonce, DTLS_CCM_BLOCKSIZE - L - 1);
+  SET_COUNTER(A, L, 0, counter_tmp);
 
-  SET_COUNTER(A, L, counter, counter_tmp);    
-  rijndael_encrypt(ctx, A, S);
-  memxor(msg, S, len);
+  rijndael_encrypt_blocks(ctx, B, X, 2);
 }
 
+/**
+ * Feeds \p len bytes of \p msg (zero padded to a full block) into the
+ * CBC-MAC in the first half of \p X. When \p counter is not 0, the
+ * counter block A_counter is encrypted along with it, so that the
+ * second half of \p X holds S_counter afterwards. Doing both in one
+ * call lets the AES implementation work on the two blocks in parallel.
+ */
 static inline void
-mac(rijndael_ctx *ctx, 
-    unsigned char *msg, size_t len,
-    unsigned char B[DTLS_CCM_BLOCKSIZE],
-    unsigned char X[DTLS_CCM_BLOCKSIZE]) {
+mac_and_counter(rijndael_ctx *ctx, size_t L, unsigned long counter,
+		const unsigned char *msg, size_t len,
+		unsigned char B[2 * DTLS_CCM_BLOCKSIZE],
+		unsigned char X[2 * DTLS_CCM_BLOCKSIZE]) {
+  unsigned long counter_tmp;
   size_t i;
 
   for (i = 0; i < len; ++i)
     B[i] = X[i] ^ msg[i];
+  memcpy(B + len, X + len, DTLS_CCM_BLOCKSIZE - len);
 
-  rijndael_encrypt(ctx, B, X);
-
+  if (counter) {
+    SET_COUNTER(B + DTLS_CCM_BLOCKSIZE, L, counter, counter_tmp);
+    rijndael_encrypt_blocks(ctx, B, X, 2);
+  } else {
+    rijndael_encrypt(ctx, B, X);
+  }
 }
 
 long int
@@ -168,61 +191,34 @@ dtls_ccm_encrypt_message(rijndael_ctx *ctx, size_t M, size_t L,
 			 const unsigned char nonce[DTLS_CCM_BLOCKSIZE],
 			 unsigned char *msg, size_t lm, 
 			 const unsigned char *aad, size_t la) {
-  size_t i, len;
-  unsigned long counter_tmp;
+  size_t i, n, len;
   unsigned long counter = 1; /* \bug does not work correctly on ia32 when
 			             lm >= 2^16 */
-  unsigned char A[DTLS_CCM_BLOCKSIZE]; /* A_i blocks for encryption input */
-  unsigned char B[DTLS_CCM_BLOCKSIZE]; /* B_i blocks for CBC-MAC input */
-  unsigned char S[DTLS_CCM_BLOCKSIZE]; /* S_i = encrypted A_i blocks */
-  unsigned char X[DTLS_CCM_BLOCKSIZE]; /* X_i = encrypted B_i blocks */
+  unsigned char B[2 * DTLS_CCM_BLOCKSIZE]; /* B_i for CBC-MAC input, A_i */
+  unsigned char X[2 * DTLS_CCM_BLOCKSIZE]; /* X_i = encrypted B_i, S_i */
+  unsigned char S0[DTLS_CCM_BLOCKSIZE];
+  const unsigned char *S = X + DTLS_CCM_BLOCKSIZE;
 
   len = lm;			/* save original length */
-  /* create the initial authentication block B0 */
-  block0(M, L, la, lm, nonce, B);
+  start_blocks(ctx, M, L, la, lm, nonce, B, X);
+  memcpy(S0, S, DTLS_CCM_BLOCKSIZE);
   add_auth_data(ctx, aad, la, B, X);
 
-  /* initialize block template */
-  A[0] = L-1;
-
-  /* copy the nonce */
-  memcpy(A + 1, nonce, DTLS_CCM_BLOCKSIZE - L - 1);
-  
-  while (lm >= DTLS_CCM_BLOCKSIZE) {
-    /* calculate MAC */
-    mac(ctx, msg, DTLS_CCM_BLOCKSIZE, B, X);
+  while (lm) {
+    n = min(lm, DTLS_CCM_BLOCKSIZE);
 
-    /* encrypt */
-    encrypt(ctx, L, counter, msg, DTLS_CCM_BLOCKSIZE, A, S);
+    /* calculate MAC and S_counter, then encrypt */
+    mac_and_counter(ctx, L, counter, msg, n, B, X);
+    memxor(msg, S, n);
 
     /* update local pointers */
-    lm -= DTLS_CCM_BLOCKSIZE;
-    msg += DTLS_CCM_BLOCKSIZE;
+    lm -= n;
+    msg += n;
     counter++;
   }
 
-  if (lm) {
-    /* Calculate MAC. The remainder of B must be padded with zeroes, so
-     * B is constructed to contain X ^ msg for the first lm bytes (done in
-     * mac() and X ^ 0 for the remaining DTLS_CCM_BLOCKSIZE - lm bytes
-     * (i.e., we can use memcpy() here).
-     */
-    memcpy(B + lm, X + lm, DTLS_CCM_BLOCKSIZE - lm);
-    mac(ctx, msg, lm, B, X);
-
-    /* encrypt */
-    encrypt(ctx, L, counter, msg, lm, A, S);
-
-    /* update local pointers */
-    msg += lm;
-  }
-  
-  /* calculate S_0 */  
-  SET_COUNTER(A, L, 0, counter_tmp);
-  rijndael_encrypt(ctx, A, S);
-
   for (i = 0; i < M; ++i)
-    *msg++ = X[i] ^ S[i];
+    *msg++ = X[i] ^ S0[i];
 
   return len + M;
 }
@@ -233,14 +229,14 @@ dtls_ccm_decrypt_message(rijndael_ctx *ctx, size_t M, size_t L,
 			 unsigned char *msg, size_t lm, 
 			 const unsigned char *aad, size_t la) {
   
-  size_t len;
-  unsigned long counter_tmp;
+  size_t n, len;
   unsigned long counter = 1; /* \bug does not work correctly on ia32 when
 			             lm >= 2^16 */
-  unsigned char A[DTLS_CCM_BLOCKSIZE]; /* A_i blocks for encryption input */
-  unsigned char B[DTLS_CCM_BLOCKSIZE]; /* B_i blocks for CBC-MAC input */
-  unsigned char S[DTLS_CCM_BLOCKSIZE]; /* S_i = encrypted A_i blocks */
-  unsigned char X[DTLS_CCM_BLOCKSIZE]; /* X_i = encrypted B_i blocks */
+  unsigned char B[2 * DTLS_CCM_BLOCKSIZE]; /* B_i for CBC-MAC input, A_i */
+  unsigned char X[2 * DTLS_CCM_BLOCKSIZE]; /* X_i = encrypted B_i, S_i */
+  unsigned char S0[DTLS_CCM_BLOCKSIZE];
+  unsigned char *S = X + DTLS_CCM_BLOCKSIZE;
+  unsigned long counter_tmp;
 
   if (lm < M)
     goto error;
@@ -248,50 +244,33 @@ dtls_ccm_decrypt_message(rijndael_ctx *ctx, size_t M, size_t L,
   len = lm;	      /* save original length */
   lm -= M;	      /* detract MAC size*/
 
-  /* create the initial authentication block B0 */
-  block0(M, L, la, lm, nonce, B);
+  start_blocks(ctx, M, L, la, lm, nonce, B, X);
+  memcpy(S0, S, DTLS_CCM_BLOCKSIZE);
   add_auth_data(ctx, aad, la, B, X);
 
-  /* initialize block template */
-  A[0] = L-1;
+  /* The MAC is over the plaintext, so S_1 is needed first. After that,
+   * S_(i+1) is calculated along with the MAC of block i. */
+  if (lm) {
+    SET_COUNTER(B + DTLS_CCM_BLOCKSIZE, L, counter, counter_tmp);
+    rijndael_encrypt(ctx, B + DTLS_CCM_BLOCKSIZE, S);
+  }
+
+  while (lm) {
+    n = min(lm, DTLS_CCM_BLOCKSIZE);
 
-  /* copy the nonce */
-  memcpy(A + 1, nonce, DTLS_CCM_BLOCKSIZE - L - 1);
-  
-  while (lm >= DTLS_CCM_BLOCKSIZE) {
     /* decrypt */
-    encrypt(ctx, L, counter, msg, DTLS_CCM_BLOCKSIZE, A, S);
-    
-    /* calculate MAC */
-    mac(ctx, msg, DTLS_CCM_BLOCKSIZE, B, X);
+    memxor(msg, S, n);
 
     /* update local pointers */
-    lm -= DTLS_CCM_BLOCKSIZE;
-    msg += DTLS_CCM_BLOCKSIZE;
+    lm -= n;
     counter++;
-  }
 
-  if (lm) {
-    /* decrypt */
-    encrypt(ctx, L, counter, msg, lm, A, S);
-
-    /* Calculate MAC. Note that msg ends in the MAC so we must
-     * construct B to contain X ^ msg for the first lm bytes (done in
-     * mac() and X ^ 0 for the remaining DTLS_CCM_BLOCKSIZE - lm bytes
-     * (i.e., we can use memcpy() here).
-     */
-    memcpy(B + lm, X + lm, DTLS_CCM_BLOCKSIZE - lm);
-    mac(ctx, msg, lm, B, X); 
-
-    /* update local pointers */
-    msg += lm;
+    /* calculate MAC and the next S_counter, if any */
+    mac_and_counter(ctx, L, lm ? counter : 0, msg, n, B, X);
+    msg += n;
   }
-  
-  /* calculate S_0 */  
-  SET_COUNTER(A, L, 0, counter_tmp);
-  rijndael_encrypt(ctx, A, S);
 
-  memxor(msg, S, M);
+  memxor(msg, S0, M);
 
   /* return length if MAC is valid, otherwise continue with error handling */
   if (equals(X, msg, M))
@@ -16,6 +16,7 @@
  *******************************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 
 #include "tinydtls.h"
 
@@ -35,8 +36,6 @@
 #include "dtls_prng.h"
 #include "netq.h"
 
-#include "dtls_mutex.h"
-
 #ifdef WITH_ZEPHYR
 LOG_MODULE_DECLARE(TINYDTLS, CONFIG_TINYDTLS_LOG_LEVEL);
 #endif /* WITH_ZEPHYR */
@@ -59,20 +58,6 @@ memarray_t security_storage;
 #define HMAC_UPDATE_SEED(Context,Seed,Length)		\
   if (Seed) dtls_hmac_update(Context, (Seed), (Length))
 
-static struct dtls_cipher_context_t cipher_context;
-static dtls_mutex_t cipher_context_mutex = DTLS_MUTEX_INITIALIZER;
-
-static struct dtls_cipher_context_t *dtls_cipher_context_get(void)
-{
-  dtls_mutex_lock(&cipher_context_mutex);
-  return &cipher_context;
-}
-
-static void dtls_cipher_context_release(void)
-{
-  dtls_mutex_unlock(&cipher_context_mutex);
-}
-
 #if !(defined (WITH_CONTIKI)) && !(defined (RIOT_VERSION))
 void crypto_init(void)
 {
@@ -292,44 +277,6 @@ dtls_mac(dtls_hmac_context_t *hmac_ctx,
   dtls_hmac_finalize(hmac_ctx, buf);
 }
 
-static size_t
-dtls_ccm_encrypt(aes128_ccm_t *ccm_ctx, const unsigned char *src, size_t srclen,
-		 unsigned char *buf, 
-		 const unsigned char *nonce,
-		 const unsigned char *aad, size_t la) {
-  long int len;
-  (void)src;
-
-  assert(ccm_ctx);
-
-  len = dtls_ccm_encrypt_message(&ccm_ctx->ctx,
-                                 ccm_ctx->tag_length /* M */,
-				 ccm_ctx->l /* L */,
-				 nonce,
-				 buf, srclen,
-				 aad, la);
-  return len;
-}
-
-static size_t
-dtls_ccm_decrypt(aes128_ccm_t *ccm_ctx, const unsigned char *src,
-		 size_t srclen, unsigned char *buf,
-		 const unsigned char *nonce,
-		 const unsigned char *aad, size_t la) {
-  long int len;
-  (void)src;
-
-  assert(ccm_ctx);
-
-  len = dtls_ccm_decrypt_message(&ccm_ctx->ctx,
-                                 ccm_ctx->tag_length /* M */,
-				 ccm_ctx->l /* L */,
-				 nonce,
-				 buf, srclen,
-				 aad, la);
-  return len;
-}
-
 #ifdef DTLS_PSK
 int
 dtls_psk_pre_master_secret(unsigned char *key, size_t keylen,
@@ -559,29 +506,48 @@ dtls_ecdsa_verify_sig(const unsigned char *pub_key_x,
 #endif /* DTLS_ECC */
 
 int
-dtls_encrypt_params(const dtls_ccm_params_t *params,
-                    const unsigned char *src, size_t length,
-                    unsigned char *buf,
-                    const unsigned char *key, size_t keylen,
-                    const unsigned char *aad, size_t la) {
+dtls_cipher_set_key(rijndael_ctx *ctx,
+                    const unsigned char *key, size_t keylen) {
   int ret;
-  struct dtls_cipher_context_t *ctx = dtls_cipher_context_get();
-  ctx->data.tag_length = params->tag_length;
-  ctx->data.l = params->l;
 
-  ret = rijndael_set_key_enc_only(&ctx->data.ctx, key, 8 * keylen);
+  ret = rijndael_set_key_enc_only(ctx, key, 8 * keylen);
   if (ret < 0) {
     /* cleanup everything in case the key has the wrong size */
+    memset(ctx, 0, sizeof(*ctx));
     dtls_warn("cannot set rijndael key\n");
-    goto error;
   }
+  return ret;
+}
+
+int
+dtls_encrypt_ctx(rijndael_ctx *ctx, const dtls_ccm_params_t *params,
+                 const unsigned char *src, size_t length,
+                 unsigned char *buf,
+                 const unsigned char *aad, size_t la) {
+  assert(ctx);
 
   if (src != buf)
     memmove(buf, src, length);
-  ret = dtls_ccm_encrypt(&ctx->data, src, length, buf, params->nonce, aad, la);
+  return dtls_ccm_encrypt_message(ctx, params->tag_length /* M */,
+                                  params->l /* L */, params->nonce,
+                                  buf, length, aad, la);
+}
+
+int
+dtls_encrypt_params(const dtls_ccm_params_t *params,
+                    const unsigned char *src, size_t length,
+                    unsigned char *buf,
+                    const unsigned char *key, size_t keylen,
+                    const unsigned char *aad, size_t la) {
+  rijndael_ctx ctx;
+  int ret;
 
-error:
-  dtls_cipher_context_release();
+  ret = dtls_cipher_set_key(&ctx, key, keylen);
+  if (ret < 0)
+    return ret;
+
+  ret = dtls_encrypt_ctx(&ctx, params, src, length, buf, aad, la);
+  memset(&ctx, 0, sizeof(ctx));
   return ret;
 }
 
@@ -599,6 +565,21 @@ dtls_encrypt(const unsigned char *src, size_t length,
   return dtls_encrypt_params(&params, src, length, buf, key, keylen, aad, la);
 }
 
+int
+dtls_decrypt_ctx(rijndael_ctx *ctx, const dtls_ccm_params_t *params,
+                 const unsigned char *src, size_t length,
+                 unsigned char *buf,
+                 const unsigned char *aad, size_t la)
+{
+  assert(ctx);
+
+  if (src != buf)
+    memmove(buf, src, length);
+  return dtls_ccm_decrypt_message(ctx, params->tag_length /* M */,
+                                  params->l /* L */, params->nonce,
+                                  buf, length, aad, la);
+}
+
 int
 dtls_decrypt_params(const dtls_ccm_params_t *params,
                     const unsigned char *src, size_t length,
@@ -606,24 +587,15 @@ dtls_decrypt_params(const dtls_ccm_params_t *params,
                     const unsigned char *key, size_t keylen,
                     const unsigned char *aad, size_t la)
 {
+  rijndael_ctx ctx;
   int ret;
-  struct dtls_cipher_context_t *ctx = dtls_cipher_context_get();
-  ctx->data.tag_length = params->tag_length;
-  ctx->data.l = params->l;
-
-  ret = rijndael_set_key_enc_only(&ctx->data.ctx, key, 8 * keylen);
-  if (ret < 0) {
-    /* cleanup everything in case the key has the wrong size */
-    dtls_warn("cannot set rijndael key\n");
-    goto error;
-  }
 
-  if (src != buf)
-    memmove(buf, src, length);
-  ret = dtls_ccm_decrypt(&ctx->data, src, length, buf, params->nonce, aad, la);
+  ret = dtls_cipher_set_key(&ctx, key, keylen);
+  if (ret < 0)
+    return ret;
 
-error:
-  dtls_cipher_context_release();
+  ret = dtls_decrypt_ctx(&ctx, params, src, length, buf, aad, la);
+  memset(&ctx, 0, sizeof(ctx));
   return ret;
 }
 
@@ -64,19 +64,6 @@ typedef enum {
   DTLS_ECDH_CURVE_SECP256R1
 } dtls_ecdh_curve;
 
-/** Crypto context for TLS_PSK_WITH_AES_128_CCM_8 cipher suite. */
-typedef struct {
-  rijndael_ctx ctx;		       /**< AES-128 encryption context */
-  uint8_t tag_length;                  /**< length of MAC tag (=M) */
-  uint8_t l;                           /**< number of bytes in length
-                                        *   field (= L) */
-} aes128_ccm_t;
-
-typedef struct dtls_cipher_context_t {
-  /** numeric identifier of this cipher suite in host byte order. */
-  aes128_ccm_t data;		/**< The crypto context */
-} dtls_cipher_context_t;
-
 typedef struct {
   uint8 own_eph_priv[32];
   uint8 other_eph_pub_x[32];
@@ -91,6 +78,12 @@ typedef struct {
 #define DTLS_PSK_MAX_CLIENT_IDENTITY_LEN   32
 #endif /* DTLS_PSK_MAX_CLIENT_IDENTITY_LEN */
 
+/* This is the maximal number of concurrent handshakes of a context. The
+ * platforms without malloc(3) also size their memory pool with it. */
+#ifndef DTLS_HANDSHAKE_MAX
+#define DTLS_HANDSHAKE_MAX 32
+#endif /* DTLS_HANDSHAKE_MAX */
+
 /* This is the maximal supported length of the pre-shared key. */
 #define DTLS_PSK_MAX_KEY_LEN DTLS_KEY_LENGTH
 
@@ -124,6 +117,14 @@ typedef struct {
    * access the components of the key block.
    */
   uint8 key_block[MAX_KEYBLOCK_LENGTH];
+
+  /**
+   * The expanded AES key schedules of the local and remote write keys
+   * in key_block. These are set up once with dtls_cipher_set_key() when
+   * the key_block is generated, rather than for each record.
+   */
+  rijndael_ctx write_ctx;	/**< for dtls_kb_local_write_key() */
+  rijndael_ctx read_ctx;	/**< for dtls_kb_remote_write_key() */
   
   seqnum_t cseq;        /**<sequence number of last record received*/
 } dtls_security_parameters_t;
@@ -317,6 +318,38 @@ int dtls_encrypt_params(const dtls_ccm_params_t *params,
                         const unsigned char *key, size_t keylen,
                         const unsigned char *aad, size_t aad_length);
 
+/**
+ * Expands the given AES \p key into \p ctx for use with
+ * dtls_encrypt_ctx() and dtls_decrypt_ctx().
+ *
+ * \param ctx     The key schedule to set up.
+ * \param key     The key to use
+ * \param keylen  The length of the key
+ * \return 0 on success, less than zero if the key has the wrong size.
+ */
+int dtls_cipher_set_key(rijndael_ctx *ctx,
+                        const unsigned char *key, size_t keylen);
+
+/**
+ * Encrypts the specified \p src of given \p length like
+ * dtls_encrypt_params(), using the key schedule \p ctx that was set
+ * up by dtls_cipher_set_key().
+ *
+ * \param ctx    The expanded key to use.
+ * \param params AEAD parameters: Nonce, M and L.
+ * \param src    The data to encrypt.
+ * \param length The actual size of of \p src.
+ * \param buf    The result buffer.
+ * \param aad    additional data for AEAD ciphers
+ * \param aad_length actual size of @p aad
+ * \return The number of encrypted bytes on success, less than zero
+ *         otherwise.
+ */
+int dtls_encrypt_ctx(rijndael_ctx *ctx, const dtls_ccm_params_t *params,
+                     const unsigned char *src, size_t length,
+                     unsigned char *buf,
+                     const unsigned char *aad, size_t aad_length);
+
 /** 
  * Encrypts the specified \p src of given \p length, writing the
  * result to \p buf. The cipher implementation may add more data to
@@ -375,6 +408,26 @@ int dtls_decrypt_params(const dtls_ccm_params_t *params,
                         const unsigned char *key, size_t keylen,
                         const unsigned char *aad, size_t aad_length);
 
+/**
+ * Decrypts the given buffer \p src of given \p length like
+ * dtls_decrypt_params(), using the key schedule \p ctx that was set
+ * up by dtls_cipher_set_key().
+ *
+ * \param ctx     The expanded key to use.
+ * \param params  AEAD parameters: Nonce, M and L.
+ * \param src     The input buffer to decrypt.
+ * \param length  The length of the input buffer.
+ * \param buf     The result buffer.
+ * \param aad     additional authentication data for AEAD ciphers
+ * \param aad_length actual size of @p aad
+ * \return Less than zero on error, the number of decrypted bytes
+ *         otherwise.
+ */
+int dtls_decrypt_ctx(rijndael_ctx *ctx, const dtls_ccm_params_t *params,
+                     const unsigned char *src, size_t length,
+                     unsigned char *buf,
+                     const unsigned char *aad, size_t aad_length);
+
 /** 
  * Decrypts the given buffer \p src of given \p length, writing the
  * result to \p buf. The function returns \c -1 in case of an error,
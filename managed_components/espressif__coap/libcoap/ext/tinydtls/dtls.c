@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef HAVE_ASSERT_H
 #include <assert.h>
 #endif
@@ -41,11 +42,6 @@
 #  endif
 #endif /* HAVE_INTTYPES_H */
 
-#include "utlist.h"
-#ifndef DTLS_PEERS_NOHASH
-#include "uthash.h"
-#endif /* DTLS_PEERS_NOHASH */
-
 #include "dtls_debug.h"
 #include "numeric.h"
 #include "netq.h"
@@ -91,35 +87,6 @@ memarray_t dtlscontext_storage;
 #define dtls_get_sequence_number(H) dtls_uint48_to_ulong((H)->sequence_number)
 #define dtls_get_fragment_length(H) dtls_uint24_to_int((H)->fragment_length)
 
-#ifdef DTLS_PEERS_NOHASH
-#define FIND_PEER(head,sess,out)                                \
-  do {                                                          \
-    dtls_peer_t * tmp;                                          \
-    (out) = NULL;                                               \
-    LL_FOREACH((head), tmp) {                                   \
-      if (dtls_session_equals(&tmp->session, (sess))) {         \
-        (out) = tmp;                                            \
-        break;                                                  \
-      }                                                         \
-    }                                                           \
-  } while (0)
-#define DEL_PEER(head,delptr)                   \
-  if ((head) != NULL && (delptr) != NULL) {	\
-    LL_DELETE(head,delptr);                     \
-  }
-#define ADD_PEER(head,sess,add)                 \
-  LL_PREPEND(ctx->peers, peer);
-#else /* DTLS_PEERS_NOHASH */
-#define FIND_PEER(head,sess,out)		\
-  HASH_FIND(hh,head,sess,sizeof(session_t),out)
-#define ADD_PEER(head,sess,add)                 \
-  HASH_ADD(hh,head,sess,sizeof(session_t),add)
-#define DEL_PEER(head,delptr)                   \
-  if ((head) != NULL && (delptr) != NULL) {	\
-    HASH_DELETE(hh,head,delptr);		\
-  }
-#endif /* DTLS_PEERS_NOHASH */
-
 #define DTLS_RH_LENGTH sizeof(dtls_record_header_t)
 #define DTLS_HS_LENGTH sizeof(dtls_handshake_header_t)
 /*
@@ -385,9 +352,7 @@ static void dtls_stop_retransmission(dtls_context_t *context, dtls_peer_t *peer)
 
 dtls_peer_t *
 dtls_get_peer(const dtls_context_t *ctx, const session_t *session) {
-  dtls_peer_t *p;
-  FIND_PEER(ctx->peers, session, p);
-  return p;
+  return dtls_peer_table_find(&ctx->peers, session);
 }
 
 /**
@@ -397,8 +362,36 @@ dtls_get_peer(const dtls_context_t *ctx, const session_t *session) {
  */
 static int
 dtls_add_peer(dtls_context_t *ctx, dtls_peer_t *peer) {
-  ADD_PEER(ctx->peers, session, peer);
-  return 0;
+  return dtls_peer_table_add(&ctx->peers, peer);
+}
+
+/**
+ * Allocates the parameters for a new handshake in @p ctx. This function
+ * returns NULL if DTLS_HANDSHAKE_MAX handshakes of @p ctx are already in
+ * progress, or if there is no memory.
+ */
+static dtls_handshake_parameters_t *
+dtls_ctx_handshake_new(dtls_context_t *ctx) {
+  dtls_handshake_parameters_t *handshake;
+
+  if (ctx->handshake_count >= DTLS_HANDSHAKE_MAX) {
+    dtls_debug("all %u handshakes in use\n", (unsigned int)DTLS_HANDSHAKE_MAX);
+    return NULL;
+  }
+  handshake = dtls_handshake_new();
+  if (handshake)
+    ctx->handshake_count++;
+  return handshake;
+}
+
+/** Releases @p handshake allocated by dtls_ctx_handshake_new(). */
+static void
+dtls_ctx_handshake_free(dtls_context_t *ctx,
+                        dtls_handshake_parameters_t *handshake) {
+  if (handshake) {
+    dtls_handshake_free(handshake);
+    ctx->handshake_count--;
+  }
 }
 
 int
@@ -1089,6 +1082,16 @@ calculate_key_block(dtls_context_t *ctx,
   memcpy(handshake->tmp.master_secret, master_secret, DTLS_MASTER_SECRET_LENGTH);
   dtls_debug_keyblock(security);
 
+  /* expand the write keys once for all records of this epoch */
+  if (dtls_cipher_set_key(&security->write_ctx,
+                          dtls_kb_local_write_key(security, role),
+                          dtls_kb_key_size(security, role)) < 0 ||
+      dtls_cipher_set_key(&security->read_ctx,
+                          dtls_kb_remote_write_key(security, role),
+                          dtls_kb_key_size(security, role)) < 0) {
+    return dtls_alert_fatal_create(DTLS_ALERT_INTERNAL_ERROR);
+  }
+
   security->cipher_index = handshake->cipher_index;
   security->compression = handshake->compression;
   security->rseq = 0;
@@ -1713,7 +1716,7 @@ dtls_prepare_record(dtls_peer_t *peer, dtls_security_parameters_t *security,
     const uint8_t mac_len = get_cipher_suite_mac_len(security->cipher_index);
     const cipher_suite_key_exchange_algorithm_t key_exchange_algorithm =
             get_key_exchange_algorithm(security->cipher_index);
-    /* For backwards-compatibility, dtls_encrypt_params is called with
+    /* For backwards-compatibility, the record is protected with
      * M=<macLen> and L=3. */
     const dtls_ccm_params_t params = { nonce, mac_len, 3 };
 
@@ -1803,9 +1806,8 @@ dtls_prepare_record(dtls_peer_t *peer, dtls_security_parameters_t *security,
     memcpy(A_DATA + 8,  &DTLS_RECORD_HEADER(sendbuf)->content_type, 3); /* type and version */
     dtls_int_to_uint16(A_DATA + 11, res - 8); /* length */
 
-    res = dtls_encrypt_params(&params, start + 8, res - 8, start + 8,
-               dtls_kb_local_write_key(security, peer->role),
-               dtls_kb_key_size(security, peer->role),
+    res = dtls_encrypt_ctx(&security->write_ctx, &params,
+               start + 8, res - 8, start + 8,
                A_DATA, A_DATA_LEN);
 
     if (res < 0)
@@ -2197,8 +2199,10 @@ dtls_destroy_peer(dtls_context_t *ctx, dtls_peer_t *peer, int flags) {
     dtls_close(ctx, &peer->session);
   }
   dtls_stop_retransmission(ctx, peer);
-  DEL_PEER(ctx->peers, peer);
+  dtls_peer_table_remove(&ctx->peers, peer);
   dtls_dsrv_log_addr(DTLS_LOG_DEBUG, "removed peer", &peer->session);
+  dtls_ctx_handshake_free(ctx, peer->handshake_params);
+  peer->handshake_params = NULL;
   dtls_free_peer(peer);
 }
 
@@ -3776,7 +3780,7 @@ decrypt_verify(dtls_peer_t *peer, uint8 *packet, size_t length,
     unsigned char nonce[DTLS_CCM_BLOCKSIZE];
     unsigned char A_DATA[A_DATA_LEN];
     const uint8_t mac_len = get_cipher_suite_mac_len(security->cipher_index);
-    /* For backwards-compatibility, dtls_encrypt_params is called with
+    /* For backwards-compatibility, the record is protected with
      * M=<macLen> and L=3. */
     const dtls_ccm_params_t params = { nonce, mac_len, 3 };
 
@@ -3807,9 +3811,8 @@ decrypt_verify(dtls_peer_t *peer, uint8 *packet, size_t length,
 
     dtls_int_to_uint16(A_DATA + 11, clen - mac_len); /* length without MAC */
 
-    clen = dtls_decrypt_params(&params, *cleartext, clen, *cleartext,
-               dtls_kb_remote_write_key(security, peer->role),
-               dtls_kb_key_size(security, peer->role),
+    clen = dtls_decrypt_ctx(&security->read_ctx, &params,
+               *cleartext, clen, *cleartext,
                A_DATA, A_DATA_LEN);
     if (clen < 0)
       dtls_warn("decryption failed\n");
@@ -4052,7 +4055,7 @@ handle_handshake_msg(dtls_context_t *ctx, dtls_peer_t *peer, uint8 *data, size_t
         return err;
       }
     }
-    dtls_handshake_free(peer->handshake_params);
+    dtls_ctx_handshake_free(ctx, peer->handshake_params);
     peer->handshake_params = NULL;
     dtls_debug("Handshake complete\n");
     check_stack();
@@ -4124,7 +4127,7 @@ handle_handshake_msg(dtls_context_t *ctx, dtls_peer_t *peer, uint8 *data, size_t
     if (!peer->handshake_params) {
       dtls_handshake_header_t *hs_header = DTLS_HANDSHAKE_HEADER(data);
 
-      peer->handshake_params = dtls_handshake_new();
+      peer->handshake_params = dtls_ctx_handshake_new(ctx);
       if (!peer->handshake_params)
         return dtls_alert_fatal_create(DTLS_ALERT_INTERNAL_ERROR);
 
@@ -4181,8 +4184,20 @@ handle_0_verified_client_hello(dtls_context_t *ctx,
          dtls_ephemeral_peer_t *ephemeral_peer,
          uint8 *data, size_t data_length) {
   int err;
+  dtls_handshake_parameters_t *handshake;
+  dtls_peer_t *peer;
+
+  /* msg contains a ClientHello with a valid cookie, so this is the
+   * first point where handshake state is allocated. If all handshake
+   * slots are taken, the ClientHello is dropped before an existing
+   * peer for this session is touched; the client will retransmit. */
+  handshake = dtls_ctx_handshake_new(ctx);
+  if (!handshake) {
+    dtls_warn("no handshake slot available, dropping ClientHello\n");
+    return 0;
+  }
 
-  dtls_peer_t *peer = dtls_get_peer(ctx, ephemeral_peer->session);
+  peer = dtls_get_peer(ctx, ephemeral_peer->session);
   if (peer) {
      dtls_debug("removing the peer, new handshake\n");
      dtls_destroy_peer(ctx, peer, 0);
@@ -4190,14 +4205,14 @@ handle_0_verified_client_hello(dtls_context_t *ctx,
   }
   dtls_debug("creating new peer\n");
 
-  /* msg contains a ClientHello with a valid cookie, so we can
-   * safely create the server state machine and continue with
-   * the handshake. */
+  /* create the server state machine and continue with the handshake */
   peer = dtls_new_peer(ephemeral_peer->session);
   if (!peer) {
     dtls_alert("cannot create peer\n");
+    dtls_ctx_handshake_free(ctx, handshake);
     return dtls_alert_fatal_create(DTLS_ALERT_INTERNAL_ERROR);
   }
+  peer->handshake_params = handshake;
   peer->role = DTLS_SERVER;
 
   dtls_security_parameters_t *security = dtls_security_params(peer);
@@ -4209,14 +4224,8 @@ handle_0_verified_client_hello(dtls_context_t *ctx,
 
   if (dtls_add_peer(ctx, peer) < 0) {
     dtls_alert("cannot add peer\n");
-    dtls_free_peer(peer);
-    return dtls_alert_fatal_create(DTLS_ALERT_INTERNAL_ERROR);
-  }
-
-  peer->handshake_params = dtls_handshake_new();
-  if (!peer->handshake_params) {
-    dtls_alert("cannot create handshake parameter\n");
-    DEL_PEER(ctx->peers, peer);
+    dtls_ctx_handshake_free(ctx, peer->handshake_params);
+    peer->handshake_params = NULL;
     dtls_free_peer(peer);
     return dtls_alert_fatal_create(DTLS_ALERT_INTERNAL_ERROR);
   }
@@ -4492,7 +4501,7 @@ handle_alert(dtls_context_t *ctx, dtls_peer_t *peer,
     else
       dtls_alert("%d invalidate peer\n", data[1]);
 
-    DEL_PEER(ctx->peers, peer);
+    dtls_peer_table_remove(&ctx->peers, peer);
 
 #ifdef WITH_CONTIKI
 #ifndef NDEBUG
@@ -4802,6 +4811,7 @@ dtls_context_t *
 dtls_new_context(void *app_data) {
   dtls_context_t *c;
   dtls_tick_t now;
+  uint32_t seed;
 
   dtls_ticks(&now);
   dtls_prng_init(now);
@@ -4826,6 +4836,10 @@ dtls_new_context(void *app_data) {
   else
     goto error;
 
+  if (!dtls_prng((unsigned char *)&seed, sizeof(seed)))
+    goto error;
+  dtls_peer_table_init(&c->peers, seed);
+
   return c;
 
  error:
@@ -4842,21 +4856,19 @@ void dtls_reset_peer(dtls_context_t *ctx, dtls_peer_t *peer)
 
 void
 dtls_free_context(dtls_context_t *ctx) {
-  dtls_peer_t *p, *tmp;
+  dtls_peer_t *p;
+  unsigned int i;
 
   if (!ctx) {
     return;
   }
 
-  if (ctx->peers) {
-#ifdef DTLS_PEERS_NOHASH
-    LL_FOREACH_SAFE(ctx->peers, p, tmp) {
-#else /* DTLS_PEERS_NOHASH */
-    HASH_ITER(hh, ctx->peers, p, tmp) {
-#endif /* DTLS_PEERS_NOHASH */
+  for (i = 0; i < ctx->peers.size; i++) {
+    /* removing a peer may move the next one into this slot */
+    while ((p = ctx->peers.slots[i]) != NULL)
       dtls_destroy_peer(ctx, p, DTLS_DESTROY_CLOSE);
-    }
   }
+  dtls_peer_table_free(&ctx->peers);
 
   free_context(ctx);
 }
@@ -4885,15 +4897,20 @@ dtls_connect_peer(dtls_context_t *ctx, dtls_peer_t *peer) {
   /* set local peer role to client, remote is server */
   peer->role = DTLS_CLIENT;
 
+  /* Allocated before the peer is added, so that a peer without
+   * handshake state is never left in the peer table. */
+  peer->handshake_params = dtls_ctx_handshake_new(ctx);
+  if (!peer->handshake_params)
+    return -1;
+
   if (dtls_add_peer(ctx, peer) < 0) {
     dtls_alert("cannot add peer\n");
+    dtls_ctx_handshake_free(ctx, peer->handshake_params);
+    peer->handshake_params = NULL;
     return -1;
   }
 
   /* send ClientHello with empty Cookie */
-  peer->handshake_params = dtls_handshake_new();
-      if (!peer->handshake_params)
-        return -1;
 
   peer->handshake_params->hs_state.mseq_r = 0;
   peer->handshake_params->hs_state.mseq_s = 0;
@@ -4909,12 +4926,15 @@ dtls_connect_peer(dtls_context_t *ctx, dtls_peer_t *peer) {
 int
 dtls_connect(dtls_context_t *ctx, const session_t *dst) {
   dtls_peer_t *peer;
+  int created = 0;
   int res;
 
   peer = dtls_get_peer(ctx, dst);
 
-  if (!peer)
+  if (!peer) {
     peer = dtls_new_peer(dst);
+    created = 1;
+  }
 
   if (!peer) {
     dtls_crit("cannot create new peer\n");
@@ -4922,6 +4942,11 @@ dtls_connect(dtls_context_t *ctx, const session_t *dst) {
   }
 
   res = dtls_connect_peer(ctx, peer);
+  if (res < 0 && created && dtls_get_peer(ctx, dst) != peer) {
+    /* not added to ctx, so it would not be freed otherwise */
+    dtls_free_peer(peer);
+    return res;
+  }
 
   /* Invoke event callback to indicate connection attempt or
    * re-negotiation. */
@@ -31,8 +31,6 @@
 #include "state.h"
 #include "peer.h"
 
-#include "uthash.h"
-
 #include "alert.h"
 #include "crypto.h"
 #include "hmac.h"
@@ -228,7 +226,8 @@ typedef struct dtls_context_t {
   unsigned char cookie_secret[DTLS_COOKIE_SECRET_LENGTH];
   clock_time_t cookie_secret_age; /**< the time the secret has been generated */
 
-  dtls_peer_t *peers;		/**< peer hash map */
+  dtls_peer_table_t peers;	/**< peer hash table */
+  unsigned int handshake_count;	/**< number of handshakes in progress */
 #ifdef WITH_CONTIKI
   struct etimer retransmit_timer; /**< fires when the next packet must be sent */
 #endif /* WITH_CONTIKI */
@@ -468,12 +467,6 @@ void dtls_reset_peer(dtls_context_t *context, dtls_peer_t *peer);
  * This software is under the <a 
  * href="http://www.opensource.org/licenses/mit-license.php">MIT License</a>.
  * 
- * @subsection uthash UTHash
- *
- * This library uses <a href="http://uthash.sourceforge.net/">uthash</a> to manage
- * its peers (not used for Contiki). @b uthash uses the <b>BSD revised license</b>, see
- * <a href="http://uthash.sourceforge.net/license.html">http://uthash.sourceforge.net/license.html</a>.
- *
  * @subsection sha256 Aaron D. Gifford's SHA256 Implementation
  *
  * tinyDTLS provides HMAC-SHA256 with BSD-licensed code from Aaron D. Gifford, 
@@ -77,6 +77,7 @@ static void rshiftby(const uint32_t *in, uint8_t in_size, uint32_t *out, uint8_t
 }
 
 //finite field functions
+#ifdef TEST_INCLUDE
 //FFFFFFFF00000001000000000000000000000000FFFFFFFFFFFFFFFFFFFFFFFF
 static const uint32_t ecc_prime_m[8] = {0xffffffff, 0xffffffff, 0xffffffff, 0x00000000,
 					0x00000000, 0x00000000, 0x00000001, 0xffffffff};
@@ -85,6 +86,7 @@ static const uint32_t ecc_prime_m[8] = {0xffffffff, 0xffffffff, 0xffffffff, 0x00
 /* This is added after an static byte addition if the answer has a carry in MSB*/
 static const uint32_t ecc_prime_r[8] = {0x00000001, 0x00000000, 0x00000000, 0xffffffff,
 					0xffffffff, 0xffffffff, 0xfffffffe, 0x00000000};
+#endif /* TEST_INCLUDE */
 
 // ffffffff00000000ffffffffffffffffbce6faada7179e84f3b9cac2fc632551
 static const uint32_t ecc_order_m[9] = {0xFC632551, 0xF3B9CAC2, 0xA7179E84, 0xBCE6FAAD,
@@ -135,6 +137,8 @@ static int isGreater(const uint32_t *A, const uint32_t *B, uint8_t length){
 }
 
 
+#ifdef TEST_INCLUDE
+/* the field functions below are only used by the tests */
 static int fieldAdd(const uint32_t *x, const uint32_t *y, const uint32_t *reducer, uint32_t *result){
 	if(add(x, y, result, arrayLength)){ //add prime if carry is still set!
 		uint32_t tempas[8];
@@ -144,6 +148,7 @@ static int fieldAdd(const uint32_t *x, const uint32_t *y, const uint32_t *reduce
 	}
 	return 0;
 }
+#endif /* TEST_INCLUDE */
 
 static int fieldSub(const uint32_t *x, const uint32_t *y, const uint32_t *modulus, uint32_t *result){
 	if(sub(x, y, result, arrayLength)){ //add modulus if carry is set
@@ -177,6 +182,7 @@ static int fieldMult(const uint32_t *x, const uint32_t *y, uint32_t *result, uin
 	return 0;
 }
 
+#ifdef TEST_INCLUDE
 //TODO: maximum:
 //fffffffe00000002fffffffe0000000100000001fffffffe00000001fffffffe00000001fffffffefffffffffffffffffffffffe000000000000000000000001_16
 static void fieldModP(uint32_t *A, const uint32_t *B)
@@ -253,6 +259,8 @@ static void fieldModP(uint32_t *A, const uint32_t *B)
 	}
 }
 
+#endif /* TEST_INCLUDE */
+
 /**
  * calculate the result = A mod n.
  * n is the order of the eliptic curve.
@@ -427,108 +435,550 @@ static void fieldInv(const uint32_t *A, const uint32_t *modulus, const uint32_t
 	}
 }
 
-static void ec_double(const uint32_t *px, const uint32_t *py, uint32_t *Dx, uint32_t *Dy){
-	uint32_t tempA[8];
-	uint32_t tempB[8];
-	uint32_t tempC[8];
-	uint32_t tempD[16];
+/*
+ * Point arithmetic.
+ *
+ * Field elements are kept in Montgomery form (a * 2^256 mod p), in four
+ * 64-bit limbs where the compiler has a 128-bit type and in eight 32-bit
+ * limbs otherwise. Points are kept in Jacobian coordinates (X, Y, Z)
+ * for x = X / Z^2, y = Y / Z^3, so no inversion is needed until the
+ * result is converted back. Z = 0 is the point at infinity.
+ *
+ * The scalar multiplications only branch on the scalar bits through
+ * masks, and only look up their tables by scanning all entries, so they
+ * take the same time for any secret.
+ */
+#if defined(__SIZEOF_INT128__) && !defined(ECC_NO_INT128)
+typedef uint64_t limb_t;
+__extension__ typedef unsigned __int128 dlimb_t;
+#define LIMB_BITS 64
+#define FE(a0, a1, a2, a3, a4, a5, a6, a7) {				\
+		(uint64_t)(a1) << 32 | (a0), (uint64_t)(a3) << 32 | (a2), \
+		(uint64_t)(a5) << 32 | (a4), (uint64_t)(a7) << 32 | (a6) }
+#else
+typedef uint32_t limb_t;
+typedef uint64_t dlimb_t;
+#define LIMB_BITS 32
+#define FE(a0, a1, a2, a3, a4, a5, a6, a7) { a0, a1, a2, a3, a4, a5, a6, a7 }
+#endif
+#define LIMBS (256 / LIMB_BITS)
+
+/* the borrow out of a limb subtraction done in dlimb_t */
+#define borrow_of(d) ((limb_t)((d) >> LIMB_BITS) & 1)
+
+typedef limb_t fe_t[LIMBS];
+
+typedef struct {
+	fe_t x, y, z;
+} jpoint_t;
+
+typedef struct {
+	fe_t x, y;
+} apoint_t;
+
+static const fe_t fe_p = FE(0xffffffff, 0xffffffff, 0xffffffff, 0x00000000,
+			    0x00000000, 0x00000000, 0x00000001, 0xffffffff);
+/* 2^512 mod p, to convert into Montgomery form */
+static const fe_t fe_rr = FE(0x00000003, 0x00000000, 0xffffffff, 0xfffffffb,
+			     0xfffffffe, 0xffffffff, 0xfffffffd, 0x00000004);
+/* 1 in Montgomery form */
+static const fe_t fe_one = FE(0x00000001, 0x00000000, 0x00000000, 0xffffffff,
+			      0xffffffff, 0xffffffff, 0xfffffffe, 0x00000000);
+
+/* r = (hi * 2^256 + a) mod p for a value below 2p */
+static void fe_reduce_once(fe_t r, const limb_t *a, limb_t hi){
+	fe_t t;
+	dlimb_t d = 0;
+	limb_t borrow, mask;
+	int i;
 
-	if(isZero(px) && isZero(py)){
-		copy(px, Dx,arrayLength);
-		copy(py, Dy,arrayLength);
-		return;
+	for (i = 0; i < LIMBS; i++) {
+		d = (dlimb_t)a[i] - fe_p[i] - borrow_of(d);
+		t[i] = (limb_t)d;
 	}
+	borrow = borrow_of(d);
+	/* keep a if it was below p, i.e. no carry in and a borrow out */
+	mask = (limb_t)0 - (borrow & (hi ^ 1));
+	for (i = 0; i < LIMBS; i++)
+		r[i] = (a[i] & mask) | (t[i] & ~mask);
+}
 
-	fieldMult(px, px, tempD, arrayLength);
-	fieldModP(tempA, tempD);
-	setZero(tempB, 8);
-	tempB[0] = 0x00000001;
-	fieldSub(tempA, tempB, ecc_prime_m, tempC); //tempC = (qx^2-1)
-	tempB[0] = 0x00000003;
-	fieldMult(tempC, tempB, tempD, arrayLength);
-	fieldModP(tempA, tempD);//tempA = 3*(qx^2-1)
-	fieldAdd(py, py, ecc_prime_r, tempB); //tempB = 2*qy
-	fieldInv(tempB, ecc_prime_m, ecc_prime_r, tempC); //tempC = 1/(2*qy)
-	fieldMult(tempA, tempC, tempD, arrayLength); //tempB = lambda = (3*(qx^2-1))/(2*qy)
-	fieldModP(tempB, tempD);
-
-	fieldMult(tempB, tempB, tempD, arrayLength); //tempC = lambda^2
-	fieldModP(tempC, tempD);
-	fieldSub(tempC, px, ecc_prime_m, tempA); //lambda^2 - Px
-	fieldSub(tempA, px, ecc_prime_m, Dx); //lambda^2 - Px - Qx
-
-	fieldSub(px, Dx, ecc_prime_m, tempA); //tempA = qx-dx
-	fieldMult(tempB, tempA, tempD, arrayLength); //tempC = lambda * (qx-dx)
-	fieldModP(tempC, tempD);
-	fieldSub(tempC, py, ecc_prime_m, Dy); //Dy = lambda * (qx-dx) - px
+static void fe_add(fe_t r, const fe_t a, const fe_t b){
+	limb_t t[LIMBS];
+	dlimb_t c = 0;
+	int i;
+
+	for (i = 0; i < LIMBS; i++) {
+		c += (dlimb_t)a[i] + b[i];
+		t[i] = (limb_t)c;
+		c >>= LIMB_BITS;
+	}
+	fe_reduce_once(r, t, (limb_t)c);
 }
 
-static void ec_add(const uint32_t *px, const uint32_t *py, const uint32_t *qx, const uint32_t *qy, uint32_t *Sx, uint32_t *Sy){
-	uint32_t tempA[8];
-	uint32_t tempB[8];
-	uint32_t tempC[8];
-	uint32_t tempD[16];
+static void fe_sub(fe_t r, const fe_t a, const fe_t b){
+	dlimb_t d = 0, c = 0;
+	limb_t mask;
+	int i;
 
-	if(isZero(px) && isZero(py)){
-		copy(qx, Sx,arrayLength);
-		copy(qy, Sy,arrayLength);
-		return;
-	} else if(isZero(qx) && isZero(qy)) {
-		copy(px, Sx,arrayLength);
-		copy(py, Sy,arrayLength);
+	for (i = 0; i < LIMBS; i++) {
+		d = (dlimb_t)a[i] - b[i] - borrow_of(d);
+		r[i] = (limb_t)d;
+	}
+	/* add p back on a borrow */
+	mask = (limb_t)0 - borrow_of(d);
+	for (i = 0; i < LIMBS; i++) {
+		c += (dlimb_t)r[i] + (fe_p[i] & mask);
+		r[i] = (limb_t)c;
+		c >>= LIMB_BITS;
+	}
+}
+
+/*
+ * Montgomery multiplication, r = a * b / 2^256 mod p. As p = -1 mod
+ * 2^96, -1/p mod 2^LIMB_BITS is 1 and the factor for each reduction
+ * step is just the lowest limb.
+ */
+static void fe_mul(fe_t r, const fe_t a, const fe_t b){
+	limb_t t[LIMBS + 2];
+	dlimb_t c;
+	limb_t m;
+	int i, j;
+
+	memset(t, 0, sizeof(t));
+	for (i = 0; i < LIMBS; i++) {
+		c = 0;
+		for (j = 0; j < LIMBS; j++) {
+			c += (dlimb_t)a[j] * b[i] + t[j];
+			t[j] = (limb_t)c;
+			c >>= LIMB_BITS;
+		}
+		c += t[LIMBS];
+		t[LIMBS] = (limb_t)c;
+		t[LIMBS + 1] = (limb_t)(c >> LIMB_BITS);
+
+		m = t[0];
+		c = ((dlimb_t)m * fe_p[0] + t[0]) >> LIMB_BITS;
+		for (j = 1; j < LIMBS; j++) {
+			c += (dlimb_t)m * fe_p[j] + t[j];
+			t[j - 1] = (limb_t)c;
+			c >>= LIMB_BITS;
+		}
+		c += t[LIMBS];
+		t[LIMBS - 1] = (limb_t)c;
+		t[LIMBS] = t[LIMBS + 1] + (limb_t)(c >> LIMB_BITS);
+	}
+	fe_reduce_once(r, t, t[LIMBS]);
+}
+
+static void fe_sqr(fe_t r, const fe_t a){
+	fe_mul(r, a, a);
+}
+
+/* r = 1 / a, as a^(p - 2) */
+static void fe_inv(fe_t r, const fe_t a){
+	/* p - 2 */
+	static const uint32_t e[8] = {0xfffffffd, 0xffffffff, 0xffffffff, 0x00000000,
+				      0x00000000, 0x00000000, 0x00000001, 0xffffffff};
+	fe_t t;
+	int i;
+
+	memcpy(t, fe_one, sizeof(t));
+	for (i = 255; i >= 0; i--) {
+		fe_sqr(t, t);
+		if (e[i / 32] & ((uint32_t)1 << (i % 32)))
+			fe_mul(t, t, a);
+	}
+	memcpy(r, t, sizeof(t));
+}
+
+/* all ones if a is 0, else 0 */
+static limb_t fe_zero_mask(const fe_t a){
+	limb_t t = 0;
+	int i;
+
+	for (i = 0; i < LIMBS; i++)
+		t |= a[i];
+	/* the top bit of t | -t is set unless t is 0 */
+	return ((t | ((limb_t)0 - t)) >> (LIMB_BITS - 1)) - 1;
+}
+
+/* r = a where mask is all ones */
+static void fe_cmov(fe_t r, const fe_t a, limb_t mask){
+	int i;
+
+	for (i = 0; i < LIMBS; i++)
+		r[i] ^= (r[i] ^ a[i]) & mask;
+}
+
+static void fe_from_words(fe_t r, const uint32_t *w){
+	int i;
+
+	for (i = 0; i < LIMBS; i++) {
+#if LIMB_BITS == 64
+		r[i] = (limb_t)w[2 * i + 1] << 32 | w[2 * i];
+#else
+		r[i] = w[i];
+#endif
+	}
+	fe_mul(r, r, fe_rr);
+}
+
+static void fe_to_words(uint32_t *w, const fe_t a){
+	static const fe_t one = { 1 };
+	fe_t t;
+	int i;
+
+	fe_mul(t, a, one);
+	for (i = 0; i < LIMBS; i++) {
+#if LIMB_BITS == 64
+		w[2 * i] = (uint32_t)t[i];
+		w[2 * i + 1] = (uint32_t)(t[i] >> 32);
+#else
+		w[i] = t[i];
+#endif
+	}
+}
+
+static void point_set_infinity(jpoint_t *r){
+	memcpy(r->x, fe_one, sizeof(fe_t));
+	memcpy(r->y, fe_one, sizeof(fe_t));
+	memset(r->z, 0, sizeof(fe_t));
+}
+
+static void point_from_affine(jpoint_t *r, const uint32_t *x, const uint32_t *y){
+	fe_from_words(r->x, x);
+	fe_from_words(r->y, y);
+	memcpy(r->z, fe_one, sizeof(fe_t));
+}
+
+/* the point at infinity comes out as (0, 0) */
+static void point_to_affine(uint32_t *x, uint32_t *y, const jpoint_t *p){
+	fe_t zi, zi2, t;
+
+	if (fe_zero_mask(p->z)) {
+		setZero(x, arrayLength);
+		setZero(y, arrayLength);
 		return;
 	}
+	fe_inv(zi, p->z);
+	fe_sqr(zi2, zi);
+	fe_mul(t, p->x, zi2);
+	fe_to_words(x, t);
+	fe_mul(zi2, zi2, zi);
+	fe_mul(t, p->y, zi2);
+	fe_to_words(y, t);
+}
 
-	if(isSame(px, qx, arrayLength)){
-		if(!isSame(py, qy, arrayLength)){
-			setZero(Sx, 8);
-			setZero(Sy, 8);
-			return;
+/* r = 2 * p, dbl-2001-b for a = -3; works in place and on infinity */
+static void point_double(jpoint_t *r, const jpoint_t *p){
+	fe_t delta, gamma, beta, alpha, t1, t2;
+
+	fe_sqr(delta, p->z);
+	fe_sqr(gamma, p->y);
+	fe_mul(beta, p->x, gamma);
+	fe_sub(t1, p->x, delta);
+	fe_add(t2, p->x, delta);
+	fe_mul(alpha, t1, t2);
+	fe_add(t1, alpha, alpha);
+	fe_add(alpha, alpha, t1);		/* alpha = 3 * (x - delta) * (x + delta) */
+
+	fe_add(t1, p->y, p->z);
+	fe_sqr(t1, t1);
+	fe_sub(t1, t1, gamma);
+	fe_sub(r->z, t1, delta);		/* z3 = (y + z)^2 - gamma - delta */
+
+	fe_add(beta, beta, beta);
+	fe_add(beta, beta, beta);		/* beta = 4 * beta */
+	fe_sqr(t1, alpha);
+	fe_add(t2, beta, beta);
+	fe_sub(r->x, t1, t2);			/* x3 = alpha^2 - 8 * beta */
+
+	fe_sub(t1, beta, r->x);
+	fe_mul(t1, alpha, t1);
+	fe_sqr(gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_sub(r->y, t1, gamma);		/* y3 = alpha * (4 * beta - x3) - 8 * gamma^2 */
+}
+
+/*
+ * r = p + q, add-2007-bl. If q is affine (q->z is not used then, and
+ * q_inf tells whether q is the point at infinity) this is madd-2007-bl
+ * instead. Infinity on either side is handled through masks, only
+ * adding a point to itself takes a different path, which the scalar
+ * multiplications below do not run into for scalars below the order.
+ */
+static void point_add(jpoint_t *r, const jpoint_t *p, const jpoint_t *q,
+		      int q_affine, limb_t q_inf){
+	fe_t z1z1, z2z2, u1, u2, s1, s2, h, i, j, rr, v, t;
+	limb_t p_inf, special;
+	jpoint_t res;
+
+	p_inf = fe_zero_mask(p->z);
+	if (!q_affine)
+		q_inf = fe_zero_mask(q->z);
+
+	fe_sqr(z1z1, p->z);
+	fe_mul(u2, q->x, z1z1);
+	fe_mul(s2, q->y, p->z);
+	fe_mul(s2, s2, z1z1);
+	if (q_affine) {
+		memcpy(u1, p->x, sizeof(fe_t));
+		memcpy(s1, p->y, sizeof(fe_t));
+	} else {
+		fe_sqr(z2z2, q->z);
+		fe_mul(u1, p->x, z2z2);
+		fe_mul(s1, p->y, q->z);
+		fe_mul(s1, s1, z2z2);
+	}
+	fe_sub(h, u2, u1);
+	fe_sub(rr, s2, s1);
+
+	special = fe_zero_mask(h) & ~p_inf & ~q_inf;
+	if (special) {
+		if (fe_zero_mask(rr)) {
+			jpoint_t d;
+
+			memcpy(d.x, q->x, sizeof(fe_t));
+			memcpy(d.y, q->y, sizeof(fe_t));
+			memcpy(d.z, q_affine ? fe_one : q->z, sizeof(fe_t));
+			point_double(r, &d);
 		} else {
-			ec_double(px, py, Sx, Sy);
-			return;
+			point_set_infinity(r);
 		}
+		return;
+	}
+
+	fe_add(i, h, h);
+	fe_sqr(i, i);				/* i = (2 * h)^2 */
+	fe_mul(j, h, i);
+	fe_add(rr, rr, rr);			/* r = 2 * (s2 - s1) */
+	fe_mul(v, u1, i);
+
+	fe_sqr(t, rr);
+	fe_sub(t, t, j);
+	fe_sub(t, t, v);
+	fe_sub(res.x, t, v);			/* x3 = r^2 - j - 2 * v */
+
+	fe_sub(t, v, res.x);
+	fe_mul(t, rr, t);
+	fe_mul(s1, s1, j);
+	fe_add(s1, s1, s1);
+	fe_sub(res.y, t, s1);			/* y3 = r * (v - x3) - 2 * s1 * j */
+
+	if (q_affine) {
+		fe_add(t, p->z, p->z);
+		fe_mul(res.z, t, h);		/* z3 = 2 * z1 * h */
+	} else {
+		fe_add(t, p->z, q->z);
+		fe_sqr(t, t);
+		fe_sub(t, t, z1z1);
+		fe_sub(t, t, z2z2);
+		fe_mul(res.z, t, h);		/* z3 = ((z1 + z2)^2 - z1z1 - z2z2) * h */
 	}
 
-	fieldSub(py, qy, ecc_prime_m, tempA);
-	fieldSub(px, qx, ecc_prime_m, tempB);
-	fieldInv(tempB, ecc_prime_m, ecc_prime_r, tempB);
-	fieldMult(tempA, tempB, tempD, arrayLength); 
-	fieldModP(tempC, tempD); //tempC = lambda
+	/* p + infinity = p, infinity + q = q */
+	fe_cmov(res.x, p->x, q_inf);
+	fe_cmov(res.y, p->y, q_inf);
+	fe_cmov(res.z, p->z, q_inf);
+	fe_cmov(res.x, q->x, p_inf);
+	fe_cmov(res.y, q->y, p_inf);
+	fe_cmov(res.z, q_affine ? fe_one : q->z, p_inf);
+	*r = res;
+}
 
-	fieldMult(tempC, tempC, tempD, arrayLength); //tempA = lambda^2
-	fieldModP(tempA, tempD);
-	fieldSub(tempA, px, ecc_prime_m, tempB); //lambda^2 - Px
-	fieldSub(tempB, qx, ecc_prime_m, Sx); //lambda^2 - Px - Qx
+/* all ones if a == b, else 0 */
+static limb_t eq_mask(uint32_t a, uint32_t b){
+	uint32_t t = a ^ b;
 
-	fieldSub(qx, Sx, ecc_prime_m, tempB);
-	fieldMult(tempC, tempB, tempD, arrayLength);
-	fieldModP(tempC, tempD);
-	fieldSub(tempC, qy, ecc_prime_m, Sy);
+	return (limb_t)0 - (limb_t)(((t | ((uint32_t)0 - t)) >> 31) ^ 1);
 }
 
-void ecc_ec_mult(const uint32_t *px, const uint32_t *py, const uint32_t *secret, uint32_t *resultx, uint32_t *resulty){
-	uint32_t Qx[8];
-	uint32_t Qy[8];
-	setZero(Qx, 8);
-	setZero(Qy, 8);
+/*
+ * Fixed window scalar multiplication for any point: 64 windows of 4 bits,
+ * each costs four doublings and one addition of 0..15 * P.
+ */
+static void point_mult(jpoint_t *r, const jpoint_t *p, const uint32_t *k){
+	jpoint_t table[16];
+	jpoint_t q, t;
+	limb_t mask;
+	uint32_t digit;
+	int i, n;
+
+	point_set_infinity(&table[0]);
+	table[1] = *p;
+	for (i = 2; i < 16; i++) {
+		if (i & 1)
+			point_add(&table[i], &table[i - 1], p, 0, 0);
+		else
+			point_double(&table[i], &table[i / 2]);
+	}
 
-	uint32_t tempx[8];
-	uint32_t tempy[8];
+	point_set_infinity(&q);
+	for (i = 63; i >= 0; i--) {
+		if (i != 63) {
+			point_double(&q, &q);
+			point_double(&q, &q);
+			point_double(&q, &q);
+			point_double(&q, &q);
+		}
+		digit = (k[i / 8] >> (4 * (i % 8))) & 0xf;
+		memset(&t, 0, sizeof(t));
+		for (n = 0; n < 16; n++) {
+			mask = eq_mask(digit, n);
+			fe_cmov(t.x, table[n].x, mask);
+			fe_cmov(t.y, table[n].y, mask);
+			fe_cmov(t.z, table[n].z, mask);
+		}
+		point_add(&q, &q, &t, 0, 0);
+	}
+	*r = q;
+}
 
-	int i;
-	for (i = 256;i--;){
-		ec_double(Qx, Qy, tempx, tempy);
-		copy(tempx, Qx,arrayLength);
-		copy(tempy, Qy,arrayLength);
-		if (((secret[i / 32]) & ((uint32_t)1 << (i % 32)))) {
-			ec_add(Qx, Qy, px, py, tempx, tempy); //eccAdd
-			copy(tempx, Qx,arrayLength);
-			copy(tempy, Qy,arrayLength);
+/*
+ * Comb for the base point with 5 teeth 52 bits apart: entry i - 1 is
+ * the sum of 2^(52 * t) * G over the bits t set in i, in affine
+ * Montgomery form.
+ */
+#define COMB_TEETH 5
+#define COMB_SPACING 52
+
+static const apoint_t comb_table[(1 << COMB_TEETH) - 1] = {
+	{ FE(0x18a9143c, 0x79e730d4, 0x5fedb601, 0x75ba95fc, 0x77622510, 0x79fb732b, 0xa53755c6, 0x18905f76),
+	  FE(0xce95560a, 0xddf25357, 0xba19e45c, 0x8b4ab8e4, 0xdd21f325, 0xd2e88688, 0x25885d85, 0x8571ff18) },
+	{ FE(0xceca9754, 0x83f49167, 0x4b7939a0, 0x426d2cf6, 0x723fd0bf, 0x2555e355, 0xc4f144e2, 0xa96e6d06),
+	  FE(0x87880e61, 0x4768a8dd, 0xe508e4d5, 0x15543815, 0xb1b65e15, 0x09d7e772, 0xac302fa0, 0x63439dd6) },
+	{ FE(0xa0be5d0e, 0xf2675562, 0x4d1bb068, 0x4b524d25, 0xa9b75b8c, 0xbc2c5ff2, 0xd9a6f548, 0x4f326643),
+	  FE(0x1258835e, 0x50dd6844, 0x676090e0, 0x7d21beee, 0xf4a17b42, 0xb0b62c65, 0xb3cec3b0, 0x60dfae28) },
+	{ FE(0xcf7d62d2, 0x20d3c982, 0x23ba8150, 0x1f36e29d, 0x92763f9e, 0x48ae0bf0, 0x1d3a7007, 0x7a527e6b),
+	  FE(0x581a85e3, 0xb4a89097, 0xdc158be5, 0x1f1a520f, 0x167d726e, 0xf98db37d, 0x1113e862, 0x8802786e) },
+	{ FE(0xb113f918, 0x531e7b64, 0x920a681d, 0x26b5d70a, 0x24c37044, 0x04e52f8f, 0xbb7c375b, 0xbc7c9542),
+	  FE(0xf2e26375, 0xb63a044b, 0xe922a3d0, 0xd842a342, 0xa9292d57, 0x9eed2eca, 0x49ac7832, 0xfe27d2c2) },
+	{ FE(0xf24aab7e, 0xedbd7944, 0xcd1a1921, 0x56e51d9e, 0x962dae55, 0x11c63188, 0x326acd14, 0x37090565),
+	  FE(0xd71ed134, 0xc436e587, 0xad89b461, 0x3d96ac3a, 0xdcb718bb, 0xcdf570bc, 0xdcfabde2, 0xaaa490e9) },
+	{ FE(0x0b639942, 0xb0ab5401, 0x19379664, 0xa6e12f57, 0x1d040abc, 0xc535f8b4, 0xa75eef24, 0xef255c54),
+	  FE(0xaeceb0ea, 0xb236f734, 0x9d879e2f, 0x38fcc8c1, 0x180cacab, 0x674d8fdc, 0xf624df06, 0x0a18bad4) },
+	{ FE(0xca8d9d1a, 0x488f1185, 0xd987ded2, 0xadf2c77d, 0x60c46124, 0x5f3039f0, 0x71e095f4, 0xe5d70b75),
+	  FE(0x6260e70f, 0x82d58650, 0xf750d105, 0x39d75ea7, 0x75bac364, 0x8cf3d0b1, 0x21d01329, 0xf3a7564d) },
+	{ FE(0x60530d0a, 0x83fc8091, 0x7bc23dc8, 0x58c24f52, 0xa653af5a, 0xecde2f1f, 0xb10e511e, 0xb2e2a374),
+	  FE(0x9bebe1e4, 0xf0c54b32, 0xade42270, 0x239c25df, 0x9f22b433, 0xd866f55e, 0xed17efd3, 0x1e513ca2) },
+	{ FE(0x5bc98e0d, 0x66313dc8, 0x9a256888, 0xb13fe4e6, 0xecd6e280, 0x74816589, 0x5ba88474, 0xdee13cde),
+	  FE(0xc53bc78d, 0xae4e1872, 0x2f08a464, 0x9b79904a, 0x9da51935, 0xef6e5ce2, 0x083c47ea, 0x9e58df82) },
+	{ FE(0xf5a32632, 0x4e066713, 0x4b36f498, 0x431f75d4, 0x70bd5f07, 0x40ae279f, 0x239ec23d, 0x252cdb93),
+	  FE(0x7312a246, 0xc18dddf8, 0x23a9e561, 0x5b77673c, 0x1715fede, 0x020f09c3, 0xa580cfc5, 0xabef6451) },
+	{ FE(0xf2a0d962, 0x3c8bc3bf, 0x3405a8aa, 0x59f856ee, 0xb3dc5948, 0x2fb6590c, 0xed85740e, 0xc8aa740c),
+	  FE(0xe9aafe19, 0xf8081cfb, 0x2534800d, 0xf7d2e1f3, 0x8d78d247, 0x355148c2, 0xd1557399, 0xaf0dc5a4) },
+	{ FE(0xc7f68782, 0x34dfbfc4, 0x08ac2685, 0x2c6a80d6, 0x08d0255b, 0x5479e1bc, 0x9110c616, 0x42eb9de0),
+	  FE(0x10b4acba, 0x97991dd8, 0x94d997c7, 0xf36acc8f, 0x69ddc036, 0xd05ad78b, 0xe68b4243, 0x1ac7e528) },
+	{ FE(0xe82c8e2a, 0xdd9f8a00, 0x21f80126, 0x104b85c6, 0x5b17a522, 0x1997228d, 0x923d0bd0, 0x706e5ec3),
+	  FE(0x1dc33622, 0x00c6af27, 0x271f09e1, 0xb3bc76c8, 0xe36e325a, 0xec1b7c0b, 0x68f12bfe, 0x128200e2) },
+	{ FE(0xa8636d07, 0x8e86cb3d, 0x2be46da2, 0xc79c42ac, 0xaa01e0e1, 0xed70e08a, 0xe3b69272, 0x773579fc),
+	  FE(0x4d8464c3, 0xbc0fe555, 0xcf54e071, 0x9e87a057, 0x3913b1d3, 0xda655b0a, 0x9a55dba4, 0x052774d4) },
+	{ FE(0xadf7cccf, 0x75d9bc15, 0xdfa1e1b0, 0x81a3e5d6, 0x249bc17e, 0x8c39e444, 0x8ea7fd43, 0xf37dccb2),
+	  FE(0x907fba12, 0xda654873, 0x4a372904, 0x35daa6da, 0x6283a6c5, 0x0564cfc6, 0x4a9395bf, 0xd09fa4f6) },
+	{ FE(0xe37542ca, 0xb1f5c026, 0x72e01034, 0x0b860cf3, 0x025289f2, 0x3a7c10e4, 0x92901032, 0xd2197d5f),
+	  FE(0x267ca2f6, 0xfa06f835, 0xbf6e43aa, 0x8fcb9a29, 0x7ed9f8e7, 0x465f6c11, 0xe6077aaf, 0x8a50a5b3) },
+	{ FE(0xd2b59e85, 0xad76c703, 0x9204c53f, 0x0a230645, 0x4a9f1335, 0x9bbc0bc4, 0xd0a967e9, 0x71603515),
+	  FE(0xa0205375, 0x8b6d6d6e, 0x51ad76de, 0x63104183, 0xaabbd0ac, 0x5abfbc21, 0xc71f3060, 0x61fb45c3) },
+	{ FE(0x1d323961, 0x579345df, 0x94cd3bc4, 0x45b79ead, 0x423668d2, 0x50b664be, 0x42bc26ea, 0x19dd5b75),
+	  FE(0x3677ae8f, 0xc7c1fbaa, 0x5d033158, 0x7b2e711a, 0x8942ac93, 0x8aecb50a, 0x8a16718c, 0xe255438b) },
+	{ FE(0x33396533, 0x80253642, 0x2c5ad150, 0x82cb33a7, 0x070ca168, 0x7c147998, 0x6aac6636, 0x07791253),
+	  FE(0x7c78be24, 0x160003ae, 0xa30eeabf, 0xbba9fe68, 0x3073f0ed, 0x16c31c40, 0x789caeca, 0xd329cd28) },
+	{ FE(0x7972bcdf, 0x840dbcbf, 0xbd11900c, 0xb5c8444f, 0x16520cee, 0x78b2b290, 0xbe88d914, 0xe19f13a3),
+	  FE(0x49d3c0df, 0x052ddc89, 0xe0b4224b, 0xc9fc183c, 0xcf31e0bb, 0x2c8dd074, 0xa26b1441, 0x872c7b95) },
+	{ FE(0x74c8a327, 0xed93585d, 0x06be87ca, 0xf2fb7d08, 0x84e36244, 0x707d83ca, 0x3efa6833, 0x037f499d),
+	  FE(0x99bf5dde, 0xf3218d42, 0x69ff7ce3, 0xbe0a81c0, 0x9eb7d4c0, 0x068fbbea, 0xe6938c78, 0xf4ef6609) },
+	{ FE(0xcb22715e, 0x202e5c5a, 0x288f8243, 0x88e93d23, 0xdc7eace6, 0xdf1d1f52, 0x373183f8, 0xc6b38b3b),
+	  FE(0x3eac9c4b, 0x77798b7f, 0x6bfa9835, 0xa9d37dff, 0xfaac41c9, 0xaff4a447, 0x0fcb6036, 0xf14fd13c) },
+	{ FE(0x49ccc093, 0xef5ee27d, 0x40d359a3, 0x7ff3263d, 0xc6d6c0ea, 0x885d1942, 0x28c97fee, 0x925abba3),
+	  FE(0x5d95f52d, 0xd7383480, 0x4eb691db, 0x6979981c, 0x553a29c6, 0x6544e8ae, 0x5043559f, 0x28324ef8) },
+	{ FE(0x300c0e39, 0xd6c8e4b7, 0x3e37f58a, 0x37ad4a1a, 0xe5e8cdfb, 0x763330f5, 0x870ea133, 0x62bf8c2c),
+	  FE(0x763ccac9, 0x03fbc63a, 0xfb1886c0, 0xc889d8a5, 0xbe49d9fe, 0xf0486de5, 0x62c23338, 0xaf9a8778) },
+	{ FE(0x76aa81b3, 0x8a43a2a1, 0x8a0cc3d2, 0x89602129, 0x821f6640, 0x49d311e8, 0x5c734ae4, 0x8035608f),
+	  FE(0x349adc3b, 0xa7be0561, 0x96a337b5, 0x328525b2, 0x6bccf78a, 0x575413c3, 0x4854960f, 0x6c7292ec) },
+	{ FE(0x3c2943ff, 0x121e6a71, 0x6374c47e, 0x0468565c, 0x2826f138, 0xd66fe993, 0x7748e3ac, 0x4e2cfaf1),
+	  FE(0x4708a6c8, 0xe9baaa2c, 0x66ffb5b4, 0xa3845c8c, 0xb77c8fac, 0xad3e293e, 0x440a35e8, 0x00b5cfa9) },
+	{ FE(0x63e06277, 0x3f55f58c, 0x64ba6e8c, 0x1a81de8a, 0xf4cc043b, 0x85cfdc74, 0x048d26e0, 0x7cbefb98),
+	  FE(0x82aba891, 0x5bde4b3c, 0x86db6f46, 0x863d8f75, 0x845186c5, 0xc7af5c1f, 0xcb527cec, 0x41d7d404) },
+	{ FE(0x83e1a246, 0x3b446994, 0xf6b819a2, 0x11c5ced4, 0xaff79a46, 0xc79d4660, 0x5f22411a, 0x423bbdc1),
+	  FE(0xa964039d, 0x22652251, 0xe738657b, 0x808d6753, 0x4e909dc8, 0xc0ca19e3, 0x34ab0d07, 0x0e036e47) },
+	{ FE(0x7a26f742, 0x233593e7, 0xfc0f14d9, 0xddc1c79f, 0x2d359358, 0xb33c8980, 0x730aacfe, 0x51df6155),
+	  FE(0x0f2c0b8d, 0xa9a6066c, 0x2e706f80, 0xb9212227, 0x96a5efe9, 0x3994a532, 0x52316b12, 0xcf3d168b) },
+	{ FE(0x27eafcc0, 0xbe47dd50, 0xec7e66db, 0x23df1041, 0x78a4dddd, 0x18c977ff, 0x9d2d152e, 0xb51565d7),
+	  FE(0x78f4a4de, 0x24f6a6d5, 0x7d86b2ca, 0xbbc15b20, 0x1d3b43ca, 0xa064d39c, 0x52200839, 0x55248667) },
+};
+
+/* 52 doublings and 52 mixed additions for k * G */
+static void point_mult_base(jpoint_t *r, const uint32_t *k){
+	jpoint_t q, t;
+	limb_t mask;
+	uint32_t idx;
+	int i, n, bit;
+
+	point_set_infinity(&q);
+	for (i = COMB_SPACING - 1; i >= 0; i--) {
+		point_double(&q, &q);
+		idx = 0;
+		for (n = 0; n < COMB_TEETH; n++) {
+			bit = i + n * COMB_SPACING;
+			if (bit < 256)
+				idx |= ((k[bit / 32] >> (bit % 32)) & 1) << n;
+		}
+		memset(&t, 0, sizeof(t));
+		for (n = 0; n < (1 << COMB_TEETH) - 1; n++) {
+			mask = eq_mask(idx, n + 1);
+			fe_cmov(t.x, comb_table[n].x, mask);
+			fe_cmov(t.y, comb_table[n].y, mask);
 		}
+		point_add(&q, &q, &t, 1, eq_mask(idx, 0));
+	}
+	*r = q;
+}
+
+#ifdef TEST_INCLUDE
+/* affine wrappers for the tests */
+static void ec_double(const uint32_t *px, const uint32_t *py, uint32_t *Dx, uint32_t *Dy){
+	jpoint_t p;
+
+	if(isZero(px) && isZero(py)){
+		copy(px, Dx,arrayLength);
+		copy(py, Dy,arrayLength);
+		return;
+	}
+	point_from_affine(&p, px, py);
+	point_double(&p, &p);
+	point_to_affine(Dx, Dy, &p);
+}
+
+static void ec_add(const uint32_t *px, const uint32_t *py, const uint32_t *qx, const uint32_t *qy, uint32_t *Sx, uint32_t *Sy){
+	jpoint_t p, q;
+
+	if(isZero(px) && isZero(py))
+		point_set_infinity(&p);
+	else
+		point_from_affine(&p, px, py);
+	if(isZero(qx) && isZero(qy))
+		point_set_infinity(&q);
+	else
+		point_from_affine(&q, qx, qy);
+	point_add(&p, &p, &q, 0, 0);
+	point_to_affine(Sx, Sy, &p);
+}
+#endif /* TEST_INCLUDE */
+
+void ecc_ec_mult(const uint32_t *px, const uint32_t *py, const uint32_t *secret, uint32_t *resultx, uint32_t *resulty){
+	jpoint_t p;
+
+	if (isSame(px, ecc_g_point_x, arrayLength) &&
+	    isSame(py, ecc_g_point_y, arrayLength)) {
+		point_mult_base(&p, secret);
+	} else {
+		point_from_affine(&p, px, py);
+		point_mult(&p, &p, secret);
 	}
-	copy(Qx, resultx,arrayLength);
-	copy(Qy, resulty,arrayLength);
+	point_to_affine(resultx, resulty, &p);
 }
 
 /**
@@ -615,12 +1065,9 @@ int ecc_ecdsa_validate(const uint32_t *x, const uint32_t *y, const uint32_t *e,
 	uint32_t tmp[16];
 	uint32_t u1[9];
 	uint32_t u2[9];
-	uint32_t tmp1_x[8];
-	uint32_t tmp1_y[8];
-	uint32_t tmp2_x[8];
-	uint32_t tmp2_y[8];
 	uint32_t tmp3_x[8];
 	uint32_t tmp3_y[8];
+	jpoint_t p1, p2;
 
 	if (isZero(r) || isZero(s))
 		return -1;
@@ -637,15 +1084,11 @@ int ecc_ecdsa_validate(const uint32_t *x, const uint32_t *y, const uint32_t *e,
 	fieldModO(tmp, u2, 16);
 
 	// 5. Calculate the curve point (x_1, y_1) = u_1 * G + u_2 * Q_A.
-	// tmp1 = u_1 * G
-	ecc_ec_mult(ecc_g_point_x, ecc_g_point_y, u1, tmp1_x, tmp1_y);
-
-	// tmp2 = u_2 * Q_A
-	ecc_ec_mult(x, y, u2, tmp2_x, tmp2_y);
-
-	// tmp3 = tmp1 + tmp2
-	ec_add(tmp1_x, tmp1_y, tmp2_x, tmp2_y, tmp3_x, tmp3_y);
-	// TODO: this u_1 * G + u_2 * Q_A  could be optimiced with Straus's algorithm.
+	point_mult_base(&p1, u1);
+	point_from_affine(&p2, x, y);
+	point_mult(&p2, &p2, u2);
+	point_add(&p1, &p1, &p2, 0, 0);
+	point_to_affine(tmp3_x, tmp3_y, &p1);
 
 	return isSame(tmp3_x, r, arrayLength) ? 0 : -1;
 }
@@ -199,6 +199,108 @@ ecdsaTest(void) {
 	assert(!ret);
 }
 
+static const uint32_t orderMinusOne[8] = {0xFC632550, 0xF3B9CAC2, 0xA7179E84, 0xBCE6FAAD,
+					0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0xFFFFFFFF};
+
+/* k = 0, 1 and n - 1 for the base point (comb) and any other point (window) */
+static void
+edgeTest(void){
+	uint32_t zero[8];
+	uint32_t one[8];
+	uint32_t tempx[8];
+	uint32_t tempy[8];
+	uint32_t negy[8];
+
+	ecc_setZero(zero, 8);
+	ecc_setZero(one, 8);
+	one[0] = 1;
+
+	ecc_ec_mult(BasePointx, BasePointy, zero, tempx, tempy);
+	assert(ecc_isSame(tempx, zero, arrayLength) && ecc_isSame(tempy, zero, arrayLength));
+	ecc_ec_mult(Sx, Sy, zero, tempx, tempy);
+	assert(ecc_isSame(tempx, zero, arrayLength) && ecc_isSame(tempy, zero, arrayLength));
+
+	ecc_ec_mult(BasePointx, BasePointy, one, tempx, tempy);
+	assert(ecc_isSame(tempx, BasePointx, arrayLength) && ecc_isSame(tempy, BasePointy, arrayLength));
+	ecc_ec_mult(Sx, Sy, one, tempx, tempy);
+	assert(ecc_isSame(tempx, Sx, arrayLength) && ecc_isSame(tempy, Sy, arrayLength));
+
+	ecc_ec_mult(BasePointx, BasePointy, orderMinusOne, tempx, tempy);
+	ecc_sub(ecc_prime_m, BasePointy, negy, arrayLength);
+	assert(ecc_isSame(tempx, BasePointx, arrayLength) && ecc_isSame(tempy, negy, arrayLength));
+	ecc_ec_mult(Sx, Sy, orderMinusOne, tempx, tempy);
+	ecc_sub(ecc_prime_m, Sy, negy, arrayLength);
+	assert(ecc_isSame(tempx, Sx, arrayLength) && ecc_isSame(tempy, negy, arrayLength));
+}
+
+/* (a * b mod n) * G with the comb must match b * (a * G) with the window */
+static void
+combTest(void){
+	uint32_t a[8];
+	uint32_t b[8];
+	uint32_t ab[16];
+	uint32_t abmod[9];
+	uint32_t tempx[8];
+	uint32_t tempy[8];
+	uint32_t tempx2[8];
+	uint32_t tempy2[8];
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		ecc_setRandom(a);
+		ecc_setRandom(b);
+		ecc_fieldMult(a, b, ab, arrayLength);
+		ecc_fieldModO(ab, abmod, 16);
+
+		ecc_ec_mult(BasePointx, BasePointy, abmod, tempx, tempy);
+		ecc_ec_mult(BasePointx, BasePointy, a, tempx2, tempy2);
+		ecc_ec_mult(tempx2, tempy2, b, tempx2, tempy2);
+		assert(ecc_isSame(tempx, tempx2, arrayLength));
+		assert(ecc_isSame(tempy, tempy2, arrayLength));
+	}
+}
+
+#ifndef CONTIKI
+static double
+benchSeconds(clock_t start){
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* operations per second for the steps of an ECDHE-ECDSA handshake */
+static void
+benchTest(void){
+	uint32_t tempx[9];
+	uint32_t tempy[9];
+	uint32_t pub_x[8];
+	uint32_t pub_y[8];
+	const int rounds = 200;
+	clock_t start;
+	int i;
+
+	ecc_ec_mult(BasePointx, BasePointy, ecdsaTestSecret, pub_x, pub_y);
+
+	start = clock();
+	for (i = 0; i < rounds; i++)
+		ecc_gen_pub_key(ecdsaTestSecret, tempx, tempy);
+	printf("key generation   %8.1f ops/s\n", rounds / benchSeconds(start));
+
+	start = clock();
+	for (i = 0; i < rounds; i++)
+		ecc_ecdh(Sx, Sy, ecdsaTestSecret, tempx, tempy);
+	printf("ecdh             %8.1f ops/s\n", rounds / benchSeconds(start));
+
+	start = clock();
+	for (i = 0; i < rounds; i++)
+		ecc_ecdsa_sign(ecdsaTestSecret, ecdsaTestMessage, ecdsaTestRand1, tempx, tempy);
+	printf("ecdsa sign       %8.1f ops/s\n", rounds / benchSeconds(start));
+
+	start = clock();
+	for (i = 0; i < rounds; i++)
+		assert(!ecc_ecdsa_validate(pub_x, pub_y, ecdsaTestMessage, tempx, tempy));
+	printf("ecdsa verify     %8.1f ops/s\n", rounds / benchSeconds(start));
+}
+#endif /* !CONTIKI */
+
 #ifdef CONTIKI
 PROCESS(ecc_test, "ECC test");
 AUTOSTART_PROCESSES(&ecc_test);
@@ -212,6 +314,8 @@ PROCESS_THREAD(ecc_test, ev, d)
 	multTest();
 	eccdhTest();
 	ecdsaTest();
+	edgeTest();
+	combTest();
 	printf("%s\n", "All Tests successful.");
 
 	PROCESS_END();
@@ -228,7 +332,10 @@ int main(int argc, char const *argv[])
 	multTest();
 	eccdhTest();
 	ecdsaTest();
+	edgeTest();
+	combTest();
 	printf("%s\n", "All Tests successful.");
+	benchTest();
 	return 0;
 }
 #endif /* CONTIKI */
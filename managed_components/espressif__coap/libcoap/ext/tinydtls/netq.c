@@ -15,6 +15,8 @@
  *
  *******************************************************************************/
 
+#include <string.h>
+
 #include "dtls_debug.h"
 #include "netq.h"
 #include "utlist.h"
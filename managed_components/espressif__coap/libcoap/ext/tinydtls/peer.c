@@ -107,3 +107,123 @@ dtls_new_peer(const session_t *session) {
 
   return peer;
 }
+
+#ifndef DTLS_PEER_TABLE_SIZE
+/** The number of slots of a peer table when the first peer is added. */
+#define DTLS_PEER_TABLE_MIN_SIZE 16
+#endif /* ! DTLS_PEER_TABLE_SIZE */
+
+static inline unsigned int
+peer_table_home(const dtls_peer_table_t *table, const session_t *session) {
+  return dtls_session_hash(session, table->seed) % table->size;
+}
+
+static void
+peer_table_insert(dtls_peer_table_t *table, dtls_peer_t *peer) {
+  unsigned int i = peer_table_home(table, &peer->session);
+
+  while (table->slots[i])
+    i = (i + 1) % table->size;
+  table->slots[i] = peer;
+  table->count++;
+}
+
+#ifndef DTLS_PEER_TABLE_SIZE
+static int
+peer_table_grow(dtls_peer_table_t *table) {
+  dtls_peer_t **old_slots = table->slots;
+  unsigned int old_size = table->size;
+  unsigned int new_size = old_size ? 2 * old_size : DTLS_PEER_TABLE_MIN_SIZE;
+  unsigned int i;
+
+  table->slots = (dtls_peer_t **)calloc(new_size, sizeof(dtls_peer_t *));
+  if (!table->slots) {
+    table->slots = old_slots;
+    return -1;
+  }
+  table->size = new_size;
+  table->count = 0;
+  for (i = 0; i < old_size; i++) {
+    if (old_slots[i])
+      peer_table_insert(table, old_slots[i]);
+  }
+  free(old_slots);
+  return 0;
+}
+#endif /* ! DTLS_PEER_TABLE_SIZE */
+
+void
+dtls_peer_table_init(dtls_peer_table_t *table, uint32_t seed) {
+  memset(table, 0, sizeof(dtls_peer_table_t));
+#ifdef DTLS_PEER_TABLE_SIZE
+  table->size = DTLS_PEER_TABLE_SIZE;
+#endif /* DTLS_PEER_TABLE_SIZE */
+  table->seed = seed;
+}
+
+void
+dtls_peer_table_free(dtls_peer_table_t *table) {
+#ifndef DTLS_PEER_TABLE_SIZE
+  free(table->slots);
+  table->slots = NULL;
+  table->size = 0;
+#endif /* ! DTLS_PEER_TABLE_SIZE */
+  table->count = 0;
+}
+
+dtls_peer_t *
+dtls_peer_table_find(const dtls_peer_table_t *table, const session_t *session) {
+  unsigned int i;
+
+  if (!table->count)
+    return NULL;
+
+  for (i = peer_table_home(table, session); table->slots[i];
+       i = (i + 1) % table->size) {
+    if (dtls_session_equals(&table->slots[i]->session, session))
+      return table->slots[i];
+  }
+  return NULL;
+}
+
+int
+dtls_peer_table_add(dtls_peer_table_t *table, dtls_peer_t *peer) {
+  if (2 * (table->count + 1) > table->size) {
+#ifdef DTLS_PEER_TABLE_SIZE
+    return -1;
+#else /* ! DTLS_PEER_TABLE_SIZE */
+    if (peer_table_grow(table) < 0)
+      return -1;
+#endif /* ! DTLS_PEER_TABLE_SIZE */
+  }
+  peer_table_insert(table, peer);
+  return 0;
+}
+
+void
+dtls_peer_table_remove(dtls_peer_table_t *table, dtls_peer_t *peer) {
+  unsigned int i, j, home;
+
+  if (!table->count || !peer)
+    return;
+
+  for (i = peer_table_home(table, &peer->session); table->slots[i] != peer;
+       i = (i + 1) % table->size) {
+    if (!table->slots[i])
+      return;
+  }
+  table->slots[i] = NULL;
+  table->count--;
+
+  /* Move the following peers of the probe sequence back into the gap
+   * unless their home slot lies cyclically between the gap and their
+   * current slot. This keeps lookups correct without tombstones. */
+  for (j = (i + 1) % table->size; table->slots[j]; j = (j + 1) % table->size) {
+    home = peer_table_home(table, &table->slots[j]->session);
+    if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+      table->slots[i] = table->slots[j];
+      table->slots[j] = NULL;
+      i = j;
+    }
+  }
+}
@@ -32,22 +32,12 @@
 #include "state.h"
 #include "crypto.h"
 
-#ifndef DTLS_PEERS_NOHASH
-#include "uthash.h"
-#endif /* DTLS_PEERS_NOHASH */
-
 typedef enum { DTLS_CLIENT=0, DTLS_SERVER } dtls_peer_type;
 
 /** 
  * Holds security parameters, local state and the transport address
  * for each peer. */
 typedef struct dtls_peer_t {
-#ifdef DTLS_PEERS_NOHASH
-  struct dtls_peer_t *next;
-#else /* DTLS_PEERS_NOHASH */
-  UT_hash_handle hh;
-#endif /* DTLS_PEERS_NOHASH */
-
   session_t session;	     /**< peer address and local interface */
 
   dtls_peer_type role;       /**< denotes if this host is DTLS_CLIENT or DTLS_SERVER */
@@ -66,6 +56,24 @@ typedef struct dtls_ephemeral_peer_t {
   uint16_t mseq;             /**< ClientHello handshake message sequence number */
 } dtls_ephemeral_peer_t;
 
+/**
+ * The peers of a context, kept in an open-addressing hash table with
+ * linear probing. The table is never more than half full, so a lookup
+ * stops at an empty slot after a few probes. If DTLS_PEER_TABLE_SIZE
+ * is defined, the slots are part of the context and the table does not
+ * grow; otherwise they are allocated and doubled as needed.
+ */
+typedef struct dtls_peer_table_t {
+#ifdef DTLS_PEER_TABLE_SIZE
+  dtls_peer_t *slots[DTLS_PEER_TABLE_SIZE];
+#else /* ! DTLS_PEER_TABLE_SIZE */
+  dtls_peer_t **slots;
+#endif /* ! DTLS_PEER_TABLE_SIZE */
+  unsigned int size;          /**< number of slots */
+  unsigned int count;         /**< number of peers in the table */
+  uint32_t seed;              /**< seed for dtls_session_hash() */
+} dtls_peer_table_t;
+
 static inline dtls_security_parameters_t *dtls_security_params_epoch(dtls_peer_t *peer, uint16_t epoch)
 {
   if (peer->security_params[0] && peer->security_params[0]->epoch == epoch) {
@@ -152,6 +160,28 @@ dtls_peer_t *dtls_new_peer(const session_t *session);
 /** Releases the storage allocated to @p peer. */
 void dtls_free_peer(dtls_peer_t *peer);
 
+/** Initializes the empty peer table @p table with the hash @p seed. */
+void dtls_peer_table_init(dtls_peer_table_t *table, uint32_t seed);
+
+/** Releases the slots of @p table. The peers are not freed. */
+void dtls_peer_table_free(dtls_peer_table_t *table);
+
+/**
+ * Returns the peer for @p session from @p table, or NULL if there is
+ * none.
+ */
+dtls_peer_t *dtls_peer_table_find(const dtls_peer_table_t *table,
+                                  const session_t *session);
+
+/**
+ * Adds @p peer to @p table. This function returns @c 0 on success, or
+ * @c -1 if the table is full and cannot grow.
+ */
+int dtls_peer_table_add(dtls_peer_table_t *table, dtls_peer_t *peer);
+
+/** Removes @p peer from @p table if it is there. */
+void dtls_peer_table_remove(dtls_peer_table_t *table, dtls_peer_t *peer);
+
 /** Returns the current state of @p peer. */
 static inline dtls_state_t dtls_peer_state(const dtls_peer_t *peer) {
   return peer->state;
@@ -69,10 +69,6 @@
 #define PACKAGE_VERSION "0.8.6"
 
 
-
-/** do not use uthash's hash tables (the tables uses malloc/free) */
-#define DTLS_PEERS_NOHASH 1
-
 /*
  * INFORMATION SHA2/ LIBRARY VARIABLES
  *
@@ -67,8 +67,10 @@
 #  define DTLS_HASH_MAX (3 * DTLS_PEER_MAX)
 #endif
 
-/** do not use uthash hash tables */
-#define DTLS_PEERS_NOHASH 1
+#ifndef DTLS_PEER_TABLE_SIZE
+/** The number of slots in the peer table of a context. */
+#  define DTLS_PEER_TABLE_SIZE (2 * DTLS_PEER_MAX)
+#endif
 
 /* BYTE_ORDER definition for sha2 */
 #ifndef LITTLE_ENDIAN
@@ -100,8 +100,10 @@
 #  define DTLS_HASH_MAX (3 * DTLS_PEER_MAX)
 #endif
 
-/** do not use uthash's hash tables (the tables uses malloc/free) */
-#define DTLS_PEERS_NOHASH 1
+#ifndef DTLS_PEER_TABLE_SIZE
+/** The number of slots in the peer table of a context. */
+#  define DTLS_PEER_TABLE_SIZE (2 * DTLS_PEER_MAX)
+#endif
 
 /* The 802.15.4 ACK can provoke very fast re-transmissions with a value
  * higher than one. This is a temporary bad behavior for the RIOT MAC
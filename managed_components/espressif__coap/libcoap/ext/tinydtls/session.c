@@ -163,3 +163,69 @@ dtls_session_equals(const session_t *a, const session_t *b) {
   return _dtls_address_equals_impl(a, b);
 #endif /* RIOT_VERSION */
 }
+
+/* FNV-1a over the given bytes, continuing from hash value h */
+static uint32_t
+hash_bytes(uint32_t h, const void *data, size_t length) {
+  const unsigned char *p = (const unsigned char *)data;
+
+  while (length--) {
+    h ^= *p++;
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+uint32_t
+dtls_session_hash(const session_t *sess, uint32_t seed) {
+  uint32_t h = 2166136261UL ^ seed;
+
+  assert(sess);
+  h = hash_bytes(h, &sess->ifindex, sizeof(sess->ifindex));
+#if defined(WITH_CONTIKI)
+  h = hash_bytes(h, &sess->port, sizeof(sess->port));
+  h = hash_bytes(h, &sess->addr, sizeof(sess->addr));
+#elif defined(WITH_RIOT_SOCK)
+  h = hash_bytes(h, &sess->addr.port, sizeof(sess->addr.port));
+  switch (sess->addr.family) {
+#ifdef SOCK_HAS_IPV4
+  case AF_INET:
+    h = hash_bytes(h, &sess->addr.ipv4, sizeof(sess->addr.ipv4));
+    break;
+#endif
+#ifdef SOCK_HAS_IPV6
+  case AF_INET6:
+    h = hash_bytes(h, &sess->addr.ipv6, sizeof(sess->addr.ipv6));
+    break;
+#endif
+  default:
+    ;
+  }
+#elif defined(WITH_LWIP_NO_SOCKET)
+  h = hash_bytes(h, &sess->port, sizeof(sess->port));
+#if LWIP_IPV4
+  if (IP_IS_V4(&sess->addr))
+    h = hash_bytes(h, ip_2_ip4(&sess->addr), sizeof(ip4_addr_t));
+#endif
+#if LWIP_IPV6
+  if (IP_IS_V6(&sess->addr))
+    h = hash_bytes(h, ip_2_ip6(&sess->addr)->addr,
+                   sizeof(ip_2_ip6(&sess->addr)->addr));
+#endif
+#else /* ! WITH_CONTIKI && !WITH_RIOT_SOCK && ! WITH_LWIP_NO_SOCKET */
+  /* only the parts compared by _dtls_address_equals_impl() */
+  switch (sess->addr.sa.sa_family) {
+  case AF_INET:
+    h = hash_bytes(h, &sess->addr.sin.sin_port, sizeof(sess->addr.sin.sin_port));
+    h = hash_bytes(h, &sess->addr.sin.sin_addr, sizeof(struct in_addr));
+    break;
+  case AF_INET6:
+    h = hash_bytes(h, &sess->addr.sin6.sin6_port, sizeof(sess->addr.sin6.sin6_port));
+    h = hash_bytes(h, &sess->addr.sin6.sin6_addr, sizeof(struct in6_addr));
+    break;
+  default:
+    ;
+  }
+#endif /* ! WITH_CONTIKI && !WITH_RIOT_SOCK && ! WITH_LWIP_NO_SOCKET */
+  return h ^ (h >> 16);
+}
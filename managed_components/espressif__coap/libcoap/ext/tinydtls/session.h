@@ -17,6 +17,8 @@
 #ifndef _DTLS_SESSION_H_
 #define _DTLS_SESSION_H_
 
+#include <stdint.h>
+
 #include "tinydtls.h"
 #include "global.h"
 
@@ -144,4 +146,12 @@ struct sockaddr* dtls_session_addr(session_t *sess, socklen_t *addrlen);
  */
 int dtls_session_equals(const session_t *a, const session_t *b);
 
+/**
+ * Computes a hash value of @p sess for the peer table. Sessions that
+ * are equal according to dtls_session_equals() have the same hash
+ * value. The @p seed is chosen per context to make collisions hard to
+ * provoke from the network.
+ */
+uint32_t dtls_session_hash(const session_t *sess, uint32_t seed);
+
 #endif /* _DTLS_SESSION_H_ */
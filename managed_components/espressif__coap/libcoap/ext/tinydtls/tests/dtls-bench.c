@@ -0,0 +1,491 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2025 Contributors to the Eclipse Foundation.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v. 1.0 which accompanies this distribution.
+ *
+ * The Eclipse Public License is available at http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ *******************************************************************************/
+
+/*
+ * Measures DTLS record throughput without any network I/O. A server
+ * context and one client context per peer exchange their packets through
+ * an in-memory queue. After the PSK handshakes, each client in turn sends
+ * an application data record to the server, so every record is encrypted
+ * once and decrypted once.
+ *
+ * The AES-CCM cost of a record is also measured on its own, both with the
+ * key expanded for every record (dtls_encrypt_params()) and with a key
+ * schedule set up once (dtls_encrypt_ctx()), the latter for each AES
+ * implementation this CPU supports.
+ *
+ * Full handshakes are measured last, with PSK and with ECDHE-ECDSA
+ * (both sides authenticated), as one client after the other connects
+ * and is dropped again.
+ *
+ * Usage: dtls-bench [-n records] [-p peers] [-s size] [-H handshakes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tinydtls.h"
+#include "dtls_debug.h"
+#include "dtls.h"
+
+#define MAX_PEERS 1024
+#define QUEUE_SIZE 256
+#define BASE_PORT 20000
+
+typedef struct {
+  int to_server;              /* else to client[peer] */
+  int peer;
+  size_t length;
+  uint8 data[DTLS_MAX_BUF];
+} packet_t;
+
+static packet_t queue[QUEUE_SIZE];
+static unsigned int q_head, q_tail;
+static int queue_overflow;
+
+static dtls_context_t *server;
+static dtls_context_t *client[MAX_PEERS];
+static session_t server_addr;
+static session_t client_addr[MAX_PEERS];
+static int peer_index[MAX_PEERS];
+static unsigned int connected;
+static unsigned long received;
+
+static double
+elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void
+set_addr(session_t *session, uint32_t host, uint16_t port) {
+  dtls_session_init(session);
+  session->size = sizeof(session->addr.sin);
+  session->addr.sin.sin_family = AF_INET;
+  session->addr.sin.sin_addr.s_addr = htonl(host);
+  session->addr.sin.sin_port = htons(port);
+}
+
+static int
+send_to_peer(struct dtls_context_t *ctx, session_t *session,
+             uint8 *data, size_t len) {
+  packet_t *packet;
+
+  if (q_tail - q_head >= QUEUE_SIZE || len > sizeof(queue[0].data)) {
+    queue_overflow = 1;
+    return -1;
+  }
+  packet = &queue[q_tail++ % QUEUE_SIZE];
+  if (ctx == server) {
+    packet->to_server = 0;
+    packet->peer = ntohs(session->addr.sin.sin_port) - BASE_PORT;
+  } else {
+    packet->to_server = 1;
+    packet->peer = *(int *)dtls_get_app_data(ctx);
+  }
+  packet->length = len;
+  memcpy(packet->data, data, len);
+  return (int)len;
+}
+
+static int
+read_from_peer(struct dtls_context_t *ctx, session_t *session,
+               uint8 *data, size_t len) {
+  (void)ctx;
+  (void)session;
+  (void)data;
+  (void)len;
+  received++;
+  return 0;
+}
+
+static int
+handle_event(struct dtls_context_t *ctx, session_t *session,
+             dtls_alert_level_t level, unsigned short code) {
+  (void)session;
+  if (level == 0 && code == DTLS_EVENT_CONNECTED && ctx != server)
+    connected++;
+  return 0;
+}
+
+static int
+get_psk_info(struct dtls_context_t *ctx, const session_t *session,
+             dtls_credentials_type_t type,
+             const unsigned char *id, size_t id_len,
+             unsigned char *result, size_t result_length) {
+  static const unsigned char identity[] = "Client_identity";
+  static const unsigned char key[] = "secretPSK";
+  (void)session;
+
+  switch (type) {
+  case DTLS_PSK_IDENTITY:
+    if (ctx == server || result_length < sizeof(identity) - 1)
+      return 0;
+    memcpy(result, identity, sizeof(identity) - 1);
+    return sizeof(identity) - 1;
+  case DTLS_PSK_KEY:
+    if (ctx == server &&
+        (id_len != sizeof(identity) - 1 || memcmp(id, identity, id_len) != 0))
+      return dtls_alert_fatal_create(DTLS_ALERT_DECRYPT_ERROR);
+    if (result_length < sizeof(key) - 1)
+      return dtls_alert_fatal_create(DTLS_ALERT_INTERNAL_ERROR);
+    memcpy(result, key, sizeof(key) - 1);
+    return sizeof(key) - 1;
+  case DTLS_PSK_HINT:
+  default:
+    return 0;
+  }
+}
+
+#ifdef DTLS_ECC
+/* the key pair of dtls-server, used by both sides */
+static const unsigned char ecdsa_priv_key[] = {
+  0xD9, 0xE2, 0x70, 0x7A, 0x72, 0xDA, 0x6A, 0x05,
+  0x04, 0x99, 0x5C, 0x86, 0xED, 0xDB, 0xE3, 0xEF,
+  0xC7, 0xF1, 0xCD, 0x74, 0x83, 0x8F, 0x75, 0x70,
+  0xC8, 0x07, 0x2D, 0x0A, 0x76, 0x26, 0x1B, 0xD4 };
+
+static const unsigned char ecdsa_pub_key_x[] = {
+  0xD0, 0x55, 0xEE, 0x14, 0x08, 0x4D, 0x6E, 0x06,
+  0x15, 0x59, 0x9D, 0xB5, 0x83, 0x91, 0x3E, 0x4A,
+  0x3E, 0x45, 0x26, 0xA2, 0x70, 0x4D, 0x61, 0xF2,
+  0x7A, 0x4C, 0xCF, 0xBA, 0x97, 0x58, 0xEF, 0x9A };
+
+static const unsigned char ecdsa_pub_key_y[] = {
+  0xB4, 0x18, 0xB6, 0x4A, 0xFE, 0x80, 0x30, 0xDA,
+  0x1D, 0xDC, 0xF4, 0xF4, 0x2E, 0x2F, 0x26, 0x31,
+  0xD0, 0x43, 0xB1, 0xFB, 0x03, 0xE2, 0x2F, 0x4D,
+  0x17, 0xDE, 0x43, 0xF9, 0xF9, 0xAD, 0xEE, 0x70 };
+
+static int
+get_ecdsa_key(struct dtls_context_t *ctx, const session_t *session,
+              const dtls_ecdsa_key_t **result) {
+  static const dtls_ecdsa_key_t ecdsa_key = {
+    .curve = DTLS_ECDH_CURVE_SECP256R1,
+    .priv_key = ecdsa_priv_key,
+    .pub_key_x = ecdsa_pub_key_x,
+    .pub_key_y = ecdsa_pub_key_y
+  };
+  (void)ctx;
+  (void)session;
+
+  *result = &ecdsa_key;
+  return 0;
+}
+
+static int
+verify_ecdsa_key(struct dtls_context_t *ctx, const session_t *session,
+                 const unsigned char *other_pub_x,
+                 const unsigned char *other_pub_y, size_t key_size) {
+  (void)ctx;
+  (void)session;
+  if (key_size != sizeof(ecdsa_pub_key_x) ||
+      memcmp(other_pub_x, ecdsa_pub_key_x, key_size) != 0 ||
+      memcmp(other_pub_y, ecdsa_pub_key_y, key_size) != 0)
+    return dtls_alert_fatal_create(DTLS_ALERT_BAD_CERTIFICATE);
+  return 0;
+}
+#endif /* DTLS_ECC */
+
+static dtls_handler_t cb = {
+  .write = send_to_peer,
+  .read  = read_from_peer,
+  .event = handle_event,
+  .get_psk_info = get_psk_info,
+};
+
+#ifdef DTLS_ECC
+/* the server offers both, a client gets cb or ecdsa_cb */
+static dtls_handler_t server_cb = {
+  .write = send_to_peer,
+  .read  = read_from_peer,
+  .event = handle_event,
+  .get_psk_info = get_psk_info,
+  .get_ecdsa_key = get_ecdsa_key,
+  .verify_ecdsa_key = verify_ecdsa_key,
+};
+
+static dtls_handler_t ecdsa_cb = {
+  .write = send_to_peer,
+  .read  = read_from_peer,
+  .event = handle_event,
+  .get_ecdsa_key = get_ecdsa_key,
+  .verify_ecdsa_key = verify_ecdsa_key,
+};
+#endif /* DTLS_ECC */
+
+static int
+pump(void) {
+  packet_t *packet;
+  session_t session;
+
+  while (q_head != q_tail) {
+    packet = &queue[q_head++ % QUEUE_SIZE];
+    if (packet->to_server) {
+      session = client_addr[packet->peer];
+      dtls_handle_message(server, &session, packet->data, packet->length);
+    } else {
+      session = server_addr;
+      dtls_handle_message(client[packet->peer], &session,
+                          packet->data, packet->length);
+    }
+  }
+  return queue_overflow ? -1 : 0;
+}
+
+static void
+report(const char *name, unsigned long count, double secs) {
+  printf("  %-16s %10.0f records/sec  %7.0f ns/record\n", name,
+         count / secs, secs * 1e9 / count);
+}
+
+static int
+bench_ccm(unsigned long num_records, size_t size) {
+  static const unsigned char key[DTLS_KEY_LENGTH] = "0123456789abcdef";
+  unsigned char nonce[DTLS_CCM_BLOCKSIZE];
+  unsigned char aad[13];
+  unsigned char buf[DTLS_MAX_BUF];
+  const dtls_ccm_params_t params = { nonce, 8, 3 };
+  static const char *impls[] = { "table", "ct", "aesni" };
+  rijndael_ctx ctx;
+  struct timespec start;
+  unsigned long i;
+  size_t n;
+  char name[32];
+  int len;
+
+  memset(nonce, 0x5a, sizeof(nonce));
+  memset(aad, 0x17, sizeof(aad));
+  memset(buf, 0xa5, size);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_records; i++) {
+    len = dtls_encrypt_params(&params, buf, size, buf, key, sizeof(key),
+                              aad, sizeof(aad));
+    if (len < 0 ||
+        dtls_decrypt_params(&params, buf, len, buf, key, sizeof(key),
+                            aad, sizeof(aad)) != (int)size)
+      return -1;
+  }
+  snprintf(name, sizeof(name), "ccm expand %s", rijndael_get_impl()->name);
+  report(name, num_records, elapsed(&start));
+
+  for (n = 0; n < sizeof(impls) / sizeof(impls[0]); n++) {
+    if (rijndael_set_impl(impls[n]) < 0)
+      continue;
+    if (dtls_cipher_set_key(&ctx, key, sizeof(key)) < 0)
+      return -1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_records; i++) {
+      len = dtls_encrypt_ctx(&ctx, &params, buf, size, buf, aad, sizeof(aad));
+      if (len < 0 ||
+          dtls_decrypt_ctx(&ctx, &params, buf, len, buf,
+                           aad, sizeof(aad)) != (int)size)
+        return -1;
+    }
+    snprintf(name, sizeof(name), "ccm %s", impls[n]);
+    report(name, num_records, elapsed(&start));
+  }
+  return rijndael_set_impl(NULL);
+}
+
+static int
+bench_records(unsigned int num_peers, unsigned long num_records, size_t size) {
+  uint8 payload[DTLS_MAX_BUF];
+  struct timespec start;
+  unsigned long i;
+  unsigned int p;
+  char name[32];
+  int ret = -1;
+
+  server = dtls_new_context(NULL);
+  if (!server)
+    return -1;
+  dtls_set_handler(server, &cb);
+  set_addr(&server_addr, 0x7f000001, 5684);
+  connected = 0;
+  received = 0;
+  q_head = q_tail = 0;
+  queue_overflow = 0;
+
+  for (p = 0; p < num_peers; p++) {
+    peer_index[p] = p;
+    set_addr(&client_addr[p], 0x7f000002, BASE_PORT + p);
+    client[p] = dtls_new_context(&peer_index[p]);
+    if (!client[p])
+      goto fail;
+    dtls_set_handler(client[p], &cb);
+    if (dtls_connect(client[p], &server_addr) < 0 || pump() < 0)
+      goto fail;
+  }
+  if (connected != num_peers) {
+    fprintf(stderr, "only %u of %u peers connected\n", connected, num_peers);
+    goto fail;
+  }
+
+  memset(payload, 0x42, size);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_records; i++) {
+    p = i % num_peers;
+    if (dtls_write(client[p], &server_addr, payload, size) != (int)size ||
+        pump() < 0)
+      goto fail;
+  }
+  snprintf(name, sizeof(name), "%u peer%s", num_peers, num_peers == 1 ? "" : "s");
+  report(name, num_records, elapsed(&start));
+  if (received != num_records) {
+    fprintf(stderr, "server received %lu of %lu records\n",
+            received, num_records);
+    goto fail;
+  }
+  ret = 0;
+
+fail:
+  for (p = 0; p < num_peers; p++) {
+    if (client[p])
+      dtls_free_context(client[p]);
+    client[p] = NULL;
+  }
+  dtls_free_context(server);
+  server = NULL;
+  return ret;
+}
+
+static int
+bench_handshakes(const char *name, dtls_handler_t *client_cb,
+                 unsigned long num_handshakes) {
+  struct timespec start;
+  unsigned long i;
+  dtls_peer_t *peer;
+  int ret = -1;
+
+  server = dtls_new_context(NULL);
+  if (!server)
+    return -1;
+#ifdef DTLS_ECC
+  dtls_set_handler(server, &server_cb);
+#else /* ! DTLS_ECC */
+  dtls_set_handler(server, &cb);
+#endif /* ! DTLS_ECC */
+  set_addr(&server_addr, 0x7f000001, 5684);
+  set_addr(&client_addr[0], 0x7f000002, BASE_PORT);
+  peer_index[0] = 0;
+  connected = 0;
+  q_head = q_tail = 0;
+  queue_overflow = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_handshakes; i++) {
+    client[0] = dtls_new_context(&peer_index[0]);
+    if (!client[0])
+      goto fail;
+    dtls_set_handler(client[0], client_cb);
+    if (dtls_connect(client[0], &server_addr) < 0 || pump() < 0 ||
+        connected != i + 1)
+      goto fail;
+    dtls_free_context(client[0]);
+    client[0] = NULL;
+    /* drop the server side along with whatever it queued for the client */
+    q_head = q_tail;
+    peer = dtls_get_peer(server, &client_addr[0]);
+    if (peer)
+      dtls_reset_peer(server, peer);
+    q_head = q_tail;
+  }
+  printf("  %-16s %10.1f handshakes/sec\n", name,
+         num_handshakes / elapsed(&start));
+  ret = 0;
+
+fail:
+  if (ret < 0)
+    fprintf(stderr, "%s handshake %lu failed\n", name, i + 1);
+  if (client[0])
+    dtls_free_context(client[0]);
+  client[0] = NULL;
+  dtls_free_context(server);
+  server = NULL;
+  return ret;
+}
+
+int
+main(int argc, char **argv) {
+  static const unsigned int default_peers[] = { 1, 8, 64 };
+  unsigned long num_records = 200000;
+  unsigned int num_peers = 0;
+  unsigned long num_handshakes = 200;
+  size_t size = 64;
+  size_t i;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:p:s:H:")) != -1) {
+    switch (opt) {
+    case 'n':
+      num_records = strtoul(optarg, NULL, 0);
+      break;
+    case 'p':
+      num_peers = (unsigned int)strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      size = strtoul(optarg, NULL, 0);
+      break;
+    case 'H':
+      num_handshakes = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n records] [-p peers] [-s size] "
+              "[-H handshakes]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (!num_records || num_peers > MAX_PEERS || !size || size > 1024) {
+    fprintf(stderr, "-n must not be 0, -p at most %u and -s 1 to 1024\n",
+            MAX_PEERS);
+    exit(1);
+  }
+
+  dtls_init();
+  dtls_set_log_level(DTLS_LOG_CRIT);
+
+  printf("%lu records of %zu bytes:\n", num_records, size);
+  if (bench_ccm(num_records, size) < 0)
+    goto fail;
+  if (num_peers) {
+    if (bench_records(num_peers, num_records, size) < 0)
+      goto fail;
+  } else {
+    for (i = 0; i < sizeof(default_peers) / sizeof(default_peers[0]); i++) {
+      if (bench_records(default_peers[i], num_records, size) < 0)
+        goto fail;
+    }
+  }
+
+  if (!num_handshakes)
+    return 0;
+  printf("%lu full handshakes:\n", num_handshakes);
+  if (bench_handshakes("psk", &cb, num_handshakes) < 0)
+    goto fail;
+#ifdef DTLS_ECC
+  if (bench_handshakes("ecdhe-ecdsa", &ecdsa_cb, num_handshakes) < 0)
+    goto fail;
+#endif /* DTLS_ECC */
+  return 0;
+
+fail:
+  fprintf(stderr, "benchmark failed\n");
+  return 1;
+}
@@ -168,6 +168,110 @@ t_test_dtls_decrypt(void) {
   }
 }
 
+static const char *aes_impls[] = { "table", "ct", "aesni" };
+
+static void
+t_test_aes_impls(void) {
+  /* FIPS-197, Appendix C.1 */
+  static const unsigned char key[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+  };
+  static const unsigned char pt[16] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+  };
+  static const unsigned char ct[16] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+  };
+  unsigned char in[3 * 16], out[3 * 16];
+  rijndael_ctx ctx;
+  size_t i, n;
+  long int len;
+
+  for (i = 0; i < sizeof(aes_impls) / sizeof(aes_impls[0]); i++) {
+    if (rijndael_set_impl(aes_impls[i]) < 0) {
+      /* only the CPU specific ones may be missing */
+      CU_ASSERT(i >= 2);
+      continue;
+    }
+    CU_ASSERT(strcmp(rijndael_get_impl()->name, aes_impls[i]) == 0);
+    CU_ASSERT(rijndael_set_key_enc_only(&ctx, key, 128) == 0);
+    CU_ASSERT(ctx.impl == rijndael_get_impl());
+
+    /* an odd number of blocks, to cover the paired and the single path */
+    for (n = 0; n < 3; n++)
+      memcpy(in + 16 * n, pt, 16);
+    in[16] ^= 1;
+    rijndael_encrypt_blocks(&ctx, in, out, 3);
+    CU_ASSERT(memcmp(out, ct, 16) == 0);
+    CU_ASSERT(memcmp(out + 16, ct, 16) != 0);
+    CU_ASSERT(memcmp(out + 32, ct, 16) == 0);
+    rijndael_encrypt(&ctx, in + 16, in);
+    CU_ASSERT(memcmp(in, out + 16, 16) == 0);
+
+    for (n = 0; n < sizeof(data)/sizeof(struct test_vector); ++n) {
+      CU_ASSERT(rijndael_set_key_enc_only(&ctx, data[n].key, 8*sizeof(data[n].key)) == 0);
+
+      memcpy(buf, data[n].msg + data[n].la, data[n].lm - data[n].la);
+      len = dtls_ccm_encrypt_message(&ctx, data[n].M, data[n].L, data[n].nonce,
+                                     buf, data[n].lm - data[n].la,
+                                     data[n].msg, data[n].la);
+      CU_ASSERT((size_t)len == data[n].r_lm - data[n].la);
+      CU_ASSERT(memcmp(buf, data[n].result + data[n].la, len) == 0);
+
+      len = dtls_ccm_decrypt_message(&ctx, data[n].M, data[n].L, data[n].nonce,
+                                     buf, len, data[n].msg, data[n].la);
+      CU_ASSERT((size_t)len == data[n].lm - data[n].la);
+      CU_ASSERT(memcmp(buf, data[n].msg + data[n].la, len) == 0);
+    }
+  }
+  CU_ASSERT(rijndael_set_impl("none") < 0);
+  CU_ASSERT(rijndael_set_impl(NULL) == 0);
+}
+
+/* records of every length up to a few blocks, sealed and opened with
+ * each pair of implementations */
+static void
+t_test_aes_impls_cross(void) {
+  static const unsigned char key[16] = "0123456789abcdef";
+  static const unsigned char aad[13] = "additionaldat";
+  const unsigned char *nonce = data[0].nonce;
+  unsigned char ref[100], msg[100];
+  rijndael_ctx ctx;
+  size_t i, j, lm;
+  long int len;
+
+  for (lm = 0; lm <= sizeof(ref) - 8; lm++) {
+    for (i = 0; i < lm; i++)
+      ref[i] = (unsigned char)(i * 7 + lm);
+    CU_ASSERT(rijndael_set_impl("table") == 0);
+    CU_ASSERT(rijndael_set_key_enc_only(&ctx, key, 128) == 0);
+    len = dtls_ccm_encrypt_message(&ctx, 8, 3, nonce, ref, lm,
+                                   aad, sizeof(aad));
+    CU_ASSERT((size_t)len == lm + 8);
+
+    for (j = 1; j < sizeof(aes_impls) / sizeof(aes_impls[0]); j++) {
+      if (rijndael_set_impl(aes_impls[j]) < 0)
+        continue;
+      CU_ASSERT(rijndael_set_key_enc_only(&ctx, key, 128) == 0);
+      memcpy(msg, ref, lm + 8);
+      CU_ASSERT(dtls_ccm_decrypt_message(&ctx, 8, 3, nonce, msg, lm + 8,
+                                         aad, sizeof(aad)) == (long int)lm);
+      CU_ASSERT(dtls_ccm_encrypt_message(&ctx, 8, 3, nonce, msg, lm,
+                                         aad, sizeof(aad)) == (long int)lm + 8);
+      CU_ASSERT(memcmp(msg, ref, lm + 8) == 0);
+
+      /* a modified tag must not verify */
+      msg[lm] ^= 0x80;
+      CU_ASSERT(dtls_ccm_decrypt_message(&ctx, 8, 3, nonce, msg, lm + 8,
+                                         aad, sizeof(aad)) < 0);
+    }
+  }
+  CU_ASSERT(rijndael_set_impl(NULL) == 0);
+}
+
 CU_pSuite
 t_init_ccm_tests(void) {
   CU_pSuite suite;
@@ -210,6 +314,16 @@ t_init_ccm_tests(void) {
             CU_get_error_msg());
   }
 
+  if (!CU_ADD_TEST(suite,t_test_aes_impls)) {
+    fprintf(stderr, "W: cannot add t_test_aes_impls (%s)\n",
+            CU_get_error_msg());
+  }
+
+  if (!CU_ADD_TEST(suite,t_test_aes_impls_cross)) {
+    fprintf(stderr, "W: cannot add t_test_aes_impls_cross (%s)\n",
+            CU_get_error_msg());
+  }
+
   return suite;
 }
 
@@ -0,0 +1,337 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2026 Olaf Bergmann (TZI) and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v. 1.0 which accompanies this distribution.
+ *
+ * The Eclipse Public License is available at http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dtls_config.h"
+#include "test_peer.h"
+
+#include "tinydtls.h"
+#include "dtls.h"
+#include "peer.h"
+#include "session.h"
+
+#include <CUnit/CUnit.h>
+
+#define PEER_SEED 0x5eed1234
+
+static void
+set_session(session_t *session, unsigned short port) {
+  dtls_session_init(session);
+  session->size = sizeof(session->addr.sin);
+  session->addr.sin.sin_family = AF_INET;
+  session->addr.sin.sin_addr.s_addr = htonl(0x7f000001);
+  session->addr.sin.sin_port = htons(port);
+}
+
+/* Returns the slot of @p table that holds @p peer, or -1. */
+static int
+slot_of(const dtls_peer_table_t *table, const dtls_peer_t *peer) {
+  unsigned int i;
+
+  for (i = 0; i < table->size; i++) {
+    if (table->slots[i] == peer)
+      return (int)i;
+  }
+  return -1;
+}
+
+/* Finds @p count ports from @p port onwards whose sessions have the
+ * home slot @p home in a table of @p size slots. */
+static void
+find_ports(unsigned int size, unsigned int home, unsigned short port,
+           unsigned short *ports, int count) {
+  session_t session;
+
+  while (count) {
+    set_session(&session, port);
+    if (dtls_session_hash(&session, PEER_SEED) % size == home) {
+      *ports++ = port;
+      count--;
+    }
+    port++;
+  }
+}
+
+static void
+t_test_peer_table_add_find(void) {
+  dtls_peer_table_t table;
+  dtls_peer_t *peers[40];
+  session_t session;
+  unsigned int n;
+
+  dtls_peer_table_init(&table, PEER_SEED);
+  set_session(&session, 5684);
+  CU_ASSERT_PTR_NULL(dtls_peer_table_find(&table, &session));
+
+  /* enough peers to make the table grow a few times */
+  for (n = 0; n < 40; n++) {
+    set_session(&session, 20000 + n);
+    peers[n] = dtls_new_peer(&session);
+    CU_ASSERT_FATAL(peers[n] != NULL);
+    CU_ASSERT(dtls_peer_table_add(&table, peers[n]) == 0);
+    CU_ASSERT(2 * table.count <= table.size);
+  }
+  CU_ASSERT_EQUAL(table.count, 40);
+
+  for (n = 0; n < 40; n++) {
+    set_session(&session, 20000 + n);
+    CU_ASSERT_PTR_EQUAL(dtls_peer_table_find(&table, &session), peers[n]);
+  }
+  set_session(&session, 20000 + n);
+  CU_ASSERT_PTR_NULL(dtls_peer_table_find(&table, &session));
+
+  /* removing every other peer must not lose the rest */
+  for (n = 0; n < 40; n += 2)
+    dtls_peer_table_remove(&table, peers[n]);
+  CU_ASSERT_EQUAL(table.count, 20);
+  for (n = 0; n < 40; n++) {
+    set_session(&session, 20000 + n);
+    CU_ASSERT_PTR_EQUAL(dtls_peer_table_find(&table, &session),
+                        n % 2 ? peers[n] : NULL);
+  }
+
+  /* removing a peer twice is harmless */
+  dtls_peer_table_remove(&table, peers[0]);
+  CU_ASSERT_EQUAL(table.count, 20);
+
+  for (n = 1; n < 40; n += 2)
+    dtls_peer_table_remove(&table, peers[n]);
+  CU_ASSERT_EQUAL(table.count, 0);
+  for (n = 0; n < 40; n++)
+    dtls_free_peer(peers[n]);
+  dtls_peer_table_free(&table);
+}
+
+static void
+t_test_peer_table_shift(void) {
+  dtls_peer_table_t table;
+  dtls_peer_t *a, *b, *c, *d;
+  session_t session;
+  unsigned short ports[3], other;
+  unsigned int size;
+
+  dtls_peer_table_init(&table, PEER_SEED);
+  /* the first peer allocates the slots */
+  set_session(&session, 1);
+  a = dtls_new_peer(&session);
+  CU_ASSERT_FATAL(a != NULL);
+  CU_ASSERT_FATAL(dtls_peer_table_add(&table, a) == 0);
+  dtls_peer_table_remove(&table, a);
+  dtls_free_peer(a);
+  size = table.size;
+
+  /* a, b and c collide in slot 2, d lives in slot 4 */
+  find_ports(size, 2, 30000, ports, 3);
+  find_ports(size, 4, 30000, &other, 1);
+
+  set_session(&session, ports[0]);
+  a = dtls_new_peer(&session);
+  set_session(&session, ports[1]);
+  b = dtls_new_peer(&session);
+  set_session(&session, ports[2]);
+  c = dtls_new_peer(&session);
+  set_session(&session, other);
+  d = dtls_new_peer(&session);
+  CU_ASSERT_FATAL(a && b && c && d);
+
+  CU_ASSERT(dtls_peer_table_add(&table, d) == 0);
+  CU_ASSERT(dtls_peer_table_add(&table, a) == 0);
+  CU_ASSERT(dtls_peer_table_add(&table, b) == 0);
+  CU_ASSERT(dtls_peer_table_add(&table, c) == 0);
+  CU_ASSERT_EQUAL(table.size, size);
+  CU_ASSERT_EQUAL(slot_of(&table, a), 2);
+  CU_ASSERT_EQUAL(slot_of(&table, b), 3);
+  CU_ASSERT_EQUAL(slot_of(&table, d), 4);
+  CU_ASSERT_EQUAL(slot_of(&table, c), 5);
+
+  /* b and c move back into the gap, d stays in its home slot */
+  dtls_peer_table_remove(&table, a);
+  CU_ASSERT_EQUAL(slot_of(&table, b), 2);
+  CU_ASSERT_EQUAL(slot_of(&table, c), 3);
+  CU_ASSERT_EQUAL(slot_of(&table, d), 4);
+  CU_ASSERT_PTR_EQUAL(dtls_peer_table_find(&table, &c->session), c);
+  CU_ASSERT_PTR_EQUAL(dtls_peer_table_find(&table, &d->session), d);
+  CU_ASSERT_PTR_NULL(dtls_peer_table_find(&table, &a->session));
+
+  dtls_peer_table_remove(&table, b);
+  dtls_peer_table_remove(&table, c);
+  dtls_peer_table_remove(&table, d);
+  CU_ASSERT_EQUAL(table.count, 0);
+  dtls_free_peer(a);
+  dtls_free_peer(b);
+  dtls_free_peer(c);
+  dtls_free_peer(d);
+  dtls_peer_table_free(&table);
+}
+
+static void
+t_test_peer_table_wrap(void) {
+  dtls_peer_table_t table;
+  dtls_peer_t *a, *b, *c;
+  session_t session;
+  unsigned short ports[3];
+  unsigned int size;
+
+  dtls_peer_table_init(&table, PEER_SEED);
+  set_session(&session, 1);
+  a = dtls_new_peer(&session);
+  CU_ASSERT_FATAL(a != NULL);
+  CU_ASSERT_FATAL(dtls_peer_table_add(&table, a) == 0);
+  dtls_peer_table_remove(&table, a);
+  dtls_free_peer(a);
+  size = table.size;
+
+  /* all three have the last slot as home, so b and c wrap around */
+  find_ports(size, size - 1, 40000, ports, 3);
+  set_session(&session, ports[0]);
+  a = dtls_new_peer(&session);
+  set_session(&session, ports[1]);
+  b = dtls_new_peer(&session);
+  set_session(&session, ports[2]);
+  c = dtls_new_peer(&session);
+  CU_ASSERT_FATAL(a && b && c);
+
+  CU_ASSERT(dtls_peer_table_add(&table, a) == 0);
+  CU_ASSERT(dtls_peer_table_add(&table, b) == 0);
+  CU_ASSERT(dtls_peer_table_add(&table, c) == 0);
+  CU_ASSERT_EQUAL(slot_of(&table, a), (int)size - 1);
+  CU_ASSERT_EQUAL(slot_of(&table, b), 0);
+  CU_ASSERT_EQUAL(slot_of(&table, c), 1);
+  CU_ASSERT_PTR_EQUAL(dtls_peer_table_find(&table, &c->session), c);
+
+  /* the shift must follow the probe sequence across the end */
+  dtls_peer_table_remove(&table, a);
+  CU_ASSERT_EQUAL(slot_of(&table, b), (int)size - 1);
+  CU_ASSERT_EQUAL(slot_of(&table, c), 0);
+  CU_ASSERT_PTR_EQUAL(dtls_peer_table_find(&table, &b->session), b);
+  CU_ASSERT_PTR_EQUAL(dtls_peer_table_find(&table, &c->session), c);
+
+  dtls_peer_table_remove(&table, b);
+  CU_ASSERT_EQUAL(slot_of(&table, c), (int)size - 1);
+  CU_ASSERT_PTR_EQUAL(dtls_peer_table_find(&table, &c->session), c);
+
+  dtls_peer_table_remove(&table, c);
+  CU_ASSERT_EQUAL(table.count, 0);
+  dtls_free_peer(a);
+  dtls_free_peer(b);
+  dtls_free_peer(c);
+  dtls_peer_table_free(&table);
+}
+
+static int
+discard_write(struct dtls_context_t *ctx, session_t *session,
+              uint8 *buf, size_t len) {
+  (void)ctx;
+  (void)session;
+  (void)buf;
+  return (int)len;
+}
+
+#ifdef DTLS_PSK
+static int
+get_psk_info(struct dtls_context_t *ctx, const session_t *session,
+             dtls_credentials_type_t type,
+             const unsigned char *desc, size_t desc_len,
+             unsigned char *result, size_t result_length) {
+  (void)ctx;
+  (void)session;
+  (void)desc;
+  (void)desc_len;
+
+  if (result_length < 4)
+    return -1;
+  switch (type) {
+  case DTLS_PSK_IDENTITY:
+  case DTLS_PSK_KEY:
+    memcpy(result, "test", 4);
+    return 4;
+  default:
+    return -1;
+  }
+}
+#endif /* DTLS_PSK */
+
+static dtls_handler_t discard_handler = {
+  .write = discard_write,
+#ifdef DTLS_PSK
+  .get_psk_info = get_psk_info,
+#endif /* DTLS_PSK */
+};
+
+static void
+t_test_handshake_cap(void) {
+  dtls_context_t *ctx;
+  dtls_peer_t *peer;
+  session_t session;
+  unsigned int n;
+
+  ctx = dtls_new_context(NULL);
+  CU_ASSERT_FATAL(ctx != NULL);
+  dtls_set_handler(ctx, &discard_handler);
+
+  for (n = 0; n < DTLS_HANDSHAKE_MAX; n++) {
+    set_session(&session, 50000 + n);
+    CU_ASSERT(dtls_connect(ctx, &session) > 0);
+  }
+  CU_ASSERT_EQUAL(ctx->handshake_count, DTLS_HANDSHAKE_MAX);
+
+  /* no handshake left, and no peer must stay behind */
+  set_session(&session, 50000 + n);
+  CU_ASSERT(dtls_connect(ctx, &session) < 0);
+  CU_ASSERT_PTR_NULL(dtls_get_peer(ctx, &session));
+  CU_ASSERT_EQUAL(ctx->peers.count, DTLS_HANDSHAKE_MAX);
+  CU_ASSERT_EQUAL(ctx->handshake_count, DTLS_HANDSHAKE_MAX);
+
+  /* resetting a peer hands back its handshake */
+  set_session(&session, 50000);
+  peer = dtls_get_peer(ctx, &session);
+  CU_ASSERT_FATAL(peer != NULL);
+  dtls_reset_peer(ctx, peer);
+  CU_ASSERT_EQUAL(ctx->handshake_count, DTLS_HANDSHAKE_MAX - 1);
+
+  set_session(&session, 50000 + n);
+  CU_ASSERT(dtls_connect(ctx, &session) > 0);
+  CU_ASSERT_PTR_NOT_NULL(dtls_get_peer(ctx, &session));
+  CU_ASSERT_EQUAL(ctx->handshake_count, DTLS_HANDSHAKE_MAX);
+
+  dtls_free_context(ctx);
+}
+
+CU_pSuite
+t_init_peer_tests(void) {
+  CU_pSuite suite;
+
+  suite = CU_add_suite("peer", NULL, NULL);
+  if (!suite) {                        /* signal error */
+    fprintf(stderr, "W: cannot add peer test suite (%s)\n",
+            CU_get_error_msg());
+
+    return NULL;
+  }
+
+  dtls_init();
+
+#define PEER_TEST(s,t)                                                  \
+  if (!CU_ADD_TEST(s,t)) {                                              \
+    fprintf(stderr, "W: cannot add test for peer (%s)\n",               \
+            CU_get_error_msg());                                        \
+  }
+
+  PEER_TEST(suite, t_test_peer_table_add_find);
+  PEER_TEST(suite, t_test_peer_table_shift);
+  PEER_TEST(suite, t_test_peer_table_wrap);
+  PEER_TEST(suite, t_test_handshake_cap);
+
+  return suite;
+}
@@ -436,6 +436,59 @@ COAP_API void coap_context_set_block_mode(coap_context_t *context,
  */
 COAP_API int coap_context_set_max_block_size(coap_context_t *context, size_t max_block_size);
 
+/**
+ * Definition of the block data handler function, used to pass a large body
+ * to the application as it comes in rather than re-assembling it in memory.
+ *
+ * The data is always passed over in order.  Blocks that arrive out of order
+ * (e.g. using Q-Block) are held until the gap is filled, up to
+ * COAP_BLOCK_STREAM_WINDOW blocks at a time.
+ *
+ * @param session  The session the data is being received on.
+ * @param pdu      The PDU (request or response) the data came in (may be NULL
+ *                 if @p data is NULL).
+ * @param resource The resource the data is for, or NULL for a response.
+ * @param app_data Pointer to application data to be used for the whole
+ *                 body, initially NULL.
+ * @param offset   The offset of @p data into the body.  If 0, the body is
+ *                 (re-)starting and any previous data is to be discarded.
+ * @param data     The next data of the body, or NULL if the body is complete
+ *                 or abandoned (only if @p app_data has been set, which is
+ *                 then to be freed off).
+ * @param length   The length of @p data.
+ * @param total    The total length of the body, or 0 if not known yet.  If
+ *                 @p data is NULL, @p total is the same as @p offset if the
+ *                 body is complete, else 0.
+ *
+ * @return @c 1 if the data was consumed, @c 0 on failure (the transfer is
+ *         then abandoned).
+ */
+typedef int (*coap_block_data_handler_t)(coap_session_t *session,
+                                         const coap_pdu_t *pdu,
+                                         coap_resource_t *resource,
+                                         void **app_data,
+                                         size_t offset,
+                                         const uint8_t *data,
+                                         size_t length,
+                                         size_t total);
+
+/**
+ * Registers a handler that is passed each part of a large body in order as it
+ * is received, instead of libcoap re-assembling the whole body (in the cases
+ * where COAP_BLOCK_SINGLE_BODY, Q-Block or BERT would otherwise cause the body
+ * to be re-assembled). The request or response handler is then called with no
+ * data once the whole body has been passed over.
+ *
+ * Note: COAP_BLOCK_USE_LIBCOAP must be set using coap_context_set_block_mode()
+ * if libcoap is to do this work.
+ *
+ * @param context The context to register the handler for.
+ * @param handler The block data handler to register, or NULL to revert to
+ *                re-assembling the body.
+ */
+void coap_register_block_data_handler(coap_context_t *context,
+                                      coap_block_data_handler_t handler);
+
 /**@}*/
 
 #endif /* COAP_BLOCK_H_ */
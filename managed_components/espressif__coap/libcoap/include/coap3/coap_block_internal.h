@@ -92,6 +92,36 @@ typedef enum {
   COAP_RECURSE_NO
 } coap_recurse_t;
 
+#ifndef COAP_BLOCK_STREAM_WINDOW
+/**
+ * The number of chunks of a large body that can be held while waiting for
+ * an earlier one if a coap_block_data_handler_t is registered.  Later chunks
+ * that do not fit are treated as not received and get recovered.
+ */
+#define COAP_BLOCK_STREAM_WINDOW 16
+#endif /* COAP_BLOCK_STREAM_WINDOW */
+
+/**
+ * A chunk of a large body received ahead of the data before it.
+ */
+typedef struct coap_lg_chunk_t {
+  struct coap_lg_chunk_t *next;
+  size_t offset;         /**< Offset of data in body */
+  size_t length;         /**< Length of data */
+  uint8_t data[1];       /**< Data (extended) */
+} coap_lg_chunk_t;
+
+/**
+ * Large body receive state if passing the body to the
+ * coap_block_data_handler_t rather than re-assembling it.
+ */
+typedef struct coap_lg_stream_t {
+  void *app_data;        /**< Application data for the handler */
+  size_t next_offset;    /**< Data given to the handler so far */
+  coap_lg_chunk_t *pending; /**< Chunks beyond next_offset, in order */
+  uint32_t pending_count; /**< Number of pending chunks */
+} coap_lg_stream_t;
+
 struct coap_lg_range {
   uint32_t begin;
   uint32_t end;
@@ -197,6 +227,7 @@ struct coap_lg_crcv_t {
   uint64_t state_token; /**< state token */
   coap_pdu_t pdu;        /**< skeletal PDU */
   coap_rblock_t rec_blocks; /** < list of received blocks */
+  coap_lg_stream_t stream; /**< Used instead of body_data if streaming */
   coap_tick_t last_used; /**< Last time all data sent or 0 */
 };
 #endif /* COAP_CLIENT_SUPPORT */
@@ -222,6 +253,7 @@ struct coap_lg_srcv_t {
   coap_resource_t *resource; /**< associated resource */
   coap_str_const_t *uri_path; /** set to uri_path if unknown resource */
   coap_rblock_t rec_blocks; /** < list of received blocks */
+  coap_lg_stream_t stream; /**< Used instead of body_data if streaming */
   coap_bin_const_t *last_token; /**< last used token */
   coap_mid_t last_mid;   /**< Last received mid for this set of packets */
   coap_tick_t last_used; /**< Last time data sent or 0 */
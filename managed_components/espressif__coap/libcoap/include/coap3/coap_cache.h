@@ -229,6 +229,39 @@ void coap_cache_set_app_data(coap_cache_entry_t *cache_entry, void *data,
  */
 void *coap_cache_get_app_data(const coap_cache_entry_t *cache_entry);
 
+/**
+ * Sets the maximum number of bytes the cache-entries of @p context may hold,
+ * counting the entries, their cache-keys and any recorded PDUs. When a new
+ * cache-entry takes the cache over this limit, the least recently used
+ * responses cached by libcoap (see COAP_RESOURCE_FLAGS_CACHE_RESPONSE) are
+ * deleted until it fits. Cache-entries created by the application with
+ * coap_new_cache_entry() count towards the limit, but are never deleted to
+ * keep within it.
+ *
+ * @param context  The context to update.
+ * @param max_size The maximum number of bytes, or @c 0 (the default) for
+ *                 no limit.
+ */
+COAP_API void coap_cache_set_max_size(coap_context_t *context,
+                                      size_t max_size);
+
+/**
+ * Get the cache statistics of @p context.
+ *
+ * @param context   The context to use.
+ * @param hits      Updated with the number of cache lookups that found a
+ *                  cache-entry, if not NULL.
+ * @param misses    Updated with the number of cache lookups that did not,
+ *                  if not NULL.
+ * @param evictions Updated with the number of cache-entries deleted to keep
+ *                  within the coap_cache_set_max_size() limit, if not NULL.
+ * @param size      Updated with the number of bytes currently held by
+ *                  cache-entries, if not NULL.
+ */
+void coap_cache_get_stats(const coap_context_t *context, uint64_t *hits,
+                          uint64_t *misses, uint64_t *evictions,
+                          size_t *size);
+
 /** @} */
 
 #endif  /* COAP_CACHE_H */
@@ -34,21 +34,61 @@ typedef struct coap_digest_t {
   uint8_t key[32];
 } coap_digest_t;
 
+/* A 128-bit SipHash-1-3 of the cache-key parts of a PDU */
 struct coap_cache_key_t {
-  uint8_t key[32];
+  uint8_t key[16];
 };
 
 struct coap_cache_entry_t {
   UT_hash_handle hh;
+  coap_cache_entry_t *lru_prev;   /**< Previous in context cache_lru (only
+                                       if resource is set) */
+  coap_cache_entry_t *lru_next;   /**< Next in context cache_lru */
+  coap_cache_entry_t *res_prev;   /**< Previous in resource cache_entries */
+  coap_cache_entry_t *res_next;   /**< Next in resource cache_entries */
   coap_cache_key_t *cache_key;
   coap_session_t *session;
+  coap_resource_t *resource;      /**< Set if a response that libcoap
+                                       serves itself */
   coap_pdu_t *pdu;
   void *app_data;
   coap_tick_t expire_ticks;
+  size_t expire_idx;              /**< 1 + index in context cache_expire, or 0
+                                       if the entry does not expire */
+  size_t size;                    /**< Bytes counted against cache_max_size */
   unsigned int idle_timeout;
   coap_cache_app_data_free_callback_t callback;
 };
 
+/**
+ * The Max-Age to use for a cached response that does not have a Max-Age
+ * option. https://rfc-editor.org/rfc/rfc7252#section-5.10.5
+ */
+#define COAP_CACHE_DEFAULT_MAX_AGE 60
+
+/**
+ * Calculates the cache-key for @p pdu into @p cache_key, in the same way as
+ * coap_cache_derive_key_w_ignore() but without any memory allocation.
+ *
+ * @param session       The session to add into cache-key if @p session_based
+ *                      is set.
+ * @param pdu           The CoAP PDU for which a cache-key is to be
+ *                      calculated.
+ * @param session_based COAP_CACHE_IS_SESSION_BASED if session based
+ *                      cache-key, else COAP_CACHE_NOT_SESSION_BASED.
+ * @param ignore_options The array of options to ignore.
+ * @param ignore_count   The number of options to ignore.
+ * @param cache_key     Updated with the cache-key.
+ *
+ * @return @c 1 if successful, else @c 0.
+ */
+int coap_cache_derive_key_into(const coap_session_t *session,
+                               const coap_pdu_t *pdu,
+                               coap_cache_session_based_t session_based,
+                               const uint16_t *ignore_options,
+                               size_t ignore_count,
+                               coap_cache_key_t *cache_key);
+
 /**
  * Expire coap_cache_entry_t entries
  *
@@ -139,6 +179,64 @@ coap_cache_entry_t *coap_new_cache_entry_lkd(coap_session_t *session,
                                              coap_cache_session_based_t session_based,
                                              unsigned int idle_time);
 
+/**
+ * Sets the byte budget for the cache-entries held by @p context.
+ *
+ * Note: This function must be called in the locked state.
+ *
+ * @param context  The context to update.
+ * @param max_size The maximum number of bytes, or @c 0 for no limit.
+ */
+void coap_cache_set_max_size_lkd(coap_context_t *context, size_t max_size);
+
+/**
+ * Fills in @p response from the cached response to @p request for
+ * @p resource, which must have COAP_RESOURCE_FLAGS_CACHE_RESPONSE set. If the
+ * request has an ETag option matching the cached response, @p response is
+ * a 2.03 (Valid).
+ *
+ * Note: This function must be called in the locked state.
+ *
+ * @param session  The session the request came in on.
+ * @param resource The resource the request is for.
+ * @param request  The GET request.
+ * @param response The response, which only has its token set up.
+ *
+ * @return @c 1 if @p response is filled in, else @c 0.
+ */
+int coap_cache_serve_response_lkd(coap_session_t *session,
+                                  coap_resource_t *resource,
+                                  const coap_pdu_t *request,
+                                  coap_pdu_t *response);
+
+/**
+ * Keeps a copy of @p response for coap_cache_serve_response_lkd() if it is
+ * a 2.05 (Content) with a complete body, until its Max-Age expires.
+ *
+ * Note: This function must be called in the locked state.
+ *
+ * @param session  The session the request came in on.
+ * @param resource The resource the request is for.
+ * @param request  The GET request.
+ * @param response The response from the request handler.
+ */
+void coap_cache_add_response_lkd(coap_session_t *session,
+                                 coap_resource_t *resource,
+                                 const coap_pdu_t *request,
+                                 const coap_pdu_t *response);
+
+/**
+ * Deletes the cached responses of @p resource, as it has changed or is being
+ * deleted.
+ *
+ * Note: This function must be called in the locked state.
+ *
+ * @param context  The context holding the cache.
+ * @param resource The resource.
+ */
+void coap_cache_delete_resource_entries(coap_context_t *context,
+                                        coap_resource_t *resource);
+
 typedef void coap_digest_ctx_t;
 
 /**
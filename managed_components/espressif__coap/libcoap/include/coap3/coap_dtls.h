@@ -40,6 +40,10 @@ typedef struct coap_dtls_pki_t coap_dtls_pki_t;
 #ifndef COAP_DTLS_MAX_PSK
 #define COAP_DTLS_MAX_PSK 64
 #endif
+#ifndef COAP_DTLS_RESUME_LIFETIME
+/** Default number of seconds a (D)TLS session can be resumed for */
+#define COAP_DTLS_RESUME_LIFETIME 7200
+#endif
 
 typedef enum coap_dtls_role_t {
   COAP_DTLS_ROLE_CLIENT, /**< Internal function invoked for client */
@@ -492,6 +492,96 @@ int coap_dtls_define_issue(coap_define_issue_key_t type,
  */
 int coap_dtls_set_cid_tuple_change(coap_context_t *context, uint8_t every);
 
+/**
+ * Apply the context's session resumption settings (resume_cache_size and
+ * resume_lifetime) to the (D)TLS library context.
+ *
+ * @param context        The coap_context_t object.
+ *
+ * @return @c 1 if session resumption is supported, else @c 0.
+ */
+int coap_dtls_context_set_resumption(coap_context_t *context);
+
+/**
+ * Account for a completed (D)TLS handshake, reporting
+ * COAP_EVENT_DTLS_RESUMED if an earlier session was resumed.
+ *
+ * @param session        The session whose handshake has completed.
+ * @param resumed        @c 1 if the handshake was abbreviated, else @c 0.
+ */
+void coap_dtls_handshake_done(coap_session_t *session, int resumed);
+
+#if COAP_CLIENT_SUPPORT
+/**
+ * Record the fingerprint of the PSK setup of client @p session, so that it
+ * only resumes sessions set up with the same identity and key.
+ *
+ * @param session        The client session.
+ */
+void coap_dtls_resume_setup_psk(coap_session_t *session);
+
+/**
+ * Record the fingerprint of the PKI setup of client @p session, so that it
+ * only resumes sessions set up with the same certificates, verification
+ * options and callbacks.
+ *
+ * @param session        The client session.
+ * @param setup_data     The PKI setup of @p session.
+ */
+void coap_dtls_resume_setup_pki(coap_session_t *session,
+                                const coap_dtls_pki_t *setup_data);
+
+/**
+ * Find the (D)TLS library session held for resumption with the server of
+ * client @p session, making it the most recently used.
+ *
+ * @param session        The client session.
+ * @param sni            The SNI requested by the client, or @c NULL.
+ *
+ * @return The (D)TLS library session, or @c NULL if none is held or
+ *         resumption is disabled.
+ */
+void *coap_dtls_resume_find(coap_session_t *session, const char *sni);
+
+/**
+ * Hold a (D)TLS library session for resumption with the server of client
+ * @p session, replacing any session already held for it. The least recently
+ * used session is released if there are more than resume_cache_size.
+ *
+ * @param session        The client session.
+ * @param sni            The SNI requested by the client, or @c NULL.
+ * @param data           The (D)TLS library session, which is owned by the
+ *                       held entry from now on.
+ * @param free_data      Releases @p data.
+ */
+void coap_dtls_resume_store(coap_session_t *session, const char *sni,
+                            void *data, void (*free_data)(void *data));
+
+/**
+ * Release the (D)TLS library session held for resumption with the server of
+ * client @p session, for example after a handshake offering it failed.
+ *
+ * @param session        The client session.
+ * @param sni            The SNI requested by the client, or @c NULL.
+ */
+void coap_dtls_resume_remove(coap_session_t *session, const char *sni);
+
+/**
+ * Release the least recently used held sessions until there are no more than
+ * the context's resume_cache_size.
+ *
+ * @param context        The coap_context_t object.
+ */
+void coap_dtls_resume_trim(coap_context_t *context);
+
+/**
+ * Release all the held sessions of @p context.
+ *
+ * @param context        The coap_context_t object.
+ */
+void coap_dtls_resume_free_all(coap_context_t *context);
+#endif /* COAP_CLIENT_SUPPORT */
+
 /** @} */
 
 #endif /* COAP_DTLS_INTERNAL_H */
@@ -41,6 +41,8 @@ typedef enum {
   COAP_EVENT_DTLS_CONNECTED    = 0x01DE,
   /** Triggered when (D)TLS session renegotiated */
   COAP_EVENT_DTLS_RENEGOTIATE  = 0x01DF,
+  /** Triggered when (D)TLS session resumed by an abbreviated handshake */
+  COAP_EVENT_DTLS_RESUMED      = 0x01E0,
   /** Triggered when (D)TLS error occurs */
   COAP_EVENT_DTLS_ERROR        = 0x0200,
 
@@ -38,6 +38,26 @@
 #define COAP_MAX_EPOLL_EVENTS 10
 #endif /* COAP_MAX_EPOLL_EVENTS */
 
+/*
+ * The upper limit for the number of datagrams read from an endpoint in a
+ * single system call when batched receive is enabled (see
+ * coap_context_set_rx_batch_size()), which can be changed by using
+ * -DCOAP_RX_BATCH_MAX=nn at compile time.
+ */
+#ifndef COAP_RX_BATCH_MAX
+#define COAP_RX_BATCH_MAX 32
+#endif /* COAP_RX_BATCH_MAX */
+
+/*
+ * The upper limit for the number of datagrams queued per endpoint for
+ * sending in a single system call when batched transmit is enabled (see
+ * coap_context_set_tx_batch_size()), which can be changed by using
+ * -DCOAP_TX_BATCH_MAX=nn at compile time.
+ */
+#ifndef COAP_TX_BATCH_MAX
+#define COAP_TX_BATCH_MAX 64
+#endif /* COAP_TX_BATCH_MAX */
+
 #ifdef _WIN32
 typedef SOCKET coap_fd_t;
 #define coap_closesocket closesocket
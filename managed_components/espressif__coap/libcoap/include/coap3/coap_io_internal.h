@@ -204,6 +204,112 @@ ssize_t coap_socket_send(coap_socket_t *sock, coap_session_t *session,
  */
 ssize_t coap_socket_recv(coap_socket_t *sock, coap_packet_t *packet);
 
+#if defined(HAVE_RECVMMSG) && defined(HAVE_STRUCT_CMSGHDR) && \
+    !defined(WITH_LWIP) && !defined(WITH_CONTIKI) && !defined(RIOT_VERSION)
+#define COAP_RECVMMSG_SUPPORT 1
+
+/**
+ * Function interface for reading multiple datagrams from an unconnected
+ * socket using a single recvmmsg() call. The local address and interface
+ * of each datagram is set up from its IP_PKTINFO / IPV6_PKTINFO ancillary
+ * data in the same way as coap_socket_recv().
+ *
+ * @param sock    Socket to read data from.
+ * @param packets Array of @p count packets with their payload buffers
+ *                (COAP_RXBUFFER_SIZE bytes) and addresses preset.
+ * @param count   The number of entries in @p packets.
+ *
+ * @return       The number of packets received (which can be @c 0),
+ *               or @c -1 on error.
+ */
+int coap_socket_recv_batch(coap_socket_t *sock, coap_packet_t *packets,
+                           unsigned int count);
+#endif /* HAVE_RECVMMSG && HAVE_STRUCT_CMSGHDR && ! WITH_LWIP && ! WITH_CONTIKI && ! RIOT_VERSION */
+
+#if defined(__linux__) && !defined(WITH_LWIP) && !defined(WITH_CONTIKI) && \
+    !defined(RIOT_VERSION)
+/* Only Linux spreads traffic over all the SO_REUSEPORT sockets of a port */
+#define COAP_REUSEPORT_SUPPORT 1
+
+#if COAP_SERVER_SUPPORT
+/**
+ * Set up a new (not yet bound) endpoint socket to share its port with the
+ * other shards, if the endpoint's context is sharded.
+ *
+ * @param sock The endpoint socket.
+ *
+ * @return @c 1 if successful (or the context is not sharded), else @c 0.
+ */
+int coap_socket_set_shard(coap_socket_t *sock);
+
+/**
+ * Set up how peers are steered to the shards sharing the port of a bound
+ * (and for TCP, listening) endpoint socket, if the endpoint's context is
+ * sharded.
+ *
+ * @param sock The endpoint socket.
+ *
+ * @return @c 1 if successful (or the context is not sharded), else @c 0.
+ */
+int coap_socket_steer_shard(coap_socket_t *sock);
+#endif /* COAP_SERVER_SUPPORT */
+#endif /* __linux__ && ! WITH_LWIP && ! WITH_CONTIKI && ! RIOT_VERSION */
+
+#if defined(HAVE_SENDMMSG) && defined(HAVE_STRUCT_CMSGHDR) && \
+    !defined(WITH_LWIP) && !defined(WITH_CONTIKI) && !defined(RIOT_VERSION)
+#define COAP_SENDMMSG_SUPPORT 1
+
+/**
+ * Datagrams queued for transmission over an endpoint socket.
+ */
+typedef struct coap_tx_batch_t coap_tx_batch_t;
+
+#if COAP_SERVER_SUPPORT
+/**
+ * Function interface for queuing a datagram to be sent over an endpoint's
+ * (unconnected) socket. Queued datagrams are sent using sendmmsg() (and UDP
+ * GSO where consecutive datagrams are for the same peer) when
+ * coap_socket_send_flush() is called, or when the queue is full.
+ *
+ * @param endpoint      Endpoint to send data over.
+ * @param session       Addressing information for the datagram.
+ * @param data          The data to send.
+ * @param datalen       The actual length of @p data.
+ *
+ * @return              The number of bytes queued on success, or a value
+ *                      less than zero on error.
+ */
+ssize_t coap_socket_send_queue(coap_endpoint_t *endpoint,
+                               coap_session_t *session,
+                               const uint8_t *data, size_t datalen);
+
+/**
+ * Send all the datagrams queued for @p endpoint.
+ *
+ * @param endpoint      Endpoint to flush the send queue of.
+ */
+void coap_socket_send_flush(coap_endpoint_t *endpoint);
+
+/**
+ * Release any queued datagram storage for @p endpoint. Any datagrams still
+ * queued are discarded.
+ *
+ * @param endpoint      Endpoint to release the send queue of.
+ */
+void coap_socket_send_queue_free(coap_endpoint_t *endpoint);
+#endif /* COAP_SERVER_SUPPORT */
+#endif /* HAVE_SENDMMSG && HAVE_STRUCT_CMSGHDR && ! WITH_LWIP && ! WITH_CONTIKI && ! RIOT_VERSION */
+
+/**
+ * Send off all the datagrams that have been queued for transmission on the
+ * endpoints of @p context during the current I/O processing iteration.
+ *
+ * Note: Needs to be called in a locked state.
+ *
+ * @param context The CoAP context.
+ */
+void coap_io_flush_send_lkd(coap_context_t *context);
+
 #ifndef coap_mcast_interface
 # define coap_mcast_interface(Local) 0
 #endif
@@ -65,6 +65,9 @@ typedef enum {
   COAP_OSCORE_EP,
   COAP_OSCORE_BUF,
   COAP_COSE,
+  COAP_WORK,
+  COAP_CACHE_EXPIRE,
+  COAP_PROXY_EXPIRE,
   COAP_MEM_TAG_LAST
 } coap_memory_tag_t;
 
@@ -86,7 +89,8 @@ void *coap_malloc_type(coap_memory_tag_t type, size_t size);
  * Reallocates a chunk @p p of bytes created by coap_malloc_type() or
  * coap_realloc_type() and returns a pointer to the newly allocated memory of
  * @p size.
- * Only COAP_STRING type is supported.
+ * Only COAP_STRING, COAP_CACHE_EXPIRE and COAP_PROXY_EXPIRE types are
+ * supported.
  *
  * Note: If there is an error, @p p will separately need to be released by
  * coap_free_type().
@@ -108,6 +112,38 @@ void *coap_realloc_type(coap_memory_tag_t type, void *p, size_t size);
  */
 void coap_free_type(coap_memory_tag_t type, void *p);
 
+/**
+ * Selects whether coap_malloc_type() hands out small objects from slabs of
+ * memory kept for each memory type and size class, instead of using the
+ * system's malloc() for every object. Faster allocation is traded for more
+ * heap in use, as objects are rounded up to size classes and the slab memory
+ * is held for re-use for the life of the process.
+ *
+ * Slab support is only built in if COAP_MEMORY_SLAB is defined to 1. This
+ * can then be changed at any time, as objects are always released to where
+ * they came from. The initial setting is set by COAP_MEMORY_SLAB_ENABLE.
+ *
+ * @param enable @c 1 to use the slab allocator, @c 0 to use malloc().
+ *
+ * @return @c 1 if successful, @c 0 if slab support is not built in.
+ */
+int coap_memory_set_slab(int enable);
+
+/**
+ * Preallocates slab memory for @p count objects of @p type of up to @p size
+ * bytes, e.g. just after coap_startup() to have all the PDUs needed for
+ * normal operation allocated up front.
+ *
+ * @param type  The type of object.
+ * @param size  The maximum size of the objects.
+ * @param count The number of objects to preallocate.
+ *
+ * @return @c 1 if successful, @c 0 if slab support is not built in, @p size
+ *         is too large for a slab or there is no memory.
+ */
+int coap_memory_slab_reserve(coap_memory_tag_t type, size_t size,
+                             size_t count);
+
 /**
  * Dumps the current usage of malloc'd memory types.
  *
@@ -187,6 +223,10 @@ coap_free(void *pointer) {
 
 #define coap_dump_memory_type_counts(l) coap_lwip_dump_memory_pools(l)
 
+/* LwIP has its own memory pools */
+#define coap_memory_set_slab(e) (0)
+#define coap_memory_slab_reserve(t,s,c) (0)
+
 #endif /* WITH_LWIP */
 
 #endif /* COAP_MEM_H_ */
@@ -150,4 +150,20 @@ typedef int coap_mutex_t;
 
 #endif /* !WITH_CONTIKI && !WITH_LWIP && !RIOT_VERSION && !HAVE_PTHREAD_H && !HAVE_PTHREAD_MUTEX_LOCK */
 
+/*
+ * Static variables that are used as scratch space (large buffers instead of
+ * stack variables, or returned strings) can be in use by the threads of
+ * different contexts at the same time, as each context has its own lock.
+ * So, with thread safe support, each thread gets its own copy.
+ */
+#if COAP_THREAD_SAFE
+#if defined(_MSC_VER)
+#define COAP_THREAD_LOCAL __declspec(thread)
+#else /* ! _MSC_VER */
+#define COAP_THREAD_LOCAL __thread
+#endif /* ! _MSC_VER */
+#else /* ! COAP_THREAD_SAFE */
+#define COAP_THREAD_LOCAL
+#endif /* ! COAP_THREAD_SAFE */
+
 #endif /* COAP_MUTEX_INTERNAL_H_ */
@@ -212,6 +212,49 @@ COAP_API int coap_context_set_pki_root_cas(coap_context_t *context,
                                            const char *ca_file,
                                            const char *ca_dir);
 
+/**
+ * Enable (D)TLS session resumption for the context, so that a client
+ * reconnecting to a server it has recently had a (D)TLS session with can use
+ * an abbreviated handshake without the key exchange.
+ *
+ * As a server, up to @p cache_size sessions are held for resumption by
+ * session ID, and session tickets are issued to clients that support them.
+ * The key protecting the tickets is changed every @p lifetime seconds.
+ *
+ * As a client, up to @p cache_size sessions are held, one per server (address,
+ * protocol, SNI and PSK identity), and are offered when a new client session
+ * is created to the same server with the same security setup (PSK key, or
+ * PKI verification options, certificates, keys and validation callbacks).
+ * Setting new root CAs releases the held sessions.
+ *
+ * A resumed session reports COAP_EVENT_DTLS_RESUMED when its handshake
+ * completes. Certificate and PSK identity validation callbacks are not
+ * called for resumed sessions.
+ *
+ * @param context    The coap_context_t object.
+ * @param cache_size The maximum number of sessions held for resumption, or
+ *                   @c 0 (the default) to disable resumption.
+ * @param lifetime   The number of seconds a session can be resumed for, or
+ *                   @c 0 for COAP_DTLS_RESUME_LIFETIME.
+ *
+ * @return @c 1 if successful, @c 0 if the (D)TLS library does not support
+ *         session resumption (TinyDTLS).
+ */
+COAP_API int coap_context_set_session_resumption(coap_context_t *context,
+                                                 unsigned int cache_size,
+                                                 unsigned int lifetime);
+
+/**
+ * Get the number of (D)TLS handshakes completed by the context's sessions.
+ *
+ * @param context The coap_context_t object.
+ * @param full    If not @c NULL, updated with the number of full handshakes.
+ * @param resumed If not @c NULL, updated with the number of abbreviated
+ *                handshakes, where an earlier session was resumed.
+ */
+void coap_context_get_handshake_stats(const coap_context_t *context,
+                                      uint64_t *full, uint64_t *resumed);
+
 /**
  * Set the context keepalive timer for sessions.
  * A keepalive message will be sent after if a session has been inactive,
@@ -385,6 +428,127 @@ void coap_context_set_max_handshake_sessions(coap_context_t *context,
  */
 unsigned int coap_context_get_max_handshake_sessions(const coap_context_t *context);
 
+/**
+ * Set the maximum number of datagrams that are read from a UDP or DTLS
+ * endpoint in a single system call (using recvmmsg()) each time the endpoint
+ * socket becomes readable. Any value larger than COAP_RX_BATCH_MAX is reduced
+ * to COAP_RX_BATCH_MAX.
+ * 0 or 1 (the default) means that one datagram is read at a time.
+ *
+ * @param context       The coap_context_t object.
+ * @param rx_batch_size The maximum number of datagrams to read at a time.
+ *
+ * @return @c 1 if successful, @c 0 if batched receive is not supported.
+ */
+int coap_context_set_rx_batch_size(coap_context_t *context,
+                                   unsigned int rx_batch_size);
+
+/**
+ * Get the maximum number of datagrams read from an endpoint at a time.
+ *
+ * @param context The coap_context_t object.
+ *
+ * @return The maximum number of datagrams read at a time.
+ */
+unsigned int coap_context_get_rx_batch_size(const coap_context_t *context);
+
+/**
+ * Get the endpoint receive statistics. @p packets divided by @p wakeups gives
+ * the average number of datagrams handled per endpoint read event (and
+ * receive system call).
+ *
+ * @param context The coap_context_t object.
+ * @param wakeups Updated with the number of endpoint read events, if not NULL.
+ * @param packets Updated with the number of datagrams read, if not NULL.
+ */
+void coap_context_get_rx_batch_stats(const coap_context_t *context,
+                                     uint64_t *wakeups, uint64_t *packets);
+
+/**
+ * Set the maximum number of datagrams that are queued up for sending over a
+ * UDP or DTLS endpoint before they are sent using a single system call
+ * (sendmmsg(), with UDP GSO where consecutive datagrams are for the same
+ * peer). Datagrams queued during an I/O processing iteration (for example
+ * observe notifications or retransmits) are always sent before
+ * coap_io_process() waits for the next event. Any value larger than
+ * COAP_TX_BATCH_MAX is reduced to COAP_TX_BATCH_MAX.
+ * 0 or 1 (the default) means that each datagram is sent immediately.
+ *
+ * @param context       The coap_context_t object.
+ * @param tx_batch_size The maximum number of datagrams to queue.
+ *
+ * @return @c 1 if successful, @c 0 if batched transmit is not supported.
+ */
+int coap_context_set_tx_batch_size(coap_context_t *context,
+                                   unsigned int tx_batch_size);
+
+/**
+ * Get the maximum number of datagrams queued per endpoint before sending.
+ *
+ * @param context The coap_context_t object.
+ *
+ * @return The maximum number of datagrams queued.
+ */
+unsigned int coap_context_get_tx_batch_size(const coap_context_t *context);
+
+/**
+ * Get the endpoint batched transmit statistics.
+ *
+ * @param context  The coap_context_t object.
+ * @param syscalls Updated with the number of batched send system calls,
+ *                 if not NULL.
+ * @param packets  Updated with the number of datagrams sent by those calls,
+ *                 if not NULL.
+ */
+void coap_context_get_tx_batch_stats(const coap_context_t *context,
+                                     uint64_t *syscalls, uint64_t *packets);
+
+/**
+ * How incoming traffic is spread over the contexts of a sharded server.
+ */
+typedef enum coap_shard_steer_t {
+  COAP_SHARD_STEER_HASH = 0, /**< Kernel hash of the peer address and port */
+  COAP_SHARD_STEER_ADDR,     /**< Hash of the peer address only, so that a
+                                  peer stays on the same shard if its port
+                                  changes (e.g. NAT re-binding with DTLS
+                                  Connection-ID) */
+} coap_shard_steer_t;
+
+/**
+ * Make the endpoints subsequently created by coap_new_endpoint() in
+ * @p context part of a sharded server. Each of the @p num_shards contexts of
+ * the server (typically one per CPU core, each driven by its own thread or
+ * process calling coap_io_process()) sets up the same resources and creates
+ * endpoints on the same addresses and ports. The socket option SO_REUSEPORT
+ * then lets them share each port, with the kernel steering every peer to one
+ * of the shards as defined by @p steer.
+ *
+ * All sessions, observe state and cache entries stay local to the shard
+ * that the peer was steered to. As each context has its own lock in a
+ * thread-safe build, the shards can be run as threads of one process as well
+ * as separate processes. With threads, the application has to protect any
+ * state that the resource handlers of different shards share.
+ *
+ * @param context    The coap_context_t object.
+ * @param num_shards The number of contexts sharing the endpoints.
+ *                   0 or 1 means the endpoints are not shared.
+ * @param steer      How peers are spread over the shards.
+ *
+ * @return @c 1 if successful, @c 0 if sharding (or @p steer) is not
+ *         supported.
+ */
+int coap_context_set_shards(coap_context_t *context, unsigned int num_shards,
+                            coap_shard_steer_t steer);
+
+/**
+ * Get the number of contexts sharing the endpoints of @p context.
+ *
+ * @param context The coap_context_t object.
+ *
+ * @return The number of shards set by coap_context_set_shards().
+ */
+unsigned int coap_context_get_shards(const coap_context_t *context);
+
 /**
  * Returns a new message id and updates @p session->tx_mid accordingly. The
  * message id is returned in network byte order to make it easier to read in
@@ -707,6 +871,42 @@ COAP_API int coap_io_process_with_fds(coap_context_t *ctx, uint32_t timeout_ms,
  */
 COAP_API int coap_io_pending(coap_context_t *context);
 
+/**
+ * Work handler invoked by coap_io_process() for work posted using
+ * coap_io_post_work().
+ *
+ * @param context The CoAP context.
+ * @param arg     The @c arg passed to coap_io_post_work().
+ */
+typedef void (*coap_io_work_handler_t)(coap_context_t *context, void *arg);
+
+/**
+ * Hand over some work to the thread running coap_io_process() for @p context.
+ *
+ * This does not lock the libcoap lock of @p context, and so can be used by
+ * other application threads without contending with the I/O thread (and even
+ * if libcoap is not built with thread-safe support).  @p handler
+ * is invoked (in posting order) from within coap_io_process() with the
+ * lock of @p context held, so can safely call any of the libcoap public API, e.g.
+ * coap_resource_notify_observers() or coap_send().
+ *
+ * If libcoap is built with epoll support, or on other systems with
+ * select() and thread-safe support, the I/O thread is woken up immediately.
+ * Otherwise @p handler is called the next time coap_io_process() is called
+ * or returns from waiting.
+ *
+ * Any work still pending when @p context is freed is run by
+ * coap_free_context().
+ *
+ * @param context The CoAP context.
+ * @param handler The handler to invoke.
+ * @param arg     Argument passed to @p handler.
+ *
+ * @return @c 1 if the work has been queued, else @c 0.
+ */
+int coap_io_post_work(coap_context_t *context, coap_io_work_handler_t handler,
+                      void *arg);
+
 /**
 * Iterates through all the coap_socket_t structures embedded in endpoints or
 * sessions associated with the @p ctx to determine which are wanting any
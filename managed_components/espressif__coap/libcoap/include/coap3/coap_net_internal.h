@@ -33,11 +33,21 @@
  * Queue entry
  */
 struct coap_queue_t {
-  struct coap_queue_t *next;
-  coap_tick_t t;                /**< when to send PDU for the next time */
+  struct coap_queue_t *next;    /**< next entry in session->delayqueue */
+  coap_tick_t t;                /**< when to send PDU for the next time,
+                                 *   relative to context->sendqueue_basetime */
   unsigned char retransmit_cnt; /**< retransmission counter, will be removed
                                  *    when zero */
   uint8_t is_mcast;             /**< Set if this is a queued mcast response */
+  uint8_t in_sendqueue;         /**< Set while held in context->sendqueue */
+  struct coap_queue_t *h_child; /**< sendqueue heap: first child */
+  struct coap_queue_t *h_next;  /**< sendqueue heap: next sibling */
+  struct coap_queue_t *h_prev;  /**< sendqueue heap: previous sibling, or
+                                 *   parent if this is the first child */
+  struct coap_queue_t *s_next;  /**< next entry of the same session in
+                                 *   the sendqueue */
+  struct coap_queue_t *s_prev;  /**< previous entry of the same session in
+                                 *   the sendqueue */
   unsigned int timeout;         /**< the randomized timeout value */
   coap_session_t *session;      /**< the CoAP session */
   coap_mid_t id;                /**< CoAP message id */
@@ -56,6 +66,8 @@ struct coap_context_t {
                                           unknown resources */
   coap_resource_t *proxy_uri_resource; /**< can be used for handling
                                             proxy URI resources */
+  struct coap_route_node_t *routes; /**< radix tree of the {param} and
+                                         prefix resources */
   coap_resource_release_userdata_handler_t release_userdata;
   /**< function to  release user_data
        when resource is deleted */
@@ -68,16 +80,23 @@ struct coap_context_t {
 #endif /* COAP_ASYNC_SUPPORT */
 
   /**
-   * The time stamp in the first element of the sendqeue is relative
+   * The time stamps of all the elements in the sendqueue are relative
    * to sendqueue_basetime. */
   coap_tick_t sendqueue_basetime;
-  coap_queue_t *sendqueue;
+  coap_queue_t *sendqueue;        /**< root of the retransmission pairing heap,
+                                       i.e. the next entry to become due */
 #if COAP_SERVER_SUPPORT
   coap_endpoint_t *endpoint;      /**< the endpoints used for listening  */
 #endif /* COAP_SERVER_SUPPORT */
 #if COAP_CLIENT_SUPPORT
   coap_session_t *sessions;       /**< client sessions */
 #endif /* COAP_CLIENT_SUPPORT */
+  coap_session_t *session_timers; /**< pairing heap of sessions ordered by
+                                       when their timers next need checking */
+  coap_session_t *sessions_due;   /**< sessions to check at the next
+                                       coap_io_prepare_io() */
+  uint32_t session_timer_pass;    /**< count of session timer checks */
+  uint8_t session_timers_rescan;  /**< Set if all sessions need checking */
 
 #ifdef WITH_CONTIKI
   struct uip_udp_conn *conn;      /**< uIP connection object */
@@ -108,6 +127,8 @@ struct coap_context_t {
   coap_ping_handler_t ping_handler; /**< Called when a CoAP ping is received */
   coap_pong_handler_t pong_handler; /**< Called when a ping response
                                          is received */
+  coap_block_data_handler_t block_data_handler; /**< Called with each part
+                                                     of a large body */
 
 #if COAP_SERVER_SUPPORT
   coap_observe_added_t observe_added; /**< Called when there is a new observe
@@ -160,6 +181,43 @@ struct coap_context_t {
   unsigned int ping_timeout;           /**< Minimum inactivity time before
                                             sending a ping message. 0 means
                                             disabled. */
+  unsigned int resume_cache_size;  /**< Maximum number of (D)TLS sessions
+                                        held for resumption. 0 means
+                                        resumption is disabled. */
+  unsigned int resume_lifetime;    /**< Number of seconds a session can be
+                                        resumed for, and how often session
+                                        ticket keys are changed */
+  uint64_t tls_full_handshakes;    /**< Number of full (D)TLS handshakes */
+  uint64_t tls_resumed_handshakes; /**< Number of abbreviated (D)TLS
+                                        handshakes */
+#if COAP_CLIENT_SUPPORT
+  struct coap_dtls_resume_t *dtls_resume; /**< client sessions held for
+                                               resumption, least recently
+                                               used first */
+  unsigned int dtls_resume_count;  /**< Number of entries in dtls_resume */
+#endif /* COAP_CLIENT_SUPPORT */
+#if COAP_SERVER_SUPPORT
+  unsigned int rx_batch_size;      /**< Maximum number of datagrams to read
+                                        from an endpoint per read event.
+                                        0 or 1 means no batching. */
+  coap_packet_t *rx_batch;         /**< rx_batch_alloc packets followed by
+                                        their payload buffers */
+  unsigned int rx_batch_alloc;     /**< Number of packets in rx_batch */
+  uint64_t rx_wakeups;             /**< Number of endpoint read events */
+  uint64_t rx_packets;             /**< Number of datagrams read from
+                                        endpoints */
+  unsigned int tx_batch_size;      /**< Maximum number of datagrams queued
+                                        per endpoint before sending. 0 or 1
+                                        means no batching. */
+  uint64_t tx_syscalls;            /**< Number of endpoint send calls */
+  uint64_t tx_packets;             /**< Number of datagrams sent over
+                                        endpoints */
+  unsigned int num_shards;         /**< Number of contexts sharing each
+                                        endpoint with SO_REUSEPORT. 0 or 1
+                                        means not sharded. */
+  coap_shard_steer_t shard_steer;  /**< How peers are spread over the
+                                        shards */
+#endif /* COAP_SERVER_SUPPORT */
   uint32_t csm_timeout_ms;         /**< Timeout for waiting for a CSM from
                                            the remote side. */
   uint32_t csm_max_message_size;   /**< Value for CSM Max-Message-Size */
@@ -171,6 +229,20 @@ struct coap_context_t {
                                         cache-key */
   size_t cache_ignore_count;       /**< The number of CoAP options to ignore
                                         when creating a cache-key */
+  uint64_t cache_seed[2];          /**< Random key for the cache-key hash */
+  coap_cache_entry_t *cache_lru;   /**< cache-entries, least recently used
+                                        first */
+  coap_cache_entry_t **cache_expire; /**< min-heap of cache-entries that
+                                          expire, soonest first */
+  size_t cache_expire_count;       /**< Number of entries in cache_expire */
+  size_t cache_expire_max;         /**< Allocated size of cache_expire */
+  size_t cache_size;               /**< Bytes held by cache-entries */
+  size_t cache_max_size;           /**< Byte budget for cache-entries, or 0
+                                        if unlimited */
+  uint64_t cache_hits;             /**< Number of cache lookups found */
+  uint64_t cache_misses;           /**< Number of cache lookups not found */
+  uint64_t cache_evictions;        /**< Number of cache-entries evicted to
+                                        keep within cache_max_size */
 #endif /* COAP_SERVER_SUPPORT */
   void *app;                       /**< application-specific data */
   uint32_t max_token_size;         /**< Largest token size supported RFC8974 */
@@ -189,30 +261,75 @@ struct coap_context_t {
 #endif /* ! COAP_EPOLL_SUPPORT */
 #if COAP_SERVER_SUPPORT
   uint8_t observe_pending;         /**< Observe response pending */
+  uint8_t observe_deferred;        /**< Notifications held back by
+                                        COAP_OBS_MAX_BURST */
+  uint32_t notify_pass;            /**< coap_check_notify() pass counter */
+  coap_tick_t observe_due;         /**< when the next held back (pmin/pmax)
+                                        notification is due, or 0 */
+  coap_resource_t *dirty_resources; /**< resources with notifications
+                                         pending */
   uint8_t observe_no_clear;        /**< Observe 4.04 not to be sent on deleting
                                         resource */
   uint8_t mcast_per_resource;      /**< Mcast controlled on a per resource
                                         basis */
 #endif /* COAP_SERVER_SUPPORT */
 #if COAP_PROXY_SUPPORT
-  coap_proxy_list_t *proxy_list;   /**< Set of active proxy sessions */
-  size_t proxy_list_count;         /**< Number of active proxy sessions */
+  coap_proxy_list_t *proxy_list;   /**< Hash of active proxy sessions */
+  struct coap_proxy_upstream_t *proxy_upstreams; /**< Hash of upstream
+                                                      servers in use */
+  coap_proxy_list_t **proxy_expire; /**< Min-heap of proxy sessions by idle
+                                         timeout */
+  size_t proxy_expire_count;       /**< Entries in proxy_expire */
+  size_t proxy_expire_max;         /**< Space allocated for proxy_expire */
 #endif /* COAP_PROXY_SUPPORT */
 #if COAP_CLIENT_SUPPORT
   uint8_t testing_cids;            /**< Change client's source port every testing_cids */
+  uint32_t cid_track_counter;      /**< Packets sent, for testing_cids */
 #endif /* COAP_CLIENT_SUPPORT */
   uint32_t block_mode;             /**< Zero or more COAP_BLOCK_ or'd options */
+  coap_work_queue_t work_queue;    /**< Work posted by coap_io_post_work() */
+#if COAP_THREAD_SAFE
+  coap_lock_t lock;                /**< Lock for everything in this context */
+#endif /* COAP_THREAD_SAFE */
 };
 
+#if COAP_THREAD_SAFE
 /**
- * Adds @p node to given @p queue, ordered by variable t in @p node.
+ * Get the lock to use for @p context.
  *
- * @param queue Queue to add to.
- * @param node Node entry to add to Queue.
+ * @param context The context, or NULL for state that is not part of a
+ *                context.
+ *
+ * @return context->lock, or global_lock if @p context is NULL.
+ */
+COAP_STATIC_INLINE coap_lock_t *
+coap_lock_get(coap_context_t *context) {
+  return context ? &context->lock : &global_lock;
+}
+#endif /* COAP_THREAD_SAFE */
+
+/**
+ * Adds @p node to the sendqueue of @p context, ordered by variable t in
+ * @p node. The sendqueue is kept as a pairing heap, so this takes constant
+ * time. If @p node->session is set, @p node is also linked into the
+ * session's list of entries in the sendqueue.
+ *
+ * @param context The context holding the sendqueue.
+ * @param node Node entry to add to the sendqueue.
  *
  * @return @c 1 added to queue, @c 0 failure.
  */
-int coap_insert_node(coap_queue_t **queue, coap_queue_t *node);
+int coap_insert_node(coap_context_t *context, coap_queue_t *node);
+
+/**
+ * Removes @p node from the sendqueue of @p context (and from its session's
+ * list of entries in the sendqueue). Nothing is done if @p node is not in the
+ * sendqueue. The storage of @p node is @b not released.
+ *
+ * @param context The context holding the sendqueue.
+ * @param node Node entry to remove from the sendqueue.
+ */
+void coap_unlink_node(coap_context_t *context, coap_queue_t *node);
 
 /**
  * Destroys specified @p node.
@@ -237,13 +354,14 @@ COAP_API int coap_delete_node(coap_queue_t *node);
 int coap_delete_node_lkd(coap_queue_t *node);
 
 /**
- * Removes all items from given @p queue and frees the allocated storage.
+ * Removes all items from the sendqueue of @p context and frees the allocated
+ * storage.
  *
  * Internal function.
  *
- * @param queue The queue to delete.
+ * @param context The context whose sendqueue is to be deleted.
  */
-void coap_delete_all(coap_queue_t *queue);
+void coap_delete_all(coap_context_t *context);
 
 /**
  * Creates a new node suitable for adding to the CoAP sendqueue.
@@ -296,14 +414,15 @@ coap_mid_t coap_retransmit(coap_context_t *context, coap_queue_t *node);
 int coap_handle_dgram(coap_context_t *ctx, coap_session_t *session, uint8_t *data, size_t data_len);
 
 /**
- * This function removes the element with given @p id from the list given list.
+ * This function removes the element with given @p id for @p session from the
+ * sendqueue of @p context. Only the entries of @p session are searched.
  * If @p id was found, @p node is updated to point to the removed element. Note
  * that the storage allocated by @p node is @b not released. The caller must do
  * this manually using coap_delete_node(). This function returns @c 1 if the
  * element with id @p id was found, @c 0 otherwise. For a return value of @c 0,
  * the contents of @p node is undefined.
  *
- * @param queue The queue to search for @p id.
+ * @param context The context holding the sendqueue to search for @p id.
  * @param session The session to look for.
  * @param id    The message id to look for.
  * @param node  If found, @p node is updated to point to the removed node. You
@@ -311,7 +430,7 @@ int coap_handle_dgram(coap_context_t *ctx, coap_session_t *session, uint8_t *dat
  *
  * @return      @c 1 if @p id was found, @c 0 otherwise.
  */
-int coap_remove_from_queue(coap_queue_t **queue,
+int coap_remove_from_queue(coap_context_t *context,
                            coap_session_t *session,
                            coap_mid_t id,
                            coap_queue_t **node);
@@ -469,7 +588,8 @@ int coap_client_delay_first(coap_session_t *session);
  * resources that have been registered with @p context, and frees the attached
  * endpoints.
  *
- * Note: This function must be called in the locked state.
+ * Note: This function must be called in the locked state. The context lock
+ * is released as part of freeing off @p context.
  *
  * @param context The current coap_context_t object to free off.
  */
@@ -562,6 +682,24 @@ int coap_context_set_pki_root_cas_lkd(coap_context_t *context,
                                       const char *ca_file,
                                       const char *ca_dir);
 
+/**
+ * Enable or disable (D)TLS session resumption for the context.
+ *
+ * Note: This function must be called in the locked state.
+ *
+ * @param context    The current coap_context_t object.
+ * @param cache_size The maximum number of sessions held for resumption, or
+ *                   @c 0 to disable resumption.
+ * @param lifetime   The number of seconds a session can be resumed for, or
+ *                   @c 0 for COAP_DTLS_RESUME_LIFETIME.
+ *
+ * @return @c 1 if successful, @c 0 if the (D)TLS library does not support
+ *         session resumption.
+ */
+int coap_context_set_session_resumption_lkd(coap_context_t *context,
+                                            unsigned int cache_size,
+                                            unsigned int lifetime);
+
 /**
  * Set the context's default PSK hint and/or key for a server.
  *
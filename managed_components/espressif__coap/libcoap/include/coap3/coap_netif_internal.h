@@ -97,6 +97,22 @@ ssize_t coap_netif_dgrm_read(coap_session_t *session, coap_packet_t *packet);
 ssize_t coap_netif_dgrm_read_ep(coap_endpoint_t *endpoint,
                                 coap_packet_t *packet);
 
+#if COAP_RECVMMSG_SUPPORT
+/**
+ * Function interface for layer data datagram receiving of multiple datagrams
+ * for endpoints in a single system call.
+ *
+ * @param endpoint Endpoint to receive data on.
+ * @param packets  Where to put the received information.
+ * @param count    The number of entries in @p packets.
+ *
+ * @return                 >=0 Number of packets read.
+ *                          -1 Error of some sort (see errno).
+ */
+int coap_netif_dgrm_read_ep_batch(coap_endpoint_t *endpoint,
+                                  coap_packet_t *packets, unsigned int count);
+#endif /* COAP_RECVMMSG_SUPPORT */
+
 /**
  * Function interface for netif datagram data transmission. This function
  * returns the number of bytes that have been transmitted, or a value less
@@ -400,6 +400,19 @@ coap_pdu_t *coap_pdu_init(coap_pdu_type_t type, coap_pdu_code_t code,
 COAP_API coap_pdu_t *coap_new_pdu(coap_pdu_type_t type, coap_pdu_code_t code,
                                   coap_session_t *session);
 
+/**
+ * Makes sure that @p pdu has storage for at least @p size bytes of token,
+ * options and data, so that a PDU whose final size is known (or can be
+ * estimated) up front is grown once rather than as each option and the data
+ * are added. @p size is capped at the PDU's maximum message size.
+ *
+ * @param pdu  The PDU to reserve storage in.
+ * @param size The number of bytes of token, options and data to allow for.
+ *
+ * @return @c 1 on success, or @c 0 if the storage could not be allocated.
+ */
+int coap_pdu_reserve(coap_pdu_t *pdu, size_t size);
+
 /**
  * Dispose of an CoAP PDU and frees associated storage.
  * Not that in general you should not call this function directly.
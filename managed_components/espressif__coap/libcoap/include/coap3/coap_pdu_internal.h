@@ -142,6 +142,8 @@ struct coap_pdu_t {
   uint8_t hdr_size;         /**< actual size used for protocol-specific
                                  header (0 until header is encoded) */
   uint8_t crit_opt;         /**< Set if unknown critical option for proxy */
+  uint8_t borrowed;         /**< Set if the token buffer belongs to the caller
+                                 (see coap_pdu_parse_borrowed()) */
   uint16_t max_opt;         /**< highest option number in PDU */
   uint32_t e_token_length;  /**< length of Token space (includes leading
                                  extended bytes */
@@ -245,6 +247,37 @@ int coap_pdu_parse_header(coap_pdu_t *pdu, coap_proto_t proto);
  */
 int coap_pdu_parse_opt(coap_pdu_t *pdu);
 
+#ifndef WITH_LWIP
+/**
+ * Parses the @p length bytes of @p data as a CoAP PDU into @p pdu (typically
+ * on the caller's stack) without allocating or copying anything. The token,
+ * options and payload of @p pdu point into @p data, which must stay valid
+ * until coap_pdu_release_borrowed() is called. If @p pdu has to grow (e.g.
+ * an option is updated), it is first copied into an allocated buffer.
+ *
+ * As with any received PDU, anything that needs to keep @p pdu once it has
+ * been handled must take a copy of it.
+ *
+ * @param proto    Session's protocol.
+ * @param data     The raw data to parse as CoAP PDU.
+ * @param length   The actual size of @p data.
+ * @param max_size The maximum size that @p pdu can grow to.
+ * @param pdu      The PDU structure to initialize.
+ *
+ * @return 1 on success or @c 0 on error.
+ */
+int coap_pdu_parse_borrowed(coap_proto_t proto, uint8_t *data, size_t length,
+                            size_t max_size, coap_pdu_t *pdu);
+
+/**
+ * Frees off any buffer that a PDU set up by coap_pdu_parse_borrowed() had to
+ * allocate. The coap_pdu_t itself is not freed.
+ *
+ * @param pdu The PDU to release.
+ */
+void coap_pdu_release_borrowed(coap_pdu_t *pdu);
+#endif /* ! WITH_LWIP */
+
 /**
  * Clears any contents from @p pdu and resets @c used_size,
  * and @c data pointers. @c max_size is set to @p size, any
@@ -48,6 +48,9 @@ typedef struct coap_proxy_server_list_t {
   int track_client_session;   /**< If 1, track individual connections to upstream
                                    server, else 0 */
   unsigned int idle_timeout_secs; /**< Proxy session idle timeout (0 is no timeout) */
+  unsigned int max_upstream_sessions; /**< Maximum sessions to any one upstream
+                                           server if track_client_session
+                                           (0 is no limit) */
 } coap_proxy_server_list_t;
 
 /**
@@ -97,9 +100,12 @@ int COAP_API coap_proxy_forward_request(coap_session_t *session,
  * @param cache_key Updated with the cache key pointer provided to
  *                  coap_proxy_forward_request().  The caller should
  *                  delete this cach key (unless the client request set up an
- *                  Observe and there will be unsolicited responses).
+ *                  Observe and there will be unsolicited responses).  If
+ *                  the response went to several coalesced requests, this is
+ *                  the cache key of the first and the others are deleted.
  *
- * @return One of COAP_RESPONSE_FAIL or COAP_RESPONSE_OK.
+ * @return One of COAP_RESPONSE_FAIL or COAP_RESPONSE_OK.  COAP_RESPONSE_FAIL
+ *         is returned for a notification that no client is observing.
  */
 coap_response_t COAP_API coap_proxy_forward_response(coap_session_t *session,
                                                      const coap_pdu_t *received,
@@ -18,6 +18,7 @@
 #define COAP_PROXY_INTERNAL_H_
 
 #include "coap_internal.h"
+#include "coap_uthash_internal.h"
 
 /**
  * @ingroup internal_api
@@ -26,22 +27,52 @@
  * @{
  */
 
+/*
+ * Identical GET or FETCH requests (the same req_key) that are waiting for
+ * the same upstream response share the same token_used, so that only one
+ * request is sent upstream and the response goes back to all of them.
+ */
 typedef struct coap_proxy_req_t {
   coap_pdu_t *pdu;
   coap_resource_t *resource;
   coap_session_t *incoming;
   coap_bin_const_t *token_used;
   coap_cache_key_t *cache_key;
+  coap_cache_key_t req_key;  /**< Key of request (if coalesce) */
+  uint8_t coalesce;          /**< Set if can share upstream request */
+  uint8_t observe;           /**< Set if Observe registration */
+  coap_pdu_t *last_pdu;      /**< Options of last notification for
+                                  observers that join later */
+  coap_binary_t *last_body;  /**< Body of last notification */
 } coap_proxy_req_t;
 
+/*
+ * An upstream server, keyed by scheme, port and host.  It counts the
+ * ongoing sessions (one per incoming session if client tracking) so that
+ * they can be limited.
+ */
+typedef struct coap_proxy_upstream_t {
+  UT_hash_handle hh;         /**< Hash handle, key is key[0..key_len) */
+  size_t session_count;      /**< Number of proxy entries using this */
+  size_t key_len;            /**< Length of key */
+  uint8_t key[1];            /**< Scheme, port and host (extended) */
+} coap_proxy_upstream_t;
+
+typedef struct coap_proxy_entry_key_t {
+  coap_proxy_upstream_t *upstream; /**< Upstream server */
+  coap_session_t *incoming;  /**< Incoming session (if client tracking) */
+} coap_proxy_entry_key_t;
+
 struct coap_proxy_list_t {
+  UT_hash_handle hh;         /**< Hash handle, key is key */
+  coap_proxy_entry_key_t key; /**< Upstream and (if tracking) incoming */
   coap_session_t *ongoing;   /**< Ongoing session */
-  coap_session_t *incoming;  /**< Incoming session (used if client tracking( */
   coap_proxy_req_t *req_list; /**< Incoming list of request info */
   size_t req_count;          /**< Count of incoming request info */
-  coap_uri_t uri;            /**< URI info for connection */
   coap_tick_t idle_timeout_ticks; /**< Idle timeout (0 == no timeout) */
   coap_tick_t last_used;     /**< Last time entry was used */
+  size_t expire_idx;         /**< 1 + index in context->proxy_expire,
+                                  or 0 if no idle timeout */
 };
 
 /**
@@ -53,7 +84,8 @@ void coap_proxy_cleanup(coap_context_t *context);
 
 /**
  * Idle timeout inactive proxy sessions as well as return in @p tim_rem the time
- * to remaining to timeout the inactive proxy.
+ * to remaining to timeout the inactive proxy.  Only the proxy sessions that
+ * are due are looked at.
  *
  * @param context Context to check against.
  * @param now Current time in ticks.
@@ -157,6 +157,35 @@ typedef void (*coap_method_handler_t)(coap_resource_t *resource,
  */
 #define COAP_RESOURCE_HANDLE_WELLKNOWN_CORE 0x800
 
+/**
+ * The resource's uri_path is a prefix mount. Any request whose path starts
+ * with uri_path (at a segment boundary) and does not match a more specific
+ * resource is passed to this resource. The remaining path segments can be
+ * read with coap_resource_get_uri_remainder().
+ */
+#define COAP_RESOURCE_FLAGS_URI_PREFIX 0x1000
+
+/**
+ * Render an observe notification once per change of the resource and send a
+ * copy of it to every subscriber that made the same request (same method,
+ * options and data other than the token), rather than calling the GET/FETCH
+ * handler for each subscriber. Only use this if the handler's response does
+ * not depend on the subscriber's session.
+ */
+#define COAP_RESOURCE_FLAGS_NOTIFY_RENDER_ONCE 0x2000
+
+/**
+ * Cache the 2.05 (Content) responses to GET requests for this resource until
+ * their Max-Age (60 seconds if not set) expires, and answer repeated requests
+ * with the same cache-key from the cache without calling the GET handler.
+ * A request with a matching ETag is answered with 2.03 (Valid).
+ * The cached responses are dropped when coap_resource_notify_observers() is
+ * called for the resource, or a PUT, POST, DELETE, PATCH or iPATCH for it
+ * gets a 2.01, 2.02 or 2.04 response. Only use this if the handler's
+ * response does not depend on the client's session.
+ */
+#define COAP_RESOURCE_FLAGS_CACHE_RESPONSE 0x4000
+
 /**
  * Creates a new resource object and initializes the link field to the string
  * @p uri_path. This function returns the new coap_resource_t object.
@@ -326,6 +355,40 @@ COAP_API coap_resource_t *coap_get_resource_from_uri_path(coap_context_t *contex
  */
 coap_str_const_t *coap_resource_get_uri_path(coap_resource_t *resource);
 
+/**
+ * Get the value of the path parameter @p name for a request matched against
+ * a uri_path template such as "sensors/{id}/value". The value is the
+ * Uri-Path option of @p request in the same position as "{name}" in the
+ * template, and points into @p request (nothing is allocated).
+ *
+ * @param resource The resource that the request was matched against.
+ * @param request  The request PDU passed to the resource handler.
+ * @param name     The parameter name without the braces.
+ * @param value    Updated with the parameter value.
+ *
+ * @return         @c 1 if @p value was updated, else @c 0.
+ */
+int coap_resource_get_uri_param(const coap_resource_t *resource,
+                                const coap_pdu_t *request, const char *name,
+                                coap_str_const_t *value);
+
+/**
+ * Get the path segment at @p index following the uri_path of a resource
+ * defined with COAP_RESOURCE_FLAGS_URI_PREFIX. The value points into
+ * @p request (nothing is allocated).
+ *
+ * @param resource The resource that the request was matched against.
+ * @param request  The request PDU passed to the resource handler.
+ * @param index    The index of the segment after the prefix, starting at 0.
+ * @param value    Updated with the segment.
+ *
+ * @return         @c 1 if @p value was updated, @c 0 if there is no such
+ *                 segment.
+ */
+int coap_resource_get_uri_remainder(const coap_resource_t *resource,
+                                    const coap_pdu_t *request, size_t index,
+                                    coap_str_const_t *value);
+
 /**
  * Sets the notification message type of resource @p resource to given
  * @p mode
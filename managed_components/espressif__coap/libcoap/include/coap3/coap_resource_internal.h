@@ -58,6 +58,11 @@ struct coap_resource_t {
   unsigned int cacheable:1;      /**< can be cached */
   unsigned int is_unknown:1;     /**< resource created for unknown handler */
   unsigned int is_proxy_uri:1;   /**< resource created for proxy URI handler */
+  unsigned int is_routed:1;      /**< in the context's route tree */
+  unsigned int is_template:1;    /**< uri_path has {param} segments, so
+                                  *   requests only match it by routing */
+  unsigned int dirty_queued:1;   /**< in context->dirty_resources */
+  unsigned int has_value:1;      /**< value is set */
 
   /**
    * Used to store handlers for the seven coap methods @c GET, @c POST, @c PUT,
@@ -72,6 +77,21 @@ struct coap_resource_t {
 
   coap_attr_t *link_attr; /**< attributes to be included with the link format */
   coap_subscription_t *subscribers;  /**< list of observers for this resource */
+  coap_subscription_t *dirty_subscribers; /**< subscribers whose notification
+                                               is still to be sent */
+  struct coap_resource_t *dirty_next; /**< next in context->dirty_resources */
+  struct coap_resource_t *dirty_prev; /**< previous in
+                                           context->dirty_resources */
+  coap_cache_entry_t *cache_entries; /**< responses cached for this
+                                         resource */
+  /**
+   * With COAP_RESOURCE_FLAGS_NOTIFY_RENDER_ONCE, the notification rendered
+   * for the current change, shared by subscribers whose request matches
+   * notify_req.
+   */
+  coap_pdu_t *notify_pdu;
+  coap_binary_t *notify_req; /**< code, options and data of the request
+                                  notify_pdu was rendered for */
 
   /**
    * Request URI Path for this resource. This field will point into static
@@ -88,6 +108,13 @@ struct coap_resource_t {
   */
   unsigned int observe;
 
+  /**
+   * The numeric value of the resource, as given to
+   * coap_resource_notify_observers_value(), for the gt, lt and st conditional
+   * observe attributes.
+   */
+  double value;
+
   /**
    * Pointer back to the context that 'owns' this resource.
    */
@@ -145,6 +172,44 @@ int coap_delete_resource_lkd(coap_context_t *context, coap_resource_t *resource)
  */
 void coap_delete_all_resources(coap_context_t *context);
 
+/**
+ * Node of the compressed radix tree that maps request URI paths to resources
+ * with {param} segments or the COAP_RESOURCE_FLAGS_URI_PREFIX flag. Static
+ * edges are labelled with one or more characters of the path; a param node
+ * matches one complete path segment.
+ */
+typedef struct coap_route_node_t {
+  struct coap_route_node_t *next;  /**< next sibling (with a different first
+                                        label character) */
+  struct coap_route_node_t *child; /**< static children */
+  struct coap_route_node_t *param; /**< child matching one {param} segment */
+  coap_resource_t *resource;       /**< resource whose path ends here */
+  coap_resource_t *prefix;         /**< resource mounted at this prefix */
+  size_t length;                   /**< length of label */
+  uint8_t label[1];                /**< static label (length bytes) */
+} coap_route_node_t;
+
+/**
+ * Returns the resource with {param} segments, or mounted as a prefix, that
+ * best matches @p uri_path. At each level of the path, a static segment takes
+ * precedence over a {param} segment, and the longest matching prefix mount is
+ * used if there is no complete match. A segment of @p uri_path that is itself
+ * of the form {name} does not match a {param} segment. The lookup is
+ * O(length of @p uri_path) whatever the number of resources.
+ *
+ * Resources with {param} segments are only to be matched this way, and not
+ * by their (literal) uri_path.
+ *
+ * Note: This function must be called in the locked state.
+ *
+ * @param context  The context to look for the resource.
+ * @param uri_path The request URI path.
+ *
+ * @return         A pointer to the resource or @c NULL if no match.
+ */
+coap_resource_t *coap_resource_route_lkd(coap_context_t *context,
+                                         const coap_str_const_t *uri_path);
+
 #define RESOURCES_ADD(r, obj) \
   HASH_ADD(hh, (r), uri_path->s[0], (obj)->uri_path->length, (obj))
 
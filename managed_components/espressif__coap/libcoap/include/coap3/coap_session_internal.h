@@ -93,6 +93,8 @@ struct coap_session_t {
                                          used in this session */
   coap_queue_t *delayqueue;         /**< list of delayed messages waiting to
                                          be sent */
+  coap_queue_t *sendqueue;          /**< list of this session's entries in
+                                         context->sendqueue */
   coap_lg_xmit_t *lg_xmit;          /**< list of large transmissions */
 #if COAP_CLIENT_SUPPORT
   coap_lg_crcv_t *lg_crcv;       /**< Client list of expected large receives */
@@ -110,6 +112,27 @@ struct coap_session_t {
   coap_pdu_t *partial_pdu;          /**< incomplete incoming pdu */
   coap_tick_t last_rx_tx;
   coap_tick_t last_tx_rst;
+  coap_tick_t timer_t;              /**< when the session's timers next need
+                                         checking (if in session_timers) */
+  struct coap_session_t *timer_child; /**< session_timers heap: first child */
+  struct coap_session_t *timer_next;  /**< session_timers heap: next sibling */
+  struct coap_session_t *timer_prev;  /**< session_timers heap: previous
+                                           sibling, or parent if first child */
+  struct coap_session_t *due_next;  /**< next in context->sessions_due */
+  struct coap_session_t *due_prev;  /**< previous in context->sessions_due */
+  uint32_t timer_pass;              /**< last coap_io_prepare_io() pass the
+                                         session's timers were checked in */
+  uint8_t timer_flags;              /**< Zero or more COAP_SESSION_TIMER_* */
+#if COAP_SERVER_SUPPORT
+  struct coap_session_t *idle_next; /**< next in endpoint->idle_lru */
+  struct coap_session_t *idle_prev; /**< previous in endpoint->idle_lru */
+  struct coap_session_t *hs_next;   /**< next in endpoint->hs_lru */
+  struct coap_session_t *hs_prev;   /**< previous in endpoint->hs_lru */
+  uint8_t lru_flags;                /**< Zero or more COAP_SESSION_LRU_* */
+  uint32_t notify_pass;             /**< last coap_check_notify() pass a
+                                         notification was sent in */
+  uint32_t notify_cnt;              /**< notifications sent in notify_pass */
+#endif /* COAP_SERVER_SUPPORT */
   coap_tick_t last_ping;
   coap_tick_t last_pong;
   coap_tick_t csm_tx;
@@ -205,6 +228,9 @@ struct coap_session_t {
                                            coap_ext_token_check_t */
 #if COAP_CLIENT_SUPPORT
   uint8_t negotiated_cid;         /**< Set for a client if CID negotiated */
+  uint64_t dtls_setup_fp;         /**< Fingerprint of the client's (D)TLS
+                                       security setup, checked before a held
+                                       session is resumed */
 #endif /* COAP_CLIENT_SUPPORT */
   uint8_t is_dtls13;              /**< Set if session is DTLS1.3 */
   coap_mid_t remote_test_mid;     /**< mid used for checking remote
@@ -222,6 +248,10 @@ struct coap_session_t {
 #if COAP_SERVER_SUPPORT
   coap_bin_const_t *client_cid;     /**< Contains client CID or NULL */
 #endif /* COAP_SERVER_SUPPORT */
+#if COAP_PROXY_SUPPORT
+  coap_proxy_list_t *proxy_entry; /**< Proxy entry if an ongoing proxy
+                                       session */
+#endif /* COAP_PROXY_SUPPORT */
 };
 
 #if COAP_SERVER_SUPPORT
@@ -238,6 +268,15 @@ struct coap_endpoint_t {
                                        any */
   coap_address_t bind_addr;       /**< local interface address */
   coap_session_t *sessions;       /**< hash table or list of active sessions */
+  coap_session_t *idle_lru;       /**< unused server sessions, least recently
+                                       used first */
+  coap_session_t *hs_lru;         /**< unused sessions in (D)TLS handshake,
+                                       least recently used first */
+  unsigned int num_idle;          /**< number of sessions in idle_lru */
+  unsigned int num_hs;            /**< number of sessions in hs_lru */
+#if COAP_SENDMMSG_SUPPORT
+  coap_tx_batch_t *tx_batch;      /**< datagrams queued for sending */
+#endif /* COAP_SENDMMSG_SUPPORT */
 };
 #endif /* COAP_SERVER_SUPPORT */
 
@@ -581,6 +620,73 @@ coap_session_t *coap_session_new_dtls_session(coap_session_t *session,
 void coap_session_free(coap_session_t *session);
 void coap_session_mfree(coap_session_t *session);
 
+#define COAP_SESSION_TIMER_QUEUED 0x01 /**< In context->session_timers */
+#define COAP_SESSION_TIMER_DUE    0x02 /**< In context->sessions_due */
+#define COAP_SESSION_TIMER_CHECKING 0x04 /**< Timers currently being checked */
+#define COAP_SESSION_TIMER_OWNED  0x08 /**< Created by coap_make_session() */
+
+#if COAP_SERVER_SUPPORT
+#define COAP_SESSION_LRU_IDLE 0x01 /**< In endpoint->idle_lru */
+#define COAP_SESSION_LRU_HS   0x02 /**< In endpoint->hs_lru */
+
+/**
+ * Updates the membership of server @p session in its endpoint's lists of
+ * unused (idle) sessions and unused sessions in (D)TLS handshake, used by
+ * coap_endpoint_get_session() to pick a session to evict. A session that is
+ * (still) unused is moved to the end of the lists as most recently used.
+ * This needs to be called when the session is used, or its reference count,
+ * type, state or delayqueue may have changed.
+ *
+ * @param session The session to update.
+ */
+void coap_session_update_lru(coap_session_t *session);
+#endif /* COAP_SERVER_SUPPORT */
+
+/**
+ * Flags @p session so that its timers (idle expiry, DTLS handshake timeout,
+ * keepalive, large body transfer timeouts) get re-evaluated by the next
+ * coap_io_prepare_io_lkd(). This needs to be called whenever something
+ * happens that may cause a session timer to fire earlier than currently
+ * scheduled. Timers that move later are handled when they fire.
+ *
+ * @param session The session to check.
+ */
+void coap_session_timer_touch(coap_session_t *session);
+
+/**
+ * Schedules the next check of the timers of @p session for @p when (in
+ * ticks), replacing any previous schedule or pending
+ * coap_session_timer_touch(). If @p when is @c 0, the session is not
+ * scheduled.
+ *
+ * @param session The session to schedule.
+ * @param when    The time the session timers next need checking, or @c 0.
+ */
+void coap_session_timer_set(coap_session_t *session, coap_tick_t when);
+
+/**
+ * Takes the next session whose timers need checking in this pass of
+ * coap_io_prepare_io_lkd() off the context's session timer tracking. These
+ * are sessions flagged by coap_session_timer_touch() followed by sessions
+ * whose scheduled time is no later than @p now. Each session is only
+ * returned once for the same @p pass.
+ *
+ * @param context The context.
+ * @param now     The current time in ticks.
+ * @param pass    The current pass number.
+ *
+ * @return The session to check, or @c NULL if none are due.
+ */
+coap_session_t *coap_session_timer_next(coap_context_t *context,
+                                        coap_tick_t now, uint32_t pass);
+
+/**
+ * Removes @p session from all session timer tracking of its context.
+ *
+ * @param session The session to remove.
+ */
+void coap_session_timer_remove(coap_session_t *session);
+
 void coap_read_session(coap_context_t *ctx, coap_session_t *session, coap_tick_t now);
 
 void coap_connect_session(coap_session_t *session, coap_tick_t now);
@@ -63,6 +63,21 @@ void coap_resource_set_get_observable(coap_resource_t *resource, int mode);
 COAP_API int coap_resource_notify_observers(coap_resource_t *resource,
                                             const coap_string_t *query);
 
+/**
+ * Initiate the sending of an Observe packet for all observers of @p resource,
+ * giving the new numeric @p value of the resource. Observers that asked for
+ * the gt, lt or st conditional attributes are only notified if @p value
+ * has crossed gt or lt, or moved by at least st, since their last
+ * notification.
+ *
+ * @param resource The CoAP resource to use.
+ * @param value    The new value of the resource.
+ *
+ * @return         @c 1 if the Observe has been triggered, @c 0 otherwise.
+ */
+COAP_API int coap_resource_notify_observers_value(coap_resource_t *resource,
+                                                  double value);
+
 /**
  * Checks all known resources to see if they are dirty and then notifies
  * subscribed observers.
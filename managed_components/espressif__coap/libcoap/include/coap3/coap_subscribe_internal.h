@@ -53,6 +53,40 @@
 #error COAP_OBS_MAX_FAIL is too large
 #endif /* COAP_OBS_MAX_FAIL > 255 */
 
+/**
+ * Maximum number of notifications sent to any one session in a single
+ * coap_check_notify() pass, so that a session observing many resources does
+ * not hold up the notifications to the others. The rest are sent on the
+ * following passes. @c 0 means no limit.
+ */
+#ifndef COAP_OBS_MAX_BURST
+#define COAP_OBS_MAX_BURST 32
+#endif /* COAP_OBS_MAX_BURST */
+
+/**
+ * Largest pmin or pmax (in seconds) taken from an observe request. Larger
+ * values are reduced to this.
+ */
+#ifndef COAP_OBS_COND_MAX_PERIOD
+#define COAP_OBS_COND_MAX_PERIOD 86400
+#endif /* COAP_OBS_COND_MAX_PERIOD */
+
+/**
+ * @defgroup obs_cond Conditional observe attributes
+ * Set in coap_subscription_t cond from the Uri-Query of the observe request
+ * (draft-ietf-core-conditional-attributes).
+ * @{
+ */
+#define COAP_OBS_COND_PMIN      0x01 /**< pmin: minimum period (seconds) */
+#define COAP_OBS_COND_PMAX      0x02 /**< pmax: maximum period (seconds) */
+#define COAP_OBS_COND_GT        0x04 /**< gt: notify on crossing this value */
+#define COAP_OBS_COND_LT        0x08 /**< lt: notify on crossing this value */
+#define COAP_OBS_COND_ST        0x10 /**< st: notify on a change this big */
+#define COAP_OBS_COND_LAST      0x80 /**< last_value is set */
+#define COAP_OBS_COND_VALUE \
+  (COAP_OBS_COND_GT|COAP_OBS_COND_LT|COAP_OBS_COND_ST)
+/** @} */
+
 /** Subscriber information */
 struct coap_subscription_t {
   struct coap_subscription_t *next; /**< next element in linked list */
@@ -62,7 +96,21 @@ struct coap_subscription_t {
   uint8_t fail_cnt; /**< up to 255 confirmable notifies can fail */
   uint8_t dirty;    /**< set if the notification temporarily could not be
                      *   sent (in that case, the resource's partially
-                     *   dirty flag is set too) */
+                     *   dirty flag is set too, and the subscription is
+                     *   in the resource's dirty_subscribers) */
+  struct coap_subscription_t *dirty_next; /**< next in dirty_subscribers */
+  struct coap_subscription_t *dirty_prev; /**< previous in
+                                               dirty_subscribers */
+  coap_tick_t notify_due;  /**< if dirty, not to be sent before this time */
+  coap_tick_t last_notify; /**< when the last notification was sent */
+  unsigned int last_observe; /**< Observe value of the last notification */
+  uint8_t cond;            /**< zero or more COAP_OBS_COND_* */
+  coap_tick_t pmin;        /**< minimum time between notifications */
+  coap_tick_t pmax;        /**< maximum time between notifications */
+  double gt;               /**< upper threshold */
+  double lt;               /**< lower threshold */
+  double st;               /**< step */
+  double last_value;       /**< resource value of the last notification */
   coap_cache_key_t *cache_key; /** cache_key to identify requester */
   coap_pdu_t *pdu;         /**< PDU to use for additional requests */
 };
@@ -182,6 +230,20 @@ void coap_delete_observers(coap_context_t *context, coap_session_t *session);
 int coap_resource_notify_observers_lkd(coap_resource_t *resource,
                                        const coap_string_t *query);
 
+/**
+ * Initiate the sending of an Observe packet for all observers of @p resource,
+ * giving the new numeric @p value of the resource.
+ *
+ * Note: This function must be called in the locked state.
+ *
+ * @param resource The CoAP resource to use.
+ * @param value    The new value of the resource.
+ *
+ * @return         @c 1 if the Observe has been triggered, @c 0 otherwise.
+ */
+int coap_resource_notify_observers_value_lkd(coap_resource_t *resource,
+                                             double value);
+
 /**
  * Checks all known resources to see if they are dirty and then notifies
  * subscribed observers.
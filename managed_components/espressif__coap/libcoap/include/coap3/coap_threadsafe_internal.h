@@ -27,34 +27,40 @@
 /*
  * Support thread safe access into libcoap
  *
- * Locking at different component levels (i.e context and session) is
- * problematic in that coap_process_io() needs to lock the context as
- * it scans for all the sessions and then could lock the session being
- * processed as well - but context needs to remain locked as a list is
- * being scanned.
- *
- * Then if the session process needs to update context ( e.g. delayqueue),
- * context needs to be locked. So, if coap_send() is done on a session,
- * it has to be locked, but a retransmission of a PDU by coap_process_io()
- * has the context already locked.
- *
- * However, when the context is going away (coap_free_context()), other
- * threads may still be access the lock in what is now freed memory.
- * A solution (by flagging being freed), worked, but still with a timing
- * window wen the context was finally de-allocated.  Coverity Scan did
- * not like the solution.
- *
- * So the initial support for thread safe is done at global lock level
- * using global_lock. However, context is provided as a parameter should
- * context level locking be subsequently used.
- *
- * Any public API call needs to potentially lock global_lock.
+ * Each context has its own lock (context->lock), which protects the context
+ * and everything that hangs off it (endpoints, sessions, resources, ...).
+ * Threads working on different contexts (e.g. one I/O thread per context)
+ * therefore do not contend with each other. global_lock is only used for
+ * the little state that is not part of any context, by passing a NULL
+ * context. It may be locked while a context lock is held, but is only held
+ * for short periods, never over a call-back into app space and never while
+ * locking a context lock. Static scratch buffers are thread local (see
+ * COAP_THREAD_LOCAL) rather than being protected by a lock.
+ *
+ * Locking at the session level as well is not done.  coap_io_process()
+ * needs to lock the context as it scans for all the sessions and then could
+ * lock the session being processed as well - but context needs to remain
+ * locked as a list is being scanned. Then if the session process needs to
+ * update context ( e.g. delayqueue), context needs to be locked. So, if
+ * coap_send() is done on a session, it has to be locked, but a
+ * retransmission of a PDU by coap_process_io() has the context already
+ * locked.
+ *
+ * When the context is going away (coap_free_context()), its lock goes with
+ * it. So the application must make sure that no other thread is using the
+ * context (or any of its sessions etc.) once coap_free_context() has been
+ * called - which was already needed as the sessions etc. are freed.
+ *
+ * Any public API call needs to potentially lock the context lock.
  *
  * If a public API needs thread safe protection, the coap_X() function
- * locks the global_lock lock, calls the coap_X_lkd() function
- * that does all the work and on return unlocks the global_lock before
+ * locks the context lock, calls the coap_X_lkd() function
+ * that does all the work and on return unlocks the context lock before
  * returning to the caller of coap_X().  These coap_X() functions
- * need COAP_API in their definitions.
+ * need COAP_API in their definitions. The expression used to find the
+ * context when unlocking must still be valid after coap_X_lkd() has
+ * returned (e.g. take a copy of session->context if the session may be
+ * freed).
  *
  * Any internal libcoap calls that are to the public API coap_X() must call
  * coap_X_lkd() if the calling code is already locked.
@@ -62,16 +68,18 @@
  * libcoap call to a COAP_API labelled function]
  *
  * Any call-back into app space must be done by using the coap_lock_callback()
- * (or coap_lock_callback_ret()) wrapper where the global_lock remains locked.
+ * (or coap_lock_callback_ret()) wrapper where the context lock remains locked.
  *
  * Note:
  * libcoap may call a handler, which may in turn call into libcoap, which may
- * then call a handler. global_lock will remain locked thoughout this process
- * by the same thread.
+ * then call a handler. The context lock will remain locked thoughout this
+ * process by the same thread. A handler calling into a different context
+ * locks that context as well, so two threads doing so for the same two
+ * contexts in the opposite order can deadlock.
  *
  * Alternatively, coap_lock_callback_release() (or
- * coap_lock_callback_ret_release()), is used where the global_lock is unlocked
- * for the duration of the call-back. Used for things like a request
+ * coap_lock_callback_ret_release()), is used where the context lock is
+ * unlocked for the duration of the call-back. Used for things like a request
  * handler which could be busy for some time.
  *
  * Note: On return from the call-back, the code has to be careful not to
@@ -79,14 +87,13 @@
  * calling a Public API.
  *
  * Any wait on select() or equivalent when a thread is waiting on an event
- * must be preceded by unlock global_lock, and then global_lock re-locked after
- * return;
+ * must be preceded by unlock of the context lock, and then the context lock
+ * re-locked after return;
  *
  * To check for recursive deadlock coding errors, COAP_THREAD_RECURSIVE_CHECK
  * needs to be defined.
  *
- * If thread safe is not enabled, then locking of the global_lock does not take
- * place.
+ * If thread safe is not enabled, then locking does not take place.
  */
 
 #if COAP_THREAD_SAFE
@@ -110,43 +117,45 @@ typedef struct coap_lock_t {
 } coap_lock_t;
 
 /**
- * Unlock the global_lock lock.
+ * Unlock @p lock.
  *
  * If this is a nested lock (Public API - libcoap - app call-back - Public API),
- * then the lock remains locked, but global_lock.in_callback is decremented.
+ * then the lock remains locked, but lock->in_callback is decremented.
  *
  * Note: Invoked by wrapper macro, not used directly.
  *
+ * @param lock The lock to unlock.
  * @param file The file from which coap_lock_unlock_func() is getting called.
  * @param line The line no from which coap_lock_unlock_func() is getting called.
  */
-void coap_lock_unlock_func(const char *file, int line);
+void coap_lock_unlock_func(coap_lock_t *lock, const char *file, int line);
 
 /**
- * Lock the global_lock lock.
+ * Lock @p lock.
  *
  * If this is a nested lock (Public API - libcoap - app call-back - Public API),
- * then increment the global_lock.in_callback.
+ * then increment the lock->in_callback.
  *
  * Note: Invoked by wrapper macro, not used directly.
  *
+ * @param lock The lock to lock.
  * @param file The file from which coap_lock_lock_func() is getting called.
  * @param line The line no from which coap_lock_lock_func() is getting called.
  *
  * @return @c 0 if libcoap has not started (coap_startup() not called), else @c 1.
  */
-int coap_lock_lock_func(const char *file, int line);
+int coap_lock_lock_func(coap_lock_t *lock, const char *file, int line);
 
 /**
- * libcoap library code. Lock The global_lock.
+ * libcoap library code. Lock the context lock (global_lock if @p c is NULL).
  *
  * Invoked when
  *   Not locked at all
  *   Locked, app call-back, call from app call-back
  *   Locked, app call-back, call from app call-back, app call-back, call from app call-back
  * Result
- *   global_lock locked.
- *   global_lock not locked if libcoap not started and @p failed is executed. @p failed must
+ *   context lock locked.
+ *   context lock not locked if libcoap not started and @p failed is executed. @p failed must
  *   be code that skips doing the lock protected code.
  *
  * @param c Context.
@@ -154,13 +163,13 @@ int coap_lock_lock_func(const char *file, int line);
  *
  */
 #define coap_lock_lock(c,failed) do { \
-    if (!coap_lock_lock_func(__FILE__, __LINE__)) { \
+    if (!coap_lock_lock_func(coap_lock_get(c), __FILE__, __LINE__)) { \
       failed; \
     } \
   } while (0)
 
 /**
- * libcoap library code. Unlock The global_lock.
+ * libcoap library code. Unlock the context lock (global_lock if @p c is NULL).
  *
  * Unlocked when
  *   Same thread locked context
@@ -169,11 +178,12 @@ int coap_lock_lock_func(const char *file, int line);
  * @param c Context.
  */
 #define coap_lock_unlock(c) do { \
-    coap_lock_unlock_func(__FILE__, __LINE__); \
+    coap_lock_unlock_func(coap_lock_get(c), __FILE__, __LINE__); \
   } while (0)
 
 /**
- * libcoap library code. Invoke an app callback, leaving global_lock locked.
+ * libcoap library code. Invoke an app callback, leaving the context lock
+ * locked.
  *
  * Called when
  *   Locked
@@ -183,17 +193,18 @@ int coap_lock_lock_func(const char *file, int line);
  *
  */
 #define coap_lock_callback(c,func) do { \
+    coap_lock_t *cb_lock = coap_lock_get(c); \
     coap_lock_check_locked(c); \
-    global_lock.in_callback++; \
-    global_lock.callback_file = __FILE__; \
-    global_lock.callback_line = __LINE__; \
+    cb_lock->in_callback++; \
+    cb_lock->callback_file = __FILE__; \
+    cb_lock->callback_line = __LINE__; \
     func; \
-    global_lock.in_callback--; \
+    cb_lock->in_callback--; \
   } while (0)
 
 /**
  * libcoap library code. Invoke an app callback that has a return value,
- * leaving global_lock locked.
+ * leaving the context lock locked.
  *
  * Called when
  *   Locked
@@ -204,16 +215,18 @@ int coap_lock_lock_func(const char *file, int line);
  *
  */
 #define coap_lock_callback_ret(r,c,func) do { \
+    coap_lock_t *cb_lock = coap_lock_get(c); \
     coap_lock_check_locked(c); \
-    global_lock.in_callback++; \
-    global_lock.callback_file = __FILE__; \
-    global_lock.callback_line = __LINE__; \
+    cb_lock->in_callback++; \
+    cb_lock->callback_file = __FILE__; \
+    cb_lock->callback_line = __LINE__; \
     (r) = func; \
-    global_lock.in_callback--; \
+    cb_lock->in_callback--; \
   } while (0)
 
 /**
- * libcoap library code. Invoke an app callback, unlocking global_lock first.
+ * libcoap library code. Invoke an app callback, unlocking the context lock
+ * first.
  *
  * Called when
  *   Locked
@@ -232,7 +245,7 @@ int coap_lock_lock_func(const char *file, int line);
 
 /**
  * libcoap library code. Invoke an app callback that has a return value,
- * unlocking global_lock first.
+ * unlocking the context lock first.
  *
  * Called when
  *   Locked (need to unlock over app call-back)
@@ -250,8 +263,6 @@ int coap_lock_lock_func(const char *file, int line);
     coap_lock_lock(c,failed); \
   } while (0)
 
-extern coap_lock_t global_lock;
-
 # else /* ! COAP_THREAD_RECURSIVE_CHECK */
 
 /*
@@ -265,38 +276,41 @@ typedef struct coap_lock_t {
 } coap_lock_t;
 
 /**
- * Unlock the global_lock lock.
+ * Unlock @p lock.
  *
  * If this is a nested lock (Public API - libcoap - app call-back - Public API),
- * then the lock remains locked, but global_lock.in_callback is decremented.
+ * then the lock remains locked, but lock->in_callback is decremented.
  *
  * Note: Invoked by wrapper macro, not used directly.
  *
+ * @param lock The lock to unlock.
  */
-void coap_lock_unlock_func(void);
+void coap_lock_unlock_func(coap_lock_t *lock);
 
 /**
- * Lock the global_lock lock.
+ * Lock @p lock.
  *
  * If this is a nested lock (Public API - libcoap - app call-back - Public API),
- * then increment the global_lock.in_callback.
+ * then increment the lock->in_callback.
  *
  * Note: Invoked by wrapper macro, not used directly.
  *
+ * @param lock The lock to lock.
+ *
  * @return @c 0 if libcoap has not started (coap_startup() not called), else @c 1.
  */
-int coap_lock_lock_func(void);
+int coap_lock_lock_func(coap_lock_t *lock);
 
 /**
- * libcoap library code. Lock The global_lock.
+ * libcoap library code. Lock the context lock (global_lock if @p c is NULL).
  *
  * Invoked when
  *   Not locked at all
  *   Locked, app call-back, call from app call-back
  *   Locked, app call-back, call from app call-back, app call-back, call from app call-back
  * Result
- *   global_lock locked.
- *   global not locked if libcoap not started and @p failed is executed. @p failed must
+ *   context lock locked.
+ *   context lock not locked if libcoap not started and @p failed is executed. @p failed must
  *   be code that skips doing the lock protected code.
  *
  * @param c Contex.
@@ -304,13 +318,14 @@ int coap_lock_lock_func(void);
  *
  */
 #define coap_lock_lock(c,failed) do { \
-    if (!coap_lock_lock_func()) { \
+    if (!coap_lock_lock_func(coap_lock_get(c))) { \
       failed; \
     } \
   } while (0)
 
 /**
- *  libcoap library code. Unlock The global_lock.
+ *  libcoap library code. Unlock the context lock (global_lock if @p c is
+ *  NULL).
  *
  * Unlocked when
  *   Same thread locked context.
@@ -319,12 +334,12 @@ int coap_lock_lock_func(void);
  * @param c Context.
  */
 #define coap_lock_unlock(c) do { \
-    assert(c); \
-    coap_lock_unlock_func(); \
+    coap_lock_unlock_func(coap_lock_get(c)); \
   } while (0)
 
 /**
- * libcoap library code. Invoke an app callback, leaving global_lock locked.
+ * libcoap library code. Invoke an app callback, leaving the context lock
+ * locked.
  *
  * Called when
  *   Locked
@@ -334,15 +349,16 @@ int coap_lock_lock_func(void);
  *
  */
 #define coap_lock_callback(c,func) do { \
+    coap_lock_t *cb_lock = coap_lock_get(c); \
     coap_lock_check_locked(c); \
-    global_lock.in_callback++; \
+    cb_lock->in_callback++; \
     func; \
-    global_lock.in_callback--; \
+    cb_lock->in_callback--; \
   } while (0)
 
 /**
  * libcoap library code. Invoke an app callback that has a return value,
- * leaving global_lock locked.
+ * leaving the context lock locked.
  *
  * Called when
  *   Locked
@@ -353,15 +369,16 @@ int coap_lock_lock_func(void);
  *
  */
 #define coap_lock_callback_ret(r,c,func) do { \
+    coap_lock_t *cb_lock = coap_lock_get(c); \
     coap_lock_check_locked(c); \
-    global_lock.in_callback++; \
-    global_lock.in_callback++; \
+    cb_lock->in_callback++; \
     (r) = func; \
-    global_lock.in_callback--; \
+    cb_lock->in_callback--; \
   } while (0)
 
 /**
- * libcoap library code. Invoke an app callback, unlocking global_lock first.
+ * libcoap library code. Invoke an app callback, unlocking the context lock
+ * first.
  *
  * Called when
  *   Locked (need to unlock over app call-back)
@@ -380,7 +397,7 @@ int coap_lock_lock_func(void);
 
 /**
  * libcoap library code. Invoke an app callback that has a return value,
- * unlocking global_lock first.
+ * unlocking the context lock first.
  *
  * Called when
  *   Locked (need to unlock over app call-back)
@@ -404,21 +421,41 @@ int coap_lock_lock_func(void);
  * libcoap library code. Initialize the global_lock.
  */
 #define coap_lock_init() do { \
-    memset(&global_lock.mutex, 0, sizeof(global_lock.mutex)); \
+    memset(&global_lock, 0, sizeof(global_lock)); \
     coap_mutex_init(&global_lock.mutex); \
   } while (0)
 
 /**
- * libcoap library code. Check that global_lock is locked.
+ * libcoap library code. Initialize the lock of the new context @p c.
+ */
+#define coap_lock_context_init(c) do { \
+    memset(&(c)->lock, 0, sizeof((c)->lock)); \
+    coap_mutex_init(&(c)->lock.mutex); \
+  } while (0)
+
+/**
+ * libcoap library code. Unlock and release the lock of context @p c, which
+ * is about to be freed.
+ */
+#define coap_lock_context_free(c) do { \
+    coap_lock_check_locked(c); \
+    (c)->lock.pid = 0; \
+    coap_mutex_unlock(&(c)->lock.mutex); \
+    coap_mutex_destroy(&(c)->lock.mutex); \
+  } while (0)
+
+/**
+ * libcoap library code. Check that the context lock (global_lock if @p c is
+ * NULL) is locked.
  */
 #define coap_lock_check_locked(c) do { \
-    assert(coap_thread_pid == global_lock.pid); \
+    assert(coap_thread_pid == coap_lock_get(c)->pid); \
   } while (0)
 
 /**
  * libcoap library code. Lock an alternative lock. To prevent
- * locking order issues, global_lock is unlocked, the alternative
- * lock is locked and then global_lock is re-locked.
+ * locking order issues, the context lock is unlocked, the alternative
+ * lock is locked and then the context lock is re-locked.
  *
  * Called when
  *   Locked (need to unlock over locking of alternative lock)
@@ -435,6 +472,10 @@ int coap_lock_lock_func(void);
     coap_lock_lock(c,failed); \
   } while (0)
 
+/*
+ * Lock for the state that is not part of a context. Only locked for
+ * short periods, and no context lock is ever locked while it is held.
+ */
 extern coap_lock_t global_lock;
 
 #else /* ! COAP_THREAD_SAFE */
@@ -447,15 +488,15 @@ typedef coap_mutex_t coap_lock_t;
 /**
  * Dummy for no thread-safe code
  *
- * libcoap library code. Lock The global_lock.
+ * libcoap library code. Lock the context lock.
  *
  * Invoked when
  *   Not locked at all
  *   Locked, app call-back, call from app call-back
  *   Locked, app call-back, call from app call-back, app call-back, call from app call-back
  * Result
- *   global_lock locked.
- *   global_lock not locked if libcoap not started and @p failed is executed. @p failed must
+ *   context lock locked.
+ *   context lock not locked if libcoap not started and @p failed is executed. @p failed must
  *   be code that skips doing the lock protected code.
  *
  * @param c Context.
@@ -467,7 +508,7 @@ typedef coap_mutex_t coap_lock_t;
 /**
  * Dummy for no thread-safe code
  *
- * libcoap library code. Unlock The global_lock.
+ * libcoap library code. Unlock the context lock.
  *
  * Unlocked when
  *   Same thread locked context
@@ -486,14 +527,28 @@ typedef coap_mutex_t coap_lock_t;
 /**
  * Dummy for no thread-safe code
  *
- * libcoap library code. Check that global_lock is locked.
+ * libcoap library code. Initialize the lock of context @p c.
+ */
+#define coap_lock_context_init(c)
+
+/**
+ * Dummy for no thread-safe code
+ *
+ * libcoap library code. Release the lock of context @p c.
+ */
+#define coap_lock_context_free(c)
+
+/**
+ * Dummy for no thread-safe code
+ *
+ * libcoap library code. Check that the context lock is locked.
  */
 #define coap_lock_check_locked(c) {}
 
 /**
  * Dummy for no thread-safe code
  *
- * libcoap library code. Invoke an app callback, leaving global_lock locked.
+ * libcoap library code. Invoke an app callback, leaving the context lock locked.
  *
  * Called when
  *   Locked
@@ -508,7 +563,7 @@ typedef coap_mutex_t coap_lock_t;
  * Dummy for no thread-safe code
  *
  * libcoap library code. Invoke an app callback that has a return value,
- * leaving global_lock locked.
+ * leaving the context lock locked.
  *
  * Called when
  *   Locked
@@ -523,7 +578,7 @@ typedef coap_mutex_t coap_lock_t;
 /**
  * Dummy for no thread-safe code
  *
- * libcoap library code. Invoke an app callback, unlocking global_lock first.
+ * libcoap library code. Invoke an app callback, unlocking the context lock first.
  *
  * Called when
  *   Locked
@@ -539,7 +594,7 @@ typedef coap_mutex_t coap_lock_t;
  * Dummy for no thread-safe code
  *
  * libcoap library code. Invoke an app callback that has a return value,
- * unlocking global_lock first.
+ * unlocking the context lock first.
  *
  * Called when
  *   Locked (need to unlock over app call-back)
@@ -557,8 +612,8 @@ typedef coap_mutex_t coap_lock_t;
  * Dummy for no thread-safe code
  *
  * libcoap library code. Lock an alternative lock. To prevent
- * locking order issues, global_lock is unlocked, the alternative
- * lock is locked and then global_lock is re-locked.
+ * locking order issues, the context lock is unlocked, the alternative
+ * lock is locked and then the context lock is re-locked.
  *
  * Called when
  *   Locked (need to unlock over locking of alternative lock)
@@ -572,6 +627,118 @@ typedef coap_mutex_t coap_lock_t;
 
 #endif /* ! COAP_THREAD_SAFE */
 
+/*
+ * Work queue for coap_io_post_work().
+ *
+ * This is an intrusive multi-producer, single-consumer queue (after
+ * Dmitry Vyukov's design).  Producers (any thread) only touch the tail of
+ * the queue using an atomic exchange, so do not need the context lock. The
+ * consumer (the thread running coap_io_process()) owns the head and drains
+ * the queue with the context lock held.
+ *
+ * The atomic builtins are used whenever the compiler provides them, so that
+ * coap_io_post_work() can be called from other threads even if libcoap is not
+ * built with thread-safe support. Otherwise, with thread-safe support, the
+ * queue is protected by its own mutex instead - which is still not
+ * the context lock.
+ */
+#if COAP_THREAD_SAFE && !(defined(__GNUC__) || defined(__clang__))
+#define COAP_WORK_QUEUE_LOCKED 1
+#else /* ! COAP_THREAD_SAFE || __GNUC__ || __clang__ */
+#define COAP_WORK_QUEUE_LOCKED 0
+#endif /* ! COAP_THREAD_SAFE || __GNUC__ || __clang__ */
+
+/*
+ * Without epoll (where eptimerfd is used), a connected loopback UDP socket
+ * is used to wake up a coap_io_process() that is waiting in select().
+ */
+#if COAP_THREAD_SAFE && !defined(COAP_EPOLL_SUPPORT) && \
+    !defined(WITH_LWIP) && !defined(WITH_CONTIKI) && !defined(RIOT_VERSION)
+#define COAP_WORK_QUEUE_WAKE_SOCKET 1
+#else /* ! COAP_THREAD_SAFE || COAP_EPOLL_SUPPORT || ... */
+#define COAP_WORK_QUEUE_WAKE_SOCKET 0
+#endif /* ! COAP_THREAD_SAFE || COAP_EPOLL_SUPPORT || ... */
+
+/**
+ * Item of work posted by coap_io_post_work().
+ */
+typedef struct coap_work_t {
+  struct coap_work_t *next;       /**< next item in the queue */
+  coap_io_work_handler_t handler; /**< handler to invoke */
+  void *arg;                      /**< argument to pass to handler */
+} coap_work_t;
+
+/**
+ * Queue of work posted by coap_io_post_work().
+ */
+typedef struct coap_work_queue_t {
+  coap_work_t *head;              /**< consumer end (context lock held) */
+  coap_work_t *tail;              /**< producer end (atomic) */
+  coap_work_t stub;               /**< always-present dummy item */
+  uint8_t ran;                    /**< set when some work has been run */
+#if COAP_WORK_QUEUE_LOCKED
+  coap_mutex_t mutex;             /**< protects head and tail */
+#endif /* COAP_WORK_QUEUE_LOCKED */
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+  coap_fd_t wake_fd;              /**< loopback socket connected to itself,
+                                       or COAP_INVALID_SOCKET */
+#endif /* COAP_WORK_QUEUE_WAKE_SOCKET */
+} coap_work_queue_t;
+
+/**
+ * Initialize the work queue of @p context.
+ *
+ * @param context The context.
+ */
+void coap_work_queue_init(coap_context_t *context);
+
+/**
+ * Run any pending work, then release any resources held by the work
+ * queue of @p context. Called from coap_free_context().
+ *
+ * @param context The context.
+ */
+void coap_work_queue_free(coap_context_t *context);
+
+/**
+ * Invoke the handlers of all the work that has been posted to @p context.
+ * Called with the context lock held by the thread running coap_io_process().
+ *
+ * @param context The context.
+ */
+void coap_work_queue_run(coap_context_t *context);
+
+/**
+ * Check whether there is work waiting (or being posted) for @p context, or
+ * whether work has been run since context->work_queue.ran was last cleared.
+ * Used after setting up the I/O timer so that coap_io_process() returns
+ * after running work, and a post that raced with coap_work_queue_run() is
+ * not left waiting until the next timeout.
+ *
+ * @param context The context.
+ *
+ * @return @c 1 if work is pending (or has been run), else @c 0.
+ */
+int coap_work_queue_pending(coap_context_t *context);
+
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+/**
+ * Create the wake up socket for @p context if not already done. Called
+ * by the thread running coap_io_process() before it first waits in select().
+ *
+ * @param context The context.
+ */
+void coap_work_queue_setup_wake(coap_context_t *context);
+
+/**
+ * Consume any wake up datagrams. Called when select() has flagged
+ * the wake up socket as readable.
+ *
+ * @param context The context.
+ */
+void coap_work_queue_drain_wake(coap_context_t *context);
+#endif /* COAP_WORK_QUEUE_WAKE_SOCKET */
+
 /** @} */
 
 #endif /* COAP_THREADSAFE_INTERNAL_H_ */
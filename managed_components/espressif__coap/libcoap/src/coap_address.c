@@ -166,6 +166,8 @@ coap_is_bcast(const coap_address_t *a) {
   struct in_addr ipv4;
 #if defined(HAVE_IFADDRS_H)
   int i;
+  int ret = 0;
+  int locked = 1;
   coap_tick_t now;
 #endif /* HAVE_IFADDRS_H */
 #endif /* COAP_IPV4_SUPPORT */
@@ -201,6 +203,8 @@ coap_is_bcast(const coap_address_t *a) {
     return 1;
 
 #if defined(HAVE_IFADDRS_H)
+  /* The broadcast address cache is shared by all contexts */
+  coap_lock_lock(NULL, locked = 0);
   coap_ticks(&now);
   if (bcst_cnt == -1 ||
       (now - last_refresh) > (COAP_BCST_REFRESH_SECS * COAP_TICKS_PER_SECOND)) {
@@ -210,7 +214,7 @@ coap_is_bcast(const coap_address_t *a) {
 
     if (getifaddrs(&ifa) != 0) {
       coap_log_warn("coap_is_bcst: Cannot determine any broadcast addresses\n");
-      return 0;
+      goto finish;
     }
     bcst_cnt = 0;
     last_refresh = now;
@@ -239,11 +243,19 @@ coap_is_bcast(const coap_address_t *a) {
     freeifaddrs(ifa);
   }
   for (i = 0; i < bcst_cnt; i++) {
-    if (ipv4.s_addr == b_ipv4[i].s_addr)
-      return 1;
+    if (ipv4.s_addr == b_ipv4[i].s_addr) {
+      ret = 1;
+      break;
+    }
   }
-#endif /* HAVE_IFADDRS_H */
+finish:
+  if (locked) {
+    coap_lock_unlock(NULL);
+  }
+  return ret;
+#else /* ! HAVE_IFADDRS_H */
   return 0;
+#endif /* ! HAVE_IFADDRS_H */
 #endif /* COAP_IPV4_SUPPORT */
 }
 
@@ -495,7 +507,7 @@ coap_resolve_address_info(const coap_str_const_t *address,
 
   struct addrinfo *res, *ainfo;
   struct addrinfo hints;
-  static char addrstr[256];
+  static COAP_THREAD_LOCAL char addrstr[256];
   int error;
   coap_addr_info_t *info = NULL;
   coap_addr_info_t *info_prev = NULL;
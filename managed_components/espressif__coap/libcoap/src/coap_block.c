@@ -19,6 +19,9 @@
 #define min(a,b) ((a) < (b) ? (a) : (b))
 #endif
 
+/* Size1/2 (5), ETag (9), Request-Tag (9) and BlockX (4) option space */
+#define COAP_BLOCK_OPT_HEADROOM 32
+
 #if COAP_Q_BLOCK_SUPPORT
 int
 coap_q_block_is_supported(void) {
@@ -428,6 +431,12 @@ coap_context_set_max_block_size_lkd(coap_context_t *context, size_t max_block_si
   return 1;
 }
 
+void
+coap_register_block_data_handler(coap_context_t *context,
+                                 coap_block_data_handler_t handler) {
+  context->block_data_handler = handler;
+}
+
 COAP_STATIC_INLINE int
 full_match(const uint8_t *a, size_t alen,
            const uint8_t *b, size_t blen) {
@@ -814,6 +823,13 @@ coap_add_data_large_internal(coap_session_t *session,
   }
 
   chunk = (size_t)1 << (blk_size + 4);
+  /*
+   * Grow the PDU once for the Size, ETag, Request-Tag and BlockX options
+   * that may get added below, and the (first block of) data.
+   */
+  if (!coap_pdu_reserve(pdu, pdu->used_size + COAP_BLOCK_OPT_HEADROOM +
+                        min(length, chunk) + 1))
+    goto fail;
   if ((have_block_defined && block.num != 0) || single_request ||
       ((session->block_mode & COAP_BLOCK_STLESS_BLOCK2) && session->type != COAP_SESSION_TYPE_CLIENT)) {
     /* App is defining a single block to send or we are stateless */
@@ -993,6 +1009,7 @@ coap_add_data_large_internal(coap_session_t *session,
 
     /* Set up skeletal PDU to use as a basis for all the subsequent blocks */
     memcpy(&lg_xmit->pdu, pdu, sizeof(lg_xmit->pdu));
+    lg_xmit->pdu.borrowed = 0;
     lg_xmit->pdu.token = coap_malloc_type(COAP_PDU_BUF,
                                           lg_xmit->pdu.used_size + lg_xmit->pdu.max_hdr_size);
     if (!lg_xmit->pdu.token)
@@ -1584,6 +1601,122 @@ check_if_received_block(coap_rblock_t *rec_blocks, uint32_t block_num) {
   return 0;
 }
 
+/*
+ * Pass the data to the block data handler, along with any held chunks that
+ * then follow on.  Data beyond what has been passed over so far is held
+ * until the gap is filled.
+ *
+ * Returns 1 if the data was consumed or held, 0 if the handler failed and
+ * -1 if the data could not be held (it is to be treated as not received).
+ */
+static int
+coap_block_stream_data(coap_session_t *session, const coap_pdu_t *pdu,
+                       coap_resource_t *resource, coap_lg_stream_t *stream,
+                       size_t offset, const uint8_t *data, size_t length,
+                       size_t total) {
+  coap_context_t *context = session->context;
+  coap_lg_chunk_t **pp;
+  coap_lg_chunk_t *chunk;
+  int ret;
+
+  if (offset > stream->next_offset) {
+    pp = &stream->pending;
+    while (*pp && (*pp)->offset < offset)
+      pp = &(*pp)->next;
+    if (*pp && (*pp)->offset == offset)
+      return 1;
+    if (stream->pending_count >= COAP_BLOCK_STREAM_WINDOW)
+      return -1;
+    chunk = coap_malloc_type(COAP_STRING, sizeof(coap_lg_chunk_t) + length - 1);
+    if (!chunk)
+      return -1;
+    chunk->offset = offset;
+    chunk->length = length;
+    memcpy(chunk->data, data, length);
+    chunk->next = *pp;
+    *pp = chunk;
+    stream->pending_count++;
+    return 1;
+  }
+  if (offset + length > stream->next_offset) {
+    data += stream->next_offset - offset;
+    length -= stream->next_offset - offset;
+    coap_lock_callback_ret(ret, context,
+                           context->block_data_handler(session, pdu, resource,
+                                                       &stream->app_data,
+                                                       stream->next_offset,
+                                                       data, length, total));
+    if (!ret)
+      return 0;
+    stream->next_offset += length;
+  }
+
+  /* Pass over any held chunks that now follow on */
+  while (stream->pending && stream->pending->offset <= stream->next_offset) {
+    chunk = stream->pending;
+    stream->pending = chunk->next;
+    stream->pending_count--;
+    ret = 1;
+    if (chunk->offset + chunk->length > stream->next_offset) {
+      size_t skip = stream->next_offset - chunk->offset;
+
+      coap_lock_callback_ret(ret, context,
+                             context->block_data_handler(session, pdu, resource,
+                                                         &stream->app_data,
+                                                         stream->next_offset,
+                                                         &chunk->data[skip],
+                                                         chunk->length - skip,
+                                                         total));
+      stream->next_offset = chunk->offset + chunk->length;
+    }
+    coap_free_type(COAP_STRING, chunk);
+    if (!ret)
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * Drop any held chunks so that the body can be passed over again from the
+ * start.
+ */
+static void
+coap_block_stream_reset(coap_lg_stream_t *stream) {
+  coap_lg_chunk_t *chunk;
+
+  while (stream->pending) {
+    chunk = stream->pending;
+    stream->pending = chunk->next;
+    coap_free_type(COAP_STRING, chunk);
+  }
+  stream->pending_count = 0;
+  stream->next_offset = 0;
+}
+
+/*
+ * Let the block data handler free off its application data, the body
+ * being complete or abandoned.
+ */
+static void
+coap_block_stream_release(coap_session_t *session, const coap_pdu_t *pdu,
+                          coap_resource_t *resource, coap_lg_stream_t *stream,
+                          int complete) {
+  coap_context_t *context = session->context;
+  size_t offset = stream->next_offset;
+  int ret;
+
+  coap_block_stream_reset(stream);
+  if (stream->app_data && context->block_data_handler) {
+    coap_lock_callback_ret(ret, context,
+                           context->block_data_handler(session, pdu, resource,
+                                                       &stream->app_data,
+                                                       offset, NULL, 0,
+                                                       complete ? offset : 0));
+    (void)ret;
+  }
+  stream->app_data = NULL;
+}
+
 #if COAP_SERVER_SUPPORT
 static int
 check_if_next_block(coap_rblock_t *rec_blocks, uint32_t block_num) {
@@ -2241,6 +2374,7 @@ coap_block_new_lg_crcv(coap_session_t *session, coap_pdu_t *pdu,
   coap_ticks(&lg_crcv->last_used);
   /* Set up skeletal PDU to use as a basis for all the subsequent blocks */
   memcpy(&lg_crcv->pdu, pdu, sizeof(lg_crcv->pdu));
+  lg_crcv->pdu.borrowed = 0;
   /* Make sure that there is space for increased token + option change */
   lg_crcv->pdu.max_size = token_options + data_len + 9;
   lg_crcv->pdu.used_size = token_options + data_len;
@@ -2314,6 +2448,7 @@ coap_block_delete_lg_crcv(coap_session_t *session,
   if (lg_crcv->pdu.token)
     coap_free_type(COAP_PDU_BUF, lg_crcv->pdu.token - lg_crcv->pdu.max_hdr_size);
   coap_free_type(COAP_STRING, lg_crcv->body_data);
+  coap_block_stream_release(session, NULL, NULL, &lg_crcv->stream, 0);
   coap_log_debug("** %s: lg_crcv %p released\n",
                  coap_session_str(session), (void *)lg_crcv);
   coap_delete_binary(lg_crcv->app_token);
@@ -2338,6 +2473,7 @@ coap_block_delete_lg_srcv(coap_session_t *session,
   coap_delete_str_const(lg_srcv->uri_path);
   coap_delete_bin_const(lg_srcv->last_token);
   coap_free_type(COAP_STRING, lg_srcv->body_data);
+  coap_block_stream_release(session, NULL, lg_srcv->resource, &lg_srcv->stream, 0);
   coap_log_debug("** %s: lg_srcv %p released\n",
                  coap_session_str(session), (void *)lg_srcv);
   coap_free_type(COAP_LG_SRCV, lg_srcv);
@@ -2820,6 +2956,7 @@ coap_handle_request_put_block(coap_context_t *context,
   int update_data;
   unsigned int saved_num;
   size_t saved_offset;
+  coap_rblock_t saved_blocks;
 
   *added_block = 0;
   *pfree_lg_srcv = NULL;
@@ -3012,6 +3149,7 @@ coap_handle_request_put_block(coap_context_t *context,
   update_data = 0;
   saved_num = block.num;
   saved_offset = offset;
+  saved_blocks = lg_srcv->rec_blocks;
 
   while (offset < saved_offset + length) {
     if (!check_if_received_block(&lg_srcv->rec_blocks, block.num)) {
@@ -3036,16 +3174,40 @@ coap_handle_request_put_block(coap_context_t *context,
     lg_srcv->rec_blocks.processing_payload_set =
         block.num / COAP_MAX_PAYLOADS(session);
 #endif /* COAP_Q_BLOCK_SUPPORT */
+    if (context->block_data_handler) {
+      /* Only data that has been accepted as a new block gets passed over */
+      switch (coap_block_stream_data(session, pdu, resource, &lg_srcv->stream,
+                                     saved_offset, data, length, total)) {
+      case 0:
+        coap_add_data(response, sizeof("Data handler failed")-1,
+                      (const uint8_t *)"Data handler failed");
+        response->code = COAP_RESPONSE_CODE(500);
+        goto free_lg_srcv;
+      case -1:
+        /* Not held - leave it to be sent again */
+        lg_srcv->rec_blocks = saved_blocks;
+        if (block_option == COAP_OPTION_BLOCK1) {
+          coap_add_data(response, sizeof("Missing interim block")-1,
+                        (const uint8_t *)"Missing interim block");
+          response->code = COAP_RESPONSE_CODE(408);
+        }
+        goto skip_app_handler;
+      default:
+        break;
+      }
+    }
     if (lg_srcv->total_len < saved_offset + length) {
       lg_srcv->total_len = saved_offset + length;
     }
-    lg_srcv->body_data = coap_block_build_body(lg_srcv->body_data, length, data,
-                                               saved_offset, lg_srcv->total_len);
-    if (!lg_srcv->body_data) {
-      coap_add_data(response, sizeof("Memory issue")-1,
-                    (const uint8_t *)"Memory issue");
-      response->code = COAP_RESPONSE_CODE(500);
-      goto skip_app_handler;
+    if (!context->block_data_handler) {
+      lg_srcv->body_data = coap_block_build_body(lg_srcv->body_data, length, data,
+                                                 saved_offset, lg_srcv->total_len);
+      if (!lg_srcv->body_data) {
+        coap_add_data(response, sizeof("Memory issue")-1,
+                      (const uint8_t *)"Memory issue");
+        response->code = COAP_RESPONSE_CODE(500);
+        goto skip_app_handler;
+      }
     }
   }
 
@@ -3163,6 +3325,14 @@ give_app_data:
     pdu->body_data = NULL;
     pdu->body_length = 0;
   }
+  if (context->block_data_handler) {
+    coap_block_stream_release(session, pdu, resource, &lg_srcv->stream, 1);
+    /* The body has been passed over, so do not present this block's data */
+    if (pdu->data) {
+      pdu->used_size = pdu->data - pdu->token - 1;
+      pdu->data = NULL;
+    }
+  }
   pdu->body_offset = 0;
   pdu->body_total = lg_srcv->total_len;
   coap_log_debug("Server app version of updated PDU\n");
@@ -3728,6 +3898,8 @@ coap_handle_response_get_block(coap_context_t *context,
       size_t size2 = size_opt ?
                      coap_decode_var_bytes(coap_opt_value(size_opt),
                                            coap_opt_length(size_opt)) : 0;
+      /* The body length is not known if Size2 is missing until the last block */
+      int size2_known = size_opt != NULL;
 
       /* length and data are cleared on error */
       (void)coap_get_data(rcvd, &length, &data);
@@ -3764,6 +3936,7 @@ coap_handle_response_get_block(coap_context_t *context,
                                                  COAP_OPTION_ETAG,
                                                  &opt_iter);
         size_t saved_offset;
+        coap_rblock_t saved_blocks;
         int updated_block;
 
         if (length > block.chunk_size) {
@@ -3782,10 +3955,13 @@ coap_handle_response_get_block(coap_context_t *context,
         chunk = (size_t)1 << (block.szx + 4);
         offset = block.num * chunk;
         if (size2 < (offset + length)) {
-          if (block.m)
+          if (block.m) {
             size2 = offset + length + 1;
-          else
+            size2_known = 0;
+          } else {
             size2 = offset + length;
+            size2_known = 1;
+          }
         }
         saved_offset = offset;
 
@@ -3798,6 +3974,7 @@ reinit:
             coap_free_type(COAP_STRING, lg_crcv->body_data);
             lg_crcv->body_data = NULL;
           }
+          coap_block_stream_reset(&lg_crcv->stream);
           if (etag_opt) {
             lg_crcv->etag_length = coap_opt_length(etag_opt);
             memcpy(lg_crcv->etag, coap_opt_value(etag_opt), lg_crcv->etag_length);
@@ -3888,6 +4065,7 @@ reinit:
             lg_crcv->observe_set = 0;
           }
         }
+        saved_blocks = lg_crcv->rec_blocks;
         updated_block = 0;
         while (offset < saved_offset + length) {
           if (!check_if_received_block(&lg_crcv->rec_blocks, block.num)) {
@@ -3920,7 +4098,23 @@ reinit:
         block.num--;
         /* Only process if not duplicate block */
         if (updated_block) {
-          if ((session->block_mode & COAP_SINGLE_BLOCK_OR_Q) || block.bert) {
+          if (((session->block_mode & COAP_SINGLE_BLOCK_OR_Q) || block.bert) &&
+              context->block_data_handler) {
+            /* Only data that has been accepted as a new block gets passed over */
+            switch (coap_block_stream_data(session, rcvd, NULL, &lg_crcv->stream,
+                                           saved_offset, data, length,
+                                           size2_known ? size2 : 0)) {
+            case 0:
+              goto fail_resp;
+            case -1:
+              /* Not held - leave it to be requested again */
+              lg_crcv->rec_blocks = saved_blocks;
+              goto skip_app_handler;
+            default:
+              break;
+            }
+          } else if ((session->block_mode & COAP_SINGLE_BLOCK_OR_Q) ||
+                     block.bert) {
             if (size2 < saved_offset + length) {
               size2 = saved_offset + length;
             }
@@ -4028,7 +4222,17 @@ give_to_app:
               coap_update_option(rcvd, COAP_OPTION_OBSERVE,
                                  lg_crcv->observe_length, lg_crcv->observe);
             }
-            rcvd->body_data = lg_crcv->body_data->s;
+            if (context->block_data_handler) {
+              coap_block_stream_release(session, rcvd, NULL, &lg_crcv->stream, 1);
+              /* The body has been passed over, so do not present this block's data */
+              if (rcvd->data) {
+                rcvd->used_size = rcvd->data - rcvd->token - 1;
+                rcvd->data = NULL;
+              }
+              rcvd->body_data = NULL;
+            } else {
+              rcvd->body_data = lg_crcv->body_data->s;
+            }
 #if COAP_Q_BLOCK_SUPPORT
             rcvd->body_length = block_opt == COAP_OPTION_Q_BLOCK2 ?
                                 lg_crcv->total_len : saved_offset + length;
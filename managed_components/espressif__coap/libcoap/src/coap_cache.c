@@ -81,43 +81,168 @@ coap_cache_ignore_options_lkd(coap_context_t *ctx,
   return 1;
 }
 
-coap_cache_key_t *
-coap_cache_derive_key_w_ignore(const coap_session_t *session,
-                               const coap_pdu_t *pdu,
-                               coap_cache_session_based_t session_based,
-                               const uint16_t *cache_ignore_options,
-                               size_t cache_ignore_count) {
+/*
+ * Cache-keys are a 128-bit SipHash-1-3 keyed with a random per-context
+ * seed, so that a peer cannot choose requests that collide. SipHash is
+ * https://cr.yp.to/siphash/siphash-20120918.pdf
+ */
+typedef struct coap_sip_t {
+  uint64_t v0, v1, v2, v3;
+  uint64_t tail;     /* bytes not yet in a full 8 byte word */
+  size_t length;     /* total bytes added */
+} coap_sip_t;
+
+#define SIP_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3)                             \
+  do {                                                        \
+    v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0;                \
+    v0 = SIP_ROTL(v0, 32);                                    \
+    v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2;                \
+    v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0;                \
+    v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2;                \
+    v2 = SIP_ROTL(v2, 32);                                    \
+  } while (0)
+
+#define SIP_WORD(v0, v1, v2, v3, m)                           \
+  do {                                                        \
+    v3 ^= (m);                                                \
+    SIP_ROUND(v0, v1, v2, v3);                                \
+    v0 ^= (m);                                                \
+  } while (0)
+
+static void
+coap_sip_init(coap_sip_t *sip, const uint64_t seed[2]) {
+  sip->v0 = seed[0] ^ 0x736f6d6570736575ULL;
+  sip->v1 = seed[1] ^ 0x646f72616e646f6dULL ^ 0xee;
+  sip->v2 = seed[0] ^ 0x6c7967656e657261ULL;
+  sip->v3 = seed[1] ^ 0x7465646279746573ULL;
+  sip->tail = 0;
+  sip->length = 0;
+}
+
+/*
+ * The state is worked on in locals, as the compiler has to assume that the
+ * uint8_t data could alias it.
+ */
+static void
+coap_sip_update(coap_sip_t *sip, const uint8_t *data, size_t len) {
+  uint64_t v0 = sip->v0, v1 = sip->v1, v2 = sip->v2, v3 = sip->v3;
+  uint64_t tail = sip->tail;
+  size_t used = sip->length & 7;
+
+  sip->length += len;
+  /* Complete any partial word */
+  if (used) {
+    while (len && used < 8) {
+      tail |= (uint64_t)*data++ << (8 * used++);
+      len--;
+    }
+    if (used < 8) {
+      sip->tail = tail;
+      return;
+    }
+    SIP_WORD(v0, v1, v2, v3, tail);
+    tail = 0;
+  }
+  while (len >= 8) {
+    uint64_t m = (uint64_t)data[0] | (uint64_t)data[1] << 8 |
+                 (uint64_t)data[2] << 16 | (uint64_t)data[3] << 24 |
+                 (uint64_t)data[4] << 32 | (uint64_t)data[5] << 40 |
+                 (uint64_t)data[6] << 48 | (uint64_t)data[7] << 56;
+
+    SIP_WORD(v0, v1, v2, v3, m);
+    data += 8;
+    len -= 8;
+  }
+  for (used = 0; used < len; used++)
+    tail |= (uint64_t)data[used] << (8 * used);
+  sip->v0 = v0;
+  sip->v1 = v1;
+  sip->v2 = v2;
+  sip->v3 = v3;
+  sip->tail = tail;
+}
+
+static void
+coap_sip_final(coap_sip_t *sip, uint8_t out[16]) {
+  uint64_t v0 = sip->v0, v1 = sip->v1, v2 = sip->v2, v3 = sip->v3;
+  uint64_t h[2];
+  size_t i;
+
+  SIP_WORD(v0, v1, v2, v3, sip->tail | (uint64_t)sip->length << 56);
+  v2 ^= 0xee;
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  h[0] = v0 ^ v1 ^ v2 ^ v3;
+  v1 ^= 0xdd;
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  h[1] = v0 ^ v1 ^ v2 ^ v3;
+  for (i = 0; i < 8; i++) {
+    out[i] = (uint8_t)(h[0] >> (8 * i));
+    out[i + 8] = (uint8_t)(h[1] >> (8 * i));
+  }
+}
+
+/*
+ * Options are mostly only a few bytes long, so they are gathered up in buf
+ * and passed to coap_sip_update() in larger pieces.
+ */
+typedef struct coap_cache_key_buf_t {
+  coap_sip_t sip;
+  size_t used;
+  uint8_t buf[128];
+} coap_cache_key_buf_t;
+
+static void
+coap_cache_key_add(coap_cache_key_buf_t *kb, const uint8_t *data, size_t len) {
+  if (kb->used + len > sizeof(kb->buf)) {
+    coap_sip_update(&kb->sip, kb->buf, kb->used);
+    kb->used = 0;
+    if (len > sizeof(kb->buf)) {
+      coap_sip_update(&kb->sip, data, len);
+      return;
+    }
+  }
+  memcpy(kb->buf + kb->used, data, len);
+  kb->used += len;
+}
+
+int
+coap_cache_derive_key_into(const coap_session_t *session,
+                           const coap_pdu_t *pdu,
+                           coap_cache_session_based_t session_based,
+                           const uint16_t *cache_ignore_options,
+                           size_t cache_ignore_count,
+                           coap_cache_key_t *cache_key) {
   coap_opt_t *option;
   coap_opt_iterator_t opt_iter;
-  coap_digest_ctx_t *dctx;
-  coap_digest_t digest;
-  coap_cache_key_t *cache_key;
+  coap_cache_key_buf_t kb;
+  uint8_t hdr[4];
 
   if (!coap_option_iterator_init(pdu, &opt_iter, COAP_OPT_ALL)) {
-    return NULL;
+    return 0;
   }
 
-  dctx = coap_digest_setup();
-  if (!dctx)
-    return NULL;
-
+  coap_sip_init(&kb.sip, session->context->cache_seed);
+  kb.used = 0;
   if (session_based == COAP_CACHE_IS_SESSION_BASED) {
     /* Include the session ptr */
-    if (!coap_digest_update(dctx, (const uint8_t *)&session, sizeof(session))) {
-      goto update_fail;
-    }
+    coap_cache_key_add(&kb, (const uint8_t *)&session, sizeof(session));
   }
   while ((option = coap_option_next(&opt_iter))) {
     if (is_cache_key(opt_iter.number, cache_ignore_count,
                      cache_ignore_options)) {
-      if (!coap_digest_update(dctx, (const uint8_t *)&opt_iter.number,
-                              sizeof(opt_iter.number))) {
-        goto update_fail;
-      }
-      if (!coap_digest_update(dctx, coap_opt_value(option),
-                              coap_opt_length(option))) {
-        goto update_fail;
-      }
+      /* Include the length so that option boundaries are unambiguous */
+      hdr[0] = (uint8_t)(opt_iter.number >> 8);
+      hdr[1] = (uint8_t)opt_iter.number;
+      hdr[2] = (uint8_t)(coap_opt_length(option) >> 8);
+      hdr[3] = (uint8_t)coap_opt_length(option);
+      coap_cache_key_add(&kb, hdr, sizeof(hdr));
+      coap_cache_key_add(&kb, coap_opt_value(option), coap_opt_length(option));
     }
   }
 
@@ -127,24 +252,34 @@ coap_cache_derive_key_w_ignore(const coap_session_t *session,
     size_t len;
     const uint8_t *data;
     if (coap_get_data(pdu, &len, &data)) {
-      if (!coap_digest_update(dctx, data, len)) {
-        goto update_fail;
-      }
+      coap_cache_key_add(&kb, data, len);
     }
   }
 
-  if (!coap_digest_final(dctx, &digest)) {
-    /* coap_digest_final() is guaranteed to free off dctx no matter what */
+  coap_sip_update(&kb.sip, kb.buf, kb.used);
+  coap_sip_final(&kb.sip, cache_key->key);
+  return 1;
+}
+
+coap_cache_key_t *
+coap_cache_derive_key_w_ignore(const coap_session_t *session,
+                               const coap_pdu_t *pdu,
+                               coap_cache_session_based_t session_based,
+                               const uint16_t *cache_ignore_options,
+                               size_t cache_ignore_count) {
+  coap_cache_key_t key;
+  coap_cache_key_t *cache_key;
+
+  if (!coap_cache_derive_key_into(session, pdu, session_based,
+                                  cache_ignore_options, cache_ignore_count,
+                                  &key)) {
     return NULL;
   }
   cache_key = coap_malloc_type(COAP_CACHE_KEY, sizeof(coap_cache_key_t));
   if (cache_key) {
-    memcpy(cache_key->key, digest.key, sizeof(cache_key->key));
+    *cache_key = key;
   }
   return cache_key;
-update_fail:
-  coap_digest_free(dctx);
-  return NULL;
 }
 
 coap_cache_key_t *
@@ -161,6 +296,186 @@ coap_delete_cache_key(coap_cache_key_t *cache_key) {
   coap_free_type(COAP_CACHE_KEY, cache_key);
 }
 
+/*
+ * The cache-entries that expire are kept in a binary min-heap ordered by
+ * expire_ticks, so that coap_expire_cache_entries() only has to look at the
+ * top of the heap.
+ */
+static void
+coap_cache_heap_set(coap_context_t *ctx, size_t idx, coap_cache_entry_t *entry) {
+  ctx->cache_expire[idx] = entry;
+  entry->expire_idx = idx + 1;
+}
+
+static void
+coap_cache_heap_up(coap_context_t *ctx, size_t idx) {
+  coap_cache_entry_t *entry = ctx->cache_expire[idx];
+
+  while (idx > 0) {
+    size_t parent = (idx - 1) / 2;
+
+    if (ctx->cache_expire[parent]->expire_ticks <= entry->expire_ticks)
+      break;
+    coap_cache_heap_set(ctx, idx, ctx->cache_expire[parent]);
+    idx = parent;
+  }
+  coap_cache_heap_set(ctx, idx, entry);
+}
+
+static void
+coap_cache_heap_down(coap_context_t *ctx, size_t idx) {
+  coap_cache_entry_t *entry = ctx->cache_expire[idx];
+
+  for (;;) {
+    size_t child = 2 * idx + 1;
+
+    if (child >= ctx->cache_expire_count)
+      break;
+    if (child + 1 < ctx->cache_expire_count &&
+        ctx->cache_expire[child + 1]->expire_ticks <
+        ctx->cache_expire[child]->expire_ticks)
+      child++;
+    if (entry->expire_ticks <= ctx->cache_expire[child]->expire_ticks)
+      break;
+    coap_cache_heap_set(ctx, idx, ctx->cache_expire[child]);
+    idx = child;
+  }
+  coap_cache_heap_set(ctx, idx, entry);
+}
+
+static int
+coap_cache_heap_add(coap_context_t *ctx, coap_cache_entry_t *entry) {
+  if (ctx->cache_expire_count == ctx->cache_expire_max) {
+    size_t max = ctx->cache_expire_max ? 2 * ctx->cache_expire_max : 16;
+    coap_cache_entry_t **heap;
+
+    heap = coap_realloc_type(COAP_CACHE_EXPIRE, ctx->cache_expire,
+                             max * sizeof(heap[0]));
+    if (!heap)
+      return 0;
+    ctx->cache_expire = heap;
+    ctx->cache_expire_max = max;
+  }
+  ctx->cache_expire[ctx->cache_expire_count++] = entry;
+  coap_cache_heap_up(ctx, ctx->cache_expire_count - 1);
+  return 1;
+}
+
+static void
+coap_cache_heap_remove(coap_context_t *ctx, coap_cache_entry_t *entry) {
+  size_t idx = entry->expire_idx - 1;
+  coap_cache_entry_t *last;
+
+  entry->expire_idx = 0;
+  last = ctx->cache_expire[--ctx->cache_expire_count];
+  if (last == entry)
+    return;
+  coap_cache_heap_set(ctx, idx, last);
+  if (idx > 0 &&
+      ctx->cache_expire[(idx - 1) / 2]->expire_ticks > last->expire_ticks)
+    coap_cache_heap_up(ctx, idx);
+  else
+    coap_cache_heap_down(ctx, idx);
+}
+
+/* The entry has just been used */
+static void
+coap_cache_touch(coap_context_t *ctx, coap_cache_entry_t *entry) {
+  if (entry->lru_next) {
+    DL_DELETE2(ctx->cache_lru, entry, lru_prev, lru_next);
+    DL_APPEND2(ctx->cache_lru, entry, lru_prev, lru_next);
+  }
+  if (entry->idle_timeout > 0 && entry->expire_idx) {
+    coap_ticks(&entry->expire_ticks);
+    entry->expire_ticks += entry->idle_timeout * COAP_TICKS_PER_SECOND;
+    coap_cache_heap_down(ctx, entry->expire_idx - 1);
+  }
+}
+
+/*
+ * Delete the least recently used entries until within cache_max_size. Only
+ * the entries that libcoap manages itself are on cache_lru, as the
+ * application may still be holding on to the ones it created.
+ */
+static void
+coap_cache_evict(coap_context_t *ctx, const coap_cache_entry_t *keep) {
+  while (ctx->cache_max_size && ctx->cache_size > ctx->cache_max_size &&
+         ctx->cache_lru && ctx->cache_lru != keep) {
+    ctx->cache_evictions++;
+    coap_delete_cache_entry(ctx, ctx->cache_lru);
+  }
+}
+
+/* Take a copy of pdu that only holds what pdu uses */
+static coap_pdu_t *
+coap_cache_copy_pdu(const coap_pdu_t *pdu) {
+  coap_pdu_t *copy;
+  size_t alloc_size;
+  size_t max_size;
+
+  copy = coap_pdu_init(pdu->type, pdu->code, pdu->mid, pdu->used_size);
+  if (!copy)
+    return NULL;
+  if (!coap_pdu_resize(copy, pdu->used_size)) {
+    coap_delete_pdu(copy);
+    return NULL;
+  }
+  alloc_size = copy->alloc_size;
+  max_size = copy->max_size;
+  /* Need to get the appropriate data across */
+  memcpy(copy, pdu, offsetof(coap_pdu_t, token));
+  memcpy(copy->token, pdu->token, pdu->used_size);
+  /* And adjust all the pointers etc. */
+  copy->alloc_size = alloc_size;
+  copy->max_size = max_size;
+  copy->borrowed = 0;
+  /* As set by coap_pdu_clear() or coap_pdu_parse(), even if no token */
+  copy->actual_token.s = copy->token +
+                         (pdu->e_token_length - pdu->actual_token.length);
+  copy->data = pdu->data ? copy->token + (pdu->data - pdu->token) : NULL;
+  return copy;
+}
+
+static coap_cache_entry_t *
+coap_cache_add_entry(coap_context_t *ctx, coap_session_t *session,
+                     coap_resource_t *resource, coap_cache_key_t *cache_key,
+                     coap_pdu_t *pdu, coap_tick_t expire_ticks,
+                     unsigned int idle_timeout) {
+  coap_cache_entry_t *entry;
+
+  entry = coap_malloc_type(COAP_CACHE_ENTRY, sizeof(coap_cache_entry_t));
+  if (!entry) {
+    coap_delete_pdu(pdu);
+    coap_delete_cache_key(cache_key);
+    return NULL;
+  }
+  memset(entry, 0, sizeof(coap_cache_entry_t));
+  entry->session = session;
+  entry->cache_key = cache_key;
+  entry->pdu = pdu;
+  entry->idle_timeout = idle_timeout;
+  entry->expire_ticks = expire_ticks;
+  if (expire_ticks && !coap_cache_heap_add(ctx, entry)) {
+    coap_delete_pdu(pdu);
+    coap_delete_cache_key(cache_key);
+    coap_free_type(COAP_CACHE_ENTRY, entry);
+    return NULL;
+  }
+  entry->size = sizeof(coap_cache_entry_t) + sizeof(coap_cache_key_t);
+  if (pdu)
+    entry->size += sizeof(coap_pdu_t) + pdu->alloc_size;
+  ctx->cache_size += entry->size;
+
+  HASH_ADD(hh, ctx->cache, cache_key[0], sizeof(coap_cache_key_t), entry);
+  if (resource) {
+    entry->resource = resource;
+    DL_APPEND2(resource->cache_entries, entry, res_prev, res_next);
+    DL_APPEND2(ctx->cache_lru, entry, lru_prev, lru_next);
+  }
+  coap_cache_evict(ctx, entry);
+  return entry;
+}
+
 COAP_API coap_cache_entry_t *
 coap_new_cache_entry(coap_session_t *session, const coap_pdu_t *pdu,
                      coap_cache_record_pdu_t record_pdu,
@@ -180,45 +495,27 @@ coap_new_cache_entry_lkd(coap_session_t *session, const coap_pdu_t *pdu,
                          coap_cache_record_pdu_t record_pdu,
                          coap_cache_session_based_t session_based,
                          unsigned int idle_timeout) {
-  coap_cache_entry_t *entry;
+  coap_pdu_t *copy = NULL;
+  coap_cache_key_t *cache_key;
+  coap_tick_t expire_ticks = 0;
 
   coap_lock_check_locked(session->context);
-  entry = coap_malloc_type(COAP_CACHE_ENTRY,
-                           sizeof(coap_cache_entry_t));
-  if (!entry) {
-    return NULL;
-  }
-
-  memset(entry, 0, sizeof(coap_cache_entry_t));
-  entry->session = session;
   if (record_pdu == COAP_CACHE_RECORD_PDU) {
-    entry->pdu = coap_pdu_init(pdu->type, pdu->code, pdu->mid, pdu->alloc_size);
-    if (entry->pdu) {
-      if (!coap_pdu_resize(entry->pdu, pdu->alloc_size)) {
-        coap_delete_pdu(entry->pdu);
-        coap_free_type(COAP_CACHE_ENTRY, entry);
-        return NULL;
-      }
-      /* Need to get the appropriate data across */
-      memcpy(entry->pdu, pdu, offsetof(coap_pdu_t, token));
-      memcpy(entry->pdu->token, pdu->token, pdu->used_size);
-      /* And adjust all the pointers etc. */
-      entry->pdu->data = entry->pdu->token + (pdu->data - pdu->token);
-    }
+    copy = coap_cache_copy_pdu(pdu);
+    if (!copy)
+      return NULL;
   }
-  entry->cache_key = coap_cache_derive_key(session, pdu, session_based);
-  if (!entry->cache_key) {
-    coap_free_type(COAP_CACHE_ENTRY, entry);
+  cache_key = coap_cache_derive_key(session, pdu, session_based);
+  if (!cache_key) {
+    coap_delete_pdu(copy);
     return NULL;
   }
-  entry->idle_timeout = idle_timeout;
   if (idle_timeout > 0) {
-    coap_ticks(&entry->expire_ticks);
-    entry->expire_ticks += idle_timeout * COAP_TICKS_PER_SECOND;
+    coap_ticks(&expire_ticks);
+    expire_ticks += idle_timeout * COAP_TICKS_PER_SECOND;
   }
-
-  HASH_ADD(hh, session->context->cache, cache_key[0], sizeof(coap_cache_key_t), entry);
-  return entry;
+  return coap_cache_add_entry(session->context, session, NULL, cache_key, copy,
+                              expire_ticks, idle_timeout);
 }
 
 COAP_API coap_cache_entry_t *
@@ -240,9 +537,11 @@ coap_cache_get_by_key_lkd(coap_context_t *ctx, const coap_cache_key_t *cache_key
   if (cache_key) {
     HASH_FIND(hh, ctx->cache, cache_key, sizeof(coap_cache_key_t), cache_entry);
   }
-  if (cache_entry && cache_entry->idle_timeout > 0) {
-    coap_ticks(&cache_entry->expire_ticks);
-    cache_entry->expire_ticks += cache_entry->idle_timeout * COAP_TICKS_PER_SECOND;
+  if (cache_entry) {
+    ctx->cache_hits++;
+    coap_cache_touch(ctx, cache_entry);
+  } else {
+    ctx->cache_misses++;
   }
   return cache_entry;
 }
@@ -263,20 +562,15 @@ coap_cache_entry_t *
 coap_cache_get_by_pdu_lkd(coap_session_t *session,
                           const coap_pdu_t *request,
                           coap_cache_session_based_t session_based) {
-  coap_cache_key_t *cache_key = coap_cache_derive_key(session, request, session_based);
-  coap_cache_entry_t *cache_entry;
-
-  if (!cache_key)
-    return NULL;
+  coap_cache_key_t cache_key;
 
   coap_lock_check_locked(session->context);
-  cache_entry = coap_cache_get_by_key_lkd(session->context, cache_key);
-  coap_delete_cache_key(cache_key);
-  if (cache_entry && cache_entry->idle_timeout > 0) {
-    coap_ticks(&cache_entry->expire_ticks);
-    cache_entry->expire_ticks += cache_entry->idle_timeout * COAP_TICKS_PER_SECOND;
-  }
-  return cache_entry;
+  if (!coap_cache_derive_key_into(session, request, session_based,
+                                  session->context->cache_ignore_options,
+                                  session->context->cache_ignore_count,
+                                  &cache_key))
+    return NULL;
+  return coap_cache_get_by_key_lkd(session->context, &cache_key);
 }
 
 void
@@ -287,6 +581,14 @@ coap_delete_cache_entry(coap_context_t *ctx, coap_cache_entry_t *cache_entry) {
   if (cache_entry) {
     HASH_DELETE(hh, ctx->cache, cache_entry);
   }
+  if (cache_entry->expire_idx)
+    coap_cache_heap_remove(ctx, cache_entry);
+  if (cache_entry->resource) {
+    DL_DELETE2(ctx->cache_lru, cache_entry, lru_prev, lru_next);
+    DL_DELETE2(cache_entry->resource->cache_entries, cache_entry,
+               res_prev, res_next);
+  }
+  ctx->cache_size -= cache_entry->size;
   if (cache_entry->pdu) {
     coap_delete_pdu(cache_entry->pdu);
   }
@@ -315,19 +617,214 @@ coap_cache_get_app_data(const coap_cache_entry_t *cache_entry) {
   return cache_entry->app_data;
 }
 
+COAP_API void
+coap_cache_set_max_size(coap_context_t *ctx, size_t max_size) {
+  coap_lock_lock(ctx, return);
+  coap_cache_set_max_size_lkd(ctx, max_size);
+  coap_lock_unlock(ctx);
+}
+
 void
-coap_expire_cache_entries(coap_context_t *ctx) {
+coap_cache_set_max_size_lkd(coap_context_t *ctx, size_t max_size) {
+  coap_lock_check_locked(ctx);
+  ctx->cache_max_size = max_size;
+  coap_cache_evict(ctx, NULL);
+}
+
+void
+coap_cache_get_stats(const coap_context_t *ctx, uint64_t *hits,
+                     uint64_t *misses, uint64_t *evictions, size_t *size) {
+  if (hits)
+    *hits = ctx->cache_hits;
+  if (misses)
+    *misses = ctx->cache_misses;
+  if (evictions)
+    *evictions = ctx->cache_evictions;
+  if (size)
+    *size = ctx->cache_size;
+}
+
+/*
+ * A request that validates (with ETag) the response libcoap has cached
+ * needs to find it. https://rfc-editor.org/rfc/rfc7252#section-5.10.6.2
+ */
+static const uint16_t cache_response_ignore_options[] = { COAP_OPTION_ETAG };
+#define COAP_CACHE_RESPONSE_IGNORE_COUNT \
+  (sizeof(cache_response_ignore_options) / sizeof(cache_response_ignore_options[0]))
+
+/* Returns 1 if libcoap can cache the response to request itself */
+static int
+coap_cache_response_usable(const coap_pdu_t *request) {
+  coap_opt_iterator_t opt_iter;
+
+  if (request->code != COAP_REQUEST_CODE_GET)
+    return 0;
+  /* Only whole bodies, and not observe registrations */
+  if (coap_check_option(request, COAP_OPTION_OBSERVE, &opt_iter) ||
+      coap_check_option(request, COAP_OPTION_BLOCK2, &opt_iter) ||
+      coap_check_option(request, COAP_OPTION_Q_BLOCK2, &opt_iter))
+    return 0;
+  return 1;
+}
+
+int
+coap_cache_serve_response_lkd(coap_session_t *session,
+                              coap_resource_t *resource,
+                              const coap_pdu_t *request,
+                              coap_pdu_t *response) {
+  coap_context_t *ctx = session->context;
+  coap_cache_entry_t *entry;
+  coap_cache_key_t cache_key;
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t *option;
+  coap_opt_t *etag;
   coap_tick_t now;
-  coap_cache_entry_t *cp, *ctmp;
+  uint32_t max_age;
+  uint8_t buf[4];
+  size_t len;
+  const uint8_t *data;
 
+  coap_lock_check_locked(ctx);
+  if (!coap_cache_response_usable(request))
+    return 0;
+  if (!coap_cache_derive_key_into(session, request,
+                                  COAP_CACHE_NOT_SESSION_BASED,
+                                  cache_response_ignore_options,
+                                  COAP_CACHE_RESPONSE_IGNORE_COUNT,
+                                  &cache_key))
+    return 0;
+  HASH_FIND(hh, ctx->cache, &cache_key, sizeof(coap_cache_key_t), entry);
   coap_ticks(&now);
-  HASH_ITER(hh, ctx->cache, cp, ctmp) {
-    if (cp->idle_timeout > 0) {
-      if (cp->expire_ticks <= now) {
-        coap_delete_cache_entry(ctx, cp);
+  if (entry && entry->resource == resource && entry->expire_ticks <= now) {
+    /* Expired, but coap_expire_cache_entries() has not got to it yet */
+    coap_delete_cache_entry(ctx, entry);
+    entry = NULL;
+  }
+  if (!entry || entry->resource != resource) {
+    ctx->cache_misses++;
+    return 0;
+  }
+  ctx->cache_hits++;
+  coap_cache_touch(ctx, entry);
+  max_age = (uint32_t)((entry->expire_ticks - now + COAP_TICKS_PER_SECOND - 1) /
+                       COAP_TICKS_PER_SECOND);
+
+  /* https://rfc-editor.org/rfc/rfc7252#section-5.10.6.2 */
+  etag = coap_check_option(entry->pdu, COAP_OPTION_ETAG, &opt_iter);
+  if (etag) {
+    coap_option_iterator_init(request, &opt_iter, COAP_OPT_ALL);
+    while ((option = coap_option_next(&opt_iter))) {
+      if (opt_iter.number == COAP_OPTION_ETAG &&
+          coap_opt_length(option) == coap_opt_length(etag) &&
+          memcmp(coap_opt_value(option), coap_opt_value(etag),
+                 coap_opt_length(etag)) == 0) {
+        response->code = COAP_RESPONSE_CODE(203);
+        if (!coap_add_option_internal(response, COAP_OPTION_ETAG,
+                                      coap_opt_length(etag),
+                                      coap_opt_value(etag)) ||
+            !coap_add_option_internal(response, COAP_OPTION_MAXAGE,
+                                      coap_encode_var_safe(buf, sizeof(buf),
+                                                           max_age), buf))
+          return 0;
+        return 1;
       }
     }
   }
+
+  response->code = entry->pdu->code;
+  coap_option_iterator_init(entry->pdu, &opt_iter, COAP_OPT_ALL);
+  while ((option = coap_option_next(&opt_iter))) {
+    if (opt_iter.number == COAP_OPTION_MAXAGE)
+      continue;
+    if (!coap_add_option_internal(response, opt_iter.number,
+                                  coap_opt_length(option),
+                                  coap_opt_value(option)))
+      return 0;
+  }
+  if (!coap_add_option_internal(response, COAP_OPTION_MAXAGE,
+                                coap_encode_var_safe(buf, sizeof(buf), max_age),
+                                buf))
+    return 0;
+  if (coap_get_data(entry->pdu, &len, &data) &&
+      !coap_add_data(response, len, data))
+    return 0;
+  return 1;
+}
+
+void
+coap_cache_add_response_lkd(coap_session_t *session,
+                            coap_resource_t *resource,
+                            const coap_pdu_t *request,
+                            const coap_pdu_t *response) {
+  coap_context_t *ctx = session->context;
+  coap_cache_entry_t *entry;
+  coap_cache_key_t key;
+  coap_cache_key_t *cache_key;
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t *option;
+  coap_pdu_t *copy;
+  coap_tick_t expire_ticks;
+  uint32_t max_age = COAP_CACHE_DEFAULT_MAX_AGE;
+
+  coap_lock_check_locked(ctx);
+  if (response->code != COAP_RESPONSE_CODE(205) ||
+      !coap_cache_response_usable(request))
+    return;
+  if (coap_check_option(response, COAP_OPTION_OBSERVE, &opt_iter) ||
+      coap_check_option(response, COAP_OPTION_BLOCK2, &opt_iter) ||
+      coap_check_option(response, COAP_OPTION_Q_BLOCK2, &opt_iter))
+    return;
+  option = coap_check_option(response, COAP_OPTION_MAXAGE, &opt_iter);
+  if (option)
+    max_age = coap_decode_var_bytes(coap_opt_value(option),
+                                    coap_opt_length(option));
+  if (max_age == 0)
+    return;
+
+  if (!coap_cache_derive_key_into(session, request,
+                                  COAP_CACHE_NOT_SESSION_BASED,
+                                  cache_response_ignore_options,
+                                  COAP_CACHE_RESPONSE_IGNORE_COUNT, &key))
+    return;
+  HASH_FIND(hh, ctx->cache, &key, sizeof(coap_cache_key_t), entry);
+  if (entry) {
+    /* Already in use, possibly by the application */
+    return;
+  }
+  cache_key = coap_malloc_type(COAP_CACHE_KEY, sizeof(coap_cache_key_t));
+  if (!cache_key)
+    return;
+  *cache_key = key;
+  copy = coap_cache_copy_pdu(response);
+  if (!copy) {
+    coap_delete_cache_key(cache_key);
+    return;
+  }
+  copy->session = NULL;
+  copy->lg_xmit = NULL;
+  coap_ticks(&expire_ticks);
+  expire_ticks += (coap_tick_t)max_age * COAP_TICKS_PER_SECOND;
+  coap_cache_add_entry(ctx, NULL, resource, cache_key, copy, expire_ticks, 0);
+}
+
+void
+coap_cache_delete_resource_entries(coap_context_t *ctx,
+                                   coap_resource_t *resource) {
+  while (resource->cache_entries)
+    coap_delete_cache_entry(ctx, resource->cache_entries);
+}
+
+void
+coap_expire_cache_entries(coap_context_t *ctx) {
+  coap_tick_t now;
+
+  if (!ctx->cache_expire_count)
+    return;
+  coap_ticks(&now);
+  while (ctx->cache_expire_count &&
+         ctx->cache_expire[0]->expire_ticks <= now) {
+    coap_delete_cache_entry(ctx, ctx->cache_expire[0]);
+  }
 }
 
 #endif /* ! COAP_SERVER_SUPPORT */
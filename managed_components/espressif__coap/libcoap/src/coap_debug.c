@@ -114,7 +114,7 @@ static const char *loglevels[] = {
 
 const char *
 coap_log_level_desc(coap_log_t level) {
-  static char bad[8];
+  static COAP_THREAD_LOCAL char bad[8];
   if (level >= sizeof(loglevels)/sizeof(loglevels[0])) {
     snprintf(bad, sizeof(bad), "%4d", level);
     return bad;
@@ -571,7 +571,7 @@ msg_code_string(uint16_t c) {
   static const char *signals[] = { "7.00", "CSM", "Ping", "Pong", "Release",
                                    "Abort"
                                  };
-  static char buf[5];
+  static COAP_THREAD_LOCAL char buf[5];
 
   if (c < sizeof(methods)/sizeof(const char *)) {
     return methods[c];
@@ -639,7 +639,7 @@ msg_option_string(uint8_t code, uint16_t option_type) {
     { COAP_SIGNALING_OPTION_BAD_CSM_OPTION, "Bad-CSM-Option" }
   };
 
-  static char buf[6];
+  static COAP_THREAD_LOCAL char buf[6];
   size_t i;
 
   if (code == COAP_SIGNALING_CSM) {
@@ -778,9 +778,8 @@ void
 coap_show_pdu(coap_log_t level, const coap_pdu_t *pdu) {
 #if COAP_CONSTRAINED_STACK
   /* Proxy-Uri: can be 1034 bytes long */
-  /* buf and outbuf can be protected by global_lock if needed */
-  static unsigned char buf[min(COAP_DEBUG_BUF_SIZE, 1035)];
-  static char outbuf[COAP_DEBUG_BUF_SIZE];
+  static COAP_THREAD_LOCAL unsigned char buf[min(COAP_DEBUG_BUF_SIZE, 1035)];
+  static COAP_THREAD_LOCAL char outbuf[COAP_DEBUG_BUF_SIZE];
 #else /* ! COAP_CONSTRAINED_STACK */
   /* Proxy-Uri: can be 1034 bytes long */
   unsigned char buf[min(COAP_DEBUG_BUF_SIZE, 1035)];
@@ -1267,8 +1266,7 @@ coap_log_impl(coap_log_t level, const char *format, ...) {
 
   if (log_handler) {
 #if COAP_CONSTRAINED_STACK
-    /* message can be protected by global_lock if needed */
-    static char message[COAP_DEBUG_BUF_SIZE];
+    static COAP_THREAD_LOCAL char message[COAP_DEBUG_BUF_SIZE];
 #else /* ! COAP_CONSTRAINED_STACK */
     char message[COAP_DEBUG_BUF_SIZE];
 #endif /* ! COAP_CONSTRAINED_STACK */
@@ -1360,24 +1358,35 @@ coap_debug_set_packet_loss(const char *loss_level) {
 
 int
 coap_debug_send_packet(void) {
-  ++send_packet_count;
+  int count;
+  int drop = 0;
+  int locked = 1;
+
+  /* The packet counter is shared by all contexts */
+  coap_lock_lock(NULL, locked = 0);
+  count = ++send_packet_count;
   if (num_packet_loss_intervals > 0) {
     int i;
     for (i = 0; i < num_packet_loss_intervals; i++) {
-      if (send_packet_count >= packet_loss_intervals[i].start &&
-          send_packet_count <= packet_loss_intervals[i].end) {
-        coap_log_debug("Packet %u dropped\n", send_packet_count);
-        return 0;
+      if (count >= packet_loss_intervals[i].start &&
+          count <= packet_loss_intervals[i].end) {
+        drop = 1;
+        break;
       }
     }
   }
-  if (packet_loss_level > 0) {
+  if (locked) {
+    coap_lock_unlock(NULL);
+  }
+  if (!drop && packet_loss_level > 0) {
     uint16_t r = 0;
     coap_prng_lkd((uint8_t *)&r, 2);
-    if (r < packet_loss_level) {
-      coap_log_debug("Packet %u dropped\n", send_packet_count);
-      return 0;
-    }
+    if (r < packet_loss_level)
+      drop = 1;
+  }
+  if (drop) {
+    coap_log_debug("Packet %u dropped\n", count);
+    return 0;
   }
   return 1;
 }
@@ -319,3 +319,264 @@ coap_tls_close(coap_session_t *session) {
   session->sock.lfunc[COAP_LAYER_TLS].l_close(session);
 }
 #endif /* !COAP_DISABLE_TCP */
+
+void
+coap_dtls_handshake_done(coap_session_t *session, int resumed) {
+  coap_context_t *context = session->context;
+
+  if (resumed) {
+    context->tls_resumed_handshakes++;
+    coap_log_debug("*  %s: (D)TLS session resumed\n",
+                   coap_session_str(session));
+    coap_handle_event_lkd(context, COAP_EVENT_DTLS_RESUMED, session);
+  } else {
+    context->tls_full_handshakes++;
+  }
+}
+
+#if COAP_CLIENT_SUPPORT
+/*
+ * A (D)TLS library session held for resumption. A client can only resume a
+ * session with the same server (and with the same credentials), so they are
+ * keyed by everything that identifies the server to the client. A resumed
+ * session skips the checks of the peer's credentials, so the key also has a
+ * fingerprint of the security setup that was used for those checks.
+ */
+typedef struct coap_dtls_resume_t {
+  struct coap_dtls_resume_t *prev;
+  struct coap_dtls_resume_t *next;
+  coap_proto_t proto;
+  coap_address_t remote;
+  coap_bin_const_t *sni;
+  coap_bin_const_t *identity;
+  uint64_t setup_fp;
+  void *data;
+  void (*free_data)(void *data);
+} coap_dtls_resume_t;
+
+/*
+ * The fingerprint is a 64-bit FNV-1a, with each part preceded by its
+ * length so that the parts cannot run into each other. It only has to tell
+ * apart the setups of this client, not to resist a peer.
+ */
+#define COAP_DTLS_FP_INIT 0xcbf29ce484222325ULL
+
+static uint64_t
+coap_dtls_fp_add(uint64_t fp, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  size_t i;
+
+  for (i = 0; i < sizeof(len); i++) {
+    fp ^= (uint8_t)(len >> (8 * i));
+    fp *= 0x100000001b3ULL;
+  }
+  for (i = 0; i < len; i++) {
+    fp ^= p[i];
+    fp *= 0x100000001b3ULL;
+  }
+  return fp;
+}
+
+static uint64_t
+coap_dtls_fp_str(uint64_t fp, const char *s) {
+  return coap_dtls_fp_add(fp, s ? s : "", s ? strlen(s) + 1 : 0);
+}
+
+/* Only the file name, URI or ENGINE name of these definition types */
+static uint64_t
+coap_dtls_fp_define(uint64_t fp, coap_pki_define_t def,
+                    coap_const_char_ptr_t key, size_t len) {
+  fp = coap_dtls_fp_add(fp, &def, sizeof(def));
+  if (def == COAP_PKI_KEY_DEF_PEM || def == COAP_PKI_KEY_DEF_DER ||
+      def == COAP_PKI_KEY_DEF_PKCS11 || def == COAP_PKI_KEY_DEF_PKCS11_RPK ||
+      def == COAP_PKI_KEY_DEF_ENGINE)
+    return coap_dtls_fp_str(fp, key.s_byte);
+  return coap_dtls_fp_add(fp, key.u_byte, key.u_byte ? len : 0);
+}
+
+void
+coap_dtls_resume_setup_psk(coap_session_t *session) {
+  const coap_dtls_cpsk_t *setup = &session->cpsk_setup_data;
+  const coap_bin_const_t *key = session->psk_key ? session->psk_key :
+                                &setup->psk_info.key;
+  uint64_t fp = COAP_DTLS_FP_INIT;
+
+  fp = coap_dtls_fp_add(fp, key->s, key->length);
+  fp = coap_dtls_fp_add(fp, &setup->validate_ih_call_back,
+                        sizeof(setup->validate_ih_call_back));
+  fp = coap_dtls_fp_add(fp, &setup->ih_call_back_arg,
+                        sizeof(setup->ih_call_back_arg));
+  session->dtls_setup_fp = fp;
+}
+
+void
+coap_dtls_resume_setup_pki(coap_session_t *session,
+                           const coap_dtls_pki_t *setup_data) {
+  const coap_dtls_key_t *key = &setup_data->pki_key;
+  uint64_t fp = COAP_DTLS_FP_INIT;
+
+  /* verify_peer_cert up to and including use_cid */
+  fp = coap_dtls_fp_add(fp, &setup_data->verify_peer_cert,
+                        offsetof(coap_dtls_pki_t, reserved) -
+                        offsetof(coap_dtls_pki_t, verify_peer_cert));
+  fp = coap_dtls_fp_add(fp, &setup_data->validate_cn_call_back,
+                        sizeof(setup_data->validate_cn_call_back));
+  fp = coap_dtls_fp_add(fp, &setup_data->cn_call_back_arg,
+                        sizeof(setup_data->cn_call_back_arg));
+  fp = coap_dtls_fp_add(fp, &setup_data->additional_tls_setup_call_back,
+                        sizeof(setup_data->additional_tls_setup_call_back));
+  fp = coap_dtls_fp_add(fp, &key->key_type, sizeof(key->key_type));
+  if (key->key_type == COAP_PKI_KEY_PEM) {
+    fp = coap_dtls_fp_str(fp, key->key.pem.ca_file);
+    fp = coap_dtls_fp_str(fp, key->key.pem.public_cert);
+    fp = coap_dtls_fp_str(fp, key->key.pem.private_key);
+  } else if (key->key_type == COAP_PKI_KEY_PEM_BUF) {
+    fp = coap_dtls_fp_add(fp, key->key.pem_buf.ca_cert,
+                          key->key.pem_buf.ca_cert ?
+                          key->key.pem_buf.ca_cert_len : 0);
+    fp = coap_dtls_fp_add(fp, key->key.pem_buf.public_cert,
+                          key->key.pem_buf.public_cert ?
+                          key->key.pem_buf.public_cert_len : 0);
+    fp = coap_dtls_fp_add(fp, key->key.pem_buf.private_key,
+                          key->key.pem_buf.private_key ?
+                          key->key.pem_buf.private_key_len : 0);
+  } else if (key->key_type == COAP_PKI_KEY_ASN1) {
+    fp = coap_dtls_fp_add(fp, key->key.asn1.ca_cert,
+                          key->key.asn1.ca_cert ?
+                          key->key.asn1.ca_cert_len : 0);
+    fp = coap_dtls_fp_add(fp, key->key.asn1.public_cert,
+                          key->key.asn1.public_cert ?
+                          key->key.asn1.public_cert_len : 0);
+    fp = coap_dtls_fp_add(fp, key->key.asn1.private_key,
+                          key->key.asn1.private_key ?
+                          key->key.asn1.private_key_len : 0);
+  } else if (key->key_type == COAP_PKI_KEY_PKCS11) {
+    fp = coap_dtls_fp_str(fp, key->key.pkcs11.ca);
+    fp = coap_dtls_fp_str(fp, key->key.pkcs11.public_cert);
+    fp = coap_dtls_fp_str(fp, key->key.pkcs11.private_key);
+  } else if (key->key_type == COAP_PKI_KEY_DEFINE) {
+    fp = coap_dtls_fp_define(fp, key->key.define.ca_def, key->key.define.ca,
+                             key->key.define.ca_len);
+    fp = coap_dtls_fp_define(fp, key->key.define.public_cert_def,
+                             key->key.define.public_cert,
+                             key->key.define.public_cert_len);
+    fp = coap_dtls_fp_define(fp, key->key.define.private_key_def,
+                             key->key.define.private_key,
+                             key->key.define.private_key_len);
+  }
+  session->dtls_setup_fp = fp;
+}
+
+static coap_dtls_resume_t *
+coap_dtls_resume_lookup(coap_session_t *session, const char *sni) {
+  coap_dtls_resume_t *entry;
+  coap_bin_const_t lsni;
+  const coap_bin_const_t *identity =
+      &session->cpsk_setup_data.psk_info.identity;
+
+  lsni.s = (const uint8_t *)sni;
+  lsni.length = sni ? strlen(sni) : 0;
+  DL_FOREACH(session->context->dtls_resume, entry) {
+    if (entry->proto == session->proto &&
+        coap_address_equals(&entry->remote, &session->addr_info.remote) &&
+        coap_binary_equal(entry->sni, &lsni) &&
+        coap_binary_equal(entry->identity, identity) &&
+        entry->setup_fp == session->dtls_setup_fp)
+      return entry;
+  }
+  return NULL;
+}
+
+static void
+coap_dtls_resume_delete(coap_context_t *context, coap_dtls_resume_t *entry) {
+  DL_DELETE(context->dtls_resume, entry);
+  context->dtls_resume_count--;
+  entry->free_data(entry->data);
+  coap_delete_bin_const(entry->sni);
+  coap_delete_bin_const(entry->identity);
+  coap_free_type(COAP_STRING, entry);
+}
+
+void *
+coap_dtls_resume_find(coap_session_t *session, const char *sni) {
+  coap_context_t *context = session->context;
+  coap_dtls_resume_t *entry;
+
+  if (!context->resume_cache_size)
+    return NULL;
+  entry = coap_dtls_resume_lookup(session, sni);
+  if (!entry)
+    return NULL;
+  DL_DELETE(context->dtls_resume, entry);
+  DL_APPEND(context->dtls_resume, entry);
+  coap_log_debug("*  %s: offering to resume (D)TLS session\n",
+                 coap_session_str(session));
+  return entry->data;
+}
+
+void
+coap_dtls_resume_store(coap_session_t *session, const char *sni,
+                       void *data, void (*free_data)(void *data)) {
+  coap_context_t *context = session->context;
+  coap_dtls_resume_t *entry;
+  const coap_bin_const_t *identity =
+      &session->cpsk_setup_data.psk_info.identity;
+
+  if (!context->resume_cache_size) {
+    free_data(data);
+    return;
+  }
+  entry = coap_dtls_resume_lookup(session, sni);
+  if (entry) {
+    entry->free_data(entry->data);
+    DL_DELETE(context->dtls_resume, entry);
+  } else {
+    entry = coap_malloc_type(COAP_STRING, sizeof(coap_dtls_resume_t));
+    if (!entry) {
+      free_data(data);
+      return;
+    }
+    memset(entry, 0, sizeof(coap_dtls_resume_t));
+    entry->proto = session->proto;
+    coap_address_copy(&entry->remote, &session->addr_info.remote);
+    entry->setup_fp = session->dtls_setup_fp;
+    entry->sni = coap_new_bin_const((const uint8_t *)(sni ? sni : ""),
+                                    sni ? strlen(sni) : 0);
+    entry->identity = coap_new_bin_const(identity->length ? identity->s :
+                                         (const uint8_t *)"",
+                                         identity->length);
+    if (!entry->sni || !entry->identity) {
+      coap_delete_bin_const(entry->sni);
+      coap_delete_bin_const(entry->identity);
+      coap_free_type(COAP_STRING, entry);
+      free_data(data);
+      return;
+    }
+    context->dtls_resume_count++;
+  }
+  entry->data = data;
+  entry->free_data = free_data;
+  DL_APPEND(context->dtls_resume, entry);
+  coap_dtls_resume_trim(context);
+}
+
+void
+coap_dtls_resume_remove(coap_session_t *session, const char *sni) {
+  coap_dtls_resume_t *entry = coap_dtls_resume_lookup(session, sni);
+
+  if (entry)
+    coap_dtls_resume_delete(session->context, entry);
+}
+
+void
+coap_dtls_resume_trim(coap_context_t *context) {
+  while (context->dtls_resume_count > context->resume_cache_size)
+    coap_dtls_resume_delete(context, context->dtls_resume);
+}
+
+void
+coap_dtls_resume_free_all(coap_context_t *context) {
+  while (context->dtls_resume)
+    coap_dtls_resume_delete(context, context->dtls_resume);
+}
+#endif /* COAP_CLIENT_SUPPORT */
@@ -102,6 +102,8 @@ typedef struct coap_gnutls_env_t {
   int doing_dtls_timeout;
   coap_tick_t last_timeout;
   int sent_alert;
+  const char *resume_sni; /* SNI the client's held session is keyed on */
+  int resume_offered;     /* Set if the client offered a held session */
 } coap_gnutls_env_t;
 
 #define IS_PSK (1 << 0)
@@ -121,6 +123,17 @@ typedef struct psk_sni_entry {
   gnutls_psk_server_credentials_t psk_credentials;
 } psk_sni_entry;
 
+#if COAP_SERVER_SUPPORT
+/* A server session held for resumption by session ID */
+typedef struct coap_gnutls_db_entry_t {
+  UT_hash_handle hh;
+  coap_tick_t expires;
+  gnutls_datum_t data;
+  unsigned int key_len;
+  uint8_t key[GNUTLS_MAX_SESSION_ID_SIZE];
+} coap_gnutls_db_entry_t;
+#endif /* COAP_SERVER_SUPPORT */
+
 typedef struct coap_gnutls_context_t {
   coap_dtls_pki_t setup_data;
   int psk_pki_enabled;
@@ -132,6 +145,14 @@ typedef struct coap_gnutls_context_t {
   char *root_ca_file;
   char *root_ca_path;
   gnutls_priority_t priority_cache;
+#if COAP_SERVER_SUPPORT
+  unsigned int resume_cache_size; /* 0 if resumption disabled */
+  unsigned int resume_lifetime;
+  coap_gnutls_db_entry_t *db;     /* oldest first */
+  unsigned int db_count;
+  gnutls_datum_t ticket_key;
+  coap_tick_t ticket_key_time;
+#endif /* COAP_SERVER_SUPPORT */
 } coap_gnutls_context_t;
 
 typedef enum coap_free_bye_t {
@@ -498,6 +519,23 @@ coap_dtls_get_log_level(void) {
   return dtls_log_level;
 }
 
+#if COAP_SERVER_SUPPORT
+static void
+db_delete(coap_gnutls_context_t *g_context, coap_gnutls_db_entry_t *entry) {
+  HASH_DELETE(hh, g_context->db, entry);
+  g_context->db_count--;
+  gnutls_free(entry->data.data);
+  gnutls_free(entry);
+}
+
+/* Release the oldest held sessions until there are no more than max */
+static void
+db_trim(coap_gnutls_context_t *g_context, unsigned int max) {
+  while (g_context->db_count > max)
+    db_delete(g_context, g_context->db);
+}
+#endif /* COAP_SERVER_SUPPORT */
+
 /*
  * return +ve  new g_context
  *        NULL failure
@@ -573,6 +611,11 @@ coap_dtls_free_context(void *handle) {
 
   gnutls_priority_deinit(g_context->priority_cache);
 
+#if COAP_SERVER_SUPPORT
+  db_trim(g_context, 0);
+  gnutls_free(g_context->ticket_key.data);
+#endif /* COAP_SERVER_SUPPORT */
+
   gnutls_global_deinit();
   gnutls_free(g_context);
 }
@@ -1730,6 +1773,40 @@ fail:
 #endif /* COAP_SERVER_SUPPORT */
 
 #if COAP_CLIENT_SUPPORT
+static void
+free_resume_data(void *data) {
+  gnutls_datum_t *datum = (gnutls_datum_t *)data;
+
+  gnutls_free(datum->data);
+  gnutls_free(datum);
+}
+
+/*
+ * Hold the client's session so that a later session to the same server
+ * can resume it.
+ */
+static void
+hold_client_session(coap_session_t *c_session, coap_gnutls_env_t *g_env) {
+  gnutls_datum_t *datum;
+
+#if (GNUTLS_VERSION_NUMBER >= 0x030606)
+  /* A TLS1.3 session can only be resumed once a ticket has been received */
+  if (gnutls_protocol_get_version(g_env->g_session) == GNUTLS_TLS1_3 &&
+      !(gnutls_session_get_flags(g_env->g_session) &
+        GNUTLS_SFLAGS_SESSION_TICKET))
+    return;
+#endif /* GNUTLS_VERSION_NUMBER >= 0x030606 */
+  datum = gnutls_malloc(sizeof(gnutls_datum_t));
+  if (!datum)
+    return;
+  if (gnutls_session_get_data2(g_env->g_session, datum) < 0) {
+    gnutls_free(datum);
+    return;
+  }
+  coap_dtls_resume_store(c_session, g_env->resume_sni, datum,
+                         free_resume_data);
+}
+
 /*
  * return 0   Success (GNUTLS_E_SUCCESS)
  *        neg GNUTLS_E_* error code
@@ -1738,6 +1815,7 @@ static int
 setup_client_ssl_session(coap_session_t *c_session, coap_gnutls_env_t *g_env) {
   coap_gnutls_context_t *g_context =
       (coap_gnutls_context_t *)c_session->context->dtls_context;
+  gnutls_datum_t *resume_data;
   int ret;
 
   g_context->psk_pki_enabled |= IS_CLIENT;
@@ -1756,6 +1834,7 @@ setup_client_ssl_session(coap_session_t *c_session, coap_gnutls_env_t *g_env) {
                                      setup_data->client_sni,
                                      strlen(setup_data->client_sni)),
               "gnutls_server_name_set");
+      g_env->resume_sni = setup_data->client_sni;
     }
     if (setup_data->validate_ih_call_back) {
       const char *err;
@@ -1810,8 +1889,15 @@ setup_client_ssl_session(coap_session_t *c_session, coap_gnutls_env_t *g_env) {
                                      setup_data->client_sni,
                                      strlen(setup_data->client_sni)),
               "gnutls_server_name_set");
+      g_env->resume_sni = setup_data->client_sni;
     }
   }
+
+  resume_data = coap_dtls_resume_find(c_session, g_env->resume_sni);
+  if (resume_data &&
+      gnutls_session_set_data(g_env->g_session, resume_data->data,
+                              resume_data->size) == GNUTLS_E_SUCCESS)
+    g_env->resume_offered = 1;
   return GNUTLS_E_SUCCESS;
 
 fail:
@@ -1876,6 +1962,136 @@ psk_server_callback(gnutls_session_t g_session,
   return 0;
 }
 
+/*
+ * gnutls_db_store_func
+ *
+ * return 0   Success
+ *        -1  failed
+ */
+static int
+db_store(void *ptr, gnutls_datum_t key, gnutls_datum_t data) {
+  coap_gnutls_context_t *g_context = (coap_gnutls_context_t *)ptr;
+  coap_gnutls_db_entry_t *entry;
+  coap_tick_t now;
+
+  if (key.size > sizeof(entry->key))
+    return -1;
+  HASH_FIND(hh, g_context->db, key.data, key.size, entry);
+  if (entry)
+    db_delete(g_context, entry);
+
+  entry = gnutls_malloc(sizeof(coap_gnutls_db_entry_t));
+  if (!entry)
+    return -1;
+  memset(entry, 0, sizeof(coap_gnutls_db_entry_t));
+  entry->data.data = gnutls_malloc(data.size);
+  if (!entry->data.data) {
+    gnutls_free(entry);
+    return -1;
+  }
+  memcpy(entry->data.data, data.data, data.size);
+  entry->data.size = data.size;
+  memcpy(entry->key, key.data, key.size);
+  entry->key_len = key.size;
+  coap_ticks(&now);
+  entry->expires = now + g_context->resume_lifetime * COAP_TICKS_PER_SECOND;
+  HASH_ADD(hh, g_context->db, key, entry->key_len, entry);
+  g_context->db_count++;
+  db_trim(g_context, g_context->resume_cache_size);
+  return 0;
+}
+
+/*
+ * gnutls_db_retr_func
+ *
+ * return copy of the session data, empty if not found
+ */
+static gnutls_datum_t
+db_retrieve(void *ptr, gnutls_datum_t key) {
+  coap_gnutls_context_t *g_context = (coap_gnutls_context_t *)ptr;
+  coap_gnutls_db_entry_t *entry;
+  gnutls_datum_t data = { NULL, 0 };
+  coap_tick_t now;
+
+  HASH_FIND(hh, g_context->db, key.data, key.size, entry);
+  if (!entry)
+    return data;
+  coap_ticks(&now);
+  if (entry->expires <= now) {
+    db_delete(g_context, entry);
+    return data;
+  }
+  data.data = gnutls_malloc(entry->data.size);
+  if (data.data) {
+    memcpy(data.data, entry->data.data, entry->data.size);
+    data.size = entry->data.size;
+  }
+  return data;
+}
+
+/*
+ * gnutls_db_remove_func
+ *
+ * return 0   Success
+ *        -1  not found
+ */
+static int
+db_remove(void *ptr, gnutls_datum_t key) {
+  coap_gnutls_context_t *g_context = (coap_gnutls_context_t *)ptr;
+  coap_gnutls_db_entry_t *entry;
+
+  HASH_FIND(hh, g_context->db, key.data, key.size, entry);
+  if (!entry)
+    return -1;
+  db_delete(g_context, entry);
+  return 0;
+}
+
+/*
+ * Allow clients to resume sessions by session ID or by session ticket.
+ *
+ * return 0   Success (GNUTLS_E_SUCCESS)
+ *        neg GNUTLS_E_* error code
+ */
+static int
+setup_server_resumption(coap_gnutls_context_t *g_context,
+                        coap_gnutls_env_t *g_env) {
+  int ret;
+
+  if (g_context->ticket_key.data) {
+    coap_tick_t now;
+
+    coap_ticks(&now);
+#if (GNUTLS_VERSION_NUMBER < 0x030604)
+    /* Since 3.6.4 GnuTLS rotates the keys derived from ticket_key itself */
+    if (now - g_context->ticket_key_time >=
+        g_context->resume_lifetime * COAP_TICKS_PER_SECOND) {
+      gnutls_free(g_context->ticket_key.data);
+      g_context->ticket_key.data = NULL;
+    }
+#endif /* GNUTLS_VERSION_NUMBER < 0x030604 */
+  }
+  if (!g_context->ticket_key.data) {
+    G_CHECK(gnutls_session_ticket_key_generate(&g_context->ticket_key),
+            "gnutls_session_ticket_key_generate");
+    coap_ticks(&g_context->ticket_key_time);
+  }
+  G_CHECK(gnutls_session_ticket_enable_server(g_env->g_session,
+                                              &g_context->ticket_key),
+          "gnutls_session_ticket_enable_server");
+
+  gnutls_db_set_retrieve_function(g_env->g_session, db_retrieve);
+  gnutls_db_set_store_function(g_env->g_session, db_store);
+  gnutls_db_set_remove_function(g_env->g_session, db_remove);
+  gnutls_db_set_ptr(g_env->g_session, g_context);
+  gnutls_db_set_cache_expiration(g_env->g_session,
+                                 (int)g_context->resume_lifetime);
+  return GNUTLS_E_SUCCESS;
+
+fail:
+  return ret;
+}
+
 /*
  * return 0   Success (GNUTLS_E_SUCCESS)
  *        neg GNUTLS_E_* error code
@@ -1926,6 +2142,10 @@ setup_server_ssl_session(coap_session_t *c_session, coap_gnutls_env_t *g_env) {
                                    g_env->pki_credentials),
             "gnutls_credentials_set\n");
   }
+
+  if (g_context->resume_cache_size)
+    G_CHECK(setup_server_resumption(g_context, g_env),
+            "setup_server_resumption");
   return GNUTLS_E_SUCCESS;
 
 fail:
@@ -1933,6 +2153,21 @@ fail:
 }
 #endif /* COAP_SERVER_SUPPORT */
 
+int
+coap_dtls_context_set_resumption(coap_context_t *c_context) {
+#if COAP_SERVER_SUPPORT
+  coap_gnutls_context_t *g_context =
+      (coap_gnutls_context_t *)c_context->dtls_context;
+
+  g_context->resume_cache_size = c_context->resume_cache_size;
+  g_context->resume_lifetime = c_context->resume_lifetime;
+  db_trim(g_context, g_context->resume_cache_size);
+#else /* ! COAP_SERVER_SUPPORT */
+  (void)c_context;
+#endif /* ! COAP_SERVER_SUPPORT */
+  return 1;
+}
+
 /*
  * return +ve data amount
  *        0   no more
@@ -2201,6 +2436,13 @@ do_gnutls_handshake(coap_session_t *c_session, coap_gnutls_env_t *g_env) {
     g_env->established = 1;
     coap_log_debug("*  %s: GnuTLS established\n",
                    coap_session_str(c_session));
+    coap_dtls_handshake_done(c_session,
+                             gnutls_session_is_resumed(g_env->g_session));
+#if COAP_CLIENT_SUPPORT
+    if (c_session->type == COAP_SESSION_TYPE_CLIENT &&
+        c_session->context->resume_cache_size)
+      hold_client_session(c_session, g_env);
+#endif /* COAP_CLIENT_SUPPORT */
     ret = 1;
     break;
   case GNUTLS_E_INTERRUPTED:
@@ -2314,6 +2556,19 @@ coap_dtls_new_client_session(coap_session_t *c_session) {
 void
 coap_dtls_free_session(coap_session_t *c_session) {
   if (c_session && c_session->context && c_session->tls) {
+#if COAP_CLIENT_SUPPORT
+    coap_gnutls_env_t *g_env = (coap_gnutls_env_t *)c_session->tls;
+
+    if (c_session->type == COAP_SESSION_TYPE_CLIENT &&
+        c_session->context->resume_cache_size) {
+      if (g_env->established)
+        /* A TLS1.3 ticket may have arrived after the handshake */
+        hold_client_session(c_session, g_env);
+      else if (g_env->resume_offered)
+        /* Do not offer it again if it was the cause of the failure */
+        coap_dtls_resume_remove(c_session, g_env->resume_sni);
+    }
+#endif /* COAP_CLIENT_SUPPORT */
     coap_dtls_free_gnutls_env(c_session->context->dtls_context,
                               c_session->tls,
                               COAP_PROTO_NOT_RELIABLE(c_session->proto) ?
@@ -33,6 +33,9 @@
 #ifdef HAVE_NETINET_IN_H
 # include <netinet/in.h>
 #endif
+#if defined(HAVE_SENDMMSG) && defined(HAVE_NETINET_IN_H)
+# include <netinet/udp.h>
+#endif
 #ifdef HAVE_WS2TCPIP_H
 #include <ws2tcpip.h>
 # define OPTVAL_T(t)         (const char*)(t)
@@ -43,6 +46,9 @@
 #ifdef HAVE_SYS_UIO_H
 # include <sys/uio.h>
 #endif
+#ifdef HAVE_LINUX_FILTER_H
+# include <linux/filter.h>
+#endif
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
@@ -89,6 +95,98 @@ coap_mfree_endpoint(coap_endpoint_t *ep) {
 #if !defined(WITH_CONTIKI) && !defined(WITH_LWIP) && !defined(RIOT_VERSION)
 
 #if COAP_SERVER_SUPPORT
+#if COAP_REUSEPORT_SUPPORT
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+/*
+ * Classic BPF program that selects the socket in the SO_REUSEPORT group from
+ * a hash of the source address (IPv4, or IPv6 folded to 32 bits) of the
+ * incoming packet.
+ */
+static int
+coap_socket_attach_addr_steer(coap_socket_t *sock, unsigned int num_shards) {
+  struct sock_filter code[] = {
+    /* A = IP version */
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF + 0),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 2, 0),
+    /* IPv4 source address */
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+    BPF_JUMP(BPF_JMP | BPF_JA, 10, 0, 0),
+    /* IPv6 source address */
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 8),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 16),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    /* Socket index = (A * golden ratio) >> 16 mod num_shards */
+    BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9e3779b1),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, num_shards),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  struct sock_fprog prog;
+
+  prog.len = sizeof(code) / sizeof(code[0]);
+  prog.filter = code;
+  if (setsockopt(sock->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                 sizeof(prog)) == COAP_SOCKET_ERROR) {
+    coap_log_warn("coap_socket_steer_shard: setsockopt SO_ATTACH_REUSEPORT_CBPF: %s\n",
+                  coap_socket_strerror());
+    return 0;
+  }
+  return 1;
+}
+#endif /* HAVE_LINUX_FILTER_H && SO_ATTACH_REUSEPORT_CBPF */
+
+int
+coap_socket_set_shard(coap_socket_t *sock) {
+  coap_context_t *context = sock->endpoint ? sock->endpoint->context : NULL;
+  int on = 1;
+
+  if (!context || context->num_shards <= 1)
+    return 1;
+
+  if (setsockopt(sock->fd, SOL_SOCKET, SO_REUSEPORT, OPTVAL_T(&on),
+                 sizeof(on)) == COAP_SOCKET_ERROR) {
+    coap_log_warn("coap_socket_set_shard: setsockopt SO_REUSEPORT: %s\n",
+                  coap_socket_strerror());
+    return 0;
+  }
+  return 1;
+}
+
+int
+coap_socket_steer_shard(coap_socket_t *sock) {
+  coap_context_t *context = sock->endpoint ? sock->endpoint->context : NULL;
+
+  if (!context || context->num_shards <= 1)
+    return 1;
+
+  switch (context->shard_steer) {
+  case COAP_SHARD_STEER_ADDR:
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    /*
+     * The program is shared by the whole group. An index beyond the
+     * current number of sockets in the group (not all shards bound yet)
+     * falls back to the kernel hash.
+     */
+    return coap_socket_attach_addr_steer(sock, context->num_shards);
+#else /* ! HAVE_LINUX_FILTER_H || ! SO_ATTACH_REUSEPORT_CBPF */
+    return 0;
+#endif /* ! HAVE_LINUX_FILTER_H || ! SO_ATTACH_REUSEPORT_CBPF */
+  case COAP_SHARD_STEER_HASH:
+  default:
+    break;
+  }
+  return 1;
+}
+#endif /* COAP_REUSEPORT_SUPPORT */
+
 int
 coap_socket_bind_udp(coap_socket_t *sock,
                      const coap_address_t *listen_addr,
@@ -125,6 +223,11 @@ coap_socket_bind_udp(coap_socket_t *sock,
     coap_log_warn("coap_socket_bind_udp: setsockopt SO_REUSEADDR: %s\n",
                   coap_socket_strerror());
 
+#if COAP_REUSEPORT_SUPPORT
+  if (!coap_socket_set_shard(sock))
+    goto error;
+#endif /* COAP_REUSEPORT_SUPPORT */
+
   switch (listen_addr->addr.sa.sa_family) {
 #if COAP_IPV4_SUPPORT
   case AF_INET:
@@ -184,6 +287,10 @@ coap_socket_bind_udp(coap_socket_t *sock,
                   coap_socket_strerror());
     goto error;
   }
+#if COAP_REUSEPORT_SUPPORT
+  if (!coap_socket_steer_shard(sock))
+    goto error;
+#endif /* COAP_REUSEPORT_SUPPORT */
 #if defined(RIOT_VERSION) && defined(COAP_SERVER_SUPPORT)
   if (sock->endpoint &&
       bound_addr->addr.sa.sa_family == AF_INET6) {
@@ -776,15 +883,13 @@ static __declspec(thread) LPFN_WSARECVMSG lpWSARecvMsg = NULL;
 
 #if !defined(RIOT_VERSION) && !defined(WITH_LWIP) && !defined(WITH_CONTIKI)
 #if COAP_CLIENT_SUPPORT
-static uint32_t cid_track_counter;
-
 static void
 coap_test_cid_tuple_change(coap_session_t *session) {
   if (session->type == COAP_SESSION_TYPE_CLIENT &&
       session->negotiated_cid &&
       session->state == COAP_SESSION_STATE_ESTABLISHED &&
       session->proto == COAP_PROTO_DTLS && session->context->testing_cids) {
-    if ((++cid_track_counter) % session->context->testing_cids == 0) {
+    if ((++session->context->cid_track_counter) % session->context->testing_cids == 0) {
       coap_address_t local_if = session->addr_info.local;
       uint16_t port = coap_address_get_port(&local_if);
 
@@ -814,6 +919,129 @@ coap_test_cid_tuple_change(coap_session_t *session) {
 }
 #endif /* COAP_CLIENT_SUPPORT */
 
+#ifdef HAVE_STRUCT_CMSGHDR
+/*
+ * Set up the ancillary data in mhdr (using buf for storage) so that the
+ * datagram is sent from the session's local address and interface.
+ *
+ * return 1 success
+ *        0 protocol not supported
+ */
+static int
+coap_socket_send_pktinfo(coap_session_t *session, struct msghdr *mhdr,
+                         char *buf) {
+  if (!coap_address_isany(&session->addr_info.local) &&
+      !coap_is_mcast(&session->addr_info.local)) {
+    switch (session->addr_info.local.addr.sa.sa_family) {
+#if COAP_IPV6_SUPPORT
+    case AF_INET6: {
+      struct cmsghdr *cmsg;
+
+#if COAP_IPV4_SUPPORT
+      if (IN6_IS_ADDR_V4MAPPED(&session->addr_info.local.addr.sin6.sin6_addr)) {
+#if defined(IP_PKTINFO)
+        struct in_pktinfo *pktinfo;
+        mhdr->msg_control = buf;
+        mhdr->msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+
+        cmsg = CMSG_FIRSTHDR(mhdr);
+        cmsg->cmsg_level = COAP_SOL_IP;
+        cmsg->cmsg_type = IP_PKTINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+
+        pktinfo = (struct in_pktinfo *)CMSG_DATA(cmsg);
+
+        pktinfo->ipi_ifindex = session->ifindex;
+        memcpy(&pktinfo->ipi_spec_dst,
+               session->addr_info.local.addr.sin6.sin6_addr.s6_addr + 12,
+               sizeof(pktinfo->ipi_spec_dst));
+#elif defined(IP_SENDSRCADDR)
+        mhdr->msg_control = buf;
+        mhdr->msg_controllen = CMSG_SPACE(sizeof(struct in_addr));
+
+        cmsg = CMSG_FIRSTHDR(mhdr);
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type = IP_SENDSRCADDR;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
+
+        memcpy(CMSG_DATA(cmsg),
+               session->addr_info.local.addr.sin6.sin6_addr.s6_addr + 12,
+               sizeof(struct in_addr));
+#endif /* IP_PKTINFO */
+      } else {
+#endif /* COAP_IPV4_SUPPORT */
+        struct in6_pktinfo *pktinfo;
+        mhdr->msg_control = buf;
+        mhdr->msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
+
+        cmsg = CMSG_FIRSTHDR(mhdr);
+        cmsg->cmsg_level = IPPROTO_IPV6;
+        cmsg->cmsg_type = IPV6_PKTINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+
+        pktinfo = (struct in6_pktinfo *)CMSG_DATA(cmsg);
+
+        pktinfo->ipi6_ifindex = session->ifindex;
+        memcpy(&pktinfo->ipi6_addr,
+               &session->addr_info.local.addr.sin6.sin6_addr,
+               sizeof(pktinfo->ipi6_addr));
+#if COAP_IPV4_SUPPORT
+      }
+#endif /* COAP_IPV4_SUPPORT */
+      break;
+    }
+#endif /* COAP_IPV6_SUPPORT */
+#if COAP_IPV4_SUPPORT
+    case AF_INET: {
+#if defined(IP_PKTINFO)
+      struct cmsghdr *cmsg;
+      struct in_pktinfo *pktinfo;
+
+      mhdr->msg_control = buf;
+      mhdr->msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+
+      cmsg = CMSG_FIRSTHDR(mhdr);
+      cmsg->cmsg_level = COAP_SOL_IP;
+      cmsg->cmsg_type = IP_PKTINFO;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+
+      pktinfo = (struct in_pktinfo *)CMSG_DATA(cmsg);
+
+      pktinfo->ipi_ifindex = session->ifindex;
+      memcpy(&pktinfo->ipi_spec_dst,
+             &session->addr_info.local.addr.sin.sin_addr,
+             sizeof(pktinfo->ipi_spec_dst));
+#elif defined(IP_SENDSRCADDR)
+      struct cmsghdr *cmsg;
+      mhdr->msg_control = buf;
+      mhdr->msg_controllen = CMSG_SPACE(sizeof(struct in_addr));
+
+      cmsg = CMSG_FIRSTHDR(mhdr);
+      cmsg->cmsg_level = IPPROTO_IP;
+      cmsg->cmsg_type = IP_SENDSRCADDR;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
+
+      memcpy(CMSG_DATA(cmsg),
+             &session->addr_info.local.addr.sin.sin_addr,
+             sizeof(struct in_addr));
+#endif /* IP_PKTINFO */
+      break;
+    }
+#endif /* COAP_IPV4_SUPPORT */
+#if COAP_AF_UNIX_SUPPORT
+    case AF_UNIX:
+      break;
+#endif /* COAP_AF_UNIX_SUPPORT */
+    default:
+      /* error */
+      coap_log_warn("protocol not supported\n");
+      return 0;
+    }
+  }
+  return 1;
+}
+#endif /* HAVE_STRUCT_CMSGHDR */
+
 /*
  * dgram
  * return +ve Number of bytes written.
@@ -864,114 +1092,8 @@ coap_socket_send(coap_socket_t *sock, coap_session_t *session,
     mhdr.msg_iov = iov;
     mhdr.msg_iovlen = 1;
 
-    if (!coap_address_isany(&session->addr_info.local) &&
-        !coap_is_mcast(&session->addr_info.local)) {
-      switch (session->addr_info.local.addr.sa.sa_family) {
-#if COAP_IPV6_SUPPORT
-      case AF_INET6: {
-        struct cmsghdr *cmsg;
-
-#if COAP_IPV4_SUPPORT
-        if (IN6_IS_ADDR_V4MAPPED(&session->addr_info.local.addr.sin6.sin6_addr)) {
-#if defined(IP_PKTINFO)
-          struct in_pktinfo *pktinfo;
-          mhdr.msg_control = buf;
-          mhdr.msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
-
-          cmsg = CMSG_FIRSTHDR(&mhdr);
-          cmsg->cmsg_level = COAP_SOL_IP;
-          cmsg->cmsg_type = IP_PKTINFO;
-          cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
-
-          pktinfo = (struct in_pktinfo *)CMSG_DATA(cmsg);
-
-          pktinfo->ipi_ifindex = session->ifindex;
-          memcpy(&pktinfo->ipi_spec_dst,
-                 session->addr_info.local.addr.sin6.sin6_addr.s6_addr + 12,
-                 sizeof(pktinfo->ipi_spec_dst));
-#elif defined(IP_SENDSRCADDR)
-          mhdr.msg_control = buf;
-          mhdr.msg_controllen = CMSG_SPACE(sizeof(struct in_addr));
-
-          cmsg = CMSG_FIRSTHDR(&mhdr);
-          cmsg->cmsg_level = IPPROTO_IP;
-          cmsg->cmsg_type = IP_SENDSRCADDR;
-          cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
-
-          memcpy(CMSG_DATA(cmsg),
-                 session->addr_info.local.addr.sin6.sin6_addr.s6_addr + 12,
-                 sizeof(struct in_addr));
-#endif /* IP_PKTINFO */
-        } else {
-#endif /* COAP_IPV4_SUPPORT */
-          struct in6_pktinfo *pktinfo;
-          mhdr.msg_control = buf;
-          mhdr.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
-
-          cmsg = CMSG_FIRSTHDR(&mhdr);
-          cmsg->cmsg_level = IPPROTO_IPV6;
-          cmsg->cmsg_type = IPV6_PKTINFO;
-          cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
-
-          pktinfo = (struct in6_pktinfo *)CMSG_DATA(cmsg);
-
-          pktinfo->ipi6_ifindex = session->ifindex;
-          memcpy(&pktinfo->ipi6_addr,
-                 &session->addr_info.local.addr.sin6.sin6_addr,
-                 sizeof(pktinfo->ipi6_addr));
-#if COAP_IPV4_SUPPORT
-        }
-#endif /* COAP_IPV4_SUPPORT */
-        break;
-      }
-#endif /* COAP_IPV6_SUPPORT */
-#if COAP_IPV4_SUPPORT
-      case AF_INET: {
-#if defined(IP_PKTINFO)
-        struct cmsghdr *cmsg;
-        struct in_pktinfo *pktinfo;
-
-        mhdr.msg_control = buf;
-        mhdr.msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
-
-        cmsg = CMSG_FIRSTHDR(&mhdr);
-        cmsg->cmsg_level = COAP_SOL_IP;
-        cmsg->cmsg_type = IP_PKTINFO;
-        cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
-
-        pktinfo = (struct in_pktinfo *)CMSG_DATA(cmsg);
-
-        pktinfo->ipi_ifindex = session->ifindex;
-        memcpy(&pktinfo->ipi_spec_dst,
-               &session->addr_info.local.addr.sin.sin_addr,
-               sizeof(pktinfo->ipi_spec_dst));
-#elif defined(IP_SENDSRCADDR)
-        struct cmsghdr *cmsg;
-        mhdr.msg_control = buf;
-        mhdr.msg_controllen = CMSG_SPACE(sizeof(struct in_addr));
-
-        cmsg = CMSG_FIRSTHDR(&mhdr);
-        cmsg->cmsg_level = IPPROTO_IP;
-        cmsg->cmsg_type = IP_SENDSRCADDR;
-        cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
-
-        memcpy(CMSG_DATA(cmsg),
-               &session->addr_info.local.addr.sin.sin_addr,
-               sizeof(struct in_addr));
-#endif /* IP_PKTINFO */
-        break;
-      }
-#endif /* COAP_IPV4_SUPPORT */
-#if COAP_AF_UNIX_SUPPORT
-      case AF_UNIX:
-        break;
-#endif /* COAP_AF_UNIX_SUPPORT */
-      default:
-        /* error */
-        coap_log_warn("protocol not supported\n");
-        return -1;
-      }
-    }
+    if (!coap_socket_send_pktinfo(session, &mhdr, buf))
+      return -1;
 #endif /* HAVE_STRUCT_CMSGHDR */
 
 #if defined(_WIN32)
@@ -999,6 +1121,236 @@ coap_socket_send(coap_socket_t *sock, coap_session_t *session,
 
   return bytes_written;
 }
+
+#if COAP_SENDMMSG_SUPPORT && COAP_SERVER_SUPPORT
+/* The maximum number of segments and size of a single UDP GSO send */
+#define COAP_GSO_MAX_SEGMENTS 64
+#define COAP_GSO_MAX_BYTES 65000
+
+/* A buffer large enough to hold all packet info types, ipv6 is the largest */
+#define COAP_TX_PKTINFO_SPACE CMSG_SPACE(sizeof(struct in6_pktinfo))
+
+typedef struct coap_tx_dgram_t {
+  coap_address_t remote;        /**< Where the datagram is to be sent */
+  socklen_t namelen;            /**< Length of remote to use */
+  size_t controllen;            /**< Length of control data */
+  char control[COAP_TX_PKTINFO_SPACE]; /**< Local address ancillary data */
+  size_t length;                /**< Length of the datagram */
+} coap_tx_dgram_t;
+
+struct coap_tx_batch_t {
+  unsigned int max;             /**< Number of datagram slots */
+  unsigned int count;           /**< Number of datagrams queued */
+  int use_gso;                  /**< 1 if UDP GSO is to be tried */
+  coap_tx_dgram_t *dgram;       /**< max datagram descriptions */
+  uint8_t *data;                /**< max COAP_RXBUFFER_SIZE data slots */
+};
+
+static coap_tx_batch_t *
+coap_tx_batch_new(unsigned int max) {
+  coap_tx_batch_t *batch;
+
+  batch = coap_malloc_type(COAP_PACKET, sizeof(coap_tx_batch_t) +
+                           max * (sizeof(coap_tx_dgram_t) + COAP_RXBUFFER_SIZE));
+  if (batch == NULL)
+    return NULL;
+  batch->max = max;
+  batch->count = 0;
+#if defined(UDP_SEGMENT)
+  batch->use_gso = 1;
+#else /* ! UDP_SEGMENT */
+  batch->use_gso = 0;
+#endif /* ! UDP_SEGMENT */
+  batch->dgram = (coap_tx_dgram_t *)(batch + 1);
+  batch->data = (uint8_t *)&batch->dgram[max];
+  return batch;
+}
+
+/*
+ * Check whether the two datagrams can be sent as segments of the
+ * same UDP GSO send.
+ */
+static int
+coap_tx_dgram_same_path(const coap_tx_dgram_t *a, const coap_tx_dgram_t *b) {
+  return a->namelen == b->namelen &&
+         a->controllen == b->controllen &&
+         memcmp(&a->remote.addr, &b->remote.addr, a->namelen) == 0 &&
+         memcmp(a->control, b->control, a->controllen) == 0;
+}
+
+void
+coap_socket_send_flush(coap_endpoint_t *endpoint) {
+  coap_tx_batch_t *batch = endpoint->tx_batch;
+  coap_context_t *ctx = endpoint->context;
+#if COAP_CONSTRAINED_STACK
+  static COAP_THREAD_LOCAL struct mmsghdr mmsg[COAP_TX_BATCH_MAX];
+  static COAP_THREAD_LOCAL struct iovec iov[COAP_TX_BATCH_MAX];
+  static COAP_THREAD_LOCAL unsigned int nsegs[COAP_TX_BATCH_MAX];
+  static COAP_THREAD_LOCAL char control[COAP_TX_BATCH_MAX][COAP_TX_PKTINFO_SPACE +
+                                         CMSG_SPACE(sizeof(uint16_t))];
+#else /* ! COAP_CONSTRAINED_STACK */
+  struct mmsghdr mmsg[COAP_TX_BATCH_MAX];
+  struct iovec iov[COAP_TX_BATCH_MAX];
+  unsigned int nsegs[COAP_TX_BATCH_MAX];
+  char control[COAP_TX_BATCH_MAX][COAP_TX_PKTINFO_SPACE +
+                                  CMSG_SPACE(sizeof(uint16_t))];
+#endif /* ! COAP_CONSTRAINED_STACK */
+  unsigned int done = 0;
+
+  if (batch == NULL || batch->count == 0)
+    return;
+
+  while (done < batch->count) {
+    unsigned int nmsg = 0;
+    unsigned int i = done;
+    unsigned int k;
+    int num;
+
+    /* Build up the messages, coalescing datagrams for the same peer */
+    while (i < batch->count) {
+      coap_tx_dgram_t *dgram = &batch->dgram[i];
+      struct msghdr *mhdr = &mmsg[nmsg].msg_hdr;
+      size_t total = dgram->length;
+      unsigned int nseg = 1;
+
+      iov[i].iov_base = batch->data + i * COAP_RXBUFFER_SIZE;
+      iov[i].iov_len = dgram->length;
+      while (batch->use_gso && i + nseg < batch->count &&
+             nseg < COAP_GSO_MAX_SEGMENTS) {
+        coap_tx_dgram_t *next = &batch->dgram[i + nseg];
+
+        if (next->length > dgram->length ||
+            total + next->length > COAP_GSO_MAX_BYTES ||
+            !coap_tx_dgram_same_path(dgram, next))
+          break;
+        iov[i + nseg].iov_base = batch->data + (i + nseg) * COAP_RXBUFFER_SIZE;
+        iov[i + nseg].iov_len = next->length;
+        total += next->length;
+        nseg++;
+        /* A shorter segment has to be the last one */
+        if (next->length < dgram->length)
+          break;
+      }
+
+      memset(mhdr, 0, sizeof(*mhdr));
+      mhdr->msg_name = &dgram->remote.addr;
+      mhdr->msg_namelen = dgram->namelen;
+      mhdr->msg_iov = &iov[i];
+      mhdr->msg_iovlen = nseg;
+      if (dgram->controllen) {
+        memcpy(control[nmsg], dgram->control, dgram->controllen);
+        mhdr->msg_control = control[nmsg];
+        mhdr->msg_controllen = dgram->controllen;
+      }
+#if defined(UDP_SEGMENT)
+      if (nseg > 1) {
+        struct cmsghdr *cmsg;
+        uint16_t gso_size = (uint16_t)dgram->length;
+
+        mhdr->msg_control = control[nmsg];
+        if (mhdr->msg_controllen) {
+          mhdr->msg_controllen += CMSG_SPACE(sizeof(uint16_t));
+          cmsg = CMSG_NXTHDR(mhdr, CMSG_FIRSTHDR(mhdr));
+        } else {
+          mhdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+          cmsg = CMSG_FIRSTHDR(mhdr);
+        }
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+      }
+#endif /* UDP_SEGMENT */
+      nsegs[nmsg++] = nseg;
+      i += nseg;
+    }
+
+    num = sendmmsg(endpoint->sock.fd, mmsg, nmsg, 0);
+    ctx->tx_syscalls++;
+    if (num <= 0) {
+      if (nsegs[0] > 1 && (errno == EIO || errno == EINVAL ||
+                           errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+        /* Kernel or interface does not support UDP GSO - so do without */
+        coap_log_debug("*  %s: UDP GSO not supported (%s)\n",
+                       coap_endpoint_str(endpoint), coap_socket_strerror());
+        batch->use_gso = 0;
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        coap_log_warn("*  %s: coap_socket_send_flush: %u datagrams dropped: %s\n",
+                      coap_endpoint_str(endpoint), batch->count - done,
+                      coap_socket_strerror());
+        break;
+      }
+      coap_log_crit("coap_socket_send_flush: %s\n", coap_socket_strerror());
+      /* Skip over the failing message */
+      done += nsegs[0];
+      continue;
+    }
+    for (k = 0; k < (unsigned int)num; k++) {
+      done += nsegs[k];
+      ctx->tx_packets += nsegs[k];
+    }
+  }
+  batch->count = 0;
+}
+
+ssize_t
+coap_socket_send_queue(coap_endpoint_t *endpoint, coap_session_t *session,
+                       const uint8_t *data, size_t datalen) {
+  coap_context_t *ctx = endpoint->context;
+  coap_tx_batch_t *batch = endpoint->tx_batch;
+  coap_tx_dgram_t *dgram;
+  struct msghdr mhdr;
+
+  assert(session);
+
+  if (!coap_debug_send_packet())
+    return (ssize_t)datalen;
+
+  if (datalen > COAP_RXBUFFER_SIZE) {
+    /* Too large for a slot, but the datagrams have to be kept in order */
+    coap_socket_send_flush(endpoint);
+    return coap_socket_send(&endpoint->sock, session, data, datalen);
+  }
+  if (batch == NULL || batch->max != ctx->tx_batch_size) {
+    coap_socket_send_queue_free(endpoint);
+    batch = coap_tx_batch_new(ctx->tx_batch_size);
+    if (batch == NULL)
+      return coap_socket_send(&endpoint->sock, session, data, datalen);
+    endpoint->tx_batch = batch;
+  }
+  if (batch->count == batch->max)
+    coap_socket_send_flush(endpoint);
+
+  dgram = &batch->dgram[batch->count];
+  memset(dgram->control, 0, sizeof(dgram->control));
+  memset(&mhdr, 0, sizeof(mhdr));
+  if (!coap_socket_send_pktinfo(session, &mhdr, dgram->control))
+    return -1;
+  dgram->controllen = mhdr.msg_controllen;
+  coap_address_copy(&dgram->remote, &session->addr_info.remote);
+  dgram->namelen = session->addr_info.remote.addr.sa.sa_family == AF_INET ?
+                   (socklen_t)sizeof(struct sockaddr_in) :
+                   session->addr_info.remote.size;
+  memcpy(batch->data + batch->count * COAP_RXBUFFER_SIZE, data, datalen);
+  dgram->length = datalen;
+  batch->count++;
+  return (ssize_t)datalen;
+}
+
+void
+coap_socket_send_queue_free(coap_endpoint_t *endpoint) {
+  if (endpoint->tx_batch) {
+    if (endpoint->tx_batch->count) {
+      coap_log_debug("*  %s: %u queued datagrams discarded\n",
+                     coap_endpoint_str(endpoint), endpoint->tx_batch->count);
+    }
+    coap_free_type(COAP_PACKET, endpoint->tx_batch);
+    endpoint->tx_batch = NULL;
+  }
+}
+#endif /* COAP_SENDMMSG_SUPPORT && COAP_SERVER_SUPPORT */
 #endif /* ! RIOT_VERSION && ! WITH_LWIP && ! WITH_CONTIKI */
 
 #define SIN6(A) ((struct sockaddr_in6 *)(A))
@@ -1010,6 +1362,95 @@ coap_packet_get_memmapped(coap_packet_t *packet, unsigned char **address, size_t
 }
 
 #if !defined(WITH_LWIP) && !defined(WITH_CONTIKI) && !defined(RIOT_VERSION)
+#ifdef HAVE_STRUCT_CMSGHDR
+/*
+ * Walk through the ancillary data of a received datagram to determine the
+ * local address and interface the datagram was received on.
+ */
+static void
+coap_socket_recv_local_addr(coap_socket_t *sock, struct msghdr *mhdr,
+                            coap_packet_t *packet) {
+  struct cmsghdr *cmsg;
+  int dst_found = 0;
+
+  /* Walk through ancillary data records until the local interface
+   * is found where the data was received. */
+  for (cmsg = CMSG_FIRSTHDR(mhdr); cmsg; cmsg = CMSG_NXTHDR(mhdr, cmsg)) {
+
+#if COAP_IPV6_SUPPORT
+    /* get the local interface for IPv6 */
+    if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
+      union {
+        uint8_t *c;
+        struct in6_pktinfo *p;
+      } u;
+      u.c = CMSG_DATA(cmsg);
+      packet->ifindex = (int)(u.p->ipi6_ifindex);
+      memcpy(&packet->addr_info.local.addr.sin6.sin6_addr,
+             &u.p->ipi6_addr, sizeof(struct in6_addr));
+      dst_found = 1;
+      break;
+    }
+#endif /* COAP_IPV6_SUPPORT */
+
+#if COAP_IPV4_SUPPORT
+    /* local interface for IPv4 */
+#if defined(IP_PKTINFO)
+    if (cmsg->cmsg_level == COAP_SOL_IP && cmsg->cmsg_type == IP_PKTINFO) {
+      union {
+        uint8_t *c;
+        struct in_pktinfo *p;
+      } u;
+      u.c = CMSG_DATA(cmsg);
+      packet->ifindex = u.p->ipi_ifindex;
+#if COAP_IPV6_SUPPORT
+      if (packet->addr_info.local.addr.sa.sa_family == AF_INET6) {
+        memset(packet->addr_info.local.addr.sin6.sin6_addr.s6_addr, 0, 10);
+        packet->addr_info.local.addr.sin6.sin6_addr.s6_addr[10] = 0xff;
+        packet->addr_info.local.addr.sin6.sin6_addr.s6_addr[11] = 0xff;
+        memcpy(packet->addr_info.local.addr.sin6.sin6_addr.s6_addr + 12,
+               &u.p->ipi_addr, sizeof(struct in_addr));
+      } else
+#endif /* COAP_IPV6_SUPPORT */
+      {
+        memcpy(&packet->addr_info.local.addr.sin.sin_addr,
+               &u.p->ipi_addr, sizeof(struct in_addr));
+      }
+      dst_found = 1;
+      break;
+    }
+#endif /* IP_PKTINFO */
+#if defined(IP_RECVDSTADDR)
+    if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVDSTADDR) {
+      packet->ifindex = (int)sock->fd;
+      memcpy(&packet->addr_info.local.addr.sin.sin_addr,
+             CMSG_DATA(cmsg), sizeof(struct in_addr));
+      dst_found = 1;
+      break;
+    }
+#endif /* IP_RECVDSTADDR */
+#endif /* COAP_IPV4_SUPPORT */
+    if (!dst_found) {
+      /* cmsg_level / cmsg_type combination we do not understand
+         (ignore preset case for bad recvmsg() not updating cmsg) */
+      if (cmsg->cmsg_level != -1 && cmsg->cmsg_type != -1) {
+        coap_log_debug("cmsg_level = %d and cmsg_type = %d not supported - fix\n",
+                       cmsg->cmsg_level, cmsg->cmsg_type);
+      }
+    }
+  }
+  if (!dst_found) {
+    /* Not expected, but cmsg_level and cmsg_type don't match above and
+       may need a new case */
+    packet->ifindex = (int)sock->fd;
+    if (getsockname(sock->fd, &packet->addr_info.local.addr.sa,
+                    &packet->addr_info.local.size) < 0) {
+      coap_log_debug("Cannot determine local port\n");
+    }
+  }
+}
+#endif /* HAVE_STRUCT_CMSGHDR */
+
 /*
  * dgram
  * return +ve Number of bytes written.
@@ -1138,86 +1579,9 @@ coap_socket_recv(coap_socket_t *sock, coap_packet_t *packet) {
       goto error;
     } else {
 #ifdef HAVE_STRUCT_CMSGHDR
-      int dst_found = 0;
-
       packet->addr_info.remote.size = mhdr.msg_namelen;
       packet->length = (size_t)len;
-
-      /* Walk through ancillary data records until the local interface
-       * is found where the data was received. */
-      for (cmsg = CMSG_FIRSTHDR(&mhdr); cmsg; cmsg = CMSG_NXTHDR(&mhdr, cmsg)) {
-
-#if COAP_IPV6_SUPPORT
-        /* get the local interface for IPv6 */
-        if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-          union {
-            uint8_t *c;
-            struct in6_pktinfo *p;
-          } u;
-          u.c = CMSG_DATA(cmsg);
-          packet->ifindex = (int)(u.p->ipi6_ifindex);
-          memcpy(&packet->addr_info.local.addr.sin6.sin6_addr,
-                 &u.p->ipi6_addr, sizeof(struct in6_addr));
-          dst_found = 1;
-          break;
-        }
-#endif /* COAP_IPV6_SUPPORT */
-
-#if COAP_IPV4_SUPPORT
-        /* local interface for IPv4 */
-#if defined(IP_PKTINFO)
-        if (cmsg->cmsg_level == COAP_SOL_IP && cmsg->cmsg_type == IP_PKTINFO) {
-          union {
-            uint8_t *c;
-            struct in_pktinfo *p;
-          } u;
-          u.c = CMSG_DATA(cmsg);
-          packet->ifindex = u.p->ipi_ifindex;
-#if COAP_IPV6_SUPPORT
-          if (packet->addr_info.local.addr.sa.sa_family == AF_INET6) {
-            memset(packet->addr_info.local.addr.sin6.sin6_addr.s6_addr, 0, 10);
-            packet->addr_info.local.addr.sin6.sin6_addr.s6_addr[10] = 0xff;
-            packet->addr_info.local.addr.sin6.sin6_addr.s6_addr[11] = 0xff;
-            memcpy(packet->addr_info.local.addr.sin6.sin6_addr.s6_addr + 12,
-                   &u.p->ipi_addr, sizeof(struct in_addr));
-          } else
-#endif /* COAP_IPV6_SUPPORT */
-          {
-            memcpy(&packet->addr_info.local.addr.sin.sin_addr,
-                   &u.p->ipi_addr, sizeof(struct in_addr));
-          }
-          dst_found = 1;
-          break;
-        }
-#endif /* IP_PKTINFO */
-#if defined(IP_RECVDSTADDR)
-        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVDSTADDR) {
-          packet->ifindex = (int)sock->fd;
-          memcpy(&packet->addr_info.local.addr.sin.sin_addr,
-                 CMSG_DATA(cmsg), sizeof(struct in_addr));
-          dst_found = 1;
-          break;
-        }
-#endif /* IP_RECVDSTADDR */
-#endif /* COAP_IPV4_SUPPORT */
-        if (!dst_found) {
-          /* cmsg_level / cmsg_type combination we do not understand
-             (ignore preset case for bad recvmsg() not updating cmsg) */
-          if (cmsg->cmsg_level != -1 && cmsg->cmsg_type != -1) {
-            coap_log_debug("cmsg_level = %d and cmsg_type = %d not supported - fix\n",
-                           cmsg->cmsg_level, cmsg->cmsg_type);
-          }
-        }
-      }
-      if (!dst_found) {
-        /* Not expected, but cmsg_level and cmsg_type don't match above and
-           may need a new case */
-        packet->ifindex = (int)sock->fd;
-        if (getsockname(sock->fd, &packet->addr_info.local.addr.sa,
-                        &packet->addr_info.local.size) < 0) {
-          coap_log_debug("Cannot determine local port\n");
-        }
-      }
+      coap_socket_recv_local_addr(sock, &mhdr, packet);
 #else /* ! HAVE_STRUCT_CMSGHDR */
       packet->length = (size_t)len;
       packet->ifindex = 0;
@@ -1235,8 +1599,106 @@ coap_socket_recv(coap_socket_t *sock, coap_packet_t *packet) {
 error:
   return -1;
 }
+
+#if COAP_RECVMMSG_SUPPORT
+/*
+ * dgram
+ * return +ve Number of packets read.
+ *          0 Nothing read or ICMP error response
+ *         -1 Error error in errno).
+ */
+int
+coap_socket_recv_batch(coap_socket_t *sock, coap_packet_t *packets,
+                       unsigned int count) {
+  /* a buffer large enough to hold all packet info types, ipv6 is the largest */
+  typedef char cmsg_buf_t[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+#if COAP_CONSTRAINED_STACK
+  static COAP_THREAD_LOCAL struct mmsghdr mmsg[COAP_RX_BATCH_MAX];
+  static COAP_THREAD_LOCAL struct iovec iov[COAP_RX_BATCH_MAX];
+  static COAP_THREAD_LOCAL cmsg_buf_t buf[COAP_RX_BATCH_MAX];
+#else /* ! COAP_CONSTRAINED_STACK */
+  struct mmsghdr mmsg[COAP_RX_BATCH_MAX];
+  struct iovec iov[COAP_RX_BATCH_MAX];
+  cmsg_buf_t buf[COAP_RX_BATCH_MAX];
+#endif /* ! COAP_CONSTRAINED_STACK */
+  struct cmsghdr *cmsg;
+  unsigned int i;
+  int num;
+
+  assert(sock);
+  assert(packets);
+  assert(!(sock->flags & COAP_SOCKET_CONNECTED));
+
+  if ((sock->flags & COAP_SOCKET_CAN_READ) == 0) {
+    return -1;
+  } else {
+    /* clear has-data flag */
+    sock->flags &= ~COAP_SOCKET_CAN_READ;
+  }
+
+  if (count > COAP_RX_BATCH_MAX)
+    count = COAP_RX_BATCH_MAX;
+
+  memset(mmsg, 0, count * sizeof(mmsg[0]));
+  for (i = 0; i < count; i++) {
+    iov[i].iov_base = packets[i].payload;
+    iov[i].iov_len = COAP_RXBUFFER_SIZE;
+
+    mmsg[i].msg_hdr.msg_name = (struct sockaddr *)&packets[i].addr_info.remote.addr;
+    mmsg[i].msg_hdr.msg_namelen = sizeof(packets[i].addr_info.remote.addr);
+    mmsg[i].msg_hdr.msg_iov = &iov[i];
+    mmsg[i].msg_hdr.msg_iovlen = 1;
+    mmsg[i].msg_hdr.msg_control = buf[i];
+    mmsg[i].msg_hdr.msg_controllen = sizeof(buf[i]);
+    /* preset the first cmsg with bad data (see coap_socket_recv()) */
+    cmsg = (struct cmsghdr *)buf[i];
+    cmsg->cmsg_len = CMSG_LEN(sizeof(buf[i]));
+    cmsg->cmsg_level = -1;
+    cmsg->cmsg_type = -1;
+  }
+
+  num = recvmmsg(sock->fd, mmsg, count, MSG_DONTWAIT, NULL);
+  if (num < 0) {
+    if (errno == ECONNREFUSED || errno == EHOSTUNREACH || errno == ECONNRESET) {
+      /* server-side ICMP destination unreachable, ignore it. */
+      coap_log_warn("** %s: coap_socket_recv_batch: ICMP: %s\n",
+                    sock->session ?
+                    coap_session_str(sock->session) : "",
+                    coap_socket_strerror());
+      return 0;
+    }
+    if (errno != EAGAIN) {
+      coap_log_warn("coap_socket_recv_batch: %s\n", coap_socket_strerror());
+    }
+    return -1;
+  }
+
+  for (i = 0; i < (unsigned int)num; i++) {
+    packets[i].addr_info.remote.size = mmsg[i].msg_hdr.msg_namelen;
+    packets[i].length = (size_t)mmsg[i].msg_len;
+    coap_socket_recv_local_addr(sock, &mmsg[i].msg_hdr, &packets[i]);
+  }
+  return num;
+}
+#endif /* COAP_RECVMMSG_SUPPORT */
 #endif /* ! WITH_LWIP && ! WITH_CONTIKI && ! RIOT_VERSION */
 
+void
+coap_io_flush_send_lkd(coap_context_t *context) {
+#if COAP_SENDMMSG_SUPPORT && COAP_SERVER_SUPPORT
+  coap_endpoint_t *ep;
+
+  coap_lock_check_locked(context);
+  LL_FOREACH(context->endpoint, ep) {
+    coap_socket_send_flush(ep);
+    if (context->tx_batch_size <= 1)
+      coap_socket_send_queue_free(ep);
+  }
+#else /* ! (COAP_SENDMMSG_SUPPORT && COAP_SERVER_SUPPORT) */
+  (void)context;
+#endif /* ! (COAP_SENDMMSG_SUPPORT && COAP_SERVER_SUPPORT) */
+}
+
 COAP_API unsigned int
 coap_io_prepare_epoll(coap_context_t *ctx, coap_tick_t now) {
   unsigned int ret;
@@ -1294,6 +1756,212 @@ coap_io_prepare_epoll_lkd(coap_context_t *ctx, coap_tick_t now) {
 #endif /* COAP_EPOLL_SUPPORT */
 }
 
+#if COAP_SERVER_SUPPORT
+/*
+ * Checks the timers of server session s, freeing s if it has been idle for
+ * too long.
+ *
+ * return  0 Session has been freed
+ *         1 Session still exists, *next updated with when the timers need
+ *           checking again (0 if nothing pending)
+ */
+static int
+coap_io_check_server_session(coap_context_t *ctx, coap_session_t *s,
+                             coap_tick_t now, int check_dtls_timeouts,
+                             coap_tick_t *next) {
+  coap_tick_t timeout = 0;
+  coap_tick_t s_timeout;
+  coap_tick_t session_timeout;
+
+  if (ctx->session_timeout > 0)
+    session_timeout = ctx->session_timeout * COAP_TICKS_PER_SECOND;
+  else
+    session_timeout = COAP_DEFAULT_SESSION_TIMEOUT * COAP_TICKS_PER_SECOND;
+
+  /* Check whether the idle server session should be released */
+  if (s->type == COAP_SESSION_TYPE_SERVER && s->ref == 0 &&
+      s->delayqueue == NULL &&
+      (s->last_rx_tx + session_timeout <= now ||
+       s->state == COAP_SESSION_STATE_NONE)) {
+    coap_handle_event_lkd(ctx, COAP_EVENT_SERVER_SESSION_DEL, s);
+    coap_session_free(s);
+    return 0;
+  }
+  /* Make sure the session object is not deleted in any callbacks */
+  coap_session_reference_lkd(s);
+  /* Check any DTLS timeouts and expire if appropriate */
+  if (check_dtls_timeouts && s->state == COAP_SESSION_STATE_HANDSHAKE &&
+      s->proto == COAP_PROTO_DTLS && s->tls) {
+    coap_tick_t tls_timeout = coap_dtls_get_timeout(s, now);
+    while (tls_timeout > 0 && tls_timeout <= now) {
+      coap_log_debug("** %s: DTLS retransmit timeout\n",
+                     coap_session_str(s));
+      if (coap_dtls_handle_timeout(s))
+        goto release;
+
+      if (s->tls)
+        tls_timeout = coap_dtls_get_timeout(s, now);
+      else {
+        tls_timeout = 0;
+        timeout = 1;
+      }
+    }
+    if (tls_timeout > 0 && (timeout == 0 || tls_timeout - now < timeout))
+      timeout = tls_timeout - now;
+  }
+  /* Check if any server large receives are missing blocks */
+  if (s->lg_srcv) {
+    if (coap_block_check_lg_srcv_timeouts(s, now, &s_timeout)) {
+      if (timeout == 0 || s_timeout < timeout)
+        timeout = s_timeout;
+    }
+  }
+  /* Check if any server large sending have timed out */
+  if (s->lg_xmit) {
+    if (coap_block_check_lg_xmit_timeouts(s, now, &s_timeout)) {
+      if (timeout == 0 || s_timeout < timeout)
+        timeout = s_timeout;
+    }
+  }
+#if COAP_Q_BLOCK_SUPPORT
+  /*
+   * Check if any server large transmits have hit MAX_PAYLOAD and need
+   * restarting
+   */
+  if (s->lg_xmit) {
+    s_timeout = coap_block_check_q_block2_xmit(s, now);
+    if (timeout == 0 || s_timeout < timeout)
+      timeout = s_timeout;
+  }
+#endif /* COAP_Q_BLOCK_SUPPORT */
+release:
+  coap_session_release_lkd(s);
+
+  /* When an unused session is to be released */
+  if (s->type == COAP_SESSION_TYPE_SERVER && s->ref == 0 &&
+      s->delayqueue == NULL) {
+    if (s->state == COAP_SESSION_STATE_NONE ||
+        s->last_rx_tx + session_timeout <= now)
+      s_timeout = 1;
+    else
+      s_timeout = (s->last_rx_tx + session_timeout) - now;
+    if (timeout == 0 || s_timeout < timeout)
+      timeout = s_timeout;
+  }
+  *next = timeout ? now + timeout : 0;
+  return 1;
+}
+#endif /* COAP_SERVER_SUPPORT */
+
+#if COAP_CLIENT_SUPPORT
+/*
+ * Checks the timers of client session s, sending a keepalive ping if needed.
+ *
+ * return  0 Session has gone away
+ *         1 Session still exists, *next updated with when the timers need
+ *           checking again (0 if nothing pending)
+ */
+static int
+coap_io_check_client_session(coap_context_t *ctx, coap_session_t *s,
+                             coap_tick_t now, coap_tick_t *next) {
+  coap_tick_t timeout = 0;
+  coap_tick_t s_timeout;
+
+  /* Make sure the session object is not deleted in any callbacks */
+  coap_session_reference_lkd(s);
+  if (s->state == COAP_SESSION_STATE_ESTABLISHED &&
+      ctx->ping_timeout > 0) {
+    if (s->last_rx_tx + ctx->ping_timeout * COAP_TICKS_PER_SECOND <= now) {
+      /* Time to send a ping */
+      if ((s->last_ping_mid = coap_session_send_ping_lkd(s)) == COAP_INVALID_MID)
+        /* Some issue - not safe to continue processing */
+        goto release;
+      if (s->last_ping > 0 && s->last_pong < s->last_ping) {
+        coap_handle_event_lkd(s->context, COAP_EVENT_KEEPALIVE_FAILURE, s);
+      }
+      s->last_rx_tx = now;
+      s->last_ping = now;
+    }
+    s_timeout = (s->last_rx_tx + ctx->ping_timeout * COAP_TICKS_PER_SECOND) - now;
+    if (timeout == 0 || s_timeout < timeout)
+      timeout = s_timeout;
+  }
+
+#if !COAP_DISABLE_TCP
+  if (COAP_PROTO_RELIABLE(s->proto) &&
+      s->state == COAP_SESSION_STATE_CSM && ctx->csm_timeout_ms > 0) {
+    if (s->csm_tx == 0) {
+      s->csm_tx = now;
+      s_timeout = (ctx->csm_timeout_ms * COAP_TICKS_PER_SECOND) / 1000;
+    } else if (s->csm_tx + (ctx->csm_timeout_ms * COAP_TICKS_PER_SECOND) / 1000 <= now) {
+      /* timed out */
+      s_timeout = 0;
+    } else {
+      s_timeout = (s->csm_tx + (ctx->csm_timeout_ms * COAP_TICKS_PER_SECOND) / 1000) - now;
+    }
+    if ((timeout == 0 || s_timeout < timeout) && s_timeout != 0)
+      timeout = s_timeout;
+  }
+#endif /* !COAP_DISABLE_TCP */
+
+  /* Check any DTLS timeouts and expire if appropriate */
+  if (s->state == COAP_SESSION_STATE_HANDSHAKE &&
+      s->proto == COAP_PROTO_DTLS && s->tls) {
+    coap_tick_t tls_timeout = coap_dtls_get_timeout(s, now);
+    while (tls_timeout > 0 && tls_timeout <= now) {
+      coap_log_debug("** %s: DTLS retransmit timeout\n", coap_session_str(s));
+      if (coap_dtls_handle_timeout(s))
+        goto release;
+
+      if (s->tls)
+        tls_timeout = coap_dtls_get_timeout(s, now);
+      else {
+        tls_timeout = 0;
+        timeout = 1;
+      }
+    }
+    if (tls_timeout > 0 && (timeout == 0 || tls_timeout - now < timeout))
+      timeout = tls_timeout - now;
+  }
+
+  /* Check if any client large receives are missing blocks */
+  if (s->lg_crcv) {
+    if (coap_block_check_lg_crcv_timeouts(s, now, &s_timeout)) {
+      if (timeout == 0 || s_timeout < timeout)
+        timeout = s_timeout;
+    }
+  }
+  /* Check if any client large sending have timed out */
+  if (s->lg_xmit) {
+    if (coap_block_check_lg_xmit_timeouts(s, now, &s_timeout)) {
+      if (timeout == 0 || s_timeout < timeout)
+        timeout = s_timeout;
+    }
+  }
+#if COAP_Q_BLOCK_SUPPORT
+  /*
+   * Check if any client large transmits have hit MAX_PAYLOAD and need
+   * restarting
+   */
+  if (s->lg_xmit) {
+    s_timeout = coap_block_check_q_block1_xmit(s, now);
+    if (timeout == 0 || s_timeout < timeout)
+      timeout = s_timeout;
+  }
+#endif /* COAP_Q_BLOCK_SUPPORT */
+
+release:
+  if (s->ref == 1) {
+    /* Only our reference is left, so the session is about to go away */
+    coap_session_release_lkd(s);
+    return 0;
+  }
+  coap_session_release_lkd(s);
+  *next = timeout ? now + timeout : 0;
+  return 1;
+}
+#endif /* COAP_CLIENT_SUPPORT */
+
 /*
  * return  0 No i/o pending
  *       +ve millisecs to next i/o activity
@@ -1326,7 +1994,9 @@ coap_io_prepare_io_lkd(coap_context_t *ctx,
   coap_session_t *s, *rtmp;
   coap_tick_t timeout = 0;
   coap_tick_t s_timeout;
+  uint32_t pass;
 #if COAP_SERVER_SUPPORT
+  coap_endpoint_t *ep;
   int check_dtls_timeouts = 0;
 #endif /* COAP_SERVER_SUPPORT */
 #if defined(COAP_EPOLL_SUPPORT) || defined(WITH_LWIP) || defined(RIOT_VERSION)
@@ -1337,6 +2007,9 @@ coap_io_prepare_io_lkd(coap_context_t *ctx,
   coap_lock_check_locked(ctx);
   *num_sockets = 0;
 
+  /* Run any work handed over by other threads */
+  coap_work_queue_run(ctx);
+
 #if COAP_SERVER_SUPPORT
   /* Check to see if we need to send off any Observe requests */
   coap_check_notify_lkd(ctx);
@@ -1345,6 +2018,16 @@ coap_io_prepare_io_lkd(coap_context_t *ctx,
   /* Check to see if we need to send off any Async requests */
   timeout = coap_check_async(ctx, now);
 #endif /* COAP_ASYNC_SUPPORT */
+  if (ctx->observe_deferred) {
+    /* Send the notifications held back by COAP_OBS_MAX_BURST shortly */
+    timeout = 1;
+  }
+  if (ctx->observe_due) {
+    /* Notifications held back for pmin or waiting for pmax */
+    s_timeout = ctx->observe_due > now ? ctx->observe_due - now : 1;
+    if (timeout == 0 || s_timeout < timeout)
+      timeout = s_timeout;
+  }
 #endif /* COAP_SERVER_SUPPORT */
 
   /* Check to see if we need to send off any retransmit request */
@@ -1382,195 +2065,92 @@ coap_io_prepare_io_lkd(coap_context_t *ctx,
       timeout = s_timeout;
   }
 #endif /* COAP_PROXY_SUPPORT */
+  /*
+   * Only check the sessions that have been flagged by
+   * coap_session_timer_touch() or whose timers are due.
+   */
+  if (ctx->session_timers_rescan) {
+    ctx->session_timers_rescan = 0;
 #if COAP_SERVER_SUPPORT
-  coap_endpoint_t *ep;
-  coap_tick_t session_timeout;
+    LL_FOREACH(ctx->endpoint, ep) {
+      SESSIONS_ITER(ep->sessions, s, rtmp) {
+        coap_session_timer_touch(s);
+      }
+    }
+#endif /* COAP_SERVER_SUPPORT */
+#if COAP_CLIENT_SUPPORT
+    SESSIONS_ITER(ctx->sessions, s, rtmp) {
+      coap_session_timer_touch(s);
+    }
+#endif /* COAP_CLIENT_SUPPORT */
+  }
+  pass = ++ctx->session_timer_pass;
+  while ((s = coap_session_timer_next(ctx, now, pass)) != NULL) {
+    coap_tick_t next = 0;
+    int active = 0;
+#if COAP_CLIENT_SUPPORT
+    /* s may be freed by coap_io_check_server_session() */
+    int is_client = s->type == COAP_SESSION_TYPE_CLIENT;
+#endif /* COAP_CLIENT_SUPPORT */
 
-  if (ctx->session_timeout > 0)
-    session_timeout = ctx->session_timeout * COAP_TICKS_PER_SECOND;
-  else
-    session_timeout = COAP_DEFAULT_SESSION_TIMEOUT * COAP_TICKS_PER_SECOND;
+    s->timer_flags |= COAP_SESSION_TIMER_CHECKING;
+#if COAP_SERVER_SUPPORT
+    if (s->endpoint)
+      active = coap_io_check_server_session(ctx, s, now, check_dtls_timeouts,
+                                            &next);
+#endif /* COAP_SERVER_SUPPORT */
+#if COAP_CLIENT_SUPPORT
+    if (is_client)
+      active = coap_io_check_client_session(ctx, s, now, &next);
+#endif /* COAP_CLIENT_SUPPORT */
+    if (active) {
+      s->timer_flags &= ~COAP_SESSION_TIMER_CHECKING;
+      coap_session_timer_set(s, next);
+    }
+  }
+  if (ctx->session_timers) {
+    s_timeout = ctx->session_timers->timer_t > now ?
+                ctx->session_timers->timer_t - now : 1;
+    if (timeout == 0 || s_timeout < timeout)
+      timeout = s_timeout;
+  }
+  if (ctx->sessions_due) {
+    /* Touched by another session's callbacks after being checked */
+    timeout = 1;
+  }
 
-  LL_FOREACH(ctx->endpoint, ep) {
 #if !defined(COAP_EPOLL_SUPPORT) && !defined(WITH_LWIP) && !defined(RIOT_VERSION)
+#if COAP_SERVER_SUPPORT
+  LL_FOREACH(ctx->endpoint, ep) {
     if (ep->sock.flags & (COAP_SOCKET_WANT_READ | COAP_SOCKET_WANT_WRITE | COAP_SOCKET_WANT_ACCEPT)) {
       if (*num_sockets < max_sockets)
         sockets[(*num_sockets)++] = &ep->sock;
     }
-#endif /* ! COAP_EPOLL_SUPPORT && ! WITH_LWIP && ! RIOT_VERSION */
-    SESSIONS_ITER_SAFE(ep->sessions, s, rtmp) {
-      /* Check whether any idle server sessions should be released */
-      if (s->type == COAP_SESSION_TYPE_SERVER && s->ref == 0 &&
-          s->delayqueue == NULL &&
-          (s->last_rx_tx + session_timeout <= now ||
-           s->state == COAP_SESSION_STATE_NONE)) {
-        coap_handle_event_lkd(ctx, COAP_EVENT_SERVER_SESSION_DEL, s);
-        coap_session_free(s);
-      } else {
-        if (s->type == COAP_SESSION_TYPE_SERVER && s->ref == 0 &&
-            s->delayqueue == NULL) {
-          s_timeout = (s->last_rx_tx + session_timeout) - now;
-          if (timeout == 0 || s_timeout < timeout)
-            timeout = s_timeout;
-        }
-        /* Make sure the session object is not deleted in any callbacks */
-        coap_session_reference_lkd(s);
-        /* Check any DTLS timeouts and expire if appropriate */
-        if (check_dtls_timeouts && s->state == COAP_SESSION_STATE_HANDSHAKE &&
-            s->proto == COAP_PROTO_DTLS && s->tls) {
-          coap_tick_t tls_timeout = coap_dtls_get_timeout(s, now);
-          while (tls_timeout > 0 && tls_timeout <= now) {
-            coap_log_debug("** %s: DTLS retransmit timeout\n",
-                           coap_session_str(s));
-            if (coap_dtls_handle_timeout(s))
-              goto release_1;
-
-            if (s->tls)
-              tls_timeout = coap_dtls_get_timeout(s, now);
-            else {
-              tls_timeout = 0;
-              timeout = 1;
-            }
-          }
-          if (tls_timeout > 0 && (timeout == 0 || tls_timeout - now < timeout))
-            timeout = tls_timeout - now;
-        }
-        /* Check if any server large receives are missing blocks */
-        if (s->lg_srcv) {
-          if (coap_block_check_lg_srcv_timeouts(s, now, &s_timeout)) {
-            if (timeout == 0 || s_timeout < timeout)
-              timeout = s_timeout;
-          }
-        }
-        /* Check if any server large sending have timed out */
-        if (s->lg_xmit) {
-          if (coap_block_check_lg_xmit_timeouts(s, now, &s_timeout)) {
-            if (timeout == 0 || s_timeout < timeout)
-              timeout = s_timeout;
-          }
-        }
-#if !defined(COAP_EPOLL_SUPPORT) && !defined(WITH_LWIP) && !defined(RIOT_VERSION)
-        if (s->sock.flags & (COAP_SOCKET_WANT_READ|COAP_SOCKET_WANT_WRITE)) {
-          if (*num_sockets < max_sockets)
-            sockets[(*num_sockets)++] = &s->sock;
-        }
-#endif /* ! COAP_EPOLL_SUPPORT && ! WITH_LWIP && ! RIOT_VERSION */
-#if COAP_Q_BLOCK_SUPPORT
-        /*
-         * Check if any server large transmits have hit MAX_PAYLOAD and need
-         * restarting
-         */
-        if (s->lg_xmit) {
-          s_timeout = coap_block_check_q_block2_xmit(s, now);
-          if (timeout == 0 || s_timeout < timeout)
-            timeout = s_timeout;
-        }
-#endif /* COAP_Q_BLOCK_SUPPORT */
-release_1:
-        coap_session_release_lkd(s);
+    /* Datagram server sessions share the endpoint socket */
+    if (COAP_PROTO_NOT_RELIABLE(ep->proto))
+      continue;
+    SESSIONS_ITER(ep->sessions, s, rtmp) {
+      if (s->sock.flags & (COAP_SOCKET_WANT_READ|COAP_SOCKET_WANT_WRITE)) {
+        if (*num_sockets < max_sockets)
+          sockets[(*num_sockets)++] = &s->sock;
       }
     }
   }
 #endif /* COAP_SERVER_SUPPORT */
 #if COAP_CLIENT_SUPPORT
-  SESSIONS_ITER_SAFE(ctx->sessions, s, rtmp) {
-    if (s->type == COAP_SESSION_TYPE_CLIENT &&
-        s->state == COAP_SESSION_STATE_ESTABLISHED &&
-        ctx->ping_timeout > 0) {
-      if (s->last_rx_tx + ctx->ping_timeout * COAP_TICKS_PER_SECOND <= now) {
-        /* Time to send a ping */
-        if ((s->last_ping_mid = coap_session_send_ping_lkd(s)) == COAP_INVALID_MID)
-          /* Some issue - not safe to continue processing */
-          continue;
-        if (s->last_ping > 0 && s->last_pong < s->last_ping) {
-          coap_handle_event_lkd(s->context, COAP_EVENT_KEEPALIVE_FAILURE, s);
-        }
-        s->last_rx_tx = now;
-        s->last_ping = now;
-      }
-      s_timeout = (s->last_rx_tx + ctx->ping_timeout * COAP_TICKS_PER_SECOND) - now;
-      if (timeout == 0 || s_timeout < timeout)
-        timeout = s_timeout;
-    }
-
-#if !COAP_DISABLE_TCP
-    if (s->type == COAP_SESSION_TYPE_CLIENT && COAP_PROTO_RELIABLE(s->proto) &&
-        s->state == COAP_SESSION_STATE_CSM && ctx->csm_timeout_ms > 0) {
-      if (s->csm_tx == 0) {
-        s->csm_tx = now;
-        s_timeout = (ctx->csm_timeout_ms * COAP_TICKS_PER_SECOND) / 1000;
-      } else if (s->csm_tx + (ctx->csm_timeout_ms * COAP_TICKS_PER_SECOND) / 1000 <= now) {
-        /* timed out */
-        s_timeout = 0;
-      } else {
-        s_timeout = (s->csm_tx + (ctx->csm_timeout_ms * COAP_TICKS_PER_SECOND) / 1000) - now;
-      }
-      if ((timeout == 0 || s_timeout < timeout) && s_timeout != 0)
-        timeout = s_timeout;
-    }
-#endif /* !COAP_DISABLE_TCP */
-
-    /* Make sure the session object is not deleted in any callbacks */
-    coap_session_reference_lkd(s);
-    /* Check any DTLS timeouts and expire if appropriate */
-    if (s->state == COAP_SESSION_STATE_HANDSHAKE &&
-        s->proto == COAP_PROTO_DTLS && s->tls) {
-      coap_tick_t tls_timeout = coap_dtls_get_timeout(s, now);
-      while (tls_timeout > 0 && tls_timeout <= now) {
-        coap_log_debug("** %s: DTLS retransmit timeout\n", coap_session_str(s));
-        if (coap_dtls_handle_timeout(s))
-          goto release_2;
-
-        if (s->tls)
-          tls_timeout = coap_dtls_get_timeout(s, now);
-        else {
-          tls_timeout = 0;
-          timeout = 1;
-        }
-      }
-      if (tls_timeout > 0 && (timeout == 0 || tls_timeout - now < timeout))
-        timeout = tls_timeout - now;
-    }
-
-    /* Check if any client large receives are missing blocks */
-    if (s->lg_crcv) {
-      if (coap_block_check_lg_crcv_timeouts(s, now, &s_timeout)) {
-        if (timeout == 0 || s_timeout < timeout)
-          timeout = s_timeout;
-      }
-    }
-    /* Check if any client large sending have timed out */
-    if (s->lg_xmit) {
-      if (coap_block_check_lg_xmit_timeouts(s, now, &s_timeout)) {
-        if (timeout == 0 || s_timeout < timeout)
-          timeout = s_timeout;
-      }
-    }
-#if COAP_Q_BLOCK_SUPPORT
-    /*
-     * Check if any client large transmits have hit MAX_PAYLOAD and need
-     * restarting
-     */
-    if (s->lg_xmit) {
-      s_timeout = coap_block_check_q_block1_xmit(s, now);
-      if (timeout == 0 || s_timeout < timeout)
-        timeout = s_timeout;
-    }
-#endif /* COAP_Q_BLOCK_SUPPORT */
-
-#if !defined(COAP_EPOLL_SUPPORT) && !defined(WITH_LWIP) && !defined(RIOT_VERSION)
-    assert(s->ref > 1);
+  SESSIONS_ITER(ctx->sessions, s, rtmp) {
     if (s->sock.flags & (COAP_SOCKET_WANT_READ |
                          COAP_SOCKET_WANT_WRITE |
                          COAP_SOCKET_WANT_CONNECT)) {
       if (*num_sockets < max_sockets)
         sockets[(*num_sockets)++] = &s->sock;
     }
-#endif /* ! COAP_EPOLL_SUPPORT && ! WITH_LWIP && ! RIOT_VERSION */
-release_2:
-    coap_session_release_lkd(s);
   }
 #endif /* COAP_CLIENT_SUPPORT */
+#endif /* ! COAP_EPOLL_SUPPORT && ! WITH_LWIP && ! RIOT_VERSION */
+
+  /* Send off anything queued up by notifications or retransmits */
+  coap_io_flush_send_lkd(ctx);
 
   return (unsigned int)((timeout * 1000 + COAP_TICKS_PER_SECOND - 1) / COAP_TICKS_PER_SECOND);
 }
@@ -1622,6 +2202,10 @@ coap_io_process_with_fds_lkd(coap_context_t *ctx, uint32_t timeout_ms,
 
 #ifndef COAP_EPOLL_SUPPORT
 
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+  coap_work_queue_setup_wake(ctx);
+#endif /* COAP_WORK_QUEUE_WAKE_SOCKET */
+  ctx->work_queue.ran = 0;
   timeout = coap_io_prepare_io_lkd(ctx, ctx->sockets,
                                    (sizeof(ctx->sockets) / sizeof(ctx->sockets[0])),
                                    &ctx->num_sockets, before);
@@ -1660,8 +2244,16 @@ coap_io_process_with_fds_lkd(coap_context_t *ctx, uint32_t timeout_ms,
     }
 #endif /* !COAP_DISABLE_TCP */
   }
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+  if (ctx->work_queue.wake_fd != COAP_INVALID_SOCKET) {
+    if (ctx->work_queue.wake_fd + 1 > nfds)
+      nfds = ctx->work_queue.wake_fd + 1;
+    FD_SET(ctx->work_queue.wake_fd, &ctx->readfds);
+  }
+#endif /* COAP_WORK_QUEUE_WAKE_SOCKET */
 
-  if (timeout_ms == COAP_IO_NO_WAIT) {
+  if (timeout_ms == COAP_IO_NO_WAIT || coap_work_queue_pending(ctx)) {
+    /* Also do not wait if some work has been run, or is still pending */
     tv.tv_usec = 0;
     tv.tv_sec = 0;
     timeout = 1;
@@ -1691,6 +2283,14 @@ coap_io_process_with_fds_lkd(coap_context_t *ctx, uint32_t timeout_ms,
       return -1;
     }
   }
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+  if (result > 0 && ctx->work_queue.wake_fd != COAP_INVALID_SOCKET &&
+      FD_ISSET(ctx->work_queue.wake_fd, &ctx->readfds)) {
+    coap_work_queue_drain_wake(ctx);
+    FD_CLR(ctx->work_queue.wake_fd, &ctx->readfds);
+    /* Work will be run by coap_io_prepare_io_lkd() */
+  }
+#endif /* COAP_WORK_QUEUE_WAKE_SOCKET */
   if (ereadfds) {
     *ereadfds = ctx->readfds;
   }
@@ -1736,6 +2336,7 @@ coap_io_process_with_fds_lkd(coap_context_t *ctx, uint32_t timeout_ms,
   (void)eexceptfds;
   (void)enfds;
 
+  ctx->work_queue.ran = 0;
   timeout = coap_io_prepare_epoll_lkd(ctx, before);
 
   do {
@@ -1743,8 +2344,11 @@ coap_io_process_with_fds_lkd(coap_context_t *ctx, uint32_t timeout_ms,
     int etimeout;
 
     /* Potentially adjust based on what the caller wants */
-    if (timeout_ms == COAP_IO_NO_WAIT) {
-      /* Need to return immediately from epoll_wait() */
+    if (timeout_ms == COAP_IO_NO_WAIT || coap_work_queue_pending(ctx)) {
+      /*
+       * Need to return immediately from epoll_wait(), including if some
+       * work has been run, or is still pending.
+       */
       etimeout = 0;
     } else if (timeout == 0 && timeout_ms == COAP_IO_WAIT) {
       /*
@@ -1877,7 +2481,7 @@ coap_io_pending_lkd(coap_context_t *context) {
 #ifdef _WIN32
 const char *
 coap_socket_format_errno(int error) {
-  static char szError[256];
+  static COAP_THREAD_LOCAL char szError[256];
   if (FormatMessage(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
                     NULL, (DWORD)error, MAKELANGID(LANG_NEUTRAL,
                                                    SUBLANG_DEFAULT), (LPSTR)szError, (DWORD)sizeof(szError),
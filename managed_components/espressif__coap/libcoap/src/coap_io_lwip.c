@@ -187,6 +187,7 @@ coap_recvc(void *arg, struct udp_pcb *upcb, struct pbuf *p,
 
   coap_log_debug("*  %s: lwip:  recv %4d bytes\n",
                  coap_session_str(session), p->len);
+  coap_session_timer_touch(session);
   if (session->proto == COAP_PROTO_DTLS) {
     if (session->tls) {
       result = coap_dtls_receive(session, p->payload, p->len);
@@ -287,6 +288,8 @@ coap_udp_recvs(void *arg, struct udp_pcb *upcb, struct pbuf *p,
       result = coap_dtls_receive(session, p->payload, p->len);
     if (session->type == COAP_SESSION_TYPE_HELLO && result == 1)
       coap_session_new_dtls_session(session, now);
+    /* Type or state may have changed */
+    coap_session_update_lru(session);
     pbuf_free(p);
   } else {
     pdu = coap_pdu_from_pbuf(p);
@@ -73,6 +73,12 @@
 #include <mbedtls/oid.h>
 #include <mbedtls/debug.h>
 #include <mbedtls/sha256.h>
+#if defined(MBEDTLS_SSL_CACHE_C)
+#include <mbedtls/ssl_cache.h>
+#endif /* MBEDTLS_SSL_CACHE_C */
+#if defined(MBEDTLS_SSL_TICKET_C)
+#include <mbedtls/ssl_ticket.h>
+#endif /* MBEDTLS_SSL_TICKET_C */
 #if defined(ESPIDF_VERSION) && defined(CONFIG_MBEDTLS_DEBUG)
 #include <mbedtls/esp_debug.h>
 #endif /* ESPIDF_VERSION && CONFIG_MBEDTLS_DEBUG */
@@ -108,6 +114,12 @@
 #define IS_CLIENT (1 << 6)
 #define IS_SERVER (1 << 7)
 
+/* Client sessions can only be held for resumption if TLS1.2 is supported */
+#if defined(MBEDTLS_SSL_CLI_C) && \
+    (defined(MBEDTLS_2_X_COMPAT) || defined(MBEDTLS_SSL_PROTO_TLS1_2))
+#define COAP_MBEDTLS_CLIENT_RESUME
+#endif /* MBEDTLS_SSL_CLI_C && (MBEDTLS_2_X_COMPAT || MBEDTLS_SSL_PROTO_TLS1_2) */
+
 typedef struct coap_ssl_t {
   const uint8_t *pdu;
   unsigned pdu_len;
@@ -138,6 +150,13 @@ typedef struct coap_mbedtls_env_t {
   unsigned int retry_scalar;
   coap_ssl_t coap_ssl_data;
   uint32_t server_hello_cnt;
+  struct coap_mbedtls_context_t *m_context;
+  int resumed;            /* Set if the handshake resumed a session */
+  const char *resume_sni; /* SNI the client's held session is keyed on */
+  int resume_offered;     /* Set if the client offered a held session */
+#ifdef COAP_MBEDTLS_CLIENT_RESUME
+  unsigned char resume_master[48]; /* Of the offered session */
+#endif /* COAP_MBEDTLS_CLIENT_RESUME */
 } coap_mbedtls_env_t;
 
 typedef struct pki_sni_entry {
@@ -162,6 +181,17 @@ typedef struct coap_mbedtls_context_t {
   char *root_ca_file;
   char *root_ca_path;
   int psk_pki_enabled;
+  unsigned int resume_cache_size; /* 0 if resumption disabled */
+  unsigned int resume_lifetime;
+#if defined(MBEDTLS_SSL_SRV_C)
+#if defined(MBEDTLS_SSL_CACHE_C)
+  mbedtls_ssl_cache_context cache;
+#endif /* MBEDTLS_SSL_CACHE_C */
+#if defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_ticket_context ticket;
+#endif /* MBEDTLS_SSL_TICKET_C && MBEDTLS_SSL_SESSION_TICKETS */
+  int resume_setup;               /* Set if cache and ticket are set up */
+#endif /* MBEDTLS_SSL_SRV_C */
 } coap_mbedtls_context_t;
 
 typedef enum coap_enc_method_t {
@@ -170,7 +200,8 @@ typedef enum coap_enc_method_t {
   COAP_ENC_ECJPAKE,
 } coap_enc_method_t;
 
-#ifndef MBEDTLS_2_X_COMPAT
+#if !defined(MBEDTLS_2_X_COMPAT) || (defined(MBEDTLS_SSL_SRV_C) && \
+    defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_SSL_SESSION_TICKETS))
 /*
  * mbedtls_ callback functions expect 0 on success, -ve on failure.
  */
@@ -178,7 +209,7 @@ static int
 coap_rng(void *ctx COAP_UNUSED, unsigned char *buf, size_t len) {
   return coap_prng_lkd(buf, len) ? 0 : MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
 }
-#endif /* MBEDTLS_2_X_COMPAT */
+#endif /* ! MBEDTLS_2_X_COMPAT || MBEDTLS_SSL_TICKET_C */
 
 static int
 coap_dgram_read(void *ctx, unsigned char *out, size_t outl) {
@@ -342,7 +373,7 @@ get_san_or_cn_from_cert(mbedtls_x509_crt *crt) {
 #if COAP_MAX_LOGGING_LEVEL > 0
 static char *
 get_error_string(int ret) {
-  static char buf[128] = {0};
+  static COAP_THREAD_LOCAL char buf[128] = {0};
   mbedtls_strerror(ret, buf, sizeof(buf)-1);
   return buf;
 }
@@ -1019,6 +1050,132 @@ psk_sni_callback(void *p_info, mbedtls_ssl_context *ssl,
 }
 #endif /* MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED */
 
+/*
+ * The session cache and ticket callbacks are given the env of the session
+ * doing the handshake, so that a resumed session can be reported.
+ */
+#if defined(MBEDTLS_SSL_CACHE_C)
+#ifdef MBEDTLS_2_X_COMPAT
+static int
+resume_cache_get(void *data, mbedtls_ssl_session *session) {
+  coap_mbedtls_env_t *m_env = (coap_mbedtls_env_t *)data;
+  int ret = mbedtls_ssl_cache_get(&m_env->m_context->cache, session);
+
+  if (ret == 0)
+    m_env->resumed = 1;
+  return ret;
+}
+
+static int
+resume_cache_set(void *data, const mbedtls_ssl_session *session) {
+  coap_mbedtls_env_t *m_env = (coap_mbedtls_env_t *)data;
+
+  return mbedtls_ssl_cache_set(&m_env->m_context->cache, session);
+}
+#else /* ! MBEDTLS_2_X_COMPAT */
+static int
+resume_cache_get(void *data, unsigned char const *session_id,
+                 size_t session_id_len, mbedtls_ssl_session *session) {
+  coap_mbedtls_env_t *m_env = (coap_mbedtls_env_t *)data;
+  int ret = mbedtls_ssl_cache_get(&m_env->m_context->cache, session_id,
+                                  session_id_len, session);
+
+  if (ret == 0)
+    m_env->resumed = 1;
+  return ret;
+}
+
+static int
+resume_cache_set(void *data, unsigned char const *session_id,
+                 size_t session_id_len, const mbedtls_ssl_session *session) {
+  coap_mbedtls_env_t *m_env = (coap_mbedtls_env_t *)data;
+
+  return mbedtls_ssl_cache_set(&m_env->m_context->cache, session_id,
+                               session_id_len, session);
+}
+#endif /* ! MBEDTLS_2_X_COMPAT */
+#endif /* MBEDTLS_SSL_CACHE_C */
+
+#if defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+static int
+resume_ticket_write(void *p_ticket, const mbedtls_ssl_session *session,
+                    unsigned char *start, const unsigned char *end,
+                    size_t *tlen, uint32_t *lifetime) {
+  coap_mbedtls_env_t *m_env = (coap_mbedtls_env_t *)p_ticket;
+
+  return mbedtls_ssl_ticket_write(&m_env->m_context->ticket, session, start,
+                                  end, tlen, lifetime);
+}
+
+static int
+resume_ticket_parse(void *p_ticket, mbedtls_ssl_session *session,
+                    unsigned char *buf, size_t len) {
+  coap_mbedtls_env_t *m_env = (coap_mbedtls_env_t *)p_ticket;
+  int ret = mbedtls_ssl_ticket_parse(&m_env->m_context->ticket, session, buf,
+                                     len);
+
+  if (ret == 0)
+    m_env->resumed = 1;
+  return ret;
+}
+#endif /* MBEDTLS_SSL_TICKET_C && MBEDTLS_SSL_SESSION_TICKETS */
+
+/* Release the server's session cache and ticket keys */
+static void
+free_server_resumption(coap_mbedtls_context_t *m_context) {
+  if (!m_context->resume_setup)
+    return;
+#if defined(MBEDTLS_SSL_CACHE_C)
+  mbedtls_ssl_cache_free(&m_context->cache);
+#endif /* MBEDTLS_SSL_CACHE_C */
+#if defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_ticket_free(&m_context->ticket);
+#endif /* MBEDTLS_SSL_TICKET_C && MBEDTLS_SSL_SESSION_TICKETS */
+  m_context->resume_setup = 0;
+}
+
+/*
+ * Set up the server's session cache and ticket keys, which are shared by
+ * all the server sessions. The ticket keys are changed every lifetime.
+ *
+ * return 0   Success
+ *        neg MBEDTLS_ERR_* error code
+ */
+static int
+setup_server_resumption(coap_mbedtls_context_t *m_context) {
+  int ret = 0;
+
+  free_server_resumption(m_context);
+  if (!m_context->resume_cache_size)
+    return 0;
+#if defined(MBEDTLS_SSL_CACHE_C)
+  mbedtls_ssl_cache_init(&m_context->cache);
+  mbedtls_ssl_cache_set_max_entries(&m_context->cache,
+                                    (int)m_context->resume_cache_size);
+#if defined(MBEDTLS_HAVE_TIME)
+  mbedtls_ssl_cache_set_timeout(&m_context->cache,
+                                (int)m_context->resume_lifetime);
+#endif /* MBEDTLS_HAVE_TIME */
+#endif /* MBEDTLS_SSL_CACHE_C */
+#if defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_ticket_init(&m_context->ticket);
+  if ((ret = mbedtls_ssl_ticket_setup(&m_context->ticket, coap_rng, NULL,
+#if defined(MBEDTLS_GCM_C)
+                                      MBEDTLS_CIPHER_AES_256_GCM,
+#else /* ! MBEDTLS_GCM_C */
+                                      MBEDTLS_CIPHER_AES_128_CCM,
+#endif /* ! MBEDTLS_GCM_C */
+                                      m_context->resume_lifetime)) != 0) {
+    coap_log_err("mbedtls_ssl_ticket_setup returned -0x%x: '%s'\n",
+                 -ret, get_error_string(ret));
+  }
+#endif /* MBEDTLS_SSL_TICKET_C && MBEDTLS_SSL_SESSION_TICKETS */
+  m_context->resume_setup = 1;
+  if (ret != 0)
+    free_server_resumption(m_context);
+  return ret;
+}
+
 static int
 setup_server_ssl_session(coap_session_t *c_session,
                          coap_mbedtls_env_t *m_env) {
@@ -1100,6 +1257,17 @@ setup_server_ssl_session(coap_session_t *c_session,
    */
   mbedtls_ssl_conf_cid(&m_env->conf, COAP_DTLS_CID_LENGTH, MBEDTLS_SSL_UNEXPECTED_CID_IGNORE);
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+
+  if (m_context->resume_setup) {
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_conf_session_cache(&m_env->conf, m_env,
+                                   resume_cache_get, resume_cache_set);
+#endif /* MBEDTLS_SSL_CACHE_C */
+#if defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets_cb(&m_env->conf, resume_ticket_write,
+                                        resume_ticket_parse, m_env);
+#endif /* MBEDTLS_SSL_TICKET_C && MBEDTLS_SSL_SESSION_TICKETS */
+  }
 fail:
   return ret;
 }
@@ -1140,6 +1308,8 @@ coap_ssl_ciphersuite_uses_psk(const mbedtls_ssl_ciphersuite_t *info) {
 
 static void
 set_ciphersuites(mbedtls_ssl_config *conf, coap_enc_method_t method) {
+  /* The cipher suite lists are shared by all contexts */
+  coap_lock_lock(NULL, return);
   if (!processed_ciphers) {
     const int *list = mbedtls_ssl_list_ciphersuites();
     const int *base = list;
@@ -1193,6 +1363,7 @@ set_ciphersuites(mbedtls_ssl_config *conf, coap_enc_method_t method) {
     psk_ciphers = mbedtls_malloc(psk_count * sizeof(psk_ciphers[0]));
     if (psk_ciphers == NULL) {
       coap_log_err("set_ciphers: mbedtls_malloc with count %d failed\n", psk_count);
+      coap_lock_unlock(NULL);
       return;
     }
     pki_ciphers = mbedtls_malloc(pki_count * sizeof(pki_ciphers[0]));
@@ -1200,6 +1371,7 @@ set_ciphersuites(mbedtls_ssl_config *conf, coap_enc_method_t method) {
       coap_log_err("set_ciphers: mbedtls_malloc with count %d failed\n", pki_count);
       mbedtls_free(psk_ciphers);
       psk_ciphers = NULL;
+      coap_lock_unlock(NULL);
       return;
     }
 #if defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
@@ -1210,6 +1382,7 @@ set_ciphersuites(mbedtls_ssl_config *conf, coap_enc_method_t method) {
       mbedtls_free(pki_ciphers);
       psk_ciphers = NULL;
       pki_ciphers = NULL;
+      coap_lock_unlock(NULL);
       return;
     }
 #endif /* MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED */
@@ -1265,6 +1438,7 @@ set_ciphersuites(mbedtls_ssl_config *conf, coap_enc_method_t method) {
     *pki_list = 0;
     processed_ciphers = 1;
   }
+  coap_lock_unlock(NULL);
   switch (method) {
   case COAP_ENC_PSK:
     mbedtls_ssl_conf_ciphersuites(conf, psk_ciphers);
@@ -1339,6 +1513,7 @@ setup_client_ssl_session(coap_session_t *c_session,
         goto fail;
       }
     }
+    m_env->resume_sni = c_session->cpsk_setup_data.client_sni;
     /* Identity Hint currently not supported in Mbed TLS so code removed */
 
 #ifdef MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED
@@ -1384,6 +1559,7 @@ setup_client_ssl_session(coap_session_t *c_session,
     }
 #endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_ALPN */
     mbedtls_ssl_set_hostname(&m_env->ssl, m_context->setup_data.client_sni);
+    m_env->resume_sni = m_context->setup_data.client_sni;
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 #if MBEDTLS_VERSION_NUMBER >= 0x02100100
     mbedtls_ssl_set_mtu(&m_env->ssl, (uint16_t)c_session->mtu);
@@ -1396,8 +1572,74 @@ setup_client_ssl_session(coap_session_t *c_session,
 fail:
   return ret;
 }
+
+#ifdef COAP_MBEDTLS_CLIENT_RESUME
+static void
+free_resume_data(void *data) {
+  mbedtls_ssl_session_free((mbedtls_ssl_session *)data);
+  mbedtls_free(data);
+}
+
+/*
+ * Offer the session held for the server, if any. Only TLS1.2 sessions are
+ * held, as a resumed TLS1.3 session cannot be told apart.
+ */
+static void
+offer_client_session(coap_session_t *c_session, coap_mbedtls_env_t *m_env) {
+  mbedtls_ssl_session *resume;
+
+  resume = coap_dtls_resume_find(c_session, m_env->resume_sni);
+  if (resume && mbedtls_ssl_set_session(&m_env->ssl, resume) == 0) {
+    memcpy(m_env->resume_master, resume->master,
+           sizeof(m_env->resume_master));
+    m_env->resume_offered = 1;
+  }
+}
+
+/*
+ * Hold the client's session so that a later session to the same server
+ * can resume it.
+ */
+static void
+hold_client_session(coap_session_t *c_session, coap_mbedtls_env_t *m_env) {
+  mbedtls_ssl_session *resume;
+
+  if (!c_session->context->resume_cache_size)
+    return;
+#if MBEDTLS_VERSION_NUMBER >= 0x03020000
+  if (mbedtls_ssl_get_version_number(&m_env->ssl) !=
+      MBEDTLS_SSL_VERSION_TLS1_2)
+    return;
+#endif /* MBEDTLS_VERSION_NUMBER >= 0x03020000 */
+  resume = mbedtls_malloc(sizeof(mbedtls_ssl_session));
+  if (!resume)
+    return;
+  mbedtls_ssl_session_init(resume);
+  if (mbedtls_ssl_get_session(&m_env->ssl, resume) != 0) {
+    free_resume_data(resume);
+    return;
+  }
+  coap_dtls_resume_store(c_session, m_env->resume_sni, resume,
+                         free_resume_data);
+}
+#endif /* COAP_MBEDTLS_CLIENT_RESUME */
 #endif /* COAP_CLIENT_SUPPORT */
 
+/* Account for the completed handshake of c_session */
+static void
+handshake_done(coap_session_t *c_session, coap_mbedtls_env_t *m_env) {
+#ifdef COAP_MBEDTLS_CLIENT_RESUME
+  if (c_session->type == COAP_SESSION_TYPE_CLIENT) {
+    /* A resumed TLS1.2 session keeps its master secret */
+    m_env->resumed = m_env->resume_offered &&
+                     memcmp(m_env->ssl.session->master, m_env->resume_master,
+                            sizeof(m_env->resume_master)) == 0;
+    hold_client_session(c_session, m_env);
+  }
+#endif /* COAP_MBEDTLS_CLIENT_RESUME */
+  coap_dtls_handshake_done(c_session, m_env->resumed);
+}
+
 static void
 mbedtls_cleanup(coap_mbedtls_env_t *m_env) {
   if (!m_env) {
@@ -1467,6 +1709,7 @@ do_mbedtls_handshake(coap_session_t *c_session,
     m_env->established = 1;
     coap_log_debug("*  %s: Mbed TLS established\n",
                    coap_session_str(c_session));
+    handshake_done(c_session, m_env);
     ret = 1;
 #ifdef MBEDTLS_SSL_DTLS_CONNECTION_ID
 #if COAP_CLIENT_SUPPORT
@@ -1729,6 +1972,7 @@ coap_dtls_new_mbedtls_env(coap_session_t *c_session,
     return NULL;
   }
   memset(m_env, 0, sizeof(coap_mbedtls_env_t));
+  m_env->m_context = (coap_mbedtls_context_t *)c_session->context->dtls_context;
 
   mbedtls_ssl_init(&m_env->ssl);
   mbedtls_ctr_drbg_init(&m_env->ctr_drbg);
@@ -1783,6 +2027,10 @@ coap_dtls_new_mbedtls_env(coap_session_t *c_session,
   if (mbedtls_ssl_setup(&m_env->ssl, &m_env->conf) != 0) {
     goto fail;
   }
+#ifdef COAP_MBEDTLS_CLIENT_RESUME
+  if (role == COAP_DTLS_ROLE_CLIENT)
+    offer_client_session(c_session, m_env);
+#endif /* COAP_MBEDTLS_CLIENT_RESUME */
   if (proto == COAP_PROTO_DTLS) {
     mbedtls_ssl_set_bio(&m_env->ssl, c_session, coap_dgram_write,
                         coap_dgram_read, NULL);
@@ -2143,9 +2391,26 @@ coap_dtls_free_context(void *dtls_context) {
   if (m_context->root_ca_file)
     mbedtls_free(m_context->root_ca_file);
 
+#if defined(MBEDTLS_SSL_SRV_C)
+  free_server_resumption(m_context);
+#endif /* MBEDTLS_SSL_SRV_C */
   mbedtls_free(m_context);
 }
 
+int
+coap_dtls_context_set_resumption(coap_context_t *c_context) {
+  coap_mbedtls_context_t *m_context =
+      (coap_mbedtls_context_t *)c_context->dtls_context;
+
+  m_context->resume_cache_size = c_context->resume_cache_size;
+  m_context->resume_lifetime = c_context->resume_lifetime;
+#if defined(MBEDTLS_SSL_SRV_C)
+  if (setup_server_resumption(m_context) != 0)
+    return 0;
+#endif /* MBEDTLS_SSL_SRV_C */
+  return 1;
+}
+
 #if COAP_CLIENT_SUPPORT
 void *
 coap_dtls_new_client_session(coap_session_t *c_session) {
@@ -2204,6 +2469,14 @@ coap_dtls_new_server_session(coap_session_t *c_session) {
 void
 coap_dtls_free_session(coap_session_t *c_session) {
   if (c_session && c_session->context && c_session->tls) {
+#ifdef COAP_MBEDTLS_CLIENT_RESUME
+    coap_mbedtls_env_t *m_env = (coap_mbedtls_env_t *)c_session->tls;
+
+    if (c_session->type == COAP_SESSION_TYPE_CLIENT &&
+        !m_env->established && m_env->resume_offered)
+      /* Do not offer it again if it was the cause of the failure */
+      coap_dtls_resume_remove(c_session, m_env->resume_sni);
+#endif /* COAP_MBEDTLS_CLIENT_RESUME */
     coap_dtls_free_mbedtls_env(c_session->tls);
     c_session->tls = NULL;
     coap_handle_event_lkd(c_session->context, COAP_EVENT_DTLS_CLOSED, c_session);
@@ -2380,8 +2653,7 @@ coap_dtls_receive(coap_session_t *c_session,
 
   if (m_env->established) {
 #if COAP_CONSTRAINED_STACK
-    /* pdu can be protected by global_lock if needed */
-    static uint8_t pdu[COAP_RXBUFFER_SIZE];
+    static COAP_THREAD_LOCAL uint8_t pdu[COAP_RXBUFFER_SIZE];
 #else /* ! COAP_CONSTRAINED_STACK */
     uint8_t pdu[COAP_RXBUFFER_SIZE];
 #endif /* ! COAP_CONSTRAINED_STACK */
@@ -20,6 +20,52 @@
 static int track_counts[COAP_MEM_TAG_LAST];
 static int peak_counts[COAP_MEM_TAG_LAST];
 static int fail_counts[COAP_MEM_TAG_LAST];
+static unsigned int resize_counts[COAP_MEM_TAG_LAST];
+
+/*
+ * Allocations are made by threads holding different context locks (or none),
+ * so the counts are only updated atomically.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define coap_track_add(p,v)  __atomic_add_fetch(p, v, __ATOMIC_RELAXED)
+#define coap_track_load(p)   __atomic_load_n(p, __ATOMIC_RELAXED)
+#define coap_track_cas(p,o,v) \
+  __atomic_compare_exchange_n(p, o, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else /* ! __GNUC__ && ! __clang__ */
+#define coap_track_add(p,v)  (*(p) += (v))
+#define coap_track_load(p)   (*(p))
+#define coap_track_cas(p,o,v) (*(p) = (v), 1)
+#endif /* ! __GNUC__ && ! __clang__ */
+
+static void
+coap_track_new(coap_memory_tag_t type) {
+  int count;
+  int peak;
+
+  assert(type < COAP_MEM_TAG_LAST);
+  count = coap_track_add(&track_counts[type], 1);
+  peak = coap_track_load(&peak_counts[type]);
+  while (count > peak && !coap_track_cas(&peak_counts[type], &peak, count))
+    ;
+}
+
+static void
+coap_track_resize(coap_memory_tag_t type) {
+  assert(type < COAP_MEM_TAG_LAST);
+  coap_track_add(&resize_counts[type], 1);
+}
+
+static void
+coap_track_fail(coap_memory_tag_t type) {
+  assert(type < COAP_MEM_TAG_LAST);
+  coap_track_add(&fail_counts[type], 1);
+}
+
+static void
+coap_track_free(coap_memory_tag_t type) {
+  assert(type < COAP_MEM_TAG_LAST);
+  coap_track_add(&track_counts[type], -1);
+}
 #endif /* COAP_MEMORY_TYPE_TRACK */
 #endif /* ! WITH_LWIP */
 
@@ -433,14 +479,10 @@ coap_malloc_type(coap_memory_tag_t type, size_t size) {
     coap_log_warn("coap_malloc_type: Failure (no free blocks) for type %d\n",
                   type);
 #if COAP_MEMORY_TYPE_TRACK
-  assert(type < COAP_MEM_TAG_LAST);
-  if (ptr) {
-    track_counts[type]++;
-    if (track_counts[type] > peak_counts[type])
-      peak_counts[type] = track_counts[type];
-  } else {
-    fail_counts[type]++;
-  }
+  if (ptr)
+    coap_track_new(type);
+  else
+    coap_track_fail(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   return ptr;
 }
@@ -448,9 +490,8 @@ coap_malloc_type(coap_memory_tag_t type, size_t size) {
 void
 coap_free_type(coap_memory_tag_t type, void *object) {
 #if COAP_MEMORY_TYPE_TRACK
-  assert(type < COAP_MEM_TAG_LAST);
   if (object)
-    track_counts[type]--;
+    coap_track_free(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   if (object != NULL)
     memarray_free(get_container(type), object);
@@ -473,6 +514,9 @@ coap_realloc_type(coap_memory_tag_t type, void *p, size_t size) {
       coap_free_type(type, p);
       return NULL;
     }
+#if COAP_MEMORY_TYPE_TRACK
+    coap_track_resize(type);
+#endif /* COAP_MEMORY_TYPE_TRACK */
     return p;
   }
   return coap_malloc_type(type, size);
@@ -495,14 +539,10 @@ coap_malloc_type(coap_memory_tag_t type, size_t size) {
   (void)type;
   ptr = k_malloc(size);
 #if COAP_MEMORY_TYPE_TRACK
-  assert(type < COAP_MEM_TAG_LAST);
-  if (ptr) {
-    track_counts[type]++;
-    if (track_counts[type] > peak_counts[type])
-      peak_counts[type] = track_counts[type];
-  } else {
-    fail_counts[type]++;
-  }
+  if (ptr)
+    coap_track_new(type);
+  else
+    coap_track_fail(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   return ptr;
 }
@@ -523,15 +563,12 @@ coap_realloc_type(coap_memory_tag_t type, void *p, size_t size) {
   }
 #endif /* KERNEL_VERSION_NUMBER < 0x30700 */
 #if COAP_MEMORY_TYPE_TRACK
-  if (ptr) {
-    assert(type < COAP_MEM_TAG_LAST);
-    if (!p)
-      track_counts[type]++;
-    if (track_counts[type] > peak_counts[type])
-      peak_counts[type] = track_counts[type];
-  } else {
-    fail_counts[type]++;
-  }
+  if (!ptr)
+    coap_track_fail(type);
+  else if (!p)
+    coap_track_new(type);
+  else
+    coap_track_resize(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   return ptr;
 }
@@ -540,9 +577,8 @@ void
 coap_free_type(coap_memory_tag_t type, void *p) {
   (void)type;
 #if COAP_MEMORY_TYPE_TRACK
-  assert(type < COAP_MEM_TAG_LAST);
   if (p)
-    track_counts[type]--;
+    coap_track_free(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   k_free(p);
 }
@@ -550,6 +586,381 @@ coap_free_type(coap_memory_tag_t type, void *p) {
 #elif defined(HAVE_MALLOC) || defined(__MINGW32__)
 #include <stdlib.h>
 
+/**
+ * Set to 1 to build in support for the slab allocator (see
+ * coap_memory_set_slab()). When built in, every allocation carries a slab
+ * header, even while the slab allocator is not in use. Needs pthreads if
+ * built thread-safe.
+ */
+#ifndef COAP_MEMORY_SLAB
+#define COAP_MEMORY_SLAB 0
+#endif /* COAP_MEMORY_SLAB */
+#if COAP_MEMORY_SLAB && COAP_THREAD_SAFE && !defined(HAVE_PTHREAD_H)
+#undef COAP_MEMORY_SLAB
+#define COAP_MEMORY_SLAB 0
+#endif /* COAP_MEMORY_SLAB && COAP_THREAD_SAFE && ! HAVE_PTHREAD_H */
+
+#if COAP_MEMORY_SLAB
+/**
+ * Set to 1 for the slab allocator to be in use from startup, rather than
+ * waiting for coap_memory_set_slab() to be called.
+ */
+#ifndef COAP_MEMORY_SLAB_ENABLE
+#define COAP_MEMORY_SLAB_ENABLE 0
+#endif /* COAP_MEMORY_SLAB_ENABLE */
+
+/**
+ * The (approximate) size of each chunk of memory that is carved up into
+ * objects of the same type and size class.
+ */
+#ifndef COAP_MEMORY_SLAB_CHUNK_SIZE
+#define COAP_MEMORY_SLAB_CHUNK_SIZE (4096U)
+#endif /* COAP_MEMORY_SLAB_CHUNK_SIZE */
+
+#if COAP_THREAD_SAFE
+#include <pthread.h>
+
+/**
+ * The maximum number of free objects of each type and size class a thread
+ * keeps for itself before handing half of them back to the shared pool.
+ */
+#ifndef COAP_MEMORY_SLAB_THREAD_CACHE
+#define COAP_MEMORY_SLAB_THREAD_CACHE (16U)
+#endif /* COAP_MEMORY_SLAB_THREAD_CACHE */
+#endif /* COAP_THREAD_SAFE */
+
+/*
+ * Every block starts with a header so that coap_free_type() and
+ * coap_realloc_type() know where the block came from without being told the
+ * size. The union keeps the returned memory suitably aligned.
+ */
+typedef union coap_slab_hdr_t {
+  struct {
+    uint32_t size;        /* requested size (heap blocks only) */
+    uint8_t size_class;   /* index into slab_class_size or COAP_SLAB_HEAP */
+  } h;
+  union coap_slab_hdr_t *next; /* when on a free list */
+  double align_d;
+  uint64_t align_u;
+  void *align_p;
+} coap_slab_hdr_t;
+
+#define COAP_SLAB_HEAP 0xff
+
+/*
+ * 272, 528 and 1040 hold the PDU buffer sizes coap_pdu_check_resize() doubles
+ * through (256, 512, 1024 + header), 1168 one of a full MTU
+ */
+static const uint16_t slab_class_size[] = {
+  32, 48, 64, 96, 128, 192, 272, 384, 528, 768, 1040, 1168, 1536
+};
+#define COAP_SLAB_CLASSES \
+  (sizeof(slab_class_size) / sizeof(slab_class_size[0]))
+#define COAP_SLAB_MAX_SIZE slab_class_size[COAP_SLAB_CLASSES - 1]
+
+typedef struct coap_slab_pool_t {
+  coap_slab_hdr_t *free;  /* free objects */
+  uint32_t num_free;
+} coap_slab_pool_t;
+
+typedef union coap_slab_chunk_t {
+  struct {
+    union coap_slab_chunk_t *next;
+    size_t size;
+  } c;
+  coap_slab_hdr_t align;
+} coap_slab_chunk_t;
+
+static int slab_enabled = COAP_MEMORY_SLAB_ENABLE;
+/* Slab memory is kept for the life of the process for later re-use */
+static coap_slab_chunk_t *slab_chunks;
+static size_t slab_chunk_bytes;
+static coap_slab_pool_t slab_pool[COAP_MEM_TAG_LAST][COAP_SLAB_CLASSES];
+
+#if COAP_THREAD_SAFE
+typedef struct coap_slab_cache_t {
+  coap_slab_pool_t pool[COAP_MEM_TAG_LAST][COAP_SLAB_CLASSES];
+} coap_slab_cache_t;
+
+static pthread_mutex_t slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slab_key;
+static __thread coap_slab_cache_t *slab_cache;
+
+#define coap_slab_lock()   pthread_mutex_lock(&slab_mutex)
+#define coap_slab_unlock() pthread_mutex_unlock(&slab_mutex)
+#else /* ! COAP_THREAD_SAFE */
+#define coap_slab_lock()
+#define coap_slab_unlock()
+#endif /* ! COAP_THREAD_SAFE */
+
+static uint8_t
+coap_slab_class(size_t size) {
+  uint8_t i;
+
+  for (i = 0; i < COAP_SLAB_CLASSES; i++) {
+    if (size <= slab_class_size[i])
+      return i;
+  }
+  return COAP_SLAB_HEAP;
+}
+
+/* Add a chunk of new objects to pool. Must be called locked. */
+static int
+coap_slab_grow(coap_slab_pool_t *pool, uint8_t size_class, size_t count) {
+  size_t stride = sizeof(coap_slab_hdr_t) +
+                  (slab_class_size[size_class] + sizeof(coap_slab_hdr_t) - 1) /
+                  sizeof(coap_slab_hdr_t) * sizeof(coap_slab_hdr_t);
+  coap_slab_chunk_t *chunk;
+  uint8_t *obj;
+  size_t i;
+
+  if (count == 0) {
+    count = COAP_MEMORY_SLAB_CHUNK_SIZE / stride;
+    if (count < 4)
+      count = 4;
+  }
+  chunk = malloc(sizeof(coap_slab_chunk_t) + count * stride);
+  if (!chunk)
+    return 0;
+  chunk->c.size = sizeof(coap_slab_chunk_t) + count * stride;
+  chunk->c.next = slab_chunks;
+  slab_chunks = chunk;
+  slab_chunk_bytes += chunk->c.size;
+
+  obj = (uint8_t *)(chunk + 1);
+  for (i = 0; i < count; i++) {
+    coap_slab_hdr_t *hdr = (coap_slab_hdr_t *)obj;
+
+    hdr->next = pool->free;
+    pool->free = hdr;
+    obj += stride;
+  }
+  pool->num_free += (uint32_t)count;
+  return 1;
+}
+
+#if COAP_THREAD_SAFE
+/* Move up to count objects from one pool to another */
+static void
+coap_slab_move(coap_slab_pool_t *to, coap_slab_pool_t *from, uint32_t count) {
+  while (count-- && from->free) {
+    coap_slab_hdr_t *hdr = from->free;
+
+    from->free = hdr->next;
+    from->num_free--;
+    hdr->next = to->free;
+    to->free = hdr;
+    to->num_free++;
+  }
+}
+
+/* Hand back the free objects of a thread that is exiting */
+static void
+coap_slab_cache_release(void *arg) {
+  coap_slab_cache_t *cache = (coap_slab_cache_t *)arg;
+  size_t t, c;
+
+  coap_slab_lock();
+  for (t = 0; t < COAP_MEM_TAG_LAST; t++) {
+    for (c = 0; c < COAP_SLAB_CLASSES; c++) {
+      coap_slab_move(&slab_pool[t][c], &cache->pool[t][c],
+                     cache->pool[t][c].num_free);
+    }
+  }
+  coap_slab_unlock();
+  free(cache);
+}
+
+static void
+coap_slab_key_create(void) {
+  pthread_key_create(&slab_key, coap_slab_cache_release);
+}
+
+static coap_slab_cache_t *
+coap_slab_get_cache(void) {
+  if (!slab_cache) {
+    pthread_once(&slab_once, coap_slab_key_create);
+    slab_cache = calloc(1, sizeof(coap_slab_cache_t));
+    if (slab_cache)
+      pthread_setspecific(slab_key, slab_cache);
+  }
+  return slab_cache;
+}
+#endif /* COAP_THREAD_SAFE */
+
+static coap_slab_hdr_t *
+coap_slab_alloc(coap_memory_tag_t type, uint8_t size_class) {
+  coap_slab_pool_t *pool = &slab_pool[type][size_class];
+  coap_slab_hdr_t *hdr;
+#if COAP_THREAD_SAFE
+  coap_slab_cache_t *cache = coap_slab_get_cache();
+
+  if (cache) {
+    coap_slab_pool_t *local = &cache->pool[type][size_class];
+
+    if (!local->free) {
+      coap_slab_lock();
+      if (!pool->free && !coap_slab_grow(pool, size_class, 0)) {
+        coap_slab_unlock();
+        return NULL;
+      }
+      coap_slab_move(local, pool, COAP_MEMORY_SLAB_THREAD_CACHE / 2);
+      coap_slab_unlock();
+    }
+    pool = local;
+  } else {
+    coap_slab_lock();
+  }
+#endif /* COAP_THREAD_SAFE */
+  if (!pool->free && !coap_slab_grow(pool, size_class, 0)) {
+    hdr = NULL;
+  } else {
+    hdr = pool->free;
+    pool->free = hdr->next;
+    pool->num_free--;
+    hdr->h.size_class = size_class;
+  }
+#if COAP_THREAD_SAFE
+  if (!cache)
+    coap_slab_unlock();
+#endif /* COAP_THREAD_SAFE */
+  return hdr;
+}
+
+static void
+coap_slab_free(coap_memory_tag_t type, coap_slab_hdr_t *hdr) {
+  coap_slab_pool_t *pool = &slab_pool[type][hdr->h.size_class];
+#if COAP_THREAD_SAFE
+  coap_slab_cache_t *cache = coap_slab_get_cache();
+
+  if (cache) {
+    coap_slab_pool_t *local = &cache->pool[type][hdr->h.size_class];
+
+    hdr->next = local->free;
+    local->free = hdr;
+    local->num_free++;
+    if (local->num_free > COAP_MEMORY_SLAB_THREAD_CACHE) {
+      coap_slab_lock();
+      coap_slab_move(pool, local, COAP_MEMORY_SLAB_THREAD_CACHE / 2);
+      coap_slab_unlock();
+    }
+    return;
+  }
+#endif /* COAP_THREAD_SAFE */
+  coap_slab_lock();
+  hdr->next = pool->free;
+  pool->free = hdr;
+  pool->num_free++;
+  coap_slab_unlock();
+}
+
+static void *
+coap_slab_malloc(coap_memory_tag_t type, size_t size) {
+  coap_slab_hdr_t *hdr;
+  uint8_t size_class = COAP_SLAB_HEAP;
+
+  if (slab_enabled)
+    size_class = coap_slab_class(size);
+  if (size_class != COAP_SLAB_HEAP) {
+    hdr = coap_slab_alloc(type, size_class);
+  } else {
+    if (size > UINT32_MAX - sizeof(coap_slab_hdr_t))
+      return NULL;
+    hdr = malloc(sizeof(coap_slab_hdr_t) + size);
+    if (hdr) {
+      hdr->h.size = (uint32_t)size;
+      hdr->h.size_class = COAP_SLAB_HEAP;
+    }
+  }
+  return hdr ? hdr + 1 : NULL;
+}
+
+static void
+coap_slab_release(coap_memory_tag_t type, void *p) {
+  coap_slab_hdr_t *hdr = (coap_slab_hdr_t *)p - 1;
+
+  if (hdr->h.size_class == COAP_SLAB_HEAP)
+    free(hdr);
+  else
+    coap_slab_free(type, hdr);
+}
+
+static void *
+coap_slab_realloc(coap_memory_tag_t type, void *p, size_t size) {
+  coap_slab_hdr_t *hdr = (coap_slab_hdr_t *)p - 1;
+  size_t old_size;
+  void *ptr;
+
+  if (hdr->h.size_class == COAP_SLAB_HEAP) {
+    if (!slab_enabled || size > COAP_SLAB_MAX_SIZE) {
+      if (size > UINT32_MAX - sizeof(coap_slab_hdr_t))
+        return NULL;
+      hdr = realloc(hdr, sizeof(coap_slab_hdr_t) + size);
+      if (!hdr)
+        return NULL;
+      hdr->h.size = (uint32_t)size;
+      return hdr + 1;
+    }
+    old_size = hdr->h.size;
+  } else {
+    old_size = slab_class_size[hdr->h.size_class];
+    if (size <= old_size)
+      return p;
+  }
+  ptr = coap_slab_malloc(type, size);
+  if (ptr) {
+    memcpy(ptr, p, old_size < size ? old_size : size);
+    coap_slab_release(type, p);
+  }
+  return ptr;
+}
+
+int
+coap_memory_set_slab(int enable) {
+  slab_enabled = enable ? 1 : 0;
+  return 1;
+}
+
+int
+coap_memory_slab_reserve(coap_memory_tag_t type, size_t size, size_t count) {
+  uint8_t size_class = coap_slab_class(size);
+  int ret;
+
+  if (type >= COAP_MEM_TAG_LAST || size_class == COAP_SLAB_HEAP || !count)
+    return 0;
+  coap_slab_lock();
+  ret = coap_slab_grow(&slab_pool[type][size_class], size_class, count);
+  coap_slab_unlock();
+  return ret;
+}
+
+static void
+coap_slab_dump(coap_log_t level) {
+  size_t t, c;
+  uint32_t num_free = 0;
+
+  coap_slab_lock();
+  for (t = 0; t < COAP_MEM_TAG_LAST; t++) {
+    for (c = 0; c < COAP_SLAB_CLASSES; c++) {
+      num_free += slab_pool[t][c].num_free;
+    }
+  }
+  coap_log(level, "*  Slab %s: %zu bytes in chunks, %u shared free objects\n",
+           slab_enabled ? "enabled" : "disabled", slab_chunk_bytes, num_free);
+  coap_slab_unlock();
+}
+
+#define coap_heap_malloc(t,s)    coap_slab_malloc(t,s)
+#define coap_heap_realloc(t,p,s) coap_slab_realloc(t,p,s)
+#define coap_heap_free(t,p)      coap_slab_release(t,p)
+
+#else /* ! COAP_MEMORY_SLAB */
+#define coap_heap_malloc(t,s)    malloc(s)
+#define coap_heap_realloc(t,p,s) realloc(p,s)
+#define coap_heap_free(t,p)      free(p)
+#endif /* ! COAP_MEMORY_SLAB */
+
 void
 coap_memory_init(void) {
 }
@@ -559,16 +970,12 @@ coap_malloc_type(coap_memory_tag_t type, size_t size) {
   void *ptr;
 
   (void)type;
-  ptr = malloc(size);
+  ptr = coap_heap_malloc(type, size);
 #if COAP_MEMORY_TYPE_TRACK
-  assert(type < COAP_MEM_TAG_LAST);
-  if (ptr) {
-    track_counts[type]++;
-    if (track_counts[type] > peak_counts[type])
-      peak_counts[type] = track_counts[type];
-  } else {
-    fail_counts[type]++;
-  }
+  if (ptr)
+    coap_track_new(type);
+  else
+    coap_track_fail(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   return ptr;
 }
@@ -578,17 +985,17 @@ coap_realloc_type(coap_memory_tag_t type, void *p, size_t size) {
   void *ptr;
 
   (void)type;
-  ptr = realloc(p, size);
+  if (p)
+    ptr = coap_heap_realloc(type, p, size);
+  else
+    ptr = coap_heap_malloc(type, size);
 #if COAP_MEMORY_TYPE_TRACK
-  if (ptr) {
-    assert(type < COAP_MEM_TAG_LAST);
-    if (!p)
-      track_counts[type]++;
-    if (track_counts[type] > peak_counts[type])
-      peak_counts[type] = track_counts[type];
-  } else {
-    fail_counts[type]++;
-  }
+  if (!ptr)
+    coap_track_fail(type);
+  else if (!p)
+    coap_track_new(type);
+  else
+    coap_track_resize(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   return ptr;
 }
@@ -597,11 +1004,11 @@ void
 coap_free_type(coap_memory_tag_t type, void *p) {
   (void)type;
 #if COAP_MEMORY_TYPE_TRACK
-  assert(type < COAP_MEM_TAG_LAST);
   if (p)
-    track_counts[type]--;
+    coap_track_free(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
-  free(p);
+  if (p)
+    coap_heap_free(type, p);
 }
 
 #else /* ! HAVE_MALLOC  && !__MINGW32__ && !__ZEPHYR__*/
@@ -618,14 +1025,10 @@ coap_malloc_type(coap_memory_tag_t type, size_t size) {
   void *ptr = heapmem_alloc(size);
 
 #if COAP_MEMORY_TYPE_TRACK
-  assert(type < COAP_MEM_TAG_LAST);
-  if (ptr) {
-    track_counts[type]++;
-    if (track_counts[type] > peak_counts[type])
-      peak_counts[type] = track_counts[type];
-  } else {
-    fail_counts[type]++;
-  }
+  if (ptr)
+    coap_track_new(type);
+  else
+    coap_track_fail(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   return ptr;
 }
@@ -634,15 +1037,12 @@ void *
 coap_realloc_type(coap_memory_tag_t type, void *p, size_t size) {
   void *ptr = heapmem_realloc(p, size);
 #if COAP_MEMORY_TYPE_TRACK
-  if (ptr) {
-    assert(type < COAP_MEM_TAG_LAST);
-    if (!p)
-      track_counts[type]++;
-    if (track_counts[type] > peak_counts[type])
-      peak_counts[type] = track_counts[type];
-  } else {
-    fail_counts[type]++;
-  }
+  if (!ptr)
+    coap_track_fail(type);
+  else if (!p)
+    coap_track_new(type);
+  else
+    coap_track_resize(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   return ptr;
 }
@@ -650,9 +1050,8 @@ coap_realloc_type(coap_memory_tag_t type, void *p, size_t size) {
 void
 coap_free_type(coap_memory_tag_t type, void *ptr) {
 #if COAP_MEMORY_TYPE_TRACK
-  assert(type < COAP_MEM_TAG_LAST);
   if (ptr)
-    track_counts[type]--;
+    coap_track_free(type);
 #endif /* COAP_MEMORY_TYPE_TRACK */
   heapmem_free(ptr);
 }
@@ -664,6 +1063,22 @@ coap_free_type(coap_memory_tag_t type, void *ptr) {
 #endif /* ! RIOT_VERSION */
 
 #ifndef WITH_LWIP
+#if !COAP_MEMORY_SLAB
+int
+coap_memory_set_slab(int enable) {
+  (void)enable;
+  return 0;
+}
+
+int
+coap_memory_slab_reserve(coap_memory_tag_t type, size_t size, size_t count) {
+  (void)type;
+  (void)size;
+  (void)count;
+  return 0;
+}
+#endif /* ! COAP_MEMORY_SLAB */
+
 #define MAKE_CASE(n) case n: name = #n; break
 void
 coap_dump_memory_type_counts(coap_log_t level) {
@@ -705,15 +1120,25 @@ coap_dump_memory_type_counts(coap_log_t level) {
       MAKE_CASE(COAP_OSCORE_EP);
       MAKE_CASE(COAP_OSCORE_BUF);
       MAKE_CASE(COAP_COSE);
+      MAKE_CASE(COAP_WORK);
+      MAKE_CASE(COAP_CACHE_EXPIRE);
+      MAKE_CASE(COAP_PROXY_EXPIRE);
     case COAP_MEM_TAG_LAST:
     default:
       break;
     }
-    coap_log(level, "*    %-20s in-use %3d peak %3d failed %2d\n",
-             name, track_counts[i], peak_counts[i], fail_counts[i]);
+    coap_log(level, "*    %-20s in-use %3d peak %3d failed %2d resized %3u\n",
+             name, coap_track_load(&track_counts[i]),
+             coap_track_load(&peak_counts[i]),
+             coap_track_load(&fail_counts[i]),
+             coap_track_load(&resize_counts[i]));
   }
-#else /* COAP_MEMORY_TYPE_TRACK */
-  (void)level;
 #endif /* COAP_MEMORY_TYPE_TRACK */
+#if COAP_MEMORY_SLAB
+  coap_slab_dump(level);
+#endif /* COAP_MEMORY_SLAB */
+#if !COAP_MEMORY_TYPE_TRACK && !COAP_MEMORY_SLAB
+  (void)level;
+#endif /* ! COAP_MEMORY_TYPE_TRACK && ! COAP_MEMORY_SLAB */
 }
 #endif /* !WITH_LWIP */
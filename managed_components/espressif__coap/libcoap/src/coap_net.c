@@ -126,35 +126,147 @@ coap_free_node(coap_queue_t *node) {
 }
 #endif /* WITH_LWIP */
 
+/*
+ * The sendqueue is a pairing heap threaded through the coap_queue_t entries,
+ * so that no additional memory is needed (nodes may come from fixed size
+ * pools). The root (context->sendqueue) is the entry that is due next.
+ * Insert is O(1), removing the root or an arbitrary entry is O(log n)
+ * amortized. Each entry is additionally held in a per session list so that
+ * the entries of a session can be found without walking the whole queue.
+ */
+
+/* Returns 1 if a is due before b. Entries due at the same time are in no
+ * particular order. */
+#define COAP_QUEUE_BEFORE(a,b) ((a)->t < (b)->t)
+
+static coap_queue_t *
+coap_queue_meld(coap_queue_t *a, coap_queue_t *b) {
+  coap_queue_t *tmp;
+
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+  if (COAP_QUEUE_BEFORE(b, a)) {
+    tmp = a;
+    a = b;
+    b = tmp;
+  }
+  /* b becomes first child of a */
+  b->h_prev = a;
+  b->h_next = a->h_child;
+  if (a->h_child)
+    a->h_child->h_prev = b;
+  a->h_child = b;
+  a->h_next = NULL;
+  a->h_prev = NULL;
+  return a;
+}
+
+/* Standard two pass combine of the sibling list starting at first */
+static coap_queue_t *
+coap_queue_merge_pairs(coap_queue_t *first) {
+  coap_queue_t *paired = NULL;
+  coap_queue_t *a, *b, *next;
+
+  /* Left to right: meld in pairs, chain the results in reverse via h_next */
+  while (first) {
+    a = first;
+    b = a->h_next;
+    next = b ? b->h_next : NULL;
+    a->h_next = a->h_prev = NULL;
+    if (b)
+      b->h_next = b->h_prev = NULL;
+    a = coap_queue_meld(a, b);
+    a->h_next = paired;
+    paired = a;
+    first = next;
+  }
+  /* Right to left: meld everything into one */
+  first = NULL;
+  while (paired) {
+    next = paired->h_next;
+    paired->h_next = NULL;
+    first = coap_queue_meld(first, paired);
+    paired = next;
+  }
+  return first;
+}
+
+int
+coap_insert_node(coap_context_t *context, coap_queue_t *node) {
+  if (!context || !node || node->in_sendqueue)
+    return 0;
+
+  node->h_child = node->h_next = node->h_prev = NULL;
+  context->sendqueue = coap_queue_meld(context->sendqueue, node);
+  node->in_sendqueue = 1;
+  if (node->session)
+    DL_APPEND2(node->session->sendqueue, node, s_prev, s_next);
+  return 1;
+}
+
+void
+coap_unlink_node(coap_context_t *context, coap_queue_t *node) {
+  if (!context || !node || !node->in_sendqueue)
+    return;
+
+  if (node == context->sendqueue) {
+    context->sendqueue = coap_queue_merge_pairs(node->h_child);
+  } else {
+    /* Cut node (and its sub-heap) out of its sibling list */
+    if (node->h_prev->h_child == node)
+      node->h_prev->h_child = node->h_next;
+    else
+      node->h_prev->h_next = node->h_next;
+    if (node->h_next)
+      node->h_next->h_prev = node->h_prev;
+    context->sendqueue = coap_queue_meld(context->sendqueue,
+                                         coap_queue_merge_pairs(node->h_child));
+  }
+  node->h_child = node->h_next = node->h_prev = NULL;
+  node->in_sendqueue = 0;
+  if (node->session)
+    DL_DELETE2(node->session->sendqueue, node, s_prev, s_next);
+  node->s_next = node->s_prev = NULL;
+}
+
 unsigned int
 coap_adjust_basetime(coap_context_t *ctx, coap_tick_t now) {
   unsigned int result = 0;
   coap_tick_diff_t delta = now - ctx->sendqueue_basetime;
+  coap_queue_t *q = ctx->sendqueue;
 
-  if (ctx->sendqueue) {
-    /* delta < 0 means that the new time stamp is before the old. */
+  /*
+   * Walk the whole heap (depth first, without recursion). Moving every
+   * entry by the same amount (and clamping timed out entries to zero) does
+   * not change the heap order.
+   * delta < 0 means that the new time stamp is before the old. For every
+   * element that has timed out, its relative time is set to zero and the
+   * result counter is increased.
+   */
+  while (q) {
     if (delta <= 0) {
-      ctx->sendqueue->t -= delta;
+      q->t -= delta;
+    } else if (q->t < (coap_tick_t)delta) {
+      q->t = 0;
+      result++;
     } else {
-      /* This case is more complex: The time must be advanced forward,
-       * thus possibly leading to timed out elements at the queue's
-       * start. For every element that has timed out, its relative
-       * time is set to zero and the result counter is increased. */
-
-      coap_queue_t *q = ctx->sendqueue;
-      coap_tick_t t = 0;
-      while (q && (t + q->t < (coap_tick_t)delta)) {
-        t += q->t;
-        q->t = 0;
-        result++;
-        q = q->next;
-      }
-
-      /* finally adjust the first element that has not expired */
-      if (q) {
-        q->t = (coap_tick_t)delta - t;
-      }
+      q->t -= delta;
+    }
+    if (q->h_child) {
+      q = q->h_child;
+      continue;
+    }
+    /* Go to the next sibling, climbing back up as necessary */
+    while (q && !q->h_next) {
+      /* Find the parent by walking back to the first child */
+      while (q->h_prev && q->h_prev->h_child != q)
+        q = q->h_prev;
+      q = q->h_prev;
     }
+    if (q)
+      q = q->h_next;
   }
 
   /* adjust basetime */
@@ -163,43 +275,6 @@ coap_adjust_basetime(coap_context_t *ctx, coap_tick_t now) {
   return result;
 }
 
-int
-coap_insert_node(coap_queue_t **queue, coap_queue_t *node) {
-  coap_queue_t *p, *q;
-  if (!queue || !node)
-    return 0;
-
-  /* set queue head if empty */
-  if (!*queue) {
-    *queue = node;
-    return 1;
-  }
-
-  /* replace queue head if PDU's time is less than head's time */
-  q = *queue;
-  if (node->t < q->t) {
-    node->next = q;
-    *queue = node;
-    q->t -= node->t;                /* make q->t relative to node->t */
-    return 1;
-  }
-
-  /* search for right place to insert */
-  do {
-    node->t -= q->t;                /* make node-> relative to q->t */
-    p = q;
-    q = q->next;
-  } while (q && q->t <= node->t);
-
-  /* insert new item */
-  if (q) {
-    q->t -= node->t;                /* make q->t relative to node->t */
-  }
-  node->next = q;
-  p->next = node;
-  return 1;
-}
-
 COAP_API int
 coap_delete_node(coap_queue_t *node) {
   int ret;
@@ -233,9 +308,7 @@ coap_delete_node_lkd(coap_queue_t *node) {
     /*
      * Need to remove out of context->sendqueue as added in by coap_wait_ack()
      */
-    if (node->session->context->sendqueue) {
-      LL_DELETE(node->session->context->sendqueue, node);
-    }
+    coap_unlink_node(node->session->context, node);
     coap_session_release_lkd(node->session);
   }
   coap_free_node(node);
@@ -244,12 +317,11 @@ coap_delete_node_lkd(coap_queue_t *node) {
 }
 
 void
-coap_delete_all(coap_queue_t *queue) {
-  if (!queue)
-    return;
+coap_delete_all(coap_context_t *context) {
+  coap_queue_t *q;
 
-  coap_delete_all(queue->next);
-  coap_delete_node_lkd(queue);
+  while ((q = coap_pop_next(context)) != NULL)
+    coap_delete_node_lkd(q);
 }
 
 coap_queue_t *
@@ -282,11 +354,7 @@ coap_pop_next(coap_context_t *context) {
     return NULL;
 
   next = context->sendqueue;
-  context->sendqueue = context->sendqueue->next;
-  if (context->sendqueue) {
-    context->sendqueue->t += next->t;
-  }
-  next->next = NULL;
+  coap_unlink_node(context, next);
   return next;
 }
 
@@ -449,14 +517,59 @@ coap_context_set_pki_root_cas_lkd(coap_context_t *ctx,
                                   const char *ca_file,
                                   const char *ca_dir) {
   if (coap_dtls_is_supported() || coap_tls_is_supported()) {
+#if COAP_CLIENT_SUPPORT
+    /* Held sessions were verified against the previous root CAs */
+    coap_dtls_resume_free_all(ctx);
+#endif /* COAP_CLIENT_SUPPORT */
     return coap_dtls_context_set_pki_root_cas(ctx, ca_file, ca_dir);
   }
   return 0;
 }
 
+COAP_API int
+coap_context_set_session_resumption(coap_context_t *ctx,
+                                    unsigned int cache_size,
+                                    unsigned int lifetime) {
+  int ret;
+
+  coap_lock_lock(ctx, return 0);
+  ret = coap_context_set_session_resumption_lkd(ctx, cache_size, lifetime);
+  coap_lock_unlock(ctx);
+  return ret;
+}
+
+int
+coap_context_set_session_resumption_lkd(coap_context_t *ctx,
+                                        unsigned int cache_size,
+                                        unsigned int lifetime) {
+  coap_lock_check_locked(ctx);
+  if (!ctx->dtls_context)
+    return cache_size == 0;
+  ctx->resume_cache_size = cache_size;
+  ctx->resume_lifetime = lifetime ? lifetime : COAP_DTLS_RESUME_LIFETIME;
+#if COAP_CLIENT_SUPPORT
+  coap_dtls_resume_trim(ctx);
+#endif /* COAP_CLIENT_SUPPORT */
+  if (!coap_dtls_context_set_resumption(ctx)) {
+    ctx->resume_cache_size = 0;
+    return cache_size == 0;
+  }
+  return 1;
+}
+
+void
+coap_context_get_handshake_stats(const coap_context_t *context,
+                                 uint64_t *full, uint64_t *resumed) {
+  if (full)
+    *full = context->tls_full_handshakes;
+  if (resumed)
+    *resumed = context->tls_resumed_handshakes;
+}
+
 void
 coap_context_set_keepalive(coap_context_t *context, unsigned int seconds) {
   context->ping_timeout = seconds;
+  context->session_timers_rescan = 1;
 }
 
 int
@@ -500,6 +613,142 @@ coap_context_get_max_handshake_sessions(const coap_context_t *context) {
   return context->max_handshake_sessions;
 }
 
+int
+coap_context_set_rx_batch_size(coap_context_t *context,
+                               unsigned int rx_batch_size) {
+#if COAP_SERVER_SUPPORT
+  if (rx_batch_size > COAP_RX_BATCH_MAX)
+    rx_batch_size = COAP_RX_BATCH_MAX;
+  /*
+   * rx_batch is re-allocated on its next use with the new size, as this may
+   * be called by a handler while the packets in rx_batch are being handled.
+   */
+  context->rx_batch_size = rx_batch_size;
+#if COAP_RECVMMSG_SUPPORT
+  return 1;
+#else /* ! COAP_RECVMMSG_SUPPORT */
+  return rx_batch_size <= 1;
+#endif /* ! COAP_RECVMMSG_SUPPORT */
+#else /* ! COAP_SERVER_SUPPORT */
+  (void)context;
+  (void)rx_batch_size;
+  return 0;
+#endif /* ! COAP_SERVER_SUPPORT */
+}
+
+unsigned int
+coap_context_get_rx_batch_size(const coap_context_t *context) {
+#if COAP_SERVER_SUPPORT
+  return context->rx_batch_size;
+#else /* ! COAP_SERVER_SUPPORT */
+  (void)context;
+  return 0;
+#endif /* ! COAP_SERVER_SUPPORT */
+}
+
+int
+coap_context_set_tx_batch_size(coap_context_t *context,
+                               unsigned int tx_batch_size) {
+#if COAP_SERVER_SUPPORT
+  if (tx_batch_size > COAP_TX_BATCH_MAX)
+    tx_batch_size = COAP_TX_BATCH_MAX;
+  /* Endpoint queues are re-allocated on next use with the new size */
+  context->tx_batch_size = tx_batch_size;
+#if COAP_SENDMMSG_SUPPORT
+  return 1;
+#else /* ! COAP_SENDMMSG_SUPPORT */
+  return tx_batch_size <= 1;
+#endif /* ! COAP_SENDMMSG_SUPPORT */
+#else /* ! COAP_SERVER_SUPPORT */
+  (void)context;
+  (void)tx_batch_size;
+  return 0;
+#endif /* ! COAP_SERVER_SUPPORT */
+}
+
+unsigned int
+coap_context_get_tx_batch_size(const coap_context_t *context) {
+#if COAP_SERVER_SUPPORT
+  return context->tx_batch_size;
+#else /* ! COAP_SERVER_SUPPORT */
+  (void)context;
+  return 0;
+#endif /* ! COAP_SERVER_SUPPORT */
+}
+
+void
+coap_context_get_tx_batch_stats(const coap_context_t *context,
+                                uint64_t *syscalls, uint64_t *packets) {
+#if COAP_SERVER_SUPPORT
+  if (syscalls)
+    *syscalls = context->tx_syscalls;
+  if (packets)
+    *packets = context->tx_packets;
+#else /* ! COAP_SERVER_SUPPORT */
+  (void)context;
+  if (syscalls)
+    *syscalls = 0;
+  if (packets)
+    *packets = 0;
+#endif /* ! COAP_SERVER_SUPPORT */
+}
+
+void
+coap_context_get_rx_batch_stats(const coap_context_t *context,
+                                uint64_t *wakeups, uint64_t *packets) {
+#if COAP_SERVER_SUPPORT
+  if (wakeups)
+    *wakeups = context->rx_wakeups;
+  if (packets)
+    *packets = context->rx_packets;
+#else /* ! COAP_SERVER_SUPPORT */
+  (void)context;
+  if (wakeups)
+    *wakeups = 0;
+  if (packets)
+    *packets = 0;
+#endif /* ! COAP_SERVER_SUPPORT */
+}
+
+int
+coap_context_set_shards(coap_context_t *context, unsigned int num_shards,
+                        coap_shard_steer_t steer) {
+#if COAP_SERVER_SUPPORT && COAP_REUSEPORT_SUPPORT
+  if (num_shards > 1) {
+    switch (steer) {
+    case COAP_SHARD_STEER_HASH:
+      break;
+    case COAP_SHARD_STEER_ADDR:
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+      break;
+#else /* ! HAVE_LINUX_FILTER_H || ! SO_ATTACH_REUSEPORT_CBPF */
+      return 0;
+#endif /* ! HAVE_LINUX_FILTER_H || ! SO_ATTACH_REUSEPORT_CBPF */
+    default:
+      return 0;
+    }
+  }
+  /* Only applies to endpoints that are created from now on */
+  context->num_shards = num_shards;
+  context->shard_steer = steer;
+  return 1;
+#else /* ! COAP_SERVER_SUPPORT || ! COAP_REUSEPORT_SUPPORT */
+  (void)context;
+  (void)steer;
+  return num_shards <= 1;
+#endif /* ! COAP_SERVER_SUPPORT || ! COAP_REUSEPORT_SUPPORT */
+}
+
+unsigned int
+coap_context_get_shards(const coap_context_t *context) {
+#if COAP_SERVER_SUPPORT && COAP_REUSEPORT_SUPPORT
+  return context->num_shards;
+#else /* ! COAP_SERVER_SUPPORT || ! COAP_REUSEPORT_SUPPORT */
+  (void)context;
+  return 0;
+#endif /* ! COAP_SERVER_SUPPORT || ! COAP_REUSEPORT_SUPPORT */
+}
+
 static unsigned int s_csm_timeout = 30;
 
 void
@@ -523,6 +772,7 @@ coap_context_set_csm_timeout_ms(coap_context_t *context,
   if (csm_timeout_ms > 10000)
     csm_timeout_ms = 10000;
   context->csm_timeout_ms = csm_timeout_ms;
+  context->session_timers_rescan = 1;
 }
 
 unsigned int
@@ -546,6 +796,7 @@ void
 coap_context_set_session_timeout(coap_context_t *context,
                                  unsigned int session_timeout) {
   context->session_timeout = session_timeout;
+  context->session_timers_rescan = 1;
 }
 
 unsigned int
@@ -658,6 +909,8 @@ coap_new_context(const coap_address_t *listen_addr) {
     return NULL;
   }
   memset(c, 0, sizeof(coap_context_t));
+  coap_lock_context_init(c);
+  coap_work_queue_init(c);
 
   coap_lock_lock(c, coap_free_type(COAP_CONTEXT, c); return NULL);
 #ifdef COAP_EPOLL_SUPPORT
@@ -719,12 +972,16 @@ coap_new_context(const coap_address_t *listen_addr) {
 #endif /* COAP_SERVER_SUPPORT */
 
   c->max_token_size = COAP_TOKEN_DEFAULT_MAX; /* RFC8974 */
+#if COAP_SERVER_SUPPORT
+  coap_prng_lkd(c->cache_seed, sizeof(c->cache_seed));
+#endif /* COAP_SERVER_SUPPORT */
 
   coap_lock_unlock(c);
   return c;
 
 #if defined(COAP_EPOLL_SUPPORT) || COAP_SERVER_SUPPORT
 onerror:
+  coap_lock_context_free(c);
   coap_free_type(COAP_CONTEXT, c);
   return NULL;
 #endif /* COAP_EPOLL_SUPPORT || COAP_SERVER_SUPPORT */
@@ -747,8 +1004,8 @@ coap_free_context(coap_context_t *context) {
   if (!context)
     return;
   coap_lock_lock(context, return);
+  /* This also unlocks (and releases) the context lock */
   coap_free_context_lkd(context);
-  coap_lock_unlock(context);
 }
 
 void
@@ -757,12 +1014,14 @@ coap_free_context_lkd(coap_context_t *context) {
     return;
 
   coap_lock_check_locked(context);
+  /* Run any work still posted, while everything is still in place */
+  coap_work_queue_free(context);
 #if COAP_SERVER_SUPPORT
   /* Removing a resource may cause a NON unsolicited observe to be sent */
   coap_delete_all_resources(context);
 #endif /* COAP_SERVER_SUPPORT */
 
-  coap_delete_all(context->sendqueue);
+  coap_delete_all(context);
 
 #ifdef WITH_LWIP
   context->sendqueue = NULL;
@@ -788,6 +1047,7 @@ coap_free_context_lkd(coap_context_t *context) {
   HASH_ITER(hh, context->cache, cp, ctmp) {
     coap_delete_cache_entry(context, cp);
   }
+  coap_free_type(COAP_CACHE_EXPIRE, context->cache_expire);
   if (context->cache_ignore_count) {
     coap_free_type(COAP_STRING, context->cache_ignore_options);
   }
@@ -797,6 +1057,8 @@ coap_free_context_lkd(coap_context_t *context) {
   LL_FOREACH_SAFE(context->endpoint, ep, tmp) {
     coap_free_endpoint_lkd(ep);
   }
+  coap_free_type(COAP_PACKET, context->rx_batch);
+  context->rx_batch = NULL;
 #endif /* COAP_SERVER_SUPPORT */
 
 #if COAP_CLIENT_SUPPORT
@@ -807,6 +1069,10 @@ coap_free_context_lkd(coap_context_t *context) {
   }
 #endif /* COAP_CLIENT_SUPPORT */
 
+#if COAP_CLIENT_SUPPORT
+  /* Held sessions belong to the (D)TLS library context */
+  coap_dtls_resume_free_all(context);
+#endif /* COAP_CLIENT_SUPPORT */
   if (context->dtls_context)
     coap_dtls_free_context(context->dtls_context);
 #ifdef COAP_EPOLL_SUPPORT
@@ -838,6 +1104,7 @@ coap_free_context_lkd(coap_context_t *context) {
   coap_proxy_cleanup(context);
 #endif /* COAP_PROXY_SUPPORT */
 
+  coap_lock_context_free(context);
   coap_free_type(COAP_CONTEXT, context);
   coap_dump_memory_type_counts(COAP_LOG_DEBUG);
 }
@@ -1150,6 +1417,8 @@ coap_wait_ack(coap_context_t *context, coap_session_t *session,
               coap_queue_t *node) {
   coap_tick_t now;
 
+  /* node->t cannot be changed while node is held in the sendqueue */
+  coap_unlink_node(context, node);
   node->session = coap_session_reference_lkd(session);
 
   /* Set timer for pdu retransmission. If this is the first element in
@@ -1170,7 +1439,7 @@ coap_wait_ack(coap_context_t *context, coap_session_t *session,
               (node->timeout << node->retransmit_cnt);
   }
 
-  coap_insert_node(&context->sendqueue, node);
+  coap_insert_node(context, node);
 
   coap_log_debug("** %s: mid=0x%04x: added to retransmit queue (%ums)\n",
                  coap_session_str(node->session), node->id,
@@ -1345,10 +1614,14 @@ coap_check_send_need_lg_crcv(coap_session_t *session, coap_pdu_t *pdu) {
 COAP_API coap_mid_t
 coap_send(coap_session_t *session, coap_pdu_t *pdu) {
   coap_mid_t mid;
+#if COAP_THREAD_SAFE
+  /* session may be released by an app event handler */
+  coap_context_t *context = session->context;
+#endif /* COAP_THREAD_SAFE */
 
-  coap_lock_lock(session->context, return COAP_INVALID_MID);
+  coap_lock_lock(context, return COAP_INVALID_MID);
   mid = coap_send_lkd(session, pdu);
-  coap_lock_unlock(session->context);
+  coap_lock_unlock(context);
   return mid;
 }
 
@@ -1682,6 +1955,8 @@ coap_send_internal(coap_session_t *session, coap_pdu_t *pdu) {
   coap_opt_iterator_t opt_iter;
 
   pdu->session = session;
+  /* May have set up or changed any large body transfer timeouts */
+  coap_session_timer_touch(session);
   if (pdu->code == COAP_RESPONSE_CODE(508)) {
     /*
      * Need to prepend our IP identifier to the data as per
@@ -1938,7 +2213,7 @@ coap_retransmit(coap_context_t *context, coap_queue_t *node) {
       /* make node->t relative to context->sendqueue_basetime */
       node->t = (now - context->sendqueue_basetime) + next_delay;
     }
-    coap_insert_node(&context->sendqueue, node);
+    coap_insert_node(context, node);
 
     if (node->is_mcast) {
       coap_log_debug("** %s: mid=0x%04x: mcast delayed transmission\n",
@@ -2081,9 +2356,8 @@ coap_write_session(coap_context_t *ctx, coap_session_t *session, coap_tick_t now
 void
 coap_read_session(coap_context_t *ctx, coap_session_t *session, coap_tick_t now) {
 #if COAP_CONSTRAINED_STACK
-  /* payload and packet can be protected by global_lock if needed */
-  static unsigned char payload[COAP_RXBUFFER_SIZE];
-  static coap_packet_t s_packet;
+  static COAP_THREAD_LOCAL unsigned char payload[COAP_RXBUFFER_SIZE];
+  static COAP_THREAD_LOCAL coap_packet_t s_packet;
 #else /* ! COAP_CONSTRAINED_STACK */
   unsigned char payload[COAP_RXBUFFER_SIZE];
   coap_packet_t s_packet;
@@ -2092,6 +2366,7 @@ coap_read_session(coap_context_t *ctx, coap_session_t *session, coap_tick_t now)
 
   assert(session->sock.flags & (COAP_SOCKET_CONNECTED | COAP_SOCKET_MULTICAST));
 
+  coap_session_timer_touch(session);
   packet->length = sizeof(payload);
   packet->payload = payload;
 
@@ -2245,14 +2520,88 @@ coap_read_session(coap_context_t *ctx, coap_session_t *session, coap_tick_t now)
 }
 
 #if COAP_SERVER_SUPPORT
+static int
+coap_read_endpoint_packet(coap_context_t *ctx, coap_endpoint_t *endpoint,
+                          coap_packet_t *packet, coap_tick_t now) {
+  int result = -1;
+  coap_session_t *session = coap_endpoint_get_session(endpoint, packet, now);
+
+  if (session) {
+    coap_log_debug("*  %s: netif: recv %4zd bytes\n",
+                   coap_session_str(session), packet->length);
+    result = coap_handle_dgram_for_proto(ctx, session, packet);
+    if (endpoint->proto == COAP_PROTO_DTLS && session->type == COAP_SESSION_TYPE_HELLO && result == 1)
+      coap_session_new_dtls_session(session, now);
+    /* Type or state may have changed */
+    coap_session_update_lru(session);
+  }
+  return result;
+}
+
+#if COAP_RECVMMSG_SUPPORT
+/*
+ * Read up to ctx->rx_batch_size datagrams from the endpoint with a single
+ * recvmmsg() call and then process them in order of arrival.
+ */
+static int
+coap_read_endpoint_batch(coap_context_t *ctx, coap_endpoint_t *endpoint,
+                         coap_tick_t now) {
+  unsigned int count = ctx->rx_batch_size;
+  unsigned int i;
+  int num_read;
+  int result = -1;
+
+  if (ctx->rx_batch && ctx->rx_batch_alloc != count) {
+    coap_free_type(COAP_PACKET, ctx->rx_batch);
+    ctx->rx_batch = NULL;
+  }
+  if (ctx->rx_batch == NULL) {
+    uint8_t *payload;
+
+    ctx->rx_batch = coap_malloc_type(COAP_PACKET,
+                                     count * (sizeof(coap_packet_t) + COAP_RXBUFFER_SIZE));
+    if (ctx->rx_batch == NULL)
+      return -1;
+    ctx->rx_batch_alloc = count;
+    payload = (uint8_t *)&ctx->rx_batch[count];
+    for (i = 0; i < count; i++) {
+      ctx->rx_batch[i].payload = payload + i * COAP_RXBUFFER_SIZE;
+    }
+  }
+  for (i = 0; i < count; i++) {
+    coap_packet_t *packet = &ctx->rx_batch[i];
+
+    /* Need to do this as there may be holes in addr_info */
+    memset(&packet->addr_info, 0, sizeof(packet->addr_info));
+    packet->length = COAP_RXBUFFER_SIZE;
+    coap_address_init(&packet->addr_info.remote);
+    coap_address_copy(&packet->addr_info.local, &endpoint->bind_addr);
+  }
+
+  num_read = coap_netif_dgrm_read_ep_batch(endpoint, ctx->rx_batch, count);
+  ctx->rx_wakeups++;
+  if (num_read < 0) {
+    if (errno != EAGAIN) {
+      coap_log_warn("*  %s: read failed\n", coap_endpoint_str(endpoint));
+    }
+    return -1;
+  }
+  ctx->rx_packets += num_read;
+  for (i = 0; i < (unsigned int)num_read; i++) {
+    if (ctx->rx_batch[i].length > 0)
+      result = coap_read_endpoint_packet(ctx, endpoint, &ctx->rx_batch[i], now);
+  }
+  return result;
+}
+#endif /* COAP_RECVMMSG_SUPPORT */
+
 static int
 coap_read_endpoint(coap_context_t *ctx, coap_endpoint_t *endpoint, coap_tick_t now) {
   ssize_t bytes_read = -1;
   int result = -1;                /* the value to be returned */
 #if COAP_CONSTRAINED_STACK
-  /* payload and e_packet can be protected by global_lock if needed */
-  static unsigned char payload[COAP_RXBUFFER_SIZE];
-  static coap_packet_t e_packet;
+  static COAP_THREAD_LOCAL unsigned char payload[COAP_RXBUFFER_SIZE];
+  static COAP_THREAD_LOCAL coap_packet_t e_packet;
 #else /* ! COAP_CONSTRAINED_STACK */
   unsigned char payload[COAP_RXBUFFER_SIZE];
   coap_packet_t e_packet;
@@ -2262,6 +2611,11 @@ coap_read_endpoint(coap_context_t *ctx, coap_endpoint_t *endpoint, coap_tick_t n
   assert(COAP_PROTO_NOT_RELIABLE(endpoint->proto));
   assert(endpoint->sock.flags & COAP_SOCKET_BOUND);
 
+#if COAP_RECVMMSG_SUPPORT
+  if (ctx->rx_batch_size > 1)
+    return coap_read_endpoint_batch(ctx, endpoint, now);
+#endif /* COAP_RECVMMSG_SUPPORT */
+
   /* Need to do this as there may be holes in addr_info */
   memset(&packet->addr_info, 0, sizeof(packet->addr_info));
   packet->length = sizeof(payload);
@@ -2270,19 +2624,14 @@ coap_read_endpoint(coap_context_t *ctx, coap_endpoint_t *endpoint, coap_tick_t n
   coap_address_copy(&packet->addr_info.local, &endpoint->bind_addr);
 
   bytes_read = coap_netif_dgrm_read_ep(endpoint, packet);
+  ctx->rx_wakeups++;
   if (bytes_read < 0) {
     if (errno != EAGAIN) {
       coap_log_warn("*  %s: read failed\n", coap_endpoint_str(endpoint));
     }
   } else if (bytes_read > 0) {
-    coap_session_t *session = coap_endpoint_get_session(endpoint, packet, now);
-    if (session) {
-      coap_log_debug("*  %s: netif: recv %4zd bytes\n",
-                     coap_session_str(session), bytes_read);
-      result = coap_handle_dgram_for_proto(ctx, session, packet);
-      if (endpoint->proto == COAP_PROTO_DTLS && session->type == COAP_SESSION_TYPE_HELLO && result == 1)
-        coap_session_new_dtls_session(session, now);
-    }
+    ctx->rx_packets++;
+    result = coap_read_endpoint_packet(ctx, endpoint, packet, now);
   }
   return result;
 }
@@ -2335,6 +2684,9 @@ coap_io_do_io_lkd(coap_context_t *ctx, coap_tick_t now) {
     if ((ep->sock.flags & COAP_SOCKET_CAN_ACCEPT) != 0)
       coap_accept_endpoint(ctx, ep, now, NULL);
 #endif /* !COAP_DISABLE_TCP */
+    /* Datagram server sessions share the endpoint socket */
+    if (COAP_PROTO_NOT_RELIABLE(ep->proto))
+      continue;
     SESSIONS_ITER_SAFE(ep->sessions, s, rtmp) {
       /* Make sure the session object is not deleted in one of the callbacks  */
       coap_session_reference_lkd(s);
@@ -2365,6 +2717,9 @@ coap_io_do_io_lkd(coap_context_t *ctx, coap_tick_t now) {
     coap_session_release_lkd(s);
   }
 #endif /* COAP_CLIENT_SUPPORT */
+
+  /* Send off any responses that have been queued up */
+  coap_io_flush_send_lkd(ctx);
 #endif /* ! COAP_EPOLL_SUPPORT */
 }
 
@@ -2488,6 +2843,9 @@ int
 coap_handle_dgram(coap_context_t *ctx, coap_session_t *session,
                   uint8_t *msg, size_t msg_len) {
 
+#ifndef WITH_LWIP
+  coap_pdu_t s_pdu;
+#endif /* ! WITH_LWIP */
   coap_pdu_t *pdu = NULL;
 
   assert(COAP_PROTO_NOT_RELIABLE(session->proto));
@@ -2504,19 +2862,35 @@ coap_handle_dgram(coap_context_t *ctx, coap_session_t *session,
     return -1;
   }
 
+#ifndef WITH_LWIP
+  /*
+   * Parse msg in place rather than copying it into a new PDU. Anything that
+   * needs to keep the PDU after coap_dispatch() (async, observe, cache etc.)
+   * takes its own copy. Need max space incase PDU is updated with updated
+   * token etc.
+   */
+  pdu = &s_pdu;
+  if (!coap_pdu_parse_borrowed(session->proto, msg, msg_len,
+                               coap_session_max_pdu_rcv_size(session), pdu)) {
+#else /* WITH_LWIP */
   /* Need max space incase PDU is updated with updated token etc. */
   pdu = coap_pdu_init(0, 0, 0, coap_session_max_pdu_rcv_size(session));
   if (!pdu)
     goto error;
 
   if (!coap_pdu_parse(session->proto, msg, msg_len, pdu)) {
+#endif /* WITH_LWIP */
     coap_handle_event_lkd(session->context, COAP_EVENT_BAD_PACKET, session);
     coap_log_warn("discard malformed PDU\n");
     goto error;
   }
 
   coap_dispatch(ctx, session, pdu);
+#ifndef WITH_LWIP
+  coap_pdu_release_borrowed(pdu);
+#else /* WITH_LWIP */
   coap_delete_pdu(pdu);
+#endif /* WITH_LWIP */
   return 0;
 
 error:
@@ -2525,49 +2899,31 @@ error:
    * https://rfc-editor.org/rfc/rfc7252#section-4.3 MAY send RST
    */
   coap_send_rst_lkd(session, pdu);
+#ifndef WITH_LWIP
+  coap_pdu_release_borrowed(pdu);
+#else /* WITH_LWIP */
   coap_delete_pdu(pdu);
+#endif /* WITH_LWIP */
   return -1;
 }
 
 int
-coap_remove_from_queue(coap_queue_t **queue, coap_session_t *session, coap_mid_t id,
+coap_remove_from_queue(coap_context_t *context, coap_session_t *session, coap_mid_t id,
                        coap_queue_t **node) {
-  coap_queue_t *p, *q;
+  coap_queue_t *q;
 
-  if (!queue || !*queue)
+  if (!context || !session)
     return 0;
 
-  /* replace queue head if PDU's time is less than head's time */
-
-  if (session == (*queue)->session && id == (*queue)->id) { /* found message id */
-    *node = *queue;
-    *queue = (*queue)->next;
-    if (*queue) {          /* adjust relative time of new queue head */
-      (*queue)->t += (*node)->t;
-    }
-    (*node)->next = NULL;
-    coap_log_debug("** %s: mid=0x%04x: removed (1)\n",
-                   coap_session_str(session), id);
-    return 1;
-  }
-
-  /* search message id queue to remove (only first occurence will be removed) */
-  q = *queue;
-  do {
-    p = q;
-    q = q->next;
-  } while (q && (session != q->session || id != q->id));
-
-  if (q) {                        /* found message id */
-    p->next = q->next;
-    if (p->next) {                /* must update relative time of p->next */
-      p->next->t += q->t;
+  /* search message id in the session's entries (only first occurence will be removed) */
+  DL_FOREACH2(session->sendqueue, q, s_next) {
+    if (id == q->id) {                  /* found message id */
+      coap_unlink_node(context, q);
+      *node = q;
+      coap_log_debug("** %s: mid=0x%04x: removed (1)\n",
+                     coap_session_str(session), id);
+      return 1;
     }
-    q->next = NULL;
-    *node = q;
-    coap_log_debug("** %s: mid=0x%04x: removed (2)\n",
-                   coap_session_str(session), id);
-    return 1;
   }
 
   return 0;
@@ -2577,11 +2933,11 @@ coap_remove_from_queue(coap_queue_t **queue, coap_session_t *session, coap_mid_t
 void
 coap_cancel_session_messages(coap_context_t *context, coap_session_t *session,
                              coap_nack_reason_t reason) {
-  coap_queue_t *p, *q;
+  coap_queue_t *q;
 
-  while (context->sendqueue && context->sendqueue->session == session) {
-    q = context->sendqueue;
-    context->sendqueue = q->next;
+  /* nack_handler() may add to or remove from the session's entries */
+  while ((q = session->sendqueue) != NULL) {
+    coap_unlink_node(context, q);
     coap_log_debug("** %s: mid=0x%04x: removed (3)\n",
                    coap_session_str(session), q->id);
     if (q->pdu->type == COAP_MESSAGE_CON && context->nack_handler) {
@@ -2591,30 +2947,6 @@ coap_cancel_session_messages(coap_context_t *context, coap_session_t *session,
     }
     coap_delete_node_lkd(q);
   }
-
-  if (!context->sendqueue)
-    return;
-
-  p = context->sendqueue;
-  q = p->next;
-
-  while (q) {
-    if (q->session == session) {
-      p->next = q->next;
-      coap_log_debug("** %s: mid=0x%04x: removed (4)\n",
-                     coap_session_str(session), q->id);
-      if (q->pdu->type == COAP_MESSAGE_CON && context->nack_handler) {
-        coap_check_update_token(session, q->pdu);
-        coap_lock_callback(context,
-                           context->nack_handler(session, q->pdu, reason, q->id));
-      }
-      coap_delete_node_lkd(q);
-      q = p->next;
-    } else {
-      p = q;
-      q = q->next;
-    }
-  }
 }
 
 void
@@ -2622,18 +2954,11 @@ coap_cancel_all_messages(coap_context_t *context, coap_session_t *session,
                          coap_bin_const_t *token) {
   /* cancel all messages in sendqueue that belong to session
    * and use the specified token */
-  coap_queue_t **p, *q;
-
-  if (!context->sendqueue)
-    return;
-
-  p = &context->sendqueue;
-  q = *p;
+  coap_queue_t *q, *tmp;
 
-  while (q) {
-    if (q->session == session &&
-        coap_binary_equal(&q->pdu->actual_token, token)) {
-      *p = q->next;
+  DL_FOREACH_SAFE2(session->sendqueue, q, tmp, s_next) {
+    if (coap_binary_equal(&q->pdu->actual_token, token)) {
+      coap_unlink_node(context, q);
       coap_log_debug("** %s: mid=0x%04x: removed (6)\n",
                      coap_session_str(session), q->id);
       if (q->pdu->type == COAP_MESSAGE_CON && session->con_active) {
@@ -2643,10 +2968,7 @@ coap_cancel_all_messages(coap_context_t *context, coap_session_t *session,
           coap_session_connected(session);
       }
       coap_delete_node_lkd(q);
-    } else {
-      p = &(q->next);
     }
-    q = *p;
   }
 }
 
@@ -3214,6 +3536,11 @@ handle_request(coap_context_t *context, coap_session_t *session, coap_pdu_t *pdu
     /* try to find the resource from the request URI */
     coap_str_const_t uri_path_c = { uri_path->length, uri_path->s };
     resource = coap_get_resource_from_uri_path_lkd(context, &uri_path_c);
+    if (resource && resource->is_template)
+      resource = NULL;
+    if (!resource && context->routes &&
+        !coap_string_equal(uri_path, &coap_default_uri_wellknown))
+      resource = coap_resource_route_lkd(context, &uri_path_c);
   }
 
   if ((resource == NULL) || (resource->is_unknown == 1) ||
@@ -3443,6 +3770,14 @@ handle_request(coap_context_t *context, coap_session_t *session, coap_pdu_t *pdu
     }
   }
 
+  if ((resource->flags & COAP_RESOURCE_FLAGS_CACHE_RESPONSE) && !observe &&
+      coap_cache_serve_response_lkd(session, resource, pdu, response)) {
+    coap_log_debug("cached response for resource '%*.*s'\n",
+                   (int)resource->uri_path->length,
+                   (int)resource->uri_path->length, resource->uri_path->s);
+    goto skip_handler;
+  }
+
   /* TODO for non-proxy requests */
   if (resource == context->proxy_uri_resource &&
       COAP_PROTO_NOT_RELIABLE(session->proto) &&
@@ -3499,6 +3834,22 @@ handle_request(coap_context_t *context, coap_session_t *session, coap_pdu_t *pdu
   /* Check if lg_xmit generated and update PDU code if so */
   coap_check_code_lg_xmit(session, pdu, response, resource, query);
 
+  if (resource->flags & COAP_RESOURCE_FLAGS_CACHE_RESPONSE) {
+    if (pdu->code != COAP_REQUEST_CODE_GET &&
+        pdu->code != COAP_REQUEST_CODE_FETCH &&
+        (response->code == COAP_RESPONSE_CODE(201) ||
+         response->code == COAP_RESPONSE_CODE(202) ||
+         response->code == COAP_RESPONSE_CODE(204))) {
+      /*
+       * The unsafe request changed the resource, so the cached responses are
+       * stale. https://rfc-editor.org/rfc/rfc7252#section-5.9
+       */
+      coap_cache_delete_resource_entries(context, resource);
+    } else {
+      coap_cache_add_response_lkd(session, resource, pdu, response);
+    }
+  }
+
   if (free_lg_srcv) {
     /* Check to see if the server is doing a 4.01 + Echo response */
     if (response->code ==  COAP_RESPONSE_CODE(401) &&
@@ -3899,7 +4250,7 @@ coap_dispatch(coap_context_t *context, coap_session_t *session,
       coap_send_message_type_lkd(session, pdu, COAP_MESSAGE_RST);
     }
     /* find message id in sendqueue to stop retransmission */
-    coap_remove_from_queue(&context->sendqueue, session, pdu->mid, &sent);
+    coap_remove_from_queue(context, session, pdu->mid, &sent);
     goto cleanup;
   }
 
@@ -3967,7 +4318,7 @@ coap_dispatch(coap_context_t *context, coap_session_t *session,
 #endif /* COAP_SERVER_SUPPORT */
     if (decrypt) {
       /* find message id in sendqueue to stop retransmission and get sent */
-      coap_remove_from_queue(&context->sendqueue, session, pdu->mid, &sent);
+      coap_remove_from_queue(context, session, pdu->mid, &sent);
       if ((dec_pdu = coap_oscore_decrypt_pdu(session, pdu)) == NULL) {
         if (session->recipient_ctx == NULL ||
             session->recipient_ctx->initial_state == 0) {
@@ -3988,7 +4339,7 @@ coap_dispatch(coap_context_t *context, coap_session_t *session,
   switch (pdu->type) {
   case COAP_MESSAGE_ACK:
     /* find message id in sendqueue to stop retransmission */
-    coap_remove_from_queue(&context->sendqueue, session, pdu->mid, &sent);
+    coap_remove_from_queue(context, session, pdu->mid, &sent);
 
     if (sent && session->con_active) {
       session->con_active--;
@@ -4131,7 +4482,7 @@ coap_dispatch(coap_context_t *context, coap_session_t *session,
     }
 
     /* find message id in sendqueue to stop retransmission */
-    coap_remove_from_queue(&context->sendqueue, session, pdu->mid, &sent);
+    coap_remove_from_queue(context, session, pdu->mid, &sent);
 
     if (sent) {
       coap_cancel(context, sent);
@@ -4181,7 +4532,7 @@ coap_dispatch(coap_context_t *context, coap_session_t *session,
 
   case COAP_MESSAGE_NON:
     /* find transaction in sendqueue in case large response */
-    coap_remove_from_queue(&context->sendqueue, session, pdu->mid, &sent);
+    coap_remove_from_queue(context, session, pdu->mid, &sent);
     /* check for unknown critical options */
     if (coap_option_check_critical(session, pdu, &opt_filter) == 0) {
       packet_is_bad = 1;
@@ -4296,6 +4647,8 @@ coap_event_name(coap_event_t event) {
     return "COAP_EVENT_DTLS_CONNECTED";
   case COAP_EVENT_DTLS_RENEGOTIATE:
     return "COAP_EVENT_DTLS_RENEGOTIATE";
+  case COAP_EVENT_DTLS_RESUMED:
+    return "COAP_EVENT_DTLS_RESUMED";
   case COAP_EVENT_DTLS_ERROR:
     return "COAP_EVENT_DTLS_ERROR";
   case COAP_EVENT_TCP_CONNECTED:
@@ -4364,6 +4717,9 @@ coap_handle_event_lkd(coap_context_t *context, coap_event_t event,
                       coap_session_t *session) {
   coap_log_debug("***EVENT: %s\n", coap_event_name(event));
 
+  /* Session state may have changed */
+  coap_session_timer_touch(session);
+
   if (context->handle_event) {
     int ret;
 
@@ -4445,7 +4801,8 @@ int coap_started = 0;
 
 #if COAP_THREAD_SAFE
 /*
- * Global lock for multi-thread support
+ * Lock for multi-thread support of the state that is not part of a
+ * context (each context has its own lock)
  */
 coap_lock_t global_lock;
 #endif /* COAP_THREAD_SAFE */
@@ -114,6 +114,32 @@ coap_netif_dgrm_read_ep(coap_endpoint_t *endpoint, coap_packet_t *packet) {
   }
   return bytes_read;
 }
+
+#if COAP_RECVMMSG_SUPPORT
+/*
+ * dgram
+ * return +ve Number of packets read.
+ *          0 Nothing read.
+ *         -1 Error error in errno).
+ */
+int
+coap_netif_dgrm_read_ep_batch(coap_endpoint_t *endpoint,
+                              coap_packet_t *packets, unsigned int count) {
+  int num_read;
+  int keep_errno;
+
+  num_read = coap_socket_recv_batch(&endpoint->sock, packets, count);
+  keep_errno = errno;
+  if (num_read == -1) {
+    coap_log_debug("*  %s: netif: failed to read up to %u packets (%s)\n",
+                   coap_endpoint_str(endpoint), count,
+                   coap_socket_strerror());
+    errno = keep_errno;
+  }
+  /* Let the caller do the logging as session available by then */
+  return num_read;
+}
+#endif /* COAP_RECVMMSG_SUPPORT */
 #endif /* COAP_SERVER_SUPPORT */
 
 /*
@@ -133,9 +159,14 @@ coap_netif_dgrm_write(coap_session_t *session, const uint8_t *data,
     assert(session->endpoint != NULL);
     sock = &session->endpoint->sock;
   }
+#if COAP_SENDMMSG_SUPPORT
+  if (sock != &session->sock && session->context->tx_batch_size > 1)
+    bytes_written = coap_socket_send_queue(session->endpoint, session, data,
+                                           datalen);
+  else
+#endif /* COAP_SENDMMSG_SUPPORT */
 #endif /* COAP_SERVER_SUPPORT */
-
-  bytes_written = coap_socket_send(sock, session, data, datalen);
+    bytes_written = coap_socket_send(sock, session, data, datalen);
   keep_errno = errno;
   if (bytes_written <= 0) {
     coap_log_debug("*  %s: netif: failed to send %zd bytes (%s) state %d\n",
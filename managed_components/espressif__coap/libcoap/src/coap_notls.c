@@ -96,6 +96,11 @@ coap_dtls_set_cid_tuple_change(coap_context_t *c_context, uint8_t every) {
 }
 #endif /* COAP_CLIENT_SUPPORT */
 
+int
+coap_dtls_context_set_resumption(coap_context_t *c_context COAP_UNUSED) {
+  return 0;
+}
+
 coap_tls_version_t *
 coap_get_tls_library_version(void) {
   static coap_tls_version_t version;
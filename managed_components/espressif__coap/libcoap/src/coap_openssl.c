@@ -158,6 +158,13 @@ typedef struct psk_sni_entry {
   coap_dtls_spsk_info_t psk_info;
 } psk_sni_entry;
 
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+/* Session ticket key name, HMAC secret and AES key */
+#define COAP_OPENSSL_TICKET_KEYS_LEN 80
+#else /* OPENSSL_VERSION_NUMBER < 0x10101000L */
+#define COAP_OPENSSL_TICKET_KEYS_LEN 48
+#endif /* OPENSSL_VERSION_NUMBER < 0x10101000L */
+
 typedef struct coap_openssl_context_t {
   coap_dtls_context_t dtls;
 #if !COAP_DISABLE_TCP
@@ -165,6 +172,12 @@ typedef struct coap_openssl_context_t {
 #endif /* !COAP_DISABLE_TCP */
   coap_dtls_pki_t setup_data;
   int psk_pki_enabled;
+  unsigned int resume_cache_size; /* 0 if resumption disabled */
+  unsigned int resume_lifetime;
+#if COAP_SERVER_SUPPORT
+  unsigned char ticket_keys[COAP_OPENSSL_TICKET_KEYS_LEN];
+  coap_tick_t ticket_key_time;
+#endif /* COAP_SERVER_SUPPORT */
   size_t sni_count;
   sni_entry *sni_entry_list;
 #if OPENSSL_VERSION_NUMBER < 0x10101000L
@@ -897,7 +910,7 @@ ssl_function_definition(unsigned long e) {
   (void)e;
   return "";
 #else /* OPENSSL_VERSION_NUMBER < 0x30000000L */
-  static char buff[80];
+  static COAP_THREAD_LOCAL char buff[80];
 
   snprintf(buff, sizeof(buff), " at %s:%s",
            ERR_lib_error_string(e), ERR_func_error_string(e));
@@ -1117,6 +1130,64 @@ timer_cb(SSL *s, unsigned int timer_us) {
 #endif /* OPENSSL_VERSION_NUMBER >= 0x10101000L */
 #endif /* COAP_DTLS_RETRANSMIT_MS != 1000 */
 
+/*
+ * Apply the resumption settings to ctx. Until enabled, sessions are neither
+ * cached nor are tickets issued, as no client session is ever resumed.
+ */
+static void
+setup_resumption(coap_openssl_context_t *context, SSL_CTX *ctx) {
+  if (context->resume_cache_size) {
+    static const unsigned char sid_ctx[] = "libcoap";
+
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, context->resume_cache_size);
+    SSL_CTX_set_timeout(ctx, context->resume_lifetime);
+    /* Required for resumption when the client's certificate is verified */
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+#if COAP_SERVER_SUPPORT
+    SSL_CTX_set_tlsext_ticket_keys(ctx, context->ticket_keys,
+                                   sizeof(context->ticket_keys));
+#endif /* COAP_SERVER_SUPPORT */
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  /* The client only holds on to the latest TLS1.3 ticket */
+  SSL_CTX_set_num_tickets(ctx, context->resume_cache_size ? 1 : 0);
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10101000L */
+}
+
+#if COAP_SERVER_SUPPORT
+/*
+ * Change the session ticket keys if they have been in use for longer than
+ * the resumption lifetime. Tickets issued with the previous keys can no
+ * longer be resumed, and a full handshake takes place instead.
+ */
+static void
+rotate_ticket_keys(coap_openssl_context_t *context) {
+  coap_tick_t now;
+
+  if (!context->resume_cache_size)
+    return;
+  coap_ticks(&now);
+  if (context->ticket_key_time &&
+      now - context->ticket_key_time <
+      context->resume_lifetime * COAP_TICKS_PER_SECOND)
+    return;
+  if (!RAND_bytes(context->ticket_keys, (int)sizeof(context->ticket_keys)))
+    coap_prng_lkd(context->ticket_keys, sizeof(context->ticket_keys));
+  context->ticket_key_time = now ? now : 1;
+  SSL_CTX_set_tlsext_ticket_keys(context->dtls.ctx, context->ticket_keys,
+                                 sizeof(context->ticket_keys));
+#if !COAP_DISABLE_TCP
+  SSL_CTX_set_tlsext_ticket_keys(context->tls.ctx, context->ticket_keys,
+                                 sizeof(context->ticket_keys));
+#endif /* !COAP_DISABLE_TCP */
+}
+#endif /* COAP_SERVER_SUPPORT */
+
 void *
 coap_dtls_new_context(coap_context_t *coap_context) {
   coap_openssl_context_t *context;
@@ -1153,6 +1224,7 @@ coap_dtls_new_context(coap_context_t *coap_context) {
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
     SSL_CTX_set_options(context->dtls.ctx, SSL_OP_LEGACY_SERVER_CONNECT);
 #endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+    setup_resumption(context, context->dtls.ctx);
     context->dtls.meth = BIO_meth_new(BIO_TYPE_DGRAM, "coapdgram");
     if (!context->dtls.meth)
       goto error;
@@ -1175,6 +1247,7 @@ coap_dtls_new_context(coap_context_t *coap_context) {
     SSL_CTX_set_min_proto_version(context->tls.ctx, TLS1_VERSION);
     coap_set_user_prefs(context->tls.ctx);
     SSL_CTX_set_info_callback(context->tls.ctx, coap_dtls_info_callback);
+    setup_resumption(context, context->tls.ctx);
     context->tls.meth = BIO_meth_new(BIO_TYPE_SOCKET, "coapsock");
     if (!context->tls.meth)
       goto error;
@@ -2503,7 +2576,7 @@ tls_verify_call_back(int preverify_ok, X509_STORE_CTX *ctx) {
     if (base_buf) {
       /* base_buf2 gets moved to the end */
       assert(i2d_X509(x509, &base_buf2) > 0);
-      coap_lock_callback_ret(ret, c_session->context,
+      coap_lock_callback_ret(ret, session->context,
                              setup_data->validate_cn_call_back(cn, base_buf, length, session,
                                                                depth, preverify_ok,
                                                                setup_data->cn_call_back_arg));
@@ -2989,7 +3062,7 @@ is_x509:
        */
       coap_dtls_key_t *new_entry;
 
-      coap_lock_callback_ret(new_entry, c_session->context,
+      coap_lock_callback_ret(new_entry, session->context,
                              setup_data->validate_sni_call_back(sni,
                                                                 setup_data->sni_call_back_arg));
       if (!new_entry) {
@@ -3376,17 +3449,38 @@ coap_dtls_free_context(void *handle) {
   coap_free_type(COAP_STRING, context);
 }
 
+int
+coap_dtls_context_set_resumption(coap_context_t *c_context) {
+  coap_openssl_context_t *context =
+      ((coap_openssl_context_t *)c_context->dtls_context);
+
+  context->resume_cache_size = c_context->resume_cache_size;
+  context->resume_lifetime = c_context->resume_lifetime;
+#if COAP_SERVER_SUPPORT
+  context->ticket_key_time = 0;
+  rotate_ticket_keys(context);
+#endif /* COAP_SERVER_SUPPORT */
+  setup_resumption(context, context->dtls.ctx);
+#if !COAP_DISABLE_TCP
+  setup_resumption(context, context->tls.ctx);
+#endif /* !COAP_DISABLE_TCP */
+  return 1;
+}
+
 #if COAP_SERVER_SUPPORT
 void *
 coap_dtls_new_server_session(coap_session_t *session) {
   BIO *nbio = NULL;
   SSL *nssl = NULL, *ssl = NULL;
   coap_ssl_data *data;
-  coap_dtls_context_t *dtls = &((coap_openssl_context_t *)session->context->dtls_context)->dtls;
+  coap_openssl_context_t *context =
+      ((coap_openssl_context_t *)session->context->dtls_context);
+  coap_dtls_context_t *dtls = &context->dtls;
   int r;
   const coap_bin_const_t *psk_hint;
   BIO *rbio;
 
+  rotate_ticket_keys(context);
   nssl = SSL_new(dtls->ctx);
   if (!nssl)
     goto error;
@@ -3444,13 +3538,84 @@ error:
 }
 #endif /* COAP_SERVER_SUPPORT */
 
+/*
+ * OpenSSL hands TLS1.3 ticket identities to the PSK callbacks, so a TLS1.3
+ * session using PSK cannot be resumed, and is reported as reused instead.
+ */
+static int
+is_tls13_psk(coap_session_t *session, SSL *ssl) {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  coap_openssl_context_t *context =
+      ((coap_openssl_context_t *)session->context->dtls_context);
+
+  return SSL_version(ssl) == TLS1_3_VERSION &&
+         (context->psk_pki_enabled & IS_PSK);
+#else /* OPENSSL_VERSION_NUMBER < 0x10101000L */
+  (void)session;
+  (void)ssl;
+  return 0;
+#endif /* OPENSSL_VERSION_NUMBER < 0x10101000L */
+}
+
 #if COAP_CLIENT_SUPPORT
+static void
+free_resume_data(void *data) {
+  SSL_SESSION_free((SSL_SESSION *)data);
+}
+
+/*
+ * Hold the client's session so that a later session to the same server
+ * can resume it.
+ */
+static void
+hold_client_session(coap_session_t *session, SSL *ssl) {
+  SSL_SESSION *resume;
+
+  if (!session->context->resume_cache_size || is_tls13_psk(session, ssl))
+    return;
+  resume = SSL_get1_session(ssl);
+  if (!resume)
+    return;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  /* A TLS1.3 session can only be resumed once a ticket has been received */
+  if (!SSL_SESSION_is_resumable(resume)) {
+    SSL_SESSION_free(resume);
+    return;
+  }
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10101000L */
+  coap_dtls_resume_store(session,
+                         SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name),
+                         resume, free_resume_data);
+}
+
+/* Update the client's held session as its ssl is about to be freed */
+static void
+release_client_session(coap_session_t *session, SSL *ssl) {
+  if (!session->context->resume_cache_size)
+    return;
+  if (SSL_is_init_finished(ssl)) {
+    /* A TLS1.3 ticket may have arrived after the handshake */
+    hold_client_session(session, ssl);
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  else if (SSL_get_session(ssl) &&
+           SSL_SESSION_is_resumable(SSL_get_session(ssl))) {
+    /* Do not offer it again if it was the cause of the failure */
+    coap_dtls_resume_remove(session,
+                            SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name));
+  }
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10101000L */
+}
+
 static int
 setup_client_ssl_session(coap_session_t *session, SSL *ssl
                         ) {
   coap_openssl_context_t *context =
       ((coap_openssl_context_t *)session->context->dtls_context);
+  SSL_SESSION *resume;
 
+  /* The server's session ID context does not apply to client sessions */
+  SSL_set_session_id_context(ssl, NULL, 0);
   if (context->psk_pki_enabled & IS_PSK) {
     coap_dtls_cpsk_t *setup_data = &session->cpsk_setup_data;
 
@@ -3545,6 +3710,12 @@ setup_client_ssl_session(coap_session_t *session, SSL *ssl
   }
 #endif /* OPENSSL_VERSION_NUMBER >= 0x10101000L */
 #endif /* COAP_DTLS_RETRANSMIT_MS != 1000 */
+
+  resume = coap_dtls_resume_find(session,
+                                 SSL_get_servername(ssl,
+                                                    TLSEXT_NAMETYPE_host_name));
+  if (resume)
+    SSL_set_session(ssl, resume);
   return 1;
 }
 
@@ -3604,6 +3775,17 @@ coap_dtls_session_update_mtu(coap_session_t *session) {
 }
 #endif /* COAP_CLIENT_SUPPORT */
 
+/* Account for the completed handshake of session */
+static void
+handshake_done(coap_session_t *session, SSL *ssl) {
+  coap_dtls_handshake_done(session, SSL_session_reused(ssl) &&
+                           !is_tls13_psk(session, ssl));
+#if COAP_CLIENT_SUPPORT
+  if (session->type == COAP_SESSION_TYPE_CLIENT)
+    hold_client_session(session, ssl);
+#endif /* COAP_CLIENT_SUPPORT */
+}
+
 void
 coap_dtls_free_session(coap_session_t *session) {
   SSL *ssl = (SSL *)session->tls;
@@ -3613,6 +3795,10 @@ coap_dtls_free_session(coap_session_t *session) {
       if (r == 0)
         SSL_shutdown(ssl);
     }
+#if COAP_CLIENT_SUPPORT
+    if (session->type == COAP_SESSION_TYPE_CLIENT)
+      release_client_session(session, ssl);
+#endif /* COAP_CLIENT_SUPPORT */
     SSL_free(ssl);
     session->tls = NULL;
     if (session->context)
@@ -3811,6 +3997,7 @@ retry:
       if (in_init && SSL_is_init_finished(ssl)) {
         coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                       coap_session_str(session), SSL_get_cipher_name(ssl));
+        handshake_done(session, ssl);
         coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
         session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
       }
@@ -3966,6 +4153,7 @@ coap_tls_new_client_session(coap_session_t *session) {
 
   session->tls = ssl;
   if (SSL_is_init_finished(ssl)) {
+    handshake_done(session, ssl);
     coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
     session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
   }
@@ -3984,13 +4172,21 @@ void *
 coap_tls_new_server_session(coap_session_t *session) {
   BIO *bio = NULL;
   SSL *ssl = NULL;
-  coap_tls_context_t *tls = &((coap_openssl_context_t *)session->context->dtls_context)->tls;
+  coap_openssl_context_t *context =
+      ((coap_openssl_context_t *)session->context->dtls_context);
+  coap_tls_context_t *tls = &context->tls;
   int r;
   const coap_bin_const_t *psk_hint;
 
+  rotate_ticket_keys(context);
   ssl = SSL_new(tls->ctx);
   if (!ssl)
     goto error;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  if (context->psk_pki_enabled & IS_PSK)
+    /* The tickets could not be resumed */
+    SSL_set_num_tickets(ssl, 0);
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10101000L */
   bio = BIO_new(tls->meth);
   if (!bio)
     goto error;
@@ -4036,6 +4232,7 @@ coap_tls_new_server_session(coap_session_t *session) {
 
   session->tls = ssl;
   if (SSL_is_init_finished(ssl)) {
+    handshake_done(session, ssl);
     coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
     session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
   }
@@ -4066,6 +4263,10 @@ coap_tls_free_session(coap_session_t *session) {
       if (r == 0)
         SSL_shutdown(ssl);
     }
+#if COAP_CLIENT_SUPPORT
+    if (session->type == COAP_SESSION_TYPE_CLIENT)
+      release_client_session(session, ssl);
+#endif /* COAP_CLIENT_SUPPORT */
     SSL_free(ssl);
     session->tls = NULL;
     if (session->context)
@@ -4097,6 +4298,7 @@ coap_tls_write(coap_session_t *session, const uint8_t *data, size_t data_len) {
       if (in_init && SSL_is_init_finished(ssl)) {
         coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                       coap_session_str(session), SSL_get_cipher_name(ssl));
+        handshake_done(session, ssl);
         coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
         session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
       }
@@ -4132,6 +4334,7 @@ coap_tls_write(coap_session_t *session, const uint8_t *data, size_t data_len) {
   } else if (in_init && SSL_is_init_finished(ssl)) {
     coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                   coap_session_str(session), SSL_get_cipher_name(ssl));
+    handshake_done(session, ssl);
     coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
     session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
   }
@@ -4183,6 +4386,7 @@ coap_tls_read(coap_session_t *session, uint8_t *data, size_t data_len) {
       if (in_init && SSL_is_init_finished(ssl)) {
         coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                       coap_session_str(session), SSL_get_cipher_name(ssl));
+        handshake_done(session, ssl);
         coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
         session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
       }
@@ -4218,6 +4422,7 @@ coap_tls_read(coap_session_t *session, uint8_t *data, size_t data_len) {
   } else if (in_init && SSL_is_init_finished(ssl)) {
     coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                   coap_session_str(session), SSL_get_cipher_name(ssl));
+    handshake_done(session, ssl);
     coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
     session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
   }
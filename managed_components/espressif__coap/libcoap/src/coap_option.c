@@ -552,6 +552,9 @@ coap_add_optlist_pdu(coap_pdu_t *pdu, coap_optlist_t **options) {
   coap_optlist_t *opt;
 
   if (options && *options) {
+    size_t size = pdu->used_size;
+    coap_option_num_t prev = pdu->max_opt;
+
     if (pdu->data) {
       coap_log_warn("coap_add_optlist_pdu: PDU already contains data\n");
       return 0;
@@ -559,6 +562,22 @@ coap_add_optlist_pdu(coap_pdu_t *pdu, coap_optlist_t **options) {
     /* sort options for delta encoding */
     LL_SORT((*options), order_opts);
 
+    /*
+     * Grow the PDU once for all the options. An option that has to be
+     * inserted before one already in the PDU may also lengthen the delta of
+     * the option following it.
+     */
+    LL_FOREACH((*options), opt) {
+      if (opt->number >= prev) {
+        size += coap_opt_encode_size(opt->number - prev, opt->length);
+        prev = opt->number;
+      } else {
+        size += coap_opt_encode_size(opt->number, opt->length) + 2;
+      }
+    }
+    if (size > pdu->alloc_size && !coap_pdu_reserve(pdu, size))
+      return 0;
+
     LL_FOREACH((*options), opt) {
       if (!coap_add_option_internal(pdu, opt->number, opt->length, opt->data))
         return 0;
@@ -83,6 +83,7 @@ coap_pdu_from_pbuf(struct pbuf *pbuf) {
     return NULL;
   }
 
+  pdu->borrowed = 0;
   pdu->max_hdr_size = COAP_PDU_MAX_UDP_HEADER_SIZE;
   pdu->pbuf = pbuf;
   pdu->token = (uint8_t *)pbuf->payload + pdu->max_hdr_size;
@@ -117,6 +118,7 @@ coap_pdu_init(coap_pdu_type_t type, coap_pdu_code_t code, coap_mid_t mid,
   pdu = coap_malloc_type(COAP_PDU, sizeof(coap_pdu_t));
   if (!pdu)
     return NULL;
+  pdu->borrowed = 0;
 
 #if defined(WITH_CONTIKI) || defined(WITH_LWIP)
   assert(size <= COAP_DEFAULT_MAX_PDU_RX_SIZE);
@@ -181,13 +183,41 @@ coap_delete_pdu(coap_pdu_t *pdu) {
 #ifdef WITH_LWIP
     pbuf_free(pdu->pbuf);
 #else
-    if (pdu->token != NULL)
+    if (pdu->token != NULL && !pdu->borrowed)
       coap_free_type(COAP_PDU_BUF, pdu->token - pdu->max_hdr_size);
 #endif
     coap_free_type(COAP_PDU, pdu);
   }
 }
 
+#ifndef WITH_LWIP
+int
+coap_pdu_parse_borrowed(coap_proto_t proto, uint8_t *data, size_t length,
+                        size_t max_size, coap_pdu_t *pdu) {
+  size_t hdr_size;
+
+  memset(pdu, 0, sizeof(coap_pdu_t));
+  if (length == 0)
+    return 0;
+  hdr_size = coap_pdu_parse_header_size(proto, data);
+  if (hdr_size < COAP_PDU_MAX_UDP_HEADER_SIZE || hdr_size > length)
+    return 0;
+  pdu->borrowed = 1;
+  pdu->max_hdr_size = (uint8_t)hdr_size;
+  pdu->token = data + hdr_size;
+  pdu->alloc_size = length - hdr_size;
+  coap_pdu_clear(pdu, max_size);
+  return coap_pdu_parse(proto, data, length, pdu);
+}
+
+void
+coap_pdu_release_borrowed(coap_pdu_t *pdu) {
+  if (pdu->token != NULL && !pdu->borrowed)
+    coap_free_type(COAP_PDU_BUF, pdu->token - pdu->max_hdr_size);
+  pdu->token = NULL;
+}
+#endif /* ! WITH_LWIP */
+
 COAP_API coap_pdu_t *
 coap_pdu_duplicate(const coap_pdu_t *old_pdu,
                    coap_session_t *session,
@@ -295,9 +325,25 @@ coap_pdu_resize(coap_pdu_t *pdu, size_t new_size) {
     } else {
       offset = 0;
     }
-    new_hdr = (uint8_t *)coap_realloc_type(COAP_PDU_BUF,
-                                           pdu->token - pdu->max_hdr_size,
-                                           new_size + pdu->max_hdr_size);
+    if (pdu->borrowed) {
+      /* Copy out of the caller's buffer, with full header space */
+      uint8_t hdr_size = pdu->max_hdr_size;
+
+      new_hdr = (uint8_t *)coap_malloc_type(COAP_PDU_BUF,
+                                            new_size + COAP_PDU_MAX_TCP_HEADER_SIZE);
+      if (new_hdr == NULL) {
+        coap_log_warn("coap_pdu_resize: malloc failed\n");
+        return 0;
+      }
+      memcpy(new_hdr + COAP_PDU_MAX_TCP_HEADER_SIZE - hdr_size,
+             pdu->token - hdr_size, hdr_size + pdu->used_size);
+      pdu->max_hdr_size = COAP_PDU_MAX_TCP_HEADER_SIZE;
+      pdu->borrowed = 0;
+    } else {
+      new_hdr = (uint8_t *)coap_realloc_type(COAP_PDU_BUF,
+                                             pdu->token - pdu->max_hdr_size,
+                                             new_size + pdu->max_hdr_size);
+    }
     if (new_hdr == NULL) {
       coap_log_warn("coap_pdu_resize: realloc failed\n");
       return 0;
@@ -314,8 +360,8 @@ coap_pdu_resize(coap_pdu_t *pdu, size_t new_size) {
     else
       pdu->actual_token.s = &pdu->token[2];
 #endif
+    pdu->alloc_size = new_size;
   }
-  pdu->alloc_size = new_size;
   return 1;
 }
 
@@ -336,6 +382,14 @@ coap_pdu_check_resize(coap_pdu_t *pdu, size_t size) {
   return 1;
 }
 
+int
+coap_pdu_reserve(coap_pdu_t *pdu, size_t size) {
+  assert(pdu);
+  if (pdu->max_size && size > pdu->max_size)
+    size = pdu->max_size;
+  return coap_pdu_resize(pdu, size);
+}
+
 int
 coap_add_token(coap_pdu_t *pdu, size_t len, const uint8_t *data) {
   size_t bias = 0;
@@ -1373,7 +1427,7 @@ coap_pdu_parse_opt(coap_pdu_t *pdu) {
        * error options which are prefixed by *
        * Two rows - hex and ascii (if printable)
        */
-      static char outbuf[COAP_DEBUG_BUF_SIZE];
+      static COAP_THREAD_LOCAL char outbuf[COAP_DEBUG_BUF_SIZE];
       char *obp;
       size_t tlen;
       size_t outbuflen;
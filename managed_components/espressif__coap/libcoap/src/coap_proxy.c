@@ -23,24 +23,236 @@
 #define strncasecmp _strnicmp
 #endif
 
+/* Longest upstream host name (RFC7252 Uri-Host) */
+#define COAP_PROXY_MAX_HOST_LEN 255
+
 int
 coap_proxy_is_supported(void) {
   return 1;
 }
 
+/*
+ * The proxy entries that have an idle timeout are kept in a binary min-heap
+ * ordered by when they go idle, so only the ones that are due need to be
+ * looked at.
+ */
+#define PROXY_DEADLINE(e) ((e)->last_used + (e)->idle_timeout_ticks)
+
+static void
+coap_proxy_expire_set(coap_context_t *context, size_t idx,
+                      coap_proxy_list_t *proxy_entry) {
+  context->proxy_expire[idx] = proxy_entry;
+  proxy_entry->expire_idx = idx + 1;
+}
+
+static void
+coap_proxy_expire_up(coap_context_t *context, size_t idx) {
+  coap_proxy_list_t *proxy_entry = context->proxy_expire[idx];
+
+  while (idx) {
+    size_t parent = (idx - 1) / 2;
+
+    if (PROXY_DEADLINE(context->proxy_expire[parent]) <=
+        PROXY_DEADLINE(proxy_entry))
+      break;
+    coap_proxy_expire_set(context, idx, context->proxy_expire[parent]);
+    idx = parent;
+  }
+  coap_proxy_expire_set(context, idx, proxy_entry);
+}
+
+static void
+coap_proxy_expire_down(coap_context_t *context, size_t idx) {
+  coap_proxy_list_t *proxy_entry = context->proxy_expire[idx];
+
+  while (1) {
+    size_t child = 2 * idx + 1;
+
+    if (child >= context->proxy_expire_count)
+      break;
+    if (child + 1 < context->proxy_expire_count &&
+        PROXY_DEADLINE(context->proxy_expire[child + 1]) <
+        PROXY_DEADLINE(context->proxy_expire[child]))
+      child++;
+    if (PROXY_DEADLINE(proxy_entry) <=
+        PROXY_DEADLINE(context->proxy_expire[child]))
+      break;
+    coap_proxy_expire_set(context, idx, context->proxy_expire[child]);
+    idx = child;
+  }
+  coap_proxy_expire_set(context, idx, proxy_entry);
+}
+
+static int
+coap_proxy_expire_add(coap_context_t *context, coap_proxy_list_t *proxy_entry) {
+  if (context->proxy_expire_count == context->proxy_expire_max) {
+    size_t max = context->proxy_expire_max ? 2 * context->proxy_expire_max : 16;
+    coap_proxy_list_t **heap;
+
+    heap = coap_realloc_type(COAP_PROXY_EXPIRE, context->proxy_expire,
+                             max * sizeof(heap[0]));
+    if (!heap)
+      return 0;
+    context->proxy_expire = heap;
+    context->proxy_expire_max = max;
+  }
+  context->proxy_expire[context->proxy_expire_count++] = proxy_entry;
+  coap_proxy_expire_up(context, context->proxy_expire_count - 1);
+  return 1;
+}
+
+static void
+coap_proxy_expire_remove(coap_context_t *context,
+                         coap_proxy_list_t *proxy_entry) {
+  size_t idx = proxy_entry->expire_idx - 1;
+  coap_proxy_list_t *last;
+
+  proxy_entry->expire_idx = 0;
+  last = context->proxy_expire[--context->proxy_expire_count];
+  if (last == proxy_entry)
+    return;
+  coap_proxy_expire_set(context, idx, last);
+  if (idx &&
+      PROXY_DEADLINE(context->proxy_expire[(idx - 1) / 2]) >
+      PROXY_DEADLINE(last))
+    coap_proxy_expire_up(context, idx);
+  else
+    coap_proxy_expire_down(context, idx);
+}
+
+/* The deadline can only move later, so it only needs to sink in the heap */
+static void
+coap_proxy_touch(coap_context_t *context, coap_proxy_list_t *proxy_entry) {
+  coap_ticks(&proxy_entry->last_used);
+  if (proxy_entry->expire_idx)
+    coap_proxy_expire_down(context, proxy_entry->expire_idx - 1);
+}
+
+static void
+coap_proxy_release_upstream(coap_context_t *context,
+                            coap_proxy_upstream_t *upstream) {
+  if (upstream->session_count == 0) {
+    HASH_DELETE(hh, context->proxy_upstreams, upstream);
+    coap_free_type(COAP_STRING, upstream);
+  }
+}
+
+static void
+coap_proxy_send_failure(coap_proxy_req_t *proxy_req) {
+  coap_pdu_t *response;
+  coap_bin_const_t l_token;
+
+  /* Need to send back a gateway failure */
+  response = coap_pdu_init(proxy_req->pdu->type,
+                           COAP_RESPONSE_CODE(502),
+                           coap_new_message_id_lkd(proxy_req->incoming),
+                           coap_session_max_pdu_size_lkd(proxy_req->incoming));
+  if (!response) {
+    coap_log_info("PDU creation issue\n");
+    return;
+  }
+
+  l_token = coap_pdu_get_token(proxy_req->pdu);
+  if (!coap_add_token(response, l_token.length,
+                      l_token.s)) {
+    coap_log_debug("Cannot add token to incoming proxy response PDU\n");
+  }
+
+  if (coap_send_lkd(proxy_req->incoming, response) == COAP_INVALID_MID) {
+    coap_log_info("Failed to send PDU with 5.02 gateway issue\n");
+  }
+}
+
+static void
+coap_proxy_delete_req(coap_proxy_req_t *proxy_req) {
+  coap_delete_pdu(proxy_req->pdu);
+  coap_delete_bin_const(proxy_req->token_used);
+  coap_delete_cache_key(proxy_req->cache_key);
+  coap_delete_pdu(proxy_req->last_pdu);
+  coap_delete_binary(proxy_req->last_body);
+}
+
+/*
+ * Remove request info j from the proxy entry.  Any last notification is
+ * handed on to another request sharing the same upstream request.
+ */
+static void
+coap_proxy_remove_req(coap_proxy_list_t *proxy_entry, size_t j) {
+  coap_proxy_req_t *proxy_req = &proxy_entry->req_list[j];
+  size_t k;
+
+  if (proxy_req->last_pdu) {
+    for (k = 0; k < proxy_entry->req_count; k++) {
+      if (k != j && coap_binary_equal(proxy_entry->req_list[k].token_used,
+                                      proxy_req->token_used)) {
+        proxy_entry->req_list[k].last_pdu = proxy_req->last_pdu;
+        proxy_entry->req_list[k].last_body = proxy_req->last_body;
+        proxy_req->last_pdu = NULL;
+        proxy_req->last_body = NULL;
+        break;
+      }
+    }
+  }
+  coap_proxy_delete_req(proxy_req);
+  if (proxy_entry->req_count-j > 1) {
+    memmove(&proxy_entry->req_list[j], &proxy_entry->req_list[j+1],
+            (proxy_entry->req_count-j-1) * sizeof(proxy_entry->req_list[0]));
+  }
+  proxy_entry->req_count--;
+}
+
+/*
+ * Remove the proxy entry, releasing the ongoing session.  If send_failure,
+ * any outstanding requests get a 5.02 response.
+ */
+static void
+coap_proxy_free_entry(coap_context_t *context, coap_proxy_list_t *proxy_entry,
+                      int send_failure) {
+  size_t i;
+
+  /* Take it out first, in case sending the failures gets back here */
+  HASH_DELETE(hh, context->proxy_list, proxy_entry);
+  if (proxy_entry->expire_idx)
+    coap_proxy_expire_remove(context, proxy_entry);
+  proxy_entry->key.upstream->session_count--;
+  coap_proxy_release_upstream(context, proxy_entry->key.upstream);
+
+  for (i = 0; i < proxy_entry->req_count; i++) {
+    if (send_failure)
+      coap_proxy_send_failure(&proxy_entry->req_list[i]);
+    coap_proxy_delete_req(&proxy_entry->req_list[i]);
+  }
+  coap_free_type(COAP_STRING, proxy_entry->req_list);
+  if (proxy_entry->ongoing) {
+    proxy_entry->ongoing->proxy_entry = NULL;
+    coap_session_release_lkd(proxy_entry->ongoing);
+  }
+  coap_free_type(COAP_STRING, proxy_entry);
+}
+
 void
 coap_proxy_cleanup(coap_context_t *context) {
+  coap_proxy_list_t *proxy_entry, *ptmp;
+  coap_proxy_upstream_t *upstream, *utmp;
   size_t i;
-  size_t j;
 
-  for (i = 0; i < context->proxy_list_count; i++) {
-    for (j = 0; j < context->proxy_list[i].req_count; j++) {
-      coap_delete_pdu(context->proxy_list[i].req_list[j].pdu);
-      coap_delete_cache_key(context->proxy_list[i].req_list[j].cache_key);
+  /* The ongoing sessions have already gone with the context's sessions */
+  HASH_ITER(hh, context->proxy_list, proxy_entry, ptmp) {
+    HASH_DELETE(hh, context->proxy_list, proxy_entry);
+    for (i = 0; i < proxy_entry->req_count; i++) {
+      coap_proxy_delete_req(&proxy_entry->req_list[i]);
     }
-    coap_free_type(COAP_STRING, context->proxy_list[i].req_list);
+    coap_free_type(COAP_STRING, proxy_entry->req_list);
+    coap_free_type(COAP_STRING, proxy_entry);
   }
-  coap_free_type(COAP_STRING, context->proxy_list);
+  HASH_ITER(hh, context->proxy_upstreams, upstream, utmp) {
+    HASH_DELETE(hh, context->proxy_upstreams, upstream);
+    coap_free_type(COAP_STRING, upstream);
+  }
+  coap_free_type(COAP_PROXY_EXPIRE, context->proxy_expire);
+  context->proxy_expire = NULL;
+  context->proxy_expire_count = 0;
+  context->proxy_expire_max = 0;
 }
 
 /*
@@ -50,27 +262,18 @@ coap_proxy_cleanup(coap_context_t *context) {
 int
 coap_proxy_check_timeouts(coap_context_t *context, coap_tick_t now,
                           coap_tick_t *tim_rem) {
-  size_t i;
-  int ret = 0;
-
   *tim_rem = -1;
-  for (i = 0; i < context->proxy_list_count; i++) {
-    coap_proxy_list_t *proxy_list = &context->proxy_list[i];
-
-    if (proxy_list->ongoing && proxy_list->idle_timeout_ticks) {
-      if (proxy_list->last_used + proxy_list->idle_timeout_ticks <= now) {
-        /* Drop session to upstream server */
-        coap_session_release_lkd(proxy_list->ongoing);
-        proxy_list->ongoing = NULL;
-      } else {
-        if (*tim_rem > proxy_list->last_used + proxy_list->idle_timeout_ticks - now) {
-          *tim_rem = proxy_list->last_used + proxy_list->idle_timeout_ticks - now;
-        }
-        ret = 1;
-      }
+  while (context->proxy_expire_count) {
+    coap_proxy_list_t *proxy_entry = context->proxy_expire[0];
+
+    if (PROXY_DEADLINE(proxy_entry) > now) {
+      *tim_rem = PROXY_DEADLINE(proxy_entry) - now;
+      return 1;
     }
+    /* Drop session to upstream server */
+    coap_proxy_free_entry(context, proxy_entry, 1);
   }
-  return ret;
+  return 0;
 }
 
 static int
@@ -201,10 +404,12 @@ coap_proxy_get_session(coap_session_t *session, const coap_pdu_t *request,
                        coap_pdu_t *response,
                        coap_proxy_server_list_t *server_list,
                        coap_proxy_server_t *server_use) {
-  size_t i;
-  coap_proxy_list_t *new_proxy_list;
-  coap_proxy_list_t *proxy_list = session->context->proxy_list;
-  size_t proxy_list_count = session->context->proxy_list_count;
+  coap_context_t *context = session->context;
+  coap_proxy_list_t *proxy_entry;
+  coap_proxy_upstream_t *upstream;
+  coap_proxy_entry_key_t entry_key;
+  uint8_t key[3 + COAP_PROXY_MAX_HOST_LEN];
+  size_t key_len;
 
   coap_opt_iterator_t opt_iter;
   coap_opt_t *proxy_scheme;
@@ -280,115 +485,100 @@ coap_proxy_get_session(coap_session_t *session, const coap_pdu_t *request,
   }
 
   /* See if we are already connected to the Server */
-  for (i = 0; i < proxy_list_count; i++) {
-    if (coap_string_equal(&proxy_list[i].uri.host, &server_use->uri.host) &&
-        proxy_list[i].uri.port == server_use->uri.port &&
-        proxy_list[i].uri.scheme == server_use->uri.scheme) {
-      if (!server_list->track_client_session) {
-        coap_ticks(&proxy_list[i].last_used);
-        return &proxy_list[i];
-      } else {
-        if (proxy_list[i].incoming == session) {
-          coap_ticks(&proxy_list[i].last_used);
-          return &proxy_list[i];
-        }
-      }
+  if (server_use->uri.host.length > COAP_PROXY_MAX_HOST_LEN) {
+    coap_log_warn("Proxy: upstream host name too long\n");
+    response->code = COAP_RESPONSE_CODE(505);
+    return NULL;
+  }
+  key[0] = (uint8_t)server_use->uri.scheme;
+  key[1] = (uint8_t)(server_use->uri.port >> 8);
+  key[2] = (uint8_t)(server_use->uri.port & 0xff);
+  memcpy(&key[3], server_use->uri.host.s, server_use->uri.host.length);
+  key_len = 3 + server_use->uri.host.length;
+
+  HASH_FIND(hh, context->proxy_upstreams, key, key_len, upstream);
+  if (upstream) {
+    memset(&entry_key, 0, sizeof(entry_key));
+    entry_key.upstream = upstream;
+    if (server_list->track_client_session)
+      entry_key.incoming = session;
+    HASH_FIND(hh, context->proxy_list, &entry_key, sizeof(entry_key),
+              proxy_entry);
+    if (proxy_entry) {
+      coap_proxy_touch(context, proxy_entry);
+      return proxy_entry;
+    }
+    if (server_list->max_upstream_sessions &&
+        upstream->session_count >= server_list->max_upstream_sessions) {
+      coap_log_warn("Proxy: upstream session limit (%u) reached\n",
+                    server_list->max_upstream_sessions);
+      response->code = COAP_RESPONSE_CODE(503);
+      return NULL;
     }
+  } else {
+    upstream = coap_malloc_type(COAP_STRING,
+                                sizeof(coap_proxy_upstream_t) + key_len - 1);
+    if (upstream == NULL) {
+      response->code = COAP_RESPONSE_CODE(500);
+      return NULL;
+    }
+    memset(upstream, 0, sizeof(coap_proxy_upstream_t));
+    memcpy(upstream->key, key, key_len);
+    upstream->key_len = key_len;
+    HASH_ADD(hh, context->proxy_upstreams, key[0], key_len, upstream);
   }
 
   /* Need to create a new forwarding mapping */
-  new_proxy_list = coap_realloc_type(COAP_STRING, proxy_list, (i+1)*sizeof(proxy_list[0]));
-
-  if (new_proxy_list == NULL) {
+  proxy_entry = coap_malloc_type(COAP_STRING, sizeof(coap_proxy_list_t));
+  if (proxy_entry == NULL) {
+    coap_proxy_release_upstream(context, upstream);
     response->code = COAP_RESPONSE_CODE(500);
     return NULL;
   }
-  session->context->proxy_list = proxy_list = new_proxy_list;
-  memset(&proxy_list[i], 0, sizeof(proxy_list[i]));
-
-  proxy_list[i].uri = server_use->uri;
+  memset(proxy_entry, 0, sizeof(coap_proxy_list_t));
+  proxy_entry->key.upstream = upstream;
   if (server_list->track_client_session) {
-    proxy_list[i].incoming = session;
+    proxy_entry->key.incoming = session;
   }
-  session->context->proxy_list_count++;
-  proxy_list[i].idle_timeout_ticks = server_list->idle_timeout_secs * COAP_TICKS_PER_SECOND;
-  coap_ticks(&proxy_list[i].last_used);
-  return &proxy_list[i];
+  proxy_entry->idle_timeout_ticks = server_list->idle_timeout_secs * COAP_TICKS_PER_SECOND;
+  coap_ticks(&proxy_entry->last_used);
+  if (proxy_entry->idle_timeout_ticks &&
+      !coap_proxy_expire_add(context, proxy_entry)) {
+    coap_free_type(COAP_STRING, proxy_entry);
+    coap_proxy_release_upstream(context, upstream);
+    response->code = COAP_RESPONSE_CODE(500);
+    return NULL;
+  }
+  HASH_ADD(hh, context->proxy_list, key, sizeof(proxy_entry->key), proxy_entry);
+  upstream->session_count++;
+  return proxy_entry;
 }
 
 void
 coap_proxy_remove_association(coap_session_t *session, int send_failure) {
-
-  size_t i;
+  coap_context_t *context = session->context;
+  coap_proxy_list_t *proxy_entry, *ptmp;
   size_t j;
-  coap_proxy_list_t *proxy_list = session->context->proxy_list;
-  size_t proxy_list_count = session->context->proxy_list_count;
 
-  for (i = 0; i < proxy_list_count; i++) {
-    /* Check for incoming match */
-    for (j = 0; j < proxy_list[i].req_count; j++) {
-      if (proxy_list[i].req_list[j].incoming == session) {
-        coap_delete_pdu(proxy_list[i].req_list[j].pdu);
-        coap_delete_bin_const(proxy_list[i].req_list[j].token_used);
-        coap_delete_cache_key(proxy_list[i].req_list[j].cache_key);
-        if (proxy_list[i].req_count-j > 1) {
-          memmove(&proxy_list[i].req_list[j], &proxy_list[i].req_list[j+1],
-                  (proxy_list[i].req_count-j-1) * sizeof(proxy_list[i].req_list[0]));
-        }
-        proxy_list[i].req_count--;
-        break;
-      }
-    }
-    if (proxy_list[i].incoming == session) {
+  /* Check for outgoing match */
+  if (session->proxy_entry) {
+    coap_proxy_free_entry(context, session->proxy_entry, send_failure);
+    return;
+  }
+
+  HASH_ITER(hh, context->proxy_list, proxy_entry, ptmp) {
+    if (proxy_entry->key.incoming == session) {
       /* Only if there is a one-to-one tracking */
-      coap_session_release_lkd(proxy_list[i].ongoing);
-      break;
+      coap_proxy_free_entry(context, proxy_entry, 0);
+      continue;
     }
-
-    /* Check for outgoing match */
-    if (proxy_list[i].ongoing == session) {
-      coap_session_t *ongoing;
-
-      for (j = 0; j < proxy_list[i].req_count; j++) {
-        if (send_failure) {
-          coap_pdu_t *response;
-          coap_bin_const_t l_token;
-
-          /* Need to send back a gateway failure */
-          response = coap_pdu_init(proxy_list[i].req_list[j].pdu->type,
-                                   COAP_RESPONSE_CODE(502),
-                                   coap_new_message_id_lkd(proxy_list[i].incoming),
-                                   coap_session_max_pdu_size_lkd(proxy_list[i].incoming));
-          if (!response) {
-            coap_log_info("PDU creation issue\n");
-            goto cleanup;
-          }
-
-          l_token = coap_pdu_get_token(proxy_list[i].req_list[j].pdu);
-          if (!coap_add_token(response, l_token.length,
-                              l_token.s)) {
-            coap_log_debug("Cannot add token to incoming proxy response PDU\n");
-          }
-
-          if (coap_send_lkd(proxy_list[i].incoming, response) == COAP_INVALID_MID) {
-            coap_log_info("Failed to send PDU with 5.02 gateway issue\n");
-          }
-cleanup:
-          coap_delete_pdu(proxy_list[i].req_list[j].pdu);
-          coap_delete_bin_const(proxy_list[i].req_list[j].token_used);
-          coap_delete_cache_key(proxy_list[i].req_list[j].cache_key);
-        }
-      }
-      ongoing = proxy_list[i].ongoing;
-      coap_free_type(COAP_STRING, proxy_list[i].req_list);
-      if (proxy_list_count-i > 1) {
-        memmove(&proxy_list[i],
-                &proxy_list[i+1],
-                (proxy_list_count-i-1) * sizeof(proxy_list[0]));
+    /* Check for incoming match */
+    for (j = 0; j < proxy_entry->req_count;) {
+      if (proxy_entry->req_list[j].incoming == session) {
+        coap_proxy_remove_req(proxy_entry, j);
+      } else {
+        j++;
       }
-      session->context->proxy_list_count--;
-      coap_session_release_lkd(ongoing);
-      break;
     }
   }
 }
@@ -405,7 +595,7 @@ coap_proxy_get_ongoing_session(coap_session_t *session,
   coap_addr_info_t *info_list = NULL;
   coap_proxy_list_t *proxy_entry;
   coap_context_t *context = session->context;
-  static char client_sni[256];
+  static COAP_THREAD_LOCAL char client_sni[256];
 
   proxy_entry = coap_proxy_get_session(session, request, response, server_list, server_use);
   if (!proxy_entry) {
@@ -428,7 +618,7 @@ coap_proxy_get_ongoing_session(coap_session_t *session,
 
     if (info_list == NULL) {
       response->code = COAP_RESPONSE_CODE(502);
-      coap_proxy_remove_association(session, 0);
+      coap_proxy_free_entry(context, proxy_entry, 0);
       return NULL;
     }
     proto = info_list->proto;
@@ -502,9 +692,10 @@ coap_proxy_get_ongoing_session(coap_session_t *session,
     }
     if (proxy_entry->ongoing == NULL) {
       response->code = COAP_RESPONSE_CODE(505);
-      coap_proxy_remove_association(session, 0);
+      coap_proxy_free_entry(context, proxy_entry, 0);
       return NULL;
     }
+    proxy_entry->ongoing->proxy_entry = proxy_entry;
   }
 
   return proxy_entry;
@@ -516,6 +707,233 @@ coap_proxy_release_body_data(coap_session_t *session COAP_UNUSED,
   coap_delete_binary(app_ptr);
 }
 
+/*
+ * Save the info for a request that is waiting on the upstream request with
+ * the given token.
+ */
+static coap_proxy_req_t *
+coap_proxy_add_req(coap_proxy_list_t *proxy_entry, coap_session_t *session,
+                   const coap_pdu_t *request, coap_resource_t *resource,
+                   coap_cache_key_t *cache_key, const uint8_t *token,
+                   size_t token_len) {
+  coap_bin_const_t r_token = coap_pdu_get_token(request);
+  coap_proxy_req_t *new_req_list;
+  coap_proxy_req_t *proxy_req;
+
+  new_req_list = coap_realloc_type(COAP_STRING, proxy_entry->req_list,
+                                   (proxy_entry->req_count + 1)*sizeof(coap_proxy_req_t));
+  if (new_req_list == NULL) {
+    return NULL;
+  }
+  proxy_entry->req_list = new_req_list;
+  proxy_req = &new_req_list[proxy_entry->req_count];
+  memset(proxy_req, 0, sizeof(*proxy_req));
+  proxy_req->token_used = coap_new_bin_const(token, token_len);
+  if (proxy_req->token_used == NULL) {
+    return NULL;
+  }
+  proxy_req->pdu = coap_pdu_duplicate_lkd(request, session,
+                                          r_token.length, r_token.s, NULL);
+  if (proxy_req->pdu == NULL) {
+    coap_delete_bin_const(proxy_req->token_used);
+    return NULL;
+  }
+  proxy_req->resource = resource;
+  proxy_req->incoming = session;
+  proxy_req->cache_key = cache_key;
+  proxy_entry->req_count++;
+  return proxy_req;
+}
+
+/*
+ * Fill in pdu (which already has its token) as the response to request
+ * from the upstream response received, whose body is size bytes at data.
+ */
+static int
+coap_proxy_build_response(coap_resource_t *resource, coap_session_t *incoming,
+                          const coap_pdu_t *request, coap_pdu_t *pdu,
+                          const coap_pdu_t *received, size_t size,
+                          const uint8_t *data) {
+  coap_optlist_t *optlist = NULL;
+  coap_opt_t *option;
+  coap_opt_iterator_t opt_iter;
+  uint16_t media_type = COAP_MEDIATYPE_TEXT_PLAIN;
+  int maxage = -1;
+  uint64_t etag = 0;
+  coap_binary_t *body_data = NULL;
+
+  if (size > 0) {
+    /* The request may go away before all the data is transmitted */
+    body_data = coap_new_binary(size);
+    if (!body_data) {
+      coap_log_debug("body build memory error\n");
+      return 0;
+    }
+    memcpy(body_data->s, data, size);
+  }
+  coap_pdu_set_code(pdu, coap_pdu_get_code(received));
+
+  /*
+   * Copy the options across, skipping those needed for
+   * coap_add_data_response_large()
+   */
+  coap_option_iterator_init(received, &opt_iter, COAP_OPT_ALL);
+  while ((option = coap_option_next(&opt_iter))) {
+    switch (opt_iter.number) {
+    case COAP_OPTION_CONTENT_FORMAT:
+      media_type = coap_decode_var_bytes(coap_opt_value(option),
+                                         coap_opt_length(option));
+      break;
+    case COAP_OPTION_MAXAGE:
+      maxage = coap_decode_var_bytes(coap_opt_value(option),
+                                     coap_opt_length(option));
+      break;
+    case COAP_OPTION_ETAG:
+      etag = coap_decode_var_bytes8(coap_opt_value(option),
+                                    coap_opt_length(option));
+      break;
+    case COAP_OPTION_BLOCK2:
+    case COAP_OPTION_Q_BLOCK2:
+    case COAP_OPTION_SIZE2:
+      break;
+    default:
+      coap_insert_optlist(&optlist,
+                          coap_new_optlist(opt_iter.number,
+                                           coap_opt_length(option),
+                                           coap_opt_value(option)));
+      break;
+    }
+  }
+  coap_add_optlist_pdu(pdu, &optlist);
+  coap_delete_optlist(optlist);
+
+  if (body_data) {
+    coap_string_t *l_query = coap_get_query(request);
+
+    coap_add_data_large_response_lkd(resource, incoming, request, pdu,
+                                     l_query,
+                                     media_type, maxage, etag, size,
+                                     body_data->s,
+                                     coap_proxy_release_body_data,
+                                     body_data);
+    coap_delete_string(l_query);
+  }
+  return 1;
+}
+
+/*
+ * Send the upstream response received back to the client of proxy_req as a
+ * separate response.
+ */
+static void
+coap_proxy_send_response(coap_proxy_req_t *proxy_req,
+                         const coap_pdu_t *received, size_t size,
+                         const uint8_t *data) {
+  coap_bin_const_t req_token = coap_pdu_get_token(proxy_req->pdu);
+  coap_pdu_t *pdu;
+
+  pdu = coap_pdu_init(proxy_req->pdu->type, coap_pdu_get_code(received),
+                      coap_new_message_id_lkd(proxy_req->incoming),
+                      coap_session_max_pdu_size_lkd(proxy_req->incoming));
+  if (!pdu) {
+    coap_log_debug("Failed to create ongoing proxy response PDU\n");
+    return;
+  }
+
+  if (!coap_add_token(pdu, req_token.length, req_token.s)) {
+    coap_log_debug("cannot add token to ongoing proxy response PDU\n");
+  }
+  if (!coap_proxy_build_response(proxy_req->resource, proxy_req->incoming,
+                                 proxy_req->pdu, pdu, received, size, data)) {
+    coap_delete_pdu(pdu);
+    return;
+  }
+  coap_send_lkd(proxy_req->incoming, pdu);
+}
+
+/*
+ * The client is no longer observing with the request that has token.
+ */
+static void
+coap_proxy_cancel_observe(coap_proxy_list_t *proxy_entry,
+                          coap_session_t *session,
+                          const coap_bin_const_t *token) {
+  size_t j;
+
+  for (j = 0; j < proxy_entry->req_count; j++) {
+    coap_proxy_req_t *proxy_req = &proxy_entry->req_list[j];
+    coap_bin_const_t req_token = coap_pdu_get_token(proxy_req->pdu);
+
+    if (proxy_req->observe && proxy_req->incoming == session &&
+        coap_binary_equal(&req_token, token)) {
+      coap_proxy_remove_req(proxy_entry, j);
+      return;
+    }
+  }
+}
+
+/*
+ * If an identical request is already waiting on an upstream request, wait on
+ * that as well rather than sending another one upstream.  A new observer
+ * gets the last notification (if any) piggybacked in response.
+ *
+ * Returns 1 if joined, 0 if the request needs to be sent upstream or -1 on
+ * error.
+ */
+static int
+coap_proxy_join_req(coap_proxy_list_t *proxy_entry, coap_session_t *session,
+                    const coap_pdu_t *request, coap_pdu_t *response,
+                    coap_resource_t *resource, coap_cache_key_t *cache_key,
+                    const coap_cache_key_t *req_key, int observe) {
+  coap_bin_const_t r_token = coap_pdu_get_token(request);
+  coap_bin_const_t *token_used = NULL;
+  coap_pdu_t *last_pdu = NULL;
+  coap_binary_t *last_body = NULL;
+  coap_proxy_req_t *proxy_req;
+  int registered = 0;
+  size_t j;
+
+  for (j = 0; j < proxy_entry->req_count; j++) {
+    proxy_req = &proxy_entry->req_list[j];
+    if (proxy_req->coalesce && proxy_req->observe == observe &&
+        memcmp(&proxy_req->req_key, req_key, sizeof(*req_key)) == 0) {
+      coap_bin_const_t req_token = coap_pdu_get_token(proxy_req->pdu);
+
+      token_used = proxy_req->token_used;
+      if (proxy_req->last_pdu) {
+        last_pdu = proxy_req->last_pdu;
+        last_body = proxy_req->last_body;
+      }
+      if (observe && proxy_req->incoming == session &&
+          coap_binary_equal(&req_token, &r_token)) {
+        /* Re-registration by the same client */
+        registered = 1;
+      }
+    }
+  }
+  if (!token_used)
+    return 0;
+
+  if (last_pdu &&
+      !coap_proxy_build_response(resource, session, request, response,
+                                 last_pdu, last_body ? last_body->length : 0,
+                                 last_body ? last_body->s : NULL)) {
+    return -1;
+  }
+  if (!registered) {
+    proxy_req = coap_proxy_add_req(proxy_entry, session, request, resource,
+                                   cache_key, token_used->s,
+                                   token_used->length);
+    if (!proxy_req)
+      return -1;
+    proxy_req->req_key = *req_key;
+    proxy_req->coalesce = 1;
+    proxy_req->observe = observe;
+  }
+  coap_log_debug("proxy: request joined an upstream request\n");
+  return 1;
+}
+
 int COAP_API
 coap_proxy_forward_request(coap_session_t *session,
                            const coap_pdu_t *request,
@@ -553,11 +971,14 @@ coap_proxy_forward_request_lkd(coap_session_t *session,
   coap_bin_const_t r_token = coap_pdu_get_token(request);
   uint8_t token[8];
   size_t token_len;
-  coap_proxy_req_t *new_req_list;
+  coap_proxy_req_t *proxy_req;
   coap_optlist_t *optlist = NULL;
   coap_opt_t *option;
   coap_opt_iterator_t opt_iter;
   coap_proxy_server_t server_use;
+  coap_cache_key_t req_key;
+  int coalesce = 0;
+  int observe = 0;
 
   /* Set up ongoing session (if not already done) */
 
@@ -567,31 +988,46 @@ coap_proxy_forward_request_lkd(coap_session_t *session,
     /* response code already set */
     return 0;
 
-  /* Need to save the request pdu entry */
-  new_req_list = coap_realloc_type(COAP_STRING, proxy_entry->req_list,
-                                   (proxy_entry->req_count + 1)*sizeof(coap_proxy_req_t));
-
-  if (new_req_list == NULL) {
-    goto failed;
+  if (request->code == COAP_REQUEST_CODE_GET ||
+      request->code == COAP_REQUEST_CODE_FETCH) {
+    option = coap_check_option(request, COAP_OPTION_OBSERVE, &opt_iter);
+    if (option) {
+      if (coap_decode_var_bytes(coap_opt_value(option),
+                                coap_opt_length(option)) == COAP_OBSERVE_ESTABLISH)
+        observe = 1;
+      else
+        coap_proxy_cancel_observe(proxy_entry, session, &r_token);
+    }
+    /* A deregistration is passed on as is */
+    if (!option || observe)
+      coalesce = coap_cache_derive_key_into(session, request,
+                                            COAP_CACHE_NOT_SESSION_BASED,
+                                            NULL, 0, &req_key);
   }
-  proxy_entry->req_list = new_req_list;
-  /* Get a new token for ongoing session */
+  if (coalesce) {
+    switch (coap_proxy_join_req(proxy_entry, session, request, response,
+                                resource, cache_key, &req_key, observe)) {
+    case 1:
+      return 1;
+    case 0:
+      break;
+    default:
+      goto failed;
+    }
+  }
+
+  /* Need to save the request pdu entry with a new token for ongoing session */
   coap_session_new_token(proxy_entry->ongoing, &token_len, token);
-  new_req_list[proxy_entry->req_count].token_used = coap_new_bin_const(token, token_len);
-  if (new_req_list[proxy_entry->req_count].token_used == NULL) {
+  proxy_req = coap_proxy_add_req(proxy_entry, session, request, resource,
+                                 cache_key, token, token_len);
+  if (proxy_req == NULL) {
     goto failed;
   }
-  new_req_list[proxy_entry->req_count].pdu = coap_pdu_duplicate_lkd(request, session,
-                                             r_token.length, r_token.s, NULL);
-  if (new_req_list[proxy_entry->req_count].pdu == NULL) {
-    coap_delete_bin_const(new_req_list[proxy_entry->req_count].token_used);
-    new_req_list[proxy_entry->req_count].token_used = NULL;
-    goto failed;
+  if (coalesce) {
+    proxy_req->req_key = req_key;
+    proxy_req->coalesce = 1;
+    proxy_req->observe = observe;
   }
-  new_req_list[proxy_entry->req_count].resource = resource;
-  new_req_list[proxy_entry->req_count].incoming = session;
-  new_req_list[proxy_entry->req_count].cache_key = cache_key;
-  proxy_entry->req_count++;
 
   switch (server_list->type) {
   case COAP_PROXY_REVERSE_STRIP:
@@ -722,52 +1158,35 @@ coap_response_t
 coap_proxy_forward_response_lkd(coap_session_t *session,
                                 const coap_pdu_t *received,
                                 coap_cache_key_t **cache_key) {
-  coap_pdu_t *pdu = NULL;
-  coap_session_t *incoming = NULL;
-  size_t i;
-  size_t j = 0;
-  size_t size;
-  const uint8_t *data;
-  coap_optlist_t *optlist = NULL;
-  coap_opt_t *option;
+  coap_proxy_list_t *proxy_entry = session->proxy_entry;
+  coap_pdu_code_t rcv_code = coap_pdu_get_code(received);
+  coap_bin_const_t rcv_token = coap_pdu_get_token(received);
+  coap_proxy_req_t *proxy_req = NULL;
   coap_opt_iterator_t opt_iter;
+  size_t size = 0;
   size_t offset;
   size_t total;
-  coap_proxy_list_t *proxy_entry = NULL;
-  uint16_t media_type = COAP_MEDIATYPE_TEXT_PLAIN;
-  int maxage = -1;
-  uint64_t etag = 0;
-  coap_pdu_code_t rcv_code = coap_pdu_get_code(received);
-  coap_bin_const_t rcv_token = coap_pdu_get_token(received);
-  coap_bin_const_t req_token;
-  coap_binary_t *body_data = NULL;
-  coap_pdu_t *req_pdu;
-  coap_proxy_list_t *proxy_list = session->context->proxy_list;
-  size_t proxy_list_count = session->context->proxy_list_count;
-  coap_resource_t *resource;
-  struct coap_proxy_req_t *proxy_req = NULL;
-
-  for (i = 0; i < proxy_list_count; i++) {
-    proxy_entry = &proxy_list[i];
+  const uint8_t *data = NULL;
+  int observe;
+  size_t j;
+
+  observe = coap_check_option(received, COAP_OPTION_OBSERVE, &opt_iter) != NULL;
+
+  /* The ongoing session knows its proxy entry */
+  if (proxy_entry) {
     for (j = 0; j < proxy_entry->req_count; j++) {
       if (coap_binary_equal(&rcv_token, proxy_entry->req_list[j].token_used)) {
         proxy_req = &proxy_entry->req_list[j];
         break;
       }
     }
-    if (j != proxy_entry->req_count) {
-      break;
-    }
   }
-  if (i == proxy_list_count) {
+  if (proxy_req == NULL) {
     coap_log_warn("Unknown proxy ongoing session response received\n");
-    return COAP_RESPONSE_OK;
+    /* Reject notifications that no client is observing any more */
+    return observe ? COAP_RESPONSE_FAIL : COAP_RESPONSE_OK;
   }
-
-  req_pdu = proxy_req->pdu;
-  req_token = coap_pdu_get_token(req_pdu);
-  resource = proxy_req->resource;
-  incoming = proxy_req->incoming;
+  coap_proxy_touch(session->context, proxy_entry);
 
   coap_log_debug("** process upstream incoming %d.%02d response:\n",
                  COAP_RESPONSE_CLASS(rcv_code), rcv_code & 0x1F);
@@ -775,96 +1194,58 @@ coap_proxy_forward_response_lkd(coap_session_t *session,
   if (coap_get_data_large(received, &size, &data, &offset, &total)) {
     /* COAP_BLOCK_SINGLE_BODY is set, so single body should be given */
     assert(size == total);
-    body_data = coap_new_binary(total);
-    if (!body_data) {
-      coap_log_debug("body build memory error\n");
-      goto remove_match;
-    }
-    memcpy(body_data->s, data, size);
-    data = body_data->s;
   }
 
-  /*
-   * Build up the ongoing PDU that we are going to send to proxy originator
-   * as separate response
-   */
-  pdu = coap_pdu_init(req_pdu->type, rcv_code,
-                      coap_new_message_id_lkd(incoming),
-                      coap_session_max_pdu_size_lkd(incoming));
-  if (!pdu) {
-    coap_log_debug("Failed to create ongoing proxy response PDU\n");
-    goto remove_match;
-  }
-
-  if (!coap_add_token(pdu, req_token.length, req_token.s)) {
-    coap_log_debug("cannot add token to ongoing proxy response PDU\n");
-  }
+  if (observe && proxy_req->coalesce) {
+    /* Keep the notification for any observers that join later */
+    for (j = 0; j < proxy_entry->req_count; j++) {
+      coap_proxy_req_t *share = &proxy_entry->req_list[j];
 
-  /*
-   * Copy the options across, skipping those needed for
-   * coap_add_data_response_large()
-   */
-  coap_option_iterator_init(received, &opt_iter, COAP_OPT_ALL);
-  while ((option = coap_option_next(&opt_iter))) {
-    switch (opt_iter.number) {
-    case COAP_OPTION_CONTENT_FORMAT:
-      media_type = coap_decode_var_bytes(coap_opt_value(option),
-                                         coap_opt_length(option));
-      break;
-    case COAP_OPTION_MAXAGE:
-      maxage = coap_decode_var_bytes(coap_opt_value(option),
-                                     coap_opt_length(option));
-      break;
-    case COAP_OPTION_ETAG:
-      etag = coap_decode_var_bytes8(coap_opt_value(option),
-                                    coap_opt_length(option));
-      break;
-    case COAP_OPTION_BLOCK2:
-    case COAP_OPTION_Q_BLOCK2:
-    case COAP_OPTION_SIZE2:
-      break;
-    default:
-      coap_insert_optlist(&optlist,
-                          coap_new_optlist(opt_iter.number,
-                                           coap_opt_length(option),
-                                           coap_opt_value(option)));
-      break;
+      if (coap_binary_equal(&rcv_token, share->token_used)) {
+        coap_delete_pdu(share->last_pdu);
+        coap_delete_binary(share->last_body);
+        share->last_pdu = NULL;
+        share->last_body = NULL;
+      }
+    }
+    proxy_req->last_pdu = coap_pdu_duplicate_lkd(received, session,
+                                                 rcv_token.length,
+                                                 rcv_token.s, NULL);
+    if (size) {
+      proxy_req->last_body = coap_new_binary(size);
+      if (proxy_req->last_body) {
+        memcpy(proxy_req->last_body->s, data, size);
+      } else {
+        coap_delete_pdu(proxy_req->last_pdu);
+        proxy_req->last_pdu = NULL;
+      }
     }
   }
-  coap_add_optlist_pdu(pdu, &optlist);
-  coap_delete_optlist(optlist);
-
-  if (size > 0) {
-    coap_string_t *l_query = coap_get_query(req_pdu);
 
-    coap_add_data_large_response_lkd(resource, incoming, req_pdu, pdu,
-                                     l_query,
-                                     media_type, maxage, etag, size, data,
-                                     coap_proxy_release_body_data,
-                                     body_data);
-    body_data = NULL;
-    coap_delete_string(l_query);
+  /* Send the response back to every client waiting on it */
+  for (j = 0; j < proxy_entry->req_count; j++) {
+    if (coap_binary_equal(&rcv_token, proxy_entry->req_list[j].token_used)) {
+      coap_proxy_send_response(&proxy_entry->req_list[j], received, size,
+                               data);
+    }
   }
 
   if (cache_key)
     *cache_key = proxy_req->cache_key;
 
-  coap_send_lkd(incoming, pdu);
-
-remove_match:
-  option = coap_check_option(received, COAP_OPTION_OBSERVE, &opt_iter);
-  /* Need to remove matching token entry (apart from on Observe response) */
-  if (option == NULL && proxy_entry->req_count) {
-    coap_delete_pdu(proxy_entry->req_list[j].pdu);
-    coap_delete_bin_const(proxy_entry->req_list[j].token_used);
-    /* Do not delete cache key here - caller's responsibility */
-    proxy_entry->req_count--;
-    if (proxy_entry->req_count-j > 0) {
-      memmove(&proxy_entry->req_list[j], &proxy_entry->req_list[j+1],
-              (proxy_entry->req_count-j) * sizeof(proxy_entry->req_list[0]));
+  /* Need to remove matching token entries (apart from on Observe response) */
+  if (!observe) {
+    /* Do not delete the returned cache key here - caller's responsibility */
+    if (cache_key)
+      proxy_req->cache_key = NULL;
+    for (j = 0; j < proxy_entry->req_count;) {
+      if (coap_binary_equal(&rcv_token, proxy_entry->req_list[j].token_used)) {
+        coap_proxy_remove_req(proxy_entry, j);
+      } else {
+        j++;
+      }
     }
   }
-  coap_delete_binary(body_data);
   return COAP_RESPONSE_OK;
 }
 
@@ -484,6 +484,11 @@ typedef enum coap_deleting_resource_t {
 
 static void coap_notify_observers(coap_context_t *context, coap_resource_t *r,
                                   coap_deleting_resource_t deleting);
+static void coap_notify_uncache(coap_resource_t *r);
+static void coap_notify_dequeue(coap_context_t *context, coap_resource_t *r);
+static void coap_notify_undefer(coap_resource_t *r, coap_subscription_t *obs);
+static void coap_notify_defer(coap_context_t *context, coap_resource_t *r,
+                              coap_subscription_t *obs, coap_tick_t due);
 
 static void
 coap_free_resource(coap_resource_t *resource) {
@@ -508,6 +513,10 @@ coap_free_resource(coap_resource_t *resource) {
   /* delete registered attributes */
   LL_FOREACH_SAFE(resource->link_attr, attr, tmp) coap_delete_attr(attr);
 
+  coap_notify_uncache(resource);
+  coap_notify_dequeue(resource->context, resource);
+  coap_cache_delete_resource_entries(resource->context, resource);
+
   /* Either the application provided or libcoap copied - need to delete it */
   coap_delete_str_const(resource->uri_path);
 
@@ -533,6 +542,173 @@ coap_free_resource(coap_resource_t *resource) {
   coap_free_type(COAP_RESOURCE, resource);
 }
 
+/* Returns 1 if the path segment s of length len is of the form {name} */
+static int
+coap_route_is_param(const uint8_t *s, size_t len) {
+  return len >= 2 && s[0] == '{' && s[len - 1] == '}';
+}
+
+/* Returns 1 if the uri_path of resource has {param} segments */
+static int
+coap_route_is_template(const coap_resource_t *resource) {
+  const uint8_t *s = resource->uri_path->s;
+  const uint8_t *end = s + resource->uri_path->length;
+
+  while (s < end) {
+    const uint8_t *seg_end = memchr(s, '/', end - s);
+
+    if (!seg_end)
+      seg_end = end;
+    if (coap_route_is_param(s, seg_end - s))
+      return 1;
+    if (seg_end == end)
+      break;
+    s = seg_end + 1;
+  }
+  return 0;
+}
+
+static coap_route_node_t *
+coap_route_new_node(const uint8_t *label, size_t length) {
+  coap_route_node_t *node;
+
+  node = coap_malloc_type(COAP_STRING, sizeof(coap_route_node_t) + length);
+  if (node) {
+    memset(node, 0, sizeof(coap_route_node_t));
+    node->length = length;
+    if (length)
+      memcpy(node->label, label, length);
+  }
+  return node;
+}
+
+static void
+coap_route_free(coap_route_node_t *node) {
+  while (node) {
+    coap_route_node_t *next = node->next;
+
+    coap_route_free(node->child);
+    coap_route_free(node->param);
+    coap_free_type(COAP_STRING, node);
+    node = next;
+  }
+}
+
+/*
+ * Add the static path s of length len below node, splitting any edge that
+ * only partially matches. Returns the node where s ends, or NULL on error.
+ */
+static coap_route_node_t *
+coap_route_add_static(coap_route_node_t *node, const uint8_t *s, size_t len) {
+  while (len) {
+    coap_route_node_t *c;
+    size_t common = 0;
+
+    for (c = node->child; c; c = c->next) {
+      if (c->label[0] == s[0])
+        break;
+    }
+    if (!c) {
+      c = coap_route_new_node(s, len);
+      if (!c)
+        return NULL;
+      c->next = node->child;
+      node->child = c;
+      return c;
+    }
+    while (common < c->length && common < len && c->label[common] == s[common])
+      common++;
+    if (common < c->length) {
+      /* Move the unmatched end of the label down into a new child */
+      coap_route_node_t *n = coap_route_new_node(&c->label[common],
+                                                 c->length - common);
+
+      if (!n)
+        return NULL;
+      n->child = c->child;
+      n->param = c->param;
+      n->resource = c->resource;
+      n->prefix = c->prefix;
+      c->child = n;
+      c->param = NULL;
+      c->resource = NULL;
+      c->prefix = NULL;
+      c->length = common;
+    }
+    node = c;
+    s += common;
+    len -= common;
+  }
+  return node;
+}
+
+static int
+coap_route_add(coap_context_t *context, coap_resource_t *resource) {
+  const uint8_t *s = resource->uri_path->s;
+  const uint8_t *end = s + resource->uri_path->length;
+  const uint8_t *run = s; /* start of the current static part */
+  coap_route_node_t *node;
+  coap_resource_t **slot;
+
+  if (!context->routes) {
+    context->routes = coap_route_new_node(NULL, 0);
+    if (!context->routes)
+      return 0;
+  }
+  node = context->routes;
+  while (s < end) {
+    const uint8_t *seg_end = memchr(s, '/', end - s);
+
+    if (!seg_end)
+      seg_end = end;
+    if (coap_route_is_param(s, seg_end - s)) {
+      node = coap_route_add_static(node, run, s - run);
+      if (!node)
+        return 0;
+      if (!node->param) {
+        node->param = coap_route_new_node(NULL, 0);
+        if (!node->param)
+          return 0;
+      }
+      node = node->param;
+      run = seg_end;
+    }
+    if (seg_end == end)
+      break;
+    s = seg_end + 1;
+  }
+  node = coap_route_add_static(node, run, end - run);
+  if (!node)
+    return 0;
+
+  slot = resource->flags & COAP_RESOURCE_FLAGS_URI_PREFIX ?
+         &node->prefix : &node->resource;
+  if (*slot) {
+    coap_log_warn("coap_add_resource: uri_path '%*.*s' replaces route for '%*.*s'\n",
+                  (int)resource->uri_path->length, (int)resource->uri_path->length,
+                  resource->uri_path->s,
+                  (int)(*slot)->uri_path->length, (int)(*slot)->uri_path->length,
+                  (*slot)->uri_path->s);
+  }
+  *slot = resource;
+  return 1;
+}
+
+/*
+ * Nodes are not merged back together when a resource is removed, so just
+ * rebuild the tree from the remaining resources.
+ */
+static void
+coap_route_rebuild(coap_context_t *context) {
+  coap_route_free(context->routes);
+  context->routes = NULL;
+
+  RESOURCES_ITER(context->resources, r) {
+    if (r->is_routed && !coap_route_add(context, r))
+      r->is_routed = 0;
+  }
+}
+
 COAP_API void
 coap_add_resource(coap_context_t *context, coap_resource_t *resource) {
   coap_lock_lock(context, return);
@@ -562,6 +738,16 @@ coap_add_resource_lkd(coap_context_t *context, coap_resource_t *resource) {
       coap_delete_resource_lkd(context, r);
     }
     RESOURCES_ADD(context->resources, resource);
+    resource->is_template = coap_route_is_template(resource);
+    if (resource->is_template ||
+        (resource->flags & COAP_RESOURCE_FLAGS_URI_PREFIX)) {
+      if (coap_route_add(context, resource))
+        resource->is_routed = 1;
+      else
+        coap_log_warn("coap_add_resource: no memory to route uri_path '%*.*s'\n",
+                      (int)resource->uri_path->length,
+                      (int)resource->uri_path->length, resource->uri_path->s);
+    }
 #if COAP_WITH_OBSERVE_PERSIST
     if (context->unknown_pdu && context->dyn_resource_save_file &&
         context->dyn_resource_added && resource->observable) {
@@ -622,6 +808,8 @@ coap_delete_resource_lkd(coap_context_t *context, coap_resource_t *resource) {
   } else if (context) {
     /* remove resource from list */
     RESOURCES_DELETE(context->resources, resource);
+    if (resource->is_routed)
+      coap_route_rebuild(context);
   }
 
   /* and free its allocated memory */
@@ -644,6 +832,8 @@ coap_delete_all_resources(coap_context_t *context) {
   }
 
   context->resources = NULL;
+  coap_route_free(context->routes);
+  context->routes = NULL;
 
   if (context->unknown_resource) {
     coap_free_resource(context->unknown_resource);
@@ -678,6 +868,126 @@ coap_get_resource_from_uri_path_lkd(coap_context_t *context,
   return result;
 }
 
+coap_resource_t *
+coap_resource_route_lkd(coap_context_t *context,
+                        const coap_str_const_t *uri_path) {
+  const coap_route_node_t *node = context->routes;
+  const uint8_t *path = uri_path->s;
+  size_t len = uri_path->length;
+  size_t pos = 0;
+  coap_resource_t *best = NULL;
+
+  coap_lock_check_locked(context);
+
+  while (node) {
+    const coap_route_node_t *c;
+
+    /* node's label ends at pos - a prefix must end at a segment boundary */
+    if (node->prefix && (pos == 0 || pos == len || path[pos] == '/' ||
+                         path[pos - 1] == '/'))
+      best = node->prefix;
+    if (pos == len)
+      return node->resource ? node->resource : best;
+
+    for (c = node->child; c; c = c->next) {
+      if (c->label[0] == path[pos])
+        break;
+    }
+    if (c && c->length <= len - pos &&
+        memcmp(c->label, &path[pos], c->length) == 0) {
+      pos += c->length;
+      node = c;
+    } else if (node->param && (pos == 0 || path[pos - 1] == '/') &&
+               path[pos] != '/') {
+      size_t start = pos;
+
+      while (pos < len && path[pos] != '/')
+        pos++;
+      /* A literal "{name}" is not a parameter value */
+      if (coap_route_is_param(&path[start], pos - start))
+        break;
+      node = node->param;
+    } else {
+      break;
+    }
+  }
+  return best;
+}
+
+/* Get the index'th Uri-Path option of request */
+static int
+coap_get_uri_path_segment(const coap_pdu_t *request, size_t index,
+                          coap_str_const_t *value) {
+  coap_opt_iterator_t opt_iter;
+  coap_opt_filter_t f;
+  coap_opt_t *opt;
+
+  coap_option_filter_clear(&f);
+  coap_option_filter_set(&f, COAP_OPTION_URI_PATH);
+  coap_option_iterator_init(request, &opt_iter, &f);
+  while ((opt = coap_option_next(&opt_iter))) {
+    if (index-- == 0) {
+      value->s = coap_opt_value(opt);
+      value->length = coap_opt_length(opt);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int
+coap_resource_get_uri_param(const coap_resource_t *resource,
+                            const coap_pdu_t *request, const char *name,
+                            coap_str_const_t *value) {
+  const uint8_t *s;
+  const uint8_t *end;
+  size_t name_len;
+  size_t index = 0;
+
+  if (!resource || !request || !name || !value || !resource->uri_path)
+    return 0;
+
+  s = resource->uri_path->s;
+  end = s + resource->uri_path->length;
+  name_len = strlen(name);
+  while (s < end) {
+    const uint8_t *seg_end = memchr(s, '/', end - s);
+
+    if (!seg_end)
+      seg_end = end;
+    if ((size_t)(seg_end - s) == name_len + 2 &&
+        coap_route_is_param(s, seg_end - s) &&
+        memcmp(s + 1, name, name_len) == 0)
+      return coap_get_uri_path_segment(request, index, value);
+    if (seg_end == end)
+      break;
+    index++;
+    s = seg_end + 1;
+  }
+  return 0;
+}
+
+int
+coap_resource_get_uri_remainder(const coap_resource_t *resource,
+                                const coap_pdu_t *request, size_t index,
+                                coap_str_const_t *value) {
+  size_t segments = 0;
+  size_t i;
+
+  if (!resource || !request || !value || !resource->uri_path)
+    return 0;
+
+  /* Number of path segments taken up by the resource itself */
+  if (resource->uri_path->length) {
+    segments = 1;
+    for (i = 0; i < resource->uri_path->length - 1; i++) {
+      if (resource->uri_path->s[i] == '/')
+        segments++;
+    }
+  }
+  return coap_get_uri_path_segment(request, segments + index, value);
+}
+
 coap_print_status_t
 coap_print_link(const coap_resource_t *resource,
                 unsigned char *buf, size_t *len, size_t *offset) {
@@ -788,6 +1098,128 @@ coap_find_observer_cache_key(coap_resource_t *resource, coap_session_t *session,
   return NULL;
 }
 
+static const struct {
+  const char *name;
+  uint8_t flag;
+} obs_cond_attrs[] = {
+  { "pmin", COAP_OBS_COND_PMIN },
+  { "pmax", COAP_OBS_COND_PMAX },
+  { "gt",   COAP_OBS_COND_GT },
+  { "lt",   COAP_OBS_COND_LT },
+  { "st",   COAP_OBS_COND_ST }
+};
+
+/*
+ * Parses @p s as a plain decimal number ([-]digits[.digits]) into @p v.
+ * Unlike strtod(), this does not depend on the locale and does not take
+ * "nan", "inf" or exponents, so @p v is always finite. Returns 0 if @p s is
+ * not such a number.
+ */
+static int
+coap_observe_cond_number(const char *s, double *v) {
+  double scale = 1;
+  int neg = 0;
+  int point = 0;
+  int digits = 0;
+
+  *v = 0;
+  if (*s == '-') {
+    neg = 1;
+    s++;
+  }
+  for (; *s; s++) {
+    if (*s == '.' && !point) {
+      point = 1;
+      continue;
+    }
+    if (*s < '0' || *s > '9')
+      return 0;
+    digits++;
+    if (point) {
+      scale /= 10;
+      *v += (*s - '0') * scale;
+    } else {
+      *v = *v * 10 + (*s - '0');
+    }
+  }
+  if (neg)
+    *v = -*v;
+  return digits > 0;
+}
+
+/*
+ * Picks up the conditional observe attributes (pmin, pmax, gt, lt and st) in
+ * the Uri-Query options of @p request. Any that are not valid are ignored,
+ * and pmin and pmax are capped at COAP_OBS_COND_MAX_PERIOD.
+ */
+static void
+coap_observe_cond_parse(coap_subscription_t *s, const coap_pdu_t *request) {
+  coap_opt_iterator_t opt_iter;
+  coap_opt_filter_t filter;
+  coap_opt_t *option;
+
+  coap_option_filter_clear(&filter);
+  coap_option_filter_set(&filter, COAP_OPTION_URI_QUERY);
+  coap_option_iterator_init(request, &opt_iter, &filter);
+  while ((option = coap_option_next(&opt_iter))) {
+    char buf[32];
+    size_t len = coap_opt_length(option);
+    char *value;
+    double v;
+    size_t i;
+
+    if (len >= sizeof(buf))
+      continue;
+    memcpy(buf, coap_opt_value(option), len);
+    buf[len] = '\0';
+    value = strchr(buf, '=');
+    if (!value || value[1] == '\0')
+      continue;
+    *value++ = '\0';
+    if (!coap_observe_cond_number(value, &v))
+      continue;
+    for (i = 0; i < sizeof(obs_cond_attrs) / sizeof(obs_cond_attrs[0]); i++) {
+      if (strcmp(buf, obs_cond_attrs[i].name) == 0)
+        break;
+    }
+    switch (i < sizeof(obs_cond_attrs) / sizeof(obs_cond_attrs[0]) ?
+            obs_cond_attrs[i].flag : 0) {
+    case COAP_OBS_COND_PMIN:
+      if (v < 0)
+        continue;
+      if (v > COAP_OBS_COND_MAX_PERIOD)
+        v = COAP_OBS_COND_MAX_PERIOD;
+      s->pmin = (coap_tick_t)(v * COAP_TICKS_PER_SECOND);
+      break;
+    case COAP_OBS_COND_PMAX:
+      if (v <= 0)
+        continue;
+      if (v > COAP_OBS_COND_MAX_PERIOD)
+        v = COAP_OBS_COND_MAX_PERIOD;
+      s->pmax = (coap_tick_t)(v * COAP_TICKS_PER_SECOND);
+      break;
+    case COAP_OBS_COND_GT:
+      s->gt = v;
+      break;
+    case COAP_OBS_COND_LT:
+      s->lt = v;
+      break;
+    case COAP_OBS_COND_ST:
+      if (v <= 0)
+        continue;
+      s->st = v;
+      break;
+    default:
+      continue;
+    }
+    s->cond |= obs_cond_attrs[i].flag;
+  }
+  /* pmax has to be greater than pmin */
+  if ((s->cond & COAP_OBS_COND_PMIN) && (s->cond & COAP_OBS_COND_PMAX) &&
+      s->pmax <= s->pmin)
+    s->cond &= ~COAP_OBS_COND_PMAX;
+}
+
 /* https://rfc-editor.org/rfc/rfc7641#section-3.6 */
 static const uint16_t cache_ignore_options[] = { COAP_OPTION_ETAG,
                                                  COAP_OPTION_OSCORE
@@ -798,7 +1230,8 @@ coap_add_observer(coap_resource_t *resource,
                   const coap_bin_const_t *token,
                   const coap_pdu_t *request) {
   coap_subscription_t *s;
-  coap_cache_key_t *cache_key = NULL;
+  coap_cache_key_t key;
+  coap_cache_key_t *cache_key;
   size_t len;
   const uint8_t *data;
 
@@ -812,17 +1245,17 @@ coap_add_observer(coap_resource_t *resource,
      * may not be cleaning up duplicates.  If duplicate found, then original
      * observer is deleted and a new one created with the new token
      */
-    cache_key = coap_cache_derive_key_w_ignore(session, request,
-                                               COAP_CACHE_IS_SESSION_BASED,
-                                               cache_ignore_options,
-                                               sizeof(cache_ignore_options)/sizeof(cache_ignore_options[0]));
-    if (cache_key) {
-      s = coap_find_observer_cache_key(resource, session, cache_key);
-      if (s) {
-        /* Delete old entry with old token */
-        coap_delete_observer(resource, session, &s->pdu->actual_token);
-        s = NULL;
-      }
+    if (!coap_cache_derive_key_into(session, request,
+                                    COAP_CACHE_IS_SESSION_BASED,
+                                    cache_ignore_options,
+                                    sizeof(cache_ignore_options)/sizeof(cache_ignore_options[0]),
+                                    &key))
+      return NULL;
+    s = coap_find_observer_cache_key(resource, session, &key);
+    if (s) {
+      /* Delete old entry with old token */
+      coap_delete_observer(resource, session, &s->pdu->actual_token);
+      s = NULL;
     }
   }
 
@@ -844,7 +1277,6 @@ coap_add_observer(coap_resource_t *resource,
   s = coap_malloc_type(COAP_SUBSCRIPTION, sizeof(coap_subscription_t));
 
   if (!s) {
-    coap_delete_cache_key(cache_key);
     return NULL;
   }
 
@@ -852,7 +1284,6 @@ coap_add_observer(coap_resource_t *resource,
   s->pdu = coap_pdu_duplicate_lkd(request, session, token->length,
                                   token->s, NULL);
   if (s->pdu == NULL) {
-    coap_delete_cache_key(cache_key);
     coap_free_type(COAP_SUBSCRIPTION, s);
     return NULL;
   }
@@ -861,24 +1292,31 @@ coap_add_observer(coap_resource_t *resource,
     s->pdu->max_size = 0;
     coap_add_data(s->pdu, len, data);
   }
+  cache_key = coap_malloc_type(COAP_CACHE_KEY, sizeof(coap_cache_key_t));
   if (cache_key == NULL) {
-    cache_key = coap_cache_derive_key_w_ignore(session, request,
-                                               COAP_CACHE_IS_SESSION_BASED,
-                                               cache_ignore_options,
-                                               sizeof(cache_ignore_options)/sizeof(cache_ignore_options[0]));
-    if (cache_key == NULL) {
-      coap_delete_pdu(s->pdu);
-      coap_delete_cache_key(cache_key);
-      coap_free_type(COAP_SUBSCRIPTION, s);
-      return NULL;
-    }
+    coap_delete_pdu(s->pdu);
+    coap_free_type(COAP_SUBSCRIPTION, s);
+    return NULL;
   }
+  *cache_key = key;
   s->cache_key = cache_key;
   s->session = coap_session_reference_lkd(session);
 
   /* add subscriber to resource */
   LL_PREPEND(resource->subscribers, s);
 
+  /* The response to this request is the first notification */
+  coap_observe_cond_parse(s, request);
+  coap_ticks(&s->last_notify);
+  s->last_observe = resource->observe;
+  if (resource->has_value) {
+    s->last_value = resource->value;
+    s->cond |= COAP_OBS_COND_LAST;
+  }
+  if (s->cond & COAP_OBS_COND_PMAX)
+    coap_notify_defer(resource->context, resource, s,
+                      s->last_notify + s->pmax);
+
   coap_log_debug("create new subscription %p key 0x%02x%02x%02x%02x\n",
                  (void *)s, s->cache_key->key[0], s->cache_key->key[1],
                  s->cache_key->key[2], s->cache_key->key[3]);
@@ -1021,6 +1459,7 @@ coap_delete_observer_internal(coap_resource_t *resource, coap_session_t *session
 
   if (resource->subscribers) {
     LL_DELETE(resource->subscribers, s);
+    coap_notify_undefer(resource, s);
     coap_session_release_lkd(session);
     coap_delete_pdu(s->pdu);
     coap_delete_cache_key(s->cache_key);
@@ -1054,19 +1493,18 @@ coap_delete_observer_request(coap_resource_t *resource, coap_session_t *session,
      * It is possible that the client is using the wrong token.
      * An example being a large FETCH spanning multiple blocks.
      */
-    coap_cache_key_t *cache_key;
-
-    cache_key = coap_cache_derive_key_w_ignore(session, request,
-                                               COAP_CACHE_IS_SESSION_BASED,
-                                               cache_ignore_options,
-                                               sizeof(cache_ignore_options)/sizeof(cache_ignore_options[0]));
-    if (cache_key) {
-      s = coap_find_observer_cache_key(resource, session, cache_key);
+    coap_cache_key_t cache_key;
+
+    if (coap_cache_derive_key_into(session, request,
+                                   COAP_CACHE_IS_SESSION_BASED,
+                                   cache_ignore_options,
+                                   sizeof(cache_ignore_options)/sizeof(cache_ignore_options[0]),
+                                   &cache_key)) {
+      s = coap_find_observer_cache_key(resource, session, &cache_key);
       if (s) {
         /* Delete entry with setup token */
         ret = coap_delete_observer(resource, session, &s->pdu->actual_token);
       }
-      coap_delete_cache_key(cache_key);
     }
   } else {
     coap_delete_observer_internal(resource, session, s);
@@ -1085,6 +1523,7 @@ coap_delete_observers(coap_context_t *context, coap_session_t *session) {
           context->observe_deleted(session, s, context->observe_user_data);
         assert(resource->subscribers);
         LL_DELETE(resource->subscribers, s);
+        coap_notify_undefer(resource, s);
         coap_session_release_lkd(session);
         coap_delete_pdu(s->pdu);
         coap_delete_cache_key(s->cache_key);
@@ -1094,6 +1533,186 @@ coap_delete_observers(coap_context_t *context, coap_session_t *session) {
   }
 }
 
+/*
+ * Adds @p r to the context's queue of resources that have notifications to
+ * send, if not already there. The queue is only walked by coap_check_notify()
+ * once observe_pending is set or the earliest observe_due has been reached.
+ */
+static void
+coap_notify_queue(coap_context_t *context, coap_resource_t *r) {
+  if (!r->dirty_queued) {
+    DL_APPEND2(context->dirty_resources, r, dirty_prev, dirty_next);
+    r->dirty_queued = 1;
+  }
+}
+
+static void
+coap_notify_dequeue(coap_context_t *context, coap_resource_t *r) {
+  if (r->dirty_queued) {
+    DL_DELETE2(context->dirty_resources, r, dirty_prev, dirty_next);
+    r->dirty_queued = 0;
+  }
+}
+
+static void
+coap_notify_due(coap_context_t *context, coap_tick_t due) {
+  if (context->observe_due == 0 || due < context->observe_due)
+    context->observe_due = due;
+}
+
+/*
+ * Holds back the notification for @p obs, to be tried again on the next
+ * coap_check_notify() pass or, if @p due is not 0, on the first pass once
+ * @p due has been reached.
+ */
+static void
+coap_notify_defer(coap_context_t *context, coap_resource_t *r,
+                  coap_subscription_t *obs, coap_tick_t due) {
+  if (!obs->dirty) {
+    DL_APPEND2(r->dirty_subscribers, obs, dirty_prev, dirty_next);
+    obs->dirty = 1;
+    obs->notify_due = due;
+  } else if (due < obs->notify_due) {
+    obs->notify_due = due;
+  }
+  if (obs->notify_due)
+    coap_notify_due(context, obs->notify_due);
+  else
+    context->observe_pending = 1;
+  r->partiallydirty = 1;
+  coap_notify_queue(context, r);
+}
+
+/*
+ * Returns 1 if the resource's value has changed enough since the last
+ * notification to @p obs for its gt, lt and st attributes (if any).
+ */
+static int
+coap_notify_cond_changed(const coap_resource_t *r,
+                         const coap_subscription_t *obs) {
+  double last = obs->last_value;
+  double v = r->value;
+
+  if (!(obs->cond & COAP_OBS_COND_VALUE) || !r->has_value ||
+      !(obs->cond & COAP_OBS_COND_LAST))
+    return 1;
+  if ((obs->cond & COAP_OBS_COND_ST) &&
+      (v > last ? v - last : last - v) >= obs->st)
+    return 1;
+  if ((obs->cond & COAP_OBS_COND_GT) && (last > obs->gt) != (v > obs->gt))
+    return 1;
+  if ((obs->cond & COAP_OBS_COND_LT) && (last < obs->lt) != (v < obs->lt))
+    return 1;
+  return 0;
+}
+
+/*
+ * Applies the conditional attributes of @p obs. Returns 1 if nothing is to be
+ * sent to @p obs yet: the change is too small, pmin has not passed since the
+ * last notification (the change is then sent once it has, along with any
+ * later ones), or (when @p full is 0) pmin or pmax is still to come.
+ */
+static int
+coap_notify_cond_hold(coap_context_t *context, coap_resource_t *r,
+                      coap_subscription_t *obs, int full, coap_tick_t now) {
+  if (full) {
+    if (!coap_notify_cond_changed(r, obs)) {
+      if (obs->dirty && obs->notify_due)
+        coap_notify_due(context, obs->notify_due);
+      return 1;
+    }
+    if ((obs->cond & COAP_OBS_COND_PMIN) &&
+        now < obs->last_notify + obs->pmin) {
+      coap_notify_defer(context, r, obs, obs->last_notify + obs->pmin);
+      return 1;
+    }
+  } else if (obs->notify_due > now) {
+    coap_notify_due(context, obs->notify_due);
+    return 1;
+  }
+  return 0;
+}
+
+static void
+coap_notify_undefer(coap_resource_t *r, coap_subscription_t *obs) {
+  if (obs->dirty) {
+    DL_DELETE2(r->dirty_subscribers, obs, dirty_prev, dirty_next);
+    obs->dirty = 0;
+  }
+}
+
+static void
+coap_notify_uncache(coap_resource_t *r) {
+  coap_delete_pdu(r->notify_pdu);
+  r->notify_pdu = NULL;
+  coap_delete_binary(r->notify_req);
+  r->notify_req = NULL;
+}
+
+/*
+ * Copies the code, options and data of @p from into @p to, which only has its
+ * token set up. Returns 0 (leaving @p to unchanged) if they do not fit.
+ */
+static int
+coap_notify_copy_body(coap_pdu_t *to, const coap_pdu_t *from) {
+  size_t len = from->used_size - from->e_token_length;
+
+  if (to->max_size && to->used_size + len > to->max_size)
+    return 0;
+  if (!coap_pdu_resize(to, to->used_size + len))
+    return 0;
+  memcpy(to->token + to->used_size, from->token + from->e_token_length, len);
+  if (from->data)
+    to->data = to->token + to->used_size +
+               (from->data - from->token - from->e_token_length);
+  to->used_size += len;
+  to->max_opt = from->max_opt;
+  to->code = from->code;
+  return 1;
+}
+
+/*
+ * Returns 1 if @p request has the same code, options and data as the request
+ * the resource's shared notification was rendered for.
+ */
+static int
+coap_notify_req_match(const coap_resource_t *r, const coap_pdu_t *request) {
+  size_t len = request->used_size - request->e_token_length;
+
+  return r->notify_req->length == len + 1 &&
+         r->notify_req->s[0] == request->code &&
+         memcmp(&r->notify_req->s[1], request->token + request->e_token_length,
+                len) == 0;
+}
+
+/*
+ * Keeps a copy of @p response (rendered for @p request) for the other
+ * subscribers, unless it is not a 2.xx or is being sent as blocks.
+ */
+static void
+coap_notify_cache(coap_resource_t *r, const coap_pdu_t *request,
+                  const coap_pdu_t *response) {
+  size_t len = request->used_size - request->e_token_length;
+  coap_opt_iterator_t opt_iter;
+
+  if (COAP_RESPONSE_CLASS(response->code) != 2 || response->lg_xmit ||
+      coap_check_option(request, COAP_OPTION_BLOCK2, &opt_iter) ||
+      coap_check_option(request, COAP_OPTION_Q_BLOCK2, &opt_iter) ||
+      coap_check_option(response, COAP_OPTION_BLOCK2, &opt_iter) ||
+      coap_check_option(response, COAP_OPTION_Q_BLOCK2, &opt_iter))
+    return;
+
+  r->notify_req = coap_new_binary(len + 1);
+  r->notify_pdu = coap_pdu_init(COAP_MESSAGE_CON, 0, 0, response->used_size);
+  if (!r->notify_req || !r->notify_pdu ||
+      !coap_notify_copy_body(r->notify_pdu, response)) {
+    coap_notify_uncache(r);
+    return;
+  }
+  r->notify_req->s[0] = request->code;
+  memcpy(&r->notify_req->s[1], request->token + request->e_token_length, len);
+}
+
 static void
 coap_notify_observers(coap_context_t *context, coap_resource_t *r,
                       coap_deleting_resource_t deleting) {
@@ -1105,51 +1724,66 @@ coap_notify_observers(coap_context_t *context, coap_resource_t *r,
   coap_block_b_t block;
   coap_tick_t now;
   coap_session_t *obs_session;
+  int full;
+  int count = 0;
 
   coap_lock_check_locked(context);
 
   if (r->observable && (r->dirty || r->partiallydirty)) {
     r->partiallydirty = 0;
+    /*
+     * After a change, every subscriber is notified. Otherwise only those
+     * held back last time are tried again. Any held back again keep their
+     * place in dirty_subscribers, while any newly held back (e.g. for pmax
+     * once sent) are added at the end, after the ones counted here.
+     */
+    full = r->dirty;
+    if (!full)
+      DL_COUNT2(r->dirty_subscribers, obs, count, dirty_next);
 
-    LL_FOREACH_SAFE(r->subscribers, obs, otmp) {
+    for (obs = full ? r->subscribers : r->dirty_subscribers;
+         obs && (full || count-- > 0); obs = otmp) {
+      otmp = full ? obs->next : obs->dirty_next;
       obs_session = obs->session;
-      if (r->dirty == 0 && obs->dirty == 0) {
-        /*
-         * running this resource due to partiallydirty, but this observation's
-         * notification was already enqueued
-         */
-        context->observe_pending = 1;
+      coap_ticks(&now);
+      if (deleting == COAP_NOT_DELETING_RESOURCE && (obs->cond || obs->dirty) &&
+          coap_notify_cond_hold(context, r, obs, full, now))
+        continue;
+      if (deleting == COAP_NOT_DELETING_RESOURCE && COAP_OBS_MAX_BURST &&
+          obs_session->notify_pass == context->notify_pass &&
+          obs_session->notify_cnt >= COAP_OBS_MAX_BURST) {
+        /* This session has had its share for this pass */
+        coap_notify_defer(context, r, obs, 0);
+        context->observe_deferred = 1;
         continue;
       }
       if (obs->session->con_active >= COAP_NSTART(obs->session) &&
           ((r->flags & COAP_RESOURCE_FLAGS_NOTIFY_CON) ||
            (obs->non_cnt >= COAP_OBS_MAX_NON))) {
         /* Waiting for the previous unsolicited response to finish */
-        r->partiallydirty = 1;
-        obs->dirty = 1;
-        context->observe_pending = 1;
+        coap_notify_defer(context, r, obs, 0);
         continue;
       }
-      coap_ticks(&now);
       if (obs->session->lg_xmit && obs->session->lg_xmit->last_all_sent == 0 &&
           obs->session->lg_xmit->last_obs &&
           (obs->session->lg_xmit->last_obs + 2*COAP_TICKS_PER_SECOND) > now) {
         /* Waiting for the previous blocked unsolicited response to finish */
-        r->partiallydirty = 1;
-        obs->dirty = 1;
-        context->observe_pending = 1;
+        coap_notify_defer(context, r, obs, 0);
         continue;
       }
 
       coap_mid_t mid = COAP_INVALID_MID;
-      obs->dirty = 0;
+      coap_notify_undefer(r, obs);
+      if (obs_session->notify_pass != context->notify_pass) {
+        obs_session->notify_pass = context->notify_pass;
+        obs_session->notify_cnt = 0;
+      }
+      obs_session->notify_cnt++;
       /* initialize response */
       response = coap_pdu_init(COAP_MESSAGE_CON, 0, 0,
                                coap_session_max_pdu_size_lkd(obs->session));
       if (!response) {
-        obs->dirty = 1;
-        r->partiallydirty = 1;
-        context->observe_pending = 1;
+        coap_notify_defer(context, r, obs, 0);
         coap_log_debug("coap_check_notify: pdu init failed, resource stays "
                        "partially dirty\n");
         continue;
@@ -1157,9 +1791,7 @@ coap_notify_observers(coap_context_t *context, coap_resource_t *r,
 
       if (!coap_add_token(response, obs->pdu->actual_token.length,
                           obs->pdu->actual_token.s)) {
-        obs->dirty = 1;
-        r->partiallydirty = 1;
-        context->observe_pending = 1;
+        coap_notify_defer(context, r, obs, 0);
         coap_log_debug("coap_check_notify: cannot add token, resource stays "
                        "partially dirty\n");
         coap_delete_pdu(response);
@@ -1178,6 +1810,16 @@ coap_notify_observers(coap_context_t *context, coap_resource_t *r,
       }
       switch (deleting) {
       case COAP_NOT_DELETING_RESOURCE:
+        if (!full && obs->last_observe == r->observe) {
+          /* pmax is up with no change, but the Observe value must be new */
+          r->observe = (r->observe + 1) & 0xFFFFFF;
+          coap_notify_uncache(r);
+        }
+        if (r->notify_pdu && coap_notify_req_match(r, obs->pdu) &&
+            coap_notify_copy_body(response, r->notify_pdu)) {
+          /* Already rendered for an identical request */
+          break;
+        }
         /* fill with observer-specific data */
         coap_add_option_internal(response, COAP_OPTION_OBSERVE,
                                  coap_encode_var_safe(buf, sizeof(buf),
@@ -1232,6 +1874,9 @@ coap_notify_observers(coap_context_t *context, coap_resource_t *r,
         /* Check if lg_xmit generated and update PDU code if so */
         coap_check_code_lg_xmit(obs->session, obs->pdu, response, r, query);
         coap_delete_string(query);
+        if ((r->flags & COAP_RESOURCE_FLAGS_NOTIFY_RENDER_ONCE) &&
+            !r->notify_pdu)
+          coap_notify_cache(r, obs->pdu, response);
         if (COAP_RESPONSE_CLASS(response->code) != 2) {
           coap_remove_option(response, COAP_OPTION_OBSERVE);
         }
@@ -1274,23 +1919,39 @@ coap_notify_observers(coap_context_t *context, coap_resource_t *r,
 #if COAP_Q_BLOCK_SUPPORT
 finish:
 #endif /* COAP_Q_BLOCK_SUPPORT */
-      if (COAP_INVALID_MID == mid && obs) {
+      if (obs) {
         coap_subscription_t *s;
-        coap_log_debug("coap_check_notify: sending failed, resource stays "
-                       "partially dirty\n");
+
         LL_FOREACH(r->subscribers, s) {
-          if (s == obs) {
-            /* obs not deleted during coap_send_internal() */
-            obs->dirty = 1;
+          if (s == obs)
             break;
+        }
+        if (!s) {
+          /* obs deleted during coap_send_internal() */
+        } else if (COAP_INVALID_MID == mid) {
+          coap_log_debug("coap_check_notify: sending failed, resource stays "
+                         "partially dirty\n");
+          coap_notify_defer(context, r, obs, 0);
+        } else {
+          obs->last_notify = now;
+          obs->last_observe = r->observe;
+          if (r->has_value) {
+            obs->last_value = r->value;
+            obs->cond |= COAP_OBS_COND_LAST;
           }
+          if ((obs->cond & COAP_OBS_COND_PMAX) &&
+              deleting == COAP_NOT_DELETING_RESOURCE)
+            coap_notify_defer(context, r, obs, now + obs->pmax);
         }
-        r->partiallydirty = 1;
-        context->observe_pending = 1;
       }
     }
+    /* Includes any held back for pmin or waiting for pmax */
+    if (r->dirty_subscribers)
+      r->partiallydirty = 1;
   }
   r->dirty = 0;
+  if (r->notify_pdu && !r->partiallydirty)
+    coap_notify_uncache(r);
 }
 
 COAP_API int
@@ -1314,15 +1975,37 @@ coap_resource_notify_observers(coap_resource_t *r,
   return ret;
 }
 
+COAP_API int
+coap_resource_notify_observers_value(coap_resource_t *r, double value) {
+  int ret;
+
+  coap_lock_lock(r->context, return 0);
+  ret = coap_resource_notify_observers_value_lkd(r, value);
+  coap_lock_unlock(r->context);
+  return ret;
+}
+
+int
+coap_resource_notify_observers_value_lkd(coap_resource_t *r, double value) {
+  coap_lock_check_locked(r->context);
+  r->value = value;
+  r->has_value = 1;
+  return coap_resource_notify_observers_lkd(r, NULL);
+}
+
 int
 coap_resource_notify_observers_lkd(coap_resource_t *r,
                                    const coap_string_t *query COAP_UNUSED) {
   coap_lock_check_locked(r->context);
+  /* Any cached responses are for the previous state */
+  coap_cache_delete_resource_entries(r->context, r);
   if (!r->observable)
     return 0;
   if (!r->subscribers)
     return 0;
   r->dirty = 1;
+  /* Any shared notification is for the previous state */
+  coap_notify_uncache(r);
 
   /* Increment value for next Observe use. Observe value must be < 2^24 */
   r->observe = (r->observe + 1) & 0xFFFFFF;
@@ -1337,6 +2020,7 @@ coap_resource_notify_observers_lkd(coap_resource_t *r,
                                       r->context->observe_user_data);
   }
 
+  coap_notify_queue(r->context, r);
   r->context->observe_pending = 1;
   coap_update_io_timer(r->context, 0);
   return 1;
@@ -1388,10 +2072,32 @@ void
 coap_check_notify_lkd(coap_context_t *context) {
 
   coap_lock_check_locked(context);
+  if (!context->observe_pending && context->observe_due) {
+    coap_tick_t now;
+
+    /* Only held back (pmin/pmax) notifications, so wait until one is due */
+    coap_ticks(&now);
+    if (now >= context->observe_due)
+      context->observe_pending = 1;
+  }
   if (context->observe_pending) {
+    coap_resource_t *r;
+    int count;
+
     context->observe_pending = 0;
-    RESOURCES_ITER(context->resources, r) {
+    context->observe_deferred = 0;
+    context->observe_due = 0;
+    context->notify_pass++;
+    /*
+     * Only the resources queued so far are processed. Any that still have
+     * notifications held back get queued again at the end.
+     */
+    DL_COUNT2(context->dirty_resources, r, count, dirty_next);
+    while (count-- > 0 && (r = context->dirty_resources) != NULL) {
+      coap_notify_dequeue(context, r);
       coap_notify_observers(context, r, COAP_NOT_DELETING_RESOURCE);
+      if (r->dirty || r->partiallydirty)
+        coap_notify_queue(context, r);
     }
   }
 }
@@ -1403,6 +2109,7 @@ coap_persist_set_observe_num(coap_resource_t *resource,
     return;
 
   resource->observe = start_observe_no & 0xffffff;
+  coap_notify_uncache(resource);
 }
 
 /**
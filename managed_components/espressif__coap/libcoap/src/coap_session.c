@@ -355,6 +355,11 @@ coap_session_reference(coap_session_t *session) {
 coap_session_t *
 coap_session_reference_lkd(coap_session_t *session) {
   ++session->ref;
+#if COAP_SERVER_SUPPORT
+  /* No longer unused */
+  if (session->lru_flags)
+    coap_session_update_lru(session);
+#endif /* COAP_SERVER_SUPPORT */
   return session;
 }
 
@@ -382,6 +387,13 @@ coap_session_release_lkd(coap_session_t *session) {
       --session->ref;
     if (session->ref == 0 && session->type == COAP_SESSION_TYPE_CLIENT)
       coap_session_free(session);
+    else if (session->ref == 0) {
+      /* Idle timeout now applies */
+      coap_session_timer_touch(session);
+#if COAP_SERVER_SUPPORT
+      coap_session_update_lru(session);
+#endif /* COAP_SERVER_SUPPORT */
+    }
 #else /* __COVERITY__ */
     /* Coverity scan is fooled by the reference counter leading to
      * false positives for USE_AFTER_FREE. */
@@ -480,10 +492,30 @@ coap_make_session(coap_proto_t proto, coap_session_type_t type,
   if (COAP_PROTO_NOT_RELIABLE(session->proto))
     coap_prng_lkd((unsigned char *)&session->tx_mid, sizeof(session->tx_mid));
   coap_prng_lkd((unsigned char *)&session->tx_rtag, sizeof(session->tx_rtag));
+  session->timer_flags |= COAP_SESSION_TIMER_OWNED;
+  coap_session_timer_touch(session);
 
   return session;
 }
 
+#if COAP_CLIENT_SUPPORT
+/*
+ * Returns the entry of the session's sendqueue that is due first, the
+ * same order as the context's sendqueue heap. Of entries due at the same
+ * time, the one queued last is returned.
+ */
+static coap_queue_t *
+coap_session_first_due(coap_session_t *session) {
+  coap_queue_t *q, *first = NULL;
+
+  DL_FOREACH2(session->sendqueue, q, s_next) {
+    if (!first || q->t <= first->t)
+      first = q;
+  }
+  return first;
+}
+#endif /* COAP_CLIENT_SUPPORT */
+
 void
 coap_session_mfree(coap_session_t *session) {
   coap_queue_t *q, *tmp;
@@ -498,15 +530,8 @@ coap_session_mfree(coap_session_t *session) {
       /* Need to close down observe */
       if (coap_cancel_observe_lkd(session, lg_crcv->app_token, COAP_MESSAGE_NON)) {
         /* Need to delete node we set up for NON */
-        coap_queue_t *queue = session->context->sendqueue;
-
-        while (queue) {
-          if (queue->session == session) {
-            coap_delete_node_lkd(queue);
-            break;
-          }
-          queue = queue->next;
-        }
+        if (session->sendqueue)
+          coap_delete_node_lkd(coap_session_first_due(session));
       }
     }
     /* In case coap_cancel_observe_lkd() failure, which could clear down lg_crcv */
@@ -577,7 +602,7 @@ coap_session_free(coap_session_t *session) {
   assert(session->ref == 0);
   if (session->ref)
     return;
-  /* Make sure nothing gets deleted under our feet */
+  /* Make sure nothing gets deleted under our feet (also drops off LRUs) */
   coap_session_reference_lkd(session);
   coap_session_mfree(session);
 #if COAP_SERVER_SUPPORT
@@ -598,10 +623,153 @@ coap_session_free(coap_session_t *session) {
   coap_log_debug("***%s: session %p: closed\n", coap_session_str(session),
                  (void *)session);
 
+  /* Done after coap_session_mfree() which may have touched the timers */
+  coap_session_timer_remove(session);
   assert(session->ref == 1);
   coap_free_type(COAP_SESSION, session);
 }
 
+/*
+ * Session timers.
+ *
+ * Sessions with a pending timer are held in a pairing heap ordered by
+ * session->timer_t (context->session_timers), so that coap_io_prepare_io_lkd()
+ * only needs to look at the sessions that are due. Anything that may cause
+ * a session timer to fire earlier puts the session onto the
+ * context->sessions_due list using coap_session_timer_touch().
+ */
+static coap_session_t *
+coap_session_timer_meld(coap_session_t *a, coap_session_t *b) {
+  coap_session_t *tmp;
+
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+  if (b->timer_t < a->timer_t) {
+    tmp = a;
+    a = b;
+    b = tmp;
+  }
+  /* b becomes first child of a */
+  b->timer_prev = a;
+  b->timer_next = a->timer_child;
+  if (a->timer_child)
+    a->timer_child->timer_prev = b;
+  a->timer_child = b;
+  a->timer_next = NULL;
+  a->timer_prev = NULL;
+  return a;
+}
+
+static coap_session_t *
+coap_session_timer_merge_pairs(coap_session_t *first) {
+  coap_session_t *paired = NULL;
+  coap_session_t *a, *b, *next;
+
+  while (first) {
+    a = first;
+    b = a->timer_next;
+    next = b ? b->timer_next : NULL;
+    a->timer_next = a->timer_prev = NULL;
+    if (b)
+      b->timer_next = b->timer_prev = NULL;
+    a = coap_session_timer_meld(a, b);
+    a->timer_next = paired;
+    paired = a;
+    first = next;
+  }
+  first = NULL;
+  while (paired) {
+    next = paired->timer_next;
+    paired->timer_next = NULL;
+    first = coap_session_timer_meld(first, paired);
+    paired = next;
+  }
+  return first;
+}
+
+static void
+coap_session_timer_unlink(coap_session_t *session) {
+  coap_context_t *context = session->context;
+
+  if (!(session->timer_flags & COAP_SESSION_TIMER_QUEUED))
+    return;
+  if (session == context->session_timers) {
+    context->session_timers = coap_session_timer_merge_pairs(session->timer_child);
+  } else {
+    if (session->timer_prev->timer_child == session)
+      session->timer_prev->timer_child = session->timer_next;
+    else
+      session->timer_prev->timer_next = session->timer_next;
+    if (session->timer_next)
+      session->timer_next->timer_prev = session->timer_prev;
+    context->session_timers =
+        coap_session_timer_meld(context->session_timers,
+                                coap_session_timer_merge_pairs(session->timer_child));
+  }
+  session->timer_child = session->timer_next = session->timer_prev = NULL;
+  session->timer_flags &= ~COAP_SESSION_TIMER_QUEUED;
+}
+
+void
+coap_session_timer_remove(coap_session_t *session) {
+  coap_session_timer_unlink(session);
+  if (session->timer_flags & COAP_SESSION_TIMER_DUE) {
+    DL_DELETE2(session->context->sessions_due, session, due_prev, due_next);
+    session->timer_flags &= ~COAP_SESSION_TIMER_DUE;
+  }
+}
+
+void
+coap_session_timer_set(coap_session_t *session, coap_tick_t when) {
+  coap_session_timer_remove(session);
+  if (when == 0)
+    return;
+  session->timer_t = when;
+  session->context->session_timers =
+      coap_session_timer_meld(session->context->session_timers, session);
+  session->timer_flags |= COAP_SESSION_TIMER_QUEUED;
+}
+
+void
+coap_session_timer_touch(coap_session_t *session) {
+  /*
+   * Ignore any temporary session objects not known to the context (which
+   * may be freed without coap_session_free()), and changes made while the
+   * session timers are being checked (they are picked up by the check).
+   */
+  if (!session || session->type == COAP_SESSION_TYPE_NONE ||
+      !(session->timer_flags & COAP_SESSION_TIMER_OWNED) ||
+      (session->timer_flags & (COAP_SESSION_TIMER_DUE |
+                               COAP_SESSION_TIMER_CHECKING)))
+    return;
+  DL_APPEND2(session->context->sessions_due, session, due_prev, due_next);
+  session->timer_flags |= COAP_SESSION_TIMER_DUE;
+}
+
+coap_session_t *
+coap_session_timer_next(coap_context_t *context, coap_tick_t now,
+                        uint32_t pass) {
+  coap_session_t *session;
+
+  DL_FOREACH2(context->sessions_due, session, due_next) {
+    /* Touched again after being checked in this pass - leave until next */
+    if (session->timer_pass == pass)
+      continue;
+    coap_session_timer_remove(session);
+    session->timer_pass = pass;
+    return session;
+  }
+  session = context->session_timers;
+  if (session && session->timer_t <= now) {
+    coap_session_timer_unlink(session);
+    session->timer_pass = pass;
+    return session;
+  }
+  return NULL;
+}
+
 static size_t
 coap_session_max_pdu_size_internal(const coap_session_t *session,
                                    size_t max_with_header) {
@@ -699,7 +867,7 @@ coap_session_delay_pdu(coap_session_t *session, coap_pdu_t *pdu,
                        coap_queue_t *node) {
   if (node) {
     coap_queue_t *removed = NULL;
-    coap_remove_from_queue(&session->context->sendqueue, session, node->id, &removed);
+    coap_remove_from_queue(session->context, session, node->id, &removed);
     assert(removed == node);
     coap_session_release_lkd(node->session);
     node->session = NULL;
@@ -816,6 +984,7 @@ coap_session_send_ping_lkd(coap_session_t *session) {
 
 void
 coap_session_connected(coap_session_t *session) {
+  coap_session_timer_touch(session);
   if (session->state != COAP_SESSION_STATE_ESTABLISHED) {
     coap_log_debug("***%s: session connected\n",
                    coap_session_str(session));
@@ -828,6 +997,10 @@ coap_session_connected(coap_session_t *session) {
 
   session->state = COAP_SESSION_STATE_ESTABLISHED;
   session->partial_write = 0;
+#if COAP_SERVER_SUPPORT
+  if (session->lru_flags & COAP_SESSION_LRU_HS)
+    coap_session_update_lru(session);
+#endif /* COAP_SERVER_SUPPORT */
 
   if (session->proto==COAP_PROTO_DTLS) {
     session->tls_overhead = coap_dtls_get_overhead(session);
@@ -905,9 +1078,14 @@ coap_nack_name(coap_nack_reason_t reason) {
 
 COAP_API void
 coap_session_disconnected(coap_session_t *session, coap_nack_reason_t reason) {
-  coap_lock_lock(session->context, return);
+#if COAP_THREAD_SAFE
+  /* session may be released by an app event handler */
+  coap_context_t *context = session->context;
+#endif /* COAP_THREAD_SAFE */
+
+  coap_lock_lock(context, return);
   coap_session_disconnected_lkd(session, reason);
-  coap_lock_unlock(session->context);
+  coap_lock_unlock(context);
 }
 
 void
@@ -924,23 +1102,25 @@ coap_session_disconnected_lkd(coap_session_t *session, coap_nack_reason_t reason
 #endif /* COAP_CLIENT_SUPPORT */
 
   coap_lock_check_locked(session->context);
+  coap_session_timer_touch(session);
   if (session->context->nack_handler) {
     int sent_nack = 0;
-    coap_queue_t *q = session->context->sendqueue;
-
-    while (q) {
-      if (q->session == session) {
-        /* Take the first one */
-        coap_bin_const_t token = q->pdu->actual_token;
-
-        coap_check_update_token(session, q->pdu);
-        coap_lock_callback(session->context,
-                           session->context->nack_handler(session, q->pdu, reason, q->id));
-        coap_update_token(q->pdu, token.length, token.s);
-        sent_nack = 1;
-        break;
-      }
-      q = q->next;
+    coap_queue_t *q = NULL;
+    coap_queue_t *p;
+
+    /* Take the first one due */
+    DL_FOREACH2(session->sendqueue, p, s_next) {
+      if (!q || p->t < q->t)
+        q = p;
+    }
+    if (q) {
+      coap_bin_const_t token = q->pdu->actual_token;
+
+      coap_check_update_token(session, q->pdu);
+      coap_lock_callback(session->context,
+                         session->context->nack_handler(session, q->pdu, reason, q->id));
+      coap_update_token(q->pdu, token.length, token.s);
+      sent_nack = 1;
     }
 
     if (reason != COAP_NACK_ICMP_ISSUE) {
@@ -1047,6 +1227,40 @@ coap_session_disconnected_lkd(coap_session_t *session, coap_nack_reason_t reason
 }
 
 #if COAP_SERVER_SUPPORT
+void
+coap_session_update_lru(coap_session_t *session) {
+  coap_endpoint_t *ep = session->endpoint;
+  int unused;
+
+  if (!ep)
+    return;
+  /* Take off the lists, and put back at the end if still unused */
+  if (session->lru_flags & COAP_SESSION_LRU_IDLE) {
+    DL_DELETE2(ep->idle_lru, session, idle_prev, idle_next);
+    ep->num_idle--;
+  }
+  if (session->lru_flags & COAP_SESSION_LRU_HS) {
+    DL_DELETE2(ep->hs_lru, session, hs_prev, hs_next);
+    ep->num_hs--;
+  }
+  session->lru_flags = 0;
+
+  unused = session->ref == 0 && session->delayqueue == NULL;
+  if (unused && session->type == COAP_SESSION_TYPE_SERVER) {
+    DL_APPEND2(ep->idle_lru, session, idle_prev, idle_next);
+    ep->num_idle++;
+    session->lru_flags |= COAP_SESSION_LRU_IDLE;
+  }
+  if (unused &&
+      ((session->type == COAP_SESSION_TYPE_SERVER &&
+        session->state == COAP_SESSION_STATE_HANDSHAKE) ||
+       session->type == COAP_SESSION_TYPE_HELLO)) {
+    DL_APPEND2(ep->hs_lru, session, hs_prev, hs_next);
+    ep->num_hs++;
+    session->lru_flags |= COAP_SESSION_LRU_HS;
+  }
+}
+
 static void
 coap_make_addr_hash(coap_addr_hash_t *addr_hash, coap_proto_t proto,
                     const coap_addr_tuple_t *addr_info) {
@@ -1061,10 +1275,7 @@ coap_endpoint_get_session(coap_endpoint_t *endpoint,
                           const coap_packet_t *packet, coap_tick_t now) {
   coap_session_t *session;
   coap_session_t *rtmp;
-  unsigned int num_idle = 0;
-  unsigned int num_hs = 0;
-  coap_session_t *oldest = NULL;
-  coap_session_t *oldest_hs = NULL;
+  coap_session_t *oldest;
   coap_addr_hash_t addr_hash;
 
   coap_make_addr_hash(&addr_hash, endpoint->proto, &packet->addr_info);
@@ -1074,6 +1285,8 @@ coap_endpoint_get_session(coap_endpoint_t *endpoint,
     coap_address_copy(&session->addr_info.local, &packet->addr_info.local);
     session->ifindex = packet->ifindex;
     session->last_rx_tx = now;
+    coap_session_timer_touch(session);
+    coap_session_update_lru(session);
     return session;
   }
 
@@ -1090,48 +1303,35 @@ coap_endpoint_get_session(coap_endpoint_t *endpoint,
     }
   }
 #endif /* COAP_CLIENT_SUPPORT */
-  SESSIONS_ITER(endpoint->sessions, session, rtmp) {
-    if (session->ref == 0 && session->delayqueue == NULL) {
-      if (session->type == COAP_SESSION_TYPE_SERVER) {
-        ++num_idle;
-        if (oldest==NULL || session->last_rx_tx < oldest->last_rx_tx)
-          oldest = session;
-
-        if (session->state == COAP_SESSION_STATE_HANDSHAKE) {
-          ++num_hs;
-          /* See if this is a partial (D)TLS session set up
-             which needs to be cleared down to prevent DOS */
-          if ((session->last_rx_tx + COAP_PARTIAL_SESSION_TIMEOUT_TICKS) < now) {
-            if (oldest_hs == NULL ||
-                session->last_rx_tx < oldest_hs->last_rx_tx)
-              oldest_hs = session;
-          }
-        }
-      } else if (session->type == COAP_SESSION_TYPE_HELLO) {
-        ++num_hs;
-        /* See if this is a partial (D)TLS session set up for Client Hello
-           which needs to be cleared down to prevent DOS */
-        if ((session->last_rx_tx + COAP_PARTIAL_SESSION_TIMEOUT_TICKS) < now) {
-          if (oldest_hs == NULL ||
-              session->last_rx_tx < oldest_hs->last_rx_tx)
-            oldest_hs = session;
-        }
-      }
-    }
-  }
+  /*
+   * Drop any list heads that are no longer unused, but where
+   * coap_session_update_lru() has not been called since the change.
+   */
+  while ((oldest = endpoint->idle_lru) != NULL && oldest->delayqueue)
+    coap_session_update_lru(oldest);
+  while ((oldest = endpoint->hs_lru) != NULL &&
+         (oldest->delayqueue ||
+          (oldest->type == COAP_SESSION_TYPE_SERVER &&
+           oldest->state != COAP_SESSION_STATE_HANDSHAKE)))
+    coap_session_update_lru(oldest);
 
   if (endpoint->context->max_idle_sessions > 0 &&
-      num_idle >= endpoint->context->max_idle_sessions) {
+      endpoint->num_idle >= endpoint->context->max_idle_sessions) {
+    oldest = endpoint->idle_lru;
     coap_handle_event_lkd(oldest->context, COAP_EVENT_SERVER_SESSION_DEL, oldest);
     coap_session_free(oldest);
-  } else if (oldest_hs) {
+  } else if (endpoint->hs_lru &&
+             /* See if this is a partial (D)TLS session set up
+                which needs to be cleared down to prevent DOS */
+             (endpoint->hs_lru->last_rx_tx + COAP_PARTIAL_SESSION_TIMEOUT_TICKS) < now) {
+    oldest = endpoint->hs_lru;
     coap_log_warn("***%s: Incomplete session timed out\n",
-                  coap_session_str(oldest_hs));
-    coap_handle_event_lkd(oldest_hs->context, COAP_EVENT_SERVER_SESSION_DEL, oldest_hs);
-    coap_session_free(oldest_hs);
+                  coap_session_str(oldest));
+    coap_handle_event_lkd(oldest->context, COAP_EVENT_SERVER_SESSION_DEL, oldest);
+    coap_session_free(oldest);
   }
 
-  if (num_hs > (endpoint->context->max_handshake_sessions ?
+  if (endpoint->num_hs > (endpoint->context->max_handshake_sessions ?
                 endpoint->context->max_handshake_sessions :
                 COAP_DEFAULT_MAX_HANDSHAKE_SESSIONS)) {
     /* Maxed out on number of sessions in (D)TLS negotiation state */
@@ -1229,6 +1429,7 @@ coap_endpoint_get_session(coap_endpoint_t *endpoint,
       session->type = COAP_SESSION_TYPE_HELLO;
     }
     SESSIONS_ADD(endpoint->sessions, session);
+    coap_session_update_lru(session);
     coap_log_debug("***%s: session %p: new incoming session\n",
                    coap_session_str(session), (void *)session);
     coap_handle_event_lkd(session->context, COAP_EVENT_SERVER_SESSION_NEW, session);
@@ -1652,6 +1853,7 @@ coap_new_client_session_psk2_lkd(coap_context_t *ctx,
   }
 
   coap_sanitize_client_sni(&session->cpsk_setup_data.client_sni);
+  coap_dtls_resume_setup_psk(session);
 
   if (coap_dtls_is_supported() || coap_tls_is_supported()) {
     if (!coap_dtls_context_set_cpsk(ctx, &session->cpsk_setup_data)) {
@@ -1820,6 +2022,7 @@ coap_new_client_session_pki_lkd(coap_context_t *ctx,
   if (!session) {
     return NULL;
   }
+  coap_dtls_resume_setup_pki(session, &l_setup_data);
 
   if (coap_dtls_is_supported() || coap_tls_is_supported()) {
     /* we know that setup_data is not NULL */
@@ -1865,6 +2068,7 @@ coap_new_server_session(coap_context_t *ctx, coap_endpoint_t *ep, void *extra) {
     coap_handle_event_lkd(session->context, COAP_EVENT_SERVER_SESSION_NEW, session);
     session->state = COAP_SESSION_STATE_CONNECTING;
     session->sock.lfunc[COAP_LAYER_SESSION].l_establish(session);
+    coap_session_update_lru(session);
   }
   return session;
 
@@ -2197,8 +2401,15 @@ coap_free_endpoint_lkd(coap_endpoint_t *ep) {
 #ifdef COAP_EPOLL_SUPPORT
         assert(ep->sock.session == NULL);
 #endif /* COAP_EPOLL_SUPPORT */
+#if COAP_SENDMMSG_SUPPORT
+        /* Send off anything queued, including session close downs */
+        coap_socket_send_flush(ep);
+#endif /* COAP_SENDMMSG_SUPPORT */
         coap_netif_close_ep(ep);
       }
+#if COAP_SENDMMSG_SUPPORT
+      coap_socket_send_queue_free(ep);
+#endif /* COAP_SENDMMSG_SUPPORT */
 
       if (ep->context->endpoint) {
         LL_DELETE(ep->context->endpoint, ep);
@@ -2244,7 +2455,7 @@ coap_session_get_by_peer(const coap_context_t *ctx,
 #endif
 const char *
 coap_session_str(const coap_session_t *session) {
-  static char szSession[2 * (INET6_ADDRSTRLEN + 8) + 24];
+  static COAP_THREAD_LOCAL char szSession[2 * (INET6_ADDRSTRLEN + 8) + 24];
   char *p = szSession, *end = szSession + sizeof(szSession);
 
   if (!session) {
@@ -2276,7 +2487,7 @@ coap_session_str(const coap_session_t *session) {
 #if COAP_SERVER_SUPPORT
 const char *
 coap_endpoint_str(const coap_endpoint_t *endpoint) {
-  static char szEndpoint[128];
+  static COAP_THREAD_LOCAL char szEndpoint[128];
   char *p = szEndpoint, *end = szEndpoint + sizeof(szEndpoint);
   if (coap_print_addr(&endpoint->bind_addr, (unsigned char *)p, end - p) > 0)
     p += strlen(p);
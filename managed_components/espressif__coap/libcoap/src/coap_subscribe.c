@@ -86,8 +86,7 @@ coap_persist_observe_add_lkd(coap_context_t *context,
   size_t data_len;
   coap_pdu_t *pdu = NULL;
 #if COAP_CONSTRAINED_STACK
-  /* e_packet can be protected by global_lock if needed */
-  static coap_packet_t e_packet;
+  static COAP_THREAD_LOCAL coap_packet_t e_packet;
 #else /* ! COAP_CONSTRAINED_STACK */
   coap_packet_t e_packet;
 #endif /* ! COAP_CONSTRAINED_STACK */
@@ -166,6 +165,10 @@ coap_persist_observe_add_lkd(coap_context_t *context,
 
   r = coap_get_resource_from_uri_path_lkd(session->context,
                                           (coap_str_const_t *)uri_path);
+  if (r && r->is_template)
+    r = NULL;
+  if (r == NULL && session->context->routes)
+    r = coap_resource_route_lkd(session->context, (coap_str_const_t *)uri_path);
   if (r == NULL) {
     coap_log_warn("coap_persist_observe_add: resource '%s' not defined\n",
                   uri_path->s);
@@ -234,6 +234,11 @@ coap_socket_bind_tcp(coap_socket_t *sock,
     coap_log_warn("coap_socket_bind_tcp: setsockopt SO_REUSEADDR: %s\n",
                   coap_socket_strerror());
 
+#if COAP_REUSEPORT_SUPPORT
+  if (!coap_socket_set_shard(sock))
+    goto error;
+#endif /* COAP_REUSEPORT_SUPPORT */
+
   switch (listen_addr->addr.sa.sa_family) {
 #if COAP_IPV4_SUPPORT
   case AF_INET:
@@ -279,6 +284,10 @@ coap_socket_bind_tcp(coap_socket_t *sock,
                    coap_socket_strerror());
     goto  error;
   }
+#if COAP_REUSEPORT_SUPPORT
+  if (!coap_socket_steer_shard(sock))
+    goto error;
+#endif /* COAP_REUSEPORT_SUPPORT */
 
   return 1;
 
@@ -15,69 +15,90 @@
 
 #include "coap3/coap_libcoap_build.h"
 
+#ifdef COAP_EPOLL_SUPPORT
+#include <sys/timerfd.h>
+#endif /* COAP_EPOLL_SUPPORT */
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_WS2TCPIP_H
+#include <ws2tcpip.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#endif /* COAP_WORK_QUEUE_WAKE_SOCKET */
+
 #if COAP_THREAD_SAFE
 #if COAP_THREAD_RECURSIVE_CHECK
 void
-coap_lock_unlock_func(const char *file, int line) {
-  assert(coap_thread_pid == global_lock.pid);
-  if (global_lock.in_callback) {
-    assert(global_lock.lock_count > 0);
-    global_lock.lock_count--;
+coap_lock_unlock_func(coap_lock_t *lock, const char *file, int line) {
+  assert(coap_thread_pid == lock->pid);
+  if (lock->in_callback) {
+    assert(lock->lock_count > 0);
+    lock->lock_count--;
   } else {
-    global_lock.pid = 0;
-    global_lock.unlock_file = file;
-    global_lock.unlock_line = line;
-    coap_mutex_unlock(&global_lock.mutex);
+    lock->pid = 0;
+    lock->unlock_file = file;
+    lock->unlock_line = line;
+    coap_mutex_unlock(&lock->mutex);
   }
 }
 
 int
-coap_lock_lock_func(const char *file, int line) {
+coap_lock_lock_func(coap_lock_t *lock, const char *file, int line) {
   if (!coap_started) {
     /* libcoap not initialized with coap_startup() */
     return 0;
   }
-  if (coap_mutex_trylock(&global_lock.mutex)) {
-    if (coap_thread_pid == global_lock.pid) {
+  if (coap_mutex_trylock(&lock->mutex)) {
+    if (coap_thread_pid == lock->pid) {
       /* This thread locked the mutex */
-      if (global_lock.in_callback) {
+      if (lock->in_callback) {
         /* This is called from within an app callback */
-        global_lock.lock_count++;
-        assert(global_lock.in_callback == global_lock.lock_count);
+        lock->lock_count++;
+        assert(lock->in_callback == lock->lock_count);
         return 1;
       } else {
         coap_log_alert("Thread Deadlock: Last %s: %u, this %s: %u\n",
-                       global_lock.lock_file, global_lock.lock_line, file, line);
+                       lock->lock_file, lock->lock_line, file, line);
         assert(0);
       }
     }
     /* Wait for the other thread to unlock */
-    coap_mutex_lock(&global_lock.mutex);
+    coap_mutex_lock(&lock->mutex);
   }
   /* Just got the lock, so should not be in a locked callback */
-  assert(!global_lock.in_callback);
-  global_lock.pid = coap_thread_pid;
-  global_lock.lock_file = file;
-  global_lock.lock_line = line;
+  assert(!lock->in_callback);
+  lock->pid = coap_thread_pid;
+  lock->lock_file = file;
+  lock->lock_line = line;
   return 1;
 }
 
 #else /* ! COAP_THREAD_RECURSIVE_CHECK */
 
 void
-coap_lock_unlock_func(void) {
-  assert(coap_thread_pid == global_lock.pid);
-  if (global_lock.in_callback) {
-    assert(global_lock.lock_count > 0);
-    global_lock.lock_count--;
+coap_lock_unlock_func(coap_lock_t *lock) {
+  assert(coap_thread_pid == lock->pid);
+  if (lock->in_callback) {
+    assert(lock->lock_count > 0);
+    lock->lock_count--;
   } else {
-    global_lock.pid = 0;
-    coap_mutex_unlock(&global_lock.mutex);
+    lock->pid = 0;
+    coap_mutex_unlock(&lock->mutex);
   }
 }
 
 int
-coap_lock_lock_func(void) {
+coap_lock_lock_func(coap_lock_t *lock) {
   if (!coap_started) {
     /* libcoap not initialized with coap_startup() */
     return 0;
@@ -86,29 +107,290 @@ coap_lock_lock_func(void) {
    * Some OS do not have support for coap_mutex_trylock() so
    * cannot use that here and have to rely on lock-pid being stable
    */
-  if (global_lock.in_callback && coap_thread_pid == global_lock.pid) {
-    global_lock.lock_count++;
-    assert(global_lock.in_callback == global_lock.lock_count);
+  if (lock->in_callback && coap_thread_pid == lock->pid) {
+    lock->lock_count++;
+    assert(lock->in_callback == lock->lock_count);
     return 1;
   }
-  coap_mutex_lock(&global_lock.mutex);
+  coap_mutex_lock(&lock->mutex);
   /* Just got the lock, so should not be in a locked callback */
-  assert(!global_lock.in_callback);
-  global_lock.pid = coap_thread_pid;
+  assert(!lock->in_callback);
+  lock->pid = coap_thread_pid;
   return 1;
 }
 #endif /* ! COAP_THREAD_RECURSIVE_CHECK */
 
-#else /* ! COAP_THREAD_SAFE */
+#endif /* COAP_THREAD_SAFE */
 
-#ifdef __clang__
-/* Make compilers happy that do not like empty modules. As this function is
- * never used, we ignore -Wunused-function at the end of compiling this file
+/*
+ * Work queue for coap_io_post_work().
+ *
+ * coap_work_queue_push() can be called by any thread without the context lock
+ * being held. Everything else is only called by the thread running
+ * coap_io_process() with the context lock held.
  */
-#pragma GCC diagnostic ignored "-Wunused-function"
-#endif
-static inline void
-dummy(void) {
+#if defined(__GNUC__) || defined(__clang__)
+#define coap_atomic_load(p)       __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define coap_atomic_store(p,v)    __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define coap_atomic_exchange(p,v) __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+#else /* ! __GNUC__ && ! __clang__ */
+#define coap_atomic_load(p)       (*(p))
+#define coap_atomic_store(p,v)    (*(p) = (v))
+#define coap_atomic_exchange(p,v) coap_work_exchange(p, v)
+
+static inline coap_work_t *
+coap_work_exchange(coap_work_t **p, coap_work_t *v) {
+  coap_work_t *old = *p;
+
+  *p = v;
+  return old;
+}
+#endif /* ! __GNUC__ && ! __clang__ */
+
+#if COAP_WORK_QUEUE_LOCKED
+#define coap_work_queue_lock(q)   coap_mutex_lock(&(q)->mutex)
+#define coap_work_queue_unlock(q) coap_mutex_unlock(&(q)->mutex)
+#else /* ! COAP_WORK_QUEUE_LOCKED */
+#define coap_work_queue_lock(q)
+#define coap_work_queue_unlock(q)
+#endif /* ! COAP_WORK_QUEUE_LOCKED */
+
+void
+coap_work_queue_init(coap_context_t *context) {
+  coap_work_queue_t *q = &context->work_queue;
+
+  q->stub.next = NULL;
+  q->head = &q->stub;
+  q->tail = &q->stub;
+#if COAP_WORK_QUEUE_LOCKED
+  coap_mutex_init(&q->mutex);
+#endif /* COAP_WORK_QUEUE_LOCKED */
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+  q->wake_fd = COAP_INVALID_SOCKET;
+#endif /* COAP_WORK_QUEUE_WAKE_SOCKET */
+}
+
+/*
+ * return 1 The queue was empty (so the consumer may need waking up)
+ *        0 Otherwise
+ */
+static int
+coap_work_queue_push(coap_work_queue_t *q, coap_work_t *work) {
+  coap_work_t *prev;
+
+  work->next = NULL;
+  prev = coap_atomic_exchange(&q->tail, work);
+  /*
+   * Between the exchange and this store, the queue is (briefly) broken, and
+   * the consumer will see nothing beyond prev until the store is done.
+   */
+  coap_atomic_store(&prev->next, work);
+  return prev == &q->stub;
+}
+
+static coap_work_t *
+coap_work_queue_pop(coap_work_queue_t *q) {
+  coap_work_t *head = q->head;
+  coap_work_t *next = coap_atomic_load(&head->next);
+
+  if (head == &q->stub) {
+    if (next == NULL)
+      return NULL;
+    q->head = next;
+    head = next;
+    next = coap_atomic_load(&next->next);
+  }
+  if (next) {
+    q->head = next;
+    return head;
+  }
+  if (head != coap_atomic_load(&q->tail)) {
+    /* A producer is part way through coap_work_queue_push() */
+    return NULL;
+  }
+  /* head is the last item - put stub back so head can be returned */
+  coap_work_queue_push(q, &q->stub);
+  next = coap_atomic_load(&head->next);
+  if (next) {
+    q->head = next;
+    return head;
+  }
+  return NULL;
 }
 
-#endif /* ! COAP_THREAD_SAFE */
+int
+coap_work_queue_pending(coap_context_t *context) {
+  coap_work_queue_t *q = &context->work_queue;
+  int ret;
+
+  if (q->ran)
+    return 1;
+  coap_work_queue_lock(q);
+  ret = q->head != &q->stub || coap_atomic_load(&q->tail) != &q->stub;
+  coap_work_queue_unlock(q);
+  return ret;
+}
+
+void
+coap_work_queue_run(coap_context_t *context) {
+  coap_work_queue_t *q = &context->work_queue;
+  coap_work_t *work;
+  coap_work_t *last;
+  int done = 0;
+
+  coap_lock_check_locked(context);
+  /*
+   * Only run what has already been posted, so that busy producers cannot
+   * hold up the I/O processing.
+   */
+  coap_work_queue_lock(q);
+  last = coap_atomic_load(&q->tail);
+  coap_work_queue_unlock(q);
+  while (!done) {
+    coap_io_work_handler_t handler;
+    void *arg;
+
+    coap_work_queue_lock(q);
+    work = coap_work_queue_pop(q);
+    coap_work_queue_unlock(q);
+    if (!work)
+      break;
+    done = work == last;
+    q->ran = 1;
+    handler = work->handler;
+    arg = work->arg;
+    coap_free_type(COAP_WORK, work);
+    coap_lock_callback(context, handler(context, arg));
+  }
+}
+
+void
+coap_work_queue_free(coap_context_t *context) {
+  coap_work_queue_t *q = &context->work_queue;
+
+  do {
+    q->ran = 0;
+    coap_work_queue_run(context);
+  } while (coap_work_queue_pending(context));
+#if COAP_WORK_QUEUE_LOCKED
+  coap_mutex_destroy(&q->mutex);
+#endif /* COAP_WORK_QUEUE_LOCKED */
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+  if (q->wake_fd != COAP_INVALID_SOCKET) {
+    coap_closesocket(q->wake_fd);
+    q->wake_fd = COAP_INVALID_SOCKET;
+  }
+#else /* ! COAP_WORK_QUEUE_WAKE_SOCKET */
+  (void)q;
+#endif /* ! COAP_WORK_QUEUE_WAKE_SOCKET */
+}
+
+#if COAP_WORK_QUEUE_WAKE_SOCKET
+void
+coap_work_queue_setup_wake(coap_context_t *context) {
+  coap_work_queue_t *q = &context->work_queue;
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  coap_fd_t fd;
+#ifdef _WIN32
+  u_long u_on = 1;
+#else /* ! _WIN32 */
+  int on = 1;
+#endif /* ! _WIN32 */
+
+  if (q->wake_fd != COAP_INVALID_SOCKET)
+    return;
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd == COAP_INVALID_SOCKET) {
+    coap_log_warn("coap_work_queue_setup_wake: socket: %s\n",
+                  coap_socket_strerror());
+    return;
+  }
+#ifdef _WIN32
+  if (ioctlsocket(fd, FIONBIO, &u_on) == COAP_SOCKET_ERROR)
+#else /* ! _WIN32 */
+  if (ioctl(fd, FIONBIO, &on) == COAP_SOCKET_ERROR)
+#endif /* ! _WIN32 */
+    goto error;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == COAP_SOCKET_ERROR ||
+      getsockname(fd, (struct sockaddr *)&addr, &addr_len) == COAP_SOCKET_ERROR ||
+      connect(fd, (struct sockaddr *)&addr, addr_len) == COAP_SOCKET_ERROR)
+    goto error;
+  /* Producers may now see it */
+  coap_atomic_store(&q->wake_fd, fd);
+  return;
+
+error:
+  coap_log_warn("coap_work_queue_setup_wake: %s\n", coap_socket_strerror());
+  coap_closesocket(fd);
+}
+
+void
+coap_work_queue_drain_wake(coap_context_t *context) {
+  char buf[8];
+
+  while (recv(context->work_queue.wake_fd, buf, sizeof(buf), 0) > 0)
+    ;
+}
+#endif /* COAP_WORK_QUEUE_WAKE_SOCKET */
+
+/*
+ * Cause the thread waiting in coap_io_process() to return from
+ * epoll_wait() / select().
+ */
+static void
+coap_work_queue_wake(coap_context_t *context) {
+#if defined(COAP_EPOLL_SUPPORT)
+  if (context->eptimerfd != -1) {
+    struct itimerspec new_value;
+
+    /* Fire as soon as possible. coap_io_prepare_epoll() will re-arm it */
+    memset(&new_value, 0, sizeof(new_value));
+    new_value.it_value.tv_nsec = 1;
+    if (timerfd_settime(context->eptimerfd, 0, &new_value, NULL) == -1) {
+      coap_log_err("%s: timerfd_settime failed: %s (%d)\n",
+                   "coap_io_post_work", coap_socket_strerror(), errno);
+    }
+  }
+#elif COAP_WORK_QUEUE_WAKE_SOCKET
+  coap_fd_t fd = coap_atomic_load(&context->work_queue.wake_fd);
+
+  /* If the send fails (e.g. EWOULDBLOCK), a wake up is already pending */
+  if (fd != COAP_INVALID_SOCKET)
+    (void)send(fd, "", 1, 0);
+#else /* ! COAP_EPOLL_SUPPORT && ! COAP_WORK_QUEUE_WAKE_SOCKET */
+  (void)context;
+#endif /* ! COAP_EPOLL_SUPPORT && ! COAP_WORK_QUEUE_WAKE_SOCKET */
+}
+
+int
+coap_io_post_work(coap_context_t *context, coap_io_work_handler_t handler,
+                  void *arg) {
+  coap_work_queue_t *q;
+  coap_work_t *work;
+  int was_empty;
+
+  if (!context || !handler || !coap_started)
+    return 0;
+  work = coap_malloc_type(COAP_WORK, sizeof(coap_work_t));
+  if (!work)
+    return 0;
+  work->handler = handler;
+  work->arg = arg;
+  q = &context->work_queue;
+  coap_work_queue_lock(q);
+  was_empty = coap_work_queue_push(q, work);
+  coap_work_queue_unlock(q);
+  /*
+   * Only the first post into an empty queue needs to wake the consumer. It
+   * cannot go to sleep while anything is still queued (see
+   * coap_work_queue_pending()).
+   */
+  if (was_empty)
+    coap_work_queue_wake(context);
+  return 1;
+}
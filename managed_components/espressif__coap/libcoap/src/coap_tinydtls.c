@@ -139,6 +139,17 @@ coap_dtls_set_cid_tuple_change(coap_context_t *c_context, uint8_t every) {
 }
 #endif /* COAP_CLIENT_SUPPORT */
 
+/*
+ * TinyDTLS does not support session resumption (by session ID or
+ * session ticket), so every handshake is a full one.
+ */
+int
+coap_dtls_context_set_resumption(coap_context_t *c_context) {
+  if (c_context->resume_cache_size)
+    coap_log_warn("TinyDTLS does not support session resumption\n");
+  return 0;
+}
+
 static coap_log_t
 dtls_map_logging(log_t d_level) {
   /* DTLS_LOG_ERR is missing, so account for the gap */
@@ -882,6 +893,7 @@ coap_dtls_send(coap_session_t *session,
     if (coap_event_dtls != COAP_EVENT_DTLS_CLOSED)
       coap_handle_event_lkd(session->context, coap_event_dtls, session);
     if (coap_event_dtls == COAP_EVENT_DTLS_CONNECTED) {
+      coap_dtls_handshake_done(session, 0);
 #if (DTLS_MAX_CID_LENGTH > 0)
       if (session->type == COAP_SESSION_TYPE_CLIENT) {
         dtls_peer_t *peer = dtls_get_peer(dtls_context, (session_t *)session->tls);
@@ -965,6 +977,7 @@ coap_dtls_receive(coap_session_t *session,
     if (coap_event_dtls != COAP_EVENT_DTLS_CLOSED)
       coap_handle_event_lkd(session->context, coap_event_dtls, session);
     if (coap_event_dtls == COAP_EVENT_DTLS_CONNECTED) {
+      coap_dtls_handshake_done(session, 0);
       coap_session_connected(session);
 #if (DTLS_MAX_CID_LENGTH > 0)
       if (session->type == COAP_SESSION_TYPE_CLIENT) {
@@ -120,6 +120,8 @@ typedef struct coap_wolfssl_context_t {
   int psk_pki_enabled;
   char *root_ca_file;
   char *root_ca_dir;
+  unsigned int resume_cache_size; /* 0 if resumption disabled */
+  unsigned int resume_lifetime;
 } coap_wolfssl_context_t;
 
 typedef struct coap_ssl_data_t {
@@ -136,6 +138,8 @@ typedef struct coap_wolfssl_env_t {
   coap_ssl_data_t data;
   int done_psk_check;
   coap_dtls_role_t role;
+  const char *resume_sni; /* SNI the client's held session is keyed on */
+  int resume_offered;     /* Set if the client offered a held session */
 } coap_wolfssl_env_t;
 
 typedef enum coap_enc_method_t {
@@ -221,6 +225,8 @@ set_ciphersuites(WOLFSSL *ssl, coap_enc_method_t method) {
 #if ! defined(COAP_WOLFSSL_PSK_CIPHERS) || ! defined(COAP_WOLFSSL_PKI_CIPHERS)
   static int processed_ciphers = 0;
 
+  /* The cipher lists are shared by all contexts */
+  coap_lock_lock(NULL, return);
   if (!processed_ciphers) {
     static char ciphers[WOLFSSL_CIPHER_LIST_MAX_SIZE];
     char *ciphers_ofs = ciphers;
@@ -234,6 +240,7 @@ set_ciphersuites(WOLFSSL *ssl, coap_enc_method_t method) {
 
     if (wolfSSL_get_ciphers(ciphers, (int)sizeof(ciphers)) != WOLFSSL_SUCCESS) {
       coap_log_warn("set_ciphersuites: Failed to get ciphers\n");
+      coap_lock_unlock(NULL);
       return;
     }
 
@@ -303,6 +310,7 @@ next_a:
 
     processed_ciphers = 1;
   }
+  coap_lock_unlock(NULL);
 #endif /* ! COAP_WOLFSSL_PSK_CIPHERS || ! COAP_WOLFSSL_PKI_CIPHERS */
 
   if (method == COAP_ENC_PSK) {
@@ -721,7 +729,7 @@ coap_dtls_psk_server_callback(
 
 static const char *
 ssl_function_definition(unsigned long e) {
-  static char buff[80];
+  static COAP_THREAD_LOCAL char buff[80];
 
   snprintf(buff, sizeof(buff), " at %s:%s",
            wolfSSL_ERR_lib_error_string(e), wolfSSL_ERR_func_error_string(e));
@@ -910,6 +918,33 @@ coap_set_user_prefs(WOLFSSL_CTX *ctx) {
 #endif
 }
 
+/*
+ * Apply the resumption settings to ctx. Until enabled, sessions are neither
+ * cached nor are tickets issued, as no client session is ever resumed.
+ */
+static void
+setup_resumption(coap_wolfssl_context_t *w_context, WOLFSSL_CTX *ctx) {
+  if (!ctx)
+    return;
+  if (w_context->resume_cache_size) {
+    static const unsigned char sid_ctx[] = "libcoap";
+
+    /* The session cache is shared by all contexts and has a fixed size */
+    wolfSSL_CTX_set_timeout(ctx, w_context->resume_lifetime);
+    /* Required for resumption when the client's certificate is verified */
+    wolfSSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+#if defined(HAVE_SESSION_TICKET) && !defined(NO_WOLFSSL_SERVER)
+    /* The default ticket encryption callback changes its keys itself */
+    wolfSSL_CTX_set_TicketHint(ctx, (int)w_context->resume_lifetime);
+#endif /* HAVE_SESSION_TICKET && ! NO_WOLFSSL_SERVER */
+  } else {
+    wolfSSL_CTX_set_session_cache_mode(ctx, WOLFSSL_SESS_CACHE_OFF);
+#if defined(HAVE_SESSION_TICKET) && !defined(NO_WOLFSSL_SERVER)
+    wolfSSL_CTX_NoTicketTLSv12(ctx);
+#endif /* HAVE_SESSION_TICKET && ! NO_WOLFSSL_SERVER */
+  }
+}
+
 /* Set up DTLS context if not alread done */
 static int
 setup_dtls_context(coap_wolfssl_context_t *w_context) {
@@ -937,6 +972,7 @@ setup_dtls_context(coap_wolfssl_context_t *w_context) {
 
     wolfSSL_CTX_set_info_callback(w_context->dtls.ctx, coap_dtls_info_callback);
     wolfSSL_CTX_set_options(w_context->dtls.ctx, SSL_OP_NO_QUERY_MTU);
+    setup_resumption(w_context, w_context->dtls.ctx);
     wolfSSL_SetIORecv(w_context->dtls.ctx, coap_dgram_read);
     wolfSSL_SetIOSend(w_context->dtls.ctx, coap_dgram_write);
 #ifdef WOLFSSL_DTLS_MTU
@@ -985,6 +1021,7 @@ setup_tls_context(coap_wolfssl_context_t *w_context) {
     wolfSSL_CTX_set_min_proto_version(w_context->tls.ctx, TLS1_VERSION);
     coap_set_user_prefs(w_context->tls.ctx);
     wolfSSL_CTX_set_info_callback(w_context->tls.ctx, coap_dtls_info_callback);
+    setup_resumption(w_context, w_context->tls.ctx);
     wolfSSL_SetIORecv(w_context->tls.ctx, coap_sock_read);
     wolfSSL_SetIOSend(w_context->tls.ctx, coap_sock_write);
 #if COAP_CLIENT_SUPPORT
@@ -1890,6 +1927,20 @@ coap_dtls_free_context(void *handle) {
   wolfssl_free(w_context);
 }
 
+int
+coap_dtls_context_set_resumption(coap_context_t *c_context) {
+  coap_wolfssl_context_t *w_context =
+      ((coap_wolfssl_context_t *)c_context->dtls_context);
+
+  w_context->resume_cache_size = c_context->resume_cache_size;
+  w_context->resume_lifetime = c_context->resume_lifetime;
+  setup_resumption(w_context, w_context->dtls.ctx);
+#if !COAP_DISABLE_TCP
+  setup_resumption(w_context, w_context->tls.ctx);
+#endif /* !COAP_DISABLE_TCP */
+  return 1;
+}
+
 #if COAP_SERVER_SUPPORT
 void *
 coap_dtls_new_server_session(coap_session_t *session) {
@@ -2006,10 +2057,52 @@ error:
 #endif /* COAP_SERVER_SUPPORT */
 
 #if COAP_CLIENT_SUPPORT
+static void
+free_resume_data(void *data) {
+  wolfSSL_SESSION_free((WOLFSSL_SESSION *)data);
+}
+
+/*
+ * Hold the client's session so that a later session to the same server
+ * can resume it.
+ */
+static void
+hold_client_session(coap_session_t *session, coap_wolfssl_env_t *w_env) {
+  WOLFSSL_SESSION *resume;
+
+  if (!session->context->resume_cache_size)
+    return;
+  resume = wolfSSL_get1_session(w_env->ssl);
+  if (!resume)
+    return;
+  /* A TLS1.3 session can only be resumed once a ticket has been received */
+  if (!wolfSSL_SESSION_is_resumable(resume)) {
+    wolfSSL_SESSION_free(resume);
+    return;
+  }
+  coap_dtls_resume_store(session, w_env->resume_sni, resume,
+                         free_resume_data);
+}
+
+/* Update the client's held session as its ssl is about to be freed */
+static void
+release_client_session(coap_session_t *session, coap_wolfssl_env_t *w_env) {
+  if (!session->context->resume_cache_size)
+    return;
+  if (wolfSSL_is_init_finished(w_env->ssl))
+    /* A TLS1.3 ticket may have arrived after the handshake */
+    hold_client_session(session, w_env);
+  else if (w_env->resume_offered)
+    /* Do not offer it again if it was the cause of the failure */
+    coap_dtls_resume_remove(session, w_env->resume_sni);
+}
+
 static int
-setup_client_ssl_session(coap_session_t *session, WOLFSSL *ssl) {
+setup_client_ssl_session(coap_session_t *session, coap_wolfssl_env_t *w_env,
+                         WOLFSSL *ssl) {
   coap_wolfssl_context_t *w_context =
       ((coap_wolfssl_context_t *)session->context->dtls_context);
+  WOLFSSL_SESSION *resume;
 
   if (w_context->psk_pki_enabled & IS_PSK) {
     coap_dtls_cpsk_t *setup_data = &session->cpsk_setup_data;
@@ -2036,6 +2129,7 @@ setup_client_ssl_session(coap_session_t *session, WOLFSSL *ssl) {
       coap_log_warn("wolfSSL_set_tlsext_host_name: set '%s' failed",
                     setup_data->client_sni);
     }
+    w_env->resume_sni = setup_data->client_sni;
     wolfSSL_set_psk_client_callback(ssl, coap_dtls_psk_client_callback);
 
 #if defined(WOLFSSL_DTLS_CID) && defined(WOLFSSL_DTLS13)
@@ -2087,6 +2181,7 @@ setup_client_ssl_session(coap_session_t *session, WOLFSSL *ssl) {
       coap_log_warn("wolfSSL_set_tlsext_host_name: set '%s' failed",
                     setup_data->client_sni);
     }
+    w_env->resume_sni = setup_data->client_sni;
     /* Certificate Revocation */
     if (setup_data->check_cert_revocation) {
       WOLFSSL_X509_VERIFY_PARAM *param;
@@ -2125,6 +2220,10 @@ setup_client_ssl_session(coap_session_t *session, WOLFSSL *ssl) {
 #endif /* WOLFSSL_DTLS_CID && WOLFSSL_DTLS13 */
 
   }
+
+  resume = coap_dtls_resume_find(session, w_env->resume_sni);
+  if (resume && wolfSSL_set_session(ssl, resume) == WOLFSSL_SUCCESS)
+    w_env->resume_offered = 1;
   return 1;
 }
 
@@ -2160,7 +2259,7 @@ coap_dtls_new_client_session(coap_session_t *session) {
   wolfSSL_dtls_set_mtu(ssl, (long)session->mtu);
 #endif /* WOLFSSL_DTLS_MTU */
 
-  if (!setup_client_ssl_session(session, ssl))
+  if (!setup_client_ssl_session(session, w_env, ssl))
     goto error;
 #ifdef HAVE_SERVER_RENEGOTIATION_INFO
   if (wolfSSL_UseSecureRenegotiation(ssl) != WOLFSSL_SUCCESS) {
@@ -2208,6 +2307,16 @@ coap_dtls_session_update_mtu(coap_session_t *session) {
 }
 #endif /* COAP_CLIENT_SUPPORT */
 
+/* Account for the completed handshake of session */
+static void
+handshake_done(coap_session_t *session, coap_wolfssl_env_t *w_env) {
+  coap_dtls_handshake_done(session, wolfSSL_session_reused(w_env->ssl));
+#if COAP_CLIENT_SUPPORT
+  if (session->type == COAP_SESSION_TYPE_CLIENT)
+    hold_client_session(session, w_env);
+#endif /* COAP_CLIENT_SUPPORT */
+}
+
 void
 coap_dtls_free_session(coap_session_t *session) {
   coap_wolfssl_env_t *w_env = (coap_wolfssl_env_t *)session->tls;
@@ -2219,6 +2328,10 @@ coap_dtls_free_session(coap_session_t *session) {
       if (r == 0)
         wolfSSL_shutdown(ssl);
     }
+#if COAP_CLIENT_SUPPORT
+    if (session->type == COAP_SESSION_TYPE_CLIENT)
+      release_client_session(session, w_env);
+#endif /* COAP_CLIENT_SUPPORT */
     w_env->ssl = NULL;
     wolfSSL_free(ssl);
     if (session->context)
@@ -2405,6 +2518,7 @@ coap_dtls_receive(coap_session_t *session, const uint8_t *data, size_t data_len)
         } else {
           session->is_dtls13 = 0;
         }
+        handshake_done(session, w_env);
         coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
         session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
       }
@@ -2562,7 +2676,7 @@ coap_tls_new_client_session(coap_session_t *session) {
   wolfSSL_set_app_data(ssl, session);
   w_env->data.session = session;
 
-  if (!setup_client_ssl_session(session, ssl))
+  if (!setup_client_ssl_session(session, w_env, ssl))
     return 0;
 
   session->tls = w_env;
@@ -2592,6 +2706,7 @@ coap_tls_new_client_session(coap_session_t *session) {
   coap_ticks(&now);
   w_env->last_timeout = now;
   if (wolfSSL_is_init_finished(ssl)) {
+    handshake_done(session, w_env);
     coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
     session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
   }
@@ -2693,6 +2808,7 @@ coap_tls_new_server_session(coap_session_t *session) {
 
   session->tls = w_env;
   if (wolfSSL_is_init_finished(ssl)) {
+    handshake_done(session, w_env);
     coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
     session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
   }
@@ -2718,6 +2834,10 @@ coap_tls_free_session(coap_session_t *session) {
       if (r == 0)
         wolfSSL_shutdown(ssl);
     }
+#if COAP_CLIENT_SUPPORT
+    if (session->type == COAP_SESSION_TYPE_CLIENT)
+      release_client_session(session, w_env);
+#endif /* COAP_CLIENT_SUPPORT */
     wolfSSL_free(ssl);
     w_env->ssl = NULL;
     if (session->context)
@@ -2750,6 +2870,7 @@ coap_tls_write(coap_session_t *session, const uint8_t *data, size_t data_len) {
       if (in_init && wolfSSL_is_init_finished(ssl)) {
         coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                       coap_session_str(session), wolfSSL_get_cipher((ssl)));
+        handshake_done(session, w_env);
         coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
         session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
       }
@@ -2778,6 +2899,7 @@ coap_tls_write(coap_session_t *session, const uint8_t *data, size_t data_len) {
   } else if (in_init && wolfSSL_is_init_finished(ssl)) {
     coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                   coap_session_str(session), wolfSSL_get_cipher((ssl)));
+    handshake_done(session, w_env);
     coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
     session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
   }
@@ -2829,6 +2951,7 @@ coap_tls_read(coap_session_t *session, uint8_t *data, size_t data_len) {
       if (in_init && wolfSSL_is_init_finished(ssl)) {
         coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                       coap_session_str(session), wolfSSL_get_cipher((ssl)));
+        handshake_done(session, w_env);
         coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
         session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
       }
@@ -2868,6 +2991,7 @@ coap_tls_read(coap_session_t *session, uint8_t *data, size_t data_len) {
   } else if (in_init && wolfSSL_is_init_finished(ssl)) {
     coap_dtls_log(COAP_LOG_INFO, "*  %s: Using cipher: %s\n",
                   coap_session_str(session), wolfSSL_get_cipher((ssl)));
+    handshake_done(session, w_env);
     coap_handle_event_lkd(session->context, COAP_EVENT_DTLS_CONNECTED, session);
     session->sock.lfunc[COAP_LAYER_TLS].l_establish(session);
   }
@@ -0,0 +1,261 @@
+/* libcoap benchmarks
+ *
+ * bench_alloc.c -- coap_malloc_type() latency and heap fragmentation
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org> and others
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+/*
+ * Keeps a set of live objects of the types and sizes a busy server uses
+ * (PDUs and their buffers, send queue nodes, strings, sessions), and randomly
+ * frees them and allocates new ones in their place, first with malloc() and
+ * then with the slab allocator (see coap_memory_set_slab()).
+ *
+ * Reports the mean, median, 99th percentile and maximum latency of a
+ * coap_malloc_type() / coap_free_type() pair. With glibc, it also reports the
+ * heap size compared to the bytes actually requested for the live objects
+ * (fragmentation), and how much heap is still held once all objects have
+ * been freed. Each allocator is run in its own process so that the heap
+ * figures are not skewed by the other.
+ *
+ * Usage: bench_alloc [-n operations] [-l live_objects] [-s seconds]
+ *
+ *   -s  Run each allocator for this long (e.g. a soak test), reporting every
+ *       minute, rather than for a fixed number of operations.
+ */
+
+#include <coap3/coap.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif /* __GLIBC__ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || \
+                           (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define BENCH_HAVE_MALLINFO2 1
+#endif
+
+#define BENCH_HIST_BUCKETS 4096 /* of 10ns */
+
+typedef struct {
+  coap_memory_tag_t type;
+  size_t min_size;
+  size_t max_size;
+  unsigned int weight;
+} bench_obj_t;
+
+/* Roughly the mix seen by a server handling small requests */
+static const bench_obj_t obj_mix[] = {
+  { COAP_PDU,     200,  200,  4 },
+  { COAP_PDU_BUF, 40,   1160, 4 },
+  { COAP_NODE,    64,   64,   2 },
+  { COAP_STRING,  4,    200,  3 },
+  { COAP_SESSION, 1400, 1400, 1 }
+};
+#define BENCH_MIX (sizeof(obj_mix) / sizeof(obj_mix[0]))
+
+typedef struct {
+  void *p;
+  size_t size;
+  const bench_obj_t *obj;
+} bench_live_t;
+
+static unsigned long num_ops = 5000000;
+static unsigned int num_live = 4096;
+static unsigned int run_secs;
+static unsigned long hist[BENCH_HIST_BUCKETS];
+
+static double
+elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static const bench_obj_t *
+pick_obj(void) {
+  static unsigned int total;
+  unsigned int r;
+  size_t i;
+
+  if (!total) {
+    for (i = 0; i < BENCH_MIX; i++)
+      total += obj_mix[i].weight;
+  }
+  r = (unsigned int)rand() % total;
+  for (i = 0; i < BENCH_MIX - 1; i++) {
+    if (r < obj_mix[i].weight)
+      break;
+    r -= obj_mix[i].weight;
+  }
+  return &obj_mix[i];
+}
+
+static unsigned long
+percentile(unsigned long count, double pc) {
+  unsigned long want = (unsigned long)(count * pc);
+  unsigned long seen = 0;
+  unsigned long i;
+
+  for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+    seen += hist[i];
+    if (seen > want)
+      break;
+  }
+  return i * 10;
+}
+
+static void
+report_heap(const char *when, size_t live_bytes) {
+#ifdef BENCH_HAVE_MALLINFO2
+  struct mallinfo2 mi = mallinfo2();
+  size_t heap = mi.arena + mi.hblkhd;
+
+  printf("  %-10s heap %9zu bytes, live %9zu bytes, fragmentation %5.1f%%\n",
+         when, heap, live_bytes,
+         heap ? 100.0 * (double)(heap - live_bytes) / (double)heap : 0.0);
+#else /* ! BENCH_HAVE_MALLINFO2 */
+  (void)when;
+  (void)live_bytes;
+#endif /* ! BENCH_HAVE_MALLINFO2 */
+}
+
+static int
+run(int slab) {
+  bench_live_t *live = calloc(num_live, sizeof(bench_live_t));
+  struct timespec start;
+  struct timespec last;
+  unsigned long ops = 0;
+  unsigned long max_ns = 0;
+  double total_ns = 0;
+  size_t live_bytes = 0;
+  unsigned int i;
+
+  if (!live)
+    return 0;
+  if (!coap_memory_set_slab(slab)) {
+    printf("slab allocator not built in\n");
+    free(live);
+    return 0;
+  }
+  memset(hist, 0, sizeof(hist));
+  srand(1);
+  printf("%s:\n", slab ? "slab" : "malloc");
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  last = start;
+  while (run_secs ? elapsed(&start) < run_secs : ops < num_ops) {
+    bench_live_t *l = &live[(unsigned int)rand() % num_live];
+    const bench_obj_t *obj = pick_obj();
+    size_t size = obj->min_size + (obj->max_size > obj->min_size ?
+                                   (size_t)rand() % (obj->max_size - obj->min_size) : 0);
+    struct timespec t0, t1;
+    unsigned long ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (l->p)
+      coap_free_type(l->obj->type, l->p);
+    l->p = coap_malloc_type(obj->type, size);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!l->p) {
+      fprintf(stderr, "allocation failed\n");
+      break;
+    }
+    /* Touch the memory as a real user would */
+    memset(l->p, 0, size);
+    live_bytes += size - l->size;
+    l->size = size;
+    l->obj = obj;
+
+    ns = (unsigned long)((t1.tv_sec - t0.tv_sec) * 1000000000L +
+                         (t1.tv_nsec - t0.tv_nsec));
+    total_ns += ns;
+    if (ns > max_ns)
+      max_ns = ns;
+    hist[ns / 10 < BENCH_HIST_BUCKETS ? ns / 10 : BENCH_HIST_BUCKETS - 1]++;
+    ops++;
+    if (run_secs && (ops & 0xffff) == 0 && elapsed(&last) >= 60) {
+      clock_gettime(CLOCK_MONOTONIC, &last);
+      printf("  %6.0fs %lu ops, mean %.0fns\n", elapsed(&start), ops,
+             total_ns / ops);
+      report_heap("running", live_bytes);
+      fflush(stdout);
+    }
+  }
+
+  printf("  %lu free/malloc pairs: mean %.0fns p50 %luns p99 %luns max %luns\n",
+         ops, total_ns / ops, percentile(ops, 0.5), percentile(ops, 0.99),
+         max_ns);
+  report_heap("loaded", live_bytes);
+  for (i = 0; i < num_live; i++) {
+    if (live[i].p)
+      coap_free_type(live[i].obj->type, live[i].p);
+  }
+  free(live);
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif /* __GLIBC__ */
+  report_heap("all freed", 0);
+  return 1;
+}
+
+int
+main(int argc, char **argv) {
+  int opt;
+  int slab;
+  int ret;
+
+  while ((opt = getopt(argc, argv, "l:n:s:")) != -1) {
+    switch (opt) {
+    case 'l':
+      num_live = (unsigned int)atoi(optarg);
+      break;
+    case 'n':
+      num_ops = strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      run_secs = (unsigned int)atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n operations] [-l live_objects] [-s seconds]\n",
+              argv[0]);
+      exit(1);
+    }
+  }
+  if (!num_live)
+    num_live = 1;
+
+  for (slab = 0; slab <= 1; slab++) {
+    pid_t pid = fork();
+    int status;
+
+    if (pid == -1) {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      coap_startup();
+      coap_set_log_level(COAP_LOG_WARN);
+      ret = run(slab) ? 0 : 1;
+      coap_cleanup();
+      fflush(stdout);
+      _exit(ret);
+    }
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+      return 1;
+  }
+  return 0;
+}
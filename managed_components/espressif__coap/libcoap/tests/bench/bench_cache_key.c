@@ -0,0 +1,267 @@
+/* libcoap benchmarks
+ *
+ * bench_cache_key.c -- Cache-key derivation throughput
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org> and others
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+/*
+ * Builds a set of GET requests like those a forward proxy sees (Uri-Host,
+ * Uri-Port, a few Uri-Path segments, Uri-Query and Accept) and measures how
+ * many cache-keys per second are derived:
+ *
+ *   digest  The derivation libcoap used before the keyed hash: a digest
+ *           context and the key are allocated, and every option number and
+ *           value is run through the byte at a time coap_hash() of a notls
+ *           build (TLS builds used SHA-256, which is slower still).
+ *   derive  coap_cache_derive_key() and coap_delete_cache_key().
+ *   lookup  coap_cache_get_by_pdu() against a cache holding an entry for
+ *           half of the requests, which derives the key on the stack.
+ *
+ * Usage: bench_cache_key [-n keys] [-r requests]
+ */
+
+#include <coap3/coap.h>
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned int num_keys = 2000000;
+static unsigned int num_requests = 1024;
+
+static double
+elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* The notls coap_hash() and coap_digest_*() */
+typedef unsigned char old_key_t[4];
+
+typedef struct {
+  size_t ofs;
+  old_key_t key[8];
+} old_digest_t;
+
+static void
+old_hash(const unsigned char *s, size_t len, old_key_t h) {
+  size_t j;
+
+  while (len--) {
+    j = sizeof(old_key_t) - 1;
+
+    while (j) {
+      h[j] = ((h[j] << 7) | (h[j - 1] >> 1)) + h[j];
+      --j;
+    }
+    h[0] = (h[0] << 7) + h[0] + *s++;
+  }
+}
+
+static void
+old_update(old_digest_t *d, const uint8_t *data, size_t len) {
+  old_hash(data, len, d->key[d->ofs]);
+  d->ofs = (d->ofs + 1) % 7;
+}
+
+static uint8_t *
+old_derive_key(const coap_pdu_t *pdu) {
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t *option;
+  old_digest_t *d;
+  uint8_t *key;
+
+  if (!coap_option_iterator_init(pdu, &opt_iter, COAP_OPT_ALL))
+    return NULL;
+  d = coap_malloc_type(COAP_DIGEST_CTX, sizeof(old_digest_t));
+  if (!d)
+    return NULL;
+  memset(d, 0, sizeof(old_digest_t));
+  while ((option = coap_option_next(&opt_iter))) {
+    if ((opt_iter.number & 0x1e) == 0x1c ||
+        opt_iter.number == COAP_OPTION_OBSERVE)
+      continue;
+    old_update(d, (const uint8_t *)&opt_iter.number, sizeof(opt_iter.number));
+    old_update(d, coap_opt_value(option), coap_opt_length(option));
+  }
+  key = coap_malloc_type(COAP_CACHE_KEY, 32);
+  if (key)
+    memcpy(key, d->key, 32);
+  coap_free_type(COAP_DIGEST_CTX, d);
+  return key;
+}
+
+static coap_pdu_t *
+make_request(unsigned int i) {
+  static const char *const hosts[] = {
+    "sensor-a.example", "sensor-b.example", "gw.example.net", "10.1.2.3"
+  };
+  coap_pdu_t *pdu;
+  coap_optlist_t *optlist = NULL;
+  char buf[32];
+  uint8_t num[4];
+  const char *host = hosts[i % (sizeof(hosts) / sizeof(hosts[0]))];
+
+  pdu = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_CODE_GET,
+                      (coap_mid_t)i, 1152);
+  if (!pdu)
+    return NULL;
+  coap_insert_optlist(&optlist,
+                      coap_new_optlist(COAP_OPTION_URI_HOST, strlen(host),
+                                       (const uint8_t *)host));
+  coap_insert_optlist(&optlist,
+                      coap_new_optlist(COAP_OPTION_URI_PORT,
+                                       coap_encode_var_safe(num, sizeof(num),
+                                                            5683), num));
+  coap_insert_optlist(&optlist,
+                      coap_new_optlist(COAP_OPTION_URI_PATH, 7,
+                                       (const uint8_t *)"sensors"));
+  snprintf(buf, sizeof(buf), "temp%u", i % 37);
+  coap_insert_optlist(&optlist,
+                      coap_new_optlist(COAP_OPTION_URI_PATH, strlen(buf),
+                                       (const uint8_t *)buf));
+  coap_insert_optlist(&optlist,
+                      coap_new_optlist(COAP_OPTION_ACCEPT,
+                                       coap_encode_var_safe(num, sizeof(num),
+                                                            COAP_MEDIATYPE_APPLICATION_CBOR),
+                                       num));
+  snprintf(buf, sizeof(buf), "id=%u&unit=Cel", i);
+  coap_insert_optlist(&optlist,
+                      coap_new_optlist(COAP_OPTION_URI_QUERY, strlen(buf),
+                                       (const uint8_t *)buf));
+  if (!coap_add_optlist_pdu(pdu, &optlist)) {
+    coap_delete_pdu(pdu);
+    pdu = NULL;
+  }
+  coap_delete_optlist(optlist);
+  return pdu;
+}
+
+static void
+report(const char *name, unsigned int count, double secs) {
+  printf("  %-7s %10.0f keys/sec  %6.0f ns/key\n", name, count / secs,
+         secs * 1e9 / count);
+}
+
+int
+main(int argc, char **argv) {
+  coap_context_t *ctx;
+  coap_session_t *session;
+  coap_address_t addr;
+  coap_pdu_t **req;
+  struct timespec start;
+  unsigned int found = 0;
+  unsigned int expected = 0;
+  unsigned int i;
+  int opt;
+  int ret = 1;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+    switch (opt) {
+    case 'n':
+      num_keys = (unsigned int)strtoul(optarg, NULL, 0);
+      break;
+    case 'r':
+      num_requests = (unsigned int)strtoul(optarg, NULL, 0);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n keys] [-r requests]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (!num_keys || !num_requests) {
+    fprintf(stderr, "-n and -r must not be 0\n");
+    exit(1);
+  }
+
+  coap_startup();
+  coap_set_log_level(COAP_LOG_WARN);
+  ctx = coap_new_context(NULL);
+  req = calloc(num_requests, sizeof(req[0]));
+  if (!ctx || !req)
+    goto fail;
+
+  /* The session is only used to find the context, nothing is sent */
+  coap_address_init(&addr);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_port = htons(5683);
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.size = sizeof(addr.addr.sin);
+  session = coap_new_client_session(ctx, NULL, &addr, COAP_PROTO_UDP);
+  if (!session)
+    goto fail;
+
+  for (i = 0; i < num_requests; i++) {
+    req[i] = make_request(i);
+    if (!req[i])
+      goto fail;
+  }
+  printf("%u requests, %u keys:\n", num_requests, num_keys);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_keys; i++) {
+    uint8_t *key = old_derive_key(req[i % num_requests]);
+
+    if (!key)
+      goto fail;
+    coap_free_type(COAP_CACHE_KEY, key);
+  }
+  report("digest", num_keys, elapsed(&start));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_keys; i++) {
+    coap_cache_key_t *key = coap_cache_derive_key(session, req[i % num_requests],
+                                                  COAP_CACHE_NOT_SESSION_BASED);
+
+    if (!key)
+      goto fail;
+    coap_delete_cache_key(key);
+  }
+  report("derive", num_keys, elapsed(&start));
+
+  for (i = 0; i < num_requests; i += 2) {
+    if (!coap_new_cache_entry(session, req[i], COAP_CACHE_NOT_RECORD_PDU,
+                              COAP_CACHE_NOT_SESSION_BASED, 0))
+      goto fail;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_keys; i++) {
+    if (coap_cache_get_by_pdu(session, req[i % num_requests],
+                              COAP_CACHE_NOT_SESSION_BASED))
+      found++;
+  }
+  report("lookup", num_keys, elapsed(&start));
+  /* Every request with an even index has an entry */
+  for (i = 0; i < num_keys; i++) {
+    if ((i % num_requests) % 2 == 0)
+      expected++;
+  }
+  if (found != expected) {
+    fprintf(stderr, "lookup found the wrong entries\n");
+    goto fail;
+  }
+  ret = 0;
+
+fail:
+  if (ret)
+    fprintf(stderr, "benchmark failed\n");
+  if (req) {
+    for (i = 0; i < num_requests; i++)
+      coap_delete_pdu(req[i]);
+    free(req);
+  }
+  coap_free_context(ctx);
+  coap_cleanup();
+  return ret;
+}
@@ -0,0 +1,205 @@
+/* libcoap benchmarks
+ *
+ * bench_contention.c -- Application thread hand-off throughput
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org> and others
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+/*
+ * Runs coap_io_process() in one thread, while 1, 4 and 16 producer threads
+ * flag a resource as changed, either by calling
+ * coap_resource_notify_observers() directly (which takes the context lock),
+ * or by posting the call to the I/O thread with coap_io_post_work().
+ * For comparison, the producer threads also call
+ * coap_resource_notify_observers() for a resource of their own context, so
+ * that they do not contend for the same lock.
+ *
+ * Reports how quickly the producer threads get through their calls, and how
+ * quickly the resulting work has been completed by the I/O thread.
+ *
+ * Usage: bench_contention [-n operations_per_thread] [-b]
+ *
+ *   -b  Keep the I/O thread busy (COAP_IO_NO_WAIT) rather than waiting.
+ */
+
+#include <coap3/coap.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_THREADS 16
+
+typedef enum {
+  BENCH_LOCK,
+  BENCH_POST,
+  BENCH_OWN
+} bench_mode_t;
+
+static coap_context_t *ctx;
+static coap_resource_t *resource;
+/* A context per producer thread for BENCH_OWN */
+static coap_context_t *own_ctx[BENCH_MAX_THREADS];
+static coap_resource_t *own_resource[BENCH_MAX_THREADS];
+static unsigned int num_ops = 100000;
+static int busy_io;
+static volatile int io_stop;
+static bench_mode_t mode;
+/* Only updated by the I/O thread */
+static unsigned long handled;
+
+static double
+elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void
+do_notify(coap_context_t *context COAP_UNUSED, void *arg) {
+  coap_resource_notify_observers((coap_resource_t *)arg, NULL);
+  handled++;
+}
+
+static void
+do_stop(coap_context_t *context COAP_UNUSED, void *arg COAP_UNUSED) {
+  io_stop = 1;
+}
+
+static void *
+io_thread(void *arg COAP_UNUSED) {
+  while (!io_stop) {
+    coap_io_process(ctx, busy_io ? COAP_IO_NO_WAIT : COAP_IO_WAIT);
+  }
+  return NULL;
+}
+
+static void *
+producer(void *arg) {
+  coap_resource_t *own = own_resource[*(unsigned int *)arg];
+  unsigned int i;
+
+  for (i = 0; i < num_ops; i++) {
+    if (mode == BENCH_LOCK) {
+      coap_resource_notify_observers(resource, NULL);
+    } else if (mode == BENCH_OWN) {
+      coap_resource_notify_observers(own, NULL);
+    } else {
+      while (!coap_io_post_work(ctx, do_notify, resource))
+        ;
+    }
+  }
+  return NULL;
+}
+
+static int
+run(bench_mode_t run_mode, unsigned int num_threads) {
+  pthread_t io;
+  pthread_t threads[BENCH_MAX_THREADS];
+  unsigned int index[BENCH_MAX_THREADS];
+  struct timespec start;
+  unsigned int i;
+  double call_secs;
+  double secs;
+
+  mode = run_mode;
+  io_stop = 0;
+  handled = 0;
+  if (pthread_create(&io, NULL, io_thread, NULL) != 0)
+    return 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_threads; i++) {
+    index[i] = i;
+    if (pthread_create(&threads[i], NULL, producer, &index[i]) != 0)
+      return 0;
+  }
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  call_secs = elapsed(&start);
+  /* Work is run in order, so do_stop() is run after all of the do_notify() */
+  coap_io_post_work(ctx, do_stop, NULL);
+  pthread_join(io, NULL);
+  secs = elapsed(&start);
+
+  if (mode == BENCH_POST && handled != (unsigned long)num_threads * num_ops) {
+    fprintf(stderr, "only %lu of %lu posted notifies run\n", handled,
+            (unsigned long)num_threads * num_ops);
+    return 0;
+  }
+  printf("%-30s %2u threads: %10.0f calls/sec %10.0f completed/sec\n",
+         mode == BENCH_LOCK ? "coap_resource_notify_observers" :
+         mode == BENCH_OWN ? "notify_observers (own context)" :
+         "coap_io_post_work", num_threads,
+         (double)num_threads * num_ops / call_secs,
+         (double)num_threads * num_ops / secs);
+  return 1;
+}
+
+int
+main(int argc, char **argv) {
+  static const unsigned int thread_counts[] = { 1, 4, 16 };
+  unsigned int i;
+  int opt;
+  int ret = 0;
+
+  while ((opt = getopt(argc, argv, "bn:")) != -1) {
+    switch (opt) {
+    case 'b':
+      busy_io = 1;
+      break;
+    case 'n':
+      num_ops = (unsigned int)atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n operations_per_thread] [-b]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  coap_startup();
+  coap_set_log_level(COAP_LOG_WARN);
+  if (!coap_threadsafe_is_supported())
+    printf("Note: libcoap is not built thread-safe; results are meaningless\n");
+
+  ctx = coap_new_context(NULL);
+  if (!ctx)
+    goto finish;
+  resource = coap_resource_init(coap_make_str_const("temp"), 0);
+  coap_resource_set_get_observable(resource, 1);
+  coap_add_resource(ctx, resource);
+  for (i = 0; i < BENCH_MAX_THREADS; i++) {
+    own_ctx[i] = coap_new_context(NULL);
+    if (!own_ctx[i])
+      goto finish;
+    own_resource[i] = coap_resource_init(coap_make_str_const("temp"), 0);
+    coap_resource_set_get_observable(own_resource[i], 1);
+    coap_add_resource(own_ctx[i], own_resource[i]);
+  }
+
+  for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+    if (!run(BENCH_LOCK, thread_counts[i]) ||
+        !run(BENCH_OWN, thread_counts[i]) ||
+        !run(BENCH_POST, thread_counts[i]))
+      goto finish;
+  }
+  ret = 1;
+
+finish:
+  for (i = 0; i < BENCH_MAX_THREADS; i++) {
+    coap_free_context(own_ctx[i]);
+  }
+  coap_free_context(ctx);
+  coap_cleanup();
+  return ret ? 0 : 1;
+}
@@ -0,0 +1,281 @@
+/* libcoap benchmarks
+ *
+ * bench_notify.c -- Observe notification fan-out throughput
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org> and others
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+/*
+ * Registers a number of observers (each with its own UDP socket, and hence
+ * its own server session) against a single resource and then measures how
+ * many notifications per second the server can send, with and without
+ * batched transmit (coap_context_set_tx_batch_size()).
+ *
+ * With -l, instead measures the server side latency of a notification cycle
+ * (from coap_resource_notify_observers() to all the notifications being
+ * sent) for 1, 10, 100, ... up to the given number of observers, with the
+ * GET handler called for every observer and with the notification rendered
+ * once (COAP_RESOURCE_FLAGS_NOTIFY_RENDER_ONCE).
+ *
+ * Usage: bench_notify [-o observers] [-r rounds] [-b tx_batch_size] [-l]
+ */
+
+#include <coap3/coap.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#define BENCH_PORT 5683
+
+static int *client_fd;
+static unsigned int num_observers = 1000;
+static unsigned int num_rounds = 100;
+static unsigned int handler_calls;
+
+static void
+hnd_get(coap_resource_t *resource COAP_UNUSED,
+        coap_session_t *session COAP_UNUSED,
+        const coap_pdu_t *request COAP_UNUSED,
+        const coap_string_t *query COAP_UNUSED,
+        coap_pdu_t *response) {
+  static unsigned int seq;
+  uint8_t buf[4];
+  char value[128];
+  int len;
+
+  /* A small JSON representation, as a typical sensor would render */
+  len = snprintf(value, sizeof(value),
+                 "{\"temp\":%.1f,\"unit\":\"Cel\",\"seq\":%u}",
+                 21.5 + (seq % 10) / 10.0, seq);
+  seq++;
+  handler_calls++;
+  coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+  coap_add_option(response, COAP_OPTION_CONTENT_FORMAT,
+                  coap_encode_var_safe(buf, sizeof(buf),
+                                       COAP_MEDIATYPE_APPLICATION_JSON),
+                  buf);
+  coap_add_option(response, COAP_OPTION_MAXAGE,
+                  coap_encode_var_safe(buf, sizeof(buf), 30), buf);
+  coap_add_data(response, (size_t)len, (const uint8_t *)value);
+}
+
+static double
+elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Read everything outstanding on the client sockets, acknowledging any
+ * CON notifications. Returns the number of notifications read.
+ */
+static unsigned int
+drain_clients(void) {
+  unsigned int count = 0;
+  unsigned int i;
+  uint8_t buf[256];
+
+  for (i = 0; i < num_observers; i++) {
+    ssize_t len;
+
+    while ((len = recv(client_fd[i], buf, sizeof(buf), MSG_DONTWAIT)) >= 4) {
+      if ((buf[0] & 0x30) == 0x00) {
+        /* CON - send back an empty ACK */
+        uint8_t ack[4] = { 0x60, 0x00, buf[2], buf[3] };
+
+        if (send(client_fd[i], ack, sizeof(ack), 0) < 0)
+          perror("send");
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+/*
+ * Runs the benchmark with num_observers observers. If latency is set, reports
+ * the mean time of a notification cycle rather than the throughput.
+ */
+static int
+run(unsigned int tx_batch_size, int flags, int latency) {
+  coap_context_t *ctx;
+  coap_resource_t *resource;
+  coap_address_t addr;
+  struct sockaddr_in sin;
+  struct timespec start;
+  unsigned int i;
+  unsigned int received = 0;
+  uint64_t syscalls, packets;
+  double secs;
+
+  ctx = coap_new_context(NULL);
+  if (!ctx)
+    return 0;
+  coap_context_set_tx_batch_size(ctx, tx_batch_size);
+
+  coap_address_init(&addr);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_port = htons(BENCH_PORT);
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.size = sizeof(addr.addr.sin);
+  if (!coap_new_endpoint(ctx, &addr, COAP_PROTO_UDP)) {
+    coap_free_context(ctx);
+    return 0;
+  }
+
+  resource = coap_resource_init(coap_make_str_const("temp"),
+                                COAP_RESOURCE_FLAGS_NOTIFY_NON_ALWAYS | flags);
+  coap_register_handler(resource, COAP_REQUEST_GET, hnd_get);
+  coap_resource_set_get_observable(resource, 1);
+  coap_add_resource(ctx, resource);
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(BENCH_PORT);
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  /* Register the observers: NON GET, Observe: 0, Uri-Path: temp */
+  for (i = 0; i < num_observers; i++) {
+    uint8_t req[] = { 0x51, 0x01, (uint8_t)(i >> 8), (uint8_t)i, 0x42,
+                      0x60, 0x54, 't', 'e', 'm', 'p'
+                    };
+    uint8_t buf[256];
+    int tries;
+
+    client_fd[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    if (client_fd[i] < 0 ||
+        connect(client_fd[i], (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+        send(client_fd[i], req, sizeof(req), 0) < 0) {
+      perror("client socket");
+      return 0;
+    }
+    for (tries = 0; tries < 100; tries++) {
+      coap_io_process(ctx, 1);
+      if (recv(client_fd[i], buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        break;
+    }
+    if (tries == 100) {
+      fprintf(stderr, "observer %u not registered\n", i);
+      return 0;
+    }
+  }
+
+  coap_context_get_tx_batch_stats(ctx, &syscalls, &packets);
+  /* Only the server side is timed */
+  secs = 0;
+  handler_calls = 0;
+  for (i = 0; i < num_rounds; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    coap_resource_notify_observers(resource, NULL);
+    coap_io_process(ctx, COAP_IO_NO_WAIT);
+    secs += elapsed(&start);
+    received += drain_clients();
+  }
+  for (i = 0; i < 10 && received < num_rounds * num_observers; i++) {
+    coap_io_process(ctx, 1);
+    received += drain_clients();
+  }
+
+  if (latency) {
+    printf("%6u observers, %-11s: %9.1fus per cycle, %6.2fus per observer, "
+           "%u handler calls per cycle (%u of %u received)\n",
+           num_observers,
+           (flags & COAP_RESOURCE_FLAGS_NOTIFY_RENDER_ONCE) ?
+           "render once" : "per observer",
+           secs * 1e6 / num_rounds, secs * 1e6 / num_rounds / num_observers,
+           handler_calls / num_rounds, received, num_rounds * num_observers);
+  } else {
+    uint64_t end_syscalls, end_packets;
+
+    coap_context_get_tx_batch_stats(ctx, &end_syscalls, &end_packets);
+    printf("tx_batch_size %3u: %9.0f notifications/sec "
+           "(%u of %u received, %.1f datagrams per send call)\n",
+           tx_batch_size, received / secs, received,
+           num_rounds * num_observers,
+           end_syscalls > syscalls ?
+           (double)(end_packets - packets) / (end_syscalls - syscalls) : 1.0);
+  }
+
+  for (i = 0; i < num_observers; i++) {
+    close(client_fd[i]);
+  }
+  coap_free_context(ctx);
+  return 1;
+}
+
+int
+main(int argc, char **argv) {
+  unsigned int tx_batch_size = COAP_TX_BATCH_MAX;
+  unsigned int max_observers;
+  struct rlimit rl;
+  int latency = 0;
+  int opt;
+  int ok = 1;
+
+  while ((opt = getopt(argc, argv, "b:lo:r:")) != -1) {
+    switch (opt) {
+    case 'b':
+      tx_batch_size = (unsigned int)atoi(optarg);
+      break;
+    case 'l':
+      latency = 1;
+      break;
+    case 'o':
+      num_observers = (unsigned int)atoi(optarg);
+      break;
+    case 'r':
+      num_rounds = (unsigned int)atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-o observers] [-r rounds] [-b tx_batch_size] "
+              "[-l]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  /* One socket per observer */
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < num_observers + 64) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  client_fd = calloc(num_observers, sizeof(int));
+  if (!client_fd)
+    return 1;
+
+  coap_startup();
+  coap_set_log_level(COAP_LOG_WARN);
+  if (latency) {
+    printf("%u rounds, tx_batch_size %u\n", num_rounds, tx_batch_size);
+    max_observers = num_observers;
+    for (num_observers = 1; ok && num_observers <= max_observers;
+         num_observers *= 10) {
+      ok = run(tx_batch_size, 0, 1) &&
+           run(tx_batch_size, COAP_RESOURCE_FLAGS_NOTIFY_RENDER_ONCE, 1);
+    }
+  } else {
+    printf("%u observers, %u rounds\n", num_observers, num_rounds);
+    ok = run(1, 0, 0) && (tx_batch_size <= 1 || run(tx_batch_size, 0, 0));
+  }
+  if (!ok) {
+    fprintf(stderr, "benchmark setup failed\n");
+    return 1;
+  }
+  coap_cleanup();
+  free(client_fd);
+  return 0;
+}
@@ -0,0 +1,161 @@
+/* libcoap benchmarks
+ *
+ * bench_resource_lookup.c -- Resource lookup by URI path throughput
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org> and others
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+/*
+ * Registers 8, 64 and 512 resources with URI paths typical of a device
+ * ("sensors/temp/3", "config/net/17", ...) and measures how many lookups per
+ * second coap_get_resource_from_uri_path() does for a mix of existing and
+ * unknown paths. For comparison, the same lookups are also done with a linear
+ * scan and string compare, which is what a list based resource table costs.
+ *
+ * Usage: bench_resource_lookup [-n lookups]
+ */
+
+#include <coap3/coap.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned int num_lookups = 5000000;
+
+static double
+elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static const char *const path_prefix[] = {
+  "sensors/temp/", "sensors/humidity/", "config/net/", "actuators/relay/"
+};
+
+static coap_str_const_t *
+make_path(unsigned int i) {
+  char buf[40];
+
+  snprintf(buf, sizeof(buf), "%s%u",
+           path_prefix[i % (sizeof(path_prefix) / sizeof(path_prefix[0]))],
+           i);
+  return coap_new_str_const((const uint8_t *)buf, strlen(buf));
+}
+
+static int
+run(unsigned int num_resources) {
+  coap_context_t *ctx = coap_new_context(NULL);
+  coap_str_const_t **paths;
+  /* Every fourth lookup is for an unknown path */
+  unsigned int num_paths = num_resources + num_resources / 3;
+  unsigned int found = 0;
+  unsigned int expect = 0;
+  unsigned int i;
+  struct timespec start;
+  double secs;
+  double hashed;
+  int ret = 0;
+
+  paths = calloc(num_paths, sizeof(paths[0]));
+  if (!ctx || !paths)
+    goto finish;
+  for (i = 0; i < num_paths; i++) {
+    paths[i] = make_path(i);
+    if (!paths[i])
+      goto finish;
+    if (i < num_resources) {
+      coap_resource_t *r;
+
+      r = coap_resource_init(paths[i], 0);
+      if (!r)
+        goto finish;
+      coap_add_resource(ctx, r);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_lookups; i++) {
+    if (coap_get_resource_from_uri_path(ctx, paths[(i * 7919) % num_paths]))
+      found++;
+  }
+  secs = elapsed(&start);
+  hashed = num_lookups / secs;
+  for (i = 0; i < num_lookups; i++) {
+    if ((i * 7919) % num_paths < num_resources)
+      expect++;
+  }
+  if (found != expect) {
+    fprintf(stderr, "found %u of %u resources\n", found, expect);
+    goto finish;
+  }
+
+  found = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_lookups; i++) {
+    coap_str_const_t *key = paths[(i * 7919) % num_paths];
+    unsigned int j;
+
+    for (j = 0; j < num_resources; j++) {
+      if (coap_string_equal(paths[j], key)) {
+        found++;
+        break;
+      }
+    }
+  }
+  secs = elapsed(&start);
+
+  printf("%3u resources: %10.0f lookups/sec (linear scan %10.0f)\n",
+         num_resources, hashed, num_lookups / secs);
+  ret = found == expect;
+
+finish:
+  if (paths) {
+    for (i = 0; i < num_paths; i++) {
+      coap_delete_str_const(paths[i]);
+    }
+    free(paths);
+  }
+  coap_free_context(ctx);
+  return ret;
+}
+
+int
+main(int argc, char **argv) {
+  static const unsigned int counts[] = { 8, 64, 512 };
+  unsigned int i;
+  int opt;
+  int ret = 1;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+    case 'n':
+      num_lookups = (unsigned int)atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n lookups]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  coap_startup();
+  coap_set_log_level(COAP_LOG_WARN);
+  for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    if (!run(counts[i]))
+      goto finish;
+  }
+  ret = 0;
+
+finish:
+  coap_cleanup();
+  return ret;
+}
@@ -0,0 +1,297 @@
+/* libcoap benchmarks
+ *
+ * bench_shard.c -- Sharded server request throughput
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org> and others
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+/*
+ * Runs 1, 2, 4, 8 and 16 server shards (see coap_context_set_shards()), each
+ * a process with its own context, all bound to the same UDP port. A set of
+ * client threads, each with a number of UDP sockets (and hence server
+ * sessions), keeps a window of CON GET requests outstanding per socket and
+ * counts the responses received per second.
+ *
+ * Shards are processes, as with coap-server -y.
+ *
+ * Only useful on a host with multiple cores; the client threads share those
+ * cores with the shards.
+ *
+ * Usage: bench_shard [-c client_threads] [-s sockets_per_thread]
+ *                    [-w window] [-t seconds] [-m max_shards]
+ */
+
+#include <coap3/coap.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_SHARDS 16
+
+static unsigned int num_clients = 4;
+static unsigned int num_sockets = 16;
+static unsigned int window = 8;
+static unsigned int run_secs = 2;
+static unsigned int max_shards = BENCH_MAX_SHARDS;
+static uint16_t server_port;
+static volatile int stop;
+static volatile sig_atomic_t shard_stop;
+
+static void
+hnd_get(coap_resource_t *resource COAP_UNUSED,
+        coap_session_t *session COAP_UNUSED,
+        const coap_pdu_t *request COAP_UNUSED,
+        const coap_string_t *query COAP_UNUSED,
+        coap_pdu_t *response) {
+  static const uint8_t value[] = "21.5";
+
+  coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+  coap_add_data(response, sizeof(value) - 1, value);
+}
+
+static coap_context_t *
+new_shard(unsigned int num_shards) {
+  coap_context_t *ctx = coap_new_context(NULL);
+  coap_resource_t *r;
+  coap_address_t addr;
+
+  if (!ctx)
+    return NULL;
+  if (!coap_context_set_shards(ctx, num_shards, COAP_SHARD_STEER_HASH)) {
+    fprintf(stderr, "sharding not supported\n");
+    coap_free_context(ctx);
+    return NULL;
+  }
+  r = coap_resource_init(coap_make_str_const("bench"), 0);
+  coap_register_handler(r, COAP_REQUEST_GET, hnd_get);
+  coap_add_resource(ctx, r);
+
+  coap_address_init(&addr);
+  addr.size = sizeof(struct sockaddr_in);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.addr.sin.sin_port = htons(server_port);
+  if (!coap_new_endpoint(ctx, &addr, COAP_PROTO_UDP)) {
+    coap_free_context(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+static void
+handle_sigterm(int signum COAP_UNUSED) {
+  shard_stop = 1;
+}
+
+/* Runs in the forked shard process; writes to ready_fd once bound */
+static void
+shard_process(unsigned int num_shards, int ready_fd) {
+  coap_context_t *ctx = new_shard(num_shards);
+
+  if (ctx) {
+    if (write(ready_fd, "r", 1) != 1)
+      perror("write");
+    while (!shard_stop) {
+      coap_io_process(ctx, 100);
+    }
+  }
+  coap_free_context(ctx);
+  coap_cleanup();
+  _exit(ctx ? 0 : 1);
+}
+
+static void *
+client_thread(void *arg) {
+  unsigned long *received = (unsigned long *)arg;
+  struct sockaddr_in sin;
+  struct timeval tv = { 0, 100000 };
+  uint8_t req[] = { 0x41, 0x01, 0x00, 0x00, 0x01, 0xb5,
+                    'b', 'e', 'n', 'c', 'h'
+                  };
+  uint8_t buf[64];
+  int *fd;
+  uint16_t mid = 0;
+  unsigned int i;
+  unsigned int j;
+
+  fd = calloc(num_sockets, sizeof(int));
+  if (!fd)
+    return NULL;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin.sin_port = htons(server_port);
+  for (i = 0; i < num_sockets; i++) {
+    fd[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd[i] == -1 ||
+        setsockopt(fd[i], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1 ||
+        connect(fd[i], (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+      perror("client socket");
+      goto finish;
+    }
+  }
+
+  while (!stop) {
+    for (i = 0; i < num_sockets; i++) {
+      for (j = 0; j < window; j++) {
+        mid++;
+        req[2] = (uint8_t)(mid >> 8);
+        req[3] = (uint8_t)mid;
+        if (send(fd[i], req, sizeof(req), 0) < 0)
+          perror("send");
+      }
+    }
+    for (i = 0; i < num_sockets; i++) {
+      for (j = 0; j < window; j++) {
+        /* A lost request or response just times out */
+        if (recv(fd[i], buf, sizeof(buf), 0) < 4)
+          break;
+        (*received)++;
+      }
+    }
+  }
+
+finish:
+  for (i = 0; i < num_sockets; i++) {
+    if (fd[i] > 0)
+      close(fd[i]);
+  }
+  free(fd);
+  return NULL;
+}
+
+static int
+run(unsigned int num_shards) {
+  pid_t shard[BENCH_MAX_SHARDS];
+  int ready[2] = { -1, -1 };
+  pthread_t *client_tid;
+  unsigned long *received;
+  unsigned long total = 0;
+  struct timespec start;
+  struct timespec now;
+  unsigned int num_started = 0;
+  unsigned int i;
+  double secs;
+  int ret = 0;
+
+  client_tid = calloc(num_clients, sizeof(pthread_t));
+  received = calloc(num_clients, sizeof(unsigned long));
+  if (!client_tid || !received || pipe(ready) == -1)
+    goto finish;
+
+  for (i = 0; i < num_shards; i++) {
+    shard[i] = fork();
+    if (shard[i] == -1) {
+      perror("fork");
+      goto finish;
+    }
+    if (shard[i] == 0)
+      shard_process(num_shards, ready[1]);
+    num_started++;
+  }
+  for (i = 0; i < num_shards; i++) {
+    char c;
+
+    if (read(ready[0], &c, 1) != 1) {
+      fprintf(stderr, "shard failed to start\n");
+      goto finish;
+    }
+  }
+  stop = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < num_clients; i++) {
+    pthread_create(&client_tid[i], NULL, client_thread, &received[i]);
+  }
+  sleep(run_secs);
+  stop = 1;
+  for (i = 0; i < num_clients; i++) {
+    pthread_join(client_tid[i], NULL);
+    total += received[i];
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  secs = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+
+  printf("%2u shards: %10.0f requests/sec\n", num_shards, total / secs);
+  ret = 1;
+
+finish:
+  for (i = 0; i < num_started; i++) {
+    kill(shard[i], SIGTERM);
+  }
+  for (i = 0; i < num_started; i++) {
+    waitpid(shard[i], NULL, 0);
+  }
+  if (ready[0] != -1) {
+    close(ready[0]);
+    close(ready[1]);
+  }
+  free(client_tid);
+  free(received);
+  return ret;
+}
+
+int
+main(int argc, char **argv) {
+  unsigned int num_shards;
+  int opt;
+  int ret = 1;
+
+  while ((opt = getopt(argc, argv, "c:m:s:t:w:")) != -1) {
+    switch (opt) {
+    case 'c':
+      num_clients = (unsigned int)atoi(optarg);
+      break;
+    case 'm':
+      max_shards = (unsigned int)atoi(optarg);
+      if (max_shards > BENCH_MAX_SHARDS)
+        max_shards = BENCH_MAX_SHARDS;
+      break;
+    case 's':
+      num_sockets = (unsigned int)atoi(optarg);
+      break;
+    case 't':
+      run_secs = (unsigned int)atoi(optarg);
+      break;
+    case 'w':
+      window = (unsigned int)atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-c client_threads] [-s sockets_per_thread] "
+              "[-w window] [-t seconds] [-m max_shards]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  coap_startup();
+  coap_set_log_level(COAP_LOG_WARN);
+  signal(SIGTERM, handle_sigterm);
+  server_port = (uint16_t)(20000 + getpid() % 10000);
+  printf("%u client threads, %u sockets each, window %u\n", num_clients,
+         num_sockets, window);
+
+  for (num_shards = 1; num_shards <= max_shards; num_shards *= 2) {
+    if (!run(num_shards))
+      goto finish;
+  }
+  ret = 0;
+
+finish:
+  coap_cleanup();
+  return ret;
+}
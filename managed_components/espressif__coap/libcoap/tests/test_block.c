@@ -0,0 +1,235 @@
+/* libcoap unit tests
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+#include "test_common.h"
+#include "test_block.h"
+
+#if COAP_SERVER_SUPPORT
+#include <stdio.h>
+#include <unistd.h>
+
+/* The client is a plain UDP socket, so that the Block1 blocks of a body can
+ * be sent in any order. */
+static coap_context_t *ctx;
+static coap_fd_t client_fd = COAP_INVALID_SOCKET;
+
+#define T_BLOCK_SIZE 16 /* szx 0 */
+
+static struct {
+  size_t next_offset;      /* data passed over in order so far */
+  size_t total;            /* total passed over with the last data */
+  uint32_t max_pending;    /* most chunks held back at any time */
+  int bad_data;            /* data out of order or not as sent */
+  int released;            /* called with NULL data */
+  size_t released_total;   /* total when called with NULL data */
+  int put_called;          /* PUT handler called */
+} stream;
+
+static int
+t_block_data_handler(coap_session_t *session,
+                     const coap_pdu_t *pdu COAP_UNUSED,
+                     coap_resource_t *resource COAP_UNUSED,
+                     void **app_data,
+                     size_t offset,
+                     const uint8_t *data,
+                     size_t length,
+                     size_t total) {
+  size_t i;
+
+  if (session->lg_srcv &&
+      session->lg_srcv->stream.pending_count > stream.max_pending)
+    stream.max_pending = session->lg_srcv->stream.pending_count;
+  if (!data) {
+    stream.released++;
+    stream.released_total = total;
+    *app_data = NULL;
+    return 1;
+  }
+  *app_data = &stream;
+  if (offset != stream.next_offset)
+    stream.bad_data++;
+  for (i = 0; i < length; i++) {
+    if (data[i] != (uint8_t)((offset + i) / T_BLOCK_SIZE))
+      stream.bad_data++;
+  }
+  stream.next_offset = offset + length;
+  stream.total = total;
+  return 1;
+}
+
+static void
+t_hnd_put(coap_resource_t *r COAP_UNUSED,
+          coap_session_t *s COAP_UNUSED,
+          const coap_pdu_t *request COAP_UNUSED,
+          const coap_string_t *query COAP_UNUSED,
+          coap_pdu_t *response) {
+  stream.put_called++;
+  coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+}
+
+/*
+ * Sends block @p num of a body of @p count blocks as a CON Block1 PUT (no
+ * Size1) and returns the response code, or 0 if there is no response.
+ */
+static coap_pdu_code_t
+t_block_send(uint32_t num, uint32_t count) {
+  static coap_mid_t mid = 0x2000;
+  uint8_t payload[T_BLOCK_SIZE];
+  uint8_t resp[64];
+  uint8_t buf[4];
+  uint8_t token = 0x42;
+  coap_pdu_code_t code = 0;
+  coap_pdu_t *pdu;
+  coap_tick_t start, now;
+  ssize_t len;
+
+  pdu = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_CODE_PUT, mid++, 64);
+  if (!pdu)
+    return 0;
+  memset(payload, num, sizeof(payload));
+  coap_add_token(pdu, 1, &token);
+  coap_add_option(pdu, COAP_OPTION_URI_PATH, 1, (const uint8_t *)"b");
+  coap_add_option(pdu, COAP_OPTION_BLOCK1,
+                  coap_encode_var_safe(buf, sizeof(buf),
+                                       (num << 4) |
+                                       ((num + 1 < count) << 3) | 0),
+                  buf);
+  coap_add_data(pdu, sizeof(payload), payload);
+  if (coap_pdu_encode_header(pdu, COAP_PROTO_UDP) == 0 ||
+      send(client_fd, pdu->token - pdu->hdr_size,
+           pdu->used_size + pdu->hdr_size, 0) == -1) {
+    coap_delete_pdu(pdu);
+    return 0;
+  }
+  coap_delete_pdu(pdu);
+
+  coap_ticks(&start);
+  now = start;
+  while (now - start < COAP_TICKS_PER_SECOND) {
+    coap_io_process(ctx, 10);
+    len = recv(client_fd, resp, sizeof(resp), MSG_DONTWAIT);
+    if (len >= 4) {
+      code = resp[1];
+      break;
+    }
+    coap_ticks(&now);
+  }
+  return code;
+}
+
+/* Test 1: a body streamed to the block data handler with its blocks sent out
+ * of order (all but the last one in reverse). No more than
+ * COAP_BLOCK_STREAM_WINDOW blocks are held back (one that does not fit is not
+ * treated as received), the body is never re-assembled and the handler gets
+ * all of the data in order. */
+static void
+t_block1(void) {
+  const uint32_t count = COAP_BLOCK_STREAM_WINDOW + 8;
+  const uint32_t held = count - 1 - COAP_BLOCK_STREAM_WINDOW;
+  coap_session_t *session;
+  uint32_t num;
+
+  memset(&stream, 0, sizeof(stream));
+
+  /* A window's worth of blocks can be held back */
+  for (num = count - 2; num >= held; num--) {
+    CU_ASSERT(t_block_send(num, count) == COAP_RESPONSE_CODE(231));
+  }
+  session = ctx->endpoint->sessions;
+  CU_ASSERT_PTR_NOT_NULL(session);
+  if (!session || !session->lg_srcv)
+    return;
+  CU_ASSERT(session->lg_srcv->stream.pending_count ==
+            COAP_BLOCK_STREAM_WINDOW);
+  /* The next one out of order is not held */
+  CU_ASSERT(t_block_send(num, count) == COAP_RESPONSE_CODE(408));
+  CU_ASSERT(session->lg_srcv->stream.pending_count ==
+            COAP_BLOCK_STREAM_WINDOW);
+  CU_ASSERT(stream.next_offset == 0);
+
+  /* Filling the gap passes the held blocks over */
+  for (num = 0; num < held; num++) {
+    CU_ASSERT(t_block_send(num, count) == COAP_RESPONSE_CODE(231));
+    CU_ASSERT_PTR_NULL(session->lg_srcv->body_data);
+  }
+  CU_ASSERT(session->lg_srcv->stream.pending_count == 0);
+  CU_ASSERT(stream.next_offset == (count - 1) * T_BLOCK_SIZE);
+
+  CU_ASSERT(t_block_send(count - 1, count) == COAP_RESPONSE_CODE(204));
+  CU_ASSERT(stream.max_pending <= COAP_BLOCK_STREAM_WINDOW);
+  CU_ASSERT(stream.bad_data == 0);
+  CU_ASSERT(stream.next_offset == count * T_BLOCK_SIZE);
+  /* No Size1, so no total is passed with the data */
+  CU_ASSERT(stream.total == 0);
+  CU_ASSERT(stream.released == 1);
+  CU_ASSERT(stream.released_total == count * T_BLOCK_SIZE);
+  CU_ASSERT(stream.put_called == 1);
+}
+
+static int
+t_block_tests_create(void) {
+  coap_address_t addr;
+  coap_endpoint_t *ep;
+  coap_resource_t *r;
+
+  ctx = coap_new_context(NULL);
+  if (!ctx)
+    return 1;
+  coap_context_set_block_mode(ctx, COAP_BLOCK_USE_LIBCOAP |
+                              COAP_BLOCK_SINGLE_BODY);
+  coap_register_block_data_handler(ctx, t_block_data_handler);
+  r = coap_resource_init(coap_make_str_const("b"), 0);
+  coap_register_handler(r, COAP_REQUEST_PUT, t_hnd_put);
+  coap_add_resource(ctx, r);
+
+  coap_address_init(&addr);
+  addr.size = sizeof(struct sockaddr_in);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ep = coap_new_endpoint(ctx, &addr, COAP_PROTO_UDP);
+  if (!ep)
+    return 1;
+
+  client_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  return client_fd == COAP_INVALID_SOCKET ||
+         connect(client_fd, &ep->bind_addr.addr.sa, ep->bind_addr.size) == -1;
+}
+
+static int
+t_block_tests_remove(void) {
+  if (client_fd != COAP_INVALID_SOCKET)
+    coap_closesocket(client_fd);
+  coap_free_context(ctx);
+  return 0;
+}
+
+CU_pSuite
+t_init_block_tests(void) {
+  CU_pSuite suite;
+
+  suite = CU_add_suite("block", t_block_tests_create, t_block_tests_remove);
+  if (!suite) {                        /* signal error */
+    fprintf(stderr, "W: cannot add block test suite (%s)\n",
+            CU_get_error_msg());
+
+    return NULL;
+  }
+
+#define BLOCK_TEST(s,t)                                                \
+  if (!CU_ADD_TEST(s,t)) {                                              \
+    fprintf(stderr, "W: cannot add block test (%s)\n",                \
+            CU_get_error_msg());                                      \
+  }
+
+  BLOCK_TEST(suite, t_block1);
+
+  return suite;
+}
+#endif /* COAP_SERVER_SUPPORT */
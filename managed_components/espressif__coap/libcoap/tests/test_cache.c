@@ -0,0 +1,393 @@
+/* libcoap unit tests
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+#include "test_common.h"
+#include "test_cache.h"
+
+#if COAP_SERVER_SUPPORT
+#include <stdio.h>
+#include <unistd.h>
+
+#define ReturnIf_CU_ASSERT_PTR_NOT_NULL(value) \
+  CU_ASSERT_PTR_NOT_NULL(value); \
+  if ((void*)value == NULL) return;
+
+static coap_context_t *ctx;
+static coap_resource_t *resource;
+static coap_session_t *session;
+/* A plain UDP client, for requests that go through the request handling */
+static coap_fd_t client_fd = COAP_INVALID_SOCKET;
+static unsigned int renders;
+
+static void
+t_hnd_get(coap_resource_t *r COAP_UNUSED,
+          coap_session_t *s COAP_UNUSED,
+          const coap_pdu_t *request COAP_UNUSED,
+          const coap_string_t *query COAP_UNUSED,
+          coap_pdu_t *response) {
+  char buf[16];
+
+  renders++;
+  snprintf(buf, sizeof(buf), "v%u", renders);
+  coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+  coap_add_data(response, strlen(buf), (const uint8_t *)buf);
+}
+
+static void
+t_hnd_put(coap_resource_t *r COAP_UNUSED,
+          coap_session_t *s COAP_UNUSED,
+          const coap_pdu_t *request COAP_UNUSED,
+          const coap_string_t *query COAP_UNUSED,
+          coap_pdu_t *response) {
+  coap_pdu_set_code(response, COAP_RESPONSE_CODE_CHANGED);
+}
+
+/* A GET request for the resource, made distinct by @p name */
+static coap_pdu_t *
+t_cache_request(const char *name) {
+  coap_pdu_t *request;
+
+  request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_CODE_GET, 0x1234, 64);
+  if (!request)
+    return NULL;
+  coap_add_option(request, COAP_OPTION_URI_PATH, 1, (const uint8_t *)"c");
+  coap_add_option(request, COAP_OPTION_URI_QUERY, strlen(name),
+                  (const uint8_t *)name);
+  return request;
+}
+
+/*
+ * Has libcoap cache a 2.05 response to the request for @p name, that can be
+ * used for @p max_age seconds.
+ */
+static void
+t_cache_add_response(const char *name, uint32_t max_age) {
+  coap_pdu_t *request = t_cache_request(name);
+  coap_pdu_t *response;
+  uint8_t buf[4];
+
+  response = coap_pdu_init(COAP_MESSAGE_ACK, COAP_RESPONSE_CODE_CONTENT,
+                           0x1234, 64);
+  if (request && response) {
+    coap_add_option(response, COAP_OPTION_MAXAGE,
+                    coap_encode_var_safe(buf, sizeof(buf), max_age), buf);
+    coap_add_data(response, strlen(name), (const uint8_t *)name);
+    coap_lock_lock(ctx, goto finish);
+    coap_cache_add_response_lkd(session, resource, request, response);
+    coap_lock_unlock(ctx);
+  }
+finish:
+  coap_delete_pdu(request);
+  coap_delete_pdu(response);
+}
+
+/* Returns the cache-entry for @p name, without using it */
+static coap_cache_entry_t *
+t_cache_find(const char *name) {
+  coap_pdu_t *request = t_cache_request(name);
+  coap_cache_entry_t *entry = NULL;
+  coap_cache_key_t key;
+  static const uint16_t ignore[] = { COAP_OPTION_ETAG };
+
+  if (request &&
+      coap_cache_derive_key_into(session, request,
+                                 COAP_CACHE_NOT_SESSION_BASED,
+                                 ignore, 1, &key))
+    HASH_FIND(hh, ctx->cache, &key, sizeof(coap_cache_key_t), entry);
+  coap_delete_pdu(request);
+  return entry;
+}
+
+/*
+ * Sends a CON request with method @p code for the resource from the client
+ * and returns the response code, or 0 if there is no response.
+ */
+static coap_pdu_code_t
+t_cache_send(coap_pdu_code_t code) {
+  static coap_mid_t mid = 0x5000;
+  uint8_t resp[64];
+  uint8_t token = 0x24;
+  coap_pdu_code_t rcode = 0;
+  coap_pdu_t *pdu;
+  coap_tick_t start, now;
+  ssize_t len;
+
+  pdu = coap_pdu_init(COAP_MESSAGE_CON, code, mid++, 64);
+  if (!pdu)
+    return 0;
+  coap_add_token(pdu, 1, &token);
+  coap_add_option(pdu, COAP_OPTION_URI_PATH, 1, (const uint8_t *)"c");
+  if (code == COAP_REQUEST_CODE_PUT)
+    coap_add_data(pdu, 1, (const uint8_t *)"x");
+  if (coap_pdu_encode_header(pdu, COAP_PROTO_UDP) == 0 ||
+      send(client_fd, pdu->token - pdu->hdr_size,
+           pdu->used_size + pdu->hdr_size, 0) == -1) {
+    coap_delete_pdu(pdu);
+    return 0;
+  }
+  coap_delete_pdu(pdu);
+
+  coap_ticks(&start);
+  now = start;
+  while (now - start < COAP_TICKS_PER_SECOND) {
+    coap_io_process(ctx, 10);
+    len = recv(client_fd, resp, sizeof(resp), MSG_DONTWAIT);
+    if (len >= 4) {
+      rcode = resp[1];
+      break;
+    }
+    coap_ticks(&now);
+  }
+  return rcode;
+}
+
+static void
+t_cache_clear(void) {
+  coap_cache_set_max_size(ctx, 0);
+  while (ctx->cache)
+    coap_delete_cache_entry(ctx, ctx->cache);
+  ctx->cache_evictions = 0;
+}
+
+/* Test 1: the least recently used response is the one evicted, looking an
+ * entry up counting as a use. */
+static void
+t_cache1(void) {
+  coap_cache_entry_t *a, *b, *c;
+  coap_cache_entry_t *entry;
+  uint64_t evictions;
+  size_t size;
+
+  t_cache_add_response("a", 60);
+  t_cache_add_response("b", 60);
+  t_cache_add_response("c", 60);
+  a = t_cache_find("a");
+  b = t_cache_find("b");
+  c = t_cache_find("c");
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(a);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(b);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(c);
+  CU_ASSERT(ctx->cache_lru == a);
+  CU_ASSERT(a->lru_next == b);
+  CU_ASSERT(b->lru_next == c);
+
+  /* Using a moves it to the end */
+  entry = coap_cache_get_by_key(ctx, a->cache_key);
+  CU_ASSERT(entry == a);
+  CU_ASSERT(ctx->cache_lru == b);
+  CU_ASSERT(b->lru_next == c);
+  CU_ASSERT(c->lru_next == a);
+  CU_ASSERT_PTR_NULL(a->lru_next);
+
+  /* So b goes first */
+  coap_cache_get_stats(ctx, NULL, NULL, NULL, &size);
+  coap_cache_set_max_size(ctx, size - 1);
+  coap_cache_get_stats(ctx, NULL, NULL, &evictions, &size);
+  CU_ASSERT(evictions == 1);
+  CU_ASSERT(size <= ctx->cache_max_size);
+  CU_ASSERT_PTR_NULL(t_cache_find("b"));
+  CU_ASSERT(t_cache_find("a") == a);
+  CU_ASSERT(t_cache_find("c") == c);
+  CU_ASSERT(ctx->cache_lru == c);
+  CU_ASSERT(c->lru_next == a);
+
+  t_cache_clear();
+}
+
+/* Test 2: responses expire in the order of their Max-Age, whatever the order
+ * they were cached in. */
+static void
+t_cache2(void) {
+  coap_cache_entry_t *a, *b, *c;
+
+  t_cache_add_response("a", 60);
+  t_cache_add_response("b", 10);
+  t_cache_add_response("c", 30);
+  a = t_cache_find("a");
+  b = t_cache_find("b");
+  c = t_cache_find("c");
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(a);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(b);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(c);
+  CU_ASSERT(ctx->cache_expire_count == 3);
+  CU_ASSERT(ctx->cache_expire[0] == b);
+
+  /* Nothing is due yet */
+  coap_expire_cache_entries(ctx);
+  CU_ASSERT(ctx->cache_expire_count == 3);
+
+  /* b is now due (still the earliest, so the heap holds) */
+  b->expire_ticks = 0;
+  coap_expire_cache_entries(ctx);
+  CU_ASSERT_PTR_NULL(t_cache_find("b"));
+  CU_ASSERT(ctx->cache_expire_count == 2);
+  CU_ASSERT(ctx->cache_expire[0] == c);
+  CU_ASSERT(ctx->cache_lru == a);
+  CU_ASSERT(a->lru_next == c);
+
+  c->expire_ticks = 0;
+  coap_expire_cache_entries(ctx);
+  CU_ASSERT_PTR_NULL(t_cache_find("c"));
+  CU_ASSERT(ctx->cache_expire_count == 1);
+  CU_ASSERT(ctx->cache_expire[0] == a);
+  CU_ASSERT(t_cache_find("a") == a);
+
+  t_cache_clear();
+  CU_ASSERT(ctx->cache_expire_count == 0);
+}
+
+/* Test 3: keeping within the budget evicts the responses libcoap has cached,
+ * but leaves those created by the application alone. */
+static void
+t_cache3(void) {
+  coap_cache_entry_t *app;
+  coap_pdu_t *request;
+  uint64_t evictions;
+  size_t size;
+
+  request = t_cache_request("app");
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(request);
+  app = coap_new_cache_entry(session, request, COAP_CACHE_RECORD_PDU,
+                             COAP_CACHE_NOT_SESSION_BASED, 0);
+  coap_delete_pdu(request);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(app);
+  CU_ASSERT_PTR_NULL(app->lru_prev);
+  CU_ASSERT(ctx->cache_size == app->size);
+
+  t_cache_add_response("a", 60);
+  t_cache_add_response("b", 60);
+  CU_ASSERT_PTR_NOT_NULL(t_cache_find("a"));
+  CU_ASSERT_PTR_NOT_NULL(t_cache_find("b"));
+
+  /* Less than the application entry needs on its own */
+  coap_cache_set_max_size(ctx, 1);
+  coap_cache_get_stats(ctx, NULL, NULL, &evictions, &size);
+  CU_ASSERT(evictions == 2);
+  CU_ASSERT(size == app->size);
+  CU_ASSERT_PTR_NULL(ctx->cache_lru);
+  CU_ASSERT_PTR_NULL(resource->cache_entries);
+  CU_ASSERT(ctx->cache == app);
+
+  /* A new response is kept while it is the only one that can go */
+  t_cache_add_response("c", 60);
+  CU_ASSERT_PTR_NOT_NULL(t_cache_find("c"));
+  CU_ASSERT(ctx->cache_lru == t_cache_find("c"));
+  t_cache_add_response("d", 60);
+  coap_cache_get_stats(ctx, NULL, NULL, &evictions, NULL);
+  CU_ASSERT(evictions == 3);
+  CU_ASSERT_PTR_NULL(t_cache_find("c"));
+  CU_ASSERT_PTR_NOT_NULL(t_cache_find("d"));
+  CU_ASSERT(t_cache_find("app") == app);
+  CU_ASSERT(HASH_COUNT(ctx->cache) == 2);
+
+  t_cache_clear();
+}
+
+/* Test 4: a successful unsafe request drops the cached responses for the
+ * resource, so that the next GET calls the handler again. */
+static void
+t_cache4(void) {
+  renders = 0;
+  CU_ASSERT(t_cache_send(COAP_REQUEST_CODE_GET) ==
+            COAP_RESPONSE_CODE_CONTENT);
+  CU_ASSERT(renders == 1);
+  /* From the cache */
+  CU_ASSERT(t_cache_send(COAP_REQUEST_CODE_GET) ==
+            COAP_RESPONSE_CODE_CONTENT);
+  CU_ASSERT(renders == 1);
+  CU_ASSERT_PTR_NOT_NULL(resource->cache_entries);
+
+  CU_ASSERT(t_cache_send(COAP_REQUEST_CODE_PUT) ==
+            COAP_RESPONSE_CODE_CHANGED);
+  CU_ASSERT_PTR_NULL(resource->cache_entries);
+
+  CU_ASSERT(t_cache_send(COAP_REQUEST_CODE_GET) ==
+            COAP_RESPONSE_CODE_CONTENT);
+  CU_ASSERT(renders == 2);
+
+  t_cache_clear();
+}
+
+static int
+t_cache_tests_create(void) {
+  coap_address_t addr;
+  coap_endpoint_t *ep;
+  coap_packet_t packet;
+  coap_tick_t now;
+
+  ctx = coap_new_context(NULL);
+  if (!ctx)
+    return 1;
+  resource = coap_resource_init(coap_make_str_const("c"),
+                                COAP_RESOURCE_FLAGS_CACHE_RESPONSE);
+  coap_register_handler(resource, COAP_REQUEST_GET, t_hnd_get);
+  coap_register_handler(resource, COAP_REQUEST_PUT, t_hnd_put);
+  coap_add_resource(ctx, resource);
+
+  coap_address_init(&addr);
+  addr.size = sizeof(struct sockaddr_in);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ep = coap_new_endpoint(ctx, &addr, COAP_PROTO_UDP);
+  if (!ep)
+    return 1;
+
+  /* The session is only used to derive the cache-keys */
+  memset(&packet, 0, sizeof(packet));
+  coap_address_init(&packet.addr_info.local);
+  coap_address_copy(&packet.addr_info.local, &ep->bind_addr);
+  coap_address_copy(&packet.addr_info.remote, &addr);
+  coap_address_set_port(&packet.addr_info.remote, 5683);
+  coap_ticks(&now);
+  coap_lock_lock(ctx, return 1);
+  session = coap_endpoint_get_session(ep, &packet, now);
+  coap_lock_unlock(ctx);
+  if (!session)
+    return 1;
+
+  client_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  return client_fd == COAP_INVALID_SOCKET ||
+         connect(client_fd, &ep->bind_addr.addr.sa, ep->bind_addr.size) == -1;
+}
+
+static int
+t_cache_tests_remove(void) {
+  if (client_fd != COAP_INVALID_SOCKET)
+    coap_closesocket(client_fd);
+  coap_free_context(ctx);
+  return 0;
+}
+
+CU_pSuite
+t_init_cache_tests(void) {
+  CU_pSuite suite;
+
+  suite = CU_add_suite("cache", t_cache_tests_create, t_cache_tests_remove);
+  if (!suite) {                        /* signal error */
+    fprintf(stderr, "W: cannot add cache test suite (%s)\n",
+            CU_get_error_msg());
+
+    return NULL;
+  }
+
+#define CACHE_TEST(s,t)                                                \
+  if (!CU_ADD_TEST(s,t)) {                                              \
+    fprintf(stderr, "W: cannot add cache test (%s)\n",                \
+            CU_get_error_msg());                                      \
+  }
+
+  CACHE_TEST(suite, t_cache1);
+  CACHE_TEST(suite, t_cache2);
+  CACHE_TEST(suite, t_cache3);
+  CACHE_TEST(suite, t_cache4);
+
+  return suite;
+}
+#endif /* COAP_SERVER_SUPPORT */
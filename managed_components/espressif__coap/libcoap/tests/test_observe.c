@@ -0,0 +1,480 @@
+/* libcoap unit tests
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+#include "test_common.h"
+#include "test_observe.h"
+
+#if COAP_SERVER_SUPPORT
+#include <stdio.h>
+#include <unistd.h>
+
+#define ReturnIf_CU_ASSERT_PTR_NOT_NULL(value) \
+  CU_ASSERT_PTR_NOT_NULL(value); \
+  if ((void*)value == NULL) return;
+
+/* The observers are plain UDP sockets that the notifications are sent to,
+ * so that what goes out can be checked. */
+static coap_context_t *ctx;
+static coap_resource_t *resource;
+static coap_resource_t *resource_once;
+static coap_session_t *session;
+static coap_fd_t client_fd = COAP_INVALID_SOCKET;
+/* More observers, each with its own session */
+#define T_OBSERVE_OTHERS 2
+static struct {
+  coap_fd_t fd;
+  coap_session_t *session;
+} others[T_OBSERVE_OTHERS];
+static unsigned int renders;
+
+static void
+t_hnd_get(coap_resource_t *r COAP_UNUSED,
+          coap_session_t *s COAP_UNUSED,
+          const coap_pdu_t *request COAP_UNUSED,
+          const coap_string_t *query COAP_UNUSED,
+          coap_pdu_t *response) {
+  renders++;
+  coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+}
+
+/* The response does not depend on the session, so render it once */
+static void
+t_hnd_get_once(coap_resource_t *r COAP_UNUSED,
+               coap_session_t *s COAP_UNUSED,
+               const coap_pdu_t *request COAP_UNUSED,
+               const coap_string_t *query COAP_UNUSED,
+               coap_pdu_t *response) {
+  char buf[16];
+
+  renders++;
+  coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+  snprintf(buf, sizeof(buf), "v%u", renders);
+  coap_add_data(response, strlen(buf), (const uint8_t *)buf);
+}
+
+static coap_subscription_t *
+t_observe_subscribe(coap_resource_t *r, coap_session_t *s_obs, uint8_t tok,
+                    const char *query) {
+  coap_subscription_t *s = NULL;
+  coap_bin_const_t token;
+  coap_pdu_t *request;
+
+  request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_CODE_GET,
+                          0x1000 + tok, 64);
+  if (!request)
+    return NULL;
+  token.length = 1;
+  token.s = &tok;
+  coap_add_token(request, token.length, token.s);
+  coap_add_option(request, COAP_OPTION_OBSERVE, 0, NULL);
+  coap_add_option(request, COAP_OPTION_URI_PATH, r->uri_path->length,
+                  r->uri_path->s);
+  while (query && *query) {
+    /* One Uri-Query option for each attribute */
+    size_t len = strcspn(query, "&");
+
+    coap_add_option(request, COAP_OPTION_URI_QUERY, len,
+                    (const uint8_t *)query);
+    query += query[len] ? len + 1 : len;
+  }
+  coap_lock_lock(ctx, goto finish);
+  s = coap_add_observer(r, s_obs, &token, request);
+  coap_lock_unlock(ctx);
+finish:
+  coap_delete_pdu(request);
+  return s;
+}
+
+static void
+t_observe_unsubscribe(coap_resource_t *r, coap_session_t *s_obs, uint8_t tok) {
+  coap_bin_const_t token;
+
+  token.length = 1;
+  token.s = &tok;
+  coap_lock_lock(ctx, return);
+  coap_delete_observer(r, s_obs, &token);
+  coap_lock_unlock(ctx);
+}
+
+/*
+ * Returns the number of notifications that have reached the client, keeping
+ * the Observe value of the last one in @p observe.
+ */
+static int
+t_observe_recv(unsigned int *observe) {
+  uint8_t buf[256];
+  ssize_t len;
+  int count = 0;
+
+  while ((len = recv(client_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    coap_pdu_t *pdu = coap_pdu_init(0, 0, 0, len);
+    coap_opt_iterator_t opt_iter;
+    coap_opt_t *option;
+
+    if (pdu && coap_pdu_parse(COAP_PROTO_UDP, buf, len, pdu)) {
+      option = coap_check_option(pdu, COAP_OPTION_OBSERVE, &opt_iter);
+      if (option)
+        *observe = coap_decode_var_bytes(coap_opt_value(option),
+                                         coap_opt_length(option));
+      count++;
+    }
+    coap_delete_pdu(pdu);
+  }
+  return count;
+}
+
+/* Runs the server until @p count renders have been done, or for a second */
+static void
+t_observe_wait(unsigned int count) {
+  coap_tick_t start, now;
+
+  coap_ticks(&start);
+  now = start;
+  while (renders < count && now - start < COAP_TICKS_PER_SECOND) {
+    coap_io_process(ctx, 10);
+    coap_ticks(&now);
+  }
+}
+
+/* Test 1: with pmax and no change, the resource is left alone until the
+ * pmax deadline, when a notification goes out with a new Observe value. */
+static void
+t_observe1(void) {
+  coap_subscription_t *obs;
+  unsigned int observe = 0;
+  unsigned int last;
+  int i;
+
+  t_observe_recv(&observe);
+  obs = t_observe_subscribe(resource, session, 1, "pmax=0.05");
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(obs);
+  CU_ASSERT(obs->cond & COAP_OBS_COND_PMAX);
+  renders = 0;
+  last = resource->observe;
+
+  for (i = 0; i < 3; i++) {
+    coap_check_notify(ctx);
+    CU_ASSERT(ctx->observe_pending == 0);
+    CU_ASSERT(ctx->observe_due == obs->last_notify + obs->pmax);
+  }
+  CU_ASSERT(renders == 0);
+
+  t_observe_wait(1);
+  CU_ASSERT(renders == 1);
+  CU_ASSERT(resource->observe != last);
+  CU_ASSERT(obs->last_observe == resource->observe);
+  CU_ASSERT(t_observe_recv(&observe) == 1);
+  CU_ASSERT(observe == resource->observe);
+  /* Now waiting for the next deadline */
+  CU_ASSERT(ctx->observe_pending == 0);
+  CU_ASSERT(obs->dirty);
+  CU_ASSERT(obs->notify_due == obs->last_notify + obs->pmax);
+
+  t_observe_unsubscribe(resource, session, 1);
+}
+
+/* Test 2: changes within pmin of the last notification are held back and
+ * then sent as one notification, without walking the resource meanwhile. */
+static void
+t_observe2(void) {
+  coap_subscription_t *obs;
+  unsigned int observe = 0;
+  int i;
+
+  t_observe_recv(&observe);
+  obs = t_observe_subscribe(resource, session, 2, "pmin=0.05");
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(obs);
+  CU_ASSERT(obs->cond & COAP_OBS_COND_PMIN);
+  renders = 0;
+
+  for (i = 0; i < 3; i++)
+    coap_resource_notify_observers(resource, NULL);
+  coap_check_notify(ctx);
+  CU_ASSERT(renders == 0);
+  CU_ASSERT(obs->dirty);
+  CU_ASSERT(obs->notify_due == obs->last_notify + obs->pmin);
+  CU_ASSERT(ctx->observe_pending == 0);
+  CU_ASSERT(ctx->observe_due == obs->notify_due);
+  coap_check_notify(ctx);
+  CU_ASSERT(renders == 0);
+
+  t_observe_wait(1);
+  CU_ASSERT(renders == 1);
+  CU_ASSERT(t_observe_recv(&observe) == 1);
+  CU_ASSERT(observe == resource->observe);
+  CU_ASSERT(obs->last_observe == resource->observe);
+  CU_ASSERT(!obs->dirty);
+  CU_ASSERT(ctx->observe_pending == 0);
+  CU_ASSERT(ctx->observe_due == 0);
+
+  t_observe_unsubscribe(resource, session, 2);
+}
+
+/* Test 3: an observer held back again keeps its place in dirty_subscribers,
+ * while one that is sent and then held back for pmax goes to the end (after
+ * the other one) and is not tried again in the same pass. */
+static void
+t_observe3(void) {
+  coap_subscription_t *obs_x;
+  coap_subscription_t *obs_y;
+  unsigned int observe = 0;
+
+  t_observe_recv(&observe);
+  /* y is held back for pmax from the start */
+  obs_y = t_observe_subscribe(resource, session, 4, "pmin=0.03&pmax=0.5");
+  obs_x = t_observe_subscribe(resource, session, 3, "pmin=1");
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(obs_x);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(obs_y);
+  CU_ASSERT(obs_y->cond & COAP_OBS_COND_PMAX);
+  renders = 0;
+
+  /* Both held back for pmin, y keeping its place ahead of x */
+  coap_resource_notify_observers(resource, NULL);
+  coap_check_notify(ctx);
+  CU_ASSERT(renders == 0);
+  CU_ASSERT(resource->dirty_subscribers == obs_y);
+  CU_ASSERT(obs_y->dirty_next == obs_x);
+  CU_ASSERT(obs_y->notify_due == obs_y->last_notify + obs_y->pmin);
+
+  /* y goes out, x is held back again */
+  t_observe_wait(1);
+  CU_ASSERT(renders == 1);
+  CU_ASSERT(t_observe_recv(&observe) == 1);
+  CU_ASSERT(obs_y->last_observe == resource->observe);
+  CU_ASSERT(resource->dirty_subscribers == obs_x);
+  CU_ASSERT(obs_x->dirty_next == obs_y);
+  CU_ASSERT_PTR_NULL(obs_y->dirty_next);
+  CU_ASSERT(obs_y->notify_due == obs_y->last_notify + obs_y->pmax);
+  CU_ASSERT(obs_x->notify_due == obs_x->last_notify + obs_x->pmin);
+
+  t_observe_unsubscribe(resource, session, 3);
+  t_observe_unsubscribe(resource, session, 4);
+}
+
+/*
+ * Returns 1 if the next notification to reach @p fd has token @p tok and the
+ * current Observe value, keeping its payload in @p data (of @p size).
+ */
+static int
+t_observe_recv_data(coap_fd_t fd, uint8_t tok, char *data, size_t size) {
+  uint8_t buf[256];
+  coap_pdu_t *pdu;
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t *option;
+  coap_bin_const_t token;
+  const uint8_t *rdata;
+  size_t len;
+  ssize_t rlen;
+  int ok = 0;
+
+  rlen = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+  if (rlen <= 0)
+    return 0;
+  pdu = coap_pdu_init(0, 0, 0, rlen);
+  if (pdu && coap_pdu_parse(COAP_PROTO_UDP, buf, rlen, pdu) &&
+      coap_get_data(pdu, &len, &rdata) && len < size) {
+    token = coap_pdu_get_token(pdu);
+    option = coap_check_option(pdu, COAP_OPTION_OBSERVE, &opt_iter);
+    ok = token.length == 1 && token.s[0] == tok && option &&
+         coap_decode_var_bytes(coap_opt_value(option),
+                               coap_opt_length(option)) ==
+         resource_once->observe;
+    memcpy(data, rdata, len);
+    data[len] = '\0';
+  }
+  coap_delete_pdu(pdu);
+  return ok;
+}
+
+/* Test 4: with COAP_RESOURCE_FLAGS_NOTIFY_RENDER_ONCE, the handler is called
+ * once for all the observers that made the same request, and each of them
+ * gets the same notification with its own token.  A different request is
+ * rendered for separately. */
+static void
+t_observe4(void) {
+  char data[T_OBSERVE_OTHERS][16] = { "" };
+  char first[16] = "";
+  char other[16] = "";
+  unsigned int observe = 0;
+  int i;
+
+  t_observe_recv(&observe);
+  /*
+   * Asking for something different.  The newest subscriber is notified
+   * first, and only the notification for its request is shared, so this one
+   * goes last.
+   */
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(t_observe_subscribe(resource_once, session,
+                                                      9, "x"));
+  for (i = 0; i < T_OBSERVE_OTHERS; i++) {
+    ReturnIf_CU_ASSERT_PTR_NOT_NULL(t_observe_subscribe(resource_once,
+                                                        others[i].session,
+                                                        6 + i, NULL));
+  }
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(t_observe_subscribe(resource_once, session,
+                                                      5, NULL));
+  renders = 0;
+
+  coap_resource_notify_observers(resource_once, NULL);
+  coap_check_notify(ctx);
+  CU_ASSERT(renders == 2);
+  /* Not kept once all have been sent */
+  CU_ASSERT_PTR_NULL(resource_once->notify_pdu);
+
+  CU_ASSERT(t_observe_recv_data(client_fd, 5, first, sizeof(first)));
+  CU_ASSERT(t_observe_recv_data(client_fd, 9, other, sizeof(other)));
+  CU_ASSERT(t_observe_recv(&observe) == 0);
+  CU_ASSERT(strcmp(first, other) != 0);
+  for (i = 0; i < T_OBSERVE_OTHERS; i++) {
+    CU_ASSERT(t_observe_recv_data(others[i].fd, 6 + i, data[i],
+                                  sizeof(data[i])));
+    CU_ASSERT(strcmp(data[i], first) == 0);
+  }
+
+  t_observe_unsubscribe(resource_once, session, 5);
+  t_observe_unsubscribe(resource_once, session, 9);
+  for (i = 0; i < T_OBSERVE_OTHERS; i++)
+    t_observe_unsubscribe(resource_once, others[i].session, 6 + i);
+}
+
+/* Test 5: conditional attribute values that are not plain decimal numbers
+ * are ignored, and very long periods are capped. */
+static void
+t_observe5(void) {
+  static const char *bad[] = { "pmin=nan", "pmax=inf", "pmax=-inf",
+                               "pmax=1e300", "pmin=0x10", "pmax=1.2.3",
+                               "pmin=", "pmax=-", "gt=nan", "st=inf"
+                             };
+  coap_subscription_t *obs;
+  size_t i;
+
+  for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    obs = t_observe_subscribe(resource, session, 10, bad[i]);
+    ReturnIf_CU_ASSERT_PTR_NOT_NULL(obs);
+    CU_ASSERT(obs->cond == 0);
+    t_observe_unsubscribe(resource, session, 10);
+  }
+
+  obs = t_observe_subscribe(resource, session, 10,
+                            "pmin=99999999999999999999&pmax=1000000.5");
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(obs);
+  CU_ASSERT(obs->cond & COAP_OBS_COND_PMIN);
+  CU_ASSERT(obs->pmin ==
+            (coap_tick_t)COAP_OBS_COND_MAX_PERIOD * COAP_TICKS_PER_SECOND);
+  /* Both capped, so pmax is no longer greater than pmin */
+  CU_ASSERT(!(obs->cond & COAP_OBS_COND_PMAX));
+  t_observe_unsubscribe(resource, session, 10);
+
+  obs = t_observe_subscribe(resource, session, 10, "pmin=-1&pmax=0.25&gt=-2.5");
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(obs);
+  CU_ASSERT(obs->cond == (COAP_OBS_COND_PMAX | COAP_OBS_COND_GT));
+  CU_ASSERT(obs->pmax == COAP_TICKS_PER_SECOND / 4);
+  CU_ASSERT(obs->gt == -2.5);
+  t_observe_unsubscribe(resource, session, 10);
+}
+
+static int
+t_observe_tests_create(void) {
+  coap_address_t addr;
+  coap_address_t client_addr;
+  coap_endpoint_t *ep;
+  coap_packet_t packet;
+  coap_tick_t now;
+  int i;
+
+  for (i = 0; i < T_OBSERVE_OTHERS; i++)
+    others[i].fd = COAP_INVALID_SOCKET;
+  ctx = coap_new_context(NULL);
+  if (!ctx)
+    return 1;
+  resource = coap_resource_init(coap_make_str_const("t"), 0);
+  coap_register_handler(resource, COAP_REQUEST_GET, t_hnd_get);
+  coap_resource_set_get_observable(resource, 1);
+  coap_add_resource(ctx, resource);
+  resource_once = coap_resource_init(coap_make_str_const("o"),
+                                     COAP_RESOURCE_FLAGS_NOTIFY_RENDER_ONCE);
+  coap_register_handler(resource_once, COAP_REQUEST_GET, t_hnd_get_once);
+  coap_resource_set_get_observable(resource_once, 1);
+  coap_add_resource(ctx, resource_once);
+
+  coap_address_init(&addr);
+  addr.size = sizeof(struct sockaddr_in);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ep = coap_new_endpoint(ctx, &addr, COAP_PROTO_UDP);
+  if (!ep)
+    return 1;
+
+  memset(&packet, 0, sizeof(packet));
+  coap_address_init(&packet.addr_info.local);
+  coap_address_copy(&packet.addr_info.local, &ep->bind_addr);
+  coap_ticks(&now);
+  for (i = -1; i < T_OBSERVE_OTHERS; i++) {
+    coap_fd_t *fd = i < 0 ? &client_fd : &others[i].fd;
+    coap_session_t **s = i < 0 ? &session : &others[i].session;
+
+    client_addr = addr;
+    *fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (*fd == COAP_INVALID_SOCKET ||
+        bind(*fd, &client_addr.addr.sa, client_addr.size) == -1 ||
+        getsockname(*fd, &client_addr.addr.sa, &client_addr.size) == -1)
+      return 1;
+    coap_address_copy(&packet.addr_info.remote, &client_addr);
+    coap_lock_lock(ctx, return 1);
+    *s = coap_endpoint_get_session(ep, &packet, now);
+    coap_lock_unlock(ctx);
+    if (*s == NULL)
+      return 1;
+  }
+  return 0;
+}
+
+static int
+t_observe_tests_remove(void) {
+  int i;
+
+  if (client_fd != COAP_INVALID_SOCKET)
+    coap_closesocket(client_fd);
+  for (i = 0; i < T_OBSERVE_OTHERS; i++) {
+    if (others[i].fd != COAP_INVALID_SOCKET)
+      coap_closesocket(others[i].fd);
+  }
+  coap_free_context(ctx);
+  return 0;
+}
+
+CU_pSuite
+t_init_observe_tests(void) {
+  CU_pSuite suite;
+
+  suite = CU_add_suite("observe",
+                       t_observe_tests_create, t_observe_tests_remove);
+  if (!suite) {                        /* signal error */
+    fprintf(stderr, "W: cannot add observe test suite (%s)\n",
+            CU_get_error_msg());
+
+    return NULL;
+  }
+
+#define OBSERVE_TEST(s,t)                                              \
+  if (!CU_ADD_TEST(s,t)) {                                              \
+    fprintf(stderr, "W: cannot add observe test (%s)\n",              \
+            CU_get_error_msg());                                      \
+  }
+
+  OBSERVE_TEST(suite, t_observe1);
+  OBSERVE_TEST(suite, t_observe2);
+  OBSERVE_TEST(suite, t_observe3);
+  OBSERVE_TEST(suite, t_observe4);
+  OBSERVE_TEST(suite, t_observe5);
+
+  return suite;
+}
+#endif /* COAP_SERVER_SUPPORT */
@@ -328,6 +328,51 @@ t_parse_pdu17(void) {
   CU_ASSERT(result == 0);
 }
 
+#ifndef WITH_LWIP
+static void
+t_parse_pdu18(void) {
+  uint8_t teststr[] = {
+    0x42, 0x01, 0x12, 0x34, 't', 'k', 0xb4, 't', 'e', 'm', 'p',
+    0xff, '2', '1'
+  };
+  uint8_t copy[sizeof(teststr)];
+  coap_pdu_t testpdu;
+  coap_string_t *uri_path;
+  size_t len;
+  const uint8_t *data;
+
+  memcpy(copy, teststr, sizeof(teststr));
+  CU_ASSERT(coap_pdu_parse_borrowed(COAP_PROTO_UDP, teststr, sizeof(teststr),
+                                    64, &testpdu) == 1);
+
+  /* The PDU is parsed in place */
+  CU_ASSERT(testpdu.borrowed == 1);
+  CU_ASSERT_PTR_EQUAL(testpdu.token, teststr + 4);
+  CU_ASSERT(testpdu.type == COAP_MESSAGE_CON);
+  CU_ASSERT(testpdu.code == COAP_REQUEST_CODE_GET);
+  CU_ASSERT(testpdu.mid == 0x1234);
+  CU_ASSERT(coap_get_data(&testpdu, &len, &data));
+  CU_ASSERT(len == 2 && data == teststr + 12);
+
+  /* Growing the PDU copies it out, leaving the caller's buffer alone */
+  CU_ASSERT(coap_update_option(&testpdu, COAP_OPTION_URI_PATH, 11,
+                               (const uint8_t *)"temperature") != 0);
+  CU_ASSERT(testpdu.borrowed == 0);
+  CU_ASSERT(memcmp(teststr, copy, sizeof(teststr)) == 0);
+  CU_ASSERT(testpdu.max_hdr_size == COAP_PDU_MAX_TCP_HEADER_SIZE);
+  uri_path = coap_get_uri_path(&testpdu);
+  CU_ASSERT(uri_path && uri_path->length == 11 &&
+            memcmp(uri_path->s, "temperature", 11) == 0);
+  coap_delete_string(uri_path);
+  CU_ASSERT(coap_get_data(&testpdu, &len, &data));
+  CU_ASSERT(len == 2 && memcmp(data, "21", 2) == 0);
+  CU_ASSERT(coap_pdu_encode_header(&testpdu, COAP_PROTO_UDP) == 4);
+  CU_ASSERT(memcmp(testpdu.token - 4, teststr, 4) == 0);
+
+  coap_pdu_release_borrowed(&testpdu);
+}
+#endif /* ! WITH_LWIP */
+
 /************************************************************************
  ** PDU encoder
  ************************************************************************/
@@ -1457,6 +1502,83 @@ t_encode_pdu24(void) {
   }
 }
 
+/* Build up a large PDU with the slab allocator in use, so its buffer moves
+ * through several size classes and then on to the heap. */
+static void
+t_encode_pdu25(void) {
+  coap_pdu_t *testpdu;
+  uint8_t data[2000];
+  size_t len;
+  const uint8_t *rdata;
+  size_t i;
+
+  if (!coap_memory_set_slab(1))
+    return;
+  CU_ASSERT(coap_memory_slab_reserve(COAP_PDU, sizeof(coap_pdu_t), 4) == 1);
+  CU_ASSERT(coap_memory_slab_reserve(COAP_PDU, 100000, 4) == 0);
+
+  for (i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)i;
+  testpdu = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_CODE_PUT, 0x1234,
+                          sizeof(data) + 512);
+  CU_ASSERT_PTR_NOT_NULL(testpdu);
+  if (testpdu) {
+    CU_ASSERT(coap_add_token(testpdu, 4, (const uint8_t *)"abcd") == 1);
+    for (i = 0; i < 40; i++) {
+      CU_ASSERT(coap_add_option(testpdu, COAP_OPTION_URI_PATH, 4,
+                                (const uint8_t *)"path") == 5);
+    }
+    CU_ASSERT(coap_add_data(testpdu, sizeof(data), data) == 1);
+    CU_ASSERT(coap_get_data(testpdu, &len, &rdata) == 1);
+    CU_ASSERT(len == sizeof(data) && memcmp(rdata, data, len) == 0);
+    CU_ASSERT(memcmp(testpdu->token, "abcd", 4) == 0);
+    coap_delete_pdu(testpdu);
+  }
+  coap_memory_set_slab(0);
+}
+
+/* Reserve room up front so that building the PDU does not move its buffer,
+ * and check capacity is kept once the buffer has grown. */
+static void
+t_encode_pdu26(void) {
+  coap_pdu_t *testpdu;
+  coap_optlist_t *optlist = NULL;
+  uint8_t data[1000];
+  uint8_t *token;
+  size_t i;
+
+  memset(data, 'x', sizeof(data));
+  testpdu = coap_pdu_init(COAP_MESSAGE_CON, COAP_RESPONSE_CODE(205), 0x1234,
+                          1400);
+  CU_ASSERT_PTR_NOT_NULL(testpdu);
+  if (!testpdu)
+    return;
+  CU_ASSERT(coap_add_token(testpdu, 4, (const uint8_t *)"abcd") == 1);
+  for (i = 0; i < 8; i++) {
+    coap_insert_optlist(&optlist,
+                        coap_new_optlist(COAP_OPTION_LOCATION_PATH, 40,
+                                         data));
+  }
+  /* 8 * 42 bytes of options is more than the initial buffer */
+  CU_ASSERT(coap_add_optlist_pdu(testpdu, &optlist) == 1);
+  CU_ASSERT(testpdu->alloc_size >= testpdu->used_size);
+  CU_ASSERT(testpdu->used_size == 4 + 8 * 42);
+  coap_delete_optlist(optlist);
+
+  CU_ASSERT(coap_pdu_reserve(testpdu, testpdu->used_size + 1 + sizeof(data)) == 1);
+  token = testpdu->token;
+  CU_ASSERT(coap_add_data(testpdu, sizeof(data), data) == 1);
+  CU_ASSERT(testpdu->token == token);
+  CU_ASSERT(testpdu->used_size == 4 + 8 * 42 + 1 + sizeof(data));
+
+  /* Capped at max_size, and never shrinks */
+  CU_ASSERT(coap_pdu_reserve(testpdu, 100000) == 1);
+  CU_ASSERT(testpdu->alloc_size == 1400);
+  CU_ASSERT(coap_pdu_reserve(testpdu, 10) == 1);
+  CU_ASSERT(testpdu->alloc_size == 1400);
+  coap_delete_pdu(testpdu);
+}
+
 static int
 t_pdu_tests_create(void) {
   pdu = coap_pdu_init(0, 0, 0, COAP_DEFAULT_MTU);
@@ -1505,6 +1627,9 @@ t_init_pdu_tests(void) {
   PDU_TEST(suite[0], t_parse_pdu15);
   PDU_TEST(suite[0], t_parse_pdu16);
   PDU_TEST(suite[0], t_parse_pdu17);
+#ifndef WITH_LWIP
+  PDU_TEST(suite[0], t_parse_pdu18);
+#endif /* ! WITH_LWIP */
 
   suite[1] = CU_add_suite("pdu encoder", t_pdu_tests_create, t_pdu_tests_remove);
   if (suite[1]) {
@@ -1537,6 +1662,8 @@ t_init_pdu_tests(void) {
     PDU_ENCODER_TEST(suite[1], t_encode_pdu22);
     PDU_ENCODER_TEST(suite[1], t_encode_pdu23);
     PDU_ENCODER_TEST(suite[1], t_encode_pdu24);
+    PDU_ENCODER_TEST(suite[1], t_encode_pdu25);
+    PDU_ENCODER_TEST(suite[1], t_encode_pdu26);
 
   } else                         /* signal error */
     fprintf(stderr, "W: cannot add pdu parser test suite (%s)\n",
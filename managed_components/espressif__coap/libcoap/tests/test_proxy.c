@@ -0,0 +1,439 @@
+/* libcoap unit tests
+ *
+ * Copyright (C) 2025 Olaf Bergmann <bergmann@tzi.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * This file is part of the CoAP library libcoap. Please see
+ * README for terms of use.
+ */
+
+#include "test_common.h"
+#include "test_proxy.h"
+
+#if COAP_PROXY_SUPPORT && COAP_SERVER_SUPPORT && COAP_CLIENT_SUPPORT
+#include <stdio.h>
+#include <unistd.h>
+
+#define ReturnIf_CU_ASSERT_PTR_NOT_NULL(value) \
+  CU_ASSERT_PTR_NOT_NULL(value); \
+  if ((void*)value == NULL) return;
+
+/* The clients and the upstream server are plain UDP sockets, so that what
+ * the proxy sends each of them can be checked.  The upstream responses are
+ * handed straight to coap_proxy_forward_response(). */
+#define T_PROXY_CLIENTS 3
+
+static coap_context_t *ctx;
+static coap_resource_t *resource;
+static coap_fd_t upstream_fd = COAP_INVALID_SOCKET;
+static struct {
+  coap_fd_t fd;
+  coap_session_t *session;
+} clients[T_PROXY_CLIENTS];
+static char upstream_uri[32];
+static coap_proxy_server_t server;
+static coap_proxy_server_list_t server_list;
+
+/*
+ * Has client @p c send a NON GET for @p path with token @p tok (and Observe
+ * @p observe if not -1) through the proxy.  Returns the response to the
+ * client, which has code 0 if the response is to come later.
+ */
+static coap_pdu_t *
+t_proxy_request(int c, uint8_t tok, const char *path, int observe) {
+  coap_pdu_t *request;
+  coap_pdu_t *response;
+  uint8_t buf[4];
+
+  request = coap_pdu_init(COAP_MESSAGE_NON, COAP_REQUEST_CODE_GET,
+                          0x3000 + tok, 64);
+  response = coap_pdu_init(COAP_MESSAGE_NON, 0, 0x3000 + tok, 256);
+  if (!request || !response) {
+    coap_delete_pdu(request);
+    coap_delete_pdu(response);
+    return NULL;
+  }
+  coap_add_token(request, 1, &tok);
+  coap_add_token(response, 1, &tok);
+  if (observe != -1)
+    coap_add_option(request, COAP_OPTION_OBSERVE,
+                    coap_encode_var_safe(buf, sizeof(buf), observe), buf);
+  coap_add_option(request, COAP_OPTION_URI_PATH, strlen(path),
+                  (const uint8_t *)path);
+  if (!coap_proxy_forward_request(clients[c].session, request, response,
+                                  resource, NULL, &server_list)) {
+    coap_delete_pdu(response);
+    response = NULL;
+  }
+  coap_delete_pdu(request);
+  return response;
+}
+
+/*
+ * Returns the next PDU that has reached @p fd, waiting up to a second for it
+ * if @p wait, else NULL.
+ */
+static coap_pdu_t *
+t_proxy_recv(coap_fd_t fd, int wait) {
+  uint8_t buf[256];
+  coap_tick_t start, now;
+  ssize_t len;
+
+  coap_ticks(&start);
+  now = start;
+  do {
+    len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (len > 0) {
+      coap_pdu_t *pdu = coap_pdu_init(0, 0, 0, len);
+
+      if (pdu && coap_pdu_parse(COAP_PROTO_UDP, buf, len, pdu))
+        return pdu;
+      coap_delete_pdu(pdu);
+      return NULL;
+    }
+    if (!wait)
+      break;
+    coap_io_process(ctx, 10);
+    coap_ticks(&now);
+  } while (now - start < COAP_TICKS_PER_SECOND);
+  return NULL;
+}
+
+/* Returns 1 if the next PDU to reach client @p c is a 2.05 for token @p tok
+ * carrying @p data */
+static int
+t_proxy_check_client(int c, uint8_t tok, const char *data) {
+  coap_pdu_t *pdu = t_proxy_recv(clients[c].fd, 1);
+  coap_bin_const_t token;
+  const uint8_t *rdata;
+  size_t len;
+  int ok;
+
+  if (!pdu)
+    return 0;
+  token = coap_pdu_get_token(pdu);
+  ok = coap_pdu_get_code(pdu) == COAP_RESPONSE_CODE_CONTENT &&
+       token.length == 1 && token.s[0] == tok &&
+       coap_get_data(pdu, &len, &rdata) &&
+       len == strlen(data) && memcmp(rdata, data, len) == 0;
+  coap_delete_pdu(pdu);
+  return ok;
+}
+
+/* Returns the number of requests that have reached the upstream server (they
+ * are sent as they are forwarded), keeping the token of the last one in
+ * @p token */
+static int
+t_proxy_upstream(coap_binary_t *token) {
+  coap_pdu_t *pdu;
+  int count = 0;
+
+  while ((pdu = t_proxy_recv(upstream_fd, 0)) != NULL) {
+    coap_bin_const_t tok = coap_pdu_get_token(pdu);
+
+    if (token && tok.length <= 8) {
+      memcpy(token->s, tok.s, tok.length);
+      token->length = tok.length;
+    }
+    coap_delete_pdu(pdu);
+    count++;
+  }
+  return count;
+}
+
+/* Hands the proxy an upstream 2.05 for @p token (with Observe @p observe if
+ * not -1) carrying @p data */
+static coap_response_t
+t_proxy_respond(const coap_binary_t *token, int observe, const char *data) {
+  coap_proxy_list_t *proxy_entry = ctx->proxy_list;
+  coap_response_t ret = COAP_RESPONSE_OK;
+  coap_pdu_t *pdu;
+  uint8_t buf[4];
+
+  if (!proxy_entry || !proxy_entry->ongoing)
+    return COAP_RESPONSE_OK;
+  pdu = coap_pdu_init(COAP_MESSAGE_NON, COAP_RESPONSE_CODE_CONTENT, 0x4000,
+                      256);
+  if (!pdu)
+    return COAP_RESPONSE_OK;
+  coap_add_token(pdu, token->length, token->s);
+  if (observe != -1)
+    coap_add_option(pdu, COAP_OPTION_OBSERVE,
+                    coap_encode_var_safe(buf, sizeof(buf), observe), buf);
+  coap_add_data(pdu, strlen(data), (const uint8_t *)data);
+  ret = coap_proxy_forward_response(proxy_entry->ongoing, pdu, NULL);
+  coap_delete_pdu(pdu);
+  return ret;
+}
+
+/* Returns the request info of client @p c that is using upstream @p token */
+static coap_proxy_req_t *
+t_proxy_find_req(int c, const coap_binary_t *token) {
+  coap_proxy_list_t *proxy_entry = ctx->proxy_list;
+  size_t j;
+
+  for (j = 0; proxy_entry && j < proxy_entry->req_count; j++) {
+    coap_proxy_req_t *proxy_req = &proxy_entry->req_list[j];
+
+    if (proxy_req->incoming == clients[c].session &&
+        coap_binary_equal(proxy_req->token_used, token))
+      return proxy_req;
+  }
+  return NULL;
+}
+
+/* Drops anything left over from a test */
+static void
+t_proxy_clear(void) {
+  int c;
+
+  coap_lock_lock(ctx, return);
+  for (c = 0; c < T_PROXY_CLIENTS; c++)
+    coap_proxy_remove_association(clients[c].session, 0);
+  coap_lock_unlock(ctx);
+  for (c = 0; c < T_PROXY_CLIENTS; c++) {
+    coap_pdu_t *pdu;
+
+    while ((pdu = t_proxy_recv(clients[c].fd, 0)) != NULL)
+      coap_delete_pdu(pdu);
+  }
+  t_proxy_upstream(NULL);
+}
+
+/* Test 1: a second identical request from another client waits on the
+ * request already sent upstream, and the one response goes back to both. */
+static void
+t_proxy1(void) {
+  uint8_t tok_buf[8];
+  coap_binary_t token = { 0, tok_buf };
+  coap_proxy_req_t *req_a, *req_b;
+  coap_pdu_t *response;
+
+  response = t_proxy_request(0, 0x11, "p", -1);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(response);
+  CU_ASSERT(coap_pdu_get_code(response) == 0);
+  coap_delete_pdu(response);
+  CU_ASSERT(t_proxy_upstream(&token) == 1);
+
+  response = t_proxy_request(1, 0x22, "p", -1);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(response);
+  CU_ASSERT(coap_pdu_get_code(response) == 0);
+  coap_delete_pdu(response);
+  /* Nothing more sent upstream */
+  CU_ASSERT(t_proxy_upstream(NULL) == 0);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->proxy_list);
+  CU_ASSERT(ctx->proxy_list->req_count == 2);
+  req_a = t_proxy_find_req(0, &token);
+  req_b = t_proxy_find_req(1, &token);
+  CU_ASSERT_PTR_NOT_NULL(req_a);
+  CU_ASSERT_PTR_NOT_NULL(req_b);
+
+  CU_ASSERT(t_proxy_respond(&token, -1, "hi") == COAP_RESPONSE_OK);
+  CU_ASSERT(t_proxy_check_client(0, 0x11, "hi"));
+  CU_ASSERT(t_proxy_check_client(1, 0x22, "hi"));
+  /* Both are done with */
+  CU_ASSERT(ctx->proxy_list->req_count == 0);
+
+  t_proxy_clear();
+}
+
+/* Test 2: observers share one upstream observation.  When the observer
+ * holding the last notification cancels, the others keep getting the
+ * notifications and one that joins later still gets the last one at once. */
+static void
+t_proxy2(void) {
+  uint8_t tok_buf[8];
+  coap_binary_t token = { 0, tok_buf };
+  coap_proxy_req_t *proxy_req;
+  coap_pdu_t *response;
+  const uint8_t *data;
+  size_t len;
+
+  response = t_proxy_request(0, 0x31, "o", COAP_OBSERVE_ESTABLISH);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(response);
+  coap_delete_pdu(response);
+  CU_ASSERT(t_proxy_upstream(&token) == 1);
+  response = t_proxy_request(1, 0x32, "o", COAP_OBSERVE_ESTABLISH);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(response);
+  /* No notification yet to pass on */
+  CU_ASSERT(coap_pdu_get_code(response) == 0);
+  coap_delete_pdu(response);
+  CU_ASSERT(t_proxy_upstream(NULL) == 0);
+
+  CU_ASSERT(t_proxy_respond(&token, 2, "one") == COAP_RESPONSE_OK);
+  CU_ASSERT(t_proxy_check_client(0, 0x31, "one"));
+  CU_ASSERT(t_proxy_check_client(1, 0x32, "one"));
+  proxy_req = t_proxy_find_req(0, &token);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(proxy_req);
+  CU_ASSERT_PTR_NOT_NULL(proxy_req->last_pdu);
+
+  /* The first observer cancels, handing the last notification on */
+  response = t_proxy_request(0, 0x31, "o", COAP_OBSERVE_CANCEL);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(response);
+  coap_delete_pdu(response);
+  CU_ASSERT_PTR_NULL(t_proxy_find_req(0, &token));
+  proxy_req = t_proxy_find_req(1, &token);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(proxy_req);
+  CU_ASSERT_PTR_NOT_NULL(proxy_req->last_pdu);
+  /* Only the deregistration itself goes upstream */
+  CU_ASSERT(t_proxy_upstream(NULL) == 1);
+
+  /* A new observer gets the last notification piggybacked */
+  response = t_proxy_request(2, 0x33, "o", COAP_OBSERVE_ESTABLISH);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(response);
+  CU_ASSERT(coap_pdu_get_code(response) == COAP_RESPONSE_CODE_CONTENT);
+  CU_ASSERT(coap_get_data(response, &len, &data) &&
+            len == 3 && memcmp(data, "one", 3) == 0);
+  coap_delete_pdu(response);
+  CU_ASSERT(t_proxy_upstream(NULL) == 0);
+
+  CU_ASSERT(t_proxy_respond(&token, 3, "two") == COAP_RESPONSE_OK);
+  CU_ASSERT(t_proxy_check_client(1, 0x32, "two"));
+  CU_ASSERT(t_proxy_check_client(2, 0x33, "two"));
+  response = t_proxy_recv(clients[0].fd, 0);
+  CU_ASSERT_PTR_NULL(response);
+  coap_delete_pdu(response);
+
+  t_proxy_clear();
+}
+
+/* Test 3: a notification that no client is observing is rejected, so that
+ * the upstream observation ends, while any other unknown response is not. */
+static void
+t_proxy3(void) {
+  uint8_t tok_buf[8];
+  coap_binary_t token = { 0, tok_buf };
+  uint8_t unknown_buf[] = { 0xde, 0xad };
+  coap_binary_t unknown = { sizeof(unknown_buf), unknown_buf };
+  coap_pdu_t *response;
+
+  /* Make sure that the proxy entry is there */
+  response = t_proxy_request(0, 0x41, "n", COAP_OBSERVE_ESTABLISH);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(response);
+  coap_delete_pdu(response);
+  CU_ASSERT(t_proxy_upstream(&token) == 1);
+
+  CU_ASSERT(t_proxy_respond(&unknown, 5, "x") == COAP_RESPONSE_FAIL);
+  CU_ASSERT(t_proxy_respond(&unknown, -1, "x") == COAP_RESPONSE_OK);
+
+  /* Still observed */
+  CU_ASSERT(t_proxy_respond(&token, 2, "y") == COAP_RESPONSE_OK);
+  CU_ASSERT(t_proxy_check_client(0, 0x41, "y"));
+
+  /* No longer observed */
+  response = t_proxy_request(0, 0x41, "n", COAP_OBSERVE_CANCEL);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(response);
+  coap_delete_pdu(response);
+  CU_ASSERT_PTR_NULL(t_proxy_find_req(0, &token));
+  CU_ASSERT(t_proxy_respond(&token, 3, "z") == COAP_RESPONSE_FAIL);
+  response = t_proxy_recv(clients[0].fd, 0);
+  CU_ASSERT_PTR_NULL(response);
+  coap_delete_pdu(response);
+
+  t_proxy_clear();
+}
+
+static int
+t_proxy_tests_create(void) {
+  coap_address_t addr;
+  coap_address_t client_addr;
+  coap_endpoint_t *ep;
+  coap_packet_t packet;
+  coap_tick_t now;
+  int c;
+
+  for (c = 0; c < T_PROXY_CLIENTS; c++)
+    clients[c].fd = COAP_INVALID_SOCKET;
+  ctx = coap_new_context(NULL);
+  if (!ctx)
+    return 1;
+  resource = coap_resource_unknown_init(NULL);
+  coap_add_resource(ctx, resource);
+
+  coap_address_init(&addr);
+  addr.size = sizeof(struct sockaddr_in);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ep = coap_new_endpoint(ctx, &addr, COAP_PROTO_UDP);
+  if (!ep)
+    return 1;
+
+  /* The upstream server */
+  upstream_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  client_addr = addr;
+  if (upstream_fd == COAP_INVALID_SOCKET ||
+      bind(upstream_fd, &client_addr.addr.sa, client_addr.size) == -1 ||
+      getsockname(upstream_fd, &client_addr.addr.sa, &client_addr.size) == -1)
+    return 1;
+  snprintf(upstream_uri, sizeof(upstream_uri), "coap://127.0.0.1:%u",
+           coap_address_get_port(&client_addr));
+  if (coap_split_uri((const uint8_t *)upstream_uri, strlen(upstream_uri),
+                     &server.uri) < 0)
+    return 1;
+  server_list.entry = &server;
+  server_list.entry_count = 1;
+  server_list.type = COAP_PROXY_FORWARD;
+
+  /* The clients, each with its session on the proxy */
+  memset(&packet, 0, sizeof(packet));
+  coap_address_init(&packet.addr_info.local);
+  coap_address_copy(&packet.addr_info.local, &ep->bind_addr);
+  coap_ticks(&now);
+  for (c = 0; c < T_PROXY_CLIENTS; c++) {
+    client_addr = addr;
+    clients[c].fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (clients[c].fd == COAP_INVALID_SOCKET ||
+        bind(clients[c].fd, &client_addr.addr.sa, client_addr.size) == -1 ||
+        getsockname(clients[c].fd, &client_addr.addr.sa,
+                    &client_addr.size) == -1)
+      return 1;
+    coap_address_copy(&packet.addr_info.remote, &client_addr);
+    coap_lock_lock(ctx, return 1);
+    clients[c].session = coap_endpoint_get_session(ep, &packet, now);
+    coap_lock_unlock(ctx);
+    if (!clients[c].session)
+      return 1;
+  }
+  return 0;
+}
+
+static int
+t_proxy_tests_remove(void) {
+  int c;
+
+  for (c = 0; c < T_PROXY_CLIENTS; c++) {
+    if (clients[c].fd != COAP_INVALID_SOCKET)
+      coap_closesocket(clients[c].fd);
+  }
+  if (upstream_fd != COAP_INVALID_SOCKET)
+    coap_closesocket(upstream_fd);
+  coap_free_context(ctx);
+  return 0;
+}
+
+CU_pSuite
+t_init_proxy_tests(void) {
+  CU_pSuite suite;
+
+  suite = CU_add_suite("proxy", t_proxy_tests_create, t_proxy_tests_remove);
+  if (!suite) {                        /* signal error */
+    fprintf(stderr, "W: cannot add proxy test suite (%s)\n",
+            CU_get_error_msg());
+
+    return NULL;
+  }
+
+#define PROXY_TEST(s,t)                                                \
+  if (!CU_ADD_TEST(s,t)) {                                              \
+    fprintf(stderr, "W: cannot add proxy test (%s)\n",                \
+            CU_get_error_msg());                                      \
+  }
+
+  PROXY_TEST(suite, t_proxy1);
+  PROXY_TEST(suite, t_proxy2);
+  PROXY_TEST(suite, t_proxy3);
+
+  return suite;
+}
+#endif /* COAP_PROXY_SUPPORT && COAP_SERVER_SUPPORT && COAP_CLIENT_SUPPORT */
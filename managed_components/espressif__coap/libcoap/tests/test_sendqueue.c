@@ -33,84 +33,103 @@ static coap_tick_t timestamp[] = {
 /* nodes for testing. node[0] is left empty */
 coap_queue_t *node[5];
 
-static coap_tick_t
-add_timestamps(coap_queue_t *queue, size_t num) {
-  coap_tick_t t = 0;
-  while (queue && num--) {
-    t += queue->t;
-    queue = queue->next;
+/* Pops all entries from the sendqueue into order (up to max entries) and
+ * re-inserts them, returning the number of entries found. */
+static size_t
+sendqueue_order(coap_queue_t **order, size_t max) {
+  size_t n = 0, i;
+  coap_queue_t *q;
+
+  while ((q = coap_pop_next(ctx)) != NULL) {
+    if (n < max)
+      order[n] = q;
+    n++;
   }
-
-  return t;
+  for (i = 0; i < n && i < max; i++) {
+    coap_insert_node(ctx, order[i]);
+  }
+  return n;
 }
 
 static void
 t_sendqueue1(void) {
-  int result = coap_insert_node(&ctx->sendqueue, node[1]);
+  int result = coap_insert_node(ctx, node[1]);
 
   CU_ASSERT(result > 0);
   ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue);
   CU_ASSERT_PTR_EQUAL(ctx->sendqueue, node[1]);
   CU_ASSERT(node[1]->t == timestamp[1]);
+
+  /* A node cannot be added twice */
+  result = coap_insert_node(ctx, node[1]);
+  CU_ASSERT(result == 0);
 }
 
 static void
 t_sendqueue2(void) {
   int result;
+  coap_queue_t *order[4];
 
-  result = coap_insert_node(&ctx->sendqueue, node[2]);
+  result = coap_insert_node(ctx, node[2]);
 
   CU_ASSERT(result > 0);
   CU_ASSERT_PTR_EQUAL(ctx->sendqueue, node[1]);
-  CU_ASSERT_PTR_EQUAL(ctx->sendqueue->next, node[2]);
+
+  CU_ASSERT(sendqueue_order(order, 4) == 2);
+  CU_ASSERT_PTR_EQUAL(order[0], node[1]);
+  CU_ASSERT_PTR_EQUAL(order[1], node[2]);
 
   CU_ASSERT(ctx->sendqueue->t == timestamp[1]);
-  CU_ASSERT(node[2]->t == timestamp[2] - timestamp[1]);
+  CU_ASSERT(node[2]->t == timestamp[2]);
 }
 
 /* insert new node as first element in queue */
 static void
 t_sendqueue3(void) {
   int result;
-  result = coap_insert_node(&ctx->sendqueue, node[3]);
+  coap_queue_t *order[4];
+
+  result = coap_insert_node(ctx, node[3]);
 
   CU_ASSERT(result > 0);
 
   CU_ASSERT_PTR_EQUAL(ctx->sendqueue, node[3]);
   CU_ASSERT(node[3]->t == timestamp[3]);
 
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next);
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next->next);
+  CU_ASSERT(sendqueue_order(order, 4) == 3);
+  CU_ASSERT_PTR_EQUAL(order[0], node[3]);
+  CU_ASSERT_PTR_EQUAL(order[1], node[1]);
+  CU_ASSERT_PTR_EQUAL(order[2], node[2]);
 
-  CU_ASSERT(ctx->sendqueue->next->t == timestamp[1] - timestamp[3]);
-  CU_ASSERT(ctx->sendqueue->next->next->t == timestamp[2] - timestamp[1]);
+  CU_ASSERT(node[1]->t == timestamp[1]);
+  CU_ASSERT(node[2]->t == timestamp[2]);
 }
 
-/* insert new node as fourth element in queue */
+/* insert new node as third element in queue */
 static void
 t_sendqueue4(void) {
   int result;
+  coap_queue_t *order[4];
 
-  result = coap_insert_node(&ctx->sendqueue, node[4]);
+  result = coap_insert_node(ctx, node[4]);
 
   CU_ASSERT(result > 0);
 
   CU_ASSERT_PTR_EQUAL(ctx->sendqueue, node[3]);
 
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next);
-  CU_ASSERT_PTR_EQUAL(ctx->sendqueue->next, node[1]);
+  CU_ASSERT(sendqueue_order(order, 4) == 4);
+  CU_ASSERT_PTR_EQUAL(order[0], node[3]);
+  CU_ASSERT_PTR_EQUAL(order[1], node[1]);
+  CU_ASSERT_PTR_EQUAL(order[2], node[4]);
+  CU_ASSERT_PTR_EQUAL(order[3], node[2]);
 
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next->next);
-  CU_ASSERT_PTR_EQUAL(ctx->sendqueue->next->next, node[4]);
-
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next->next->next);
-  CU_ASSERT_PTR_EQUAL(ctx->sendqueue->next->next->next, node[2]);
+  CU_ASSERT(node[3]->t == timestamp[3]);
+  CU_ASSERT(node[1]->t == timestamp[1]);
+  CU_ASSERT(node[4]->t == timestamp[4]);
+  CU_ASSERT(node[2]->t == timestamp[2]);
 
-  CU_ASSERT(ctx->sendqueue->next->t == timestamp[1] - timestamp[3]);
-  CU_ASSERT(add_timestamps(ctx->sendqueue, 1) == timestamp[3]);
-  CU_ASSERT(add_timestamps(ctx->sendqueue, 2) == timestamp[1]);
-  CU_ASSERT(add_timestamps(ctx->sendqueue, 3) == timestamp[4]);
-  CU_ASSERT(add_timestamps(ctx->sendqueue, 4) == timestamp[2]);
+  /* The session keeps track of its entries in the sendqueue */
+  CU_ASSERT_PTR_EQUAL(session->sendqueue, node[3]);
 }
 
 static void
@@ -121,13 +140,12 @@ t_sendqueue5(void) {
 
   /* space for saving the current node timestamps */
   static coap_tick_t times[sizeof(timestamp)/sizeof(coap_tick_t)];
-  coap_queue_t *p;
-  int i;
+  size_t i;
 
-  /* save timestamps of nodes in the sendqueue in their actual order */
+  /* save timestamps of nodes in the sendqueue */
   memset(times, 0, sizeof(times));
-  for (p = ctx->sendqueue, i = 0; p; p = p->next, i++) {
-    times[i] = p->t;
+  for (i = 1; i < sizeof(node)/sizeof(coap_queue_t *); i++) {
+    times[i] = node[i]->t;
   }
 
   coap_ticks(&now);
@@ -140,6 +158,7 @@ t_sendqueue5(void) {
   ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue);
   CU_ASSERT(ctx->sendqueue_basetime == now);
   CU_ASSERT(ctx->sendqueue->t == timestamp[3] + delta1);
+  CU_ASSERT(node[2]->t == timestamp[2] + delta1);
 
   now += delta2;
   result = coap_adjust_basetime(ctx, now);
@@ -148,15 +167,14 @@ t_sendqueue5(void) {
   ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue);
   CU_ASSERT(ctx->sendqueue->t == 0);
 
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next);
-  CU_ASSERT(ctx->sendqueue->next->t == 0);
-
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next->next);
-  CU_ASSERT(ctx->sendqueue->next->next->t == delta2 - delta1 - timestamp[1]);
+  CU_ASSERT(node[3]->t == 0);
+  CU_ASSERT(node[1]->t == 0);
+  CU_ASSERT(node[4]->t == timestamp[4] + delta1 - delta2);
+  CU_ASSERT(node[2]->t == timestamp[2] + delta1 - delta2);
 
   /* restore timestamps of nodes in the sendqueue */
-  for (p = ctx->sendqueue, i = 0; p; p = p->next, i++) {
-    p->t = times[i];
+  for (i = 1; i < sizeof(node)/sizeof(coap_queue_t *); i++) {
+    node[i]->t = times[i];
   }
 }
 
@@ -167,17 +185,6 @@ t_sendqueue6(void) {
   const coap_tick_diff_t delta = 20;
   coap_queue_t *tmpqueue = ctx->sendqueue;
 
-  /* space for saving the current node timestamps */
-  static coap_tick_t times[sizeof(timestamp)/sizeof(coap_tick_t)];
-  coap_queue_t *p;
-  int i;
-
-  /* save timestamps of nodes in the sendqueue in their actual order */
-  memset(times, 0, sizeof(times));
-  for (p = ctx->sendqueue, i = 0; p; p = p->next, i++) {
-    times[i] = p->t;
-  }
-
   coap_ticks(&now);
   ctx->sendqueue = NULL;
   ctx->sendqueue_basetime = now;
@@ -199,27 +206,30 @@ t_sendqueue7(void) {
   ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue);
   CU_ASSERT_PTR_EQUAL(ctx->sendqueue, node[3]);
 
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next);
-  CU_ASSERT_PTR_EQUAL(ctx->sendqueue->next, node[1]);
-
-  result = coap_remove_from_queue(&ctx->sendqueue, session, 3, &tmp_node);
+  result = coap_remove_from_queue(ctx, session, 3, &tmp_node);
 
   CU_ASSERT(result == 1);
   ReturnIf_CU_ASSERT_PTR_NOT_NULL(tmp_node);
   CU_ASSERT_PTR_EQUAL(tmp_node, node[3]);
+  CU_ASSERT(tmp_node->in_sendqueue == 0);
 
   ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue);
   CU_ASSERT_PTR_EQUAL(ctx->sendqueue, node[1]);
 
   CU_ASSERT(ctx->sendqueue->t == timestamp[1]);
+
+  /* Not in the queue any more */
+  result = coap_remove_from_queue(ctx, session, 3, &tmp_node);
+  CU_ASSERT(result == 0);
 }
 
 static void
 t_sendqueue8(void) {
   int result;
   coap_queue_t *tmp_node;
+  coap_queue_t *order[4];
 
-  result = coap_remove_from_queue(&ctx->sendqueue, session, 4, &tmp_node);
+  result = coap_remove_from_queue(ctx, session, 4, &tmp_node);
 
   CU_ASSERT(result == 1);
   ReturnIf_CU_ASSERT_PTR_NOT_NULL(tmp_node);
@@ -229,11 +239,10 @@ t_sendqueue8(void) {
   CU_ASSERT_PTR_EQUAL(ctx->sendqueue, node[1]);
   CU_ASSERT(ctx->sendqueue->t == timestamp[1]);
 
-  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ctx->sendqueue->next);
-  CU_ASSERT_PTR_EQUAL(ctx->sendqueue->next, node[2]);
-  CU_ASSERT(ctx->sendqueue->next->t == timestamp[2] - timestamp[1]);
-
-  CU_ASSERT_PTR_NULL(ctx->sendqueue->next->next);
+  CU_ASSERT(sendqueue_order(order, 4) == 2);
+  CU_ASSERT_PTR_EQUAL(order[0], node[1]);
+  CU_ASSERT_PTR_EQUAL(order[1], node[2]);
+  CU_ASSERT(node[2]->t == timestamp[2]);
 }
 
 static void
@@ -256,7 +265,8 @@ t_sendqueue9(void) {
   CU_ASSERT(tmp_node->t == timestamp[1]);
   CU_ASSERT(ctx->sendqueue->t == timestamp[2]);
 
-  CU_ASSERT_PTR_NULL(ctx->sendqueue->next);
+  CU_ASSERT_PTR_NULL(ctx->sendqueue->h_child);
+  CU_ASSERT_PTR_EQUAL(session->sendqueue, node[2]);
 }
 
 static int t_sendqueue_tests_remove(void);
@@ -271,10 +281,104 @@ t_sendqueue10(void) {
   CU_ASSERT_PTR_EQUAL(tmp_node, node[2]);
 
   CU_ASSERT_PTR_NULL(ctx->sendqueue);
+  CU_ASSERT_PTR_NULL(session->sendqueue);
 
   CU_ASSERT(tmp_node->t == timestamp[2]);
 }
 
+#define SENDQUEUE_STRESS_COUNT 1000
+
+static coap_queue_t *
+new_test_node(coap_session_t *s, coap_mid_t id, coap_tick_t t) {
+  coap_queue_t *q = coap_new_node();
+
+  if (!q)
+    return NULL;
+  q->id = id;
+  q->t = t;
+  q->pdu = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_CODE_GET, id, 0);
+  q->session = coap_session_reference(s);
+  return q;
+}
+
+/* many entries, removal of arbitrary entries and ordered pop */
+static void
+t_sendqueue11(void) {
+  coap_queue_t *q, *tmp_node;
+  coap_tick_t last = 0;
+  size_t i, count = 0;
+  uint32_t r = 1;
+  int result;
+
+  for (i = 0; i < SENDQUEUE_STRESS_COUNT; i++) {
+    r = r * 1103515245 + 12345;
+    q = new_test_node(session, (coap_mid_t)(100 + i), (r >> 8) % 500);
+    ReturnIf_CU_ASSERT_PTR_NOT_NULL(q);
+    CU_ASSERT(coap_insert_node(ctx, q) == 1);
+  }
+
+  /* remove every third entry, wherever it is in the queue */
+  for (i = 0; i < SENDQUEUE_STRESS_COUNT; i += 3) {
+    result = coap_remove_from_queue(ctx, session, (coap_mid_t)(100 + i),
+                                    &tmp_node);
+    CU_ASSERT(result == 1);
+    if (result)
+      coap_delete_node(tmp_node);
+  }
+
+  while ((q = coap_pop_next(ctx)) != NULL) {
+    CU_ASSERT(q->t >= last);
+    CU_ASSERT((q->id - 100) % 3 != 0);
+    last = q->t;
+    count++;
+    coap_delete_node(q);
+  }
+  CU_ASSERT(count == SENDQUEUE_STRESS_COUNT - (SENDQUEUE_STRESS_COUNT + 2) / 3);
+  CU_ASSERT_PTR_NULL(session->sendqueue);
+}
+
+/* cancel all entries of one session, leaving the other session alone */
+static void
+t_sendqueue12(void) {
+  coap_session_t *session2;
+  coap_address_t addr;
+  coap_queue_t *q;
+  size_t i, count = 0;
+
+  coap_address_init(&addr);
+  addr.size = sizeof(struct sockaddr_in6);
+  addr.addr.sin6.sin6_family = AF_INET6;
+  addr.addr.sin6.sin6_addr = in6addr_loopback;
+  addr.addr.sin6.sin6_port = htons(COAP_DEFAULT_PORT + 1);
+  session2 = coap_new_client_session(ctx, NULL, &addr, COAP_PROTO_UDP);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(session2);
+
+  for (i = 0; i < 20; i++) {
+    q = new_test_node(i % 2 ? session2 : session, (coap_mid_t)(200 + i),
+                      (coap_tick_t)(20 - i));
+    if (!q)
+      break;
+    coap_insert_node(ctx, q);
+  }
+  CU_ASSERT(i == 20);
+
+  coap_lock_lock(ctx, return);
+  coap_cancel_session_messages(ctx, session, COAP_NACK_NOT_DELIVERABLE);
+  coap_lock_unlock(ctx);
+  CU_ASSERT_PTR_NULL(session->sendqueue);
+  CU_ASSERT_PTR_NOT_NULL(session2->sendqueue);
+
+  while ((q = coap_pop_next(ctx)) != NULL) {
+    CU_ASSERT_PTR_EQUAL(q->session, session2);
+    count++;
+    coap_delete_node(q);
+  }
+  CU_ASSERT(count == 10);
+  CU_ASSERT_PTR_NULL(session2->sendqueue);
+
+  coap_session_release(session2);
+}
+
 /* This function creates a set of nodes for testing. These nodes
  * will exist for all tests and are modified by coap_insert_node()
  * and coap_remove_from_queue().
@@ -360,6 +464,8 @@ t_init_sendqueue_tests(void) {
   SENDQUEUE_TEST(suite, t_sendqueue8);
   SENDQUEUE_TEST(suite, t_sendqueue9);
   SENDQUEUE_TEST(suite, t_sendqueue10);
+  SENDQUEUE_TEST(suite, t_sendqueue11);
+  SENDQUEUE_TEST(suite, t_sendqueue12);
 
   return suite;
 }
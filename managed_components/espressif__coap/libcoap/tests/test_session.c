@@ -13,6 +13,7 @@
 
 #if COAP_CLIENT_SUPPORT
 #include <stdio.h>
+#include <unistd.h>
 
 /* The error threshold for timeout calculations. The precision of
  * coap_calc_timeout() is assumed to be sufficient if the resulting
@@ -169,6 +170,243 @@ t_session6(void) {
   coap_session_release(session);
 }
 
+#if COAP_SERVER_SUPPORT
+/* Test 7 feeds packets from a large number of (spoofed) source addresses
+ * to the endpoint and checks that the number of unused server sessions
+ * stays bounded by max_idle_sessions, the oldest being evicted first. */
+#define T7_MAX_IDLE 50
+#define T7_NUM_SOURCES 100000
+
+static void
+t_session7(void) {
+  coap_endpoint_t *ep = ctx->endpoint;
+  coap_packet_t packet;
+  coap_session_t *s;
+  coap_session_t *last = NULL;
+  coap_tick_t now;
+  unsigned int count;
+  unsigned int i;
+
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ep);
+  coap_context_set_max_idle_sessions(ctx, T7_MAX_IDLE);
+  coap_ticks(&now);
+
+  memset(&packet, 0, sizeof(packet));
+  coap_address_init(&packet.addr_info.local);
+  coap_address_copy(&packet.addr_info.local, &ep->bind_addr);
+  coap_address_init(&packet.addr_info.remote);
+  packet.addr_info.remote.size = sizeof(struct sockaddr_in6);
+  packet.addr_info.remote.addr.sin6.sin6_family = AF_INET6;
+
+  coap_lock_lock(ctx, return);
+  for (i = 0; i < T7_NUM_SOURCES; i++) {
+    uint8_t *a = packet.addr_info.remote.addr.sin6.sin6_addr.s6_addr;
+
+    a[0] = 0x20;
+    a[1] = 0x01;
+    a[12] = (uint8_t)(i >> 24);
+    a[13] = (uint8_t)(i >> 16);
+    a[14] = (uint8_t)(i >> 8);
+    a[15] = (uint8_t)i;
+    packet.addr_info.remote.addr.sin6.sin6_port = htons(1024 + (i % 1000));
+
+    s = coap_endpoint_get_session(ep, &packet, now + i);
+    if (!s) {
+      CU_FAIL("no session returned");
+      break;
+    }
+    last = s;
+    if (ep->num_idle > T7_MAX_IDLE) {
+      CU_FAIL("too many idle sessions");
+      break;
+    }
+  }
+  CU_ASSERT(i == T7_NUM_SOURCES);
+  CU_ASSERT(ep->num_idle == T7_MAX_IDLE);
+  CU_ASSERT(HASH_COUNT(ep->sessions) == T7_MAX_IDLE);
+
+  /* A repeat packet from a known source moves it to the end of the LRU */
+  count = 0;
+  LL_FOREACH2(ep->idle_lru, s, idle_next) {
+    count++;
+  }
+  CU_ASSERT(count == T7_MAX_IDLE);
+  CU_ASSERT(ep->idle_lru->idle_prev == last);
+  s = ep->idle_lru;
+  coap_address_copy(&packet.addr_info.remote, &s->addr_info.remote);
+  CU_ASSERT(coap_endpoint_get_session(ep, &packet, now + i) == s);
+  CU_ASSERT(ep->idle_lru != s);
+  CU_ASSERT(ep->idle_lru->idle_prev == s);
+
+  /* A referenced session is no longer a candidate for eviction */
+  coap_session_reference_lkd(s);
+  CU_ASSERT(ep->num_idle == T7_MAX_IDLE - 1);
+  coap_session_release_lkd(s);
+  CU_ASSERT(ep->num_idle == T7_MAX_IDLE);
+
+  SESSIONS_ITER_SAFE(ep->sessions, s, last) {
+    coap_session_free(s);
+  }
+  CU_ASSERT_PTR_NULL(ep->idle_lru);
+  CU_ASSERT(ep->num_idle == 0);
+  coap_lock_unlock(ctx);
+  coap_context_set_max_idle_sessions(ctx, 0);
+}
+
+#if COAP_REUSEPORT_SUPPORT
+/* Test 8 binds two sharded contexts to the same port with address steering
+ * and checks that requests from several ports of the same client address
+ * are all handled by the same shard. */
+#define T8_NUM_CLIENTS 8
+
+static void
+t8_hnd_get(coap_resource_t *resource COAP_UNUSED,
+           coap_session_t *s,
+           const coap_pdu_t *request COAP_UNUSED,
+           const coap_string_t *query COAP_UNUSED,
+           coap_pdu_t *response) {
+  unsigned int *count;
+
+  count = coap_context_get_app_data(coap_session_get_context(s));
+  (*count)++;
+  coap_pdu_set_code(response, COAP_RESPONSE_CODE_CONTENT);
+}
+
+static void
+t_session8(void) {
+  static const uint8_t get[] = { 0x41, 0x01, 0x12, 0x34, 0x01, 0xb1, 't' };
+  coap_context_t *shard[2] = { NULL, NULL };
+  unsigned int count[2] = { 0, 0 };
+  int fd[T8_NUM_CLIENTS];
+  coap_address_t addr;
+  coap_endpoint_t *ep;
+  unsigned int i;
+  int loops;
+
+  for (i = 0; i < T8_NUM_CLIENTS; i++)
+    fd[i] = -1;
+  coap_address_init(&addr);
+  addr.size = sizeof(struct sockaddr_in);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  for (i = 0; i < 2; i++) {
+    coap_resource_t *r;
+
+    shard[i] = coap_new_context(NULL);
+    ReturnIf_CU_ASSERT_PTR_NOT_NULL(shard[i]);
+    if (!coap_context_set_shards(shard[i], 2, COAP_SHARD_STEER_ADDR)) {
+      /* No classic BPF support */
+      goto finish;
+    }
+    CU_ASSERT(coap_context_get_shards(shard[i]) == 2);
+    coap_context_set_app_data(shard[i], &count[i]);
+    r = coap_resource_init(coap_make_str_const("t"), 0);
+    coap_register_handler(r, COAP_REQUEST_GET, t8_hnd_get);
+    coap_add_resource(shard[i], r);
+    /* The second shard binds to the port picked for the first one */
+    ep = coap_new_endpoint(shard[i], &addr, COAP_PROTO_UDP);
+    CU_ASSERT_PTR_NOT_NULL(ep);
+    if (!ep)
+      goto finish;
+    addr.addr.sin.sin_port = ep->bind_addr.addr.sin.sin_port;
+  }
+
+  for (i = 0; i < T8_NUM_CLIENTS; i++) {
+    fd[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    CU_ASSERT(fd[i] != -1);
+    if (fd[i] == -1 ||
+        connect(fd[i], &addr.addr.sa, addr.size) == -1 ||
+        send(fd[i], get, sizeof(get), 0) != (ssize_t)sizeof(get)) {
+      CU_FAIL("client socket");
+      goto finish;
+    }
+  }
+
+  for (loops = 0; loops < 100 && count[0] + count[1] < T8_NUM_CLIENTS;
+       loops++) {
+    coap_io_process(shard[0], 10);
+    coap_io_process(shard[1], 10);
+  }
+  CU_ASSERT(count[0] + count[1] == T8_NUM_CLIENTS);
+  CU_ASSERT(count[0] == 0 || count[1] == 0);
+
+finish:
+  for (i = 0; i < T8_NUM_CLIENTS; i++) {
+    if (fd[i] != -1)
+      close(fd[i]);
+  }
+  coap_free_context(shard[0]);
+  coap_free_context(shard[1]);
+}
+#endif /* COAP_REUSEPORT_SUPPORT */
+
+/* Test 9 lets the session timeout of an unused server session pass and
+ * checks that coap_io_prepare_io_lkd() releases the session and drops it
+ * from the session timers. Run under ASan or valgrind, this also shows
+ * that the freed session is not read afterwards. */
+static int t9_deleted;
+
+static int
+t9_event_handler(coap_session_t *s COAP_UNUSED, const coap_event_t event) {
+  if (event == COAP_EVENT_SERVER_SESSION_DEL)
+    t9_deleted++;
+  return 0;
+}
+
+static void
+t_session9(void) {
+  coap_endpoint_t *ep = ctx->endpoint;
+  coap_socket_t *sockets[8];
+  unsigned int num_sockets;
+  coap_packet_t packet;
+  coap_session_t *s;
+  coap_tick_t now;
+
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(ep);
+  coap_context_set_session_timeout(ctx, 10);
+  coap_register_event_handler(ctx, t9_event_handler);
+  t9_deleted = 0;
+  coap_ticks(&now);
+
+  memset(&packet, 0, sizeof(packet));
+  coap_address_init(&packet.addr_info.local);
+  coap_address_copy(&packet.addr_info.local, &ep->bind_addr);
+  coap_address_init(&packet.addr_info.remote);
+  packet.addr_info.remote.size = sizeof(struct sockaddr_in6);
+  packet.addr_info.remote.addr.sin6.sin6_family = AF_INET6;
+  packet.addr_info.remote.addr.sin6.sin6_addr = in6addr_loopback;
+  packet.addr_info.remote.addr.sin6.sin6_port = htons(30000);
+
+  coap_lock_lock(ctx, return);
+  s = coap_endpoint_get_session(ep, &packet, now);
+  CU_ASSERT_PTR_NOT_NULL(s);
+  CU_ASSERT(HASH_COUNT(ep->sessions) == 1);
+
+  /* Not idle for long enough yet */
+  coap_io_prepare_io_lkd(ctx, sockets, 8, &num_sockets,
+                         now + 5 * COAP_TICKS_PER_SECOND);
+  CU_ASSERT(HASH_COUNT(ep->sessions) == 1);
+  CU_ASSERT(t9_deleted == 0);
+
+  /* Session timeout has passed */
+  coap_io_prepare_io_lkd(ctx, sockets, 8, &num_sockets,
+                         now + 11 * COAP_TICKS_PER_SECOND);
+  CU_ASSERT(HASH_COUNT(ep->sessions) == 0);
+  CU_ASSERT(t9_deleted == 1);
+  CU_ASSERT_PTR_NULL(ctx->session_timers);
+  CU_ASSERT_PTR_NULL(ctx->sessions_due);
+
+  /* A later pass must not find the released session */
+  coap_io_prepare_io_lkd(ctx, sockets, 8, &num_sockets,
+                         now + 20 * COAP_TICKS_PER_SECOND);
+  CU_ASSERT(t9_deleted == 1);
+  coap_lock_unlock(ctx);
+  coap_register_event_handler(ctx, NULL);
+  coap_context_set_session_timeout(ctx, 0);
+}
+#endif /* COAP_SERVER_SUPPORT */
+
 /* This function creates a set of nodes for testing. These nodes
  * will exist for all tests and are modified by coap_insert_node()
  * and coap_remove_from_queue().
@@ -224,6 +462,13 @@ t_init_session_tests(void) {
   SESSION_TEST(suite, t_session4);
   SESSION_TEST(suite, t_session5);
   SESSION_TEST(suite, t_session6);
+#if COAP_SERVER_SUPPORT
+  SESSION_TEST(suite, t_session7);
+#if COAP_REUSEPORT_SUPPORT
+  SESSION_TEST(suite, t_session8);
+#endif /* COAP_REUSEPORT_SUPPORT */
+  SESSION_TEST(suite, t_session9);
+#endif /* COAP_SERVER_SUPPORT */
 
   return suite;
 }
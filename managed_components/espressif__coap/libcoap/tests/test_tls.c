@@ -110,6 +110,148 @@ t_tls2(void) {
   CU_ASSERT(version.type == v->type);
 }
 
+#if defined(HAVE_DTLS) && COAP_SERVER_SUPPORT && COAP_CLIENT_SUPPORT
+static unsigned int t_resumed_events;
+
+static int
+t_resume_event_handler(coap_session_t *session COAP_UNUSED,
+                       const coap_event_t event) {
+  if (event == COAP_EVENT_DTLS_RESUMED)
+    t_resumed_events++;
+  return 0;
+}
+
+static const coap_dtls_cpsk_info_t *
+t_resume_ih_handler(coap_str_const_t *hint COAP_UNUSED,
+                    coap_session_t *session COAP_UNUSED, void *arg) {
+  return (const coap_dtls_cpsk_info_t *)arg;
+}
+
+/*
+ * Connect a client to a server over loopback twice, checking that the
+ * second (D)TLS handshake resumes the session from the first. Without
+ * resumption support (TinyDTLS), both handshakes must be full ones.
+ * A third connection with the wrong key must not resume the held session,
+ * but do a full handshake that fails.
+ */
+static void
+t_resume(coap_proto_t proto) {
+  static const uint8_t key[] = "secretPSK";
+  static const uint8_t bad_key[] = "secretBAD";
+  coap_context_t *server = NULL;
+  coap_context_t *client = NULL;
+  coap_dtls_spsk_t spsk;
+  coap_dtls_cpsk_t cpsk;
+  coap_address_t addr;
+  coap_endpoint_t *ep;
+  uint64_t full, resumed;
+  int supported;
+  int i;
+
+  if (proto == COAP_PROTO_TLS && !coap_tls_is_supported())
+    return;
+
+  server = coap_new_context(NULL);
+  client = coap_new_context(NULL);
+  if (!server || !client) {
+    CU_FAIL("coap_new_context");
+    goto finish;
+  }
+  supported = coap_get_tls_library_version()->type != COAP_TLS_LIBRARY_TINYDTLS;
+  CU_ASSERT(coap_context_set_session_resumption(server, 4, 0) == supported);
+  CU_ASSERT(coap_context_set_session_resumption(client, 4, 0) == supported);
+  coap_register_event_handler(server, t_resume_event_handler);
+  coap_register_event_handler(client, t_resume_event_handler);
+  t_resumed_events = 0;
+
+  memset(&spsk, 0, sizeof(spsk));
+  spsk.version = COAP_DTLS_SPSK_SETUP_VERSION;
+  spsk.psk_info.key.s = key;
+  spsk.psk_info.key.length = sizeof(key) - 1;
+  CU_ASSERT(coap_context_set_psk2(server, &spsk) == 1);
+
+  coap_address_init(&addr);
+  addr.size = sizeof(struct sockaddr_in);
+  addr.addr.sin.sin_family = AF_INET;
+  addr.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ep = coap_new_endpoint(server, &addr, proto);
+  if (!ep) {
+    CU_FAIL("coap_new_endpoint");
+    goto finish;
+  }
+  addr.addr.sin.sin_port = ep->bind_addr.addr.sin.sin_port;
+
+  memset(&cpsk, 0, sizeof(cpsk));
+  cpsk.version = COAP_DTLS_CPSK_SETUP_VERSION;
+  cpsk.psk_info.identity.s = (const uint8_t *)"client";
+  cpsk.psk_info.identity.length = 6;
+  cpsk.psk_info.key.s = key;
+  cpsk.psk_info.key.length = sizeof(key) - 1;
+  /*
+   * Restricts the client to (D)TLS1.2, as not all (D)TLS libraries can
+   * resume a TLS1.3 session using PSK
+   */
+  cpsk.validate_ih_call_back = t_resume_ih_handler;
+  cpsk.ih_call_back_arg = &cpsk.psk_info;
+
+  for (i = 0; i < 3; i++) {
+    coap_session_t *session;
+    int loops;
+
+    if (i == 2) {
+      cpsk.psk_info.key.s = bad_key;
+      cpsk.psk_info.key.length = sizeof(bad_key) - 1;
+    }
+    session = coap_new_client_session_psk2(client, NULL, &addr, proto, &cpsk);
+    if (!session) {
+      CU_FAIL("coap_new_client_session_psk2");
+      goto finish;
+    }
+    for (loops = 0; loops < 100 &&
+         coap_session_get_state(session) != COAP_SESSION_STATE_ESTABLISHED &&
+         coap_session_get_state(session) != COAP_SESSION_STATE_NONE;
+         loops++) {
+      coap_io_process(client, 10);
+      coap_io_process(server, 10);
+    }
+    if (i < 2) {
+      CU_ASSERT(coap_session_get_state(session) == COAP_SESSION_STATE_ESTABLISHED);
+    } else {
+      CU_ASSERT(coap_session_get_state(session) != COAP_SESSION_STATE_ESTABLISHED);
+    }
+    /* Let any post-handshake messages (such as TLS1.3 tickets) through */
+    for (loops = 0; loops < 5; loops++) {
+      coap_io_process(server, 10);
+      coap_io_process(client, 10);
+    }
+    coap_session_release(session);
+    coap_io_process(server, 10);
+  }
+
+  coap_context_get_handshake_stats(client, &full, &resumed);
+  CU_ASSERT(full == (supported ? 1 : 2));
+  CU_ASSERT(resumed == (supported ? 1 : 0));
+  coap_context_get_handshake_stats(server, &full, &resumed);
+  CU_ASSERT(full == (supported ? 1 : 2));
+  CU_ASSERT(resumed == (supported ? 1 : 0));
+  CU_ASSERT(t_resumed_events == (supported ? 2U : 0U));
+
+finish:
+  coap_free_context(client);
+  coap_free_context(server);
+}
+
+static void
+t_tls3(void) {
+  t_resume(COAP_PROTO_DTLS);
+}
+
+static void
+t_tls4(void) {
+  t_resume(COAP_PROTO_TLS);
+}
+#endif /* HAVE_DTLS && COAP_SERVER_SUPPORT && COAP_CLIENT_SUPPORT */
+
 static int
 t_tls_tests_create(void) {
   coap_startup();
@@ -136,6 +278,10 @@ t_init_tls_tests(void) {
 
   TLS_TEST(suite, t_tls1);
   TLS_TEST(suite, t_tls2);
+#if defined(HAVE_DTLS) && COAP_SERVER_SUPPORT && COAP_CLIENT_SUPPORT
+  TLS_TEST(suite, t_tls3);
+  TLS_TEST(suite, t_tls4);
+#endif /* HAVE_DTLS && COAP_SERVER_SUPPORT && COAP_CLIENT_SUPPORT */
 
   return suite;
 }
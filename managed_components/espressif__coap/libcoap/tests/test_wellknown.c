@@ -191,6 +191,94 @@ t_wellknown4(void) {
   coap_delete_string(query);
 }
 
+/* Test 5 checks that {param} and prefix resources are found by the router
+ * and that the path parameters can be read back from the request. */
+static coap_resource_t *
+t_wellknown5_route(const char *path) {
+  coap_str_const_t uri_path = { strlen(path), (const uint8_t *)path };
+  coap_resource_t *r;
+
+  coap_lock_lock(ctx, return NULL);
+  r = coap_resource_route_lkd(ctx, &uri_path);
+  coap_lock_unlock(ctx);
+  return r;
+}
+
+static void
+t_wellknown5(void) {
+  coap_resource_t *value, *raw, *fixed, *files, *deep;
+  coap_str_const_t param;
+  coap_pdu_t *request;
+  static const char *const segment[] = { "sensors", "42", "value" };
+  size_t i;
+
+  value = coap_resource_init(coap_make_str_const("sensors/{id}/value"), 0);
+  raw = coap_resource_init(coap_make_str_const("sensors/{id}/raw"), 0);
+  fixed = coap_resource_init(coap_make_str_const("sensors/all/{field}"), 0);
+  files = coap_resource_init(coap_make_str_const("files"),
+                             COAP_RESOURCE_FLAGS_URI_PREFIX);
+  deep = coap_resource_init(coap_make_str_const("files/img"),
+                            COAP_RESOURCE_FLAGS_URI_PREFIX);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(value);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(raw);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(fixed);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(files);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(deep);
+  coap_add_resource(ctx, value);
+  coap_add_resource(ctx, raw);
+  coap_add_resource(ctx, fixed);
+  coap_add_resource(ctx, files);
+  coap_add_resource(ctx, deep);
+
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("sensors/42/value"), value);
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("sensors/42/raw"), raw);
+  /* A static segment takes precedence over a parameter */
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("sensors/all/value"), fixed);
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("sensors/all/raw"), fixed);
+  CU_ASSERT_PTR_NULL(t_wellknown5_route("sensors/42"));
+  CU_ASSERT_PTR_NULL(t_wellknown5_route("sensors//value"));
+  CU_ASSERT_PTR_NULL(t_wellknown5_route("sensors/42/value/x"));
+  /* A template does not match its own literal path */
+  CU_ASSERT_PTR_NULL(t_wellknown5_route("sensors/{id}/value"));
+  CU_ASSERT(value->is_template && fixed->is_template && !files->is_template);
+
+  /* The longest prefix wins, and only at a segment boundary */
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("files"), files);
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("files/a/b"), files);
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("files/img/logo.png"), deep);
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("files/imgx"), files);
+  CU_ASSERT_PTR_NULL(t_wellknown5_route("filesx"));
+
+  request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_CODE_GET, 0x1234,
+                          TEST_PDU_SIZE);
+  ReturnIf_CU_ASSERT_PTR_NOT_NULL(request);
+  for (i = 0; i < sizeof(segment) / sizeof(segment[0]); i++) {
+    coap_add_option(request, COAP_OPTION_URI_PATH, strlen(segment[i]),
+                    (const uint8_t *)segment[i]);
+  }
+  CU_ASSERT(coap_resource_get_uri_param(value, request, "id", &param) == 1);
+  CU_ASSERT(param.length == 2 && memcmp(param.s, "42", 2) == 0);
+  CU_ASSERT(coap_resource_get_uri_param(value, request, "i", &param) == 0);
+  CU_ASSERT(coap_resource_get_uri_param(fixed, request, "field", &param) == 1);
+  CU_ASSERT(param.length == 5 && memcmp(param.s, "value", 5) == 0);
+  CU_ASSERT(coap_resource_get_uri_remainder(files, request, 0, &param) == 1);
+  CU_ASSERT(param.length == 2 && memcmp(param.s, "42", 2) == 0);
+  CU_ASSERT(coap_resource_get_uri_remainder(files, request, 1, &param) == 1);
+  CU_ASSERT(param.length == 5 && memcmp(param.s, "value", 5) == 0);
+  CU_ASSERT(coap_resource_get_uri_remainder(files, request, 2, &param) == 0);
+  coap_delete_pdu(request);
+
+  /* Deleting a resource removes it from the router */
+  coap_delete_resource(ctx, fixed);
+  coap_delete_resource(ctx, deep);
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("sensors/all/value"), value);
+  CU_ASSERT_PTR_EQUAL(t_wellknown5_route("files/img/logo.png"), files);
+  coap_delete_resource(ctx, value);
+  coap_delete_resource(ctx, raw);
+  coap_delete_resource(ctx, files);
+  CU_ASSERT_PTR_NULL(t_wellknown5_route("sensors/42/value"));
+  CU_ASSERT_PTR_NULL(t_wellknown5_route("files"));
+}
 
 static int
 t_wkc_tests_create(void) {
@@ -274,6 +362,7 @@ t_init_wellknown_tests(void) {
   WKC_TEST(suite, t_wellknown2);
   WKC_TEST(suite, t_wellknown3);
   WKC_TEST(suite, t_wellknown4);
+  WKC_TEST(suite, t_wellknown5);
 
   return suite;
 }
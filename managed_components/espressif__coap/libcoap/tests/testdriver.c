@@ -18,8 +18,12 @@
 #include "test_encode.h"
 #include "test_options.h"
 #include "test_pdu.h"
+#include "test_proxy.h"
 #include "test_error_response.h"
 #include "test_session.h"
+#include "test_observe.h"
+#include "test_block.h"
+#include "test_cache.h"
 #include "test_sendqueue.h"
 #include "test_wellknown.h"
 #include "test_tls.h"
@@ -49,6 +53,12 @@ main(int argc COAP_UNUSED, char **argv COAP_UNUSED) {
 #endif /* COAP_CLIENT_SUPPORT */
 #if COAP_SERVER_SUPPORT && COAP_CLIENT_SUPPORT
   t_init_wellknown_tests();
+  t_init_observe_tests();
+  t_init_block_tests();
+  t_init_cache_tests();
+#if COAP_PROXY_SUPPORT
+  t_init_proxy_tests();
+#endif /* COAP_PROXY_SUPPORT */
 #endif /* COAP_SERVER_SUPPORT && COAP_CLIENT_SUPPORT */
   t_init_tls_tests();
 #if COAP_OSCORE_SUPPORT && COAP_SERVER_SUPPORT
@@ -35,8 +35,6 @@
 
 #define HAVE_LIMITS_H
 
-#define COAP_RESOURCES_NOHASH
-
 /* Note: If neither of COAP_CLIENT_SUPPORT or COAP_SERVER_SUPPORT is set,
    then libcoap sets both for backward compatibility */
 #ifdef CONFIG_COAP_CLIENT_SUPPORT
@@ -124,6 +122,13 @@ struct sockaddr_in6 {
 #define COAP_THREAD_SAFE 0
 #endif /* ! CONFIG_COAP_THREAD_SAFE */
 
+#ifdef CONFIG_COAP_MEMORY_SLAB
+#define COAP_MEMORY_SLAB 1
+#define COAP_MEMORY_SLAB_ENABLE 1
+#else /* ! CONFIG_COAP_MEMORY_SLAB */
+#define COAP_MEMORY_SLAB 0
+#endif /* ! CONFIG_COAP_MEMORY_SLAB */
+
 #ifdef CONFIG_COAP_DEBUGGING
 #define COAP_MAX_LOGGING_LEVEL CONFIG_COAP_LOG_DEFAULT_LEVEL
 #else /* ! CONFIG_COAP_DEBUGGING */